@@ -74,8 +74,7 @@ void dummy_start_vcpu_thread(CPUState *cpu)
     qemu_cond_init(cpu->halt_cond);
     snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "CPU %d/DUMMY",
              cpu->cpu_index);
-    qemu_thread_create(cpu->thread, thread_name, dummy_cpu_thread_fn, cpu,
-                       QEMU_THREAD_JOINABLE);
+    qemu_vcpu_thread_create(cpu, thread_name, dummy_cpu_thread_fn);
 #ifdef _WIN32
     qemu_sem_init(&cpu->sem, 0);
 #endif
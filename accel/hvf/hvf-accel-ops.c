@@ -470,8 +470,7 @@ static void hvf_start_vcpu_thread(CPUState *cpu)
 
     snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "CPU %d/HVF",
              cpu->cpu_index);
-    qemu_thread_create(cpu->thread, thread_name, hvf_cpu_thread_fn,
-                       cpu, QEMU_THREAD_JOINABLE);
+    qemu_vcpu_thread_create(cpu, thread_name, hvf_cpu_thread_fn);
 }
 
 static int hvf_insert_breakpoint(CPUState *cpu, int type, vaddr addr, vaddr len)
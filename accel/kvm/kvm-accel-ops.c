@@ -72,8 +72,7 @@ static void kvm_start_vcpu_thread(CPUState *cpu)
     qemu_cond_init(cpu->halt_cond);
     snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "CPU %d/KVM",
              cpu->cpu_index);
-    qemu_thread_create(cpu->thread, thread_name, kvm_vcpu_thread_fn,
-                       cpu, QEMU_THREAD_JOINABLE);
+    qemu_vcpu_thread_create(cpu, thread_name, kvm_vcpu_thread_fn);
 }
 
 static bool kvm_vcpu_thread_is_idle(CPUState *cpu)
@@ -753,8 +753,9 @@ static uint64_t kvm_dirty_ring_reap_locked(KVMState *s, CPUState* cpu)
 }
 
 /*
- * Currently for simplicity, we must hold BQL before calling this.  We can
- * consider to drop the BQL if we're clear with all the race conditions.
+ * Reap the ring of @cpu, or of all vCPUs if @cpu is NULL.  Walking the vCPU
+ * list needs the BQL; reaping a single vCPU is only done from its own
+ * thread, which keeps its ring mapped, and only needs the slots lock.
  */
 static uint64_t kvm_dirty_ring_reap(KVMState *s, CPUState *cpu)
 {
@@ -1512,6 +1513,102 @@ static void kvm_region_del(MemoryListener *listener,
     QSIMPLEQ_INSERT_TAIL(&kml->transaction_del, update, next);
 }
 
+/*
+ * Check whether the memslots that kvm_set_phys_mem() would create for
+ * @section already exist with the same backing and flags.
+ *
+ * Called with KVMMemoryListener.slots_lock held
+ */
+static bool kvm_section_matches_slots(KVMMemoryListener *kml,
+                                      MemoryRegionSection *section)
+{
+    MemoryRegion *mr = section->mr;
+    hwaddr start_addr, size, slot_size, mr_offset;
+    ram_addr_t ram_start_offset;
+    KVMSlot *mem;
+    void *ram;
+
+    if (!memory_region_is_ram(mr)) {
+        return false;
+    }
+
+    size = kvm_align_section(section, &start_addr);
+    if (!size) {
+        return false;
+    }
+
+    mr_offset = section->offset_within_region + start_addr -
+        section->offset_within_address_space;
+    ram = memory_region_get_ram_ptr(mr) + mr_offset;
+    ram_start_offset = memory_region_get_ram_addr(mr) + mr_offset;
+
+    do {
+        slot_size = MIN(kvm_max_slot_size, size);
+        mem = kvm_lookup_matching_slot(kml, start_addr, slot_size);
+        if (!mem || mem->ram != ram ||
+            mem->ram_start_offset != ram_start_offset ||
+            mem->flags != kvm_mem_flags(mr)) {
+            return false;
+        }
+        start_addr += slot_size;
+        ram_start_offset += slot_size;
+        ram += slot_size;
+        size -= slot_size;
+    } while (size);
+
+    return true;
+}
+
+/*
+ * Drop pairs of updates that remove and re-add the very same memslots,
+ * e.g. when a FlatRange changed only in attributes KVM does not care about.
+ * Deleting and re-creating such slots is pure churn and, as the two
+ * overlap, would force kvm_region_commit() to stop all vCPUs.
+ *
+ * Called with KVMMemoryListener.slots_lock held
+ */
+static void kvm_region_cancel_noops(KVMMemoryListener *kml)
+{
+    QSIMPLEQ_HEAD(, KVMMemoryUpdate) del = QSIMPLEQ_HEAD_INITIALIZER(del);
+    QSIMPLEQ_HEAD(, KVMMemoryUpdate) add = QSIMPLEQ_HEAD_INITIALIZER(add);
+    KVMMemoryUpdate *u1, *u2;
+
+    while (!QSIMPLEQ_EMPTY(&kml->transaction_del) &&
+           !QSIMPLEQ_EMPTY(&kml->transaction_add)) {
+        MemoryRegionSection *s1, *s2;
+
+        u1 = QSIMPLEQ_FIRST(&kml->transaction_del);
+        u2 = QSIMPLEQ_FIRST(&kml->transaction_add);
+        s1 = &u1->section;
+        s2 = &u2->section;
+
+        if (s1->mr == s2->mr &&
+            s1->offset_within_region == s2->offset_within_region &&
+            s1->offset_within_address_space ==
+            s2->offset_within_address_space &&
+            int128_eq(s1->size, s2->size) &&
+            kvm_section_matches_slots(kml, s2)) {
+            /* The reference taken when the slots were added stays valid */
+            QSIMPLEQ_REMOVE_HEAD(&kml->transaction_del, next);
+            QSIMPLEQ_REMOVE_HEAD(&kml->transaction_add, next);
+            g_free(u1);
+            g_free(u2);
+        } else if (s1->offset_within_address_space <=
+                   s2->offset_within_address_space) {
+            QSIMPLEQ_REMOVE_HEAD(&kml->transaction_del, next);
+            QSIMPLEQ_INSERT_TAIL(&del, u1, next);
+        } else {
+            QSIMPLEQ_REMOVE_HEAD(&kml->transaction_add, next);
+            QSIMPLEQ_INSERT_TAIL(&add, u2, next);
+        }
+    }
+
+    QSIMPLEQ_CONCAT(&del, &kml->transaction_del);
+    QSIMPLEQ_CONCAT(&kml->transaction_del, &del);
+    QSIMPLEQ_CONCAT(&add, &kml->transaction_add);
+    QSIMPLEQ_CONCAT(&kml->transaction_add, &add);
+}
+
 static void kvm_region_commit(MemoryListener *listener)
 {
     KVMMemoryListener *kml = container_of(listener, KVMMemoryListener,
@@ -1524,6 +1621,9 @@ static void kvm_region_commit(MemoryListener *listener)
         return;
     }
 
+    kvm_slots_lock();
+    kvm_region_cancel_noops(kml);
+
     /*
      * We have to be careful when regions to add overlap with ranges to remove.
      * We have to simulate atomic KVM memslot updates by making sure no ioctl()
@@ -1552,7 +1652,6 @@ static void kvm_region_commit(MemoryListener *listener)
         }
     }
 
-    kvm_slots_lock();
     if (need_inhibit) {
         accel_ioctl_inhibit_begin();
     }
@@ -2660,35 +2759,85 @@ static int kvm_handle_internal_error(CPUState *cpu, struct kvm_run *run)
     return -1;
 }
 
+/*
+ * The last section a coalesced ring entry was written to.  Entries usually
+ * come in runs that hit the same device, so remembering the translation
+ * saves the FlatView lookup for all but the first entry of a run.
+ */
+typedef struct KVMCoalescedTarget {
+    AddressSpace *as;
+    FlatView *fv;
+    MemoryRegion *mr;
+    hwaddr start;
+    hwaddr len;
+    hwaddr xlat;
+} KVMCoalescedTarget;
+
+/* Called within RCU critical section.  */
+static void kvm_coalesced_write(KVMState *s, KVMCoalescedTarget *t,
+                                AddressSpace *as, hwaddr addr,
+                                const uint8_t *data, hwaddr len)
+{
+    MemTxAttrs attrs = MEMTXATTRS_UNSPECIFIED;
+    FlatView *fv = address_space_to_flatview(as);
+    hwaddr l;
+
+    /* A device may have changed the memory map while handling an entry */
+    if (t->as != as || t->fv != fv ||
+        addr < t->start || addr - t->start >= t->len) {
+        t->as = as;
+        t->fv = fv;
+        t->start = addr;
+        t->len = HWADDR_MAX;
+        t->mr = flatview_translate(fv, addr, &t->xlat, &t->len, true, attrs);
+        s->coalesced_lookups++;
+    }
+
+    l = MIN(len, t->len - (addr - t->start));
+    flatview_write_continue(fv, addr, attrs, data, len,
+                            t->xlat + (addr - t->start), l, t->mr);
+}
+
 void kvm_flush_coalesced_mmio_buffer(void)
 {
     KVMState *s = kvm_state;
+    KVMCoalescedTarget target = { };
+    uint64_t entries, lookups;
 
     if (!s || s->coalesced_flush_in_progress) {
         return;
     }
 
     s->coalesced_flush_in_progress = true;
+    entries = s->coalesced_entries;
+    lookups = s->coalesced_lookups;
 
     if (s->coalesced_mmio_ring) {
         struct kvm_coalesced_mmio_ring *ring = s->coalesced_mmio_ring;
+
+        RCU_READ_LOCK_GUARD();
         while (ring->first != ring->last) {
             struct kvm_coalesced_mmio *ent;
 
             ent = &ring->coalesced_mmio[ring->first];
 
-            if (ent->pio == 1) {
-                address_space_write(&address_space_io, ent->phys_addr,
-                                    MEMTXATTRS_UNSPECIFIED, ent->data,
-                                    ent->len);
-            } else {
-                cpu_physical_memory_write(ent->phys_addr, ent->data, ent->len);
-            }
+            kvm_coalesced_write(s, &target,
+                                ent->pio == 1 ? &address_space_io :
+                                &address_space_memory,
+                                ent->phys_addr, ent->data, ent->len);
+            s->coalesced_entries++;
             smp_wmb();
             ring->first = (ring->first + 1) % KVM_COALESCED_MMIO_MAX;
         }
     }
 
+    if (s->coalesced_entries != entries) {
+        trace_kvm_flush_coalesced(s->coalesced_entries - entries,
+                                  s->coalesced_lookups - lookups,
+                                  s->coalesced_entries,
+                                  s->coalesced_lookups);
+    }
+
     s->coalesced_flush_in_progress = false;
 }
 
@@ -2942,19 +3091,18 @@ int kvm_cpu_exec(CPUState *cpu)
              * still full.  Got kicked by KVM_RESET_DIRTY_RINGS.
              */
             trace_kvm_dirty_ring_full(cpu->cpu_index);
-            qemu_mutex_lock_iothread();
             /*
-             * We throttle vCPU by making it sleep once it exit from kernel
-             * due to dirty ring full. In the dirtylimit scenario, reaping
-             * all vCPUs after a single vCPU dirty ring get full result in
-             * the miss of sleep, so just reap the ring-fulled vCPU.
+             * Only reap the ring of this vCPU, and do it without the BQL.
+             * With many vCPUs dirtying memory, reaping all rings under the
+             * BQL on every ring-full exit serializes all vCPU threads on
+             * it; this way each vCPU thread collects its own ring and they
+             * only contend on the slots lock.
+             *
+             * It also keeps the dirtylimit throttling below effective:
+             * reaping all vCPUs after a single vCPU dirty ring got full
+             * would let the others miss their sleep.
              */
-            if (dirtylimit_in_service()) {
-                kvm_dirty_ring_reap(kvm_state, cpu);
-            } else {
-                kvm_dirty_ring_reap(kvm_state, NULL);
-            }
-            qemu_mutex_unlock_iothread();
+            kvm_dirty_ring_reap(kvm_state, cpu);
             dirtylimit_vcpu_execute(cpu);
             ret = 0;
             break;
@@ -28,6 +28,7 @@
 #include "tcg/tcg.h"
 #include "qemu/atomic.h"
 #include "qemu/rcu.h"
+#include "qemu/thread-stats.h"
 #include "exec/log.h"
 #include "qemu/main-loop.h"
 #if defined(TARGET_I386) && !defined(CONFIG_USER_ONLY)
@@ -238,6 +239,37 @@ static TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
     return qht_lookup_custom(&tb_ctx.htable, &desc, h, tb_lookup_cmp);
 }
 
+/*
+ * Called by the owning vCPU on a jump cache miss.  Replace the cache
+ * with one four times as large if too many of the recent lookups missed.
+ * The new cache starts out empty; concurrent invalidation may still
+ * write to the old one until the end of the RCU grace period.
+ */
+static void tb_jmp_cache_account_miss(CPUState *cpu, CPUJumpCache *jc)
+{
+    CPUJumpCache *new_jc;
+    size_t misses = jc->misses + 1;
+
+    qatomic_set(&jc->misses, misses);
+    qemu_thread_stat_add(QEMU_STAT_TB_JMP_CACHE_MISSES, 1);
+    if (misses % TB_JMP_CACHE_WINDOW) {
+        return;
+    }
+    if (jc->bits >= TB_JMP_CACHE_MAX_BITS ||
+        jc->lookups - jc->window_lookups >
+        (size_t)TB_JMP_CACHE_WINDOW * TB_JMP_CACHE_GROW_RATIO) {
+        jc->window_lookups = jc->lookups;
+        return;
+    }
+
+    new_jc = tb_jmp_cache_new(jc->bits + 2);
+    new_jc->lookups = jc->lookups;
+    new_jc->misses = misses;
+    new_jc->window_lookups = jc->lookups;
+    qatomic_rcu_set(&cpu->tb_jmp_cache, new_jc);
+    g_free_rcu(jc, rcu);
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
                                           uint64_t cs_base, uint32_t flags,
@@ -250,8 +282,9 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(pc);
     jc = cpu->tb_jmp_cache;
+    hash = tb_jmp_cache_hash_func(jc, pc);
+    qatomic_set(&jc->lookups, jc->lookups + 1);
 
     if (cflags & CF_PCREL) {
         /* Use acquire to ensure current load of pc from jc. */
@@ -266,6 +299,7 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
         }
         tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
         if (tb == NULL) {
+            tb_jmp_cache_account_miss(cpu, jc);
             return NULL;
         }
         jc->array[hash].pc = pc;
@@ -284,12 +318,15 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
         }
         tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
         if (tb == NULL) {
+            tb_jmp_cache_account_miss(cpu, jc);
             return NULL;
         }
         /* Use the pc value already stored in tb->pc. */
         qatomic_set(&jc->array[hash].tb, tb);
     }
 
+    /* May replace the jump cache: jc must not be used afterwards. */
+    tb_jmp_cache_account_miss(cpu, jc);
     return tb;
 }
 
@@ -534,9 +571,11 @@ static void cpu_exec_longjmp_cleanup(CPUState *cpu)
 
 #ifdef CONFIG_USER_ONLY
     clear_helper_retaddr();
-    if (have_mmap_lock()) {
-        mmap_unlock();
-    }
+    /*
+     * The lock may have been taken recursively, or shared, by the code
+     * that jumped out; none of it will unwind.
+     */
+    mmap_unlock_all();
 #else
     /*
      * For softmmu, a tlb_fill fault during translation will land here,
@@ -1010,8 +1049,8 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                h = tb_jmp_cache_hash_func(pc);
                 jc = cpu->tb_jmp_cache;
+                h = tb_jmp_cache_hash_func(jc, pc);
                 if (cflags & CF_PCREL) {
                     jc->array[h].pc = pc;
                     /* Ensure pc is written first. */
@@ -1099,7 +1138,7 @@ bool tcg_exec_realizefn(CPUState *cpu, Error **errp)
         tcg_target_initialized = true;
     }
 
-    cpu->tb_jmp_cache = g_new0(CPUJumpCache, 1);
+    cpu->tb_jmp_cache = tb_jmp_cache_new(TB_JMP_CACHE_BITS);
     tlb_init(cpu);
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_init_notifier_list(cpu);
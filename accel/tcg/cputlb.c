@@ -34,6 +34,8 @@
 #include "qemu/atomic.h"
 #include "qemu/atomic128.h"
 #include "exec/translate-all.h"
+#include "sysemu/cpu-timers.h"
+#include "sysemu/cpus.h"
 #include "trace.h"
 #include "tb-hash.h"
 #include "internal-common.h"
@@ -102,6 +104,44 @@ static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
     desc->window_max_entries = max_entries;
 }
 
+static inline size_t vtlb_n_entries(const CPUTLBDesc *desc)
+{
+    return (desc->vmask + 1) * CPU_VTLB_WAYS;
+}
+
+/*
+ * Return the first victim tlb entry of the set for the main tlb entry
+ * @index.  Since the number of sets is a power of two no larger than
+ * the main tlb, the entries of one set are only ever swapped with main
+ * tlb entries that map to that same set.
+ */
+static inline size_t vtlb_set_base(const CPUTLBDesc *desc, size_t index)
+{
+    return (index & desc->vmask) * CPU_VTLB_WAYS;
+}
+
+static inline size_t vtlb_page_set_base(const CPUTLBDesc *desc, vaddr page)
+{
+    return vtlb_set_base(desc, page >> TARGET_PAGE_BITS);
+}
+
+/* Size the victim tlb for a main tlb of @n_entries.  */
+static void tlb_mmu_vtlb_alloc(CPUTLBDesc *desc, size_t n_entries)
+{
+    size_t n_sets = n_entries / (8 * CPU_VTLB_WAYS);
+
+    n_sets = MIN(MAX(n_sets, 2), CPU_VTLB_MAX_SETS);
+    if (desc->vtable && desc->vmask + 1 == n_sets) {
+        return;
+    }
+
+    g_free(desc->vtable);
+    g_free(desc->vfulltlb);
+    desc->vmask = n_sets - 1;
+    desc->vtable = g_new(CPUTLBEntry, n_sets * CPU_VTLB_WAYS);
+    desc->vfulltlb = g_new(CPUTLBEntryFull, n_sets * CPU_VTLB_WAYS);
+}
+
 static void tb_jmp_cache_clear_page(CPUState *cpu, vaddr page_addr)
 {
     CPUJumpCache *jc = cpu->tb_jmp_cache;
@@ -111,8 +151,8 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, vaddr page_addr)
         return;
     }
 
-    i0 = tb_jmp_cache_hash_page(page_addr);
-    for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
+    i0 = tb_jmp_cache_hash_page(jc, page_addr);
+    for (i = 0; i < (1 << tb_jmp_page_bits(jc)); i++) {
         qatomic_set(&jc->array[i0 + i].tb, NULL);
     }
 }
@@ -230,6 +270,7 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
         fast->table = g_try_new(CPUTLBEntry, new_size);
         desc->fulltlb = g_try_new(CPUTLBEntryFull, new_size);
     }
+    tlb_mmu_vtlb_alloc(desc, new_size);
 }
 
 static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
@@ -239,7 +280,7 @@ static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
     desc->large_page_mask = -1;
     desc->vindex = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
-    memset(desc->vtable, -1, sizeof(desc->vtable));
+    memset(desc->vtable, -1, vtlb_n_entries(desc) * sizeof(CPUTLBEntry));
 }
 
 static void tlb_flush_one_mmuidx_locked(CPUState *cpu, int mmu_idx,
@@ -261,6 +302,7 @@ static void tlb_mmu_init(CPUTLBDesc *desc, CPUTLBDescFast *fast, int64_t now)
     fast->mask = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
     fast->table = g_new(CPUTLBEntry, n_entries);
     desc->fulltlb = g_new(CPUTLBEntryFull, n_entries);
+    tlb_mmu_vtlb_alloc(desc, n_entries);
     tlb_mmu_flush_locked(desc, fast);
 }
 
@@ -280,6 +322,7 @@ void tlb_init(CPUState *cpu)
     int i;
 
     qemu_spin_init(&cpu->neg.tlb.c.lock);
+    qemu_spin_init(&cpu->neg.tlb.c.pending_lock);
 
     /* All tlbs are initialized flushed. */
     cpu->neg.tlb.c.dirty = 0;
@@ -294,12 +337,15 @@ void tlb_destroy(CPUState *cpu)
     int i;
 
     qemu_spin_destroy(&cpu->neg.tlb.c.lock);
+    qemu_spin_destroy(&cpu->neg.tlb.c.pending_lock);
     for (i = 0; i < NB_MMU_MODES; i++) {
         CPUTLBDesc *desc = &cpu->neg.tlb.d[i];
         CPUTLBDescFast *fast = &cpu->neg.tlb.f[i];
 
         g_free(fast->table);
         g_free(desc->fulltlb);
+        g_free(desc->vtable);
+        g_free(desc->vfulltlb);
     }
 }
 
@@ -332,6 +378,7 @@ static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 
     tlb_debug("mmu_idx:0x%04" PRIx16 "\n", asked);
 
+    cpu->neg.tlb.c.flush_gen++;
     qemu_spin_lock(&cpu->neg.tlb.c.lock);
 
     all_dirty = cpu->neg.tlb.c.dirty;
@@ -379,6 +426,12 @@ void tlb_flush(CPUState *cpu)
     tlb_flush_by_mmuidx(cpu, ALL_MMUIDX_BITS);
 }
 
+uint32_t tlb_flush_generation(CPUState *cpu)
+{
+    assert_cpu_is_self(cpu);
+    return cpu->neg.tlb.c.flush_gen;
+}
+
 void tlb_flush_by_mmuidx_all_cpus(CPUState *src_cpu, uint16_t idxmap)
 {
     const run_on_cpu_func fn = tlb_flush_by_mmuidx_async_work;
@@ -451,16 +504,41 @@ static inline bool tlb_flush_entry_locked(CPUTLBEntry *tlb_entry, vaddr page)
     return tlb_flush_entry_mask_locked(tlb_entry, page, -1);
 }
 
+/*
+ * Return the entry of the victim tlb set for the main tlb entry @index
+ * that is to receive an evicted entry: a free one if there is any,
+ * otherwise one chosen in round-robin order.
+ */
+static size_t vtlb_victim_way(CPUTLBDesc *desc, size_t index)
+{
+    size_t k, base = vtlb_set_base(desc, index);
+
+    for (k = base; k < base + CPU_VTLB_WAYS; k++) {
+        if (tlb_entry_is_empty(&desc->vtable[k])) {
+            return k;
+        }
+    }
+    return base + desc->vindex++ % CPU_VTLB_WAYS;
+}
+
 /* Called with tlb_c.lock held */
 static void tlb_flush_vtlb_page_mask_locked(CPUState *cpu, int mmu_idx,
                                             vaddr page,
                                             vaddr mask)
 {
     CPUTLBDesc *d = &cpu->neg.tlb.d[mmu_idx];
-    int k;
+    size_t k, base, end;
 
     assert_cpu_is_self(cpu);
-    for (k = 0; k < CPU_VTLB_SIZE; k++) {
+    if (((vaddr)d->vmask << TARGET_PAGE_BITS) & ~mask) {
+        /* The mask ignores some of the bits that select the set.  */
+        base = 0;
+        end = vtlb_n_entries(d);
+    } else {
+        base = vtlb_page_set_base(d, page);
+        end = base + CPU_VTLB_WAYS;
+    }
+    for (k = base; k < end; k++) {
         if (tlb_flush_entry_mask_locked(&d->vtable[k], page, mask)) {
             tlb_n_used_entries_dec(cpu, mmu_idx);
         }
@@ -473,6 +551,53 @@ static inline void tlb_flush_vtlb_page_locked(CPUState *cpu, int mmu_idx,
     tlb_flush_vtlb_page_mask_locked(cpu, mmu_idx, page, -1);
 }
 
+/**
+ * tlb_flush_large_page_locked:
+ * @cpu: cpu on which to flush
+ * @midx: mmu_idx to flush
+ *
+ * Flush every entry of @midx that lies within the region covering all
+ * of the large pages in the tlb, including the victim tlb, leaving the
+ * rest of the tlb intact.  Only the entries at the index of each page
+ * of the region need to be checked; if the region has more pages than
+ * the tlb has entries, scan the whole table instead.
+ * Called with tlb_c.lock held.
+ */
+static void tlb_flush_large_page_locked(CPUState *cpu, int midx)
+{
+    CPUTLBDesc *d = &cpu->neg.tlb.d[midx];
+    CPUTLBDescFast *f = &cpu->neg.tlb.f[midx];
+    vaddr lp_addr = d->large_page_addr;
+    vaddr lp_mask = d->large_page_mask;
+    uint64_t n_pages = (~lp_mask >> TARGET_PAGE_BITS) + 1;
+    size_t n_entries = tlb_n_entries(f);
+
+    tlb_debug("flushing large page region midx %d (%016"
+              VADDR_PRIx "/%016" VADDR_PRIx ")\n",
+              midx, lp_addr, lp_mask);
+
+    if (n_pages < n_entries) {
+        for (uint64_t i = 0; i < n_pages; i++) {
+            vaddr page = lp_addr + (i << TARGET_PAGE_BITS);
+
+            if (tlb_flush_entry_mask_locked(tlb_entry(cpu, midx, page),
+                                            lp_addr, lp_mask)) {
+                tlb_n_used_entries_dec(cpu, midx);
+            }
+        }
+    } else {
+        for (size_t i = 0; i < n_entries; i++) {
+            if (tlb_flush_entry_mask_locked(&f->table[i], lp_addr, lp_mask)) {
+                tlb_n_used_entries_dec(cpu, midx);
+            }
+        }
+    }
+    tlb_flush_vtlb_page_mask_locked(cpu, midx, lp_addr, lp_mask);
+
+    d->large_page_addr = -1;
+    d->large_page_mask = -1;
+}
+
 static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
 {
     vaddr lp_addr = cpu->neg.tlb.d[midx].large_page_addr;
@@ -480,10 +605,7 @@ static void tlb_flush_page_locked(CPUState *cpu, int midx, vaddr page)
 
     /* Check if we need to flush due to large pages.  */
     if ((page & lp_mask) == lp_addr) {
-        tlb_debug("forcing full flush midx %d (%016"
-                  VADDR_PRIx "/%016" VADDR_PRIx ")\n",
-                  midx, lp_addr, lp_mask);
-        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
+        tlb_flush_large_page_locked(cpu, midx);
     } else {
         if (tlb_flush_entry_locked(tlb_entry(cpu, midx, page), page)) {
             tlb_n_used_entries_dec(cpu, midx);
@@ -511,6 +633,7 @@ static void tlb_flush_page_by_mmuidx_async_0(CPUState *cpu,
 
     tlb_debug("page addr: %016" VADDR_PRIx " mmu_map:0x%x\n", addr, idxmap);
 
+    cpu->neg.tlb.c.flush_gen++;
     qemu_spin_lock(&cpu->neg.tlb.c.lock);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         if ((idxmap >> mmu_idx) & 1) {
@@ -571,6 +694,107 @@ static void tlb_flush_page_by_mmuidx_async_2(CPUState *cpu,
     g_free(d);
 }
 
+/**
+ * tlb_flush_pending_async_work:
+ * @cpu: cpu on which to flush
+ * @data: unused
+ *
+ * Process all of the flushes queued for @cpu by tlb_queue_flush.
+ */
+static void tlb_flush_pending_async_work(CPUState *cpu, run_on_cpu_data data)
+{
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+    CPUTLBPendingFlush pending[CPU_TLB_PENDING_SIZE];
+    uint16_t full;
+    unsigned i, n;
+
+    qemu_spin_lock(&c->pending_lock);
+    full = c->pending_full;
+    n = c->pending_n;
+    memcpy(pending, c->pending, n * sizeof(pending[0]));
+    c->pending_full = 0;
+    c->pending_n = 0;
+    qemu_spin_unlock(&c->pending_lock);
+
+    if (full) {
+        tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(full));
+    }
+    for (i = 0; i < n; i++) {
+        uint16_t idxmap = pending[i].idxmap & ~full;
+
+        if (idxmap) {
+            tlb_flush_page_by_mmuidx_async_0(cpu, pending[i].addr, idxmap);
+        }
+    }
+}
+
+/**
+ * tlb_queue_flush:
+ * @cpu: cpu on which to flush, not the current cpu
+ * @addr: page aligned start of the range to flush
+ * @len: length of the range to flush
+ * @idxmap: set of mmu_idx to flush
+ *
+ * Queue a flush of the pages in [@addr, @addr + @len) for each mmu_idx
+ * in @idxmap.  Requests are merged with those that @cpu has not yet
+ * processed, so that only one work item is outstanding at any time.
+ * Once more than CPU_TLB_PENDING_SIZE distinct pages are pending, the
+ * affected mmu_idx are flushed entirely instead.
+ */
+static void tlb_queue_flush(CPUState *cpu, vaddr addr, vaddr len,
+                            uint16_t idxmap)
+{
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+    bool idle;
+
+    qemu_spin_lock(&c->pending_lock);
+
+    idle = c->pending_full == 0 && c->pending_n == 0;
+    idxmap &= ~c->pending_full;
+
+    if (len > CPU_TLB_PENDING_SIZE * TARGET_PAGE_SIZE) {
+        c->pending_full |= idxmap;
+        idxmap = 0;
+    }
+    for (vaddr i = 0; idxmap && i < len; i += TARGET_PAGE_SIZE) {
+        vaddr page = addr + i;
+        unsigned j;
+
+        for (j = 0; j < c->pending_n; j++) {
+            if (c->pending[j].addr == page) {
+                c->pending[j].idxmap |= idxmap;
+                break;
+            }
+        }
+        if (j < c->pending_n) {
+            continue;
+        }
+        if (j < CPU_TLB_PENDING_SIZE) {
+            c->pending[j].addr = page;
+            c->pending[j].idxmap = idxmap;
+            c->pending_n++;
+            continue;
+        }
+
+        /* Too many pages: switch to flushing everything affected. */
+        for (j = 0; j < c->pending_n; j++) {
+            c->pending_full |= c->pending[j].idxmap;
+        }
+        c->pending_full |= idxmap;
+        c->pending_n = 0;
+        break;
+    }
+
+    if (!idle) {
+        qatomic_set(&c->coalesced_flush_count, c->coalesced_flush_count + 1);
+    }
+    qemu_spin_unlock(&c->pending_lock);
+
+    if (idle) {
+        async_run_on_cpu(cpu, tlb_flush_pending_async_work, RUN_ON_CPU_NULL);
+    }
+}
+
 void tlb_flush_page_by_mmuidx(CPUState *cpu, vaddr addr, uint16_t idxmap)
 {
     tlb_debug("addr: %016" VADDR_PRIx " mmu_idx:%" PRIx16 "\n", addr, idxmap);
@@ -580,22 +804,8 @@ void tlb_flush_page_by_mmuidx(CPUState *cpu, vaddr addr, uint16_t idxmap)
 
     if (qemu_cpu_is_self(cpu)) {
         tlb_flush_page_by_mmuidx_async_0(cpu, addr, idxmap);
-    } else if (idxmap < TARGET_PAGE_SIZE) {
-        /*
-         * Most targets have only a few mmu_idx.  In the case where
-         * we can stuff idxmap into the low TARGET_PAGE_BITS, avoid
-         * allocating memory for this operation.
-         */
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
     } else {
-        TLBFlushPageByMMUIdxData *d = g_new(TLBFlushPageByMMUIdxData, 1);
-
-        /* Otherwise allocate a structure, freed by the worker.  */
-        d->addr = addr;
-        d->idxmap = idxmap;
-        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_2,
-                         RUN_ON_CPU_HOST_PTR(d));
+        tlb_queue_flush(cpu, addr, TARGET_PAGE_SIZE, idxmap);
     }
 }
 
@@ -607,32 +817,16 @@ void tlb_flush_page(CPUState *cpu, vaddr addr)
 void tlb_flush_page_by_mmuidx_all_cpus(CPUState *src_cpu, vaddr addr,
                                        uint16_t idxmap)
 {
+    CPUState *dst_cpu;
+
     tlb_debug("addr: %016" VADDR_PRIx " mmu_idx:%"PRIx16"\n", addr, idxmap);
 
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
-    /*
-     * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
-     */
-    if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
-    } else {
-        CPUState *dst_cpu;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                TLBFlushPageByMMUIdxData *d
-                    = g_new(TLBFlushPageByMMUIdxData, 1);
-
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_queue_flush(dst_cpu, addr, TARGET_PAGE_SIZE, idxmap);
         }
     }
 
@@ -648,36 +842,30 @@ void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                               vaddr addr,
                                               uint16_t idxmap)
 {
+    CPUState *dst_cpu;
+
     tlb_debug("addr: %016" VADDR_PRIx " mmu_idx:%"PRIx16"\n", addr, idxmap);
 
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_queue_flush(dst_cpu, addr, TARGET_PAGE_SIZE, idxmap);
+        }
+    }
+
     /*
-     * Allocate memory to hold addr+idxmap only when needed.
-     * See tlb_flush_page_by_mmuidx for details.
+     * Most targets have only a few mmu_idx.  In the case where
+     * we can stuff idxmap into the low TARGET_PAGE_BITS, avoid
+     * allocating memory for this operation.
      */
     if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
         async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_1,
                               RUN_ON_CPU_TARGET_PTR(addr | idxmap));
     } else {
-        CPUState *dst_cpu;
-        TLBFlushPageByMMUIdxData *d;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                d = g_new(TLBFlushPageByMMUIdxData, 1);
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
-        }
+        TLBFlushPageByMMUIdxData *d = g_new(TLBFlushPageByMMUIdxData, 1);
 
-        d = g_new(TLBFlushPageByMMUIdxData, 1);
         d->addr = addr;
         d->idxmap = idxmap;
         async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_2,
@@ -722,11 +910,7 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
      * we only need to test the end of the range.
      */
     if (((addr + len - 1) & d->large_page_mask) == d->large_page_addr) {
-        tlb_debug("forcing full flush midx %d ("
-                  "%016" VADDR_PRIx "/%016" VADDR_PRIx ")\n",
-                  midx, d->large_page_addr, d->large_page_mask);
-        tlb_flush_one_mmuidx_locked(cpu, midx, get_clock_realtime());
-        return;
+        tlb_flush_large_page_locked(cpu, midx);
     }
 
     for (vaddr i = 0; i < len; i += TARGET_PAGE_SIZE) {
@@ -757,6 +941,7 @@ static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
     tlb_debug("range: %016" VADDR_PRIx "/%u+%016" VADDR_PRIx " mmu_map:0x%x\n",
               d.addr, d.bits, d.len, d.idxmap);
 
+    cpu->neg.tlb.c.flush_gen++;
     qemu_spin_lock(&cpu->neg.tlb.c.lock);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         if ((d.idxmap >> mmu_idx) & 1) {
@@ -821,6 +1006,8 @@ void tlb_flush_range_by_mmuidx(CPUState *cpu, vaddr addr,
 
     if (qemu_cpu_is_self(cpu)) {
         tlb_flush_range_by_mmuidx_async_0(cpu, d);
+    } else if (bits >= TARGET_LONG_BITS) {
+        tlb_queue_flush(cpu, d.addr, len, idxmap);
     } else {
         /* Otherwise allocate a structure, freed by the worker.  */
         TLBFlushRangeData *p = g_memdup(&d, sizeof(d));
@@ -864,7 +1051,12 @@ void tlb_flush_range_by_mmuidx_all_cpus(CPUState *src_cpu,
 
     /* Allocate a separate data block for each destination cpu.  */
     CPU_FOREACH(dst_cpu) {
-        if (dst_cpu != src_cpu) {
+        if (dst_cpu == src_cpu) {
+            continue;
+        }
+        if (bits >= TARGET_LONG_BITS) {
+            tlb_queue_flush(dst_cpu, d.addr, len, idxmap);
+        } else {
             TLBFlushRangeData *p = g_memdup(&d, sizeof(d));
             async_run_on_cpu(dst_cpu,
                              tlb_flush_range_by_mmuidx_async_1,
@@ -914,7 +1106,12 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
 
     /* Allocate a separate data block for each destination cpu.  */
     CPU_FOREACH(dst_cpu) {
-        if (dst_cpu != src_cpu) {
+        if (dst_cpu == src_cpu) {
+            continue;
+        }
+        if (bits >= TARGET_LONG_BITS) {
+            tlb_queue_flush(dst_cpu, d.addr, len, idxmap);
+        } else {
             p = g_memdup(&d, sizeof(d));
             async_run_on_cpu(dst_cpu, tlb_flush_range_by_mmuidx_async_1,
                              RUN_ON_CPU_HOST_PTR(p));
@@ -1020,7 +1217,8 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
                                          start1, length);
         }
 
-        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        n = vtlb_n_entries(&cpu->neg.tlb.d[mmu_idx]);
+        for (i = 0; i < n; i++) {
             tlb_reset_dirty_range_locked(&cpu->neg.tlb.d[mmu_idx].vtable[i],
                                          start1, length);
         }
@@ -1052,9 +1250,11 @@ void tlb_set_dirty(CPUState *cpu, vaddr addr)
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        int k;
-        for (k = 0; k < CPU_VTLB_SIZE; k++) {
-            tlb_set_dirty1_locked(&cpu->neg.tlb.d[mmu_idx].vtable[k], addr);
+        CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+        size_t k, base = vtlb_page_set_base(desc, addr);
+
+        for (k = base; k < base + CPU_VTLB_WAYS; k++) {
+            tlb_set_dirty1_locked(&desc->vtable[k], addr);
         }
     }
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
@@ -1220,7 +1420,7 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
      * different page; otherwise just overwrite the stale data.
      */
     if (!tlb_hit_page_anyprot(te, addr_page) && !tlb_entry_is_empty(te)) {
-        unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
+        size_t vidx = vtlb_victim_way(desc, index);
         CPUTLBEntry *tv = &desc->vtable[vidx];
 
         /* Evict the old entry into the victim tlb.  */
@@ -1242,11 +1442,22 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
      * (non-page-aligned) vaddr of the eventual memory access to get
      * the MemoryRegion offset for the access. Note that the vaddr we
      * subtract here is that of the page base, and not the same as the
-     * vaddr we add back in io_prepare()/get_page_addr_code().
+     * vaddr we add back in io_section()/get_page_addr_code().
      */
     desc->fulltlb[index] = *full;
     full = &desc->fulltlb[index];
     full->xlat_section = iotlb - addr_page;
+    /*
+     * Sections reached through an IOMMU belong to the memory map of its
+     * target address space, which can change without flushing this tlb;
+     * do not cache them, see io_section().
+     */
+    if (is_ram ||
+        section->fv != address_space_to_flatview(cpu->cpu_ases[asidx].as)) {
+        full->section = NULL;
+    } else {
+        full->section = section;
+    }
     full->phys_addr = paddr_page;
 
     /* Now calculate the new entry */
@@ -1325,22 +1536,86 @@ static inline void cpu_unaligned_access(CPUState *cpu, vaddr addr,
                                           mmu_idx, retaddr);
 }
 
+/*
+ * Return the section of the I/O or ROMD page in @full, and in @out_offset
+ * the offset of @addr within its region.  A section that was not cached
+ * when the entry was filled is looked up again, starting from the
+ * physical address of the page.
+ * Called from an RCU critical section.
+ */
 static MemoryRegionSection *
-io_prepare(hwaddr *out_offset, CPUState *cpu, hwaddr xlat,
-           MemTxAttrs attrs, vaddr addr, uintptr_t retaddr)
+io_section(hwaddr *out_offset, CPUState *cpu, CPUTLBEntryFull *full,
+           vaddr addr)
+{
+    MemoryRegionSection *section;
+    hwaddr xlat, sz = TARGET_PAGE_SIZE;
+    int prot = full->prot;
+    int asidx;
+
+    if (likely(full->section)) {
+        *out_offset = (full->xlat_section & TARGET_PAGE_MASK) + addr;
+        return full->section;
+    }
+
+    asidx = cpu_asidx_from_attrs(cpu, full->attrs);
+    section = address_space_translate_for_iotlb(cpu, asidx, full->phys_addr,
+                                                &xlat, &sz, full->attrs,
+                                                &prot);
+    *out_offset = xlat + (addr & ~TARGET_PAGE_MASK);
+    return section;
+}
+
+static MemoryRegion *
+io_prepare(hwaddr *out_offset, CPUState *cpu, CPUTLBEntryFull *full,
+           vaddr addr, uintptr_t retaddr)
 {
     MemoryRegionSection *section;
     hwaddr mr_offset;
 
-    section = iotlb_to_section(cpu, xlat, attrs);
-    mr_offset = (xlat & TARGET_PAGE_MASK) + addr;
+    section = io_section(&mr_offset, cpu, full, addr);
     cpu->mem_io_pc = retaddr;
     if (!cpu->neg.can_do_io) {
         cpu_io_recompile(cpu, retaddr);
     }
+    if (icount_quantum && !qatomic_read(&cpu->icount_io_granted)) {
+        /*
+         * Parallel icount: stop before the access and do it when
+         * the other vCPUs have reached the end of the quantum.
+         * Without a return address there is no TB to rewind, so
+         * wait in place instead.
+         */
+        if (!retaddr) {
+            cpu_prepare_io(cpu);
+        } else {
+            qatomic_set(&cpu->icount_io_pending, true);
+            qatomic_set(&cpu->exit_request, 1);
+            cpu_io_recompile(cpu, retaddr);
+        }
+    }
 
     *out_offset = mr_offset;
-    return section;
+    return section->mr;
+}
+
+/*
+ * Take the iothread lock for an access to @mr, unless the region has
+ * opted out of global locking and may be accessed concurrently.
+ * Returns true if the lock must be released with io_unlock().
+ */
+static bool io_lock(MemoryRegion *mr)
+{
+    if (mr->global_locking) {
+        qemu_mutex_lock_iothread();
+        return true;
+    }
+    return false;
+}
+
+static void io_unlock(bool locked)
+{
+    if (locked) {
+        qemu_mutex_unlock_iothread();
+    }
 }
 
 static void io_failed(CPUState *cpu, CPUTLBEntryFull *full, vaddr addr,
@@ -1362,11 +1637,12 @@ static void io_failed(CPUState *cpu, CPUTLBEntryFull *full, vaddr addr,
 static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
                            MMUAccessType access_type, vaddr page)
 {
-    size_t vidx;
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    size_t vidx, base = vtlb_set_base(desc, index);
 
     assert_cpu_is_self(cpu);
-    for (vidx = 0; vidx < CPU_VTLB_SIZE; ++vidx) {
-        CPUTLBEntry *vtlb = &cpu->neg.tlb.d[mmu_idx].vtable[vidx];
+    for (vidx = base; vidx < base + CPU_VTLB_WAYS; ++vidx) {
+        CPUTLBEntry *vtlb = &desc->vtable[vidx];
         uint64_t cmp = tlb_read_idx(vtlb, access_type);
 
         if (cmp == page) {
@@ -1383,9 +1659,13 @@ static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
             CPUTLBEntryFull *f2 = &cpu->neg.tlb.d[mmu_idx].vfulltlb[vidx];
             CPUTLBEntryFull tmpf;
             tmpf = *f1; *f1 = *f2; *f2 = tmpf;
+            qatomic_set(&cpu->neg.tlb.c.vtlb_hit_count,
+                        cpu->neg.tlb.c.vtlb_hit_count + 1);
             return true;
         }
     }
+    qatomic_set(&cpu->neg.tlb.c.vtlb_miss_count,
+                cpu->neg.tlb.c.vtlb_miss_count + 1);
     return false;
 }
 
@@ -1650,11 +1930,10 @@ bool tlb_plugin_lookup(CPUState *cpu, vaddr addr, int mmu_idx,
 
     /* We must have an iotlb entry for MMIO */
     if (tlb_addr & TLB_MMIO) {
-        MemoryRegionSection *section =
-            iotlb_to_section(cpu, full->xlat_section & ~TARGET_PAGE_MASK,
-                             full->attrs);
+        hwaddr mr_offset;
+
         data->is_io = true;
-        data->mr = section->mr;
+        data->mr = io_section(&mr_offset, cpu, full, addr)->mr;
     } else {
         data->is_io = false;
         data->mr = NULL;
@@ -1975,7 +2254,7 @@ static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
  * @size: number of bytes
  * @mmu_idx: virtual address context
  * @ra: return address into tcg generated code, or 0
- * Context: iothread lock held
+ * Context: iothread lock held, if @mr requires global locking
  *
  * Load @size bytes from @addr, which is memory-mapped i/o.
  * The bytes are concatenated in big-endian order with @ret_be.
@@ -2018,22 +2297,19 @@ static uint64_t do_ld_mmio_beN(CPUState *cpu, CPUTLBEntryFull *full,
                                uint64_t ret_be, vaddr addr, int size,
                                int mmu_idx, MMUAccessType type, uintptr_t ra)
 {
-    MemoryRegionSection *section;
     MemoryRegion *mr;
     hwaddr mr_offset;
-    MemTxAttrs attrs;
     uint64_t ret;
+    bool locked;
 
     tcg_debug_assert(size > 0 && size <= 8);
 
-    attrs = full->attrs;
-    section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
-    mr = section->mr;
+    mr = io_prepare(&mr_offset, cpu, full, addr, ra);
 
-    qemu_mutex_lock_iothread();
+    locked = io_lock(mr);
     ret = int_ld_mmio_beN(cpu, full, ret_be, addr, size, mmu_idx,
                           type, ra, mr, mr_offset);
-    qemu_mutex_unlock_iothread();
+    io_unlock(locked);
 
     return ret;
 }
@@ -2042,24 +2318,21 @@ static Int128 do_ld16_mmio_beN(CPUState *cpu, CPUTLBEntryFull *full,
                                uint64_t ret_be, vaddr addr, int size,
                                int mmu_idx, uintptr_t ra)
 {
-    MemoryRegionSection *section;
     MemoryRegion *mr;
     hwaddr mr_offset;
-    MemTxAttrs attrs;
     uint64_t a, b;
+    bool locked;
 
     tcg_debug_assert(size > 8 && size <= 16);
 
-    attrs = full->attrs;
-    section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
-    mr = section->mr;
+    mr = io_prepare(&mr_offset, cpu, full, addr, ra);
 
-    qemu_mutex_lock_iothread();
+    locked = io_lock(mr);
     a = int_ld_mmio_beN(cpu, full, ret_be, addr, size - 8, mmu_idx,
                         MMU_DATA_LOAD, ra, mr, mr_offset);
     b = int_ld_mmio_beN(cpu, full, ret_be, addr + size - 8, 8, mmu_idx,
                         MMU_DATA_LOAD, ra, mr, mr_offset + size - 8);
-    qemu_mutex_unlock_iothread();
+    io_unlock(locked);
 
     return int128_make128(b, a);
 }
@@ -2521,7 +2794,7 @@ static Int128 do_ld16_mmu(CPUState *cpu, vaddr addr,
  * @size: number of bytes
  * @mmu_idx: virtual address context
  * @ra: return address into tcg generated code, or 0
- * Context: iothread lock held
+ * Context: iothread lock held, if @mr requires global locking
  *
  * Store @size bytes at @addr, which is memory-mapped i/o.
  * The bytes to store are extracted in little-endian order from @val_le;
@@ -2565,22 +2838,19 @@ static uint64_t do_st_mmio_leN(CPUState *cpu, CPUTLBEntryFull *full,
                                uint64_t val_le, vaddr addr, int size,
                                int mmu_idx, uintptr_t ra)
 {
-    MemoryRegionSection *section;
     hwaddr mr_offset;
     MemoryRegion *mr;
-    MemTxAttrs attrs;
     uint64_t ret;
+    bool locked;
 
     tcg_debug_assert(size > 0 && size <= 8);
 
-    attrs = full->attrs;
-    section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
-    mr = section->mr;
+    mr = io_prepare(&mr_offset, cpu, full, addr, ra);
 
-    qemu_mutex_lock_iothread();
+    locked = io_lock(mr);
     ret = int_st_mmio_leN(cpu, full, val_le, addr, size, mmu_idx,
                           ra, mr, mr_offset);
-    qemu_mutex_unlock_iothread();
+    io_unlock(locked);
 
     return ret;
 }
@@ -2589,24 +2859,21 @@ static uint64_t do_st16_mmio_leN(CPUState *cpu, CPUTLBEntryFull *full,
                                  Int128 val_le, vaddr addr, int size,
                                  int mmu_idx, uintptr_t ra)
 {
-    MemoryRegionSection *section;
     MemoryRegion *mr;
     hwaddr mr_offset;
-    MemTxAttrs attrs;
     uint64_t ret;
+    bool locked;
 
     tcg_debug_assert(size > 8 && size <= 16);
 
-    attrs = full->attrs;
-    section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
-    mr = section->mr;
+    mr = io_prepare(&mr_offset, cpu, full, addr, ra);
 
-    qemu_mutex_lock_iothread();
+    locked = io_lock(mr);
     int_st_mmio_leN(cpu, full, int128_getlo(val_le), addr, 8,
                     mmu_idx, ra, mr, mr_offset);
     ret = int_st_mmio_leN(cpu, full, int128_gethi(val_le), addr + 8,
                           size - 8, mmu_idx, ra, mr, mr_offset + 8);
-    qemu_mutex_unlock_iothread();
+    io_unlock(locked);
 
     return ret;
 }
@@ -56,6 +56,8 @@ static bool icount_sleep = true;
  */
 int use_icount;
 
+int64_t icount_quantum;
+
 static void icount_enable_precise(void)
 {
     use_icount = 1;
@@ -87,6 +89,12 @@ static void icount_update_locked(CPUState *cpu)
     int64_t executed = icount_get_executed(cpu);
     cpu->icount_budget -= executed;
 
+    if (icount_quantum) {
+        /* Each vCPU has its own time until the end of the quantum */
+        qatomic_set_i64(&cpu->icount_local, cpu->icount_local + executed);
+        return;
+    }
+
     qatomic_set_i64(&timers_state.qemu_icount,
                     timers_state.qemu_icount + executed);
 }
@@ -116,6 +124,9 @@ static int64_t icount_get_raw_locked(void)
         }
         /* Take into account what has run */
         icount_update_locked(cpu);
+        if (icount_quantum) {
+            return cpu->icount_local;
+        }
     }
     /* The read is protected by the seqlock, but needs atomic64 to avoid UB */
     return qatomic_read_i64(&timers_state.qemu_icount);
@@ -155,6 +166,15 @@ int64_t icount_get(void)
     return icount;
 }
 
+void icount_set_raw(int64_t icount)
+{
+    seqlock_write_lock(&timers_state.vm_clock_seqlock,
+                       &timers_state.vm_clock_lock);
+    qatomic_set_i64(&timers_state.qemu_icount, icount);
+    seqlock_write_unlock(&timers_state.vm_clock_seqlock,
+                         &timers_state.vm_clock_lock);
+}
+
 int64_t icount_to_ns(int64_t icount)
 {
     return icount << qatomic_read(&timers_state.icount_time_shift);
@@ -301,8 +321,10 @@ void icount_start_warp_timer(void)
     /*
      * Nothing to do if the VM is stopped: QEMU_CLOCK_VIRTUAL timers
      * do not fire, so computing the deadline does not make sense.
+     * With parallel icount, idle time is skipped when the vCPUs
+     * synchronize at the end of a quantum.
      */
-    if (!runstate_is_running()) {
+    if (!runstate_is_running() || icount_quantum) {
         return;
     }
 
@@ -424,11 +446,14 @@ void icount_configure(QemuOpts *opts, Error **errp)
     const char *option = qemu_opt_get(opts, "shift");
     bool sleep = qemu_opt_get_bool(opts, "sleep", true);
     bool align = qemu_opt_get_bool(opts, "align", false);
+    uint64_t quantum = qemu_opt_get_number(opts, "quantum", 0);
     long time_shift = -1;
 
     if (!option) {
         if (qemu_opt_get(opts, "align") != NULL) {
             error_setg(errp, "Please specify shift option when using align");
+        } else if (qemu_opt_get(opts, "quantum") != NULL) {
+            error_setg(errp, "Please specify shift option when using quantum");
         }
         return;
     }
@@ -438,6 +463,21 @@ void icount_configure(QemuOpts *opts, Error **errp)
         return;
     }
 
+    if (quantum) {
+        if (quantum > INT32_MAX) {
+            error_setg(errp, "icount: Invalid quantum value");
+            return;
+        }
+        if (sleep) {
+            error_setg(errp, "quantum requires sleep=off");
+            return;
+        }
+        if (replay_mode != REPLAY_MODE_NONE) {
+            error_setg(errp, "quantum and rr are incompatible");
+            return;
+        }
+    }
+
     if (strcmp(option, "auto") != 0) {
         if (qemu_strtol(option, NULL, 0, &time_shift) < 0
             || time_shift < 0 || time_shift > MAX_ICOUNT_SHIFT) {
@@ -462,6 +502,7 @@ void icount_configure(QemuOpts *opts, Error **errp)
 
     if (time_shift >= 0) {
         timers_state.icount_time_shift = time_shift;
+        icount_quantum = quantum;
         icount_enable_precise();
         return;
     }
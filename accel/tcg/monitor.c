@@ -19,6 +19,7 @@
 #include "tcg/tcg.h"
 #include "internal-common.h"
 #include "tb-context.h"
+#include "tb-jmp-cache.h"
 
 
 static void dump_drift_info(GString *buf)
@@ -91,6 +92,9 @@ static void print_qht_statistics(struct qht_stats hst, GString *buf)
                            "Histogram: %s\n",
                            qdist_avg(&hst.chain), hgram);
     g_free(hgram);
+
+    g_string_append_printf(buf, "TB hash lookups     %zu retried\n",
+                           hst.lookup_retries);
 }
 
 struct tb_tree_stats {
@@ -126,19 +130,56 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
-static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
+static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide,
+                             size_t *pcoalesce)
 {
     CPUState *cpu;
-    size_t full = 0, part = 0, elide = 0;
+    size_t full = 0, part = 0, elide = 0, coalesce = 0;
 
     CPU_FOREACH(cpu) {
         full += qatomic_read(&cpu->neg.tlb.c.full_flush_count);
         part += qatomic_read(&cpu->neg.tlb.c.part_flush_count);
         elide += qatomic_read(&cpu->neg.tlb.c.elide_flush_count);
+        coalesce += qatomic_read(&cpu->neg.tlb.c.coalesced_flush_count);
     }
     *pfull = full;
     *ppart = part;
     *pelide = elide;
+    *pcoalesce = coalesce;
+}
+
+static void tlb_victim_counts(size_t *phits, size_t *pmisses)
+{
+    CPUState *cpu;
+    size_t hits = 0, misses = 0;
+
+    CPU_FOREACH(cpu) {
+        hits += qatomic_read(&cpu->neg.tlb.c.vtlb_hit_count);
+        misses += qatomic_read(&cpu->neg.tlb.c.vtlb_miss_count);
+    }
+    *phits = hits;
+    *pmisses = misses;
+}
+
+static void jmp_cache_counts(size_t *plookups, size_t *pmisses,
+                             size_t *pentries)
+{
+    CPUState *cpu;
+    size_t lookups = 0, misses = 0, entries = 0;
+
+    RCU_READ_LOCK_GUARD();
+    CPU_FOREACH(cpu) {
+        CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+
+        if (jc) {
+            lookups += qatomic_read(&jc->lookups);
+            misses += qatomic_read(&jc->misses);
+            entries += tb_jmp_cache_size(jc);
+        }
+    }
+    *plookups = lookups;
+    *pmisses = misses;
+    *pentries = entries;
 }
 
 static void tcg_dump_info(GString *buf)
@@ -150,7 +191,9 @@ static void dump_exec_info(GString *buf)
 {
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
-    size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t nb_tbs, flush_full, flush_part, flush_elide, flush_coalesce;
+    size_t jc_lookups, jc_misses, jc_entries;
+    size_t vtlb_hits, vtlb_misses;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -189,13 +232,26 @@ static void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "\nStatistics:\n");
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
+    g_string_append_printf(buf, "TB evict count      %u\n",
+                           qatomic_read(&tb_ctx.tb_evict_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
 
-    tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
+    tlb_flush_counts(&flush_full, &flush_part, &flush_elide, &flush_coalesce);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    g_string_append_printf(buf, "TLB merged flushes  %zu\n", flush_coalesce);
+
+    tlb_victim_counts(&vtlb_hits, &vtlb_misses);
+    g_string_append_printf(buf, "TLB victim hits     %zu\n", vtlb_hits);
+    g_string_append_printf(buf, "TLB victim misses   %zu\n", vtlb_misses);
+
+    jmp_cache_counts(&jc_lookups, &jc_misses, &jc_entries);
+    g_string_append_printf(buf, "JMP cache entries   %zu\n", jc_entries);
+    g_string_append_printf(buf, "JMP cache lookups   %zu\n", jc_lookups);
+    g_string_append_printf(buf, "JMP cache misses    %zu (%zu%%)\n", jc_misses,
+                           jc_lookups ? (jc_misses * 100) / jc_lookups : 0);
     tcg_dump_info(buf);
 }
 
@@ -11,6 +11,8 @@
 #include "qemu/osdep.h"
 #include "elf.h"
 #include "exec/exec-all.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
 #include "qemu/timer.h"
 #include "tcg/tcg.h"
 
@@ -44,12 +46,62 @@ static FILE *safe_fopen_w(const char *path)
     return f;
 }
 
+/*
+ * The entries are written by a separate thread, so that looking up the
+ * debuginfo and writing out the host code do not slow down translation.
+ * perf_report_code() captures everything that the translator may reuse
+ * or overwrite afterwards, together with the time of translation, and
+ * queues it for the writer.
+ */
+typedef struct PerfCode {
+    QSIMPLEQ_ENTRY(PerfCode) entry;
+    const void *start;
+    uint64_t timestamp;
+    uint32_t tid;
+    size_t icount;
+    uint64_t *guest_pc;     /* Guest address of each insn. */
+    uint16_t *end_off;      /* Copy of tcg_ctx->gen_insn_end_off. */
+    uint8_t *code;          /* Copy of the host code, for jitdump. */
+} PerfCode;
+
+/* Beyond this, translation waits for the writer to catch up. */
+#define PERF_QUEUE_MAX 4096
+
+static QemuMutex perf_lock;
+static QemuCond perf_cond;
+static QemuThread perf_writer;
+static QSIMPLEQ_HEAD(, PerfCode) perf_queue =
+    QSIMPLEQ_HEAD_INITIALIZER(perf_queue);
+static size_t perf_queue_len;
+static bool perf_writer_running;
+static bool perf_writer_stop;
+
+static void perf_atfork_prepare(void);
+static void perf_atfork_parent(void);
+static void perf_atfork_child(void);
+
+static void perf_init(void)
+{
+    static bool done;
+
+    if (!done) {
+        qemu_mutex_init(&perf_lock);
+        qemu_cond_init(&perf_cond);
+        pthread_atfork(perf_atfork_prepare, perf_atfork_parent,
+                       perf_atfork_child);
+        atexit(perf_exit);
+        done = true;
+    }
+}
+
 static FILE *perfmap;
 
 void perf_enable_perfmap(void)
 {
     char map_file[32];
 
+    perf_init();
+
     snprintf(map_file, sizeof(map_file), "/tmp/perf-%d.map", getpid());
     perfmap = safe_fopen_w(map_file);
     if (perfmap == NULL) {
@@ -60,15 +112,15 @@ void perf_enable_perfmap(void)
 
 /* Get PC and size of code JITed for guest instruction #INSN. */
 static void get_host_pc_size(uintptr_t *host_pc, uint16_t *host_size,
-                             const void *start, size_t insn)
+                             const PerfCode *code, size_t insn)
 {
-    uint16_t start_off = insn ? tcg_ctx->gen_insn_end_off[insn - 1] : 0;
+    uint16_t start_off = insn ? code->end_off[insn - 1] : 0;
 
     if (host_pc) {
-        *host_pc = (uintptr_t)start + start_off;
+        *host_pc = (uintptr_t)code->start + start_off;
     }
     if (host_size) {
-        *host_size = tcg_ctx->gen_insn_end_off[insn] - start_off;
+        *host_size = code->end_off[insn] - start_off;
     }
 }
 
@@ -99,13 +151,13 @@ static const char *pretty_symbol(const struct debuginfo_query *q, size_t *len)
     return buf;
 }
 
-static void write_perfmap_entry(const void *start, size_t insn,
+static void write_perfmap_entry(const PerfCode *code, size_t insn,
                                 const struct debuginfo_query *q)
 {
     uint16_t host_size;
     uintptr_t host_pc;
 
-    get_host_pc_size(&host_pc, &host_size, start, insn);
+    get_host_pc_size(&host_pc, &host_size, code, insn);
     fprintf(perfmap, "%"PRIxPTR" %"PRIx16" %s\n",
             host_pc, host_size, pretty_symbol(q, NULL));
 }
@@ -193,6 +245,8 @@ void perf_enable_jitdump(void)
     struct jitheader header;
     char jitdump_file[32];
 
+    perf_init();
+
     if (!use_rt_clock) {
         warn_report("CLOCK_MONOTONIC is not available, proceeding without jitdump");
         return;
@@ -242,10 +296,10 @@ void perf_report_prologue(const void *start, size_t size)
 }
 
 /* Write a JIT_CODE_DEBUG_INFO jitdump entry. */
-static void write_jr_code_debug_info(const void *start,
-                                     const struct debuginfo_query *q,
-                                     size_t icount)
+static void write_jr_code_debug_info(const PerfCode *code,
+                                     const struct debuginfo_query *q)
 {
+    size_t icount = code->icount;
     struct jr_code_debug_info rec;
     struct debug_entry ent;
     uintptr_t host_pc;
@@ -254,8 +308,8 @@ static void write_jr_code_debug_info(const void *start,
     /* Write the header. */
     rec.p.id = JIT_CODE_DEBUG_INFO;
     rec.p.total_size = sizeof(rec) + sizeof(ent) + 1;
-    rec.p.timestamp = get_clock();
-    rec.code_addr = (uintptr_t)start;
+    rec.p.timestamp = code->timestamp;
+    rec.code_addr = (uintptr_t)code->start;
     rec.nr_entry = 1;
     for (insn = 0; insn < icount; insn++) {
         if (q[insn].file) {
@@ -268,7 +322,7 @@ static void write_jr_code_debug_info(const void *start,
     /* Write the main debug entries. */
     for (insn = 0; insn < icount; insn++) {
         if (q[insn].file) {
-            get_host_pc_size(&host_pc, NULL, start, insn);
+            get_host_pc_size(&host_pc, NULL, code, insn);
             ent.addr = host_pc;
             ent.lineno = q[insn].line;
             ent.discrim = 0;
@@ -278,7 +332,7 @@ static void write_jr_code_debug_info(const void *start,
     }
 
     /* Write the trailing debug_entry. */
-    ent.addr = (uintptr_t)start + tcg_ctx->gen_insn_end_off[icount - 1];
+    ent.addr = (uintptr_t)code->start + code->end_off[icount - 1];
     ent.lineno = 0;
     ent.discrim = 0;
     fwrite(&ent, sizeof(ent), 1, jitdump);
@@ -286,41 +340,42 @@ static void write_jr_code_debug_info(const void *start,
 }
 
 /* Write a JIT_CODE_LOAD jitdump entry. */
-static void write_jr_code_load(const void *start, uint16_t host_size,
+static void write_jr_code_load(const PerfCode *code,
                                const struct debuginfo_query *q)
 {
     static uint64_t code_index;
+    uint16_t host_size = code->end_off[code->icount - 1];
     struct jr_code_load rec;
     const char *symbol;
     size_t symbol_size;
 
+    /*
+     * jitdump has no record for unloading code: when the code buffer is
+     * reused, perf picks the JIT_CODE_LOAD with the latest timestamp
+     * before each sample. This is why the timestamp is the time of
+     * translation rather than the time of writing.
+     */
     symbol = pretty_symbol(q, &symbol_size);
     rec.p.id = JIT_CODE_LOAD;
     rec.p.total_size = sizeof(rec) + symbol_size + host_size;
-    rec.p.timestamp = get_clock();
+    rec.p.timestamp = code->timestamp;
     rec.pid = getpid();
-    rec.tid = qemu_get_thread_id();
-    rec.vma = (uintptr_t)start;
-    rec.code_addr = (uintptr_t)start;
+    rec.tid = code->tid;
+    rec.vma = (uintptr_t)code->start;
+    rec.code_addr = (uintptr_t)code->start;
     rec.code_size = host_size;
     rec.code_index = code_index++;
     fwrite(&rec, sizeof(rec), 1, jitdump);
     fwrite(symbol, symbol_size, 1, jitdump);
-    fwrite(start, host_size, 1, jitdump);
+    fwrite(code->code, host_size, 1, jitdump);
 }
 
-void perf_report_code(uint64_t guest_pc, TranslationBlock *tb,
-                      const void *start)
+static void perf_write_code(const PerfCode *code)
 {
     struct debuginfo_query *q;
-    size_t insn, start_words;
-    uint64_t *gen_insn_data;
+    size_t insn;
 
-    if (!perfmap && !jitdump) {
-        return;
-    }
-
-    q = g_try_malloc0_n(tb->icount, sizeof(*q));
+    q = g_try_malloc0_n(code->icount, sizeof(*q));
     if (!q) {
         return;
     }
@@ -328,28 +383,17 @@ void perf_report_code(uint64_t guest_pc, TranslationBlock *tb,
     debuginfo_lock();
 
     /* Query debuginfo for each guest instruction. */
-    gen_insn_data = tcg_ctx->gen_insn_data;
-    start_words = tcg_ctx->insn_start_words;
-
-    for (insn = 0; insn < tb->icount; insn++) {
-        /* FIXME: This replicates the restore_state_to_opc() logic. */
-        q[insn].address = gen_insn_data[insn * start_words + 0];
-        if (tb_cflags(tb) & CF_PCREL) {
-            q[insn].address |= (guest_pc & TARGET_PAGE_MASK);
-        } else {
-#if defined(TARGET_I386)
-            q[insn].address -= tb->cs_base;
-#endif
-        }
+    for (insn = 0; insn < code->icount; insn++) {
+        q[insn].address = code->guest_pc[insn];
         q[insn].flags = DEBUGINFO_SYMBOL | (jitdump ? DEBUGINFO_LINE : 0);
     }
-    debuginfo_query(q, tb->icount);
+    debuginfo_query(q, code->icount);
 
     /* Emit perfmap entries if needed. */
     if (perfmap) {
         flockfile(perfmap);
-        for (insn = 0; insn < tb->icount; insn++) {
-            write_perfmap_entry(start, insn, &q[insn]);
+        for (insn = 0; insn < code->icount; insn++) {
+            write_perfmap_entry(code, insn, &q[insn]);
         }
         funlockfile(perfmap);
     }
@@ -357,9 +401,8 @@ void perf_report_code(uint64_t guest_pc, TranslationBlock *tb,
     /* Emit jitdump entries if needed. */
     if (jitdump) {
         flockfile(jitdump);
-        write_jr_code_debug_info(start, q, tb->icount);
-        write_jr_code_load(start, tcg_ctx->gen_insn_end_off[tb->icount - 1],
-                           q);
+        write_jr_code_debug_info(code, q);
+        write_jr_code_load(code, q);
         funlockfile(jitdump);
     }
 
@@ -367,8 +410,171 @@ void perf_report_code(uint64_t guest_pc, TranslationBlock *tb,
     g_free(q);
 }
 
+static void *perf_writer_thread(void *arg)
+{
+    QSIMPLEQ_HEAD(, PerfCode) batch = QSIMPLEQ_HEAD_INITIALIZER(batch);
+    PerfCode *code, *next;
+
+    qemu_mutex_lock(&perf_lock);
+    for (;;) {
+        while (QSIMPLEQ_EMPTY(&perf_queue) && !perf_writer_stop) {
+            qemu_cond_wait(&perf_cond, &perf_lock);
+        }
+        if (QSIMPLEQ_EMPTY(&perf_queue)) {
+            break;
+        }
+
+        /* Take everything queued so far and let translation continue. */
+        QSIMPLEQ_CONCAT(&batch, &perf_queue);
+        perf_queue_len = 0;
+        qemu_cond_broadcast(&perf_cond);
+        qemu_mutex_unlock(&perf_lock);
+
+        QSIMPLEQ_FOREACH_SAFE(code, &batch, entry, next) {
+            perf_write_code(code);
+            g_free(code);
+        }
+        QSIMPLEQ_INIT(&batch);
+        if (perfmap) {
+            fflush(perfmap);
+        }
+        if (jitdump) {
+            fflush(jitdump);
+        }
+
+        qemu_mutex_lock(&perf_lock);
+        qemu_cond_broadcast(&perf_cond);
+    }
+    qemu_mutex_unlock(&perf_lock);
+    return NULL;
+}
+
+/*
+ * Only the parent keeps the writer thread; the queued entries are the
+ * parent's too, so the child starts afresh and creates its own writer
+ * when it next translates.
+ */
+static void perf_atfork_prepare(void)
+{
+    qemu_mutex_lock(&perf_lock);
+}
+
+static void perf_atfork_parent(void)
+{
+    qemu_mutex_unlock(&perf_lock);
+}
+
+static void perf_atfork_child(void)
+{
+    PerfCode *code, *next;
+
+    QSIMPLEQ_FOREACH_SAFE(code, &perf_queue, entry, next) {
+        g_free(code);
+    }
+    QSIMPLEQ_INIT(&perf_queue);
+    perf_queue_len = 0;
+    perf_writer_running = false;
+    qemu_cond_init(&perf_cond);
+    qemu_mutex_unlock(&perf_lock);
+}
+
+void perf_report_code(uint64_t guest_pc, TranslationBlock *tb,
+                      const void *start)
+{
+    size_t insn, start_words, icount = tb->icount;
+    uint64_t *gen_insn_data;
+    uint16_t host_size;
+    PerfCode *code;
+    size_t size;
+
+    if (!perfmap && !jitdump) {
+        return;
+    }
+
+    host_size = tcg_ctx->gen_insn_end_off[icount - 1];
+    size = sizeof(*code) + icount * (sizeof(uint64_t) + sizeof(uint16_t));
+    if (jitdump) {
+        size += host_size;
+    }
+    code = g_try_malloc(size);
+    if (!code) {
+        return;
+    }
+
+    code->start = start;
+    code->timestamp = get_clock();
+    code->tid = qemu_get_thread_id();
+    code->icount = icount;
+    code->guest_pc = (uint64_t *)(code + 1);
+    code->end_off = (uint16_t *)(code->guest_pc + icount);
+    code->code = (uint8_t *)(code->end_off + icount);
+
+    gen_insn_data = tcg_ctx->gen_insn_data;
+    start_words = tcg_ctx->insn_start_words;
+
+    for (insn = 0; insn < icount; insn++) {
+        /* FIXME: This replicates the restore_state_to_opc() logic. */
+        code->guest_pc[insn] = gen_insn_data[insn * start_words + 0];
+        if (tb_cflags(tb) & CF_PCREL) {
+            code->guest_pc[insn] |= (guest_pc & TARGET_PAGE_MASK);
+        } else {
+#if defined(TARGET_I386)
+            code->guest_pc[insn] -= tb->cs_base;
+#endif
+        }
+    }
+    memcpy(code->end_off, tcg_ctx->gen_insn_end_off,
+           icount * sizeof(uint16_t));
+    if (jitdump) {
+        memcpy(code->code, start, host_size);
+    }
+
+    qemu_mutex_lock(&perf_lock);
+    if (perf_writer_stop) {
+        /* perf_exit() is in progress, the files are going away. */
+        qemu_mutex_unlock(&perf_lock);
+        g_free(code);
+        return;
+    }
+    if (!perf_writer_running) {
+        qemu_thread_create(&perf_writer, "perf-writer", perf_writer_thread,
+                           NULL, QEMU_THREAD_JOINABLE);
+        perf_writer_running = true;
+    }
+    while (perf_queue_len >= PERF_QUEUE_MAX) {
+        qemu_cond_wait(&perf_cond, &perf_lock);
+    }
+    QSIMPLEQ_INSERT_TAIL(&perf_queue, code, entry);
+    perf_queue_len++;
+    qemu_cond_broadcast(&perf_cond);
+    qemu_mutex_unlock(&perf_lock);
+}
+
+/* Write out everything queued so far and stop the writer thread. */
+static void perf_writer_flush(void)
+{
+    bool running;
+
+    qemu_mutex_lock(&perf_lock);
+    running = perf_writer_running;
+    perf_writer_stop = true;
+    perf_writer_running = false;
+    qemu_cond_broadcast(&perf_cond);
+    qemu_mutex_unlock(&perf_lock);
+
+    if (running) {
+        qemu_thread_join(&perf_writer);
+    }
+}
+
 void perf_exit(void)
 {
+    if (!perfmap && !jitdump) {
+        return;
+    }
+
+    perf_writer_flush();
+
     if (perfmap) {
         fclose(perfmap);
         perfmap = NULL;
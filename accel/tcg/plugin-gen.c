@@ -80,6 +80,8 @@ enum plugin_gen_from {
 enum plugin_gen_cb {
     PLUGIN_GEN_CB_UDATA,
     PLUGIN_GEN_CB_INLINE,
+    PLUGIN_GEN_CB_COND,
+    PLUGIN_GEN_CB_MEM_BATCH,
     PLUGIN_GEN_CB_MEM,
     PLUGIN_GEN_ENABLE_MEM_HELPER,
     PLUGIN_GEN_DISABLE_MEM_HELPER,
@@ -98,6 +100,12 @@ void HELPER(plugin_vcpu_mem_cb)(unsigned int vcpu_index,
                                 void *userdata)
 { }
 
+/* Unlike the stubs above, this one is called as is. */
+void HELPER(plugin_mem_batch_flush)(uint32_t cpu_index, void *batch)
+{
+    qemu_plugin_mem_batch_flush_vcpu(batch, cpu_index);
+}
+
 static void gen_empty_udata_cb(void)
 {
     TCGv_i32 cpu_index = tcg_temp_ebb_new_i32();
@@ -112,6 +120,29 @@ static void gen_empty_udata_cb(void)
     tcg_temp_free_i32(cpu_index);
 }
 
+/*
+ * Compute the address of the vCPU's counter, base + cpu_index * stride.
+ * Both base and stride are filled in when the callback is injected; for
+ * ops on a single global counter the stride is 0 and the optimizer
+ * folds the index computation away.
+ */
+static void gen_empty_vcpu_u64_ptr(TCGv_ptr ptr)
+{
+    TCGv_i32 cpu_index = tcg_temp_ebb_new_i32();
+    TCGv_ptr cpu_offset = tcg_temp_ebb_new_ptr();
+
+    tcg_gen_ld_i32(cpu_index, tcg_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    /* the second operand is replaced by the stride */
+    tcg_gen_mul_i32(cpu_index, cpu_index, cpu_index);
+    tcg_gen_ext_i32_ptr(cpu_offset, cpu_index);
+    tcg_gen_movi_ptr(ptr, 0);
+    tcg_gen_add_ptr(ptr, ptr, cpu_offset);
+
+    tcg_temp_free_ptr(cpu_offset);
+    tcg_temp_free_i32(cpu_index);
+}
+
 /*
  * For now we only support addi_i64.
  * When we support more ops, we can generate one empty inline cb for each.
@@ -121,7 +152,7 @@ static void gen_empty_inline_cb(void)
     TCGv_i64 val = tcg_temp_ebb_new_i64();
     TCGv_ptr ptr = tcg_temp_ebb_new_ptr();
 
-    tcg_gen_movi_ptr(ptr, 0);
+    gen_empty_vcpu_u64_ptr(ptr);
     tcg_gen_ld_i64(val, ptr, 0);
     /* pass an immediate != 0 so that it doesn't get optimized away */
     tcg_gen_addi_i64(val, val, 0xdeadface);
@@ -130,6 +161,33 @@ static void gen_empty_inline_cb(void)
     tcg_temp_free_i64(val);
 }
 
+/*
+ * The condition and immediate of the branch are replaced when the
+ * callback is injected, and each copy gets a label of its own.
+ */
+static void gen_empty_cond_cb(void)
+{
+    TCGv_i32 cpu_index = tcg_temp_ebb_new_i32();
+    TCGv_i64 val = tcg_temp_ebb_new_i64();
+    TCGv_ptr ptr = tcg_temp_ebb_new_ptr();
+    TCGv_ptr udata = tcg_temp_ebb_new_ptr();
+    TCGLabel *after_cb = gen_new_label();
+
+    gen_empty_vcpu_u64_ptr(ptr);
+    tcg_gen_ld_i64(val, ptr, 0);
+    tcg_gen_brcondi_i64(TCG_COND_EQ, val, 0xdeadface, after_cb);
+    tcg_gen_movi_ptr(udata, 0);
+    tcg_gen_ld_i32(cpu_index, tcg_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    gen_helper_plugin_vcpu_udata_cb(cpu_index, udata);
+    gen_set_label(after_cb);
+
+    tcg_temp_free_ptr(udata);
+    tcg_temp_free_ptr(ptr);
+    tcg_temp_free_i64(val);
+    tcg_temp_free_i32(cpu_index);
+}
+
 static void gen_empty_mem_cb(TCGv_i64 addr, uint32_t info)
 {
     TCGv_i32 cpu_index = tcg_temp_ebb_new_i32();
@@ -148,6 +206,29 @@ static void gen_empty_mem_cb(TCGv_i64 addr, uint32_t info)
     tcg_temp_free_i32(cpu_index);
 }
 
+/*
+ * The stores of a batched memory record. The ops that point @rec at the
+ * vCPU's next free record, and pass the record on, are generated when
+ * the callback is injected.
+ */
+static void gen_empty_mem_batch_cb(TCGv_i64 addr, uint32_t info)
+{
+    TCGv_ptr rec = tcg_temp_ebb_new_ptr();
+    uint64_t pc = tcg_ctx->plugin_insn->vaddr;
+
+    tcg_gen_st_i64(addr, rec, offsetof(qemu_plugin_mem_record, vaddr));
+    tcg_gen_st_i64(tcg_constant_i64(pc), rec,
+                   offsetof(qemu_plugin_mem_record, pc));
+    tcg_gen_st_i32(tcg_constant_i32(info), rec,
+                   offsetof(qemu_plugin_mem_record, info));
+    tcg_temp_free_ptr(rec);
+}
+
+/* Filled in entirely at injection time, see inject_mem_batch_flush. */
+static void gen_empty_mem_batch_flush(void)
+{
+}
+
 /*
  * Share the same function for enable/disable. When enabling, the NULL
  * pointer will be overwritten later.
@@ -190,10 +271,13 @@ static void plugin_gen_empty_callback(enum plugin_gen_from from)
          */
         gen_wrapped(from, PLUGIN_GEN_ENABLE_MEM_HELPER,
                     gen_empty_mem_helper);
+        gen_wrapped(from, PLUGIN_GEN_CB_MEM_BATCH,
+                    gen_empty_mem_batch_flush);
         /* fall through */
     case PLUGIN_GEN_FROM_TB:
         gen_wrapped(from, PLUGIN_GEN_CB_UDATA, gen_empty_udata_cb);
         gen_wrapped(from, PLUGIN_GEN_CB_INLINE, gen_empty_inline_cb);
+        gen_wrapped(from, PLUGIN_GEN_CB_COND, gen_empty_cond_cb);
         break;
     default:
         g_assert_not_reached();
@@ -211,6 +295,10 @@ void plugin_gen_empty_mem_callback(TCGv_i64 addr, uint32_t info)
     gen_plugin_cb_start(PLUGIN_GEN_FROM_MEM, PLUGIN_GEN_CB_INLINE, rw);
     gen_empty_inline_cb();
     tcg_gen_plugin_cb_end();
+
+    gen_plugin_cb_start(PLUGIN_GEN_FROM_MEM, PLUGIN_GEN_CB_MEM_BATCH, rw);
+    gen_empty_mem_batch_cb(addr, info);
+    tcg_gen_plugin_cb_end();
 }
 
 static TCGOp *find_op(TCGOp *op, TCGOpcode opc)
@@ -315,6 +403,80 @@ static TCGOp *copy_add_i64(TCGOp **begin_op, TCGOp *op, uint64_t v)
     return op;
 }
 
+static TCGOp *copy_mul_i32(TCGOp **begin_op, TCGOp *op, uint32_t v)
+{
+    op = copy_op(begin_op, op, INDEX_op_mul_i32);
+    op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+    return op;
+}
+
+static TCGOp *copy_ext_i32_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        op = copy_op(begin_op, op, INDEX_op_mov_i32);
+    } else {
+        op = copy_op(begin_op, op, INDEX_op_ext_i32_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_add_ptr(TCGOp **begin_op, TCGOp *op)
+{
+    if (UINTPTR_MAX == UINT32_MAX) {
+        op = copy_op(begin_op, op, INDEX_op_add_i32);
+    } else {
+        op = copy_op(begin_op, op, INDEX_op_add_i64);
+    }
+    return op;
+}
+
+static TCGOp *copy_vcpu_u64_ptr(TCGOp **begin_op, TCGOp *op,
+                                const qemu_plugin_u64 *entry, void *userp)
+{
+    /* ld_i32 cpu_index */
+    op = copy_op(begin_op, op, INDEX_op_ld_i32);
+    op = copy_mul_i32(begin_op, op, plugin_u64_stride(entry));
+    op = copy_ext_i32_ptr(begin_op, op);
+    op = copy_const_ptr(begin_op, op, plugin_u64_base(entry, userp));
+    op = copy_add_ptr(begin_op, op);
+    return op;
+}
+
+static void add_as_label_use(TCGLabel *l, TCGOp *op)
+{
+    TCGLabelUse *u = tcg_malloc(sizeof(TCGLabelUse));
+
+    u->op = op;
+    QSIMPLEQ_INSERT_TAIL(&l->branches, u, next);
+}
+
+static TCGOp *copy_brcondi_i64(TCGOp **begin_op, TCGOp *op, TCGCond cond,
+                               uint64_t v, TCGLabel *l)
+{
+    if (TCG_TARGET_REG_BITS == 32) {
+        op = copy_op(begin_op, op, INDEX_op_brcond2_i32);
+        op->args[2] = tcgv_i32_arg(tcg_constant_i32(v));
+        op->args[3] = tcgv_i32_arg(tcg_constant_i32(v >> 32));
+        op->args[4] = cond;
+        op->args[5] = label_arg(l);
+    } else {
+        op = copy_op(begin_op, op, INDEX_op_brcond_i64);
+        op->args[1] = tcgv_i64_arg(tcg_constant_i64(v));
+        op->args[2] = cond;
+        op->args[3] = label_arg(l);
+    }
+    add_as_label_use(l, op);
+    return op;
+}
+
+static TCGOp *copy_set_label(TCGOp **begin_op, TCGOp *op, TCGLabel *l)
+{
+    op = copy_op(begin_op, op, INDEX_op_set_label);
+    op->args[0] = label_arg(l);
+    l->present = 1;
+    return op;
+}
+
 static TCGOp *copy_st_ptr(TCGOp **begin_op, TCGOp *op)
 {
     if (UINTPTR_MAX == UINT32_MAX) {
@@ -380,8 +542,8 @@ static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
                                TCGOp *begin_op, TCGOp *op,
                                int *unused)
 {
-    /* const_ptr */
-    op = copy_const_ptr(&begin_op, op, cb->userp);
+    /* address of this vCPU's counter */
+    op = copy_vcpu_u64_ptr(&begin_op, op, &cb->inline_insn.entry, cb->userp);
 
     /* ld_i64 */
     op = copy_ld_i64(&begin_op, op);
@@ -395,6 +557,55 @@ static TCGOp *append_inline_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+static TCGCond plugin_cond_to_tcgcond(enum qemu_plugin_cond cond)
+{
+    switch (cond) {
+    case QEMU_PLUGIN_COND_EQ:
+        return TCG_COND_EQ;
+    case QEMU_PLUGIN_COND_NE:
+        return TCG_COND_NE;
+    case QEMU_PLUGIN_COND_LT:
+        return TCG_COND_LTU;
+    case QEMU_PLUGIN_COND_LE:
+        return TCG_COND_LEU;
+    case QEMU_PLUGIN_COND_GT:
+        return TCG_COND_GTU;
+    case QEMU_PLUGIN_COND_GE:
+        return TCG_COND_GEU;
+    default:
+        /* NEVER and ALWAYS are resolved at registration */
+        g_assert_not_reached();
+    }
+}
+
+static TCGOp *append_cond_cb(const struct qemu_plugin_dyn_cb *cb,
+                             TCGOp *begin_op, TCGOp *op, int *unused)
+{
+    TCGLabel *after_cb = gen_new_label();
+    TCGCond skip = tcg_invert_cond(plugin_cond_to_tcgcond(cb->cond.cond));
+    int cb_idx;
+
+    /* address of this vCPU's counter */
+    op = copy_vcpu_u64_ptr(&begin_op, op, &cb->cond.entry, NULL);
+
+    /* ld_i64 */
+    op = copy_ld_i64(&begin_op, op);
+
+    /* skip the call unless the condition holds */
+    op = copy_brcondi_i64(&begin_op, op, skip, cb->cond.imm, after_cb);
+
+    /* const_ptr */
+    op = copy_const_ptr(&begin_op, op, cb->userp);
+
+    /* ld_i32 */
+    op = copy_op(&begin_op, op, INDEX_op_ld_i32);
+
+    /* call */
+    op = copy_call(&begin_op, op, cb->f.vcpu_udata, &cb_idx);
+
+    return copy_set_label(&begin_op, op, after_cb);
+}
+
 static TCGOp *append_mem_cb(const struct qemu_plugin_dyn_cb *cb,
                             TCGOp *begin_op, TCGOp *op, int *cb_idx)
 {
@@ -424,6 +635,139 @@ static TCGOp *append_mem_cb(const struct qemu_plugin_dyn_cb *cb,
     return op;
 }
 
+/*
+ * Move the ops emitted after @last, i.e. at the end of the op stream,
+ * so that they follow @op. This lets injection use the regular tcg_gen_*
+ * functions for callbacks that have no ops to copy. Returns the last
+ * op moved.
+ */
+static TCGOp *move_ops_after(TCGOp *last, TCGOp *op)
+{
+    TCGOp *first;
+
+    tcg_debug_assert(last != op);
+    while ((first = QTAILQ_NEXT(last, link)) != NULL) {
+        QTAILQ_REMOVE(&tcg_ctx->ops, first, link);
+        QTAILQ_INSERT_AFTER(&tcg_ctx->ops, op, first, link);
+        op = first;
+    }
+    return op;
+}
+
+/* @ring = address of the vCPU's qemu_plugin_mem_ring in @batch */
+static void gen_mem_ring_ptr(TCGv_ptr ring, struct qemu_plugin_mem_batch *batch)
+{
+    TCGv_i32 cpu_index = tcg_temp_ebb_new_i32();
+
+    tcg_gen_ld_i32(cpu_index, tcg_env,
+                   -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+    tcg_gen_ext_i32_ptr(ring, cpu_index);
+    tcg_gen_muli_ptr(ring, ring,
+                     g_array_get_element_size(batch->rings->data));
+    tcg_gen_addi_ptr(ring, ring, (intptr_t)batch->rings->data->data);
+    tcg_temp_free_i32(cpu_index);
+}
+
+static TCGOp *append_mem_batch_cb(const struct qemu_plugin_dyn_cb *cb,
+                                  TCGOp *begin_op, TCGOp *op, int *unused)
+{
+    struct qemu_plugin_mem_batch *batch = cb->mem_batch.batch;
+    TCGOp *last = tcg_last_op();
+    TCGv_ptr ring = tcg_temp_ebb_new_ptr();
+    TCGv_ptr rec = tcg_temp_ebb_new_ptr();
+    TCGv_i64 seq = tcg_temp_ebb_new_i64();
+    TCGv_i32 idx = tcg_temp_ebb_new_i32();
+
+    /* rec = &ring->records[ring->seq++ & (n_records - 1)] */
+    gen_mem_ring_ptr(ring, batch);
+    tcg_gen_ld_i64(seq, ring, offsetof(struct qemu_plugin_mem_ring, seq));
+    tcg_gen_extrl_i64_i32(idx, seq);
+    tcg_gen_andi_i32(idx, idx, batch->n_records - 1);
+    tcg_gen_muli_i32(idx, idx, sizeof(qemu_plugin_mem_record));
+    tcg_gen_extu_i32_ptr(rec, idx);
+    tcg_gen_add_ptr(rec, rec, ring);
+    tcg_gen_addi_ptr(rec, rec, offsetof(struct qemu_plugin_mem_ring, records));
+    tcg_gen_addi_i64(seq, seq, 1);
+    tcg_gen_st_i64(seq, ring, offsetof(struct qemu_plugin_mem_ring, seq));
+    op = move_ops_after(last, op);
+
+    /* copy the stores of the record, rebased on @rec */
+    while (QTAILQ_NEXT(begin_op, link)->opc != INDEX_op_plugin_cb_end) {
+        op = copy_op_nocheck(&begin_op, op);
+        op->args[1] = tcgv_ptr_arg(rec);
+    }
+
+    tcg_temp_free_i32(idx);
+    tcg_temp_free_i64(seq);
+    tcg_temp_free_ptr(rec);
+    tcg_temp_free_ptr(ring);
+    return op;
+}
+
+/*
+ * At the start of an instruction that records accesses into batches,
+ * hand each vCPU's records to the plugin once its ring is half full. This
+ * is done here rather than after each access because branching is only
+ * safe between instructions; a single instruction may therefore make at
+ * most n_records / 2 accesses without losing any.
+ */
+static void inject_mem_batch_flush(const GArray *cbs, TCGOp *begin_op)
+{
+    TCGOp *end_op = find_op(begin_op, INDEX_op_plugin_cb_end);
+    TCGOp *op = end_op;
+    int i, j;
+
+    tcg_debug_assert(end_op);
+    for (i = 0; i < cbs->len; i++) {
+        struct qemu_plugin_mem_batch *batch =
+            g_array_index(cbs, struct qemu_plugin_dyn_cb, i).mem_batch.batch;
+        TCGOp *last = tcg_last_op();
+        TCGv_ptr ring, udata;
+        TCGv_i64 pending, flushed;
+        TCGv_i32 cpu_index;
+        TCGLabel *skip;
+
+        /* reads and writes may be recorded into the same batch */
+        for (j = 0; j < i; j++) {
+            if (g_array_index(cbs, struct qemu_plugin_dyn_cb,
+                              j).mem_batch.batch == batch) {
+                break;
+            }
+        }
+        if (j < i) {
+            continue;
+        }
+
+        ring = tcg_temp_ebb_new_ptr();
+        pending = tcg_temp_ebb_new_i64();
+        flushed = tcg_temp_ebb_new_i64();
+        skip = gen_new_label();
+
+        gen_mem_ring_ptr(ring, batch);
+        tcg_gen_ld_i64(pending, ring,
+                       offsetof(struct qemu_plugin_mem_ring, seq));
+        tcg_gen_ld_i64(flushed, ring,
+                       offsetof(struct qemu_plugin_mem_ring, flushed));
+        tcg_gen_sub_i64(pending, pending, flushed);
+        tcg_gen_brcondi_i64(TCG_COND_LTU, pending, batch->n_records / 2,
+                            skip);
+        tcg_temp_free_i64(flushed);
+        tcg_temp_free_i64(pending);
+        tcg_temp_free_ptr(ring);
+
+        cpu_index = tcg_temp_ebb_new_i32();
+        udata = tcg_constant_ptr(batch);
+        tcg_gen_ld_i32(cpu_index, tcg_env,
+                       -offsetof(ArchCPU, env) + offsetof(CPUState, cpu_index));
+        gen_helper_plugin_mem_batch_flush(cpu_index, udata);
+        tcg_temp_free_i32(cpu_index);
+        gen_set_label(skip);
+
+        op = move_ops_after(last, op);
+    }
+    rm_ops_range(begin_op, end_op);
+}
+
 typedef TCGOp *(*inject_fn)(const struct qemu_plugin_dyn_cb *cb,
                             TCGOp *begin_op, TCGOp *op, int *intp);
 typedef bool (*op_ok_fn)(const TCGOp *op, const struct qemu_plugin_dyn_cb *cb);
@@ -482,6 +826,28 @@ inject_inline_cb(const GArray *cbs, TCGOp *begin_op, op_ok_fn ok)
     inject_cb_type(cbs, begin_op, append_inline_cb, ok);
 }
 
+static void
+inject_cond_cb(const GArray *cbs, TCGOp *begin_op)
+{
+    TCGOp *br_op;
+    TCGLabel *l;
+
+    /*
+     * The empty callback is removed below; forget its branch so that
+     * no use of its label refers to a removed op.
+     */
+    if (TCG_TARGET_REG_BITS == 32) {
+        br_op = find_op(begin_op, INDEX_op_brcond2_i32);
+        l = arg_label(br_op->args[5]);
+    } else {
+        br_op = find_op(begin_op, INDEX_op_brcond_i64);
+        l = arg_label(br_op->args[3]);
+    }
+    QSIMPLEQ_INIT(&l->branches);
+
+    inject_cb_type(cbs, begin_op, append_cond_cb, op_ok);
+}
+
 static void
 inject_mem_cb(const GArray *cbs, TCGOp *begin_op)
 {
@@ -523,12 +889,13 @@ static void inject_mem_enable_helper(struct qemu_plugin_tb *ptb,
                                      struct qemu_plugin_insn *plugin_insn,
                                      TCGOp *begin_op)
 {
-    GArray *cbs[2];
+    GArray *cbs[3];
     GArray *arr;
     size_t n_cbs, i;
 
     cbs[0] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_REGULAR];
     cbs[1] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_INLINE];
+    cbs[2] = plugin_insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_BATCH];
 
     n_cbs = 0;
     for (i = 0; i < ARRAY_SIZE(cbs); i++) {
@@ -594,6 +961,12 @@ static void plugin_gen_tb_inline(const struct qemu_plugin_tb *ptb,
     inject_inline_cb(ptb->cbs[PLUGIN_CB_INLINE], begin_op, op_ok);
 }
 
+static void plugin_gen_tb_cond(const struct qemu_plugin_tb *ptb,
+                               TCGOp *begin_op)
+{
+    inject_cond_cb(ptb->cbs[PLUGIN_CB_COND], begin_op);
+}
+
 static void plugin_gen_insn_udata(const struct qemu_plugin_tb *ptb,
                                   TCGOp *begin_op, int insn_idx)
 {
@@ -610,6 +983,14 @@ static void plugin_gen_insn_inline(const struct qemu_plugin_tb *ptb,
                      begin_op, op_ok);
 }
 
+static void plugin_gen_insn_cond(const struct qemu_plugin_tb *ptb,
+                                 TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+
+    inject_cond_cb(insn->cbs[PLUGIN_CB_INSN][PLUGIN_CB_COND], begin_op);
+}
+
 static void plugin_gen_mem_regular(const struct qemu_plugin_tb *ptb,
                                    TCGOp *begin_op, int insn_idx)
 {
@@ -627,6 +1008,24 @@ static void plugin_gen_mem_inline(const struct qemu_plugin_tb *ptb,
     inject_inline_cb(cbs, begin_op, op_rw);
 }
 
+static void plugin_gen_mem_batch(const struct qemu_plugin_tb *ptb,
+                                 TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+
+    inject_cb_type(insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_BATCH], begin_op,
+                   append_mem_batch_cb, op_rw);
+}
+
+static void plugin_gen_insn_mem_batch_flush(const struct qemu_plugin_tb *ptb,
+                                            TCGOp *begin_op, int insn_idx)
+{
+    struct qemu_plugin_insn *insn = g_ptr_array_index(ptb->insns, insn_idx);
+
+    inject_mem_batch_flush(insn->cbs[PLUGIN_CB_MEM][PLUGIN_CB_BATCH],
+                           begin_op);
+}
+
 static void plugin_gen_enable_mem_helper(struct qemu_plugin_tb *ptb,
                                          TCGOp *begin_op, int insn_idx)
 {
@@ -676,6 +1075,12 @@ static void pr_ops(void)
             case PLUGIN_GEN_CB_INLINE:
                 type = "inline";
                 break;
+            case PLUGIN_GEN_CB_COND:
+                type = "cond";
+                break;
+            case PLUGIN_GEN_CB_MEM_BATCH:
+                type = "mem batch";
+                break;
             case PLUGIN_GEN_CB_MEM:
                 type = "mem";
                 break;
@@ -724,6 +1129,9 @@ static void plugin_gen_inject(struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_tb_inline(plugin_tb, op);
                     break;
+                case PLUGIN_GEN_CB_COND:
+                    plugin_gen_tb_cond(plugin_tb, op);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -740,6 +1148,12 @@ static void plugin_gen_inject(struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_insn_inline(plugin_tb, op, insn_idx);
                     break;
+                case PLUGIN_GEN_CB_COND:
+                    plugin_gen_insn_cond(plugin_tb, op, insn_idx);
+                    break;
+                case PLUGIN_GEN_CB_MEM_BATCH:
+                    plugin_gen_insn_mem_batch_flush(plugin_tb, op, insn_idx);
+                    break;
                 case PLUGIN_GEN_ENABLE_MEM_HELPER:
                     plugin_gen_enable_mem_helper(plugin_tb, op, insn_idx);
                     break;
@@ -759,6 +1173,9 @@ static void plugin_gen_inject(struct qemu_plugin_tb *plugin_tb)
                 case PLUGIN_GEN_CB_INLINE:
                     plugin_gen_mem_inline(plugin_tb, op, insn_idx);
                     break;
+                case PLUGIN_GEN_CB_MEM_BATCH:
+                    plugin_gen_mem_batch(plugin_tb, op, insn_idx);
+                    break;
                 default:
                     g_assert_not_reached();
                 }
@@ -9,20 +9,51 @@
 #ifndef ACCEL_TCG_TB_JMP_CACHE_H
 #define ACCEL_TCG_TB_JMP_CACHE_H
 
+/*
+ * The cache starts with TB_JMP_CACHE_BITS and is grown by the owning
+ * vCPU, two bits at a time, up to TB_JMP_CACHE_MAX_BITS when the miss
+ * rate measured over TB_JMP_CACHE_WINDOW misses exceeds 1 in
+ * TB_JMP_CACHE_GROW_RATIO lookups.
+ */
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+#define TB_JMP_CACHE_MAX_BITS 16
+#define TB_JMP_CACHE_WINDOW 4096
+#define TB_JMP_CACHE_GROW_RATIO 16
 
 /*
  * Accessed in parallel; all accesses to 'tb' must be atomic.
  * For CF_PCREL, accesses to 'pc' must be protected by a
  * load_acquire/store_release to 'tb'.
+ *
+ * The cache itself is replaced when it grows, so other threads
+ * must only dereference cpu->tb_jmp_cache within an RCU critical
+ * section.  The statistics are only written by the owning vCPU.
  */
 struct CPUJumpCache {
     struct rcu_head rcu;
+    unsigned int bits;
+    size_t lookups;
+    size_t misses;
+    size_t window_lookups;
     struct {
         TranslationBlock *tb;
         vaddr pc;
-    } array[TB_JMP_CACHE_SIZE];
+    } array[];
 };
 
+static inline size_t tb_jmp_cache_size(const CPUJumpCache *jc)
+{
+    return (size_t)1 << jc->bits;
+}
+
+static inline CPUJumpCache *tb_jmp_cache_new(unsigned int bits)
+{
+    CPUJumpCache *jc;
+
+    jc = g_malloc0(sizeof(*jc) + (sizeof(jc->array[0]) << bits));
+    jc->bits = bits;
+    return jc;
+}
+
 #endif /* ACCEL_TCG_TB_JMP_CACHE_H */
@@ -20,6 +20,7 @@
 #include "qemu/osdep.h"
 #include "qemu/interval-tree.h"
 #include "qemu/qtree.h"
+#include "qemu/thread-stats.h"
 #include "exec/cputlb.h"
 #include "exec/log.h"
 #include "exec/exec-all.h"
@@ -798,6 +799,56 @@ void tb_flush(CPUState *cpu)
     }
 }
 
+static unsigned tb_evict_gen(void)
+{
+    return qatomic_read(&tb_ctx.tb_flush_count) +
+           qatomic_read(&tb_ctx.tb_evict_count);
+}
+
+static void tb_evict_one(TranslationBlock *tb)
+{
+    if (!(tb_cflags(tb) & CF_INVALID)) {
+        tb_phys_invalidate(tb, -1);
+    }
+}
+
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_evict_gen_data)
+{
+    bool evicted;
+
+    mmap_lock();
+    /* Another CPU may have made room in the meantime */
+    if (tb_evict_gen() != tb_evict_gen_data.host_int) {
+        mmap_unlock();
+        return;
+    }
+
+    qemu_thread_jit_write();
+    evicted = tcg_region_evict(tb_evict_one);
+    qemu_thread_jit_execute();
+    if (evicted) {
+        qatomic_inc(&tb_ctx.tb_evict_count);
+    }
+    mmap_unlock();
+
+    if (!evicted) {
+        do_tb_flush(cpu, RUN_ON_CPU_HOST_INT(tb_ctx.tb_flush_count));
+    }
+}
+
+void tb_evict(CPUState *cpu)
+{
+    if (tcg_enabled()) {
+        unsigned gen = tb_evict_gen();
+
+        if (cpu_in_serial_context(cpu)) {
+            do_tb_evict(cpu, RUN_ON_CPU_HOST_INT(gen));
+        } else {
+            async_safe_run_on_cpu(cpu, do_tb_evict, RUN_ON_CPU_HOST_INT(gen));
+        }
+    }
+}
+
 /* remove @orig from its @n_orig-th jump list */
 static inline void tb_remove_from_jmp_list(TranslationBlock *orig, int n_orig)
 {
@@ -884,10 +935,11 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
             tcg_flush_jmp_cache(cpu);
         }
     } else {
-        uint32_t h = tb_jmp_cache_hash_func(tb->pc);
+        RCU_READ_LOCK_GUARD();
 
         CPU_FOREACH(cpu) {
-            CPUJumpCache *jc = cpu->tb_jmp_cache;
+            CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+            uint32_t h = tb_jmp_cache_hash_func(jc, tb->pc);
 
             if (qatomic_read(&jc->array[h].tb) == tb) {
                 qatomic_set(&jc->array[h].tb, NULL);
@@ -908,6 +960,7 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
     uint32_t orig_cflags = tb_cflags(tb);
 
     assert_memory_lock();
+    qemu_thread_stat_add(QEMU_STAT_TB_INVALIDATIONS, 1);
 
     /* make sure no further incoming jumps will be chained to this TB */
     qemu_spin_lock(&tb->jmp_lock);
@@ -28,6 +28,7 @@
 #include "sysemu/cpu-timers.h"
 #include "qemu/main-loop.h"
 #include "qemu/guest-random.h"
+#include "sysemu/cpus.h"
 #include "exec/exec-all.h"
 
 #include "tcg-accel-ops.h"
@@ -158,3 +159,234 @@ void icount_handle_interrupt(CPUState *cpu, int mask)
         cpu_abort(cpu, "Raised interrupt while not in I/O function");
     }
 }
+
+/*
+ * Parallel icount
+ *
+ * With multi-threaded TCG, every vCPU counts its own instructions and time
+ * advances in quanta: each vCPU runs until it has executed icount_quantum
+ * instructions from the start of the quantum (or goes idle), then waits
+ * for the others.  The last vCPU to arrive moves QEMU_CLOCK_VIRTUAL to the
+ * end of the quantum and runs its expired timers while all vCPUs are
+ * stopped, so that device emulation only ever sees a consistent state.
+ *
+ * Anything that does not depend on the vCPU alone is moved to the end of
+ * the quantum and done in a fixed order:
+ * - a vCPU that accesses a device stops before the access, or waits in
+ *   place if the access cannot be rewound; once all vCPUs have arrived,
+ *   the stopped vCPUs finish their quantum one at a time, in cpu_index
+ *   order, and with I/O allowed;
+ * - interrupts raised by other threads are delivered together.
+ *
+ * Guest RAM is still accessed in parallel, so runs are only reproducible
+ * if the vCPUs do not race on shared memory within a quantum.
+ */
+static struct {
+    /* Time at the start and at the end of the current quantum */
+    int64_t start;
+    int64_t end;
+    /* vCPU that finishes its quantum with I/O allowed */
+    CPUState *io_cpu;
+    /* The BQL holder is running timers while all vCPUs wait */
+    bool in_sync;
+} icount_sync;
+
+static bool icount_quantum_arrived(CPUState *cpu)
+{
+    /* icount_local and icount_io_pending are written without the BQL */
+    return qatomic_read(&cpu->icount_io_pending) ||
+           qatomic_read_i64(&cpu->icount_local) >= icount_sync.end;
+}
+
+static void icount_quantum_release(void)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        qemu_cond_broadcast(cpu->halt_cond);
+    }
+}
+
+/*
+ * Called with the BQL held when the vCPU is about to wait.  If all vCPUs
+ * have arrived, let the next one that stopped for I/O go on, or end the
+ * quantum.  Returns true if the vCPUs were released.
+ */
+static bool icount_quantum_try_sync(void)
+{
+    CPUState *cpu;
+    int64_t deadline, len;
+    bool idle = true;
+
+    if (icount_sync.io_cpu) {
+        if (!icount_quantum_arrived(icount_sync.io_cpu)) {
+            return false;
+        }
+        qatomic_set(&icount_sync.io_cpu->icount_io_granted, false);
+        icount_sync.io_cpu = NULL;
+    }
+
+    CPU_FOREACH(cpu) {
+        if (!icount_quantum_arrived(cpu)) {
+            return false;
+        }
+    }
+
+    CPU_FOREACH(cpu) {
+        if (qatomic_read(&cpu->icount_io_pending)) {
+            qatomic_set(&cpu->icount_io_pending, false);
+            qatomic_set(&cpu->icount_io_granted, true);
+            icount_sync.io_cpu = cpu;
+            qemu_cond_broadcast(cpu->halt_cond);
+            return true;
+        }
+    }
+
+    icount_sync.in_sync = true;
+    icount_set_raw(icount_sync.end);
+    icount_notify_aio_contexts();
+
+    CPU_FOREACH(cpu) {
+        if (cpu->icount_deferred_irq) {
+            int mask = cpu->icount_deferred_irq;
+
+            cpu->icount_deferred_irq = 0;
+            tcg_handle_interrupt(cpu, mask);
+        }
+        idle &= cpu_thread_is_idle(cpu);
+    }
+    icount_sync.in_sync = false;
+
+    deadline = qemu_clock_deadline_ns_all(QEMU_CLOCK_VIRTUAL,
+                                          QEMU_TIMER_ATTR_ALL);
+    len = deadline < 0 ? INT64_MAX : MAX(icount_round(deadline), 1);
+    if (idle) {
+        /* Skip to the next timer, or wait for an external event */
+        if (deadline < 0) {
+            return false;
+        }
+    } else {
+        len = MIN(len, icount_quantum);
+    }
+
+    icount_sync.start = icount_sync.end;
+    qatomic_set_i64(&icount_sync.end, icount_sync.end + len);
+    icount_quantum_release();
+    return true;
+}
+
+void icount_quantum_init_cpu(CPUState *cpu)
+{
+    qatomic_set_i64(&cpu->icount_local, icount_sync.start);
+}
+
+void icount_quantum_exit_cpu(CPUState *cpu)
+{
+    /* Never wait for this vCPU again */
+    qatomic_set_i64(&cpu->icount_local, INT64_MAX);
+    icount_quantum_try_sync();
+}
+
+void icount_quantum_prepare(CPUState *cpu)
+{
+    int insns_left;
+
+    g_assert(cpu->neg.icount_decr.u16.low == 0);
+    g_assert(cpu->icount_extra == 0);
+
+    cpu->icount_budget = qatomic_read_i64(&icount_sync.end) -
+                         cpu->icount_local;
+    insns_left = MIN(0xffff, cpu->icount_budget);
+    cpu->neg.icount_decr.u16.low = insns_left;
+    cpu->icount_extra = cpu->icount_budget - insns_left;
+}
+
+void icount_quantum_process(CPUState *cpu)
+{
+    icount_update(cpu);
+
+    cpu->neg.icount_decr.u16.low = 0;
+    cpu->icount_extra = 0;
+    cpu->icount_budget = 0;
+}
+
+/*
+ * Replaces qemu_wait_io_event() for parallel icount: wait until the vCPU
+ * can run in the current quantum.
+ */
+void icount_quantum_wait_io_event(CPUState *cpu)
+{
+    for (;;) {
+        qemu_wait_io_event_common(cpu);
+        if (cpu->unplug) {
+            return;
+        }
+        if (!cpu_is_stopped(cpu)) {
+            if (cpu_thread_is_idle(cpu)) {
+                /* Halted until the end of the quantum */
+                qatomic_set_i64(&cpu->icount_local,
+                                MAX(cpu->icount_local, icount_sync.end));
+            }
+            if (!icount_quantum_arrived(cpu)) {
+                return;
+            }
+            if (icount_quantum_try_sync() && !icount_quantum_arrived(cpu)) {
+                return;
+            }
+        }
+        qemu_cond_wait_iothread(cpu->halt_cond);
+    }
+}
+
+/*
+ * Called by a vCPU thread before a device access that cannot be rewound,
+ * because it is not done by translated code (for example port I/O from a
+ * helper, or address_space_* accesses): wait in place until the vCPU may
+ * do I/O.
+ */
+void icount_quantum_prepare_io(CPUState *cpu)
+{
+    bool release_lock = false;
+
+    /* Only the vCPU itself can lose the grant, when it arrives */
+    if (qatomic_read(&cpu->icount_io_granted)) {
+        return;
+    }
+    if (!qemu_mutex_iothread_locked()) {
+        qemu_mutex_lock_iothread();
+        release_lock = true;
+    }
+
+    /*
+     * Timers run by icount_quantum_try_sync() may access devices right
+     * away; they run in this thread while it holds the BQL.
+     */
+    if (!icount_sync.in_sync && !qatomic_read(&cpu->icount_io_granted)) {
+        qatomic_set(&cpu->icount_io_pending, true);
+        icount_quantum_try_sync();
+        while (qatomic_read(&cpu->icount_io_pending) &&
+               !cpu->stop && !cpu->unplug) {
+            qemu_cond_wait_iothread(cpu->halt_cond);
+        }
+        /* A vCPU that must stop does the access now */
+        qatomic_set(&cpu->icount_io_pending, false);
+    }
+
+    if (release_lock) {
+        qemu_mutex_unlock_iothread();
+    }
+}
+
+void icount_quantum_handle_interrupt(CPUState *cpu, int mask)
+{
+    g_assert(qemu_mutex_iothread_locked());
+
+    if (icount_sync.in_sync || qemu_cpu_is_self(cpu)) {
+        icount_handle_interrupt(cpu, mask);
+        return;
+    }
+
+    /* Deliver it at the end of the quantum, but wake up an idle vCPU */
+    cpu->icount_deferred_irq |= mask;
+    qemu_cond_broadcast(cpu->halt_cond);
+}
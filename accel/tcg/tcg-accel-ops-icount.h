@@ -17,4 +17,12 @@ void icount_process_data(CPUState *cpu);
 
 void icount_handle_interrupt(CPUState *cpu, int mask);
 
+void icount_quantum_init_cpu(CPUState *cpu);
+void icount_quantum_exit_cpu(CPUState *cpu);
+void icount_quantum_prepare(CPUState *cpu);
+void icount_quantum_process(CPUState *cpu);
+void icount_quantum_wait_io_event(CPUState *cpu);
+void icount_quantum_prepare_io(CPUState *cpu);
+void icount_quantum_handle_interrupt(CPUState *cpu, int mask);
+
 #endif /* TCG_ACCEL_OPS_ICOUNT_H */
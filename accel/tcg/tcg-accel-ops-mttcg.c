@@ -34,6 +34,7 @@
 #include "hw/boards.h"
 #include "tcg/startup.h"
 #include "tcg-accel-ops.h"
+#include "tcg-accel-ops-icount.h"
 #include "tcg-accel-ops-mttcg.h"
 
 typedef struct MttcgForceRcuNotifier {
@@ -60,6 +61,9 @@ static void mttcg_force_rcu(Notifier *notify, void *data)
  * In the multi-threaded case each vCPU has its own thread. The TLS
  * variable current_cpu can be used deep in the code to find the
  * current CPUState for a given thread.
+ *
+ * With icount, the vCPUs synchronize at the end of every quantum,
+ * see tcg-accel-ops-icount.c.
  */
 
 static void *mttcg_cpu_thread_fn(void *arg)
@@ -68,7 +72,7 @@ static void *mttcg_cpu_thread_fn(void *arg)
     CPUState *cpu = arg;
 
     assert(tcg_enabled());
-    g_assert(!icount_enabled());
+    g_assert(!icount_enabled() || icount_quantum);
 
     rcu_register_thread();
     force_rcu.notifier.notify = mttcg_force_rcu;
@@ -84,6 +88,9 @@ static void *mttcg_cpu_thread_fn(void *arg)
     current_cpu = cpu;
     cpu_thread_signal_created(cpu);
     qemu_guest_random_seed_thread_part2(cpu->random_seed);
+    if (icount_enabled()) {
+        icount_quantum_init_cpu(cpu);
+    }
 
     /* process any pending work */
     cpu->exit_request = 1;
@@ -92,7 +99,13 @@ static void *mttcg_cpu_thread_fn(void *arg)
         if (cpu_can_run(cpu)) {
             int r;
             qemu_mutex_unlock_iothread();
+            if (icount_enabled()) {
+                icount_quantum_prepare(cpu);
+            }
             r = tcg_cpus_exec(cpu);
+            if (icount_enabled()) {
+                icount_quantum_process(cpu);
+            }
             qemu_mutex_lock_iothread();
             switch (r) {
             case EXCP_DEBUG:
@@ -106,7 +119,13 @@ static void *mttcg_cpu_thread_fn(void *arg)
                 break;
             case EXCP_ATOMIC:
                 qemu_mutex_unlock_iothread();
+                if (icount_enabled()) {
+                    icount_quantum_prepare(cpu);
+                }
                 cpu_exec_step_atomic(cpu);
+                if (icount_enabled()) {
+                    icount_quantum_process(cpu);
+                }
                 qemu_mutex_lock_iothread();
             default:
                 /* Ignore everything else? */
@@ -115,9 +134,16 @@ static void *mttcg_cpu_thread_fn(void *arg)
         }
 
         qatomic_set_mb(&cpu->exit_request, 0);
-        qemu_wait_io_event(cpu);
+        if (icount_enabled()) {
+            icount_quantum_wait_io_event(cpu);
+        } else {
+            qemu_wait_io_event(cpu);
+        }
     } while (!cpu->unplug || cpu_can_run(cpu));
 
+    if (icount_enabled()) {
+        icount_quantum_exit_cpu(cpu);
+    }
     tcg_cpus_destroy(cpu);
     qemu_mutex_unlock_iothread();
     rcu_remove_force_rcu_notifier(&force_rcu.notifier);
@@ -145,6 +171,5 @@ void mttcg_start_vcpu_thread(CPUState *cpu)
     snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "CPU %d/TCG",
              cpu->cpu_index);
 
-    qemu_thread_create(cpu->thread, thread_name, mttcg_cpu_thread_fn,
-                       cpu, QEMU_THREAD_JOINABLE);
+    qemu_vcpu_thread_create(cpu, thread_name, mttcg_cpu_thread_fn);
 }
@@ -29,6 +29,7 @@
 #include "sysemu/cpu-timers.h"
 #include "tcg/startup.h"
 #include "tcg/oversized-guest.h"
+#include "tcg/tcg.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
 #include "qemu/accel.h"
@@ -45,6 +46,8 @@ struct TCGState {
 
     bool mttcg_enabled;
     bool one_insn_per_tb;
+    bool atomic_locks;
+    bool acq_rel;
     int splitwx_enabled;
     unsigned long tb_size;
 };
@@ -70,7 +73,7 @@ DECLARE_INSTANCE_CHECKER(TCGState, TCG_STATE,
 
 static bool default_mttcg_enabled(void)
 {
-    if (icount_enabled() || TCG_OVERSIZED_GUEST) {
+    if ((icount_enabled() && !icount_quantum) || TCG_OVERSIZED_GUEST) {
         return false;
     }
 #ifdef TARGET_SUPPORTS_MTTCG
@@ -112,6 +115,11 @@ static int tcg_init_machine(MachineState *ms)
     tcg_allowed = true;
     mttcg_enabled = s->mttcg_enabled;
 
+    if (icount_quantum && !mttcg_enabled) {
+        warn_report("icount quantum has no effect without MTTCG");
+        icount_quantum = 0;
+    }
+
     page_init();
     tb_htable_init();
     tcg_init(s->tb_size * MiB, s->splitwx_enabled, max_cpus);
@@ -141,8 +149,9 @@ static void tcg_set_thread(Object *obj, const char *value, Error **errp)
     if (strcmp(value, "multi") == 0) {
         if (TCG_OVERSIZED_GUEST) {
             error_setg(errp, "No MTTCG when guest word size > hosts");
-        } else if (icount_enabled()) {
-            error_setg(errp, "No MTTCG when icount is enabled");
+        } else if (icount_enabled() && !icount_quantum) {
+            error_setg(errp, "No MTTCG when icount is enabled without "
+                       "a quantum");
         } else {
 #ifndef TARGET_SUPPORTS_MTTCG
             warn_report("Guest not yet converted to MTTCG - "
@@ -207,6 +216,32 @@ static void tcg_set_one_insn_per_tb(Object *obj, bool value, Error **errp)
     qatomic_set(&one_insn_per_tb, value);
 }
 
+static bool tcg_get_atomic_locks(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->atomic_locks;
+}
+
+static void tcg_set_atomic_locks(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->atomic_locks = value;
+    qatomic_set(&tcg_atomic_locks, value);
+}
+
+static bool tcg_get_acq_rel(Object *obj, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    return s->acq_rel;
+}
+
+static void tcg_set_acq_rel(Object *obj, bool value, Error **errp)
+{
+    TCGState *s = TCG_STATE(obj);
+    s->acq_rel = value;
+    qatomic_set(&tcg_acq_rel, value);
+}
+
 static int tcg_gdbstub_supported_sstep_flags(void)
 {
     /*
@@ -252,6 +287,18 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
                                    tcg_set_one_insn_per_tb);
     object_class_property_set_description(oc, "one-insn-per-tb",
         "Only put one guest insn in each translation block");
+
+    object_class_property_add_bool(oc, "atomic-locks",
+                                   tcg_get_atomic_locks,
+                                   tcg_set_atomic_locks);
+    object_class_property_set_description(oc, "atomic-locks",
+        "Emulate atomics wider than the host under address locks");
+
+    object_class_property_add_bool(oc, "acq-rel",
+                                   tcg_get_acq_rel,
+                                   tcg_set_acq_rel);
+    object_class_property_set_description(oc, "acq-rel",
+        "Order guest memory accesses with host acquire/release");
 }
 
 static const TypeInfo tcg_accel_type = {
@@ -52,6 +52,7 @@
 #include "qemu/main-loop.h"
 #include "qemu/cacheinfo.h"
 #include "qemu/timer.h"
+#include "qemu/thread-stats.h"
 #include "exec/log.h"
 #include "sysemu/cpus.h"
 #include "sysemu/cpu-timers.h"
@@ -294,10 +295,11 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb_page_addr_t phys_pc, phys_p2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size, max_insns;
-    int64_t ti;
+    int64_t ti, translate_ns;
     void *host_pc;
 
     assert_memory_lock();
+    qemu_thread_stat_add(QEMU_STAT_TB_TRANSLATIONS, 1);
     qemu_thread_jit_write();
 
     phys_pc = get_page_addr_code_hostp(env, pc, &host_pc);
@@ -317,8 +319,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     assert_no_pages_locked();
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* room must be made in the code buffer */
+        tb_evict(cpu);
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -352,11 +354,27 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 #else
     tcg_ctx->guest_mo = TCG_MO_ALL;
 #endif
+    /*
+     * A TB without a physical page holds a single guest instruction, is
+     * never entered into the hash table and is discarded after a single
+     * execution: generate it quickly.  These are the only TBs known to be
+     * cold when they are translated; without execution counters in the
+     * generated code, other cold TBs cannot be told apart from hot ones.
+     * The tb-unoptimized-translations statistic, compared with
+     * tb-translations, tells how many translations skip the optimizer.
+     */
+    tcg_ctx->optimize = phys_pc != -1;
+    if (!tcg_ctx->optimize) {
+        qemu_thread_stat_add(QEMU_STAT_TB_UNOPTIMIZED, 1);
+    }
 
  restart_translate:
     trace_translate_block(tb, pc, tb->tc.ptr);
 
+    translate_ns = get_clock();
     gen_code_size = setjmp_gen_code(env, tb, pc, host_pc, &max_insns, &ti);
+    qemu_thread_stat_add(QEMU_STAT_TB_TRANSLATE_NS,
+                         get_clock() - translate_ns);
     if (unlikely(gen_code_size < 0)) {
         switch (gen_code_size) {
         case -1:
@@ -456,6 +474,9 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 
             /* Dump header and the first instruction */
             fprintf(logfile, "OUT: [size=%d]\n", gen_code_size);
+            fprintf(logfile, "  -- reg alloc: %u loads, %u stores,"
+                    " %u moves across calls\n", tcg_ctx->reg_stats.loads,
+                    tcg_ctx->reg_stats.stores, tcg_ctx->reg_stats.call_moves);
             fprintf(logfile,
                     "  -- guest addr 0x%016" PRIx64 " + tb prologue\n",
                     tcg_ctx->gen_insn_data[insn * TARGET_INSN_START_WORDS]);
@@ -662,14 +683,19 @@ void cpu_interrupt(CPUState *cpu, int mask)
  */
 void tcg_flush_jmp_cache(CPUState *cpu)
 {
-    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    CPUJumpCache *jc;
+    size_t n;
+
+    RCU_READ_LOCK_GUARD();
+    jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
 
     /* During early initialization, the cache may not yet be allocated. */
     if (unlikely(jc == NULL)) {
         return;
     }
 
-    for (int i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+    n = tb_jmp_cache_size(jc);
+    for (size_t i = 0; i < n; i++) {
         qatomic_set(&jc->array[i].tb, NULL);
     }
 }
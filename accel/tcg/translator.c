@@ -123,6 +123,33 @@ bool translator_use_goto_tb(DisasContextBase *db, vaddr dest)
     return ((db->pc_first ^ dest) & TARGET_PAGE_MASK) == 0;
 }
 
+bool translator_follow_jump(DisasContextBase *db, vaddr dest)
+{
+    uint32_t cflags = tb_cflags(db->tb);
+
+    /*
+     * Keep one guest branch per TB when chaining is disabled for
+     * debugging, when single-stepping, or when plugins want to see
+     * the guest's basic blocks.
+     */
+    if ((cflags & CF_NO_GOTO_TB) || db->singlestep_enabled
+        || db->plugin_enabled) {
+        return false;
+    }
+
+    /* The jump itself must not be the last insn we are allowed. */
+    if (db->num_insns >= db->max_insns) {
+        return false;
+    }
+
+    /*
+     * Only follow forward jumps within the first page: the range
+     * [pc_first, pc_next) then still covers every translated insn,
+     * which is what TB invalidation relies upon.
+     */
+    return dest > db->pc_next && is_same_page(db, dest);
+}
+
 void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
                      vaddr pc, void *host_pc, const TranslatorOps *ops,
                      DisasContextBase *db)
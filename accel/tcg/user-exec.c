@@ -167,7 +167,7 @@ int walk_memory_regions(void *priv, walk_memory_regions_fn fn)
     IntervalTreeNode *n;
     int rc = 0;
 
-    mmap_lock();
+    mmap_read_lock();
     for (n = interval_tree_iter_first(&pageflags_root, 0, -1);
          n != NULL;
          n = interval_tree_iter_next(n, 0, -1)) {
@@ -178,7 +178,7 @@ int walk_memory_regions(void *priv, walk_memory_regions_fn fn)
             break;
         }
     }
-    mmap_unlock();
+    mmap_read_unlock();
 
     return rc;
 }
@@ -218,16 +218,29 @@ int page_get_flags(target_ulong address)
     if (p) {
         return p->flags;
     }
-    if (have_mmap_lock()) {
+    if (have_mmap_read_lock()) {
         return 0;
     }
 
-    mmap_lock();
+    mmap_read_lock();
     p = pageflags_find(address, address);
-    mmap_unlock();
+    mmap_read_unlock();
     return p ? p->flags : 0;
 }
 
+int page_get_flags_range(target_ulong start, target_ulong last)
+{
+    PageFlagsNode *p;
+    int flags = 0;
+
+    assert_memory_lock();
+    for (p = pageflags_find(start, last); p;
+         p = pageflags_next(p, start, last)) {
+        flags |= p->flags;
+    }
+    return flags;
+}
+
 /* A subroutine of page_set_flags: insert a new node for [start,last]. */
 static void pageflags_create(target_ulong start, target_ulong last, int flags)
 {
@@ -521,10 +534,34 @@ void page_set_flags(target_ulong start, target_ulong last, int flags)
     }
 }
 
+/*
+ * Undo page_protect() for [@start, @last], all of which is within @p,
+ * in one go.  Only valid if host pages are no larger than target pages.
+ * Unlike page_unprotect(), this is not called from the signal handler,
+ * so there is no current TB to unwind from.
+ */
+static void page_unprotect_range(PageFlagsNode *p, target_ulong start,
+                                 target_ulong last)
+{
+    int prot = p->flags | PAGE_WRITE;
+
+    assert_memory_lock();
+    assert(qemu_host_page_size <= TARGET_PAGE_SIZE);
+
+    pageflags_set_clear(start, last, PAGE_WRITE, 0);
+    tb_invalidate_phys_range(start, last);
+
+    if (prot & PAGE_EXEC) {
+        prot = (prot & ~PAGE_EXEC) | PAGE_READ;
+    }
+    mprotect((void *)g2h_untagged(start), last - start + 1, prot & PAGE_BITS);
+}
+
 bool page_check_range(target_ulong start, target_ulong len, int flags)
 {
     target_ulong last;
-    int locked;  /* tri-state: =0: unlocked, +1: global, -1: local */
+    /* 0: unlocked, +1: held by caller, -1: local shared, -2: local excl */
+    int locked;
     bool ret;
 
     if (len == 0) {
@@ -536,7 +573,7 @@ bool page_check_range(target_ulong start, target_ulong len, int flags)
         return false; /* wrap around */
     }
 
-    locked = have_mmap_lock();
+    locked = have_mmap_read_lock();
     while (true) {
         PageFlagsNode *p = pageflags_find(start, last);
         int missing;
@@ -547,7 +584,7 @@ bool page_check_range(target_ulong start, target_ulong len, int flags)
                  * Lockless lookups have false negatives.
                  * Retry with the lock held.
                  */
-                mmap_lock();
+                mmap_read_lock();
                 locked = -1;
                 p = pageflags_find(start, last);
             }
@@ -571,12 +608,38 @@ bool page_check_range(target_ulong start, target_ulong len, int flags)
                 ret = false; /* page not writable */
                 break;
             }
-            /* Asking about writable, but has been protected: undo. */
+            /*
+             * Asking about writable, but has been protected: undo.
+             * This needs the lock exclusively; look up again once it
+             * is held, since the result can then be acted upon.
+             */
+            if (!have_mmap_lock()) {
+                /* The shared lock cannot be upgraded. */
+                assert(locked <= 0);
+                if (locked < 0) {
+                    mmap_read_unlock();
+                }
+                mmap_lock();
+                locked = -2;
+                continue;
+            }
+            if (qemu_host_page_size <= TARGET_PAGE_SIZE) {
+                target_ulong end;
+
+                start &= TARGET_PAGE_MASK;
+                end = MIN(last, p->itree.last) | ~TARGET_PAGE_MASK;
+                page_unprotect_range(p, start, end);
+                if (end >= last) {
+                    ret = true; /* ok */
+                    break;
+                }
+                start = end + 1;
+                continue;
+            }
             if (!page_unprotect(start, 0)) {
                 ret = false;
                 break;
             }
-            /* TODO: page_unprotect should take a range, not a single page. */
             if (last - start < TARGET_PAGE_SIZE) {
                 ret = true; /* ok */
                 break;
@@ -593,7 +656,9 @@ bool page_check_range(target_ulong start, target_ulong len, int flags)
     }
 
     /* Release the lock if acquired locally. */
-    if (locked < 0) {
+    if (locked == -1) {
+        mmap_read_unlock();
+    } else if (locked == -2) {
         mmap_unlock();
     }
     return ret;
@@ -1245,6 +1310,8 @@ static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
     return ret;
 }
 
+#define ATOMIC_MMU_CLEANUP do { clear_helper_retaddr(); } while (0)
+
 #include "atomic_common.c.inc"
 
 /*
@@ -1254,7 +1321,6 @@ static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
 
 #define ATOMIC_NAME(X) \
     glue(glue(glue(cpu_atomic_ ## X, SUFFIX), END), _mmu)
-#define ATOMIC_MMU_CLEANUP do { clear_helper_retaddr(); } while (0)
 
 #define DATA_SIZE 1
 #include "atomic_template.h"
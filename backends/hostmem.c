@@ -16,6 +16,8 @@
 #include "qapi/error.h"
 #include "qapi/qapi-builtin-visit.h"
 #include "qapi/visitor.h"
+#include "qapi/qmp/qlist.h"
+#include "qom/qom-qobject.h"
 #include "qemu/config-file.h"
 #include "qom/object_interfaces.h"
 #include "qemu/mmap-alloc.h"
@@ -209,6 +211,65 @@ static void host_memory_backend_set_dump(Object *obj, bool value, Error **errp)
     }
 }
 
+#ifdef CONFIG_NUMA
+/*
+ * Create a thread context whose threads run on the CPUs of the host nodes
+ * the memory is bound to, so that preallocation faults in the pages from
+ * the nodes they end up on instead of from wherever the scheduler placed
+ * the preallocation threads.  Returns NULL if that is not possible, e.g.
+ * for memory-only nodes.
+ */
+static ThreadContext *
+host_memory_backend_numa_context(HostMemoryBackend *backend)
+{
+    Object *obj = object_new(TYPE_THREAD_CONTEXT);
+    QList *nodes = qlist_new();
+    Error *local_err = NULL;
+    unsigned long node;
+
+    for (node = find_first_bit(backend->host_nodes, MAX_NODES);
+         node < MAX_NODES;
+         node = find_next_bit(backend->host_nodes, MAX_NODES, node + 1)) {
+        qlist_append_int(nodes, node);
+    }
+
+    object_property_add_child(OBJECT(backend), "prealloc-numa-context", obj);
+    object_unref(obj);
+    if (!object_property_set_qobject(obj, "node-affinity", QOBJECT(nodes),
+                                     &local_err) ||
+        !user_creatable_complete(USER_CREATABLE(obj), &local_err)) {
+        error_free(local_err);
+        object_unparent(obj);
+        obj = NULL;
+    }
+    qobject_unref(nodes);
+
+    return obj ? THREAD_CONTEXT(obj) : NULL;
+}
+#endif
+
+static void host_memory_backend_prealloc(HostMemoryBackend *backend,
+                                         void *ptr, uint64_t sz, Error **errp)
+{
+    ThreadContext *tc = backend->prealloc_context;
+    ThreadContext *numa_tc = NULL;
+
+#ifdef CONFIG_NUMA
+    if (!tc && backend->policy != HOST_MEM_POLICY_DEFAULT &&
+        !bitmap_empty(backend->host_nodes, MAX_NODES)) {
+        numa_tc = host_memory_backend_numa_context(backend);
+        tc = numa_tc;
+    }
+#endif
+
+    qemu_prealloc_mem(memory_region_get_fd(&backend->mr), ptr, sz,
+                      backend->prealloc_threads, tc, errp);
+
+    if (numa_tc) {
+        object_unparent(OBJECT(numa_tc));
+    }
+}
+
 static bool host_memory_backend_get_prealloc(Object *obj, Error **errp)
 {
     HostMemoryBackend *backend = MEMORY_BACKEND(obj);
@@ -233,12 +294,10 @@ static void host_memory_backend_set_prealloc(Object *obj, bool value,
     }
 
     if (value && !backend->prealloc) {
-        int fd = memory_region_get_fd(&backend->mr);
         void *ptr = memory_region_get_ram_ptr(&backend->mr);
         uint64_t sz = memory_region_size(&backend->mr);
 
-        qemu_prealloc_mem(fd, ptr, sz, backend->prealloc_threads,
-                          backend->prealloc_context, &local_err);
+        host_memory_backend_prealloc(backend, ptr, sz, &local_err);
         if (local_err) {
             error_propagate(errp, local_err);
             return;
@@ -399,9 +458,7 @@ host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
          * specified NUMA policy in place.
          */
         if (backend->prealloc) {
-            qemu_prealloc_mem(memory_region_get_fd(&backend->mr), ptr, sz,
-                              backend->prealloc_threads,
-                              backend->prealloc_context, &local_err);
+            host_memory_backend_prealloc(backend, ptr, sz, &local_err);
             if (local_err) {
                 goto out;
             }
@@ -8577,54 +8577,129 @@ BlockDriverState *bdrv_backing_chain_next(BlockDriverState *bs)
 }
 
 /**
- * Check whether [offset, offset + bytes) overlaps with the cached
- * block-status data region.
- *
- * If so, and @pnum is not NULL, set *pnum to `bsc.data_end - offset`,
- * which is what bdrv_bsc_is_data()'s interface needs.
- * Otherwise, *pnum is not touched.
+ * See block_int.h for this function's documentation.
  */
-static bool bdrv_bsc_range_overlaps_locked(BlockDriverState *bs,
-                                           int64_t offset, int64_t bytes,
-                                           int64_t *pnum)
+int bdrv_bsc_lookup(BlockDriverState *bs, int64_t offset, int64_t *pnum)
 {
-    BdrvBlockStatusCache *bsc = qatomic_rcu_read(&bs->block_status_cache);
-    bool overlaps;
+    BdrvBlockStatusCache *bsc;
+    BdrvBlockStatusCacheEntry *e;
+    int i;
 
-    overlaps =
-        qatomic_read(&bsc->valid) &&
-        ranges_overlap(offset, bytes, bsc->data_start,
-                       bsc->data_end - bsc->data_start);
+    IO_CODE();
+    RCU_READ_LOCK_GUARD();
 
-    if (overlaps && pnum) {
-        *pnum = bsc->data_end - offset;
+    bsc = qatomic_rcu_read(&bs->block_status_cache);
+    for (i = 0; i < BDRV_BSC_ENTRIES; i++) {
+        e = &bsc->entries[i];
+        if (qatomic_read(&e->valid) && offset >= e->start && offset < e->end) {
+            *pnum = e->end - offset;
+            return (e->zero ? BDRV_BLOCK_ZERO : BDRV_BLOCK_DATA) |
+                   BDRV_BLOCK_OFFSET_VALID;
+        }
     }
 
-    return overlaps;
+    return 0;
+}
+
+/* Called with the RCU read lock held */
+static void bdrv_bsc_invalidate_locked(BlockDriverState *bs, int64_t offset,
+                                       int64_t bytes, bool zero)
+{
+    BdrvBlockStatusCache *bsc = qatomic_rcu_read(&bs->block_status_cache);
+    BdrvBlockStatusCacheEntry *e;
+    int i;
+
+    if (zero && !bsc->has_zero) {
+        return;
+    }
+
+    for (i = 0; i < BDRV_BSC_ENTRIES; i++) {
+        e = &bsc->entries[i];
+        if (e->zero == zero && qatomic_read(&e->valid) &&
+            ranges_overlap(offset, bytes, e->start, e->end - e->start)) {
+            qatomic_set(&e->valid, false);
+        }
+    }
 }
 
 /**
  * See block_int.h for this function's documentation.
  */
-bool bdrv_bsc_is_data(BlockDriverState *bs, int64_t offset, int64_t *pnum)
+void bdrv_bsc_invalidate_range(BlockDriverState *bs,
+                               int64_t offset, int64_t bytes)
 {
     IO_CODE();
     RCU_READ_LOCK_GUARD();
-    return bdrv_bsc_range_overlaps_locked(bs, offset, 1, pnum);
+    bdrv_bsc_invalidate_locked(bs, offset, bytes, false);
 }
 
 /**
  * See block_int.h for this function's documentation.
  */
-void bdrv_bsc_invalidate_range(BlockDriverState *bs,
-                               int64_t offset, int64_t bytes)
+void coroutine_fn bdrv_bsc_invalidate_zero_range(BlockDriverState *bs,
+                                                 int64_t offset,
+                                                 int64_t bytes)
 {
     IO_CODE();
+
+    /*
+     * A zero extent that is not visible yet is being inserted by
+     * bdrv_bsc_fill_zero(), which then sees the write_gen increment of
+     * our caller and drops it.  Pairs with smp_mb() there.
+     */
+    WITH_RCU_READ_LOCK_GUARD() {
+        if (!qatomic_rcu_read(&bs->block_status_cache)->has_zero) {
+            return;
+        }
+    }
+
+    /*
+     * Invalidating entries in a copy that bdrv_bsc_insert_locked() is
+     * about to replace would leave a stale zero extent behind, so this
+     * has to be serialized against it.
+     */
+    QEMU_LOCK_GUARD(&bs->bsc_modify_lock);
     RCU_READ_LOCK_GUARD();
+    bdrv_bsc_invalidate_locked(bs, offset, bytes, true);
+}
+
+/*
+ * Publish a copy of the cache with a new entry for [offset, offset + bytes)
+ * in place of the oldest one.  Data invalidations that race with the copy
+ * may be lost, which is harmless because data extents may always be
+ * reported for zeroes.  Zero invalidations take bs->bsc_modify_lock and
+ * cannot be lost.
+ *
+ * Called with bs->bsc_modify_lock held.  Returns the new entry.
+ */
+static BdrvBlockStatusCacheEntry *
+bdrv_bsc_insert_locked(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                       bool zero)
+{
+    BdrvBlockStatusCache *new_bsc = g_new(BdrvBlockStatusCache, 1);
+    BdrvBlockStatusCache *old_bsc;
+    BdrvBlockStatusCacheEntry *e;
+    int i;
 
-    if (bdrv_bsc_range_overlaps_locked(bs, offset, bytes, NULL)) {
-        qatomic_set(&bs->block_status_cache->valid, false);
+    old_bsc = qatomic_rcu_read(&bs->block_status_cache);
+    *new_bsc = *old_bsc;
+    for (i = 0; i < BDRV_BSC_ENTRIES; i++) {
+        new_bsc->entries[i].valid = qatomic_read(&old_bsc->entries[i].valid);
     }
+
+    e = &new_bsc->entries[new_bsc->next];
+    new_bsc->next = (new_bsc->next + 1) % BDRV_BSC_ENTRIES;
+    new_bsc->has_zero |= zero;
+    *e = (BdrvBlockStatusCacheEntry) {
+        .valid = true,
+        .zero = zero,
+        .start = offset,
+        .end = offset + bytes,
+    };
+
+    qatomic_rcu_set(&bs->block_status_cache, new_bsc);
+    g_free_rcu(old_bsc, rcu);
+    return e;
 }
 
 /**
@@ -8632,21 +8707,35 @@ void bdrv_bsc_invalidate_range(BlockDriverState *bs,
  */
 void bdrv_bsc_fill(BlockDriverState *bs, int64_t offset, int64_t bytes)
 {
-    BdrvBlockStatusCache *new_bsc = g_new(BdrvBlockStatusCache, 1);
-    BdrvBlockStatusCache *old_bsc;
     IO_CODE();
+    QEMU_LOCK_GUARD(&bs->bsc_modify_lock);
+    bdrv_bsc_insert_locked(bs, offset, bytes, false);
+}
 
-    *new_bsc = (BdrvBlockStatusCache) {
-        .valid = true,
-        .data_start = offset,
-        .data_end = offset + bytes,
-    };
+/**
+ * See block_int.h for this function's documentation.
+ */
+void bdrv_bsc_fill_zero(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                        unsigned int write_gen)
+{
+    BdrvBlockStatusCacheEntry *e;
+    IO_CODE();
 
     QEMU_LOCK_GUARD(&bs->bsc_modify_lock);
+    if (qatomic_read(&bs->write_gen) != write_gen) {
+        return;
+    }
 
-    old_bsc = qatomic_rcu_read(&bs->block_status_cache);
-    qatomic_rcu_set(&bs->block_status_cache, new_bsc);
-    if (old_bsc) {
-        g_free_rcu(old_bsc, rcu);
+    /*
+     * A write may have written into the hole while its block status was
+     * being determined.  If it completes after the check above, it either
+     * finds the new entry in bdrv_bsc_invalidate_zero_range() once we drop
+     * bs->bsc_modify_lock, or we see its write_gen increment here.  Pairs
+     * with smp_mb__after_rmw() in bdrv_co_write_req_finish().
+     */
+    e = bdrv_bsc_insert_locked(bs, offset, bytes, true);
+    smp_mb();
+    if (qatomic_read(&bs->write_gen) != write_gen) {
+        qatomic_set(&e->valid, false);
     }
 }
@@ -71,6 +71,7 @@ void block_acct_cleanup(BlockAcctStats *stats)
     QSLIST_FOREACH_SAFE(s, &stats->intervals, entries, next) {
         g_free(s);
     }
+    block_acct_set_queues(stats, 0);
     qemu_mutex_destroy(&stats->lock);
 }
 
@@ -110,6 +111,20 @@ void block_acct_start(BlockAcctStats *stats, BlockAcctCookie *cookie,
     cookie->bytes = bytes;
     cookie->start_time_ns = qemu_clock_get_ns(clock_type);
     cookie->type = type;
+    cookie->queue = BLOCK_ACCT_NO_QUEUE;
+}
+
+/*
+ * Like block_acct_start(), but also record the request in the latency
+ * histogram of request queue @queue, if block_acct_set_queues() was used.
+ */
+void block_acct_start_queue(BlockAcctStats *stats, BlockAcctCookie *cookie,
+                            int64_t bytes, enum BlockAcctType type,
+                            unsigned queue)
+{
+    assert(queue != BLOCK_ACCT_NO_QUEUE);
+    block_acct_start(stats, cookie, bytes, type);
+    cookie->queue = queue;
 }
 
 /* block_latency_histogram_compare_func:
@@ -200,6 +215,133 @@ void block_latency_histograms_clear(BlockAcctStats *stats)
     }
 }
 
+void block_acct_set_queues(BlockAcctStats *stats, unsigned nr_queues)
+{
+    unsigned i;
+
+    for (i = 0; i < stats->nr_queues; i++) {
+        g_free(stats->queues[i].iothread);
+    }
+    g_free(stats->queues);
+
+    stats->queues = nr_queues ? g_new0(BlockAcctQueueStats, nr_queues) : NULL;
+    stats->nr_queues = nr_queues;
+}
+
+void block_acct_set_queue_iothread(BlockAcctStats *stats, unsigned queue,
+                                   const char *iothread)
+{
+    assert(queue < stats->nr_queues);
+
+    g_free(stats->queues[queue].iothread);
+    stats->queues[queue].iothread = g_strdup(iothread);
+}
+
+static unsigned block_acct_latency_bucket(int64_t latency_ns)
+{
+    uint64_t ns = MAX(latency_ns, 0);
+    unsigned msb;
+
+    if (ns < (1 << BLOCK_ACCT_LAT_SUB_BITS)) {
+        return ns;
+    }
+
+    msb = 63 - clz64(ns);
+    if (msb >= BLOCK_ACCT_LAT_MAX_BITS) {
+        return BLOCK_ACCT_LAT_BUCKETS - 1;
+    }
+
+    return ((msb - BLOCK_ACCT_LAT_SUB_BITS + 1) << BLOCK_ACCT_LAT_SUB_BITS) |
+           ((ns >> (msb - BLOCK_ACCT_LAT_SUB_BITS)) &
+            ((1 << BLOCK_ACCT_LAT_SUB_BITS) - 1));
+}
+
+/* Midpoint of the latencies that fall into @bucket */
+static uint64_t block_acct_latency_value(unsigned bucket)
+{
+    unsigned exp = bucket >> BLOCK_ACCT_LAT_SUB_BITS;
+    uint64_t mant = bucket & ((1 << BLOCK_ACCT_LAT_SUB_BITS) - 1);
+
+    if (exp <= 1) {
+        return bucket;
+    }
+
+    mant |= 1 << BLOCK_ACCT_LAT_SUB_BITS;
+    return (mant << (exp - 1)) + (1ULL << (exp - 2));
+}
+
+static void block_acct_latency_summarize(const uint64_t *buckets,
+                                         BlockAcctLatencySummary *sum)
+{
+    static const unsigned permille[] = { 500, 990, 999 };
+    uint64_t *result[] = { &sum->p50_ns, &sum->p99_ns, &sum->p999_ns };
+    uint64_t seen = 0;
+    unsigned i, j;
+
+    memset(sum, 0, sizeof(*sum));
+    for (i = 0; i < BLOCK_ACCT_LAT_BUCKETS; i++) {
+        sum->ops += buckets[i];
+    }
+
+    for (i = 0, j = 0; i < BLOCK_ACCT_LAT_BUCKETS && j < ARRAY_SIZE(permille);
+         i++)
+    {
+        seen += buckets[i];
+        while (j < ARRAY_SIZE(permille) &&
+               seen >= DIV_ROUND_UP(sum->ops * permille[j], 1000)) {
+            *result[j++] = block_acct_latency_value(i);
+        }
+    }
+}
+
+static void block_acct_latency_add(uint64_t *buckets,
+                                   BlockAcctQueueStats *q,
+                                   enum BlockAcctType type)
+{
+    unsigned i;
+
+    for (i = 0; i < BLOCK_ACCT_LAT_BUCKETS; i++) {
+        buckets[i] += stat64_get(&q->latency[type][i]);
+    }
+}
+
+/*
+ * Fill @sum with the latency percentiles of @type requests on @queue.
+ * All zero if the queue has not completed any such request.
+ */
+void block_acct_queue_latency(BlockAcctStats *stats, unsigned queue,
+                              enum BlockAcctType type,
+                              BlockAcctLatencySummary *sum)
+{
+    uint64_t buckets[BLOCK_ACCT_LAT_BUCKETS] = { 0 };
+
+    assert(type < BLOCK_MAX_IOTYPE);
+    if (queue < stats->nr_queues) {
+        block_acct_latency_add(buckets, &stats->queues[queue], type);
+    }
+    block_acct_latency_summarize(buckets, sum);
+}
+
+/*
+ * Same as block_acct_queue_latency(), but over all the queues that are
+ * served by IOThread @iothread (or the main loop, if NULL).
+ */
+void block_acct_iothread_latency(BlockAcctStats *stats, const char *iothread,
+                                 enum BlockAcctType type,
+                                 BlockAcctLatencySummary *sum)
+{
+    uint64_t buckets[BLOCK_ACCT_LAT_BUCKETS] = { 0 };
+    unsigned i;
+
+    assert(type < BLOCK_MAX_IOTYPE);
+    for (i = 0; i < stats->nr_queues; i++) {
+        if (!g_strcmp0(stats->queues[i].iothread, iothread)) {
+            block_acct_latency_add(buckets, &stats->queues[i], type);
+        }
+    }
+    block_acct_latency_summarize(buckets, sum);
+}
+
 static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
                                  bool failed)
 {
@@ -238,6 +380,13 @@ static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
         }
     }
 
+    if (cookie->queue != BLOCK_ACCT_NO_QUEUE &&
+        cookie->queue < stats->nr_queues) {
+        BlockAcctQueueStats *q = &stats->queues[cookie->queue];
+        stat64_add(&q->latency[cookie->type]
+                              [block_acct_latency_bucket(latency_ns)], 1);
+    }
+
     cookie->type = BLOCK_ACCT_NONE;
 }
 
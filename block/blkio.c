@@ -17,12 +17,18 @@
 #include "qapi/error.h"
 #include "qemu/error-report.h"
 #include "qapi/qmp/qdict.h"
+#include "qemu/event_notifier.h"
 #include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/timer.h"
 #include "sysemu/block-backend.h"
 #include "exec/memory.h" /* for ram_block_discard_disable() */
 
 #include "block/block-io.h"
 
+/* Period of the timer that reaps poll queue completions as a fallback */
+#define BLKIO_POLL_TIMER_NS (50 * SCALE_US)
+
 /*
  * Allocated bounce buffers are kept in a list sorted by buffer address.
  */
@@ -34,23 +40,54 @@ typedef struct BlkioBounceBuf {
 } BlkioBounceBuf;
 
 typedef struct {
+    BlockDriverState *bs;
+
+    /* A libblkio queue must not be used by two threads at once */
+    QemuMutex lock;
+    struct blkioq *blkioq;
+
+    /* -1 for poll queues, which do not signal completions */
+    int completion_fd;
+
     /*
-     * libblkio is not thread-safe so this lock protects ->blkio and
-     * ->blkioq.
+     * The AioContext whose fd and poll handlers reap the completions of
+     * this queue, or NULL while the queue is unused.  ->ready is set once
+     * the handlers are installed.
      */
-    QemuMutex blkio_lock;
-    struct blkio *blkio;
-    struct blkioq *blkioq; /* make this multi-queue in the future... */
-    int completion_fd;
+    AioContext *ctx;
+    bool ready;
 
     /*
      * Polling fetches the next completion into this field.
      *
-     * No lock is necessary since only one thread calls aio_poll() and invokes
-     * fd and poll handlers.
+     * No lock is necessary since only ->ctx invokes fd and poll handlers.
      */
     struct blkio_completion poll_completion;
 
+    /*
+     * Poll queues only: aio_poll() polls them through a notifier that is
+     * never signalled, and a timer reaps completions while requests are
+     * in flight in case the AioContext does not poll.  ->in_flight is
+     * protected by ->lock.
+     */
+    EventNotifier poll_notifier;
+    QEMUTimer *poll_timer;
+    unsigned int in_flight;
+} BlkioQueue;
+
+typedef struct {
+    /* libblkio is not thread-safe so this lock protects ->blkio. */
+    QemuMutex blkio_lock;
+    struct blkio *blkio;
+
+    /*
+     * The queues with completion fds come first, followed by the poll
+     * queues.  queues[0] always belongs to the AioContext of the node,
+     * the others are taken by the first AioContexts that submit requests.
+     */
+    BlkioQueue *queues;
+    int num_queues;
+
     /*
      * Protects ->bounce_pool, ->bounce_bufs, ->bounce_available.
      *
@@ -226,29 +263,40 @@ typedef struct {
     int ret;
 } BlkioCoData;
 
+/* Called with q->lock held */
+static void blkio_arm_poll_timer_locked(BlkioQueue *q)
+{
+    if (q->poll_timer && q->in_flight && !timer_pending(q->poll_timer)) {
+        timer_mod_ns(q->poll_timer,
+                     qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+                     BLKIO_POLL_TIMER_NS);
+    }
+}
+
 static void blkio_completion_fd_read(void *opaque)
 {
-    BlockDriverState *bs = opaque;
-    BDRVBlkioState *s = bs->opaque;
+    BlkioQueue *q = opaque;
     uint64_t val;
     int ret;
 
     /* Polling may have already fetched a completion */
-    if (s->poll_completion.user_data != NULL) {
-        BlkioCoData *cod = s->poll_completion.user_data;
-        cod->ret = s->poll_completion.ret;
+    if (q->poll_completion.user_data != NULL) {
+        BlkioCoData *cod = q->poll_completion.user_data;
+        cod->ret = q->poll_completion.ret;
 
         /* Clear it in case aio_co_wake() enters a nested event loop */
-        s->poll_completion.user_data = NULL;
+        q->poll_completion.user_data = NULL;
 
         aio_co_wake(cod->coroutine);
     }
 
     /* Reset completion fd status */
-    ret = read(s->completion_fd, &val, sizeof(val));
+    if (q->completion_fd >= 0) {
+        ret = read(q->completion_fd, &val, sizeof(val));
 
-    /* Ignore errors, there's nothing we can do */
-    (void)ret;
+        /* Ignore errors, there's nothing we can do */
+        (void)ret;
+    }
 
     /*
      * Reading one completion at a time makes nested event loop re-entrancy
@@ -258,8 +306,11 @@ static void blkio_completion_fd_read(void *opaque)
     while (true) {
         struct blkio_completion completion;
 
-        WITH_QEMU_LOCK_GUARD(&s->blkio_lock) {
-            ret = blkioq_do_io(s->blkioq, &completion, 0, 1, NULL);
+        WITH_QEMU_LOCK_GUARD(&q->lock) {
+            ret = blkioq_do_io(q->blkioq, &completion, 0, 1, NULL);
+            if (ret == 1) {
+                q->in_flight--;
+            }
         }
         if (ret != 1) {
             break;
@@ -273,17 +324,19 @@ static void blkio_completion_fd_read(void *opaque)
 
 static bool blkio_completion_fd_poll(void *opaque)
 {
-    BlockDriverState *bs = opaque;
-    BDRVBlkioState *s = bs->opaque;
+    BlkioQueue *q = opaque;
     int ret;
 
     /* Just in case we already fetched a completion */
-    if (s->poll_completion.user_data != NULL) {
+    if (q->poll_completion.user_data != NULL) {
         return true;
     }
 
-    WITH_QEMU_LOCK_GUARD(&s->blkio_lock) {
-        ret = blkioq_do_io(s->blkioq, &s->poll_completion, 0, 1, NULL);
+    WITH_QEMU_LOCK_GUARD(&q->lock) {
+        ret = blkioq_do_io(q->blkioq, &q->poll_completion, 0, 1, NULL);
+        if (ret == 1) {
+            q->in_flight--;
+        }
     }
     return ret == 1;
 }
@@ -293,47 +346,149 @@ static void blkio_completion_fd_poll_ready(void *opaque)
     blkio_completion_fd_read(opaque);
 }
 
+static void blkio_poll_queue_read(EventNotifier *n)
+{
+    BlkioQueue *q = container_of(n, BlkioQueue, poll_notifier);
+
+    event_notifier_test_and_clear(n);
+    blkio_completion_fd_read(q);
+}
+
+static bool blkio_poll_queue_poll(void *opaque)
+{
+    BlkioQueue *q = container_of(opaque, BlkioQueue, poll_notifier);
+
+    return blkio_completion_fd_poll(q);
+}
+
+static void blkio_poll_queue_poll_ready(EventNotifier *n)
+{
+    blkio_completion_fd_read(container_of(n, BlkioQueue, poll_notifier));
+}
+
+static void blkio_poll_timer_cb(void *opaque)
+{
+    BlkioQueue *q = opaque;
+
+    blkio_completion_fd_read(q);
+    qemu_mutex_lock(&q->lock);
+    blkio_arm_poll_timer_locked(q);
+    qemu_mutex_unlock(&q->lock);
+}
+
+/* Install the handlers that reap the completions of @q in @ctx */
+static void blkio_queue_attach(BlkioQueue *q, AioContext *ctx)
+{
+    q->ctx = ctx;
+    if (q->completion_fd >= 0) {
+        aio_set_fd_handler(ctx, q->completion_fd,
+                           blkio_completion_fd_read, NULL,
+                           blkio_completion_fd_poll,
+                           blkio_completion_fd_poll_ready, q);
+    } else {
+        q->poll_timer = aio_timer_new(ctx, QEMU_CLOCK_REALTIME, SCALE_NS,
+                                      blkio_poll_timer_cb, q);
+        aio_set_event_notifier(ctx, &q->poll_notifier,
+                               blkio_poll_queue_read, blkio_poll_queue_poll,
+                               blkio_poll_queue_poll_ready);
+    }
+    qatomic_store_release(&q->ready, true);
+}
+
+/* Must be called with no requests in flight on @q */
+static void blkio_queue_detach(BlkioQueue *q)
+{
+    if (!q->ctx) {
+        return;
+    }
+    if (q->completion_fd >= 0) {
+        aio_set_fd_handler(q->ctx, q->completion_fd, NULL, NULL,
+                           NULL, NULL, NULL);
+    } else {
+        aio_set_event_notifier(q->ctx, &q->poll_notifier, NULL, NULL, NULL);
+        timer_free(q->poll_timer);
+        q->poll_timer = NULL;
+    }
+    q->ready = false;
+    q->ctx = NULL;
+}
+
 static void blkio_attach_aio_context(BlockDriverState *bs,
                                      AioContext *new_context)
 {
     BDRVBlkioState *s = bs->opaque;
 
-    aio_set_fd_handler(new_context, s->completion_fd,
-                       blkio_completion_fd_read, NULL,
-                       blkio_completion_fd_poll,
-                       blkio_completion_fd_poll_ready, bs);
+    blkio_queue_attach(&s->queues[0], new_context);
 }
 
 static void blkio_detach_aio_context(BlockDriverState *bs)
 {
     BDRVBlkioState *s = bs->opaque;
+    int i;
 
-    aio_set_fd_handler(bdrv_get_aio_context(bs), s->completion_fd, NULL, NULL,
-                       NULL, NULL, NULL);
+    /* The other queues are taken again when requests are submitted */
+    for (i = 0; i < s->num_queues; i++) {
+        blkio_queue_detach(&s->queues[i]);
+    }
+}
+
+/*
+ * Return the queue to submit to from the current AioContext.  Each
+ * AioContext gets a queue of its own as long as there are unused ones, so
+ * that IOThreads do not contend on the queue lock.  When there are more
+ * AioContexts than queues, the remaining ones share the queues.
+ */
+static BlkioQueue *blkio_current_queue(BDRVBlkioState *s)
+{
+    AioContext *ctx = qemu_get_current_aio_context();
+    BlkioQueue *q;
+    int i;
+
+    for (i = 0; i < s->num_queues; i++) {
+        AioContext *owner;
+
+        q = &s->queues[i];
+        owner = qatomic_read(&q->ctx);
+        if (owner == ctx) {
+            return q;
+        }
+        if (i > 0 && !owner && !qatomic_cmpxchg(&q->ctx, NULL, ctx)) {
+            blkio_queue_attach(q, ctx);
+            return q;
+        }
+    }
+
+    if (s->num_queues > 1) {
+        q = &s->queues[1 + g_direct_hash(ctx) % (s->num_queues - 1)];
+        if (qatomic_load_acquire(&q->ready)) {
+            return q;
+        }
+    }
+    /* Still being set up by its AioContext */
+    return &s->queues[0];
 }
 
 /*
  * Called by defer_call_end() or immediately if not in a deferred section.
- * Called without blkio_lock.
+ * Called without q->lock.
  */
 static void blkio_deferred_fn(void *opaque)
 {
-    BDRVBlkioState *s = opaque;
+    BlkioQueue *q = opaque;
 
-    WITH_QEMU_LOCK_GUARD(&s->blkio_lock) {
-        blkioq_do_io(s->blkioq, NULL, 0, 0, NULL);
+    WITH_QEMU_LOCK_GUARD(&q->lock) {
+        blkioq_do_io(q->blkioq, NULL, 0, 0, NULL);
+        blkio_arm_poll_timer_locked(q);
     }
 }
 
 /*
  * Schedule I/O submission after enqueuing a new request. Called without
- * blkio_lock.
+ * q->lock.
  */
-static void blkio_submit_io(BlockDriverState *bs)
+static void blkio_submit_io(BlkioQueue *q)
 {
-    BDRVBlkioState *s = bs->opaque;
-
-    defer_call(blkio_deferred_fn, s);
+    defer_call(blkio_deferred_fn, q);
 }
 
 static int coroutine_fn
@@ -343,12 +498,15 @@ blkio_co_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes)
     BlkioCoData cod = {
         .coroutine = qemu_coroutine_self(),
     };
+    BlkioQueue *q;
 
-    WITH_QEMU_LOCK_GUARD(&s->blkio_lock) {
-        blkioq_discard(s->blkioq, offset, bytes, &cod, 0);
+    q = blkio_current_queue(s);
+    WITH_QEMU_LOCK_GUARD(&q->lock) {
+        blkioq_discard(q->blkioq, offset, bytes, &cod, 0);
+        q->in_flight++;
     }
 
-    blkio_submit_io(bs);
+    blkio_submit_io(q);
     qemu_coroutine_yield();
     return cod.ret;
 }
@@ -366,6 +524,7 @@ blkio_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
     BlkioBounceBuf bounce;
     struct iovec *iov = qiov->iov;
     int iovcnt = qiov->niov;
+    BlkioQueue *q;
 
     if (use_bounce_buffer) {
         int ret = blkio_alloc_bounce_buffer(s, &bounce, bytes);
@@ -377,11 +536,13 @@ blkio_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
         iovcnt = 1;
     }
 
-    WITH_QEMU_LOCK_GUARD(&s->blkio_lock) {
-        blkioq_readv(s->blkioq, offset, iov, iovcnt, &cod, 0);
+    q = blkio_current_queue(s);
+    WITH_QEMU_LOCK_GUARD(&q->lock) {
+        blkioq_readv(q->blkioq, offset, iov, iovcnt, &cod, 0);
+        q->in_flight++;
     }
 
-    blkio_submit_io(bs);
+    blkio_submit_io(q);
     qemu_coroutine_yield();
 
     if (use_bounce_buffer) {
@@ -410,6 +571,7 @@ static int coroutine_fn blkio_co_pwritev(BlockDriverState *bs, int64_t offset,
     BlkioBounceBuf bounce;
     struct iovec *iov = qiov->iov;
     int iovcnt = qiov->niov;
+    BlkioQueue *q;
 
     if (use_bounce_buffer) {
         int ret = blkio_alloc_bounce_buffer(s, &bounce, bytes);
@@ -422,11 +584,13 @@ static int coroutine_fn blkio_co_pwritev(BlockDriverState *bs, int64_t offset,
         iovcnt = 1;
     }
 
-    WITH_QEMU_LOCK_GUARD(&s->blkio_lock) {
-        blkioq_writev(s->blkioq, offset, iov, iovcnt, &cod, blkio_flags);
+    q = blkio_current_queue(s);
+    WITH_QEMU_LOCK_GUARD(&q->lock) {
+        blkioq_writev(q->blkioq, offset, iov, iovcnt, &cod, blkio_flags);
+        q->in_flight++;
     }
 
-    blkio_submit_io(bs);
+    blkio_submit_io(q);
     qemu_coroutine_yield();
 
     if (use_bounce_buffer) {
@@ -442,12 +606,15 @@ static int coroutine_fn blkio_co_flush(BlockDriverState *bs)
     BlkioCoData cod = {
         .coroutine = qemu_coroutine_self(),
     };
+    BlkioQueue *q;
 
-    WITH_QEMU_LOCK_GUARD(&s->blkio_lock) {
-        blkioq_flush(s->blkioq, &cod, 0);
+    q = blkio_current_queue(s);
+    WITH_QEMU_LOCK_GUARD(&q->lock) {
+        blkioq_flush(q->blkioq, &cod, 0);
+        q->in_flight++;
     }
 
-    blkio_submit_io(bs);
+    blkio_submit_io(q);
     qemu_coroutine_yield();
     return cod.ret;
 }
@@ -460,6 +627,7 @@ static int coroutine_fn blkio_co_pwrite_zeroes(BlockDriverState *bs,
         .coroutine = qemu_coroutine_self(),
     };
     uint32_t blkio_flags = 0;
+    BlkioQueue *q;
 
     if (flags & BDRV_REQ_FUA) {
         blkio_flags |= BLKIO_REQ_FUA;
@@ -471,11 +639,13 @@ static int coroutine_fn blkio_co_pwrite_zeroes(BlockDriverState *bs,
         blkio_flags |= BLKIO_REQ_NO_FALLBACK;
     }
 
-    WITH_QEMU_LOCK_GUARD(&s->blkio_lock) {
-        blkioq_write_zeroes(s->blkioq, offset, bytes, &cod, blkio_flags);
+    q = blkio_current_queue(s);
+    WITH_QEMU_LOCK_GUARD(&q->lock) {
+        blkioq_write_zeroes(q->blkioq, offset, bytes, &cod, blkio_flags);
+        q->in_flight++;
     }
 
-    blkio_submit_io(bs);
+    blkio_submit_io(q);
     qemu_coroutine_yield();
     return cod.ret;
 }
@@ -788,6 +958,104 @@ static int blkio_virtio_blk_connect(BlockDriverState *bs, QDict *options,
     return 0;
 }
 
+static QemuOptsList blkio_runtime_opts = {
+    .name = "blkio",
+    .head = QTAILQ_HEAD_INITIALIZER(blkio_runtime_opts.head),
+    .desc = {
+        {
+            .name = "num-queues",
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of queues with completion interrupts",
+        },
+        {
+            .name = "poll-queues",
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of queues whose completions are polled",
+        },
+        { /* end of list */ }
+    },
+};
+
+/* Set the libblkio queue properties, must be called in the connected state */
+static int blkio_set_queue_props(BlockDriverState *bs, QDict *options,
+                                 Error **errp)
+{
+    BDRVBlkioState *s = bs->opaque;
+    QemuOpts *opts;
+    uint64_t num_queues, poll_queues;
+    int ret = 0;
+
+    opts = qemu_opts_create(&blkio_runtime_opts, NULL, 0, &error_abort);
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        ret = -EINVAL;
+        goto out;
+    }
+
+    num_queues = qemu_opt_get_number(opts, "num-queues", 0);
+    poll_queues = qemu_opt_get_number(opts, "poll-queues", 0);
+    if ((num_queues == 0 && qemu_opt_get(opts, "num-queues")) ||
+        num_queues > UINT16_MAX || poll_queues > UINT16_MAX) {
+        error_setg(errp, "num-queues must be between 1 and %d and "
+                   "poll-queues at most %d", UINT16_MAX, UINT16_MAX);
+        ret = -EINVAL;
+        goto out;
+    }
+
+    /* Leave the libblkio defaults alone unless asked to */
+    if (num_queues) {
+        ret = blkio_set_int(s->blkio, "num-queues", num_queues);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "failed to set num-queues: %s",
+                             blkio_get_error_msg());
+            goto out;
+        }
+    }
+    if (poll_queues) {
+        ret = blkio_set_int(s->blkio, "num-poll-queues", poll_queues);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "failed to set num-poll-queues: %s",
+                             blkio_get_error_msg());
+            goto out;
+        }
+    }
+
+out:
+    qemu_opts_del(opts);
+    return ret;
+}
+
+static void blkio_init_queues(BlockDriverState *bs)
+{
+    BDRVBlkioState *s = bs->opaque;
+    int num_queues, num_poll_queues;
+    int i;
+
+    if (blkio_get_int(s->blkio, "num-queues", &num_queues) < 0) {
+        num_queues = 1;
+    }
+    if (blkio_get_int(s->blkio, "num-poll-queues", &num_poll_queues) < 0) {
+        num_poll_queues = 0;
+    }
+
+    s->num_queues = num_queues + num_poll_queues;
+    s->queues = g_new0(BlkioQueue, s->num_queues);
+    for (i = 0; i < s->num_queues; i++) {
+        BlkioQueue *q = &s->queues[i];
+
+        q->bs = bs;
+        qemu_mutex_init(&q->lock);
+        if (i < num_queues) {
+            q->blkioq = blkio_get_queue(s->blkio, i);
+            q->completion_fd = blkioq_get_completion_fd(q->blkioq);
+            blkioq_set_completion_fd_enabled(q->blkioq, true);
+        } else {
+            q->blkioq = blkio_get_poll_queue(s->blkio, i - num_queues);
+            q->completion_fd = -1;
+            event_notifier_init(&q->poll_notifier, 0);
+        }
+    }
+}
+
 static int blkio_file_open(BlockDriverState *bs, QDict *options, int flags,
                            Error **errp)
 {
@@ -825,6 +1093,9 @@ static int blkio_file_open(BlockDriverState *bs, QDict *options, int flags,
     } else {
         g_assert_not_reached();
     }
+    if (ret >= 0) {
+        ret = blkio_set_queue_props(bs, options, errp);
+    }
     if (ret < 0) {
         blkio_destroy(&s->blkio);
         return ret;
@@ -903,9 +1174,7 @@ static int blkio_file_open(BlockDriverState *bs, QDict *options, int flags,
     qemu_co_mutex_init(&s->bounce_lock);
     qemu_co_queue_init(&s->bounce_available);
     QLIST_INIT(&s->bounce_bufs);
-    s->blkioq = blkio_get_queue(s->blkio, 0);
-    s->completion_fd = blkioq_get_completion_fd(s->blkioq);
-    blkioq_set_completion_fd_enabled(s->blkioq, true);
+    blkio_init_queues(bs);
 
     blkio_attach_aio_context(bs, bdrv_get_aio_context(bs));
     return 0;
@@ -914,11 +1183,21 @@ static int blkio_file_open(BlockDriverState *bs, QDict *options, int flags,
 static void blkio_close(BlockDriverState *bs)
 {
     BDRVBlkioState *s = bs->opaque;
+    int i;
 
     /* There is no destroy() API for s->bounce_lock */
 
     qemu_mutex_destroy(&s->blkio_lock);
     blkio_detach_aio_context(bs);
+    for (i = 0; i < s->num_queues; i++) {
+        BlkioQueue *q = &s->queues[i];
+
+        if (q->completion_fd < 0) {
+            event_notifier_cleanup(&q->poll_notifier);
+        }
+        qemu_mutex_destroy(&q->lock);
+    }
+    g_free(s->queues);
     blkio_destroy(&s->blkio);
 
     if (s->may_pin_mem_regions) {
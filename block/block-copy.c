@@ -35,6 +35,11 @@
 #define BLOCK_COPY_MAX_WORKERS 64
 #define BLOCK_COPY_SLICE_TIME 100000000ULL /* ns */
 #define BLOCK_COPY_CLUSTER_SIZE_DEFAULT (1 << 16)
+/* Largest clean gap that is read to merge two dirty extents into one read */
+#define BLOCK_COPY_MAX_GAP (256 * KiB)
+#define BLOCK_COPY_MAX_HOLES 16
+/* Largest readahead past the end of a sequential block_copy() call */
+#define BLOCK_COPY_MAX_READAHEAD (1 * MiB)
 
 typedef enum {
     COPY_READ_WRITE_CLUSTER,
@@ -46,6 +51,11 @@ typedef enum {
 
 static coroutine_fn int block_copy_task_entry(AioTask *task);
 
+typedef struct BlockCopyHole {
+    int64_t offset;
+    int64_t bytes;
+} BlockCopyHole;
+
 typedef struct BlockCopyCallState {
     /* Fields initialized in block_copy_async() and never changed. */
     BlockCopyState *s;
@@ -54,6 +64,11 @@ typedef struct BlockCopyCallState {
     int max_workers;
     int64_t max_chunk;
     bool ignore_ratelimit;
+    /*
+     * Number of bytes that a dirty run may be copied past the end of the
+     * requested region.  Initialized in block_copy_common().
+     */
+    int64_t readahead;
     BlockCopyAsyncCallbackFunc cb;
     void *cb_opaque;
     /* Coroutine where async block-copy is running */
@@ -105,6 +120,15 @@ typedef struct BlockCopyTask {
      * parallel read while updating @bytes value in block_copy_task_shrink().
      */
     BlockReq req;
+
+    /*
+     * Clean ranges inside of req that block_copy_task_coalesce() merged in
+     * between dirty extents, sorted by offset.  They are read together with
+     * the dirty data, but never written to the target.  Protected like req.
+     */
+    int nb_holes;
+    int64_t hole_bytes;
+    BlockCopyHole holes[BLOCK_COPY_MAX_HOLES];
 } BlockCopyTask;
 
 static int64_t task_end(BlockCopyTask *task)
@@ -159,6 +183,13 @@ typedef struct BlockCopyState {
     ProgressMeter *progress;
     SharedResource *mem;
     RateLimit rate_limit;
+
+    /*
+     * End of the last block_copy() call and readahead to use if the next
+     * one starts there.  Protected by lock.
+     */
+    int64_t last_call_end;
+    int64_t readahead;
 } BlockCopyState;
 
 /* Called with lock held */
@@ -182,7 +213,8 @@ static int64_t block_copy_chunk_size(BlockCopyState *s)
 
 /*
  * Search for the first dirty area in offset/bytes range and create task at
- * the beginning of it.
+ * the beginning of it.  If the dirty area continues past the end of the
+ * range, the task covers up to call_state->readahead more bytes of it.
  */
 static coroutine_fn BlockCopyTask *
 block_copy_task_create(BlockCopyState *s, BlockCopyCallState *call_state,
@@ -190,12 +222,15 @@ block_copy_task_create(BlockCopyState *s, BlockCopyCallState *call_state,
 {
     BlockCopyTask *task;
     int64_t max_chunk;
+    int64_t end = offset + bytes;
 
     QEMU_LOCK_GUARD(&s->lock);
     max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s), call_state->max_chunk);
-    if (!bdrv_dirty_bitmap_next_dirty_area(s->copy_bitmap,
-                                           offset, offset + bytes,
-                                           max_chunk, &offset, &bytes))
+    if (!bdrv_dirty_bitmap_next_dirty_area(s->copy_bitmap, offset,
+                                           MIN(end + call_state->readahead,
+                                               s->len),
+                                           max_chunk, &offset, &bytes) ||
+        offset >= end)
     {
         return NULL;
     }
@@ -221,6 +256,58 @@ block_copy_task_create(BlockCopyState *s, BlockCopyCallState *call_state,
     return task;
 }
 
+/*
+ * block_copy_task_coalesce
+ *
+ * Extend a buffered copy task over the following dirty extents up to @end
+ * if the clean gaps in between are small, so that fragmented dirty areas
+ * are read with one request.  The gaps are recorded as holes of the task.
+ */
+static void coroutine_fn block_copy_task_coalesce(BlockCopyTask *task,
+                                                  int64_t end)
+{
+    BlockCopyState *s = task->s;
+    int64_t max_chunk;
+
+    QEMU_LOCK_GUARD(&s->lock);
+    max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s),
+                             task->call_state->max_chunk);
+    end = MIN(end, task->req.offset + max_chunk);
+
+    while (task->nb_holes < BLOCK_COPY_MAX_HOLES && task_end(task) < end) {
+        int64_t gap_start = task_end(task);
+        int64_t dirty_start, dirty_bytes;
+
+        if (!bdrv_dirty_bitmap_next_dirty_area(s->copy_bitmap, gap_start, end,
+                                               end - gap_start, &dirty_start,
+                                               &dirty_bytes) ||
+            dirty_start - gap_start > BLOCK_COPY_MAX_GAP)
+        {
+            break;
+        }
+        dirty_bytes = QEMU_ALIGN_UP(dirty_bytes, s->cluster_size);
+
+        /* The gap may still be copied by another task */
+        if (reqlist_find_conflict(&s->reqs, gap_start,
+                                  dirty_start + dirty_bytes - gap_start)) {
+            break;
+        }
+
+        bdrv_reset_dirty_bitmap(s->copy_bitmap, dirty_start, dirty_bytes);
+        s->in_flight_bytes += dirty_bytes;
+
+        if (dirty_start > gap_start) {
+            task->holes[task->nb_holes++] = (BlockCopyHole) {
+                .offset = gap_start,
+                .bytes  = dirty_start - gap_start,
+            };
+            task->hole_bytes += dirty_start - gap_start;
+        }
+        reqlist_extend_req(&task->req,
+                           dirty_start + dirty_bytes - task->req.offset);
+    }
+}
+
 /*
  * block_copy_task_shrink
  *
@@ -237,6 +324,7 @@ static void coroutine_fn block_copy_task_shrink(BlockCopyTask *task,
     }
 
     assert(new_bytes > 0 && new_bytes < task->req.bytes);
+    assert(!task->nb_holes);
 
     task->s->in_flight_bytes -= task->req.bytes - new_bytes;
     bdrv_set_dirty_bitmap(task->s->copy_bitmap,
@@ -249,10 +337,19 @@ static void coroutine_fn block_copy_task_shrink(BlockCopyTask *task,
 static void coroutine_fn block_copy_task_end(BlockCopyTask *task, int ret)
 {
     QEMU_LOCK_GUARD(&task->s->lock);
-    task->s->in_flight_bytes -= task->req.bytes;
+    task->s->in_flight_bytes -= task->req.bytes - task->hole_bytes;
     if (ret < 0) {
-        bdrv_set_dirty_bitmap(task->s->copy_bitmap, task->req.offset,
-                              task->req.bytes);
+        int64_t offset = task->req.offset;
+        int i;
+
+        /* Holes were clean before, they must not become dirty */
+        for (i = 0; i < task->nb_holes; i++) {
+            bdrv_set_dirty_bitmap(task->s->copy_bitmap, offset,
+                                  task->holes[i].offset - offset);
+            offset = task->holes[i].offset + task->holes[i].bytes;
+        }
+        bdrv_set_dirty_bitmap(task->s->copy_bitmap, offset,
+                              task_end(task) - offset);
     }
     if (task->s->progress) {
         progress_set_remaining(task->s->progress,
@@ -558,6 +655,55 @@ block_copy_do_copy(BlockCopyState *s, int64_t offset, int64_t bytes,
     return ret;
 }
 
+/*
+ * block_copy_do_copy_holes
+ *
+ * Copy a coalesced task: read the whole region, including its holes, with
+ * one request, and write back only the dirty extents between the holes.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+block_copy_do_copy_holes(BlockCopyState *s, BlockCopyTask *t,
+                         bool *error_is_read)
+{
+    int64_t offset = t->req.offset;
+    int64_t nbytes = MIN(task_end(t), s->len) - offset;
+    void *bounce_buffer;
+    int ret;
+    int i;
+
+    assert(t->method == COPY_READ_WRITE);
+    assert(nbytes < INT_MAX);
+
+    bounce_buffer = qemu_blockalign(s->source->bs, nbytes);
+
+    ret = bdrv_co_pread(s->source, offset, nbytes, bounce_buffer, 0);
+    if (ret < 0) {
+        trace_block_copy_read_fail(s, offset, ret);
+        *error_is_read = true;
+        goto out;
+    }
+
+    for (i = 0; i <= t->nb_holes; i++) {
+        int64_t start = i ? t->holes[i - 1].offset + t->holes[i - 1].bytes
+                          : offset;
+        int64_t end = i < t->nb_holes ? t->holes[i].offset
+                                      : MIN(task_end(t), s->len);
+
+        ret = bdrv_co_pwrite(s->target, start, end - start,
+                             bounce_buffer + (start - offset),
+                             s->write_flags);
+        if (ret < 0) {
+            trace_block_copy_write_fail(s, start, ret);
+            *error_is_read = false;
+            goto out;
+        }
+    }
+
+out:
+    qemu_vfree(bounce_buffer);
+    return ret;
+}
+
 static coroutine_fn int block_copy_task_entry(AioTask *task)
 {
     BlockCopyTask *t = container_of(task, BlockCopyTask, task);
@@ -567,8 +713,12 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
     int ret;
 
     WITH_GRAPH_RDLOCK_GUARD() {
-        ret = block_copy_do_copy(s, t->req.offset, t->req.bytes, &method,
-                                 &error_is_read);
+        if (t->nb_holes) {
+            ret = block_copy_do_copy_holes(s, t, &error_is_read);
+        } else {
+            ret = block_copy_do_copy(s, t->req.offset, t->req.bytes, &method,
+                                     &error_is_read);
+        }
     }
 
     WITH_QEMU_LOCK_GUARD(&s->lock) {
@@ -582,7 +732,7 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
                 t->call_state->error_is_read = error_is_read;
             }
         } else if (s->progress) {
-            progress_work_done(s->progress, t->req.bytes);
+            progress_work_done(s->progress, t->req.bytes - t->hole_bytes);
         }
     }
     co_put_to_shres(s->mem, t->req.bytes);
@@ -765,12 +915,16 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
             block_copy_task_end(task, 0);
             trace_block_copy_skip_range(s, task->req.offset, task->req.bytes);
             offset = task_end(task);
-            bytes = end - offset;
+            bytes = MAX(end - offset, 0);
             g_free(task);
             continue;
         }
         if (ret & BDRV_BLOCK_ZERO) {
             task->method = COPY_WRITE_ZEROES;
+        } else if (task->method == COPY_READ_WRITE &&
+                   status_bytes >= task->req.bytes &&
+                   !qatomic_read(&s->skip_unallocated)) {
+            block_copy_task_coalesce(task, end);
         }
 
         if (!call_state->ignore_ratelimit) {
@@ -790,8 +944,9 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
 
         co_get_from_shres(s->mem, task->req.bytes);
 
+        /* Readahead may have taken the task past the end of the request */
         offset = task_end(task);
-        bytes = end - offset;
+        bytes = MAX(end - offset, 0);
 
         if (!aio && bytes) {
             aio = aio_task_pool_new(call_state->max_workers);
@@ -846,6 +1001,22 @@ block_copy_common(BlockCopyCallState *call_state)
 
     qemu_co_mutex_lock(&s->lock);
     QLIST_INSERT_HEAD(&s->calls, call_state, list);
+    if (!call_state->co) {
+        /*
+         * Synchronous block_copy() calls (e.g. copy-before-write) that
+         * continue where the last one stopped get a growing readahead, so
+         * that a sequential writer does not read the source one small
+         * request at a time.
+         */
+        if (call_state->offset == s->last_call_end) {
+            s->readahead = MIN(MAX(s->readahead * 2, s->cluster_size),
+                               BLOCK_COPY_MAX_READAHEAD);
+        } else {
+            s->readahead = 0;
+        }
+        s->last_call_end = call_state->offset + call_state->bytes;
+        call_state->readahead = s->readahead;
+    }
     qemu_co_mutex_unlock(&s->lock);
 
     do {
@@ -20,8 +20,10 @@
 
 #include "qemu/osdep.h"
 
+#include "block/aio_task.h"
 #include "block/block_int.h"
 #include "block/qdict.h"
+#include "block/thread-pool.h"
 #include "sysemu/block-backend.h"
 #include "crypto/block.h"
 #include "qapi/opts-visitor.h"
@@ -32,13 +34,30 @@
 #include "qemu/option.h"
 #include "qemu/cutils.h"
 #include "qemu/memalign.h"
+#include "qemu/units.h"
 #include "crypto.h"
 
 typedef struct BlockCrypto BlockCrypto;
 
+/*
+ * Chunks of at least this size are encrypted in the thread pool, split
+ * into up to BLOCK_CRYPTO_MAX_THREADS parts that are processed in
+ * parallel.  Smaller ones are cheaper to handle in the request coroutine.
+ */
+#define BLOCK_CRYPTO_PARALLEL_MIN (128 * KiB)
+#define BLOCK_CRYPTO_MAX_THREADS 4
+
 struct BlockCrypto {
     QCryptoBlock *block;
     bool updating_keys;
+
+    /*
+     * The block has one cipher per thread, so no more than
+     * BLOCK_CRYPTO_MAX_THREADS encryption operations may run at once.
+     */
+    CoMutex lock;
+    CoQueue thread_queue;
+    int nb_threads;
 };
 
 
@@ -299,11 +318,13 @@ static int block_crypto_open_generic(QCryptoBlockFormat format,
     if (flags & BDRV_O_NO_IO) {
         cflags |= QCRYPTO_BLOCK_OPEN_NO_IO;
     }
+    qemu_co_mutex_init(&crypto->lock);
+    qemu_co_queue_init(&crypto->thread_queue);
     crypto->block = qcrypto_block_open(open_opts, NULL,
                                        block_crypto_read_func,
                                        bs,
                                        cflags,
-                                       1,
+                                       BLOCK_CRYPTO_MAX_THREADS,
                                        errp);
 
     if (!crypto->block) {
@@ -404,6 +425,112 @@ static int block_crypto_reopen_prepare(BDRVReopenState *state,
  */
 #define BLOCK_CRYPTO_MAX_IO_SIZE (1024 * 1024)
 
+typedef struct BlockCryptoTask {
+    AioTask task;
+    BlockCrypto *crypto;
+    uint64_t offset;
+    uint8_t *buf;
+    size_t len;
+    bool encrypt;
+} BlockCryptoTask;
+
+static void coroutine_fn block_crypto_get_thread(BlockCrypto *crypto)
+{
+    qemu_co_mutex_lock(&crypto->lock);
+    while (crypto->nb_threads >= BLOCK_CRYPTO_MAX_THREADS) {
+        qemu_co_queue_wait(&crypto->thread_queue, &crypto->lock);
+    }
+    crypto->nb_threads++;
+    qemu_co_mutex_unlock(&crypto->lock);
+}
+
+static void coroutine_fn block_crypto_put_thread(BlockCrypto *crypto)
+{
+    qemu_co_mutex_lock(&crypto->lock);
+    crypto->nb_threads--;
+    qemu_co_queue_next(&crypto->thread_queue);
+    qemu_co_mutex_unlock(&crypto->lock);
+}
+
+static int block_crypto_encdec_func(void *opaque)
+{
+    BlockCryptoTask *t = opaque;
+    int ret;
+
+    if (t->encrypt) {
+        ret = qcrypto_block_encrypt(t->crypto->block, t->offset,
+                                    t->buf, t->len, NULL);
+    } else {
+        ret = qcrypto_block_decrypt(t->crypto->block, t->offset,
+                                    t->buf, t->len, NULL);
+    }
+    return ret < 0 ? -EIO : 0;
+}
+
+static int coroutine_fn block_crypto_encdec_task_entry(AioTask *task)
+{
+    BlockCryptoTask *t = container_of(task, BlockCryptoTask, task);
+    int ret;
+
+    block_crypto_get_thread(t->crypto);
+    ret = thread_pool_submit_co(block_crypto_encdec_func, t);
+    block_crypto_put_thread(t->crypto);
+
+    return ret;
+}
+
+/*
+ * Encrypt or decrypt @len bytes at @buf in place, @offset being the
+ * offset of the data in the payload.
+ */
+static int coroutine_fn
+block_crypto_co_encdec(BlockCrypto *crypto, uint64_t offset, uint8_t *buf,
+                       size_t len, bool encrypt)
+{
+    uint64_t sector_size = qcrypto_block_get_sector_size(crypto->block);
+    AioTaskPool *pool;
+    size_t chunk, done;
+    int ret;
+
+    if (len < BLOCK_CRYPTO_PARALLEL_MIN) {
+        BlockCryptoTask t = {
+            .crypto = crypto,
+            .offset = offset,
+            .buf = buf,
+            .len = len,
+            .encrypt = encrypt,
+        };
+
+        block_crypto_get_thread(crypto);
+        ret = block_crypto_encdec_func(&t);
+        block_crypto_put_thread(crypto);
+        return ret;
+    }
+
+    chunk = QEMU_ALIGN_UP(DIV_ROUND_UP(len, BLOCK_CRYPTO_MAX_THREADS),
+                          sector_size);
+    pool = aio_task_pool_new(BLOCK_CRYPTO_MAX_THREADS);
+    for (done = 0; done < len && aio_task_pool_status(pool) == 0;
+         done += chunk) {
+        BlockCryptoTask *t = g_new(BlockCryptoTask, 1);
+
+        *t = (BlockCryptoTask) {
+            .task.func = block_crypto_encdec_task_entry,
+            .crypto = crypto,
+            .offset = offset + done,
+            .buf = buf + done,
+            .len = MIN(chunk, len - done),
+            .encrypt = encrypt,
+        };
+        aio_task_pool_start_task(pool, &t->task);
+    }
+    aio_task_pool_wait_all(pool);
+    ret = aio_task_pool_status(pool);
+    aio_task_pool_free(pool);
+
+    return ret;
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
                        QEMUIOVector *qiov, BdrvRequestFlags flags)
@@ -446,9 +573,9 @@ block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
             goto cleanup;
         }
 
-        if (qcrypto_block_decrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
-            ret = -EIO;
+        ret = block_crypto_co_encdec(crypto, offset + bytes_done,
+                                     cipher_data, cur_bytes, false);
+        if (ret < 0) {
             goto cleanup;
         }
 
@@ -503,9 +630,9 @@ block_crypto_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
 
         qemu_iovec_to_buf(qiov, bytes_done, cipher_data, cur_bytes);
 
-        if (qcrypto_block_encrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
-            ret = -EIO;
+        ret = block_crypto_co_encdec(crypto, offset + bytes_done,
+                                     cipher_data, cur_bytes, true);
+        if (ret < 0) {
             goto cleanup;
         }
 
@@ -48,9 +48,12 @@
                    CURLPROTO_FTP | CURLPROTO_FTPS)
 #endif
 
-#define CURL_NUM_STATES 8
 #define CURL_NUM_ACB    8
 #define CURL_TIMEOUT_MAX 10000
+#define CURL_CONNECTIONS_MAX 64
+
+/* Sequential readahead grows up to 2^CURL_READAHEAD_MAX_SHIFT * readahead */
+#define CURL_READAHEAD_MAX_SHIFT 5
 
 #define CURL_BLOCK_OPT_URL       "url"
 #define CURL_BLOCK_OPT_READAHEAD "readahead"
@@ -62,10 +65,16 @@
 #define CURL_BLOCK_OPT_PASSWORD_SECRET "password-secret"
 #define CURL_BLOCK_OPT_PROXY_USERNAME "proxy-username"
 #define CURL_BLOCK_OPT_PROXY_PASSWORD_SECRET "proxy-password-secret"
+#define CURL_BLOCK_OPT_CONNECTIONS "connections"
+#define CURL_BLOCK_OPT_CACHE_SIZE "cache-size"
+#define CURL_BLOCK_OPT_HTTP2 "http2"
 
 #define CURL_BLOCK_OPT_READAHEAD_DEFAULT (256 * 1024)
 #define CURL_BLOCK_OPT_SSLVERIFY_DEFAULT true
 #define CURL_BLOCK_OPT_TIMEOUT_DEFAULT 5
+#define CURL_BLOCK_OPT_CONNECTIONS_DEFAULT 8
+#define CURL_BLOCK_OPT_CACHE_SIZE_DEFAULT (16 * 1024 * 1024)
+#define CURL_BLOCK_OPT_HTTP2_DEFAULT true
 
 struct BDRVCURLState;
 struct CURLState;
@@ -103,14 +112,33 @@ typedef struct CURLState
     char in_use;
 } CURLState;
 
+/* A completed range transfer, kept in the shared cache */
+typedef struct CURLCacheEntry {
+    uint64_t start;
+    size_t len;
+    char *buf;
+    QTAILQ_ENTRY(CURLCacheEntry) next;
+} CURLCacheEntry;
+
 typedef struct BDRVCURLState {
     CURLM *multi;
     QEMUTimer timer;
     uint64_t len;
-    CURLState states[CURL_NUM_STATES];
+    CURLState *states;
+    int num_states;
     GHashTable *sockets; /* GINT_TO_POINTER(fd) -> socket */
     char *url;
     size_t readahead_size;
+    /* Current readahead, grows while the image is read sequentially */
+    size_t cur_readahead;
+    size_t max_readahead;
+    /* End of the last range that was requested */
+    uint64_t next_offset;
+    /* Most recently used entries first */
+    QTAILQ_HEAD(, CURLCacheEntry) cache;
+    size_t cache_size;
+    size_t cache_used;
+    bool http2;
     bool sslverify;
     uint64_t timeout;
     char *cookie;
@@ -273,12 +301,28 @@ read_end:
 static bool curl_find_buf(BDRVCURLState *s, uint64_t start, uint64_t len,
                           CURLAIOCB *acb)
 {
+    CURLCacheEntry *e;
     int i;
     uint64_t end = start + len;
     uint64_t clamped_end = MIN(end, s->len);
     uint64_t clamped_len = clamped_end - start;
 
-    for (i=0; i<CURL_NUM_STATES; i++) {
+    QTAILQ_FOREACH(e, &s->cache, next) {
+        if (start >= e->start && clamped_end <= e->start + e->len) {
+            qemu_iovec_from_buf(acb->qiov, 0, e->buf + (start - e->start),
+                                clamped_len);
+            if (clamped_len < len) {
+                qemu_iovec_memset(acb->qiov, clamped_len, 0,
+                                  len - clamped_len);
+            }
+            QTAILQ_REMOVE(&s->cache, e, next);
+            QTAILQ_INSERT_HEAD(&s->cache, e, next);
+            acb->ret = 0;
+            return true;
+        }
+    }
+
+    for (i = 0; i < s->num_states; i++) {
         CURLState *state = &s->states[i];
         uint64_t buf_end = (state->buf_start + state->buf_off);
         uint64_t buf_fend = (state->buf_start + state->buf_len);
@@ -328,6 +372,46 @@ static bool curl_find_buf(BDRVCURLState *s, uint64_t start, uint64_t len,
     return false;
 }
 
+/* Called with s->mutex held.  */
+static void curl_cache_evict(BDRVCURLState *s, size_t size)
+{
+    CURLCacheEntry *e;
+
+    while (s->cache_used > size) {
+        e = QTAILQ_LAST(&s->cache);
+        QTAILQ_REMOVE(&s->cache, e, next);
+        s->cache_used -= e->len;
+        g_free(e->buf);
+        g_free(e);
+    }
+}
+
+/*
+ * Move the data of the completed transfer in @state to the cache, so that
+ * it outlives the reuse of @state for another range.
+ *
+ * Called with s->mutex held.
+ */
+static void curl_cache_insert(BDRVCURLState *s, CURLState *state)
+{
+    CURLCacheEntry *e;
+
+    if (!state->buf_off || state->buf_off > s->cache_size) {
+        return;
+    }
+
+    e = g_new(CURLCacheEntry, 1);
+    e->start = state->buf_start;
+    e->len = state->buf_off;
+    e->buf = state->orig_buf;
+    state->orig_buf = NULL;
+    state->buf_off = 0;
+
+    curl_cache_evict(s, s->cache_size - e->len);
+    QTAILQ_INSERT_HEAD(&s->cache, e, next);
+    s->cache_used += e->len;
+}
+
 /* Called with s->mutex held.  */
 static void curl_multi_check_completion(BDRVCURLState *s)
 {
@@ -394,6 +478,9 @@ static void curl_multi_check_completion(BDRVCURLState *s)
                 qemu_mutex_lock(&s->mutex);
             }
 
+            if (!error) {
+                curl_cache_insert(s, state);
+            }
             curl_clean_state(state);
             break;
         }
@@ -449,7 +536,7 @@ static CURLState *curl_find_state(BDRVCURLState *s)
     CURLState *state = NULL;
     int i;
 
-    for (i = 0; i < CURL_NUM_STATES; i++) {
+    for (i = 0; i < s->num_states; i++) {
         if (!s->states[i].in_use) {
             state = &s->states[i];
             state->in_use = 1;
@@ -490,6 +577,19 @@ static int curl_init_state(BDRVCURLState *s, CURLState *state)
             curl_easy_setopt(state->curl, CURLOPT_FAILONERROR, 1)) {
             goto err;
         }
+#if LIBCURL_VERSION_NUM >= 0x072f00
+        /*
+         * Negotiate HTTP/2 for https:// URLs, and let transfers wait for
+         * a connection that they can be multiplexed on rather than open
+         * one each.
+         */
+        if (s->http2 &&
+            (curl_easy_setopt(state->curl, CURLOPT_HTTP_VERSION,
+                              CURL_HTTP_VERSION_2TLS) ||
+             curl_easy_setopt(state->curl, CURLOPT_PIPEWAIT, 1L))) {
+            goto err;
+        }
+#endif
         if (s->username) {
             if (curl_easy_setopt(state->curl, CURLOPT_USERNAME, s->username)) {
                 goto err;
@@ -581,7 +681,7 @@ static void curl_detach_aio_context(BlockDriverState *bs)
 
     WITH_QEMU_LOCK_GUARD(&s->mutex) {
         curl_drop_all_sockets(s->sockets);
-        for (i = 0; i < CURL_NUM_STATES; i++) {
+        for (i = 0; i < s->num_states; i++) {
             if (s->states[i].in_use) {
                 curl_clean_state(&s->states[i]);
             }
@@ -616,6 +716,11 @@ static void curl_attach_aio_context(BlockDriverState *bs,
     curl_multi_setopt(s->multi, CURLMOPT_SOCKETFUNCTION, curl_sock_cb);
     curl_multi_setopt(s->multi, CURLMOPT_TIMERDATA, s);
     curl_multi_setopt(s->multi, CURLMOPT_TIMERFUNCTION, curl_timer_cb);
+#if LIBCURL_VERSION_NUM >= 0x072f00
+    if (s->http2) {
+        curl_multi_setopt(s->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+    }
+#endif
 }
 
 static QemuOptsList runtime_opts = {
@@ -672,6 +777,21 @@ static QemuOptsList runtime_opts = {
             .type = QEMU_OPT_STRING,
             .help = "ID of secret used as password for HTTP proxy auth",
         },
+        {
+            .name = CURL_BLOCK_OPT_CONNECTIONS,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Maximum number of parallel range requests"
+        },
+        {
+            .name = CURL_BLOCK_OPT_CACHE_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Size of the cache of fetched ranges"
+        },
+        {
+            .name = CURL_BLOCK_OPT_HTTP2,
+            .type = QEMU_OPT_BOOL,
+            .help = "Multiplex requests over HTTP/2 connections"
+        },
         { /* end of list */ }
     },
 };
@@ -734,6 +854,25 @@ static int curl_open(BlockDriverState *bs, QDict *options, int flags,
         goto out_noclean;
     }
 
+    s->num_states = qemu_opt_get_number(opts, CURL_BLOCK_OPT_CONNECTIONS,
+                                        CURL_BLOCK_OPT_CONNECTIONS_DEFAULT);
+    if (s->num_states < 1 || s->num_states > CURL_CONNECTIONS_MAX) {
+        error_setg(errp, "connections must be between 1 and %d",
+                   CURL_CONNECTIONS_MAX);
+        goto out_noclean;
+    }
+
+    s->cache_size = qemu_opt_get_size(opts, CURL_BLOCK_OPT_CACHE_SIZE,
+                                      CURL_BLOCK_OPT_CACHE_SIZE_DEFAULT);
+    s->http2 = qemu_opt_get_bool(opts, CURL_BLOCK_OPT_HTTP2,
+                                 CURL_BLOCK_OPT_HTTP2_DEFAULT);
+
+    /* Do not let a single sequential window take over the whole cache */
+    s->cur_readahead = s->readahead_size;
+    s->max_readahead = MAX(s->readahead_size,
+                           MIN(s->readahead_size << CURL_READAHEAD_MAX_SHIFT,
+                               ROUND_DOWN(s->cache_size / 4, 512)));
+
     s->sslverify = qemu_opt_get_bool(opts, CURL_BLOCK_OPT_SSLVERIFY,
                                      CURL_BLOCK_OPT_SSLVERIFY_DEFAULT);
 
@@ -795,6 +934,8 @@ static int curl_open(BlockDriverState *bs, QDict *options, int flags,
     s->aio_context = bdrv_get_aio_context(bs);
     s->url = g_strdup(file);
     s->sockets = g_hash_table_new_full(NULL, NULL, NULL, g_free);
+    s->states = g_new0(CURLState, s->num_states);
+    QTAILQ_INIT(&s->cache);
     qemu_mutex_lock(&s->mutex);
     state = curl_find_state(s);
     qemu_mutex_unlock(&s->mutex);
@@ -882,6 +1023,7 @@ out_noclean:
     g_free(s->username);
     g_free(s->proxyusername);
     g_free(s->proxypassword);
+    g_free(s->states);
     if (s->sockets) {
         curl_drop_all_sockets(s->sockets);
         g_hash_table_destroy(s->sockets);
@@ -890,15 +1032,78 @@ out_noclean:
     return -EINVAL;
 }
 
+/*
+ * Start fetching @len bytes at @start into @state, which must have been
+ * reserved and initialized.
+ *
+ * Called with s->mutex held.
+ */
+static int curl_start_transfer(BDRVCURLState *s, CURLState *state,
+                               uint64_t start, uint64_t len)
+{
+    int running;
+
+    state->buf_off = 0;
+    g_free(state->orig_buf);
+    state->buf_start = start;
+    state->buf_len = len;
+    state->orig_buf = g_try_malloc(state->buf_len);
+    if (state->buf_len && state->orig_buf == NULL) {
+        return -ENOMEM;
+    }
+
+    snprintf(state->range, 127, "%" PRIu64 "-%" PRIu64,
+             start, start + len - 1);
+    if (curl_easy_setopt(state->curl, CURLOPT_RANGE, state->range) ||
+        curl_multi_add_handle(s->multi, state->curl) != CURLM_OK) {
+        return -EIO;
+    }
+
+    /* Tell curl it needs to kick things off */
+    curl_multi_socket_action(s->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+    return 0;
+}
+
+/*
+ * Fetch the range that follows @start in the background if a connection is
+ * free, so that a sequential reader finds it in the cache.
+ *
+ * Called with s->mutex held.
+ */
+static void curl_prefetch(BDRVCURLState *s, uint64_t start)
+{
+    CURLState *state;
+    uint64_t len;
+
+    if (start >= s->len) {
+        return;
+    }
+
+    state = curl_find_state(s);
+    if (!state) {
+        return;
+    }
+
+    len = MIN(s->cur_readahead, s->len - start);
+    if (curl_init_state(s, state) < 0 ||
+        curl_start_transfer(s, state, start, len) < 0) {
+        curl_clean_state(state);
+        return;
+    }
+
+    trace_curl_prefetch(start, len);
+    s->next_offset = start + len;
+}
+
 static void coroutine_fn curl_setup_preadv(BlockDriverState *bs, CURLAIOCB *acb)
 {
     CURLState *state;
-    int running;
+    bool sequential;
+    int ret;
 
     BDRVCURLState *s = bs->opaque;
 
     uint64_t start = acb->offset;
-    uint64_t end;
 
     qemu_mutex_lock(&s->mutex);
 
@@ -926,32 +1131,37 @@ static void coroutine_fn curl_setup_preadv(BlockDriverState *bs, CURLAIOCB *acb)
     acb->start = 0;
     acb->end = MIN(acb->bytes, s->len - start);
 
-    state->buf_off = 0;
-    g_free(state->orig_buf);
-    state->buf_start = start;
-    state->buf_len = MIN(acb->end + s->readahead_size, s->len - start);
-    end = start + state->buf_len - 1;
-    state->orig_buf = g_try_malloc(state->buf_len);
-    if (state->buf_len && state->orig_buf == NULL) {
-        curl_clean_state(state);
-        acb->ret = -ENOMEM;
-        goto out;
+    /*
+     * A read that starts shortly after the last requested range keeps
+     * the stream sequential: double the readahead and fetch the next
+     * window in parallel.  Anything else falls back to the configured
+     * readahead.
+     */
+    sequential = start >= s->next_offset &&
+                 start - s->next_offset <= s->readahead_size;
+    if (sequential) {
+        s->cur_readahead = MIN(s->cur_readahead * 2, s->max_readahead);
+    } else {
+        s->cur_readahead = s->readahead_size;
     }
-    state->acb[0] = acb;
 
-    snprintf(state->range, 127, "%" PRIu64 "-%" PRIu64, start, end);
+    state->acb[0] = acb;
+    ret = curl_start_transfer(s, state, start,
+                              MIN(acb->end + s->cur_readahead,
+                                  s->len - start));
     trace_curl_setup_preadv(acb->bytes, start, state->range);
-    if (curl_easy_setopt(state->curl, CURLOPT_RANGE, state->range) ||
-        curl_multi_add_handle(s->multi, state->curl) != CURLM_OK) {
+    if (ret < 0) {
         state->acb[0] = NULL;
-        acb->ret = -EIO;
+        acb->ret = ret;
 
         curl_clean_state(state);
         goto out;
     }
+    s->next_offset = state->buf_start + state->buf_len;
 
-    /* Tell curl it needs to kick things off */
-    curl_multi_socket_action(s->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+    if (sequential) {
+        curl_prefetch(s, s->next_offset);
+    }
 
 out:
     qemu_mutex_unlock(&s->mutex);
@@ -982,6 +1192,8 @@ static void curl_close(BlockDriverState *bs)
 
     trace_curl_close();
     curl_detach_aio_context(bs);
+    curl_cache_evict(s, 0);
+    g_free(s->states);
     qemu_mutex_destroy(&s->mutex);
 
     g_hash_table_destroy(s->sockets);
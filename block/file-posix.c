@@ -160,6 +160,11 @@ typedef struct BDRVRawState {
     bool has_write_zeroes:1;
     bool use_linux_aio:1;
     bool use_linux_io_uring:1;
+    bool use_fixed_buffers:1;
+#ifdef CONFIG_LINUX_IO_URING
+    /* Private ring for aio-sqpoll/aio-iopoll, NULL for the shared one */
+    LuringState *luring;
+#endif
     int page_cache_inconsistent; /* errno from fdatasync failure */
     bool has_fallocate;
     bool needs_alignment;
@@ -173,6 +178,11 @@ typedef struct BDRVRawState {
     } stats;
 
     PRManager *pr_mgr;
+#if defined(__linux__)
+    /* Use the asynchronous /dev/sg interface for SG_IO */
+    bool sg_async;
+    QLIST_HEAD(, RawSgRequest) sg_reqs;
+#endif
 } BDRVRawState;
 
 typedef struct BDRVRawReopenState {
@@ -560,6 +570,21 @@ static QemuOptsList raw_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "AIO max batch size (0 = auto handled by AIO backend, default: 0)",
         },
+        {
+            .name = "aio-fixed-buffers",
+            .type = QEMU_OPT_BOOL,
+            .help = "register guest memory with io_uring (default: off)",
+        },
+        {
+            .name = "aio-sqpoll",
+            .type = QEMU_OPT_BOOL,
+            .help = "io_uring submission queue polling (default: off)",
+        },
+        {
+            .name = "aio-iopoll",
+            .type = QEMU_OPT_BOOL,
+            .help = "io_uring completion polling (default: off)",
+        },
         {
             .name = "locking",
             .type = QEMU_OPT_STRING,
@@ -601,6 +626,9 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
     int fd, ret;
     struct stat st;
     OnOffAuto locking;
+#ifdef CONFIG_LINUX_IO_URING
+    unsigned int luring_flags = 0;
+#endif
 
     opts = qemu_opts_create(&raw_runtime_opts, NULL, 0, &error_abort);
     if (!qemu_opts_absorb_qdict(opts, options, errp)) {
@@ -641,6 +669,32 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
 
     s->aio_max_batch = qemu_opt_get_number(opts, "aio-max-batch", 0);
 
+    s->use_fixed_buffers = qemu_opt_get_bool(opts, "aio-fixed-buffers", false);
+    if (s->use_fixed_buffers && aio != BLOCKDEV_AIO_OPTIONS_IO_URING) {
+        error_setg(errp, "aio-fixed-buffers requires aio=io_uring");
+        ret = -EINVAL;
+        goto fail;
+    }
+
+#ifdef CONFIG_LINUX_IO_URING
+    if (qemu_opt_get_bool(opts, "aio-sqpoll", false)) {
+        luring_flags |= LURING_SQPOLL;
+    }
+    if (qemu_opt_get_bool(opts, "aio-iopoll", false)) {
+        luring_flags |= LURING_IOPOLL;
+    }
+    if (luring_flags && aio != BLOCKDEV_AIO_OPTIONS_IO_URING) {
+        error_setg(errp, "aio-sqpoll and aio-iopoll require aio=io_uring");
+        ret = -EINVAL;
+        goto fail;
+    }
+    if ((luring_flags & LURING_IOPOLL) && !(bdrv_flags & BDRV_O_NOCACHE)) {
+        error_setg(errp, "aio-iopoll requires cache.direct=on");
+        ret = -EINVAL;
+        goto fail;
+    }
+#endif
+
     locking = qapi_enum_parse(&OnOffAuto_lookup,
                               qemu_opt_get(opts, "locking"),
                               ON_OFF_AUTO_AUTO, &local_err);
@@ -740,6 +794,15 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
             goto fail;
         }
     }
+    if (luring_flags) {
+        s->luring = luring_init(luring_flags, errp);
+        if (!s->luring) {
+            error_prepend(errp, "Unable to use io_uring polling: ");
+            ret = -EINVAL;
+            goto fail;
+        }
+        luring_attach_aio_context(s->luring, bdrv_get_aio_context(bs));
+    }
 #else
     if (s->use_linux_io_uring) {
         error_setg(errp, "aio=io_uring was specified, but is not supported "
@@ -818,8 +881,20 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
         /* When extending regular files, we get zeros from the OS */
         bs->supported_truncate_flags = BDRV_REQ_ZERO_WRITE;
     }
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->use_linux_io_uring) {
+        luring_register_fd(s->fd);
+    }
+#endif
     ret = 0;
 fail:
+#ifdef CONFIG_LINUX_IO_URING
+    if (ret < 0 && s->luring) {
+        luring_detach_aio_context(s->luring, bdrv_get_aio_context(bs));
+        luring_cleanup(s->luring);
+        s->luring = NULL;
+    }
+#endif
     if (ret < 0 && s->fd != -1) {
         qemu_close(s->fd);
     }
@@ -2476,7 +2551,7 @@ static int coroutine_fn raw_co_prw(BlockDriverState *bs, int64_t *offset_ptr,
 #ifdef CONFIG_LINUX_IO_URING
     } else if (s->use_linux_io_uring) {
         assert(qiov->size == bytes);
-        ret = luring_co_submit(bs, s->fd, offset, qiov, type);
+        ret = luring_co_submit(bs, s->luring, s->fd, offset, qiov, type);
         goto out;
 #endif
 #ifdef CONFIG_LINUX_AIO
@@ -2568,7 +2643,8 @@ static int coroutine_fn raw_co_flush_to_disk(BlockDriverState *bs)
 
 #ifdef CONFIG_LINUX_IO_URING
     if (s->use_linux_io_uring) {
-        return luring_co_submit(bs, s->fd, 0, NULL, QEMU_AIO_FLUSH);
+        /* IOPOLL rings cannot fsync, always use the shared ring */
+        return luring_co_submit(bs, NULL, s->fd, 0, NULL, QEMU_AIO_FLUSH);
     }
 #endif
     return raw_thread_pool_submit(handle_aiocb_flush, &acb);
@@ -2597,9 +2673,50 @@ static void raw_aio_attach_aio_context(BlockDriverState *bs,
             s->use_linux_io_uring = false;
         }
     }
+    if (s->luring) {
+        luring_attach_aio_context(s->luring, new_context);
+    }
 #endif
 }
 
+static void raw_aio_detach_aio_context(BlockDriverState *bs)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    BDRVRawState *s = bs->opaque;
+
+    if (s->luring) {
+        luring_detach_aio_context(s->luring, bdrv_get_aio_context(bs));
+    }
+#endif
+}
+
+#ifdef CONFIG_LINUX_IO_URING
+/*
+ * With aio-fixed-buffers, guest memory is registered as io_uring fixed
+ * buffers so that the kernel does not have to pin the pages of every
+ * request.  This pins all of it for as long as it is registered.
+ */
+static bool raw_register_buf(BlockDriverState *bs, void *host, size_t size,
+                             Error **errp)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (s->use_fixed_buffers) {
+        luring_register_buf(host, size);
+    }
+    return true;
+}
+
+static void raw_unregister_buf(BlockDriverState *bs, void *host, size_t size)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (s->use_fixed_buffers) {
+        luring_unregister_buf(host, size);
+    }
+}
+#endif
+
 static void raw_close(BlockDriverState *bs)
 {
     BDRVRawState *s = bs->opaque;
@@ -2607,6 +2724,14 @@ static void raw_close(BlockDriverState *bs)
     if (s->fd >= 0) {
 #if defined(CONFIG_BLKZONED)
         g_free(bs->wps);
+#endif
+#ifdef CONFIG_LINUX_IO_URING
+        luring_unregister_fd(s->fd);
+        if (s->luring) {
+            luring_detach_aio_context(s->luring, bdrv_get_aio_context(bs));
+            luring_cleanup(s->luring);
+            s->luring = NULL;
+        }
 #endif
         qemu_close(s->fd);
         s->fd = -1;
@@ -3533,6 +3658,34 @@ static int coroutine_fn raw_co_zone_append(BlockDriverState *bs,
 }
 #endif
 
+#if defined(CONFIG_FALLOCATE_PUNCH_HOLE) || \
+    defined(CONFIG_FALLOCATE_ZERO_RANGE)
+/*
+ * Run fallocate() on a regular file through io_uring instead of the thread
+ * pool, which avoids spawning worker threads for large discards and zero
+ * writes.  Returns -ENOSYS if io_uring is not in use or cannot do it, and
+ * the result of fallocate() otherwise.
+ */
+static int coroutine_fn
+raw_co_fallocate_uring(BlockDriverState *bs, int mode, int64_t offset,
+                       int64_t bytes)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    BDRVRawState *s = bs->opaque;
+    int ret;
+
+    if (!s->use_linux_io_uring) {
+        return -ENOSYS;
+    }
+
+    ret = luring_co_fallocate(bs, s->fd, mode, offset, bytes);
+    return ret == -ENOSYS ? ret : translate_err(ret);
+#else
+    return -ENOSYS;
+#endif
+}
+#endif
+
 static coroutine_fn int
 raw_do_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes,
                 bool blkdev)
@@ -3541,6 +3694,18 @@ raw_do_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes,
     RawPosixAIOData acb;
     int ret;
 
+#ifdef CONFIG_FALLOCATE_PUNCH_HOLE
+    if (!blkdev && s->has_discard) {
+        ret = raw_co_fallocate_uring(bs, FALLOC_FL_PUNCH_HOLE |
+                                     FALLOC_FL_KEEP_SIZE, offset, bytes);
+        if (ret != -ENOSYS && ret != -ENOTSUP) {
+            raw_account_discard(s, bytes, ret);
+            return ret;
+        }
+        /* Let handle_aiocb_discard() sort out -ENOTSUP */
+    }
+#endif
+
     acb = (RawPosixAIOData) {
         .bs             = bs,
         .aio_fildes     = s->fd,
@@ -3628,6 +3793,44 @@ raw_do_pwrite_zeroes(BlockDriverState *bs, int64_t offset, int64_t bytes,
         handler = handle_aiocb_write_zeroes;
     }
 
+    /*
+     * For regular files, try the first fallocate() of the handlers through
+     * io_uring.  Only the rarer fallbacks still need the thread pool.
+     */
+#if defined(CONFIG_FALLOCATE_PUNCH_HOLE) || \
+    defined(CONFIG_FALLOCATE_ZERO_RANGE)
+    if (!blkdev) {
+        int ret;
+
+#ifdef CONFIG_FALLOCATE_PUNCH_HOLE
+        if (flags & BDRV_REQ_MAY_UNMAP) {
+            ret = raw_co_fallocate_uring(bs, FALLOC_FL_PUNCH_HOLE |
+                                         FALLOC_FL_KEEP_SIZE, offset, bytes);
+            if (ret == -ENOSYS) {
+                return raw_thread_pool_submit(handler, &acb);
+            }
+            if (ret != -ENOTSUP && ret != -EINVAL && ret != -EBUSY) {
+                return ret;
+            }
+            /* Same as handle_aiocb_write_zeroes_unmap() */
+            handler = handle_aiocb_write_zeroes;
+        }
+#endif
+
+#ifdef CONFIG_FALLOCATE_ZERO_RANGE
+        if (s->has_write_zeroes) {
+            ret = raw_co_fallocate_uring(bs, FALLOC_FL_ZERO_RANGE,
+                                         offset, bytes);
+            if (ret == -ENOTSUP) {
+                s->has_write_zeroes = false;
+            } else if (ret != -ENOSYS && ret != -EINVAL) {
+                return ret;
+            }
+        }
+#endif
+    }
+#endif
+
     return raw_thread_pool_submit(handler, &acb);
 }
 
@@ -3799,6 +4002,12 @@ static void raw_set_perm(BlockDriverState *bs, uint64_t perm, uint64_t shared)
     /* For reopen, we have already switched to the new fd (.bdrv_set_perm is
      * called after .bdrv_reopen_commit) */
     if (s->perm_change_fd && s->fd != s->perm_change_fd) {
+#ifdef CONFIG_LINUX_IO_URING
+        luring_unregister_fd(s->fd);
+        if (s->use_linux_io_uring) {
+            luring_register_fd(s->perm_change_fd);
+        }
+#endif
         qemu_close(s->fd);
         s->fd = s->perm_change_fd;
         s->open_flags = s->perm_change_flags;
@@ -3897,6 +4106,11 @@ BlockDriver bdrv_file = {
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
     .bdrv_refresh_limits = raw_refresh_limits,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
+    .bdrv_detach_aio_context = raw_aio_detach_aio_context,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
+#endif
 
     .bdrv_co_truncate                   = raw_co_truncate,
     .bdrv_co_getlength                  = raw_co_getlength,
@@ -4173,11 +4387,114 @@ hdev_open_Mac_error:
 
     /* Since this does ioctl the device must be already opened */
     bs->sg = hdev_is_sg(bs);
+#if defined(__linux__)
+    s->sg_async = bs->sg;
+#endif
 
     return ret;
 }
 
 #if defined(__linux__)
+/*
+ * SG_IO commands for /dev/sg devices are issued with the asynchronous sg
+ * interface instead of the SG_IO ioctl: writing the sg_io_hdr to the file
+ * descriptor queues the command and returns at once, and the header of a
+ * completed command can be read back once the file descriptor becomes
+ * readable.  This needs no thread pool worker per command, and the kernel
+ * keeps up to SG_MAX_QUEUE commands per file descriptor outstanding.  The
+ * data buffers are mapped in the same way as for the ioctl.
+ */
+typedef struct RawSgRequest {
+    Coroutine *co;
+    struct sg_io_hdr *hdr;
+    void *usr_ptr;
+    int ret;
+    QLIST_ENTRY(RawSgRequest) next;
+} RawSgRequest;
+
+static void hdev_sg_complete(BlockDriverState *bs, RawSgRequest *req, int ret)
+{
+    BDRVRawState *s = bs->opaque;
+
+    QLIST_REMOVE(req, next);
+    if (QLIST_EMPTY(&s->sg_reqs)) {
+        aio_set_fd_handler(bdrv_get_aio_context(bs), s->fd,
+                           NULL, NULL, NULL, NULL, NULL);
+    }
+    req->ret = ret;
+    aio_co_wake(req->co);
+}
+
+static void hdev_sg_read(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVRawState *s = bs->opaque;
+    RawSgRequest *req, *next;
+    struct sg_io_hdr hdr;
+    ssize_t len;
+
+    /*
+     * The file descriptor is only readable while a command issued with
+     * write() has completed, so this does not block.
+     */
+    len = RETRY_ON_EINTR(read(s->fd, &hdr, sizeof(hdr)));
+    if (len == sizeof(hdr)) {
+        req = hdr.usr_ptr;
+        hdr.usr_ptr = req->usr_ptr;
+        *req->hdr = hdr;
+        hdev_sg_complete(bs, req, 0);
+        return;
+    }
+    if (len < 0 && errno == EAGAIN) {
+        return;
+    }
+
+    /* The device is gone or broken, fail everything that is outstanding */
+    QLIST_FOREACH_SAFE(req, &s->sg_reqs, next, next) {
+        hdev_sg_complete(bs, req, len < 0 ? -errno : -EIO);
+    }
+}
+
+/*
+ * Returns the result of the command, or -ENOTSUP if it could not be
+ * queued and has to go through the SG_IO ioctl instead.
+ */
+static int coroutine_fn hdev_co_sg_io(BlockDriverState *bs,
+                                      struct sg_io_hdr *hdr)
+{
+    BDRVRawState *s = bs->opaque;
+    RawSgRequest req = {
+        .co         = qemu_coroutine_self(),
+        .hdr        = hdr,
+        .usr_ptr    = hdr->usr_ptr,
+        .ret        = -EINPROGRESS,
+    };
+    ssize_t len;
+
+    /* The kernel copies the header, which comes back from read() */
+    hdr->usr_ptr = &req;
+    len = RETRY_ON_EINTR(write(s->fd, hdr, sizeof(*hdr)));
+    hdr->usr_ptr = req.usr_ptr;
+    if (len < 0) {
+        /* EDOM means that the queue is full */
+        if (errno != EDOM && errno != EAGAIN) {
+            s->sg_async = false;
+        }
+        return -ENOTSUP;
+    }
+
+    if (QLIST_EMPTY(&s->sg_reqs)) {
+        aio_set_fd_handler(bdrv_get_aio_context(bs), s->fd,
+                           hdev_sg_read, NULL, NULL, NULL, bs);
+    }
+    QLIST_INSERT_HEAD(&s->sg_reqs, &req, next);
+
+    while (req.ret == -EINPROGRESS) {
+        qemu_coroutine_yield();
+    }
+    return req.ret;
+}
+
 static int coroutine_fn
 hdev_co_ioctl(BlockDriverState *bs, unsigned long int req, void *buf)
 {
@@ -4199,6 +4516,15 @@ hdev_co_ioctl(BlockDriverState *bs, unsigned long int req, void *buf)
         }
     }
 
+    /* The completion handler runs in the AioContext of the node */
+    if (req == SG_IO && s->sg_async &&
+        qemu_get_current_aio_context() == bdrv_get_aio_context(bs)) {
+        ret = hdev_co_sg_io(bs, buf);
+        if (ret != -ENOTSUP) {
+            return ret;
+        }
+    }
+
     acb = (RawPosixAIOData) {
         .bs         = bs,
         .aio_type   = QEMU_AIO_IOCTL,
@@ -4267,6 +4593,11 @@ static BlockDriver bdrv_host_device = {
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
     .bdrv_refresh_limits = raw_refresh_limits,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
+    .bdrv_detach_aio_context = raw_aio_detach_aio_context,
+#ifdef CONFIG_LINUX_IO_URING
+    .bdrv_register_buf = raw_register_buf,
+    .bdrv_unregister_buf = raw_unregister_buf,
+#endif
 
     .bdrv_co_truncate                   = raw_co_truncate,
     .bdrv_co_getlength                  = raw_co_getlength,
@@ -4403,6 +4734,7 @@ static BlockDriver bdrv_host_cdrom = {
     .bdrv_co_flush_to_disk  = raw_co_flush_to_disk,
     .bdrv_refresh_limits    = cdrom_refresh_limits,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
+    .bdrv_detach_aio_context = raw_aio_detach_aio_context,
 
     .bdrv_co_truncate                   = raw_co_truncate,
     .bdrv_co_getlength                  = raw_co_getlength,
@@ -4529,6 +4861,7 @@ static BlockDriver bdrv_host_cdrom = {
     .bdrv_co_flush_to_disk  = raw_co_flush_to_disk,
     .bdrv_refresh_limits    = cdrom_refresh_limits,
     .bdrv_attach_aio_context = raw_aio_attach_aio_context,
+    .bdrv_detach_aio_context = raw_aio_detach_aio_context,
 
     .bdrv_co_truncate                   = raw_co_truncate,
     .bdrv_co_getlength                  = raw_co_getlength,
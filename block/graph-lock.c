@@ -20,6 +20,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/main-loop.h"
+#include "qemu/sys_membarrier.h"
 #include "block/graph-lock.h"
 #include "block/block.h"
 #include "block/block_int.h"
@@ -150,8 +151,12 @@ void no_coroutine_fn bdrv_graph_wrlock(BlockDriverState *bs)
          * We want to only check reader_count() after has_writer = 1 is visible
          * to other threads. That way no more readers can sneak in after we've
          * determined reader_count() == 0.
+         *
+         * Pairs with smp_mb_placeholder() in bdrv_graph_co_rdlock() and
+         * bdrv_graph_co_rdunlock().  Writers are rare, so they pay for a
+         * process-wide barrier and readers only for a compiler barrier.
          */
-        smp_mb();
+        smp_mb_global();
     } while (reader_count() >= 1);
 
     bdrv_drain_all_end();
@@ -218,8 +223,11 @@ void coroutine_fn bdrv_graph_co_rdlock(void)
     for (;;) {
         qatomic_set(&bdrv_graph->reader_count,
                     bdrv_graph->reader_count + 1);
-        /* make sure writer sees reader_count before we check has_writer */
-        smp_mb();
+        /*
+         * make sure writer sees reader_count before we check has_writer;
+         * pairs with smp_mb_global() in bdrv_graph_wrlock()
+         */
+        smp_mb_placeholder();
 
         /*
          * has_writer == 0: this means writer will read reader_count as >= 1
@@ -280,8 +288,11 @@ void coroutine_fn bdrv_graph_co_rdunlock(void)
 
     qatomic_store_release(&bdrv_graph->reader_count,
                           bdrv_graph->reader_count - 1);
-    /* make sure writer sees reader_count before we check has_writer */
-    smp_mb();
+    /*
+     * make sure writer sees reader_count before we check has_writer;
+     * pairs with smp_mb_global() in bdrv_graph_wrlock()
+     */
+    smp_mb_placeholder();
 
     /*
      * has_writer == 0: this means reader will read reader_count decreased
@@ -2040,6 +2040,16 @@ bdrv_co_write_req_finish(BdrvChild *child, int64_t offset, int64_t bytes,
 
     qatomic_inc(&bs->write_gen);
 
+    /*
+     * The write may have filled holes.  Only now that its data is visible
+     * to block-status queries, drop the cached zero extents it overlaps.
+     * Pairs with smp_mb() in bdrv_bsc_fill_zero().
+     */
+    if (req->type == BDRV_TRACKED_WRITE && QLIST_EMPTY(&bs->children)) {
+        smp_mb__after_rmw();
+        bdrv_bsc_invalidate_zero_range(bs, offset, bytes);
+    }
+
     /*
      * Discard cannot extend the image, but in error handling cases, such as
      * when reverting a qcow2 cluster allocation, the discarded range can pass
@@ -2069,6 +2079,121 @@ bdrv_co_write_req_finish(BdrvChild *child, int64_t offset, int64_t bytes,
     }
 }
 
+/* Splits a data write into requests of at most @max_transfer bytes */
+static int coroutine_fn GRAPH_RDLOCK
+bdrv_driver_pwritev_fragmented(BlockDriverState *bs, int64_t offset,
+                               int64_t bytes, QEMUIOVector *qiov,
+                               size_t qiov_offset, BdrvRequestFlags flags,
+                               int max_transfer)
+{
+    int64_t bytes_remaining = bytes;
+    int ret = 0;
+
+    if (bytes <= max_transfer) {
+        return bdrv_driver_pwritev(bs, offset, bytes, qiov, qiov_offset,
+                                   flags);
+    }
+
+    while (bytes_remaining) {
+        int num = MIN(bytes_remaining, max_transfer);
+        int local_flags = flags;
+
+        assert(num);
+        if (num < bytes_remaining && (flags & BDRV_REQ_FUA) &&
+            !(bs->supported_write_flags & BDRV_REQ_FUA)) {
+            /* If FUA is going to be emulated by flush, we only
+             * need to flush on the last iteration */
+            local_flags &= ~BDRV_REQ_FUA;
+        }
+
+        ret = bdrv_driver_pwritev(bs, offset + bytes - bytes_remaining,
+                                  num, qiov,
+                                  qiov_offset + bytes - bytes_remaining,
+                                  local_flags);
+        if (ret < 0) {
+            break;
+        }
+        bytes_remaining -= num;
+    }
+
+    return ret;
+}
+
+/*
+ * With detect-zeroes, a write that is not zero as a whole may still
+ * contain zeroed blocks of the size the driver can zero efficiently (for
+ * qcow2, subclusters).  Write those as zeroes, so that image formats only
+ * update metadata for them, and only write the remaining data.
+ *
+ * Returns -ENOTSUP without writing anything if the request does not
+ * contain any such block.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+bdrv_co_pwritev_detect_zeroes(BlockDriverState *bs, int64_t offset,
+                              int64_t bytes, QEMUIOVector *qiov,
+                              size_t qiov_offset, BdrvRequestFlags flags,
+                              int max_transfer)
+{
+    int64_t align = bs->bl.pwrite_zeroes_alignment;
+    int64_t end = offset + bytes;
+    int64_t pos = offset;
+    BdrvRequestFlags zero_flags;
+    bool found_zeroes = false;
+    int ret = 0;
+
+    zero_flags = (flags & ~BDRV_REQ_REGISTERED_BUF) | BDRV_REQ_ZERO_WRITE;
+    if (bs->detect_zeroes == BLOCKDEV_DETECT_ZEROES_OPTIONS_UNMAP) {
+        zero_flags |= BDRV_REQ_MAY_UNMAP;
+    }
+
+    while (pos < end && ret >= 0) {
+        int64_t data_end = pos;
+        int64_t zero_end;
+
+        /* Find the first block that is entirely zero */
+        while (data_end < end) {
+            int64_t block_end = MIN(QEMU_ALIGN_DOWN(data_end, align) + align,
+                                    end);
+
+            if (block_end - data_end == align &&
+                qemu_iovec_is_zero(qiov, qiov_offset + data_end - offset,
+                                   align)) {
+                break;
+            }
+            data_end = block_end;
+        }
+
+        if (!found_zeroes && data_end == end) {
+            /* Nothing to gain, leave the request alone */
+            return -ENOTSUP;
+        }
+        found_zeroes = true;
+
+        /* ...and all following zero blocks */
+        zero_end = data_end;
+        while (end - zero_end >= align &&
+               qemu_iovec_is_zero(qiov, qiov_offset + zero_end - offset,
+                                  align)) {
+            zero_end += align;
+        }
+
+        if (data_end > pos) {
+            bdrv_co_debug_event(bs, BLKDBG_PWRITEV);
+            ret = bdrv_driver_pwritev_fragmented(bs, pos, data_end - pos, qiov,
+                                                 qiov_offset + pos - offset,
+                                                 flags, max_transfer);
+        }
+        if (ret >= 0 && zero_end > data_end) {
+            bdrv_co_debug_event(bs, BLKDBG_PWRITEV_ZERO);
+            ret = bdrv_co_do_pwrite_zeroes(bs, data_end, zero_end - data_end,
+                                           zero_flags);
+        }
+        pos = zero_end;
+    }
+
+    return ret;
+}
+
 /*
  * Forwards an already correctly aligned write request to the BlockDriver,
  * after possibly fragmenting it.
@@ -2081,9 +2206,9 @@ bdrv_aligned_pwritev(BdrvChild *child, BdrvTrackedRequest *req,
 {
     BlockDriverState *bs = child->bs;
     BlockDriver *drv = bs->drv;
+    bool detect_zeroes;
     int ret;
 
-    int64_t bytes_remaining = bytes;
     int max_transfer;
 
     bdrv_check_qiov_request(offset, bytes, qiov, qiov_offset, &error_abort);
@@ -2104,9 +2229,12 @@ bdrv_aligned_pwritev(BdrvChild *child, BdrvTrackedRequest *req,
 
     ret = bdrv_co_write_req_prepare(child, offset, bytes, req, flags);
 
-    if (!ret && bs->detect_zeroes != BLOCKDEV_DETECT_ZEROES_OPTIONS_OFF &&
-        !(flags & BDRV_REQ_ZERO_WRITE) && drv->bdrv_co_pwrite_zeroes &&
-        qemu_iovec_is_zero(qiov, qiov_offset, bytes)) {
+    detect_zeroes = !ret &&
+        bs->detect_zeroes != BLOCKDEV_DETECT_ZEROES_OPTIONS_OFF &&
+        !(flags & BDRV_REQ_ZERO_WRITE) &&
+        drv->bdrv_co_pwrite_zeroes;
+
+    if (detect_zeroes && qemu_iovec_is_zero(qiov, qiov_offset, bytes)) {
         flags |= BDRV_REQ_ZERO_WRITE;
         if (bs->detect_zeroes == BLOCKDEV_DETECT_ZEROES_OPTIONS_UNMAP) {
             flags |= BDRV_REQ_MAY_UNMAP;
@@ -2124,31 +2252,25 @@ bdrv_aligned_pwritev(BdrvChild *child, BdrvTrackedRequest *req,
     } else if (flags & BDRV_REQ_WRITE_COMPRESSED) {
         ret = bdrv_driver_pwritev_compressed(bs, offset, bytes,
                                              qiov, qiov_offset);
-    } else if (bytes <= max_transfer) {
-        bdrv_co_debug_event(bs, BLKDBG_PWRITEV);
-        ret = bdrv_driver_pwritev(bs, offset, bytes, qiov, qiov_offset, flags);
     } else {
-        bdrv_co_debug_event(bs, BLKDBG_PWRITEV);
-        while (bytes_remaining) {
-            int num = MIN(bytes_remaining, max_transfer);
-            int local_flags = flags;
-
-            assert(num);
-            if (num < bytes_remaining && (flags & BDRV_REQ_FUA) &&
-                !(bs->supported_write_flags & BDRV_REQ_FUA)) {
-                /* If FUA is going to be emulated by flush, we only
-                 * need to flush on the last iteration */
-                local_flags &= ~BDRV_REQ_FUA;
-            }
-
-            ret = bdrv_driver_pwritev(bs, offset + bytes - bytes_remaining,
-                                      num, qiov,
-                                      qiov_offset + bytes - bytes_remaining,
-                                      local_flags);
-            if (ret < 0) {
-                break;
-            }
-            bytes_remaining -= num;
+        ret = -ENOTSUP;
+        /*
+         * Only image formats turn partial zero writes into metadata
+         * updates; for protocol drivers, splitting the request would just
+         * mean more I/O.
+         */
+        if (detect_zeroes && drv->is_format &&
+            bs->bl.pwrite_zeroes_alignment &&
+            bytes >= 2 * bs->bl.pwrite_zeroes_alignment) {
+            ret = bdrv_co_pwritev_detect_zeroes(bs, offset, bytes, qiov,
+                                                qiov_offset, flags,
+                                                max_transfer);
+        }
+        if (ret == -ENOTSUP) {
+            bdrv_co_debug_event(bs, BLKDBG_PWRITEV);
+            ret = bdrv_driver_pwritev_fragmented(bs, offset, bytes, qiov,
+                                                 qiov_offset, flags,
+                                                 max_transfer);
         }
     }
     bdrv_co_debug_event(bs, BLKDBG_PWRITEV_DONE);
@@ -2382,6 +2504,22 @@ int bdrv_flush_all(void)
     return result;
 }
 
+/*
+ * Whether processes other than this one may be writing to @bs, i.e. none
+ * of its parents keeps them from taking the WRITE permission.
+ */
+static bool GRAPH_RDLOCK bdrv_shares_write(BlockDriverState *bs)
+{
+    BdrvChild *c;
+
+    QLIST_FOREACH(c, &bs->parents, next_parent) {
+        if (!(c->shared_perm & BLK_PERM_WRITE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 /*
  * Returns the allocation status of the specified sectors.
  * Drivers not implementing the functionality are assumed to not support
@@ -2491,11 +2629,17 @@ bdrv_co_do_block_status(BlockDriverState *bs, bool want_zero,
          * the cached regions without the cache being invalidated, and so
          * we may report zeroes as data.  This is not catastrophic,
          * however, because reporting zeroes as data is fine.
+         *
+         * Holes are cached as well, but reporting data as zeroes is not
+         * fine.  Therefore they are only cached while no one outside
+         * of this process can be writing to the node, and writes from
+         * within it invalidate them once they complete.
          */
-        if (QLIST_EMPTY(&bs->children) &&
-            bdrv_bsc_is_data(bs, aligned_offset, pnum))
-        {
-            ret = BDRV_BLOCK_DATA | BDRV_BLOCK_OFFSET_VALID;
+        unsigned int write_gen = qatomic_read(&bs->write_gen);
+
+        ret = QLIST_EMPTY(&bs->children) ?
+              bdrv_bsc_lookup(bs, aligned_offset, pnum) : 0;
+        if (ret) {
             local_file = bs;
             local_map = aligned_offset;
         } else {
@@ -2532,6 +2676,14 @@ bdrv_co_do_block_status(BlockDriverState *bs, bool want_zero,
                 assert(local_file == bs);
                 assert(local_map == aligned_offset);
                 bdrv_bsc_fill(bs, aligned_offset, *pnum);
+            } else if (want_zero &&
+                       ret == (BDRV_BLOCK_ZERO | BDRV_BLOCK_OFFSET_VALID) &&
+                       QLIST_EMPTY(&bs->children) &&
+                       !bdrv_shares_write(bs))
+            {
+                assert(local_file == bs);
+                assert(local_map == aligned_offset);
+                bdrv_bsc_fill_zero(bs, aligned_offset, *pnum, write_gen);
             }
         }
     } else {
@@ -16,6 +16,9 @@
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
 #include "qemu/defer-call.h"
+#include "qemu/lockable.h"
+#include "qemu/rcu.h"
+#include "qemu/units.h"
 #include "qapi/error.h"
 #include "sysemu/block-backend.h"
 #include "trace.h"
@@ -26,6 +29,13 @@
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* Size of the fixed file and fixed buffer tables of each ring */
+#define MAX_FIXED_FILES 64
+#define MAX_FIXED_BUFS  256
+
+/* The kernel does not accept fixed buffers larger than this */
+#define MAX_FIXED_BUF_SIZE (1 * GiB)
+
 typedef struct LuringAIOCB {
     Coroutine *co;
     struct io_uring_sqe sqeq;
@@ -34,6 +44,10 @@ typedef struct LuringAIOCB {
     bool is_read;
     QSIMPLEQ_ENTRY(LuringAIOCB) next;
 
+    /* fallocate() mode and length, see luring_co_fallocate() */
+    int mode;
+    uint64_t len;
+
     /*
      * Buffered reads may require resubmission, see
      * luring_resubmit_short_read().
@@ -58,8 +72,54 @@ typedef struct LuringState {
     LuringQueue io_q;
 
     QEMUBH *completion_bh;
+
+    /* LURING_* flags the ring was set up with */
+    unsigned int flags;
+
+    /*
+     * Whether the ring has the fixed file and buffer tables of the
+     * registry.  Cleared for good when registering with the ring fails.
+     */
+    bool use_fixed_files;
+    bool use_fixed_bufs;
+
+    /* Whether the kernel supports IORING_OP_FALLOCATE */
+    bool has_fallocate;
+
+    /* Protected by luring_registry_lock */
+    QLIST_ENTRY(LuringState) next;
 } LuringState;
 
+/*
+ * Registry of file descriptors and memory regions that are registered
+ * with every ring, see luring_register_fd() and luring_register_buf().
+ * The index in files[] and bufs[] is the index in the fixed file and
+ * buffer tables of the rings.  Updates are made on a copy under
+ * luring_registry_lock and published with RCU, so that the submission
+ * path can look up entries without taking a lock.
+ */
+typedef struct LuringFixedBuf {
+    void *host;         /* NULL if the slot is free */
+    size_t size;
+    unsigned refcnt;
+} LuringFixedBuf;
+
+typedef struct LuringRegistry {
+    struct rcu_head rcu;
+    int files[MAX_FIXED_FILES];     /* -1 if the slot is free */
+    LuringFixedBuf bufs[MAX_FIXED_BUFS];
+} LuringRegistry;
+
+static QemuMutex luring_registry_lock;
+static LuringRegistry *luring_registry;
+static QLIST_HEAD(, LuringState) luring_states =
+    QLIST_HEAD_INITIALIZER(luring_states);
+
+static void __attribute__((__constructor__)) luring_init_registry(void)
+{
+    qemu_mutex_init(&luring_registry_lock);
+}
+
 /**
  * luring_resubmit:
  *
@@ -90,6 +150,15 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
     luringcb->total_read += nread;
     remaining = luringcb->qiov->size - luringcb->total_read;
 
+    if (luringcb->sqeq.opcode == IORING_OP_READ_FIXED) {
+        /* The sqe points directly into the (single) buffer */
+        luringcb->sqeq.off += nread;
+        luringcb->sqeq.addr += nread;
+        luringcb->sqeq.len = remaining;
+        luring_resubmit(s, luringcb);
+        return;
+    }
+
     /* Shorten qiov */
     resubmit_qiov = &luringcb->resubmit_qiov;
     if (resubmit_qiov->iov == NULL) {
@@ -108,6 +177,21 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
     luring_resubmit(s, luringcb);
 }
 
+/**
+ * luring_iopoll:
+ * @s: AIO state
+ *
+ * With IOPOLL, the kernel only looks for completions when asked to, so
+ * poll the device once unless the SQ polling thread already does it.
+ */
+static void luring_iopoll(LuringState *s)
+{
+    if ((s->flags & (LURING_IOPOLL | LURING_SQPOLL)) == LURING_IOPOLL &&
+        s->io_q.in_flight) {
+        io_uring_enter(s->ring.ring_fd, 0, 0, IORING_ENTER_GETEVENTS, NULL);
+    }
+}
+
 /**
  * luring_process_completions:
  * @s: AIO state
@@ -128,6 +212,8 @@ static void luring_process_completions(LuringState *s)
 
     defer_call_begin();
 
+    luring_iopoll(s);
+
     /*
      * Request completion callbacks can run the nested event loop.
      * Schedule ourselves so the nested event loop will "see" remaining
@@ -167,10 +253,10 @@ static void luring_process_completions(LuringState *s)
 
         if (ret < 0) {
             /*
-             * Only writev/readv/fsync requests on regular files or host block
-             * devices are submitted. Therefore -EAGAIN is not expected but it's
-             * known to happen sometimes with Linux SCSI. Submit again and hope
-             * the request completes successfully.
+             * Only writev/readv/fsync/fallocate requests on regular files or
+             * host block devices are submitted. Therefore -EAGAIN is not
+             * expected but it's known to happen sometimes with Linux SCSI.
+             * Submit again and hope the request completes successfully.
              *
              * For more information, see:
              * https://lore.kernel.org/io-uring/20210727165811.284510-3-axboe@kernel.dk/T/#u
@@ -221,7 +307,13 @@ end:
         }
     }
 
-    qemu_bh_cancel(s->completion_bh);
+    /*
+     * There is no notification for IOPOLL completions, keep polling from
+     * the BH for as long as requests are in flight.
+     */
+    if (!(s->flags & LURING_IOPOLL) || !s->io_q.in_flight) {
+        qemu_bh_cancel(s->completion_bh);
+    }
 
     defer_call_end();
 }
@@ -295,6 +387,7 @@ static bool qemu_luring_poll_cb(void *opaque)
 {
     LuringState *s = opaque;
 
+    luring_iopoll(s);
     return io_uring_cq_ready(&s->ring);
 }
 
@@ -323,6 +416,46 @@ static void luring_deferred_fn(void *opaque)
     }
 }
 
+/* Returns the fixed file index of @fd, or -1 if it is not registered */
+static int luring_fixed_file_index(LuringRegistry *reg, int fd)
+{
+    int i;
+
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        if (reg->files[i] == fd) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Returns the index of the fixed buffer that contains all of @qiov, or -1
+ * if there is none.  Fixed buffer requests take a single buffer, so this is
+ * only possible if @qiov has a single element.
+ */
+static int luring_fixed_buf_index(LuringRegistry *reg, QEMUIOVector *qiov)
+{
+    uintptr_t start, end;
+    int i;
+
+    if (qiov->niov != 1) {
+        return -1;
+    }
+
+    start = (uintptr_t)qiov->iov[0].iov_base;
+    end = start + qiov->iov[0].iov_len;
+
+    for (i = 0; i < MAX_FIXED_BUFS; i++) {
+        uintptr_t host = (uintptr_t)reg->bufs[i].host;
+
+        if (host && start >= host && end <= host + reg->bufs[i].size) {
+            return i;
+        }
+    }
+    return -1;
+}
+
 /**
  * luring_do_submit:
  * @fd: file descriptor for I/O
@@ -339,28 +472,64 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
 {
     int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
+    int file_index = -1;
+    int buf_index = -1;
+
+    if (qatomic_read(&s->use_fixed_files) ||
+        qatomic_read(&s->use_fixed_bufs)) {
+        LuringRegistry *reg;
+
+        RCU_READ_LOCK_GUARD();
+        reg = qatomic_rcu_read(&luring_registry);
+        if (reg && qatomic_read(&s->use_fixed_files)) {
+            file_index = luring_fixed_file_index(reg, fd);
+        }
+        if (reg && qatomic_read(&s->use_fixed_bufs) && luringcb->qiov) {
+            buf_index = luring_fixed_buf_index(reg, luringcb->qiov);
+        }
+    }
 
     switch (type) {
     case QEMU_AIO_WRITE:
-        io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
-                             luringcb->qiov->niov, offset);
-        break;
     case QEMU_AIO_ZONE_APPEND:
-        io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
-                             luringcb->qiov->niov, offset);
+        if (buf_index >= 0) {
+            io_uring_prep_write_fixed(sqes, fd,
+                                      luringcb->qiov->iov[0].iov_base,
+                                      luringcb->qiov->size, offset, buf_index);
+        } else {
+            io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
+                                 luringcb->qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_READ:
-        io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
-                            luringcb->qiov->niov, offset);
+        if (buf_index >= 0) {
+            io_uring_prep_read_fixed(sqes, fd,
+                                     luringcb->qiov->iov[0].iov_base,
+                                     luringcb->qiov->size, offset, buf_index);
+        } else {
+            io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
+                                luringcb->qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_FLUSH:
         io_uring_prep_fsync(sqes, fd, IORING_FSYNC_DATASYNC);
         break;
+#ifdef HAVE_IO_URING_PREP_FALLOCATE
+    case QEMU_AIO_DISCARD:
+    case QEMU_AIO_WRITE_ZEROES:
+        io_uring_prep_fallocate(sqes, fd, luringcb->mode, offset,
+                                luringcb->len);
+        break;
+#endif
     default:
         fprintf(stderr, "%s: invalid AIO request type, aborting 0x%x.\n",
                         __func__, type);
         abort();
     }
+    if (file_index >= 0) {
+        sqes->fd = file_index;
+        sqes->flags |= IOSQE_FIXED_FILE;
+    }
     io_uring_sqe_set_data(sqes, luringcb);
 
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
@@ -379,18 +548,21 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
     return 0;
 }
 
-int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
+int coroutine_fn luring_co_submit(BlockDriverState *bs, LuringState *s,
+                                  int fd, uint64_t offset,
                                   QEMUIOVector *qiov, int type)
 {
     int ret;
-    AioContext *ctx = qemu_get_current_aio_context();
-    LuringState *s = aio_get_linux_io_uring(ctx);
     LuringAIOCB luringcb = {
         .co         = qemu_coroutine_self(),
         .ret        = -EINPROGRESS,
         .qiov       = qiov,
         .is_read    = (type == QEMU_AIO_READ),
     };
+
+    if (!s) {
+        s = aio_get_linux_io_uring(qemu_get_current_aio_context());
+    }
     trace_luring_co_submit(bs, s, &luringcb, fd, offset, qiov ? qiov->size : 0,
                            type);
     ret = luring_do_submit(fd, &luringcb, s, offset, type);
@@ -405,6 +577,38 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
     return luringcb.ret;
 }
 
+int coroutine_fn luring_co_fallocate(BlockDriverState *bs, int fd, int mode,
+                                     uint64_t offset, uint64_t len)
+{
+#ifdef HAVE_IO_URING_PREP_FALLOCATE
+    int ret;
+    LuringState *s = aio_get_linux_io_uring(qemu_get_current_aio_context());
+    LuringAIOCB luringcb = {
+        .co         = qemu_coroutine_self(),
+        .ret        = -EINPROGRESS,
+        .mode       = mode,
+        .len        = len,
+    };
+
+    if (!s->has_fallocate) {
+        return -ENOSYS;
+    }
+
+    trace_luring_co_fallocate(bs, s, &luringcb, fd, mode, offset, len);
+    ret = luring_do_submit(fd, &luringcb, s, offset, QEMU_AIO_WRITE_ZEROES);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (luringcb.ret == -EINPROGRESS) {
+        qemu_coroutine_yield();
+    }
+    return luringcb.ret;
+#else
+    return -ENOSYS;
+#endif
+}
+
 void luring_detach_aio_context(LuringState *s, AioContext *old_context)
 {
     aio_set_fd_handler(old_context, s->ring.ring_fd,
@@ -422,28 +626,318 @@ void luring_attach_aio_context(LuringState *s, AioContext *new_context)
                        qemu_luring_poll_cb, qemu_luring_poll_ready, s);
 }
 
-LuringState *luring_init(Error **errp)
+#ifdef HAVE_IO_URING_REGISTER_SPARSE
+static void luring_update_file(LuringState *s, unsigned index, int fd)
+{
+    int ret;
+
+    if (!qatomic_read(&s->use_fixed_files)) {
+        return;
+    }
+
+    ret = io_uring_register_files_update(&s->ring, index, &fd, 1);
+    if (ret < 0) {
+        trace_luring_register_failed(s, "file", ret);
+        qatomic_set(&s->use_fixed_files, false);
+    }
+}
+
+static void luring_update_buf(LuringState *s, unsigned index,
+                              const LuringFixedBuf *buf)
+{
+    struct iovec iov = {
+        .iov_base = buf->host,
+        .iov_len = buf->size,
+    };
+    int ret;
+
+    if (!qatomic_read(&s->use_fixed_bufs)) {
+        return;
+    }
+
+    ret = io_uring_register_buffers_update_tag(&s->ring, index, &iov,
+                                               NULL, 1);
+    if (ret < 0) {
+        trace_luring_register_failed(s, "buffer", ret);
+        qatomic_set(&s->use_fixed_bufs, false);
+    }
+}
+
+/*
+ * Update the tables of @s for all slots of @reg that differ from @old.
+ * @old may be NULL for an empty registry.
+ */
+static void luring_update_tables(LuringState *s, const LuringRegistry *old,
+                                 const LuringRegistry *reg)
+{
+    int i;
+
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        int old_fd = old ? old->files[i] : -1;
+
+        if (reg->files[i] != old_fd) {
+            luring_update_file(s, i, reg->files[i]);
+        }
+    }
+
+    for (i = 0; i < MAX_FIXED_BUFS; i++) {
+        void *old_host = old ? old->bufs[i].host : NULL;
+        size_t old_size = old ? old->bufs[i].size : 0;
+
+        if (reg->bufs[i].host != old_host || reg->bufs[i].size != old_size) {
+            luring_update_buf(s, i, &reg->bufs[i]);
+        }
+    }
+}
+
+/* Called with luring_registry_lock held */
+static LuringRegistry *luring_registry_copy(void)
+{
+    LuringRegistry *reg = g_new0(LuringRegistry, 1);
+    int i;
+
+    if (luring_registry) {
+        memcpy(reg->files, luring_registry->files, sizeof(reg->files));
+        memcpy(reg->bufs, luring_registry->bufs, sizeof(reg->bufs));
+    } else {
+        for (i = 0; i < MAX_FIXED_FILES; i++) {
+            reg->files[i] = -1;
+        }
+    }
+    return reg;
+}
+
+/*
+ * Apply @reg to the tables of all rings and make it the current registry.
+ * Called with luring_registry_lock held.
+ *
+ * Entries are removed from the kernel tables before the old registry goes
+ * away, so a request that raced with the removal fails instead of using a
+ * stale file or buffer.  That can only happen if the request itself uses a
+ * file that is being closed or memory that is being unplugged.
+ */
+static void luring_registry_commit(LuringRegistry *reg)
+{
+    LuringRegistry *old = luring_registry;
+    LuringState *s;
+
+    QLIST_FOREACH(s, &luring_states, next) {
+        luring_update_tables(s, old, reg);
+    }
+
+    qatomic_rcu_set(&luring_registry, reg);
+    if (old) {
+        g_free_rcu(old, rcu);
+    }
+}
+
+void luring_register_fd(int fd)
+{
+    LuringRegistry *reg;
+    int i;
+
+    QEMU_LOCK_GUARD(&luring_registry_lock);
+    reg = luring_registry_copy();
+
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        if (reg->files[i] == fd) {
+            g_free(reg);
+            return;
+        }
+    }
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        if (reg->files[i] == -1) {
+            reg->files[i] = fd;
+            luring_registry_commit(reg);
+            return;
+        }
+    }
+
+    /* Table full, the file is used without registration */
+    g_free(reg);
+}
+
+void luring_unregister_fd(int fd)
+{
+    LuringRegistry *reg;
+    int i;
+
+    QEMU_LOCK_GUARD(&luring_registry_lock);
+    if (!luring_registry ||
+        luring_fixed_file_index(luring_registry, fd) < 0) {
+        return;
+    }
+
+    reg = luring_registry_copy();
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        if (reg->files[i] == fd) {
+            reg->files[i] = -1;
+        }
+    }
+    luring_registry_commit(reg);
+}
+
+/*
+ * @host is split into chunks of MAX_FIXED_BUF_SIZE, each of which takes a
+ * slot in the fixed buffer table.  Several BlockDriverStates usually
+ * register the same guest RAM, so slots are reference counted.
+ */
+static int luring_find_buf(LuringRegistry *reg, void *host, size_t size)
+{
+    int i;
+
+    for (i = 0; i < MAX_FIXED_BUFS; i++) {
+        if (reg->bufs[i].host == host && reg->bufs[i].size == size) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void luring_register_buf(void *host, size_t size)
+{
+    LuringRegistry *reg;
+    size_t offset;
+
+    QEMU_LOCK_GUARD(&luring_registry_lock);
+    reg = luring_registry_copy();
+
+    for (offset = 0; offset < size; offset += MAX_FIXED_BUF_SIZE) {
+        void *chunk = host + offset;
+        size_t len = MIN(size - offset, MAX_FIXED_BUF_SIZE);
+        int i = luring_find_buf(reg, chunk, len);
+
+        if (i < 0) {
+            i = luring_find_buf(reg, NULL, 0);
+            if (i < 0) {
+                /* Table full, the rest is used without registration */
+                break;
+            }
+            reg->bufs[i].host = chunk;
+            reg->bufs[i].size = len;
+        }
+        reg->bufs[i].refcnt++;
+    }
+
+    luring_registry_commit(reg);
+}
+
+void luring_unregister_buf(void *host, size_t size)
+{
+    LuringRegistry *reg;
+    size_t offset;
+
+    QEMU_LOCK_GUARD(&luring_registry_lock);
+    if (!luring_registry) {
+        return;
+    }
+    reg = luring_registry_copy();
+
+    for (offset = 0; offset < size; offset += MAX_FIXED_BUF_SIZE) {
+        void *chunk = host + offset;
+        size_t len = MIN(size - offset, MAX_FIXED_BUF_SIZE);
+        int i = luring_find_buf(reg, chunk, len);
+
+        if (i >= 0 && --reg->bufs[i].refcnt == 0) {
+            reg->bufs[i] = (LuringFixedBuf) { 0 };
+        }
+    }
+
+    luring_registry_commit(reg);
+}
+
+/* Set up the fixed file and buffer tables of a new ring */
+static void luring_init_tables(LuringState *s)
+{
+    s->use_fixed_files =
+        io_uring_register_files_sparse(&s->ring, MAX_FIXED_FILES) == 0;
+    s->use_fixed_bufs =
+        io_uring_register_buffers_sparse(&s->ring, MAX_FIXED_BUFS) == 0;
+
+    QEMU_LOCK_GUARD(&luring_registry_lock);
+    if (luring_registry) {
+        luring_update_tables(s, NULL, luring_registry);
+    }
+    QLIST_INSERT_HEAD(&luring_states, s, next);
+}
+
+static void luring_cleanup_tables(LuringState *s)
+{
+    QEMU_LOCK_GUARD(&luring_registry_lock);
+    QLIST_REMOVE(s, next);
+}
+#else
+/* Without sparse table support, requests never use fixed files or buffers */
+void luring_register_fd(int fd)
+{
+}
+
+void luring_unregister_fd(int fd)
+{
+}
+
+void luring_register_buf(void *host, size_t size)
+{
+}
+
+void luring_unregister_buf(void *host, size_t size)
+{
+}
+
+static void luring_init_tables(LuringState *s)
+{
+}
+
+static void luring_cleanup_tables(LuringState *s)
+{
+}
+#endif /* HAVE_IO_URING_REGISTER_SPARSE */
+
+LuringState *luring_init(unsigned int flags, Error **errp)
 {
     int rc;
     LuringState *s = g_new0(LuringState, 1);
     struct io_uring *ring = &s->ring;
+    struct io_uring_params params = {};
 
     trace_luring_init_state(s, sizeof(*s));
 
-    rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+    if (flags & LURING_SQPOLL) {
+        params.flags |= IORING_SETUP_SQPOLL;
+    }
+    if (flags & LURING_IOPOLL) {
+        params.flags |= IORING_SETUP_IOPOLL;
+    }
+
+    rc = io_uring_queue_init_params(MAX_ENTRIES, ring, &params);
     if (rc < 0) {
-        error_setg_errno(errp, errno, "failed to init linux io_uring ring");
+        error_setg_errno(errp, -rc, "failed to init linux io_uring ring");
         g_free(s);
         return NULL;
     }
 
+    s->flags = flags;
     ioq_init(&s->io_q);
+    luring_init_tables(s);
+
+#ifdef HAVE_IO_URING_PREP_FALLOCATE
+    if (!(flags & LURING_IOPOLL)) {
+        struct io_uring_probe *probe = io_uring_get_probe_ring(ring);
+
+        if (probe) {
+            s->has_fallocate = io_uring_opcode_supported(probe,
+                                                         IORING_OP_FALLOCATE);
+            io_uring_free_probe(probe);
+        }
+    }
+#endif
     return s;
 
 }
 
 void luring_cleanup(LuringState *s)
 {
+    luring_cleanup_tables(s);
     io_uring_queue_exit(&s->ring);
     trace_luring_cleanup_state(s);
     g_free(s);
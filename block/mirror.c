@@ -29,6 +29,9 @@
 #define MAX_IO_BYTES (1 << 20) /* 1 Mb */
 #define DEFAULT_MIRROR_BUF_SIZE (MAX_IN_FLIGHT * MAX_IO_BYTES)
 
+/* Interval at which the latency controller adjusts the request limits */
+#define MIRROR_ADAPT_INTERVAL_NS (100 * SCALE_MS)
+
 /* The mirroring buffer is a list of granularity-sized chunks.
  * Free chunks are organized in a list.
  */
@@ -93,6 +96,24 @@ typedef struct MirrorBlockJob {
     int64_t active_write_bytes_in_flight;
     bool prepared;
     bool in_drain;
+
+    /*
+     * Limits for background copy requests.  Fixed unless latency_budget
+     * (in microseconds) is set, in which case mirror_adapt() tunes them.
+     * Written with atomics because mirror_query() reads them.
+     */
+    unsigned max_in_flight;
+    int max_io_bytes;
+    uint32_t latency_budget;
+
+    /* Samples of the current mirror_adapt() interval */
+    int64_t adapt_start_ns;
+    int64_t adapt_latency_ns;
+    uint64_t adapt_count;
+    uint64_t adapt_bytes;
+    /* Results of the last interval, to be accessed with atomics */
+    uint64_t adapt_last_latency_us;
+    uint64_t adapt_last_throughput;
 } MirrorBlockJob;
 
 typedef struct MirrorBDSOpaque {
@@ -114,6 +135,8 @@ struct MirrorOp {
     bool is_pseudo_op;
     bool is_active_write;
     bool is_in_flight;
+    /* When a background copy was submitted, for the latency controller */
+    int64_t start_ns;
     CoQueue waiting_requests;
     Coroutine *co;
     MirrorOp *waiting_for_op;
@@ -193,6 +216,64 @@ static void coroutine_fn mirror_wait_on_conflicts(MirrorOp *self,
     }
 }
 
+/*
+ * Additive increase, multiplicative decrease of the background request
+ * limits: back off when the average completion latency exceeds the budget,
+ * and add parallelism (then larger requests) while there is headroom.
+ */
+static void mirror_adapt(MirrorBlockJob *s, int64_t now)
+{
+    int64_t elapsed = now - s->adapt_start_ns;
+    uint64_t latency_us = s->adapt_latency_ns / s->adapt_count / SCALE_US;
+    uint64_t throughput = s->adapt_bytes * NANOSECONDS_PER_SECOND / elapsed;
+    unsigned max_in_flight = s->max_in_flight;
+    int max_io_bytes = s->max_io_bytes;
+    int chunk_limit = MIN(s->buf_size, MAX(s->buf_size / MAX_IN_FLIGHT,
+                                           MAX_IO_BYTES));
+
+    if (latency_us > s->latency_budget) {
+        if (max_in_flight > 1) {
+            max_in_flight /= 2;
+        } else {
+            max_io_bytes = MAX(QEMU_ALIGN_DOWN(max_io_bytes / 2,
+                                               s->granularity),
+                               s->granularity);
+        }
+    } else if (latency_us < s->latency_budget * 3 / 4) {
+        if (max_in_flight < MAX_IN_FLIGHT) {
+            max_in_flight++;
+        } else {
+            max_io_bytes = MIN((int64_t)max_io_bytes * 2, chunk_limit);
+        }
+    }
+
+    trace_mirror_adapt(s, latency_us, throughput, max_in_flight,
+                       max_io_bytes);
+
+    qatomic_set(&s->max_in_flight, max_in_flight);
+    qatomic_set(&s->max_io_bytes, max_io_bytes);
+    qatomic_set_u64(&s->adapt_last_latency_us, latency_us);
+    qatomic_set_u64(&s->adapt_last_throughput, throughput);
+
+    s->adapt_start_ns = now;
+    s->adapt_latency_ns = 0;
+    s->adapt_count = 0;
+    s->adapt_bytes = 0;
+}
+
+static void mirror_adapt_sample(MirrorBlockJob *s, MirrorOp *op)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
+    s->adapt_latency_ns += now - op->start_ns;
+    s->adapt_count++;
+    s->adapt_bytes += op->bytes;
+
+    if (now - s->adapt_start_ns >= MIRROR_ADAPT_INTERVAL_NS) {
+        mirror_adapt(s, now);
+    }
+}
+
 static void coroutine_fn mirror_iteration_done(MirrorOp *op, int ret)
 {
     MirrorBlockJob *s = op->s;
@@ -204,6 +285,9 @@ static void coroutine_fn mirror_iteration_done(MirrorOp *op, int ret)
 
     s->in_flight--;
     s->bytes_in_flight -= op->bytes;
+    if (s->latency_budget && op->start_ns) {
+        mirror_adapt_sample(s, op);
+    }
     iov = op->qiov.iov;
     for (i = 0; i < op->qiov.niov; i++) {
         MirrorBuffer *buf = (MirrorBuffer *) iov[i].iov_base;
@@ -395,6 +479,9 @@ static void coroutine_fn mirror_co_read(void *opaque)
     s->in_flight++;
     s->bytes_in_flight += op->bytes;
     op->is_in_flight = true;
+    if (s->latency_budget) {
+        op->start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    }
     trace_mirror_one_iteration(s, op->offset, op->bytes);
 
     WITH_GRAPH_RDLOCK_GUARD() {
@@ -487,7 +574,7 @@ static void coroutine_fn GRAPH_RDLOCK mirror_iteration(MirrorBlockJob *s)
     /* At least the first dirty chunk is mirrored in one iteration. */
     int nb_chunks = 1;
     bool write_zeroes_ok = bdrv_can_write_zeroes_with_unmap(blk_bs(s->target));
-    int max_io_bytes = MAX(s->buf_size / MAX_IN_FLIGHT, MAX_IO_BYTES);
+    int max_io_bytes = s->max_io_bytes;
 
     bdrv_dirty_bitmap_lock(s->dirty_bitmap);
     offset = bdrv_dirty_iter_next(s->dbi);
@@ -595,7 +682,7 @@ static void coroutine_fn GRAPH_RDLOCK mirror_iteration(MirrorBlockJob *s)
             }
         }
 
-        while (s->in_flight >= MAX_IN_FLIGHT) {
+        while (s->in_flight >= s->max_in_flight) {
             trace_mirror_yield_in_flight(s, offset, s->in_flight);
             mirror_wait_for_free_in_flight_slot(s);
         }
@@ -869,7 +956,7 @@ static int coroutine_fn GRAPH_UNLOCKED mirror_dirty_init(MirrorBlockJob *s)
                 return 0;
             }
 
-            if (s->in_flight >= MAX_IN_FLIGHT) {
+            if (s->in_flight >= s->max_in_flight) {
                 trace_mirror_yield(s, UINT64_MAX, s->buf_free_count,
                                    s->in_flight);
                 mirror_wait_for_free_in_flight_slot(s);
@@ -1014,6 +1101,16 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
     s->max_iov = MIN(bs->bl.max_iov, target_bs->bl.max_iov);
     bdrv_graph_co_rdunlock();
 
+    s->max_io_bytes = MAX(s->buf_size / MAX_IN_FLIGHT, MAX_IO_BYTES);
+    if (s->latency_budget) {
+        /* Start with a single request and let mirror_adapt() ramp up */
+        s->max_in_flight = 1;
+        s->max_io_bytes = MIN(s->max_io_bytes, s->buf_size);
+    } else {
+        s->max_in_flight = MAX_IN_FLIGHT;
+    }
+    s->adapt_start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
     s->buf = qemu_try_blockalign(bs, s->buf_size);
     if (s->buf == NULL) {
         ret = -ENOMEM;
@@ -1072,7 +1169,7 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
         }
         if (delta < BLOCK_JOB_SLICE_TIME &&
             iostatus == BLOCK_DEVICE_IO_STATUS_OK) {
-            if (s->in_flight >= MAX_IN_FLIGHT || s->buf_free_count == 0 ||
+            if (s->in_flight >= s->max_in_flight || s->buf_free_count == 0 ||
                 (cnt == 0 && s->in_flight > 0)) {
                 trace_mirror_yield(s, cnt, s->buf_free_count, s->in_flight);
                 mirror_wait_for_free_in_flight_slot(s);
@@ -1306,9 +1403,22 @@ static void mirror_change(BlockJob *job, BlockJobChangeOptions *opts,
 static void mirror_query(BlockJob *job, BlockJobInfo *info)
 {
     MirrorBlockJob *s = container_of(job, MirrorBlockJob, common);
+    MirrorAdaptiveInfo *adaptive = NULL;
+
+    if (s->latency_budget) {
+        adaptive = g_new(MirrorAdaptiveInfo, 1);
+        *adaptive = (MirrorAdaptiveInfo) {
+            .latency_budget  = s->latency_budget,
+            .in_flight_limit = qatomic_read(&s->max_in_flight),
+            .chunk_size      = qatomic_read(&s->max_io_bytes),
+            .latency         = qatomic_read_u64(&s->adapt_last_latency_us),
+            .throughput      = qatomic_read_u64(&s->adapt_last_throughput),
+        };
+    }
 
     info->u.mirror = (BlockJobInfoMirror) {
         .actively_synced = qatomic_read(&s->actively_synced),
+        .adaptive = adaptive,
     };
 }
 
@@ -1734,7 +1844,7 @@ static BlockJob *mirror_start_job(
                              bool is_none_mode, BlockDriverState *base,
                              bool auto_complete, const char *filter_node_name,
                              bool is_mirror, MirrorCopyMode copy_mode,
-                             Error **errp)
+                             uint32_t latency_budget, Error **errp)
 {
     MirrorBlockJob *s;
     MirrorBDSOpaque *bs_opaque;
@@ -1897,6 +2007,7 @@ static BlockJob *mirror_start_job(
     s->granularity = granularity;
     s->buf_size = ROUND_UP(buf_size, granularity);
     s->unmap = unmap;
+    s->latency_budget = latency_budget;
     if (auto_complete) {
         s->should_complete = true;
     }
@@ -2023,7 +2134,8 @@ void mirror_start(const char *job_id, BlockDriverState *bs,
                   BlockdevOnError on_source_error,
                   BlockdevOnError on_target_error,
                   bool unmap, const char *filter_node_name,
-                  MirrorCopyMode copy_mode, Error **errp)
+                  MirrorCopyMode copy_mode, uint32_t latency_budget,
+                  Error **errp)
 {
     bool is_none_mode;
     BlockDriverState *base;
@@ -2046,7 +2158,8 @@ void mirror_start(const char *job_id, BlockDriverState *bs,
                      speed, granularity, buf_size, backing_mode, zero_target,
                      on_source_error, on_target_error, unmap, NULL, NULL,
                      &mirror_job_driver, is_none_mode, base, false,
-                     filter_node_name, true, copy_mode, errp);
+                     filter_node_name, true, copy_mode, latency_budget,
+                     errp);
 }
 
 BlockJob *commit_active_start(const char *job_id, BlockDriverState *bs,
@@ -2075,7 +2188,7 @@ BlockJob *commit_active_start(const char *job_id, BlockDriverState *bs,
                      on_error, on_error, true, cb, opaque,
                      &commit_active_job_driver, false, base, auto_complete,
                      filter_node_name, false, MIRROR_COPY_MODE_BACKGROUND,
-                     errp);
+                     0, errp);
     if (!job) {
         goto error_restore_flags;
     }
@@ -34,14 +34,16 @@
 
 #define NVME_SQ_ENTRY_BYTES 64
 #define NVME_CQ_ENTRY_BYTES 16
+/* Size of the admin queue, and default size of the I/O queues */
 #define NVME_QUEUE_SIZE 128
+#define NVME_QUEUE_SIZE_MAX 1024
 #define NVME_DOORBELL_SIZE 4096
 
 /*
- * We have to leave one slot empty as that is the full queue case where
- * head == tail + 1.
+ * In poll-only mode, how often completions are reaped when the AioContext
+ * does not poll by itself.
  */
-#define NVME_NUM_REQS (NVME_QUEUE_SIZE - 1)
+#define NVME_POLL_TIMER_NS (50 * SCALE_US)
 
 typedef struct BDRVNVMeState BDRVNVMeState;
 
@@ -78,6 +80,24 @@ typedef struct {
     /* Read from I/O code path, initialized under BQL */
     BDRVNVMeState   *s;
     int             index;
+    /*
+     * Number of entries in sq and cq.  We have to leave one slot empty as
+     * that is the full queue case where head == tail + 1, so there are
+     * size - 1 requests.
+     */
+    unsigned        size;
+
+    /*
+     * The AioContext that submits to this queue pair, set once by the
+     * first request from it.  @ready is set when the queue pair has been
+     * set up for that AioContext.
+     */
+    AioContext      *ctx;
+    bool            ready;
+
+    /* Poll-only mode: reaping of completions in @ctx */
+    EventNotifier   poll_notifier;
+    QEMUTimer       *poll_timer;
 
     /* Fields protected by BQL */
     uint8_t     *prp_list_pages;
@@ -87,7 +107,7 @@ typedef struct {
     NVMeQueue   sq, cq;
     int         cq_phase;
     int         free_req_head;
-    NVMeRequest reqs[NVME_NUM_REQS];
+    NVMeRequest *reqs;
     int         need_kick;
     int         inflight;
 
@@ -110,6 +130,10 @@ struct BDRVNVMeState {
      */
     NVMeQueuePair **queues;
     unsigned queue_count;
+    /* Size of the I/O queues */
+    unsigned io_queue_size;
+    /* I/O completion queues do not raise interrupts */
+    bool poll_only;
     size_t page_size;
     /* How many uint32_t elements does each doorbell entry take. */
     size_t doorbell_scale;
@@ -143,6 +167,9 @@ struct BDRVNVMeState {
 
 #define NVME_BLOCK_OPT_DEVICE "device"
 #define NVME_BLOCK_OPT_NAMESPACE "namespace"
+#define NVME_BLOCK_OPT_QUEUE_SIZE "queue-size"
+#define NVME_BLOCK_OPT_NUM_QUEUES "num-queues"
+#define NVME_BLOCK_OPT_POLL_ONLY "poll-only"
 
 static void nvme_process_completion_bh(void *opaque);
 
@@ -160,6 +187,21 @@ static QemuOptsList runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "NVMe namespace",
         },
+        {
+            .name = NVME_BLOCK_OPT_QUEUE_SIZE,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of entries in each I/O queue",
+        },
+        {
+            .name = NVME_BLOCK_OPT_NUM_QUEUES,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of I/O queue pairs",
+        },
+        {
+            .name = NVME_BLOCK_OPT_POLL_ONLY,
+            .type = QEMU_OPT_BOOL,
+            .help = "Reap I/O completions by polling, without interrupts",
+        },
         { /* end of list */ }
     },
 };
@@ -200,7 +242,9 @@ static void nvme_free_queue_pair(NVMeQueuePair *q)
     nvme_free_queue(&q->sq);
     nvme_free_queue(&q->cq);
     qemu_vfree(q->prp_list_pages);
+    event_notifier_cleanup(&q->poll_notifier);
     qemu_mutex_destroy(&q->lock);
+    g_free(q->reqs);
     g_free(q);
 }
 
@@ -233,7 +277,7 @@ static NVMeQueuePair *nvme_create_queue_pair(BDRVNVMeState *s,
     }
     trace_nvme_create_queue_pair(idx, q, size, aio_context,
                                  event_notifier_get_fd(s->irq_notifier));
-    bytes = QEMU_ALIGN_UP(s->page_size * NVME_NUM_REQS,
+    bytes = QEMU_ALIGN_UP(s->page_size * (size - 1),
                           qemu_real_host_page_size());
     q->prp_list_pages = qemu_try_memalign(qemu_real_host_page_size(), bytes);
     if (!q->prp_list_pages) {
@@ -244,6 +288,13 @@ static NVMeQueuePair *nvme_create_queue_pair(BDRVNVMeState *s,
     qemu_mutex_init(&q->lock);
     q->s = s;
     q->index = idx;
+    q->size = size;
+    q->reqs = g_new0(NVMeRequest, size - 1);
+    if (s->poll_only && idx != INDEX_ADMIN &&
+        event_notifier_init(&q->poll_notifier, 0)) {
+        error_setg(errp, "Failed to init event notifier");
+        goto fail;
+    }
     qemu_co_queue_init(&q->free_req_queue);
     q->completion_bh = aio_bh_new(aio_context, nvme_process_completion_bh, q);
     r = qemu_vfio_dma_map(s->vfio, q->prp_list_pages, bytes,
@@ -253,7 +304,7 @@ static NVMeQueuePair *nvme_create_queue_pair(BDRVNVMeState *s,
         goto fail;
     }
     q->free_req_head = -1;
-    for (i = 0; i < NVME_NUM_REQS; i++) {
+    for (i = 0; i < size - 1; i++) {
         NVMeRequest *req = &q->reqs[i];
         req->cid = i + 1;
         req->free_req_next = q->free_req_head;
@@ -287,7 +338,7 @@ static void nvme_kick(NVMeQueuePair *q)
         return;
     }
     trace_nvme_kick(s, q->index);
-    assert(!(q->sq.tail & 0xFF00));
+    assert(q->sq.tail < q->size);
     /* Fence the write to submission queue entry before notifying the device. */
     smp_wmb();
     *q->sq.doorbell = cpu_to_le32(q->sq.tail);
@@ -342,7 +393,7 @@ static void nvme_put_free_req_locked(NVMeQueuePair *q, NVMeRequest *req)
 static void nvme_wake_free_req_locked(NVMeQueuePair *q)
 {
     if (!qemu_co_queue_empty(&q->free_req_queue)) {
-        replay_bh_schedule_oneshot_event(q->s->aio_context,
+        replay_bh_schedule_oneshot_event(q->ctx ?: q->s->aio_context,
                 nvme_free_req_queue_cb, q);
     }
 }
@@ -402,7 +453,7 @@ static bool nvme_process_completion(NVMeQueuePair *q)
     assert(q->inflight >= 0);
     while (q->inflight) {
         int ret;
-        int16_t cid;
+        uint16_t cid;
 
         c = (NvmeCqe *)&q->cq.queue[q->cq.head * NVME_CQ_ENTRY_BYTES];
         if ((le16_to_cpu(c->status) & 0x1) == q->cq_phase) {
@@ -412,15 +463,15 @@ static bool nvme_process_completion(NVMeQueuePair *q)
         if (ret) {
             s->stats.completion_errors++;
         }
-        q->cq.head = (q->cq.head + 1) % NVME_QUEUE_SIZE;
+        q->cq.head = (q->cq.head + 1) % q->size;
         if (!q->cq.head) {
             q->cq_phase = !q->cq_phase;
         }
         cid = le16_to_cpu(c->cid);
-        if (cid == 0 || cid > NVME_NUM_REQS) {
+        if (cid == 0 || cid > q->size - 1) {
             warn_report("NVMe: Unexpected CID in completion queue: %" PRIu32
                         ", should be within: 1..%u inclusively", cid,
-                        NVME_NUM_REQS);
+                        q->size - 1);
             continue;
         }
         trace_nvme_complete_command(s, q->index, cid);
@@ -478,6 +529,16 @@ static void nvme_trace_command(const NvmeCmd *cmd)
     }
 }
 
+/* With q->lock */
+static void nvme_arm_poll_timer_locked(NVMeQueuePair *q)
+{
+    if (q->poll_timer && q->inflight && !timer_pending(q->poll_timer)) {
+        timer_mod_ns(q->poll_timer,
+                     qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+                     NVME_POLL_TIMER_NS);
+    }
+}
+
 static void nvme_deferred_fn(void *opaque)
 {
     NVMeQueuePair *q = opaque;
@@ -485,6 +546,7 @@ static void nvme_deferred_fn(void *opaque)
     QEMU_LOCK_GUARD(&q->lock);
     nvme_kick(q);
     nvme_process_completion(q);
+    nvme_arm_poll_timer_locked(q);
 }
 
 static void nvme_submit_command(NVMeQueuePair *q, NVMeRequest *req,
@@ -501,7 +563,7 @@ static void nvme_submit_command(NVMeQueuePair *q, NVMeRequest *req,
     qemu_mutex_lock(&q->lock);
     memcpy((uint8_t *)q->sq.queue +
            q->sq.tail * NVME_SQ_ENTRY_BYTES, cmd, sizeof(*cmd));
-    q->sq.tail = (q->sq.tail + 1) % NVME_QUEUE_SIZE;
+    q->sq.tail = (q->sq.tail + 1) % q->size;
     q->need_kick++;
     qemu_mutex_unlock(&q->lock);
 
@@ -644,11 +706,21 @@ static void nvme_poll_queue(NVMeQueuePair *q)
     qemu_mutex_unlock(&q->lock);
 }
 
+/*
+ * Poll the queues whose completions are reaped in the AioContext of the
+ * BlockDriverState.  That is all of them when interrupts are used, but
+ * only the admin queue in poll-only mode.
+ */
+static unsigned nvme_irq_queue_count(BDRVNVMeState *s)
+{
+    return s->poll_only ? 1 : s->queue_count;
+}
+
 static void nvme_poll_queues(BDRVNVMeState *s)
 {
     int i;
 
-    for (i = 0; i < s->queue_count; i++) {
+    for (i = 0; i < nvme_irq_queue_count(s); i++) {
         nvme_poll_queue(s->queues[i]);
     }
 }
@@ -663,13 +735,116 @@ static void nvme_handle_event(EventNotifier *n)
     nvme_poll_queues(s);
 }
 
+static void nvme_queue_handle_event(EventNotifier *n)
+{
+    NVMeQueuePair *q = container_of(n, NVMeQueuePair, poll_notifier);
+
+    event_notifier_test_and_clear(n);
+    nvme_poll_queue(q);
+}
+
+static bool nvme_queue_poll_cb(void *opaque)
+{
+    NVMeQueuePair *q = container_of(opaque, NVMeQueuePair, poll_notifier);
+    const size_t cqe_offset = q->cq.head * NVME_CQ_ENTRY_BYTES;
+    NvmeCqe *cqe = (NvmeCqe *)&q->cq.queue[cqe_offset];
+
+    return (le16_to_cpu(cqe->status) & 0x1) != q->cq_phase;
+}
+
+static void nvme_queue_poll_ready(EventNotifier *e)
+{
+    NVMeQueuePair *q = container_of(e, NVMeQueuePair, poll_notifier);
+
+    nvme_poll_queue(q);
+}
+
+static void nvme_poll_timer_cb(void *opaque)
+{
+    NVMeQueuePair *q = opaque;
+
+    nvme_poll_queue(q);
+    qemu_mutex_lock(&q->lock);
+    nvme_arm_poll_timer_locked(q);
+    qemu_mutex_unlock(&q->lock);
+}
+
+/*
+ * Make the I/O queue pair @q the one of @ctx.  In poll-only mode the
+ * completions of @q are then reaped in @ctx, when it polls and from a
+ * timer while requests are in flight, since the completion queue raises
+ * no interrupt.
+ */
+static void nvme_queue_attach(NVMeQueuePair *q, AioContext *ctx)
+{
+    q->ctx = ctx;
+    if (q->s->poll_only) {
+        qemu_bh_delete(q->completion_bh);
+        q->completion_bh = aio_bh_new(ctx, nvme_process_completion_bh, q);
+        q->poll_timer = aio_timer_new(ctx, QEMU_CLOCK_REALTIME, SCALE_NS,
+                                      nvme_poll_timer_cb, q);
+        aio_set_event_notifier(ctx, &q->poll_notifier,
+                               nvme_queue_handle_event, nvme_queue_poll_cb,
+                               nvme_queue_poll_ready);
+    }
+    qatomic_store_release(&q->ready, true);
+}
+
+/* Must be called with no requests in flight on @q */
+static void nvme_queue_detach(NVMeQueuePair *q)
+{
+    if (q->s->poll_only && q->ctx) {
+        aio_set_event_notifier(q->ctx, &q->poll_notifier, NULL, NULL, NULL);
+        timer_free(q->poll_timer);
+        q->poll_timer = NULL;
+    }
+    q->ready = false;
+    q->ctx = NULL;
+}
+
+/*
+ * Return the I/O queue pair to submit to from the current AioContext.
+ * Each AioContext gets a queue pair of its own as long as there are
+ * unused ones, so that IOThreads neither contend on the queue lock nor
+ * share a doorbell.  When there are more AioContexts than queue pairs,
+ * the remaining ones share the queue pairs.
+ */
+static NVMeQueuePair *nvme_get_io_queue(BDRVNVMeState *s)
+{
+    AioContext *ctx = qemu_get_current_aio_context();
+    NVMeQueuePair *q;
+    unsigned i;
+
+    for (i = INDEX_IO(0); i < s->queue_count; i++) {
+        AioContext *owner;
+
+        q = s->queues[i];
+        owner = qatomic_read(&q->ctx);
+        if (owner == ctx) {
+            return q;
+        }
+        if (!owner && !qatomic_cmpxchg(&q->ctx, NULL, ctx)) {
+            nvme_queue_attach(q, ctx);
+            return q;
+        }
+    }
+
+    q = s->queues[INDEX_IO(g_direct_hash(ctx) % (s->queue_count - 1))];
+    if (!qatomic_load_acquire(&q->ready)) {
+        /* Still being set up by its AioContext */
+        q = s->queues[INDEX_IO(0)];
+    }
+    return q;
+}
+
 static bool nvme_add_io_queue(BlockDriverState *bs, Error **errp)
 {
     BDRVNVMeState *s = bs->opaque;
     unsigned n = s->queue_count;
     NVMeQueuePair *q;
     NvmeCmd cmd;
-    unsigned queue_size = NVME_QUEUE_SIZE;
+    unsigned queue_size = s->io_queue_size;
+    uint32_t cq_flags = NVME_CQ_PC | (s->poll_only ? 0 : NVME_CQ_IEN);
 
     assert(n <= UINT16_MAX);
     q = nvme_create_queue_pair(s, bdrv_get_aio_context(bs),
@@ -681,7 +856,7 @@ static bool nvme_add_io_queue(BlockDriverState *bs, Error **errp)
         .opcode = NVME_ADM_CMD_CREATE_CQ,
         .dptr.prp1 = cpu_to_le64(q->cq.iova),
         .cdw10 = cpu_to_le32(((queue_size - 1) << 16) | n),
-        .cdw11 = cpu_to_le32(NVME_CQ_IEN | NVME_CQ_PC),
+        .cdw11 = cpu_to_le32(cq_flags),
     };
     if (nvme_admin_cmd_sync(bs, &cmd)) {
         error_setg(errp, "Failed to create CQ io queue [%u]", n);
@@ -713,7 +888,7 @@ static bool nvme_poll_cb(void *opaque)
                                     irq_notifier[MSIX_SHARED_IRQ_IDX]);
     int i;
 
-    for (i = 0; i < s->queue_count; i++) {
+    for (i = 0; i < nvme_irq_queue_count(s); i++) {
         NVMeQueuePair *q = s->queues[i];
         const size_t cqe_offset = q->cq.head * NVME_CQ_ENTRY_BYTES;
         NvmeCqe *cqe = (NvmeCqe *)&q->cq.queue[cqe_offset];
@@ -738,7 +913,7 @@ static void nvme_poll_ready(EventNotifier *e)
 }
 
 static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
-                     Error **errp)
+                     unsigned num_queues, Error **errp)
 {
     BDRVNVMeState *s = bs->opaque;
     NVMeQueuePair *q;
@@ -749,6 +924,7 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
     uint64_t timeout_ms;
     uint64_t deadline, now;
     volatile NvmeBar *regs = NULL;
+    unsigned i;
 
     qemu_co_mutex_init(&s->dma_map_lock);
     qemu_co_queue_init(&s->dma_flush_queue);
@@ -795,6 +971,12 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
         ret = -EINVAL;
         goto out;
     }
+    if (s->io_queue_size > NVME_CAP_MQES(cap) + 1) {
+        error_setg(errp, "'" NVME_BLOCK_OPT_QUEUE_SIZE "' must be at most "
+                   "%u for this device", (unsigned)NVME_CAP_MQES(cap) + 1);
+        ret = -EINVAL;
+        goto out;
+    }
 
     s->page_size = 1u << (12 + NVME_CAP_MPSMIN(cap));
     s->doorbell_scale = (4 << NVME_CAP_DSTRD(cap)) / sizeof(uint32_t);
@@ -878,8 +1060,31 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
     }
 
     /* Set up command queues. */
-    if (!nvme_add_io_queue(bs, errp)) {
-        ret = -EIO;
+    if (num_queues > 1) {
+        NvmeCmd cmd = {
+            .opcode = NVME_ADM_CMD_SET_FEATURES,
+            .cdw10 = cpu_to_le32(NVME_NUMBER_OF_QUEUES),
+            .cdw11 = cpu_to_le32(((num_queues - 1) << 16) | (num_queues - 1)),
+        };
+
+        if (nvme_admin_cmd_sync(bs, &cmd)) {
+            warn_report("NVMe: cannot allocate %u I/O queues, using one",
+                        num_queues);
+            num_queues = 1;
+        }
+    }
+    for (i = 0; i < num_queues; i++) {
+        /*
+         * The controller may have allocated fewer queues than requested,
+         * in which case the extra ones fail to be created.
+         */
+        if (!nvme_add_io_queue(bs, i ? NULL : errp)) {
+            ret = i ? 0 : -EIO;
+            break;
+        }
+    }
+    if (s->queue_count > 1) {
+        nvme_queue_attach(s->queues[INDEX_IO(0)], aio_context);
     }
 out:
     if (regs) {
@@ -950,6 +1155,9 @@ static void nvme_close(BlockDriverState *bs)
     BDRVNVMeState *s = bs->opaque;
 
     for (unsigned i = 0; i < s->queue_count; ++i) {
+        if (i != INDEX_ADMIN) {
+            nvme_queue_detach(s->queues[i]);
+        }
         nvme_free_queue_pair(s->queues[i]);
     }
     g_free(s->queues);
@@ -970,6 +1178,7 @@ static int nvme_file_open(BlockDriverState *bs, QDict *options, int flags,
     const char *device;
     QemuOpts *opts;
     int namespace;
+    uint64_t queue_size, num_queues;
     int ret;
     BDRVNVMeState *s = bs->opaque;
 
@@ -985,7 +1194,24 @@ static int nvme_file_open(BlockDriverState *bs, QDict *options, int flags,
     }
 
     namespace = qemu_opt_get_number(opts, NVME_BLOCK_OPT_NAMESPACE, 1);
-    ret = nvme_init(bs, device, namespace, errp);
+    queue_size = qemu_opt_get_number(opts, NVME_BLOCK_OPT_QUEUE_SIZE,
+                                     NVME_QUEUE_SIZE);
+    if (queue_size < 2 || queue_size > NVME_QUEUE_SIZE_MAX) {
+        error_setg(errp, "'" NVME_BLOCK_OPT_QUEUE_SIZE "' must be between "
+                   "2 and %d", NVME_QUEUE_SIZE_MAX);
+        qemu_opts_del(opts);
+        return -EINVAL;
+    }
+    num_queues = qemu_opt_get_number(opts, NVME_BLOCK_OPT_NUM_QUEUES, 1);
+    if (num_queues < 1 || num_queues > UINT16_MAX) {
+        error_setg(errp, "'" NVME_BLOCK_OPT_NUM_QUEUES "' must be between "
+                   "1 and %d", UINT16_MAX);
+        qemu_opts_del(opts);
+        return -EINVAL;
+    }
+    s->io_queue_size = queue_size;
+    s->poll_only = qemu_opt_get_bool(opts, NVME_BLOCK_OPT_POLL_ONLY, false);
+    ret = nvme_init(bs, device, namespace, num_queues, errp);
     qemu_opts_del(opts);
     if (ret) {
         goto fail;
@@ -1185,7 +1411,7 @@ static coroutine_fn int nvme_co_prw_aligned(BlockDriverState *bs,
 {
     int r;
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
 
     uint32_t cdw12 = (((bytes >> s->blkshift) - 1) & 0xFFFF) |
@@ -1198,7 +1424,7 @@ static coroutine_fn int nvme_co_prw_aligned(BlockDriverState *bs,
         .cdw12 = cpu_to_le32(cdw12),
     };
     NVMeCoData data = {
-        .ctx = bdrv_get_aio_context(bs),
+        .ctx = qemu_get_current_aio_context(),
         .ret = -EINPROGRESS,
     };
 
@@ -1306,14 +1532,14 @@ static coroutine_fn int nvme_co_pwritev(BlockDriverState *bs,
 static coroutine_fn int nvme_co_flush(BlockDriverState *bs)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
     NvmeCmd cmd = {
         .opcode = NVME_CMD_FLUSH,
         .nsid = cpu_to_le32(s->nsid),
     };
     NVMeCoData data = {
-        .ctx = bdrv_get_aio_context(bs),
+        .ctx = qemu_get_current_aio_context(),
         .ret = -EINPROGRESS,
     };
 
@@ -1337,7 +1563,7 @@ static coroutine_fn int nvme_co_pwrite_zeroes(BlockDriverState *bs,
                                               BdrvRequestFlags flags)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
     uint32_t cdw12;
 
@@ -1364,7 +1590,7 @@ static coroutine_fn int nvme_co_pwrite_zeroes(BlockDriverState *bs,
     };
 
     NVMeCoData data = {
-        .ctx = bdrv_get_aio_context(bs),
+        .ctx = qemu_get_current_aio_context(),
         .ret = -EINPROGRESS,
     };
 
@@ -1400,7 +1626,7 @@ static int coroutine_fn nvme_co_pdiscard(BlockDriverState *bs,
                                          int64_t bytes)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
     QEMU_AUTO_VFREE NvmeDsmRange *buf = NULL;
     QEMUIOVector local_qiov;
@@ -1414,7 +1640,7 @@ static int coroutine_fn nvme_co_pdiscard(BlockDriverState *bs,
     };
 
     NVMeCoData data = {
-        .ctx = bdrv_get_aio_context(bs),
+        .ctx = qemu_get_current_aio_context(),
         .ret = -EINPROGRESS,
     };
 
@@ -1547,6 +1773,9 @@ static void nvme_detach_aio_context(BlockDriverState *bs)
     for (unsigned i = 0; i < s->queue_count; i++) {
         NVMeQueuePair *q = s->queues[i];
 
+        if (i != INDEX_ADMIN) {
+            nvme_queue_detach(q);
+        }
         qemu_bh_delete(q->completion_bh);
         q->completion_bh = NULL;
     }
@@ -1572,6 +1801,9 @@ static void nvme_attach_aio_context(BlockDriverState *bs,
         q->completion_bh =
             aio_bh_new(new_context, nvme_process_completion_bh, q);
     }
+    if (s->queue_count > 1) {
+        nvme_queue_attach(s->queues[INDEX_IO(0)], new_context);
+    }
 }
 
 static bool nvme_register_buf(BlockDriverState *bs, void *host, size_t size,
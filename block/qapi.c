@@ -496,6 +496,69 @@ bdrv_latency_histogram_stats(BlockLatencyHistogram *hist)
     return info;
 }
 
+static BlockLatencyPercentiles *
+bdrv_latency_percentiles(BlockAcctStats *stats, int queue,
+                         const char *iothread, enum BlockAcctType type)
+{
+    BlockLatencyPercentiles *info = g_new0(BlockLatencyPercentiles, 1);
+    BlockAcctLatencySummary sum;
+
+    if (queue >= 0) {
+        block_acct_queue_latency(stats, queue, type, &sum);
+    } else {
+        block_acct_iothread_latency(stats, iothread, type, &sum);
+    }
+
+    info->operations = sum.ops;
+    info->p50 = sum.p50_ns;
+    info->p99 = sum.p99_ns;
+    info->p999 = sum.p999_ns;
+    return info;
+}
+
+static void bdrv_query_queue_latency(BlockDeviceStats *ds,
+                                     BlockAcctStats *stats)
+{
+    BlockQueueLatencyStatsList **queue_tail = &ds->queue_latency;
+    BlockIOThreadLatencyStatsList **iothread_tail = &ds->iothread_latency;
+    unsigned i, j;
+
+    for (i = 0; i < stats->nr_queues; i++) {
+        const char *iothread = stats->queues[i].iothread;
+        BlockQueueLatencyStats *q = g_new0(BlockQueueLatencyStats, 1);
+        BlockIOThreadLatencyStats *t;
+
+        q->queue = i;
+        q->iothread = g_strdup(iothread);
+        q->rd = bdrv_latency_percentiles(stats, i, NULL, BLOCK_ACCT_READ);
+        q->wr = bdrv_latency_percentiles(stats, i, NULL, BLOCK_ACCT_WRITE);
+        q->flush = bdrv_latency_percentiles(stats, i, NULL, BLOCK_ACCT_FLUSH);
+        QAPI_LIST_APPEND(queue_tail, q);
+
+        if (!iothread) {
+            continue;
+        }
+        for (j = 0; j < i; j++) {
+            if (!g_strcmp0(stats->queues[j].iothread, iothread)) {
+                break;
+            }
+        }
+        if (j < i) {
+            /* Already reported */
+            continue;
+        }
+
+        t = g_new0(BlockIOThreadLatencyStats, 1);
+        t->iothread = g_strdup(iothread);
+        t->rd = bdrv_latency_percentiles(stats, -1, iothread, BLOCK_ACCT_READ);
+        t->wr = bdrv_latency_percentiles(stats, -1, iothread,
+                                         BLOCK_ACCT_WRITE);
+        t->flush = bdrv_latency_percentiles(stats, -1, iothread,
+                                            BLOCK_ACCT_FLUSH);
+        QAPI_LIST_APPEND(iothread_tail, t);
+    }
+}
+
 static void bdrv_query_blk_stats(BlockDeviceStats *ds, BlockBackend *blk)
 {
     BlockAcctStats *stats = blk_get_stats(blk);
@@ -591,6 +654,8 @@ static void bdrv_query_blk_stats(BlockDeviceStats *ds, BlockBackend *blk)
         = bdrv_latency_histogram_stats(&hgram[BLOCK_ACCT_ZONE_APPEND]);
     ds->flush_latency_histogram
         = bdrv_latency_histogram_stats(&hgram[BLOCK_ACCT_FLUSH]);
+
+    bdrv_query_queue_latency(ds, stats);
 }
 
 static BlockStats * GRAPH_RDLOCK
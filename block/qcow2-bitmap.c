@@ -1328,6 +1328,18 @@ store_bitmap_data(BlockDriverState *bs, BdrvDirtyBitmap *bitmap,
                                                           end - offset);
         assert(write_size <= s->cluster_size);
 
+        /*
+         * The specification lets a table entry describe a bitmap cluster
+         * that is entirely set without any data cluster behind it.  This
+         * is common for freshly created or fully dirtied bitmaps, so don't
+         * waste a cluster and a write on it.
+         */
+        if (bdrv_dirty_bitmap_next_zero(bitmap, offset, end - offset) < 0) {
+            tb[cluster] = BME_TABLE_ENTRY_FLAG_ALL_ONES;
+            offset = end;
+            continue;
+        }
+
         off = qcow2_alloc_clusters(bs, s->cluster_size);
         if (off < 0) {
             error_setg_errno(errp, -off,
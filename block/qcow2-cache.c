@@ -25,14 +25,22 @@
 #include "qemu/osdep.h"
 #include "block/block-io.h"
 #include "qemu/memalign.h"
+#include "qemu/units.h"
 #include "qcow2.h"
 #include "trace.h"
 
+/* Largest write request used to write back adjacent dirty tables */
+#define QCOW2_CACHE_MAX_WRITE (1 * MiB)
+
 typedef struct Qcow2CachedTable {
     int64_t  offset;
     uint64_t lru_counter;
     int      ref;
+    /* Next entry in the same hash bucket, or -1 */
+    int      hash_next;
     bool     dirty;
+    /* Used since the clock hand last passed, see qcow2_cache_find_victim() */
+    bool     referenced;
 } Qcow2CachedTable;
 
 struct Qcow2Cache {
@@ -44,6 +52,16 @@ struct Qcow2Cache {
     void                   *table_array;
     uint64_t                lru_counter;
     uint64_t                cache_clean_lru_counter;
+
+    /* Index of cached tables by offset, heads of the bucket chains */
+    int                    *hash_table;
+    int                     hash_bits;
+    /* Next entry the CLOCK replacement looks at */
+    int                     clock_hand;
+
+    uint64_t                hits;
+    uint64_t                misses;
+    uint64_t                evictions;
 };
 
 static inline void *qcow2_cache_get_table_addr(Qcow2Cache *c, int table)
@@ -59,6 +77,64 @@ static inline int qcow2_cache_get_table_idx(Qcow2Cache *c, void *table)
     return idx;
 }
 
+static inline unsigned qcow2_cache_hash(Qcow2Cache *c, uint64_t offset)
+{
+    return (offset / c->table_size * 0x9e3779b97f4a7c15ULL) >>
+           (64 - c->hash_bits);
+}
+
+static void qcow2_cache_hash_reset(Qcow2Cache *c)
+{
+    int i;
+
+    for (i = 0; i < (1 << c->hash_bits); i++) {
+        c->hash_table[i] = -1;
+    }
+}
+
+static int qcow2_cache_lookup(Qcow2Cache *c, uint64_t offset)
+{
+    int i = c->hash_table[qcow2_cache_hash(c, offset)];
+
+    while (i != -1 && c->entries[i].offset != offset) {
+        i = c->entries[i].hash_next;
+    }
+    return i;
+}
+
+/* Make entry @i cache the table at @offset */
+static void qcow2_cache_insert(Qcow2Cache *c, int i, uint64_t offset)
+{
+    unsigned bucket = qcow2_cache_hash(c, offset);
+
+    assert(c->entries[i].offset == 0);
+    c->entries[i].offset = offset;
+    c->entries[i].hash_next = c->hash_table[bucket];
+    c->hash_table[bucket] = i;
+}
+
+/* Drop the table cached in entry @i, if any, from the cache */
+static void qcow2_cache_remove(Qcow2Cache *c, int i)
+{
+    Qcow2CachedTable *t = &c->entries[i];
+    int *p;
+
+    if (t->offset == 0) {
+        return;
+    }
+
+    p = &c->hash_table[qcow2_cache_hash(c, t->offset)];
+    while (*p != i) {
+        assert(*p != -1);
+        p = &c->entries[*p].hash_next;
+    }
+    *p = t->hash_next;
+
+    t->offset = 0;
+    t->lru_counter = 0;
+    t->referenced = false;
+}
+
 static inline const char *qcow2_cache_get_name(BDRVQcow2State *s, Qcow2Cache *c)
 {
     if (c == s->refcount_block_cache) {
@@ -106,8 +182,7 @@ void qcow2_cache_clean_unused(Qcow2Cache *c)
 
         /* And count how many we can clean in a row */
         while (i < c->size && can_clean_entry(c, i)) {
-            c->entries[i].offset = 0;
-            c->entries[i].lru_counter = 0;
+            qcow2_cache_remove(c, i);
             i++;
             to_clean++;
         }
@@ -134,17 +209,22 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
     c = g_new0(Qcow2Cache, 1);
     c->size = num_tables;
     c->table_size = table_size;
+    c->hash_bits = MAX(ctz32(pow2ceil(num_tables)), 1);
     c->entries = g_try_new0(Qcow2CachedTable, num_tables);
+    c->hash_table = g_try_new(int, 1 << c->hash_bits);
     c->table_array = qemu_try_blockalign(bs->file->bs,
                                          (size_t) num_tables * c->table_size);
 
-    if (!c->entries || !c->table_array) {
+    if (!c->entries || !c->hash_table || !c->table_array) {
         qemu_vfree(c->table_array);
+        g_free(c->hash_table);
         g_free(c->entries);
         g_free(c);
-        c = NULL;
+        return NULL;
     }
 
+    qcow2_cache_hash_reset(c);
+
     return c;
 }
 
@@ -157,6 +237,7 @@ int qcow2_cache_destroy(Qcow2Cache *c)
     }
 
     qemu_vfree(c->table_array);
+    g_free(c->hash_table);
     g_free(c->entries);
     g_free(c);
 
@@ -179,19 +260,12 @@ qcow2_cache_flush_dependency(BlockDriverState *bs, Qcow2Cache *c)
     return 0;
 }
 
+/* Write back what the dirty tables of @c depend on */
 static int GRAPH_RDLOCK
-qcow2_cache_entry_flush(BlockDriverState *bs, Qcow2Cache *c, int i)
+qcow2_cache_flush_before_write(BlockDriverState *bs, Qcow2Cache *c)
 {
-    BDRVQcow2State *s = bs->opaque;
     int ret = 0;
 
-    if (!c->entries[i].dirty || !c->entries[i].offset) {
-        return 0;
-    }
-
-    trace_qcow2_cache_entry_flush(qemu_coroutine_self(),
-                                  c == s->l2_table_cache, i);
-
     if (c->depends) {
         ret = qcow2_cache_flush_dependency(bs, c);
     } else if (c->depends_on_flush) {
@@ -201,56 +275,168 @@ qcow2_cache_entry_flush(BlockDriverState *bs, Qcow2Cache *c, int i)
         }
     }
 
-    if (ret < 0) {
-        return ret;
+    return ret;
+}
+
+/*
+ * Write back the @n dirty entries @idx, which cache consecutive tables in
+ * the image file, with a single write request.
+ */
+static int GRAPH_RDLOCK
+qcow2_cache_write_tables(BlockDriverState *bs, Qcow2Cache *c,
+                         const int *idx, int n)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int64_t offset = c->entries[idx[0]].offset;
+    int64_t bytes = (int64_t) n * c->table_size;
+    void *buf;
+    int ret;
+    int k;
+
+    for (k = 0; k < n; k++) {
+        assert(c->entries[idx[k]].offset ==
+               offset + (int64_t) k * c->table_size);
+        trace_qcow2_cache_entry_flush(qemu_coroutine_self(),
+                                      c == s->l2_table_cache, idx[k]);
     }
 
     if (c == s->refcount_block_cache) {
         ret = qcow2_pre_write_overlap_check(bs, QCOW2_OL_REFCOUNT_BLOCK,
-                c->entries[i].offset, c->table_size, false);
+                offset, bytes, false);
     } else if (c == s->l2_table_cache) {
         ret = qcow2_pre_write_overlap_check(bs, QCOW2_OL_ACTIVE_L2,
-                c->entries[i].offset, c->table_size, false);
+                offset, bytes, false);
     } else {
         ret = qcow2_pre_write_overlap_check(bs, 0,
-                c->entries[i].offset, c->table_size, false);
+                offset, bytes, false);
     }
 
     if (ret < 0) {
         return ret;
     }
 
-    if (c == s->refcount_block_cache) {
-        BLKDBG_EVENT(bs->file, BLKDBG_REFBLOCK_UPDATE_PART);
-    } else if (c == s->l2_table_cache) {
-        BLKDBG_EVENT(bs->file, BLKDBG_L2_UPDATE);
+    for (k = 0; k < n; k++) {
+        if (c == s->refcount_block_cache) {
+            BLKDBG_EVENT(bs->file, BLKDBG_REFBLOCK_UPDATE_PART);
+        } else if (c == s->l2_table_cache) {
+            BLKDBG_EVENT(bs->file, BLKDBG_L2_UPDATE);
+        }
     }
 
-    ret = bdrv_pwrite(bs->file, c->entries[i].offset, c->table_size,
-                      qcow2_cache_get_table_addr(c, i), 0);
+    if (n == 1) {
+        buf = qcow2_cache_get_table_addr(c, idx[0]);
+    } else {
+        buf = qemu_try_blockalign(bs->file->bs, bytes);
+        if (!buf) {
+            return -ENOMEM;
+        }
+        for (k = 0; k < n; k++) {
+            memcpy((uint8_t *) buf + (size_t) k * c->table_size,
+                   qcow2_cache_get_table_addr(c, idx[k]), c->table_size);
+        }
+    }
+
+    ret = bdrv_pwrite(bs->file, offset, bytes, buf, 0);
+    if (n > 1) {
+        qemu_vfree(buf);
+    }
     if (ret < 0) {
         return ret;
     }
 
-    c->entries[i].dirty = false;
+    for (k = 0; k < n; k++) {
+        c->entries[idx[k]].dirty = false;
+    }
 
     return 0;
 }
 
+static int GRAPH_RDLOCK
+qcow2_cache_entry_flush(BlockDriverState *bs, Qcow2Cache *c, int i)
+{
+    int ret;
+
+    if (!c->entries[i].dirty || !c->entries[i].offset) {
+        return 0;
+    }
+
+    ret = qcow2_cache_flush_before_write(bs, c);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return qcow2_cache_write_tables(bs, c, &i, 1);
+}
+
+typedef struct Qcow2DirtyTable {
+    int64_t offset;
+    int     index;
+} Qcow2DirtyTable;
+
+static int qcow2_dirty_table_cmp(const void *a, const void *b)
+{
+    const Qcow2DirtyTable *ta = a, *tb = b;
+
+    return ta->offset < tb->offset ? -1 : ta->offset > tb->offset;
+}
+
+/*
+ * Write back all dirty entries.  They are written in the order of their
+ * offset in the image file, and runs of tables that are adjacent in the
+ * file (typically slices of the same L2 table) go out as one request of
+ * up to QCOW2_CACHE_MAX_WRITE bytes.
+ */
 int qcow2_cache_write(BlockDriverState *bs, Qcow2Cache *c)
 {
     BDRVQcow2State *s = bs->opaque;
+    g_autofree Qcow2DirtyTable *dirty = NULL;
+    g_autofree int *idx = NULL;
+    int max_run = MAX(QCOW2_CACHE_MAX_WRITE / c->table_size, 1);
     int result = 0;
     int ret;
-    int i;
+    int i, n = 0;
 
     trace_qcow2_cache_flush(qemu_coroutine_self(), c == s->l2_table_cache);
 
     for (i = 0; i < c->size; i++) {
-        ret = qcow2_cache_entry_flush(bs, c, i);
+        if (c->entries[i].dirty && c->entries[i].offset) {
+            if (!dirty) {
+                dirty = g_new(Qcow2DirtyTable, c->size);
+            }
+            dirty[n].offset = c->entries[i].offset;
+            dirty[n].index = i;
+            n++;
+        }
+    }
+    if (!n) {
+        return 0;
+    }
+
+    ret = qcow2_cache_flush_before_write(bs, c);
+    if (ret < 0) {
+        return ret;
+    }
+
+    qsort(dirty, n, sizeof(*dirty), qcow2_dirty_table_cmp);
+    idx = g_new(int, n);
+    for (i = 0; i < n; i++) {
+        idx[i] = dirty[i].index;
+    }
+
+    for (i = 0; i < n;) {
+        int run = 1;
+
+        while (i + run < n && run < max_run &&
+               dirty[i + run].offset ==
+               dirty[i].offset + (int64_t) run * c->table_size) {
+            run++;
+        }
+
+        ret = qcow2_cache_write_tables(bs, c, &idx[i], run);
         if (ret < 0 && result != -ENOSPC) {
             result = ret;
         }
+        i += run;
     }
 
     return result;
@@ -311,15 +497,47 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
         assert(c->entries[i].ref == 0);
         c->entries[i].offset = 0;
         c->entries[i].lru_counter = 0;
+        c->entries[i].referenced = false;
     }
+    qcow2_cache_hash_reset(c);
 
     qcow2_cache_table_release(c, 0, c->size);
 
     c->lru_counter = 0;
+    c->clock_hand = 0;
 
     return 0;
 }
 
+/*
+ * Pick the entry to replace on a cache miss with the CLOCK algorithm: the
+ * hand sweeps over the entries, skips those in use, gives those used since
+ * its last pass a second chance and stops at the first other one.  Returns
+ * -1 if all entries are in use.
+ */
+static int qcow2_cache_find_victim(Qcow2Cache *c)
+{
+    int n;
+
+    for (n = 0; n < 2 * c->size; n++) {
+        Qcow2CachedTable *t = &c->entries[c->clock_hand];
+        int i = c->clock_hand;
+
+        if (++c->clock_hand == c->size) {
+            c->clock_hand = 0;
+        }
+        if (t->ref) {
+            continue;
+        }
+        if (t->offset && t->referenced) {
+            t->referenced = false;
+            continue;
+        }
+        return i;
+    }
+    return -1;
+}
+
 static int GRAPH_RDLOCK
 qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
                    void **table, bool read_from_disk)
@@ -327,9 +545,6 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     BDRVQcow2State *s = bs->opaque;
     int i;
     int ret;
-    int lookup_index;
-    uint64_t min_lru_counter = UINT64_MAX;
-    int min_lru_index = -1;
 
     assert(offset != 0);
 
@@ -344,29 +559,21 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     }
 
     /* Check if the table is already cached */
-    i = lookup_index = (offset / c->table_size * 4) % c->size;
-    do {
-        const Qcow2CachedTable *t = &c->entries[i];
-        if (t->offset == offset) {
-            goto found;
-        }
-        if (t->ref == 0 && t->lru_counter < min_lru_counter) {
-            min_lru_counter = t->lru_counter;
-            min_lru_index = i;
-        }
-        if (++i == c->size) {
-            i = 0;
-        }
-    } while (i != lookup_index);
+    i = qcow2_cache_lookup(c, offset);
+    if (i != -1) {
+        c->hits++;
+        goto found;
+    }
+    c->misses++;
 
-    if (min_lru_index == -1) {
+    i = qcow2_cache_find_victim(c);
+    if (i == -1) {
         /* This can't happen in current synchronous code, but leave the check
          * here as a reminder for whoever starts using AIO with the cache */
         abort();
     }
 
     /* Cache miss: write a table back and replace it */
-    i = min_lru_index;
     trace_qcow2_cache_get_replace_entry(qemu_coroutine_self(),
                                         c == s->l2_table_cache, i);
 
@@ -377,7 +584,10 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 
     trace_qcow2_cache_get_read(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
-    c->entries[i].offset = 0;
+    if (c->entries[i].offset) {
+        c->evictions++;
+    }
+    qcow2_cache_remove(c, i);
     if (read_from_disk) {
         if (c == s->l2_table_cache) {
             BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
@@ -390,7 +600,7 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
         }
     }
 
-    c->entries[i].offset = offset;
+    qcow2_cache_insert(c, i, offset);
 
     /* And return the right table */
 found:
@@ -424,6 +634,7 @@ void qcow2_cache_put(Qcow2Cache *c, void **table)
 
     if (c->entries[i].ref == 0) {
         c->entries[i].lru_counter = ++c->lru_counter;
+        c->entries[i].referenced = true;
     }
 
     assert(c->entries[i].ref >= 0);
@@ -438,14 +649,9 @@ void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
 
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset)
 {
-    int i;
+    int i = qcow2_cache_lookup(c, offset);
 
-    for (i = 0; i < c->size; i++) {
-        if (c->entries[i].offset == offset) {
-            return qcow2_cache_get_table_addr(c, i);
-        }
-    }
-    return NULL;
+    return i == -1 ? NULL : qcow2_cache_get_table_addr(c, i);
 }
 
 void qcow2_cache_discard(Qcow2Cache *c, void *table)
@@ -454,9 +660,15 @@ void qcow2_cache_discard(Qcow2Cache *c, void *table)
 
     assert(c->entries[i].ref == 0);
 
-    c->entries[i].offset = 0;
-    c->entries[i].lru_counter = 0;
+    qcow2_cache_remove(c, i);
     c->entries[i].dirty = false;
 
     qcow2_cache_table_release(c, i, 1);
 }
+
+void qcow2_cache_get_stats(Qcow2Cache *c, Qcow2CacheStats *stats)
+{
+    stats->hits = c->hits;
+    stats->misses = c->misses;
+    stats->evictions = c->evictions;
+}
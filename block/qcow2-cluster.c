@@ -1136,6 +1136,72 @@ void coroutine_fn qcow2_alloc_cluster_abort(BlockDriverState *bs, QCowL2Meta *m)
     }
 }
 
+/*
+ * Points the L2 entry of the unallocated guest cluster at @guest_offset to
+ * the existing data cluster at @host_offset, whose refcount the caller has
+ * already increased.  The new entry does not get QCOW_OFLAG_COPIED because
+ * the cluster is now shared.
+ *
+ * If @copied_offset is not negative, it is the guest offset of the only
+ * other reference to the cluster, and QCOW_OFLAG_COPIED is cleared in its
+ * L2 entry so that later writes to it allocate a new cluster.
+ *
+ * Returns 0 on success, -errno on failure.
+ */
+int coroutine_fn GRAPH_RDLOCK
+qcow2_link_shared_cluster(BlockDriverState *bs, uint64_t guest_offset,
+                          uint64_t host_offset, int64_t copied_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t *l2_slice;
+    uint64_t l2_entry;
+    QCow2ClusterType type;
+    int l2_index;
+    int ret;
+
+    assert(!has_subclusters(s) && !has_data_file(bs));
+    assert(offset_into_cluster(s, guest_offset) == 0);
+
+    if (s->use_lazy_refcounts) {
+        qcow2_mark_dirty(bs);
+    }
+    if (qcow2_need_accurate_refcounts(s)) {
+        qcow2_cache_set_dependency(bs, s->l2_table_cache,
+                                   s->refcount_block_cache);
+    }
+
+    if (copied_offset >= 0) {
+        ret = get_cluster_table(bs, copied_offset, &l2_slice, &l2_index);
+        if (ret < 0) {
+            return ret;
+        }
+        l2_entry = get_l2_entry(s, l2_slice, l2_index);
+        assert((l2_entry & L2E_OFFSET_MASK) == host_offset);
+        if (l2_entry & QCOW_OFLAG_COPIED) {
+            qcow2_cache_entry_mark_dirty(s->l2_table_cache, l2_slice);
+            set_l2_entry(s, l2_slice, l2_index,
+                         l2_entry & ~QCOW_OFLAG_COPIED);
+        }
+        qcow2_cache_put(s->l2_table_cache, (void **) &l2_slice);
+    }
+
+    ret = get_cluster_table(bs, guest_offset, &l2_slice, &l2_index);
+    if (ret < 0) {
+        return ret;
+    }
+    l2_entry = get_l2_entry(s, l2_slice, l2_index);
+    type = qcow2_get_cluster_type(bs, l2_entry);
+    assert(type == QCOW2_CLUSTER_UNALLOCATED ||
+           type == QCOW2_CLUSTER_ZERO_PLAIN);
+
+    assert((host_offset & L2E_OFFSET_MASK) == host_offset);
+    qcow2_cache_entry_mark_dirty(s->l2_table_cache, l2_slice);
+    set_l2_entry(s, l2_slice, l2_index, host_offset);
+    qcow2_cache_put(s->l2_table_cache, (void **) &l2_slice);
+
+    return 0;
+}
+
 /*
  * For a given write request, create a new QCowL2Meta structure, add
  * it to @m and the BDRVQcow2State.cluster_allocs list. If the write
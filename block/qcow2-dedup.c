@@ -0,0 +1,304 @@
+/*
+ * Content based deduplication of qcow2 data clusters
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * With the dedup option, full-cluster writes to unallocated guest clusters
+ * are first looked up in an in-memory index of the SHA-256 digests of data
+ * clusters written since the image was opened.  If an identical cluster
+ * exists, the guest cluster is pointed at it and its refcount is increased
+ * instead of writing the data again.  The index itself is not stored in
+ * the image, so the on-disk format is unchanged: a deduplicated cluster
+ * looks exactly like a cluster shared with an internal snapshot.
+ *
+ * The data of a candidate cluster is always read back and compared before
+ * it is shared, so neither hash collisions nor stale index entries (e.g.
+ * for clusters that have been overwritten in place) can cause data
+ * corruption.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bswap.h"
+#include "qemu/memalign.h"
+#include "crypto/hash.h"
+#include "block/block-io.h"
+#include "qcow2.h"
+#include "trace.h"
+
+typedef struct Qcow2DedupEntry {
+    uint8_t hash[QCOW2_DEDUP_HASH_SIZE];
+    /* Offset of the data cluster in the image file */
+    uint64_t host_offset;
+    /* Guest offset of the cluster that was written to @host_offset */
+    uint64_t guest_offset;
+} Qcow2DedupEntry;
+
+static guint dedup_hash_func(gconstpointer key)
+{
+    /* SHA-256 output is uniformly distributed, any four bytes will do */
+    return ldl_he_p(key);
+}
+
+static gboolean dedup_hash_equal(gconstpointer a, gconstpointer b)
+{
+    return memcmp(a, b, QCOW2_DEDUP_HASH_SIZE) == 0;
+}
+
+static void dedup_remove(BDRVQcow2State *s, Qcow2DedupEntry *e)
+{
+    g_hash_table_remove(s->dedup_by_offset, &e->host_offset);
+    /* Frees @e */
+    g_hash_table_remove(s->dedup_by_hash, e->hash);
+}
+
+void qcow2_dedup_reset(BDRVQcow2State *s)
+{
+    if (s->dedup_by_hash) {
+        g_hash_table_destroy(s->dedup_by_offset);
+        g_hash_table_destroy(s->dedup_by_hash);
+        s->dedup_by_offset = NULL;
+        s->dedup_by_hash = NULL;
+    }
+}
+
+/*
+ * Drop the index entry for the data cluster at @host_offset, if any.  Must
+ * be called whenever the refcount of a cluster drops to 0, because the
+ * cluster may then be reused for metadata or compressed data.
+ */
+void qcow2_dedup_forget(BDRVQcow2State *s, uint64_t host_offset)
+{
+    Qcow2DedupEntry *e;
+
+    if (!s->dedup_by_offset) {
+        return;
+    }
+
+    e = g_hash_table_lookup(s->dedup_by_offset, &host_offset);
+    if (e) {
+        dedup_remove(s, e);
+    }
+}
+
+/*
+ * Record that the data with digest @hash is being written to the newly
+ * allocated cluster at @host_offset for the guest cluster at @guest_offset.
+ */
+void qcow2_dedup_insert(BDRVQcow2State *s, const uint8_t *hash,
+                        uint64_t host_offset, uint64_t guest_offset)
+{
+    Qcow2DedupEntry *e;
+
+    if (!s->dedup_by_hash) {
+        s->dedup_by_hash = g_hash_table_new_full(dedup_hash_func,
+                                                 dedup_hash_equal,
+                                                 NULL, g_free);
+        s->dedup_by_offset = g_hash_table_new(g_int64_hash, g_int64_equal);
+    }
+
+    qcow2_dedup_forget(s, host_offset);
+    e = g_hash_table_lookup(s->dedup_by_hash, hash);
+    if (e) {
+        /* Prefer the most recently written copy */
+        dedup_remove(s, e);
+    } else if (g_hash_table_size(s->dedup_by_hash) >=
+               QCOW2_DEDUP_MAX_ENTRIES) {
+        return;
+    }
+
+    e = g_new(Qcow2DedupEntry, 1);
+    memcpy(e->hash, hash, QCOW2_DEDUP_HASH_SIZE);
+    e->host_offset = host_offset;
+    e->guest_offset = guest_offset;
+    g_hash_table_insert(s->dedup_by_hash, e->hash, e);
+    g_hash_table_insert(s->dedup_by_offset, &e->host_offset, e);
+}
+
+/*
+ * Compute the digest of the cluster sized part of @qiov at @qiov_offset
+ * into @hash, which must be QCOW2_DEDUP_HASH_SIZE bytes long.
+ *
+ * Returns 0 on success, -errno on failure.
+ */
+int qcow2_dedup_hash(BDRVQcow2State *s, QEMUIOVector *qiov,
+                     size_t qiov_offset, uint8_t *hash)
+{
+    QEMUIOVector local_qiov;
+    size_t len = QCOW2_DEDUP_HASH_SIZE;
+    int ret;
+
+    qemu_iovec_init_slice(&local_qiov, qiov, qiov_offset, s->cluster_size);
+    ret = qcrypto_hash_bytesv(QCRYPTO_HASH_ALG_SHA256, local_qiov.iov,
+                              local_qiov.niov, &hash, &len, NULL);
+    qemu_iovec_destroy(&local_qiov);
+
+    return ret < 0 ? -EIO : 0;
+}
+
+static bool dedup_alloc_in_flight(BDRVQcow2State *s, uint64_t offset)
+{
+    QCowL2Meta *m;
+
+    QLIST_FOREACH(m, &s->cluster_allocs, next_in_flight) {
+        uint64_t end = m->offset +
+                       ((uint64_t)m->nb_clusters << s->cluster_bits);
+
+        if (offset < end && m->offset < offset + s->cluster_size) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+dedup_compare(BlockDriverState *bs, uint64_t host_offset,
+              QEMUIOVector *qiov, size_t qiov_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint8_t *buf;
+    int ret;
+
+    buf = qemu_try_blockalign(bs->file->bs, 2 * s->cluster_size);
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    BLKDBG_CO_EVENT(bs->file, BLKDBG_READ_AIO);
+    ret = bdrv_co_pread(bs->file, host_offset, s->cluster_size, buf, 0);
+    if (ret < 0) {
+        goto out;
+    }
+
+    qemu_iovec_to_buf(qiov, qiov_offset, buf + s->cluster_size,
+                      s->cluster_size);
+    ret = memcmp(buf, buf + s->cluster_size, s->cluster_size) == 0;
+
+out:
+    qemu_vfree(buf);
+    return ret;
+}
+
+/*
+ * Try to satisfy the write of the full, cluster aligned guest cluster at
+ * @offset, whose data is at @qiov_offset in @qiov and has the digest
+ * @hash, by sharing an identical existing data cluster.
+ *
+ * Called with s->lock held.
+ *
+ * Returns 1 if the cluster was deduplicated, 0 if the data has to be
+ * written normally, and -errno on failure.
+ */
+int coroutine_fn GRAPH_RDLOCK
+qcow2_dedup_write(BlockDriverState *bs, uint64_t offset, const uint8_t *hash,
+                  QEMUIOVector *qiov, size_t qiov_offset)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2DedupEntry *e;
+    QCow2SubclusterType type;
+    unsigned int bytes = s->cluster_size;
+    uint64_t host_offset, refcount;
+    int64_t copied_offset = -1;
+    int ret;
+
+    s->dedup_written_clusters++;
+
+    e = s->dedup_by_hash ? g_hash_table_lookup(s->dedup_by_hash, hash) : NULL;
+    if (!e) {
+        return 0;
+    }
+
+    /*
+     * Only take over guest clusters that do not reference a data cluster
+     * yet and that no other request is allocating right now.
+     */
+    ret = qcow2_get_host_offset(bs, offset, &bytes, &host_offset, &type);
+    if (ret < 0) {
+        return ret;
+    }
+    if ((type != QCOW2_SUBCLUSTER_UNALLOCATED_PLAIN &&
+         type != QCOW2_SUBCLUSTER_ZERO_PLAIN) ||
+        dedup_alloc_in_flight(s, offset))
+    {
+        return 0;
+    }
+
+    ret = qcow2_get_refcount(bs, e->host_offset >> s->cluster_bits,
+                             &refcount);
+    if (ret < 0) {
+        return ret;
+    }
+    if (refcount == 0) {
+        /* Cannot happen as long as qcow2_dedup_forget() is called */
+        dedup_remove(s, e);
+        return 0;
+    }
+    if (refcount >= s->refcount_max) {
+        return 0;
+    }
+
+    if (refcount == 1) {
+        /*
+         * The only reference must be the L2 entry the cluster was written
+         * for, which then still has QCOW_OFLAG_COPIED and may be written in
+         * place.  Sharing the cluster is only safe if no such write is in
+         * flight; clearing the flag keeps new ones from starting.
+         */
+        bytes = s->cluster_size;
+        ret = qcow2_get_host_offset(bs, e->guest_offset, &bytes,
+                                    &host_offset, &type);
+        if (ret < 0) {
+            return ret;
+        }
+        if (type != QCOW2_SUBCLUSTER_NORMAL ||
+            host_offset != e->host_offset ||
+            s->dedup_inplace_writes > 0)
+        {
+            return 0;
+        }
+        copied_offset = e->guest_offset;
+    }
+
+    ret = dedup_compare(bs, e->host_offset, qiov, qiov_offset);
+    if (ret <= 0) {
+        if (ret == 0) {
+            /* Overwritten in place since it was indexed */
+            dedup_remove(s, e);
+        }
+        return ret;
+    }
+
+    ret = qcow2_update_cluster_refcount(bs, e->host_offset >> s->cluster_bits,
+                                        1, false, QCOW2_DISCARD_NEVER);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ret = qcow2_link_shared_cluster(bs, offset, e->host_offset,
+                                    copied_offset);
+    if (ret < 0) {
+        qcow2_update_cluster_refcount(bs, e->host_offset >> s->cluster_bits,
+                                      1, true, QCOW2_DISCARD_NEVER);
+        return ret;
+    }
+
+    trace_qcow2_dedup_hit(qemu_coroutine_self(), offset, e->host_offset,
+                          refcount + 1);
+    s->dedup_hits++;
+    return 1;
+}
+
+Qcow2DedupStats *qcow2_dedup_get_stats(BDRVQcow2State *s)
+{
+    Qcow2DedupStats *stats = g_new0(Qcow2DedupStats, 1);
+
+    stats->indexed_clusters =
+        s->dedup_by_hash ? g_hash_table_size(s->dedup_by_hash) : 0;
+    stats->written_clusters = s->dedup_written_clusters;
+    stats->deduplicated_clusters = s->dedup_hits;
+
+    return stats;
+}
@@ -901,6 +901,10 @@ update_refcount(BlockDriverState *bs, int64_t offset, int64_t length,
                 qcow2_cache_discard(s->l2_table_cache, table);
             }
 
+            qcow2_compressed_cache_invalidate(bs, cluster_offset,
+                                              s->cluster_size);
+            qcow2_dedup_forget(s, cluster_offset);
+
             if (s->discard_passthrough[type]) {
                 update_refcount_discard(bs, cluster_offset, s->cluster_size);
             }
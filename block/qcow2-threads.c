@@ -33,7 +33,9 @@
 #include <zstd_errors.h>
 #endif
 
+#include "qemu/units.h"
 #include "qcow2.h"
+#include "block/aio_task.h"
 #include "block/block-io.h"
 #include "block/thread-pool.h"
 #include "crypto.h"
@@ -453,6 +455,57 @@ static int qcow2_encdec_pool_func(void *opaque)
     return data->func(data->block, data->offset, data->buf, data->len, NULL);
 }
 
+/*
+ * Ranges of at least twice this size are split across several threads,
+ * so that a single large request does not have to be encrypted serially.
+ */
+#define QCOW2_ENCDEC_SPLIT_SIZE (64 * KiB)
+
+typedef struct Qcow2EncDecTask {
+    AioTask task;
+    BlockDriverState *bs;
+    Qcow2EncDecData data;
+} Qcow2EncDecTask;
+
+static int coroutine_fn qcow2_encdec_task_entry(AioTask *task)
+{
+    Qcow2EncDecTask *t = container_of(task, Qcow2EncDecTask, task);
+
+    return qcow2_co_process(t->bs, qcow2_encdec_pool_func, &t->data);
+}
+
+static int coroutine_fn
+qcow2_co_encdec_split(BlockDriverState *bs, Qcow2EncDecData *arg,
+                      uint64_t sector_size)
+{
+    AioTaskPool *pool = aio_task_pool_new(QCOW2_MAX_THREADS);
+    size_t chunk, done;
+    int ret;
+
+    chunk = QEMU_ALIGN_UP(DIV_ROUND_UP(arg->len, QCOW2_MAX_THREADS),
+                          sector_size);
+    chunk = MAX(chunk, QCOW2_ENCDEC_SPLIT_SIZE);
+    for (done = 0; done < arg->len && aio_task_pool_status(pool) == 0;
+         done += chunk) {
+        Qcow2EncDecTask *t = g_new(Qcow2EncDecTask, 1);
+
+        *t = (Qcow2EncDecTask) {
+            .task.func = qcow2_encdec_task_entry,
+            .bs = bs,
+            .data = *arg,
+        };
+        t->data.offset += done;
+        t->data.buf += done;
+        t->data.len = MIN(chunk, arg->len - done);
+        aio_task_pool_start_task(pool, &t->task);
+    }
+    aio_task_pool_wait_all(pool);
+    ret = aio_task_pool_status(pool);
+    aio_task_pool_free(pool);
+
+    return ret;
+}
+
 static int coroutine_fn
 qcow2_co_encdec(BlockDriverState *bs, uint64_t host_offset,
                 uint64_t guest_offset, void *buf, size_t len,
@@ -475,7 +528,13 @@ qcow2_co_encdec(BlockDriverState *bs, uint64_t host_offset,
     assert(QEMU_IS_ALIGNED(host_offset, sector_size));
     assert(QEMU_IS_ALIGNED(len, sector_size));
 
-    return len == 0 ? 0 : qcow2_co_process(bs, qcow2_encdec_pool_func, &arg);
+    if (len == 0) {
+        return 0;
+    }
+    if (len >= 2 * QCOW2_ENCDEC_SPLIT_SIZE) {
+        return qcow2_co_encdec_split(bs, &arg, sector_size);
+    }
+    return qcow2_co_process(bs, qcow2_encdec_pool_func, &arg);
 }
 
 /*
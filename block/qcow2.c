@@ -42,6 +42,7 @@
 #include "qapi/qobject-input-visitor.h"
 #include "qapi/qapi-visit-block-core.h"
 #include "crypto.h"
+#include "crypto/hash.h"
 #include "block/aio_task.h"
 #include "block/dirty-bitmap.h"
 
@@ -734,6 +735,12 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_BOOL,
             .help = "Do not unreference discarded clusters",
         },
+        {
+            .name = QCOW2_OPT_DEDUP,
+            .type = QEMU_OPT_BOOL,
+            .help = "Share identical data clusters written by full-cluster "
+                    "writes",
+        },
         {
             .name = QCOW2_OPT_OVERLAP,
             .type = QEMU_OPT_STRING,
@@ -978,6 +985,7 @@ typedef struct Qcow2ReopenState {
     int overlap_check;
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     bool discard_no_unref;
+    bool dedup;
     uint64_t cache_clean_interval;
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
@@ -1157,6 +1165,21 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    r->dedup = qemu_opt_get_bool(opts, QCOW2_OPT_DEDUP, false);
+    if (r->dedup && (s->crypt_method_header != QCOW_CRYPT_NONE ||
+                     (s->incompatible_features & QCOW2_INCOMPAT_DATA_FILE) ||
+                     has_subclusters(s))) {
+        error_setg(errp, "dedup is not supported with encryption, external "
+                   "data files or extended L2 entries");
+        ret = -EINVAL;
+        goto fail;
+    }
+    if (r->dedup && !qcrypto_hash_supports(QCRYPTO_HASH_ALG_SHA256)) {
+        error_setg(errp, "dedup requires SHA-256 support");
+        ret = -ENOTSUP;
+        goto fail;
+    }
+
     switch (s->crypt_method_header) {
     case QCOW_CRYPT_NONE:
         if (encryptfmt) {
@@ -1239,6 +1262,11 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
 
     s->discard_no_unref = r->discard_no_unref;
 
+    if (!r->dedup) {
+        qcow2_dedup_reset(s);
+    }
+    s->dedup = r->dedup;
+
     if (s->cache_clean_interval != r->cache_clean_interval) {
         cache_clean_timer_del(bs);
         s->cache_clean_interval = r->cache_clean_interval;
@@ -1874,6 +1902,7 @@ qcow2_do_open(BlockDriverState *bs, QDict *options, int flags,
 #endif
 
     qemu_co_queue_init(&s->thread_task_queue);
+    qemu_co_queue_init(&s->compressed_cache_queue);
 
     return ret;
 
@@ -2584,6 +2613,7 @@ int qcow2_co_pwritev_task(BlockDriverState *bs, uint64_t host_offset,
     BDRVQcow2State *s = bs->opaque;
     void *crypt_buf = NULL;
     QEMUIOVector encrypted_qiov;
+    bool dedup_inplace = qcow2_dedup_inplace_write(s, l2meta);
 
     if (bs->encrypted) {
         assert(s->crypto);
@@ -2637,6 +2667,9 @@ out_unlocked:
 
 out_locked:
     qcow2_handle_l2meta(bs, &l2meta, false);
+    if (dedup_inplace) {
+        s->dedup_inplace_writes--;
+    }
     qemu_co_mutex_unlock(&s->lock);
 
     qemu_vfree(crypt_buf);
@@ -2671,6 +2704,8 @@ qcow2_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
     uint64_t host_offset;
     QCowL2Meta *l2meta = NULL;
     AioTaskPool *aio = NULL;
+    uint8_t dedup_hash[QCOW2_DEDUP_HASH_SIZE];
+    bool dedup;
 
     trace_qcow2_writev_start_req(qemu_coroutine_self(), offset, bytes);
 
@@ -2687,8 +2722,33 @@ qcow2_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
                             - offset_in_cluster);
         }
 
+        /*
+         * With dedup, full clusters are handled one at a time so that each
+         * of them can be looked up in the index.
+         */
+        dedup = s->dedup && offset_in_cluster == 0 &&
+                cur_bytes >= s->cluster_size;
+        if (dedup) {
+            cur_bytes = s->cluster_size;
+            ret = qcow2_dedup_hash(s, qiov, qiov_offset, dedup_hash);
+            if (ret < 0) {
+                goto fail_nometa;
+            }
+        }
+
         qemu_co_mutex_lock(&s->lock);
 
+        if (dedup) {
+            ret = qcow2_dedup_write(bs, offset, dedup_hash, qiov, qiov_offset);
+            if (ret < 0) {
+                goto out_locked;
+            }
+            if (ret > 0) {
+                qemu_co_mutex_unlock(&s->lock);
+                goto next;
+            }
+        }
+
         ret = qcow2_alloc_host_offset(bs, offset, &cur_bytes,
                                       &host_offset, &l2meta);
         if (ret < 0) {
@@ -2701,6 +2761,13 @@ qcow2_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
             goto out_locked;
         }
 
+        if (dedup && l2meta && !l2meta->keep_old_clusters) {
+            qcow2_dedup_insert(s, dedup_hash, host_offset, offset);
+        }
+        if (qcow2_dedup_inplace_write(s, l2meta)) {
+            s->dedup_inplace_writes++;
+        }
+
         qemu_co_mutex_unlock(&s->lock);
 
         if (!aio && cur_bytes != bytes) {
@@ -2714,6 +2781,7 @@ qcow2_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
             goto fail_nometa;
         }
 
+next:
         bytes -= cur_bytes;
         offset += cur_bytes;
         qiov_offset += cur_bytes;
@@ -2781,6 +2849,8 @@ static void coroutine_mixed_fn GRAPH_RDLOCK
 qcow2_do_close(BlockDriverState *bs, bool close_data_file)
 {
     BDRVQcow2State *s = bs->opaque;
+    int i;
+
     qemu_vfree(s->l1_table);
     /* else pre-write overlap checks in cache_destroy may crash */
     s->l1_table = NULL;
@@ -2793,10 +2863,18 @@ qcow2_do_close(BlockDriverState *bs, bool close_data_file)
     qcow2_cache_destroy(s->l2_table_cache);
     qcow2_cache_destroy(s->refcount_block_cache);
 
+    for (i = 0; i < QCOW2_COMPRESSED_CACHE_SIZE; i++) {
+        assert(!s->compressed_cache[i].pending);
+        qemu_vfree(s->compressed_cache[i].data);
+        s->compressed_cache[i].data = NULL;
+    }
+
     qcrypto_block_free(s->crypto);
     s->crypto = NULL;
     qapi_free_QCryptoBlockOpenOptions(s->crypto_opts);
 
+    qcow2_dedup_reset(s);
+
     g_free(s->unknown_header_fields);
     cleanup_unknown_header_ext(bs);
 
@@ -4223,6 +4301,7 @@ qcow2_co_copy_range_to(BlockDriverState *bs,
     unsigned int cur_bytes; /* number of sectors in current iteration */
     uint64_t host_offset;
     QCowL2Meta *l2meta = NULL;
+    bool dedup_inplace;
 
     assert(!bs->encrypted);
 
@@ -4250,10 +4329,18 @@ qcow2_co_copy_range_to(BlockDriverState *bs,
             goto fail;
         }
 
+        dedup_inplace = qcow2_dedup_inplace_write(s, l2meta);
+        if (dedup_inplace) {
+            s->dedup_inplace_writes++;
+        }
+
         qemu_co_mutex_unlock(&s->lock);
         ret = bdrv_co_copy_range_to(src, src_offset, s->data_file, host_offset,
                                     cur_bytes, read_flags, write_flags);
         qemu_co_mutex_lock(&s->lock);
+        if (dedup_inplace) {
+            s->dedup_inplace_writes--;
+        }
         if (ret < 0) {
             goto fail;
         }
@@ -4802,6 +4889,255 @@ qcow2_co_pwritev_compressed_part(BlockDriverState *bs,
     return ret;
 }
 
+/*
+ * Read the compressed cluster at @coffset and decompress it into @out_buf,
+ * which must be cluster_size bytes large.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+qcow2_co_read_compressed(BlockDriverState *bs, uint64_t coffset, int csize,
+                         uint8_t *out_buf)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint8_t *buf;
+    int ret;
+
+    buf = g_try_malloc(csize);
+    if (!buf) {
+        return -ENOMEM;
+    }
+
+    BLKDBG_CO_EVENT(bs->file, BLKDBG_READ_COMPRESSED);
+    ret = bdrv_co_pread(bs->file, coffset, csize, buf, 0);
+    if (ret < 0) {
+        goto fail;
+    }
+
+    if (qcow2_co_decompress(bs, out_buf, s->cluster_size, buf, csize) < 0) {
+        ret = -EIO;
+        goto fail;
+    }
+
+fail:
+    g_free(buf);
+    return ret;
+}
+
+/*
+ * Decompressed cluster cache
+ *
+ * A small number of decompressed clusters is kept, indexed by the host
+ * offset of their compressed data.  Host offsets of compressed clusters
+ * stay valid for as long as the cluster is referenced, so entries only
+ * need to be dropped when the data is freed (which update_refcount()
+ * reports through qcow2_compressed_cache_invalidate()).  An entry is
+ * pending while its cluster is being read and decompressed; other
+ * readers of the same cluster wait for it instead of decompressing the
+ * cluster again.
+ *
+ * All of this is protected by s->lock.
+ */
+
+static Qcow2CompressedCacheEntry *
+qcow2_compressed_cache_lookup(BDRVQcow2State *s, uint64_t coffset)
+{
+    int i;
+
+    for (i = 0; i < QCOW2_COMPRESSED_CACHE_SIZE; i++) {
+        if (s->compressed_cache[i].coffset == coffset) {
+            return &s->compressed_cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Take over the least recently used entry that is not pending for the
+ * compressed cluster at @coffset and mark it pending.  Returns NULL if
+ * there is no such entry.
+ */
+static Qcow2CompressedCacheEntry *
+qcow2_compressed_cache_claim(BlockDriverState *bs, uint64_t coffset,
+                             int csize)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2CompressedCacheEntry *e = NULL;
+    int i;
+
+    for (i = 0; i < QCOW2_COMPRESSED_CACHE_SIZE; i++) {
+        Qcow2CompressedCacheEntry *cur = &s->compressed_cache[i];
+
+        if (!cur->pending && (!e || cur->lru_counter < e->lru_counter)) {
+            e = cur;
+        }
+    }
+
+    if (!e) {
+        return NULL;
+    }
+
+    if (!e->data) {
+        e->data = qemu_try_blockalign(bs->file->bs, s->cluster_size);
+        if (!e->data) {
+            return NULL;
+        }
+    }
+
+    e->coffset = coffset;
+    e->csize = csize;
+    e->pending = true;
+    e->lru_counter = ++s->compressed_cache_lru_counter;
+
+    return e;
+}
+
+static void coroutine_fn
+qcow2_compressed_cache_complete(BDRVQcow2State *s,
+                                Qcow2CompressedCacheEntry *e, int ret)
+{
+    e->pending = false;
+    if (ret < 0) {
+        e->coffset = 0;
+        e->lru_counter = 0;
+    }
+    qemu_co_queue_restart_all(&s->compressed_cache_queue);
+}
+
+void qcow2_compressed_cache_invalidate(BlockDriverState *bs, uint64_t offset,
+                                       uint64_t length)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int i;
+
+    for (i = 0; i < QCOW2_COMPRESSED_CACHE_SIZE; i++) {
+        Qcow2CompressedCacheEntry *e = &s->compressed_cache[i];
+
+        if (e->coffset && e->coffset < offset + length &&
+            offset < e->coffset + e->csize)
+        {
+            /* A pending entry stays claimed until its read completes */
+            e->coffset = 0;
+            e->lru_counter = 0;
+        }
+    }
+}
+
+typedef struct Qcow2ReadaheadTask {
+    AioTask task;
+
+    BlockDriverState *bs;
+    Qcow2CompressedCacheEntry *entry;
+    uint64_t coffset;
+    int csize;
+} Qcow2ReadaheadTask;
+
+/*
+ * This function can count as GRAPH_RDLOCK because
+ * qcow2_compressed_readahead_co() holds the graph lock and keeps it until
+ * all of its tasks have terminated.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+qcow2_compressed_readahead_task_entry(AioTask *task)
+{
+    Qcow2ReadaheadTask *t = container_of(task, Qcow2ReadaheadTask, task);
+    BDRVQcow2State *s = t->bs->opaque;
+    int ret;
+
+    ret = qcow2_co_read_compressed(t->bs, t->coffset, t->csize,
+                                   t->entry->data);
+
+    qemu_co_mutex_lock(&s->lock);
+    qcow2_compressed_cache_complete(s, t->entry, ret);
+    qemu_co_mutex_unlock(&s->lock);
+
+    /* Errors are reported to the reader that actually needs the data */
+    return 0;
+}
+
+typedef struct Qcow2ReadaheadCo {
+    BlockDriverState *bs;
+    uint64_t cluster;
+} Qcow2ReadaheadCo;
+
+/*
+ * Decompress up to QCOW2_COMPRESSED_READAHEAD compressed clusters
+ * starting at guest cluster index @cluster into the cache, in parallel.
+ * Stops at the first cluster that is not compressed.
+ */
+static void coroutine_fn qcow2_compressed_readahead_co(void *opaque)
+{
+    Qcow2ReadaheadCo *ra = opaque;
+    BlockDriverState *bs = ra->bs;
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2ReadaheadTask *tasks[QCOW2_COMPRESSED_READAHEAD];
+    AioTaskPool *aio;
+    int n = 0;
+    int i;
+
+    bdrv_graph_co_rdlock();
+    qemu_co_mutex_lock(&s->lock);
+
+    for (i = 0; i < QCOW2_COMPRESSED_READAHEAD; i++) {
+        uint64_t offset = (ra->cluster + i) << s->cluster_bits;
+        unsigned int bytes = s->cluster_size;
+        QCow2SubclusterType type;
+        Qcow2CompressedCacheEntry *e;
+        uint64_t l2_entry, coffset;
+        int csize, ret;
+
+        if (offset >= bs->total_sectors * BDRV_SECTOR_SIZE) {
+            break;
+        }
+
+        ret = qcow2_get_host_offset(bs, offset, &bytes, &l2_entry, &type);
+        if (ret < 0 || type != QCOW2_SUBCLUSTER_COMPRESSED) {
+            break;
+        }
+
+        qcow2_parse_compressed_l2_entry(bs, l2_entry, &coffset, &csize);
+        if (qcow2_compressed_cache_lookup(s, coffset)) {
+            continue;
+        }
+
+        e = qcow2_compressed_cache_claim(bs, coffset, csize);
+        if (!e) {
+            break;
+        }
+
+        tasks[n] = g_new(Qcow2ReadaheadTask, 1);
+        *tasks[n] = (Qcow2ReadaheadTask) {
+            .task.func = qcow2_compressed_readahead_task_entry,
+            .bs = bs,
+            .entry = e,
+            .coffset = coffset,
+            .csize = csize,
+        };
+        n++;
+    }
+
+    qemu_co_mutex_unlock(&s->lock);
+
+    trace_qcow2_compressed_readahead(qemu_coroutine_self(), bs,
+                                     ra->cluster, n);
+
+    if (n) {
+        aio = aio_task_pool_new(QCOW2_COMPRESSED_READAHEAD);
+        for (i = 0; i < n; i++) {
+            aio_task_pool_start_task(aio, &tasks[i]->task);
+        }
+        aio_task_pool_wait_all(aio);
+        g_free(aio);
+    }
+
+    qemu_co_mutex_lock(&s->lock);
+    s->compressed_readahead = false;
+    qemu_co_mutex_unlock(&s->lock);
+
+    bdrv_graph_co_rdunlock();
+    bdrv_dec_in_flight(bs);
+    g_free(ra);
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 qcow2_co_preadv_compressed(BlockDriverState *bs,
                            uint64_t l2_entry,
@@ -4813,34 +5149,73 @@ qcow2_co_preadv_compressed(BlockDriverState *bs,
     BDRVQcow2State *s = bs->opaque;
     int ret = 0, csize;
     uint64_t coffset;
-    uint8_t *buf, *out_buf;
+    uint64_t cluster = offset >> s->cluster_bits;
+    uint8_t *out_buf;
     int offset_in_cluster = offset_into_cluster(s, offset);
+    Qcow2CompressedCacheEntry *e;
+    bool readahead;
 
     qcow2_parse_compressed_l2_entry(bs, l2_entry, &coffset, &csize);
 
-    buf = g_try_malloc(csize);
-    if (!buf) {
-        return -ENOMEM;
+    qemu_co_mutex_lock(&s->lock);
+
+    while ((e = qcow2_compressed_cache_lookup(s, coffset)) && e->pending) {
+        qemu_co_queue_wait(&s->compressed_cache_queue, &s->lock);
     }
 
-    out_buf = qemu_blockalign(bs, s->cluster_size);
+    if (e) {
+        e->lru_counter = ++s->compressed_cache_lru_counter;
+    } else {
+        e = qcow2_compressed_cache_claim(bs, coffset, csize);
+        if (e) {
+            qemu_co_mutex_unlock(&s->lock);
+            ret = qcow2_co_read_compressed(bs, coffset, csize, e->data);
+            qemu_co_mutex_lock(&s->lock);
+            qcow2_compressed_cache_complete(s, e, ret);
+        }
+    }
 
-    BLKDBG_CO_EVENT(bs->file, BLKDBG_READ_COMPRESSED);
-    ret = bdrv_co_pread(bs->file, coffset, csize, buf, 0);
-    if (ret < 0) {
-        goto fail;
+    if (e && ret == 0) {
+        qemu_iovec_from_buf(qiov, qiov_offset, e->data + offset_in_cluster,
+                            bytes);
     }
 
-    if (qcow2_co_decompress(bs, out_buf, s->cluster_size, buf, csize) < 0) {
-        ret = -EIO;
-        goto fail;
+    /*
+     * Once the guest reads the clusters of a compressed image in
+     * order, decompress the next ones in the background
+     */
+    readahead = ret == 0 && !s->compressed_readahead &&
+                cluster == s->compressed_last_cluster + 1;
+    if (readahead) {
+        s->compressed_readahead = true;
     }
+    s->compressed_last_cluster = cluster;
 
-    qemu_iovec_from_buf(qiov, qiov_offset, out_buf + offset_in_cluster, bytes);
+    qemu_co_mutex_unlock(&s->lock);
 
-fail:
-    qemu_vfree(out_buf);
-    g_free(buf);
+    if (!e) {
+        /* All cache entries are pending, do without */
+        out_buf = qemu_blockalign(bs, s->cluster_size);
+        ret = qcow2_co_read_compressed(bs, coffset, csize, out_buf);
+        if (ret == 0) {
+            qemu_iovec_from_buf(qiov, qiov_offset,
+                                out_buf + offset_in_cluster, bytes);
+        }
+        qemu_vfree(out_buf);
+    }
+
+    if (readahead) {
+        Qcow2ReadaheadCo *ra = g_new(Qcow2ReadaheadCo, 1);
+
+        *ra = (Qcow2ReadaheadCo) {
+            .bs = bs,
+            .cluster = cluster + 1,
+        };
+        bdrv_inc_in_flight(bs);
+        aio_co_enter(bdrv_get_aio_context(bs),
+                     qemu_coroutine_create(qcow2_compressed_readahead_co,
+                                           ra));
+    }
 
     return ret;
 }
@@ -4869,6 +5244,9 @@ static int GRAPH_RDLOCK make_completely_empty(BlockDriverState *bs)
         goto fail;
     }
 
+    /* All clusters are freed without going through update_refcount() */
+    qcow2_compressed_cache_invalidate(bs, 0, INT64_MAX);
+
     /* Refcounts will be broken utterly */
     ret = qcow2_mark_dirty(bs);
     if (ret < 0) {
@@ -5311,6 +5689,29 @@ qcow2_get_specific_info(BlockDriverState *bs, Error **errp)
     return spec_info;
 }
 
+static BlockStatsSpecific *qcow2_get_specific_stats(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    BlockStatsSpecific *stats;
+
+    if (!s->l2_table_cache || !s->refcount_block_cache) {
+        return NULL;
+    }
+
+    stats = g_new0(BlockStatsSpecific, 1);
+    stats->driver = BLOCKDEV_DRIVER_QCOW2;
+    stats->u.qcow2.l2_cache = g_new0(Qcow2CacheStats, 1);
+    stats->u.qcow2.refcount_cache = g_new0(Qcow2CacheStats, 1);
+    qcow2_cache_get_stats(s->l2_table_cache, stats->u.qcow2.l2_cache);
+    qcow2_cache_get_stats(s->refcount_block_cache,
+                          stats->u.qcow2.refcount_cache);
+    if (s->dedup) {
+        stats->u.qcow2.dedup = qcow2_dedup_get_stats(s);
+    }
+
+    return stats;
+}
+
 static int coroutine_mixed_fn GRAPH_RDLOCK
 qcow2_has_zero_init(BlockDriverState *bs)
 {
@@ -6160,6 +6561,7 @@ BlockDriver bdrv_qcow2 = {
     .bdrv_measure                       = qcow2_measure,
     .bdrv_co_get_info                   = qcow2_co_get_info,
     .bdrv_get_specific_info             = qcow2_get_specific_info,
+    .bdrv_get_specific_stats            = qcow2_get_specific_stats,
 
     .bdrv_co_save_vmstate               = qcow2_co_save_vmstate,
     .bdrv_co_load_vmstate               = qcow2_co_load_vmstate,
@@ -128,12 +128,18 @@
 
 #define DEFAULT_CLUSTER_SIZE 65536
 
+/* Size of the SHA-256 digest used to index clusters for deduplication */
+#define QCOW2_DEDUP_HASH_SIZE 32
+/* Maximum number of clusters tracked by the deduplication index */
+#define QCOW2_DEDUP_MAX_ENTRIES (256 * 1024)
+
 #define QCOW2_OPT_DATA_FILE "data-file"
 #define QCOW2_OPT_LAZY_REFCOUNTS "lazy-refcounts"
 #define QCOW2_OPT_DISCARD_REQUEST "pass-discard-request"
 #define QCOW2_OPT_DISCARD_SNAPSHOT "pass-discard-snapshot"
 #define QCOW2_OPT_DISCARD_OTHER "pass-discard-other"
 #define QCOW2_OPT_DISCARD_NO_UNREF "discard-no-unref"
+#define QCOW2_OPT_DEDUP "dedup"
 #define QCOW2_OPT_OVERLAP "overlap-check"
 #define QCOW2_OPT_OVERLAP_TEMPLATE "overlap-check.template"
 #define QCOW2_OPT_OVERLAP_MAIN_HEADER "overlap-check.main-header"
@@ -324,6 +330,21 @@ typedef struct Qcow2BitmapHeaderExt {
 
 #define QCOW2_MAX_THREADS 4
 
+/*
+ * Number of decompressed clusters that are kept around, and number of
+ * clusters that are decompressed ahead of a sequential reader
+ */
+#define QCOW2_COMPRESSED_CACHE_SIZE 8
+#define QCOW2_COMPRESSED_READAHEAD  4
+
+typedef struct Qcow2CompressedCacheEntry {
+    uint64_t coffset;       /* host offset of the compressed data, 0 = free */
+    int csize;
+    bool pending;           /* still being read and decompressed */
+    uint64_t lru_counter;
+    uint8_t *data;          /* the decompressed cluster */
+} Qcow2CompressedCacheEntry;
+
 typedef struct BDRVQcow2State {
     int cluster_bits;
     int cluster_size;
@@ -388,6 +409,17 @@ typedef struct BDRVQcow2State {
 
     bool discard_no_unref;
 
+    /*
+     * In-memory content index of data clusters for the dedup option, see
+     * qcow2-dedup.c.  Protected by lock.
+     */
+    bool dedup;
+    GHashTable *dedup_by_hash;
+    GHashTable *dedup_by_offset;
+    int dedup_inplace_writes;
+    uint64_t dedup_written_clusters;
+    uint64_t dedup_hits;
+
     int overlap_check; /* bitmask of Qcow2MetadataOverlap values */
     bool signaled_corruption;
 
@@ -411,6 +443,16 @@ typedef struct BDRVQcow2State {
     CoQueue thread_task_queue;
     int nb_threads;
 
+    /*
+     * Recently decompressed clusters and readahead state, see
+     * qcow2_co_preadv_compressed().  Protected by lock.
+     */
+    Qcow2CompressedCacheEntry compressed_cache[QCOW2_COMPRESSED_CACHE_SIZE];
+    uint64_t compressed_cache_lru_counter;
+    CoQueue compressed_cache_queue;
+    uint64_t compressed_last_cluster;
+    bool compressed_readahead;
+
     BdrvChild *data_file;
 
     bool metadata_preallocation_checked;
@@ -502,6 +544,18 @@ typedef struct QCowL2Meta
     QLIST_ENTRY(QCowL2Meta) next_in_flight;
 } QCowL2Meta;
 
+/*
+ * Returns true if a data write with the given @l2meta (as returned by
+ * qcow2_alloc_host_offset()) modifies a cluster that may already be in
+ * the deduplication index, and must therefore be counted in
+ * dedup_inplace_writes while it is in flight.
+ */
+static inline bool qcow2_dedup_inplace_write(BDRVQcow2State *s,
+                                             QCowL2Meta *l2meta)
+{
+    return s->dedup && (!l2meta || l2meta->keep_old_clusters);
+}
+
 /*
  * In images with standard L2 entries all clusters are treated as if
  * they had one subcluster so QCow2ClusterType and QCow2SubclusterType
@@ -848,6 +902,9 @@ int qcow2_validate_table(BlockDriverState *bs, uint64_t offset,
                          int64_t max_size_bytes, const char *table_name,
                          Error **errp);
 
+void qcow2_compressed_cache_invalidate(BlockDriverState *bs, uint64_t offset,
+                                       uint64_t length);
+
 /* qcow2-refcount.c functions */
 int coroutine_fn GRAPH_RDLOCK qcow2_refcount_init(BlockDriverState *bs);
 void qcow2_refcount_close(BlockDriverState *bs);
@@ -932,6 +989,10 @@ qcow2_get_host_offset(BlockDriverState *bs, uint64_t offset,
                       unsigned int *bytes, uint64_t *host_offset,
                       QCow2SubclusterType *subcluster_type);
 
+int coroutine_fn GRAPH_RDLOCK
+qcow2_link_shared_cluster(BlockDriverState *bs, uint64_t guest_offset,
+                          uint64_t host_offset, int64_t copied_offset);
+
 int coroutine_fn GRAPH_RDLOCK
 qcow2_alloc_host_offset(BlockDriverState *bs, uint64_t offset,
                         unsigned int *bytes, uint64_t *host_offset,
@@ -1021,6 +1082,19 @@ qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 void qcow2_cache_put(Qcow2Cache *c, void **table);
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset);
 void qcow2_cache_discard(Qcow2Cache *c, void *table);
+void qcow2_cache_get_stats(Qcow2Cache *c, Qcow2CacheStats *stats);
+
+/* qcow2-dedup.c functions */
+void qcow2_dedup_reset(BDRVQcow2State *s);
+void qcow2_dedup_forget(BDRVQcow2State *s, uint64_t host_offset);
+void qcow2_dedup_insert(BDRVQcow2State *s, const uint8_t *hash,
+                        uint64_t host_offset, uint64_t guest_offset);
+int qcow2_dedup_hash(BDRVQcow2State *s, QEMUIOVector *qiov,
+                     size_t qiov_offset, uint8_t *hash);
+int coroutine_fn GRAPH_RDLOCK
+qcow2_dedup_write(BlockDriverState *bs, uint64_t offset, const uint8_t *hash,
+                  QEMUIOVector *qiov, size_t qiov_offset);
+Qcow2DedupStats *qcow2_dedup_get_stats(BDRVQcow2State *s);
 
 /* qcow2-bitmap.c functions */
 int coroutine_fn GRAPH_RDLOCK
@@ -23,6 +23,7 @@
 #include "block/qdict.h"
 #include "crypto/secret.h"
 #include "qemu/cutils.h"
+#include "qemu/event_notifier.h"
 #include "sysemu/replay.h"
 #include "qapi/qmp/qstring.h"
 #include "qapi/qmp/qdict.h"
@@ -60,6 +61,11 @@
 
 #define RBD_MAX_SNAPS 100
 
+#define RBD_MAX_CONNECTIONS 16
+
+/* Completions fetched per rbd_poll_io_events() call */
+#define RBD_POLL_BATCH 32
+
 #define RBD_ENCRYPTION_LUKS_HEADER_VERIFICATION_LEN 8
 
 static const char rbd_luks_header_verification[
@@ -90,7 +96,21 @@ typedef enum {
     RBD_AIO_WRITE_ZEROES
 } RBDAIOCmd;
 
+/*
+ * One cluster connection with its own handle of the image.  Every cluster
+ * handle has its own messenger threads and OSD sessions, so spreading
+ * requests over several of them lets librbd use more than one core.
+ */
+typedef struct RBDConnection {
+    rados_t cluster;
+    rados_ioctx_t io_ctx;
+    rbd_image_t image;
+    /* Signalled by librbd on completion if eventfd_completion is set */
+    EventNotifier notifier;
+} RBDConnection;
+
 typedef struct BDRVRBDState {
+    /* Primary connection, also used for all metadata operations */
     rados_t cluster;
     rados_ioctx_t io_ctx;
     rbd_image_t image;
@@ -99,6 +119,12 @@ typedef struct BDRVRBDState {
     char *namespace;
     uint64_t image_size;
     uint64_t object_size;
+
+    /* conns[0] refers to the primary connection above */
+    RBDConnection *conns;
+    unsigned int n_conns;
+    unsigned int next_conn;
+    bool eventfd_completion;
 } BDRVRBDState;
 
 typedef struct RBDTask {
@@ -1061,6 +1087,230 @@ static int qemu_rbd_attempt_legacy_options(QDict *options,
     return r;
 }
 
+static int qemu_rbd_load_encryption(rbd_image_t image,
+                                    BlockdevOptionsRbd *opts, Error **errp)
+{
+    int r = 0;
+
+    if (opts->encrypt) {
+#ifdef LIBRBD_SUPPORTS_ENCRYPTION
+        if (opts->encrypt->parent) {
+#ifdef LIBRBD_SUPPORTS_ENCRYPTION_LOAD2
+            r = qemu_rbd_encryption_load2(image, opts->encrypt, errp);
+#else
+            r = -ENOTSUP;
+            error_setg(errp, "RBD library does not support layered encryption");
+#endif
+        } else {
+            r = qemu_rbd_encryption_load(image, opts->encrypt, errp);
+        }
+#else
+        r = -ENOTSUP;
+        error_setg(errp, "RBD library does not support image encryption");
+#endif
+    }
+
+    return r;
+}
+
+static void qemu_rbd_poll_events(EventNotifier *n)
+{
+    RBDConnection *conn = container_of(n, RBDConnection, notifier);
+    rbd_completion_t comps[RBD_POLL_BATCH];
+    int i, r;
+
+    event_notifier_test_and_clear(n);
+
+    do {
+        r = rbd_poll_io_events(conn->image, comps, RBD_POLL_BATCH);
+        for (i = 0; i < r; i++) {
+            RBDTask *task = rbd_aio_get_arg(comps[i]);
+
+            task->ret = rbd_aio_get_return_value(comps[i]);
+            rbd_aio_release(comps[i]);
+            task->complete = true;
+            aio_co_wake(task->co);
+        }
+    } while (r == RBD_POLL_BATCH);
+}
+
+static void qemu_rbd_detach_aio_context(BlockDriverState *bs)
+{
+    BDRVRBDState *s = bs->opaque;
+    unsigned int i;
+
+    if (!s->eventfd_completion) {
+        return;
+    }
+    for (i = 0; i < s->n_conns; i++) {
+        aio_set_event_notifier(bdrv_get_aio_context(bs),
+                               &s->conns[i].notifier, NULL, NULL, NULL);
+    }
+}
+
+static void qemu_rbd_attach_aio_context(BlockDriverState *bs,
+                                        AioContext *new_context)
+{
+    BDRVRBDState *s = bs->opaque;
+    unsigned int i;
+
+    if (!s->eventfd_completion) {
+        return;
+    }
+    for (i = 0; i < s->n_conns; i++) {
+        aio_set_event_notifier(new_context, &s->conns[i].notifier,
+                               qemu_rbd_poll_events, NULL, NULL);
+    }
+}
+
+/* Close all connections except the primary one */
+static void qemu_rbd_close_connections(BDRVRBDState *s)
+{
+    unsigned int i;
+
+    for (i = 0; i < s->n_conns; i++) {
+        RBDConnection *conn = &s->conns[i];
+
+        if (s->eventfd_completion) {
+            event_notifier_cleanup(&conn->notifier);
+        }
+        if (i > 0) {
+            rbd_close(conn->image);
+            rados_ioctx_destroy(conn->io_ctx);
+            rados_shutdown(conn->cluster);
+        }
+    }
+    g_free(s->conns);
+    s->conns = NULL;
+    s->n_conns = 0;
+}
+
+/*
+ * Open the additional cluster connections requested with the
+ * "connections" option, and set up eventfd completion delivery on all of
+ * them if requested.  The primary connection must already be open.
+ */
+static int qemu_rbd_open_connections(BlockDriverState *bs,
+                                     BlockdevOptionsRbd *opts,
+                                     const char *keypairs, int flags,
+                                     Error **errp)
+{
+    BDRVRBDState *s = bs->opaque;
+    unsigned int n = opts->has_connections ? opts->connections : 1;
+    uint64_t features;
+    unsigned int i;
+    int r;
+
+    if (n < 1 || n > RBD_MAX_CONNECTIONS) {
+        error_setg(errp, "connections must be between 1 and %d",
+                   RBD_MAX_CONNECTIONS);
+        return -EINVAL;
+    }
+
+    if (n > 1) {
+        /*
+         * Every handle has its own cache, so a write completed through
+         * one of them would not be visible to reads through the others.
+         */
+        if (!(flags & BDRV_O_NOCACHE)) {
+            error_setg(errp, "connections > 1 requires cache.direct=on");
+            return -EINVAL;
+        }
+
+        /* Writers would keep taking the lock away from each other */
+        r = rbd_get_features(s->image, &features);
+        if (r < 0) {
+            error_setg_errno(errp, -r, "error getting image features");
+            return r;
+        }
+        if ((flags & BDRV_O_RDWR) && (features & RBD_FEATURE_EXCLUSIVE_LOCK)) {
+            error_setg(errp, "connections > 1 cannot be used with writable "
+                       "images that have the exclusive-lock feature");
+            return -EINVAL;
+        }
+    }
+
+    s->eventfd_completion = opts->has_eventfd_completion &&
+                            opts->eventfd_completion;
+#ifndef CONFIG_EVENTFD
+    if (s->eventfd_completion) {
+        error_setg(errp, "eventfd-completion is not supported on this host");
+        s->eventfd_completion = false;
+        return -ENOTSUP;
+    }
+#endif
+
+    s->conns = g_new0(RBDConnection, n);
+    s->conns[0].cluster = s->cluster;
+    s->conns[0].io_ctx = s->io_ctx;
+    s->conns[0].image = s->image;
+
+    for (s->n_conns = 1; s->n_conns < n; s->n_conns++) {
+        RBDConnection *conn = &s->conns[s->n_conns];
+
+        /* The password-secret has been moved to opts->key_secret already */
+        r = qemu_rbd_connect(&conn->cluster, &conn->io_ctx, opts, false,
+                             keypairs, NULL, errp);
+        if (r < 0) {
+            goto fail;
+        }
+
+        r = rbd_open(conn->io_ctx, s->image_name, &conn->image, s->snap);
+        if (r < 0) {
+            error_setg_errno(errp, -r, "error reading header from %s",
+                             s->image_name);
+            goto fail_open;
+        }
+
+        r = qemu_rbd_load_encryption(conn->image, opts, errp);
+        if (r < 0) {
+            rbd_close(conn->image);
+            goto fail_open;
+        }
+    }
+
+    if (s->eventfd_completion) {
+        for (i = 0; i < s->n_conns; i++) {
+            RBDConnection *conn = &s->conns[i];
+
+            r = event_notifier_init(&conn->notifier, 0);
+            if (r < 0) {
+                error_setg_errno(errp, -r, "failed to create eventfd");
+                goto fail_notifiers;
+            }
+            r = rbd_set_image_notification(conn->image,
+                                           event_notifier_get_fd(
+                                               &conn->notifier),
+                                           EVENT_TYPE_EVENTFD);
+            if (r < 0) {
+                error_setg_errno(errp, -r, "error setting image notification");
+                event_notifier_cleanup(&conn->notifier);
+                goto fail_notifiers;
+            }
+        }
+        qemu_rbd_attach_aio_context(bs, bdrv_get_aio_context(bs));
+    }
+
+    return 0;
+
+fail_notifiers:
+    /* Only the notifiers before @i have been set up */
+    while (i-- > 0) {
+        event_notifier_cleanup(&s->conns[i].notifier);
+    }
+    s->eventfd_completion = false;
+    qemu_rbd_close_connections(s);
+    return r;
+
+fail_open:
+    rados_ioctx_destroy(s->conns[s->n_conns].io_ctx);
+    rados_shutdown(s->conns[s->n_conns].cluster);
+fail:
+    s->eventfd_completion = false;
+    qemu_rbd_close_connections(s);
+    return r;
+}
+
 static int qemu_rbd_open(BlockDriverState *bs, QDict *options, int flags,
                          Error **errp)
 {
@@ -1134,26 +1384,9 @@ static int qemu_rbd_open(BlockDriverState *bs, QDict *options, int flags,
         goto failed_open;
     }
 
-    if (opts->encrypt) {
-#ifdef LIBRBD_SUPPORTS_ENCRYPTION
-        if (opts->encrypt->parent) {
-#ifdef LIBRBD_SUPPORTS_ENCRYPTION_LOAD2
-            r = qemu_rbd_encryption_load2(s->image, opts->encrypt, errp);
-#else
-            r = -ENOTSUP;
-            error_setg(errp, "RBD library does not support layered encryption");
-#endif
-        } else {
-            r = qemu_rbd_encryption_load(s->image, opts->encrypt, errp);
-        }
-        if (r < 0) {
-            goto failed_post_open;
-        }
-#else
-        r = -ENOTSUP;
-        error_setg(errp, "RBD library does not support image encryption");
+    r = qemu_rbd_load_encryption(s->image, opts, errp);
+    if (r < 0) {
         goto failed_post_open;
-#endif
     }
 
     r = rbd_stat(s->image, &info, sizeof(info));
@@ -1176,6 +1409,11 @@ static int qemu_rbd_open(BlockDriverState *bs, QDict *options, int flags,
         }
     }
 
+    r = qemu_rbd_open_connections(bs, opts, keypairs, flags, errp);
+    if (r < 0) {
+        goto failed_post_open;
+    }
+
 #ifdef LIBRBD_SUPPORTS_WRITE_ZEROES
     bs->supported_zero_flags = BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK;
 #endif
@@ -1226,6 +1464,8 @@ static void qemu_rbd_close(BlockDriverState *bs)
 {
     BDRVRBDState *s = bs->opaque;
 
+    qemu_rbd_detach_aio_context(bs);
+    qemu_rbd_close_connections(s);
     rbd_close(s->image);
     rados_ioctx_destroy(s->io_ctx);
     g_free(s->snap);
@@ -1264,6 +1504,9 @@ static void qemu_rbd_finish_bh(void *opaque)
  * we need to be careful about what we do here. Generally we only
  * schedule a BH, and do the rest of the io completion handling
  * from qemu_rbd_finish_bh() which runs in a qemu context.
+ *
+ * With eventfd-completion, no callback is registered and completions
+ * are reaped by qemu_rbd_poll_events() instead.
  */
 static void qemu_rbd_completion_cb(rbd_completion_t c, RBDTask *task)
 {
@@ -1273,7 +1516,14 @@ static void qemu_rbd_completion_cb(rbd_completion_t c, RBDTask *task)
                             qemu_rbd_finish_bh, task);
 }
 
+/* Pick the connection for the next request, round-robin */
+static RBDConnection *qemu_rbd_next_conn(BDRVRBDState *s)
+{
+    return &s->conns[qatomic_fetch_inc(&s->next_conn) % s->n_conns];
+}
+
 static int coroutine_fn qemu_rbd_start_co(BlockDriverState *bs,
+                                          RBDConnection *conn,
                                           uint64_t offset,
                                           uint64_t bytes,
                                           QEMUIOVector *qiov,
@@ -1301,7 +1551,7 @@ static int coroutine_fn qemu_rbd_start_co(BlockDriverState *bs,
         }
     }
 
-    r = rbd_aio_create_completion(&task,
+    r = rbd_aio_create_completion(&task, s->eventfd_completion ? NULL :
                                   (rbd_callback_t) qemu_rbd_completion_cb, &c);
     if (r < 0) {
         return r;
@@ -1309,16 +1559,16 @@ static int coroutine_fn qemu_rbd_start_co(BlockDriverState *bs,
 
     switch (cmd) {
     case RBD_AIO_READ:
-        r = rbd_aio_readv(s->image, qiov->iov, qiov->niov, offset, c);
+        r = rbd_aio_readv(conn->image, qiov->iov, qiov->niov, offset, c);
         break;
     case RBD_AIO_WRITE:
-        r = rbd_aio_writev(s->image, qiov->iov, qiov->niov, offset, c);
+        r = rbd_aio_writev(conn->image, qiov->iov, qiov->niov, offset, c);
         break;
     case RBD_AIO_DISCARD:
-        r = rbd_aio_discard(s->image, offset, bytes, c);
+        r = rbd_aio_discard(conn->image, offset, bytes, c);
         break;
     case RBD_AIO_FLUSH:
-        r = rbd_aio_flush(s->image, c);
+        r = rbd_aio_flush(conn->image, c);
         break;
 #ifdef LIBRBD_SUPPORTS_WRITE_ZEROES
     case RBD_AIO_WRITE_ZEROES: {
@@ -1328,7 +1578,7 @@ static int coroutine_fn qemu_rbd_start_co(BlockDriverState *bs,
             zero_flags = RBD_WRITE_ZEROES_FLAG_THICK_PROVISION;
         }
 #endif
-        r = rbd_aio_write_zeroes(s->image, offset, bytes, c, zero_flags, 0);
+        r = rbd_aio_write_zeroes(conn->image, offset, bytes, c, zero_flags, 0);
         break;
     }
 #endif
@@ -1368,7 +1618,8 @@ coroutine_fn qemu_rbd_co_preadv(BlockDriverState *bs, int64_t offset,
                                 int64_t bytes, QEMUIOVector *qiov,
                                 BdrvRequestFlags flags)
 {
-    return qemu_rbd_start_co(bs, offset, bytes, qiov, flags, RBD_AIO_READ);
+    return qemu_rbd_start_co(bs, qemu_rbd_next_conn(bs->opaque), offset, bytes,
+                             qiov, flags, RBD_AIO_READ);
 }
 
 static int
@@ -1376,18 +1627,31 @@ coroutine_fn qemu_rbd_co_pwritev(BlockDriverState *bs, int64_t offset,
                                  int64_t bytes, QEMUIOVector *qiov,
                                  BdrvRequestFlags flags)
 {
-    return qemu_rbd_start_co(bs, offset, bytes, qiov, flags, RBD_AIO_WRITE);
+    return qemu_rbd_start_co(bs, qemu_rbd_next_conn(bs->opaque), offset, bytes,
+                             qiov, flags, RBD_AIO_WRITE);
 }
 
 static int coroutine_fn qemu_rbd_co_flush(BlockDriverState *bs)
 {
-    return qemu_rbd_start_co(bs, 0, 0, NULL, 0, RBD_AIO_FLUSH);
+    BDRVRBDState *s = bs->opaque;
+    unsigned int i;
+    int r;
+
+    /* Writes may have gone through any of the connections */
+    for (i = 0; i < s->n_conns; i++) {
+        r = qemu_rbd_start_co(bs, &s->conns[i], 0, 0, NULL, 0, RBD_AIO_FLUSH);
+        if (r < 0) {
+            return r;
+        }
+    }
+    return 0;
 }
 
 static int coroutine_fn qemu_rbd_co_pdiscard(BlockDriverState *bs,
                                              int64_t offset, int64_t bytes)
 {
-    return qemu_rbd_start_co(bs, offset, bytes, NULL, 0, RBD_AIO_DISCARD);
+    return qemu_rbd_start_co(bs, qemu_rbd_next_conn(bs->opaque), offset, bytes,
+                             NULL, 0, RBD_AIO_DISCARD);
 }
 
 #ifdef LIBRBD_SUPPORTS_WRITE_ZEROES
@@ -1395,8 +1659,8 @@ static int
 coroutine_fn qemu_rbd_co_pwrite_zeroes(BlockDriverState *bs, int64_t offset,
                                        int64_t bytes, BdrvRequestFlags flags)
 {
-    return qemu_rbd_start_co(bs, offset, bytes, NULL, flags,
-                             RBD_AIO_WRITE_ZEROES);
+    return qemu_rbd_start_co(bs, qemu_rbd_next_conn(bs->opaque), offset, bytes,
+                             NULL, flags, RBD_AIO_WRITE_ZEROES);
 }
 #endif
 
@@ -1843,6 +2107,8 @@ static BlockDriver bdrv_rbd = {
     .bdrv_snapshot_list     = qemu_rbd_snap_list,
     .bdrv_snapshot_goto     = qemu_rbd_snap_rollback,
     .bdrv_co_invalidate_cache = qemu_rbd_co_invalidate_cache,
+    .bdrv_detach_aio_context  = qemu_rbd_detach_aio_context,
+    .bdrv_attach_aio_context  = qemu_rbd_attach_aio_context,
 
     .strong_runtime_opts    = qemu_rbd_strong_runtime_opts,
 };
@@ -78,6 +78,14 @@ void coroutine_fn reqlist_shrink_req(BlockReq *req, int64_t new_bytes)
     qemu_co_queue_restart_all(&req->wait_queue);
 }
 
+void coroutine_fn reqlist_extend_req(BlockReq *req, int64_t new_bytes)
+{
+    assert(new_bytes >= req->bytes);
+    assert(new_bytes <= INT64_MAX - req->offset);
+
+    req->bytes = new_bytes;
+}
+
 void coroutine_fn reqlist_remove_req(BlockReq *req)
 {
     QLIST_REMOVE(req, list);
@@ -15,6 +15,7 @@
 #include "trace.h"
 #include "block/block_int.h"
 #include "block/blockjob_int.h"
+#include "block/aio_task.h"
 #include "qapi/error.h"
 #include "qapi/qmp/qdict.h"
 #include "qemu/ratelimit.h"
@@ -28,8 +29,24 @@ enum {
      * that populating contiguous regions of the image is efficient.
      */
     STREAM_CHUNK = 512 * 1024, /* in bytes */
+
+    /*
+     * How far a single block status query may look ahead.  Long runs of
+     * allocated or unallocated data are then handled with one walk of
+     * the backing chain instead of one per chunk.
+     */
+    STREAM_LOOKAHEAD = 64 * STREAM_CHUNK,
+
+    /* Number of chunks that are copied in parallel */
+    STREAM_MAX_TASKS = 4,
 };
 
+typedef struct StreamRange {
+    int64_t offset;
+    int64_t bytes;
+    QSIMPLEQ_ENTRY(StreamRange) next;
+} StreamRange;
+
 typedef struct StreamBlockJob {
     BlockJob common;
     BlockBackend *blk;
@@ -40,8 +57,19 @@ typedef struct StreamBlockJob {
     BlockdevOnError on_error;
     char *backing_file_str;
     bool bs_read_only;
+
+    /* Only accessed from the job coroutine and its copy tasks */
+    int error;                          /* first error reported/ignored */
+    QSIMPLEQ_HEAD(, StreamRange) retry; /* chunks that failed with 'stop' */
 } StreamBlockJob;
 
+typedef struct StreamTask {
+    AioTask task;
+    StreamBlockJob *s;
+    int64_t offset;
+    int64_t bytes;
+} StreamTask;
+
 static int coroutine_fn stream_populate(BlockBackend *blk,
                                         int64_t offset, uint64_t bytes)
 {
@@ -50,6 +78,56 @@ static int coroutine_fn stream_populate(BlockBackend *blk,
     return blk_co_preadv(blk, offset, bytes, NULL, BDRV_REQ_PREFETCH);
 }
 
+static int coroutine_fn stream_task_entry(AioTask *task)
+{
+    StreamTask *t = container_of(task, StreamTask, task);
+    StreamBlockJob *s = t->s;
+    BlockErrorAction action;
+    int ret;
+
+    ret = stream_populate(s->blk, t->offset, t->bytes);
+    trace_stream_copy_done(s, t->offset, t->bytes, ret);
+    if (ret < 0) {
+        action = block_job_error_action(&s->common, s->on_error, true, -ret);
+        if (action == BLOCK_ERROR_ACTION_STOP) {
+            /* The job is paused now, copy the chunk again on resume */
+            StreamRange *r = g_new(StreamRange, 1);
+
+            r->offset = t->offset;
+            r->bytes = t->bytes;
+            QSIMPLEQ_INSERT_TAIL(&s->retry, r, next);
+            return 0;
+        }
+        if (s->error == 0) {
+            s->error = ret;
+        }
+        if (action == BLOCK_ERROR_ACTION_REPORT) {
+            return ret;
+        }
+    }
+
+    /* Publish progress */
+    job_progress_update(&s->common.job, t->bytes);
+    return 0;
+}
+
+static void coroutine_fn stream_start_copy(StreamBlockJob *s,
+                                           AioTaskPool *pool,
+                                           int64_t offset, int64_t bytes)
+{
+    StreamTask *t = g_new(StreamTask, 1);
+
+    *t = (StreamTask) {
+        .task.func = stream_task_entry,
+        .s = s,
+        .offset = offset,
+        .bytes = bytes,
+    };
+
+    aio_task_pool_start_task(pool, &t->task);
+    block_job_ratelimit_processed_bytes(&s->common, bytes);
+}
+
 static int stream_prepare(Job *job)
 {
     StreamBlockJob *s = container_of(job, StreamBlockJob, common.job);
@@ -150,9 +228,11 @@ static int coroutine_fn stream_run(Job *job, Error **errp)
 {
     StreamBlockJob *s = container_of(job, StreamBlockJob, common.job);
     BlockDriverState *unfiltered_bs;
+    AioTaskPool *pool;
+    StreamRange *r;
     int64_t len;
     int64_t offset = 0;
-    int error = 0;
+    int64_t copy_bytes = 0; /* left to copy at @offset */
     int64_t n = 0; /* bytes */
 
     WITH_GRAPH_RDLOCK_GUARD() {
@@ -169,22 +249,57 @@ static int coroutine_fn stream_run(Job *job, Error **errp)
     }
     job_progress_set_remaining(&s->common.job, len);
 
-    for ( ; offset < len; offset += n) {
+    /*
+     * Block status is looked up for up to STREAM_LOOKAHEAD bytes at once,
+     * and the allocated parts are copied in STREAM_CHUNK sized tasks of
+     * which up to STREAM_MAX_TASKS run in parallel.
+     */
+    pool = aio_task_pool_new(STREAM_MAX_TASKS);
+
+    while (true) {
         bool copy;
         int ret;
 
         /* Note that even when no rate limit is applied we need to yield
-         * with no pending I/O here so that bdrv_drain_all() returns.
+         * here so that bdrv_drain_all() returns.
          */
         block_job_ratelimit_sleep(&s->common);
-        if (job_is_cancelled(&s->common.job)) {
+        if (job_is_cancelled(&s->common.job) ||
+            aio_task_pool_status(pool) < 0) {
             break;
         }
 
+        r = QSIMPLEQ_FIRST(&s->retry);
+        if (r) {
+            QSIMPLEQ_REMOVE_HEAD(&s->retry, next);
+            stream_start_copy(s, pool, r->offset, r->bytes);
+            g_free(r);
+            continue;
+        }
+
+        if (copy_bytes) {
+            n = MIN(copy_bytes, STREAM_CHUNK);
+            stream_start_copy(s, pool, offset, n);
+            offset += n;
+            copy_bytes -= n;
+            continue;
+        }
+
+        if (offset >= len) {
+            if (aio_task_pool_empty(pool)) {
+                break;
+            }
+            /* A failing copy may still queue its chunk for retrying */
+            aio_task_pool_wait_one(pool);
+            continue;
+        }
+
         copy = false;
 
         WITH_GRAPH_RDLOCK_GUARD() {
-            ret = bdrv_co_is_allocated(unfiltered_bs, offset, STREAM_CHUNK, &n);
+            ret = bdrv_co_is_allocated(unfiltered_bs, offset,
+                                       MIN(len - offset, STREAM_LOOKAHEAD),
+                                       &n);
             if (ret == 1) {
                 /* Allocated in the top, no need to copy.  */
             } else if (ret >= 0) {
@@ -205,17 +320,17 @@ static int coroutine_fn stream_run(Job *job, Error **errp)
         }
         trace_stream_one_iteration(s, offset, n, ret);
         if (copy) {
-            ret = stream_populate(s->blk, offset, n);
+            copy_bytes = n;
+            continue;
         }
         if (ret < 0) {
             BlockErrorAction action =
                 block_job_error_action(&s->common, s->on_error, true, -ret);
             if (action == BLOCK_ERROR_ACTION_STOP) {
-                n = 0;
                 continue;
             }
-            if (error == 0) {
-                error = ret;
+            if (s->error == 0) {
+                s->error = ret;
             }
             if (action == BLOCK_ERROR_ACTION_REPORT) {
                 break;
@@ -224,13 +339,19 @@ static int coroutine_fn stream_run(Job *job, Error **errp)
 
         /* Publish progress */
         job_progress_update(&s->common.job, n);
-        if (copy) {
-            block_job_ratelimit_processed_bytes(&s->common, n);
-        }
+        offset += n;
+    }
+
+    aio_task_pool_wait_all(pool);
+    aio_task_pool_free(pool);
+
+    while ((r = QSIMPLEQ_FIRST(&s->retry))) {
+        QSIMPLEQ_REMOVE_HEAD(&s->retry, next);
+        g_free(r);
     }
 
     /* Do not remove the backing file if an error was there but ignored. */
-    return error;
+    return s->error;
 }
 
 static const BlockJobDriver stream_job_driver = {
@@ -348,6 +469,7 @@ void stream_start(const char *job_id, BlockDriverState *bs,
     if (!s) {
         goto fail;
     }
+    QSIMPLEQ_INIT(&s->retry);
 
     s->blk = blk_new_with_bs(cor_filter_bs, BLK_PERM_CONSISTENT_READ,
                              basic_flags | BLK_PERM_WRITE, errp);
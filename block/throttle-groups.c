@@ -35,6 +35,9 @@
 #include "qom/object.h"
 #include "qom/object_interfaces.h"
 
+/* How far ahead a member may take tokens from its group's buckets */
+#define THROTTLE_GROUP_CREDIT_NS (5 * SCALE_MS)
+
 static void throttle_group_obj_init(Object *obj);
 static void throttle_group_obj_complete(UserCreatable *obj, Error **errp);
 static void timer_cb(ThrottleGroupMember *tgm, ThrottleDirection direction);
@@ -350,6 +353,100 @@ static void coroutine_mixed_fn schedule_next_request(ThrottleGroupMember *tgm,
     }
 }
 
+/* Use a token that was taken in advance by throttle_group_refill_credit()
+ * to let a request go through without taking the ThrottleGroup lock.
+ *
+ * @tgm:       the current ThrottleGroupMember
+ * @bytes:     the number of bytes for this I/O
+ * @direction: the ThrottleDirection
+ * @ret:       whether the request can be executed right away
+ */
+static bool throttle_group_take_credit(ThrottleGroupMember *tgm,
+                                       int64_t bytes,
+                                       ThrottleDirection direction)
+{
+    uint32_t ops, left, old;
+
+    /* Do not overtake requests of this member that are already queued */
+    if (bytes > UINT32_MAX || qatomic_read(&tgm->pending_reqs[direction])) {
+        return false;
+    }
+
+    ops = qatomic_read(&tgm->credit_ops[direction]);
+    do {
+        if (!ops) {
+            return false;
+        }
+        old = ops;
+        ops = qatomic_cmpxchg(&tgm->credit_ops[direction], old, old - 1);
+    } while (ops != old);
+
+    left = qatomic_read(&tgm->credit_bytes[direction]);
+    do {
+        if (left < bytes) {
+            qatomic_inc(&tgm->credit_ops[direction]);
+            return false;
+        }
+        old = left;
+        left = qatomic_cmpxchg(&tgm->credit_bytes[direction], old,
+                               old - bytes);
+    } while (left != old);
+
+    return true;
+}
+
+/* Give the unused tokens of a ThrottleGroupMember back to the group.
+ *
+ * This assumes that tg->lock is held.
+ *
+ * @tgm:       the ThrottleGroupMember
+ * @direction: the ThrottleDirection
+ */
+static void throttle_group_return_credit(ThrottleGroupMember *tgm,
+                                         ThrottleDirection direction)
+{
+    uint32_t ops = qatomic_xchg(&tgm->credit_ops[direction], 0);
+    uint32_t bytes = qatomic_xchg(&tgm->credit_bytes[direction], 0);
+
+    throttle_unreserve(tgm->throttle_state, direction, ops, bytes);
+}
+
+/* Take a batch of tokens from the group's buckets for a ThrottleGroupMember
+ * so that its next requests don't need the ThrottleGroup lock. This is only
+ * done while nobody in the group waits, so that round-robin scheduling
+ * among members is not affected when the limits are actually reached.
+ *
+ * This assumes that tg->lock is held.
+ *
+ * @tgm:       the current ThrottleGroupMember
+ * @direction: the ThrottleDirection
+ */
+static void throttle_group_refill_credit(ThrottleGroupMember *tgm,
+                                         ThrottleDirection direction)
+{
+    ThrottleState *ts = tgm->throttle_state;
+    ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+    ThrottleGroupMember *iter;
+    uint32_t ops, bytes;
+
+    /* Requests of more than one unit each would get too many tokens */
+    if (ts->cfg.op_size || tg->any_timer_armed[direction] ||
+        qatomic_read(&tgm->io_limits_disabled)) {
+        return;
+    }
+    QLIST_FOREACH(iter, &tg->head, round_robin) {
+        if (tgm_has_pending_reqs(iter, direction)) {
+            return;
+        }
+    }
+
+    throttle_group_return_credit(tgm, direction);
+    throttle_reserve(ts, direction, qemu_clock_get_ns(tg->clock_type),
+                     THROTTLE_GROUP_CREDIT_NS, &ops, &bytes);
+    qatomic_set(&tgm->credit_ops[direction], ops);
+    qatomic_set(&tgm->credit_bytes[direction], bytes);
+}
+
 /* Check if an I/O request needs to be throttled, wait and set a timer
  * if necessary, and schedule the next request using a round robin
  * algorithm.
@@ -362,21 +459,27 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
                                                         int64_t bytes,
                                                         ThrottleDirection direction)
 {
-    bool must_wait;
+    bool must_wait, waited;
     ThrottleGroupMember *token;
     ThrottleGroup *tg = container_of(tgm->throttle_state, ThrottleGroup, ts);
 
     assert(bytes >= 0);
     assert(direction < THROTTLE_MAX);
 
+    /* Fast path: the tokens for this request were already accounted */
+    if (throttle_group_take_credit(tgm, bytes, direction)) {
+        return;
+    }
+
     qemu_mutex_lock(&tg->lock);
 
     /* First we check if this I/O has to be throttled. */
     token = next_throttle_token(tgm, direction);
     must_wait = throttle_group_schedule_timer(token, direction);
+    waited = must_wait || tgm->pending_reqs[direction];
 
     /* Wait if there's a timer set or queued requests of this type */
-    if (must_wait || tgm->pending_reqs[direction]) {
+    if (waited) {
         tgm->pending_reqs[direction]++;
         qemu_mutex_unlock(&tg->lock);
         qemu_co_mutex_lock(&tgm->throttled_reqs_lock);
@@ -390,6 +493,11 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
     /* The I/O will be executed, so do the accounting */
     throttle_account(tgm->throttle_state, direction, bytes);
 
+    /* Nothing is throttled, so let the next requests skip the lock */
+    if (!waited) {
+        throttle_group_refill_credit(tgm, direction);
+    }
+
     /* Schedule the next request */
     schedule_next_request(tgm, direction);
 
@@ -476,8 +584,18 @@ void throttle_group_config(ThrottleGroupMember *tgm, ThrottleConfig *cfg)
 {
     ThrottleState *ts = tgm->throttle_state;
     ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+    ThrottleGroupMember *iter;
+    ThrottleDirection dir;
+
     qemu_mutex_lock(&tg->lock);
     throttle_config(ts, tg->clock_type, cfg);
+    /* The bucket levels were reset, so tokens taken before are void */
+    QLIST_FOREACH(iter, &tg->head, round_robin) {
+        for (dir = THROTTLE_READ; dir < THROTTLE_MAX; dir++) {
+            qatomic_set(&iter->credit_ops[dir], 0);
+            qatomic_set(&iter->credit_bytes[dir], 0);
+        }
+    }
     qemu_mutex_unlock(&tg->lock);
 
     throttle_group_restart_tgm(tgm);
@@ -559,6 +677,8 @@ void throttle_group_register_tgm(ThrottleGroupMember *tgm,
             tg->tokens[dir] = tgm;
         }
         qemu_co_queue_init(&tgm->throttled_reqs[dir]);
+        qatomic_set(&tgm->credit_ops[dir], 0);
+        qatomic_set(&tgm->credit_bytes[dir], 0);
     }
 
     QLIST_INSERT_HEAD(&tg->head, tgm, round_robin);
@@ -599,6 +719,7 @@ void throttle_group_unregister_tgm(ThrottleGroupMember *tgm)
 
     WITH_QEMU_LOCK_GUARD(&tg->lock) {
         for (dir = THROTTLE_READ; dir < THROTTLE_MAX; dir++) {
+            throttle_group_return_credit(tgm, dir);
             assert(tgm->pending_reqs[dir] == 0);
             assert(qemu_co_queue_empty(&tgm->throttled_reqs[dir]));
             assert(!timer_pending(tgm->throttle_timers.timers[dir]));
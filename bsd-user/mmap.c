@@ -20,13 +20,21 @@
 
 #include "qemu.h"
 
-static pthread_mutex_t mmap_mutex = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * Changes to the guest address space take mmap_lock exclusively, while
+ * threads that only need lookups to stay valid take it shared.  Both are
+ * recursive; the shared lock may be taken while already holding the
+ * exclusive one, but it cannot be upgraded.
+ */
+static pthread_rwlock_t mmap_rwlock = PTHREAD_RWLOCK_INITIALIZER;
 static __thread int mmap_lock_count;
+static __thread int mmap_read_lock_count;
 
 void mmap_lock(void)
 {
     if (mmap_lock_count++ == 0) {
-        pthread_mutex_lock(&mmap_mutex);
+        assert(mmap_read_lock_count == 0);
+        pthread_rwlock_wrlock(&mmap_rwlock);
     }
 }
 
@@ -34,7 +42,37 @@ void mmap_unlock(void)
 {
     assert(mmap_lock_count > 0);
     if (--mmap_lock_count == 0) {
-        pthread_mutex_unlock(&mmap_mutex);
+        /* Shared levels taken inside must not outlive the rwlock. */
+        assert(mmap_read_lock_count == 0);
+        pthread_rwlock_unlock(&mmap_rwlock);
+    }
+}
+
+void mmap_read_lock(void)
+{
+    if (mmap_read_lock_count++ == 0 && mmap_lock_count == 0) {
+        pthread_rwlock_rdlock(&mmap_rwlock);
+    }
+}
+
+void mmap_read_unlock(void)
+{
+    assert(mmap_read_lock_count > 0);
+    if (--mmap_read_lock_count == 0 && mmap_lock_count == 0) {
+        pthread_rwlock_unlock(&mmap_rwlock);
+    }
+}
+
+/*
+ * Release mmap_lock however deeply it is nested, shared or exclusive:
+ * the thread holds the rwlock itself only once.
+ */
+void mmap_unlock_all(void)
+{
+    if (mmap_lock_count || mmap_read_lock_count) {
+        mmap_lock_count = 0;
+        mmap_read_lock_count = 0;
+        pthread_rwlock_unlock(&mmap_rwlock);
     }
 }
 
@@ -43,20 +81,25 @@ bool have_mmap_lock(void)
     return mmap_lock_count > 0 ? true : false;
 }
 
+bool have_mmap_read_lock(void)
+{
+    return mmap_lock_count > 0 || mmap_read_lock_count > 0;
+}
+
 /* Grab lock to make sure things are in a consistent state after fork().  */
 void mmap_fork_start(void)
 {
-    if (mmap_lock_count)
+    if (mmap_lock_count || mmap_read_lock_count)
         abort();
-    pthread_mutex_lock(&mmap_mutex);
+    pthread_rwlock_wrlock(&mmap_rwlock);
 }
 
 void mmap_fork_end(int child)
 {
     if (child)
-        pthread_mutex_init(&mmap_mutex, NULL);
+        pthread_rwlock_init(&mmap_rwlock, NULL);
     else
-        pthread_mutex_unlock(&mmap_mutex);
+        pthread_rwlock_unlock(&mmap_rwlock);
 }
 
 /* NOTE: all the constants are the HOST ones, but addresses are target. */
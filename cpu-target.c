@@ -30,6 +30,7 @@
 #else
 #include "hw/core/sysemu-cpu-ops.h"
 #include "exec/address-spaces.h"
+#include "qemu/thread-context.h"
 #endif
 #include "sysemu/cpus.h"
 #include "sysemu/tcg.h"
@@ -199,6 +200,12 @@ static Property cpu_common_props[] = {
      */
     DEFINE_PROP_LINK("memory", CPUState, memory, TYPE_MEMORY_REGION,
                      MemoryRegion *),
+    /*
+     * The vCPU thread is created in this thread context, if set, so that
+     * it starts with the CPU affinity and scheduling policy of the context.
+     */
+    DEFINE_PROP_LINK("thread-context", CPUState, thread_context,
+                     TYPE_THREAD_CONTEXT, ThreadContext *),
 #endif
     DEFINE_PROP_END_OF_LIST(),
 };
@@ -21,6 +21,7 @@ void hmp_dump_guest_memory(Monitor *mon, const QDict *qdict)
     bool lzo = qdict_get_try_bool(qdict, "lzo", false);
     bool raw = qdict_get_try_bool(qdict, "raw", false);
     bool snappy = qdict_get_try_bool(qdict, "snappy", false);
+    bool zstd = qdict_get_try_bool(qdict, "zstd", false);
     const char *file = qdict_get_str(qdict, "filename");
     bool has_begin = qdict_haskey(qdict, "begin");
     bool has_length = qdict_haskey(qdict, "length");
@@ -31,8 +32,8 @@ void hmp_dump_guest_memory(Monitor *mon, const QDict *qdict)
     enum DumpGuestMemoryFormat dump_format = DUMP_GUEST_MEMORY_FORMAT_ELF;
     char *prot;
 
-    if (zlib + lzo + snappy + win_dmp > 1) {
-        error_setg(&err, "only one of '-z|-l|-s|-w' can be set");
+    if (zlib + lzo + snappy + zstd + win_dmp > 1) {
+        error_setg(&err, "only one of '-z|-l|-s|-Z|-w' can be set");
         hmp_handle_error(mon, err);
         return;
     }
@@ -65,6 +66,14 @@ void hmp_dump_guest_memory(Monitor *mon, const QDict *qdict)
         }
     }
 
+    if (zstd) {
+        if (raw) {
+            dump_format = DUMP_GUEST_MEMORY_FORMAT_KDUMP_RAW_ZSTD;
+        } else {
+            dump_format = DUMP_GUEST_MEMORY_FORMAT_KDUMP_ZSTD;
+        }
+    }
+
     if (has_begin) {
         begin = qdict_get_int(qdict, "begin");
     }
@@ -78,7 +87,8 @@ void hmp_dump_guest_memory(Monitor *mon, const QDict *qdict)
     prot = g_strconcat("file:", file, NULL);
 
     qmp_dump_guest_memory(paging, prot, true, detach, has_begin, begin,
-                          has_length, length, true, dump_format, &err);
+                          has_length, length, true, dump_format,
+                          false, 0, &err);
     hmp_handle_error(mon, err);
     g_free(prot);
 }
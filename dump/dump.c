@@ -38,6 +38,9 @@
 #ifdef CONFIG_SNAPPY
 #include <snappy-c.h>
 #endif
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
 #ifndef ELF_MACHINE_UNAME
 #define ELF_MACHINE_UNAME "Unknown"
 #endif
@@ -999,6 +1002,11 @@ static void create_header32(DumpState *s, Error **errp)
     if (s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) {
         status |= DUMP_DH_COMPRESSED_SNAPPY;
     }
+#endif
+#ifdef CONFIG_ZSTD
+    if (s->flag_compress & DUMP_DH_COMPRESSED_ZSTD) {
+        status |= DUMP_DH_COMPRESSED_ZSTD;
+    }
 #endif
     dh->status = cpu_to_dump32(s, status);
 
@@ -1110,6 +1118,11 @@ static void create_header64(DumpState *s, Error **errp)
     if (s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) {
         status |= DUMP_DH_COMPRESSED_SNAPPY;
     }
+#endif
+#ifdef CONFIG_ZSTD
+    if (s->flag_compress & DUMP_DH_COMPRESSED_ZSTD) {
+        status |= DUMP_DH_COMPRESSED_ZSTD;
+    }
 #endif
     dh->status = cpu_to_dump32(s, status);
 
@@ -1462,25 +1475,169 @@ static size_t get_len_buf_out(size_t page_size, uint32_t flag_compress)
     case DUMP_DH_COMPRESSED_SNAPPY:
         return snappy_max_compressed_length(page_size);
 #endif
+
+#ifdef CONFIG_ZSTD
+    case DUMP_DH_COMPRESSED_ZSTD:
+        return ZSTD_compressBound(page_size);
+#endif
     }
     return 0;
 }
 
+/* Number of pages each compression thread gets per batch */
+#define DUMP_PAGES_PER_THREAD   128
+
+/* Per-thread compression state */
+typedef struct DumpCompressor {
+#ifdef CONFIG_LZO
+    lzo_bytep wrkmem;
+#endif
+#ifdef CONFIG_ZSTD
+    ZSTD_CCtx *zstd;
+#endif
+} DumpCompressor;
+
+typedef struct DumpPage {
+    uint8_t *page;      /* buffer for pages that straddle guest phys blocks */
+    uint8_t *buf;       /* the page contents, @page or guest RAM */
+    uint8_t *out;       /* buffer for the compressed contents */
+    size_t size;        /* number of bytes to write, 0 for a zero page */
+    uint32_t flags;     /* compression format of @out, 0 to write @buf */
+} DumpPage;
+
+typedef struct DumpCompressThread {
+    QemuThread thread;
+    QemuSemaphore sem;      /* posted when @pages are ready or on @quit */
+    QemuSemaphore *done;    /* posted when @pages have been compressed */
+    DumpState *state;
+    DumpCompressor c;
+    DumpPage *pages;
+    int nr_pages;
+    bool quit;
+} DumpCompressThread;
+
+static void dump_compressor_init(DumpState *s, DumpCompressor *c)
+{
+#ifdef CONFIG_LZO
+    c->wrkmem = NULL;
+    if (s->flag_compress == DUMP_DH_COMPRESSED_LZO) {
+        c->wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
+    }
+#endif
+#ifdef CONFIG_ZSTD
+    c->zstd = NULL;
+    if (s->flag_compress == DUMP_DH_COMPRESSED_ZSTD) {
+        c->zstd = ZSTD_createCCtx();
+    }
+#endif
+}
+
+static void dump_compressor_cleanup(DumpCompressor *c)
+{
+#ifdef CONFIG_LZO
+    g_free(c->wrkmem);
+#endif
+#ifdef CONFIG_ZSTD
+    ZSTD_freeCCtx(c->zstd);
+#endif
+}
+
+/*
+ * Check for a zero page and compress @p in the format given by
+ * s->flag_compress.  When compression fails to work or does not make the
+ * page smaller, we fall back to save it in plaintext.
+ */
+static void dump_compress_page(DumpState *s, DumpCompressor *c, DumpPage *p)
+{
+    size_t page_size = s->dump_info.page_size;
+    size_t size_out = get_len_buf_out(page_size, s->flag_compress);
+
+    p->flags = 0;
+    if (buffer_is_zero(p->buf, page_size)) {
+        p->size = 0;
+        return;
+    }
+    p->size = page_size;
+
+    switch (s->flag_compress) {
+    case DUMP_DH_COMPRESSED_ZLIB:
+        if (compress2(p->out, (uLongf *)&size_out, p->buf, page_size,
+                      Z_BEST_SPEED) != Z_OK) {
+            return;
+        }
+        break;
+#ifdef CONFIG_LZO
+    case DUMP_DH_COMPRESSED_LZO:
+        if (lzo1x_1_compress(p->buf, page_size, p->out,
+                             (lzo_uint *)&size_out, c->wrkmem) != LZO_E_OK) {
+            return;
+        }
+        break;
+#endif
+#ifdef CONFIG_SNAPPY
+    case DUMP_DH_COMPRESSED_SNAPPY:
+        if (snappy_compress((char *)p->buf, page_size, (char *)p->out,
+                            &size_out) != SNAPPY_OK) {
+            return;
+        }
+        break;
+#endif
+#ifdef CONFIG_ZSTD
+    case DUMP_DH_COMPRESSED_ZSTD:
+        size_out = ZSTD_compressCCtx(c->zstd, p->out, size_out, p->buf,
+                                     page_size, 1);
+        if (ZSTD_isError(size_out)) {
+            return;
+        }
+        break;
+#endif
+    default:
+        return;
+    }
+
+    if (size_out < page_size) {
+        p->flags = s->flag_compress;
+        p->size = size_out;
+    }
+}
+
+static void *dump_compress_thread(void *opaque)
+{
+    DumpCompressThread *t = opaque;
+    int i;
+
+    for (;;) {
+        qemu_sem_wait(&t->sem);
+        if (t->quit) {
+            break;
+        }
+        for (i = 0; i < t->nr_pages; i++) {
+            dump_compress_page(t->state, &t->c, &t->pages[i]);
+        }
+        qemu_sem_post(t->done);
+    }
+
+    return NULL;
+}
+
 static void write_dump_pages(DumpState *s, Error **errp)
 {
     int ret = 0;
     DataCache page_desc, page_data;
-    size_t len_buf_out, size_out;
-#ifdef CONFIG_LZO
-    lzo_bytep wrkmem = NULL;
-#endif
-    uint8_t *buf_out = NULL;
+    size_t len_buf_out;
     off_t offset_desc, offset_data;
     PageDescriptor pd, pd_zero;
     uint8_t *buf;
     GuestPhysBlock *block_iter = NULL;
     uint64_t pfn_iter;
-    g_autofree uint8_t *page = NULL;
+    int nr_threads = s->compress_threads;
+    int batch_size = nr_threads * DUMP_PAGES_PER_THREAD;
+    DumpCompressThread *threads;
+    DumpCompressor compressor;
+    QemuSemaphore done;
+    DumpPage *pages;
+    bool more = true;
+    int i, nr, share, started;
 
     /* get offset of page_desc and page_data in dump file */
     offset_desc = s->offset_page;
@@ -1489,15 +1646,35 @@ static void write_dump_pages(DumpState *s, Error **errp)
     prepare_data_cache(&page_desc, s, offset_desc);
     prepare_data_cache(&page_data, s, offset_data);
 
-    /* prepare buffer to store compressed data */
+    /* prepare buffers to store compressed data */
     len_buf_out = get_len_buf_out(s->dump_info.page_size, s->flag_compress);
     assert(len_buf_out != 0);
 
-#ifdef CONFIG_LZO
-    wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
-#endif
+    pages = g_new0(DumpPage, batch_size);
+    for (i = 0; i < batch_size; i++) {
+        pages[i].page = g_malloc(s->dump_info.page_size);
+        pages[i].out = g_malloc(len_buf_out);
+    }
 
-    buf_out = g_malloc(len_buf_out);
+    /*
+     * The pages are read in batches.  The calling thread compresses the
+     * first share of each batch, the other shares are handed to
+     * compress_threads - 1 helper threads.  Once all of them are done, the
+     * batch is written out in pfn order, so the output is the same for
+     * any number of threads.
+     */
+    dump_compressor_init(s, &compressor);
+    qemu_sem_init(&done, 0);
+    threads = g_new0(DumpCompressThread, nr_threads - 1);
+    for (i = 0; i < nr_threads - 1; i++) {
+        threads[i].state = s;
+        threads[i].done = &done;
+        qemu_sem_init(&threads[i].sem, 0);
+        dump_compressor_init(s, &threads[i].c);
+        qemu_thread_create(&threads[i].thread, "dump-compress",
+                           dump_compress_thread, &threads[i],
+                           QEMU_THREAD_JOINABLE);
+    }
 
     /*
      * init zero page's page_desc and page_data, because every zero page
@@ -1516,103 +1693,70 @@ static void write_dump_pages(DumpState *s, Error **errp)
     }
 
     offset_data += s->dump_info.page_size;
-    page = g_malloc(s->dump_info.page_size);
 
     /*
      * dump memory to vmcore page by page. zero page will all be resided in the
      * first page of page section
      */
-    for (buf = page; get_next_page(&block_iter, &pfn_iter, &buf, s); buf = page) {
-        /* check zero page */
-        if (buffer_is_zero(buf, s->dump_info.page_size)) {
-            ret = write_cache(&page_desc, &pd_zero, sizeof(PageDescriptor),
-                              false);
-            if (ret < 0) {
-                error_setg(errp, "dump: failed to write page desc");
-                goto out;
+    while (more) {
+        for (nr = 0; nr < batch_size; nr++) {
+            pages[nr].buf = pages[nr].page;
+            more = get_next_page(&block_iter, &pfn_iter, &pages[nr].buf, s);
+            if (!more) {
+                break;
             }
-        } else {
-            /*
-             * not zero page, then:
-             * 1. compress the page
-             * 2. write the compressed page into the cache of page_data
-             * 3. get page desc of the compressed page and write it into the
-             *    cache of page_desc
-             *
-             * only one compression format will be used here, for
-             * s->flag_compress is set. But when compression fails to work,
-             * we fall back to save in plaintext.
-             */
-             size_out = len_buf_out;
-             if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
-                    (compress2(buf_out, (uLongf *)&size_out, buf,
-                               s->dump_info.page_size, Z_BEST_SPEED) == Z_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_ZLIB);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#ifdef CONFIG_LZO
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
-                    (lzo1x_1_compress(buf, s->dump_info.page_size, buf_out,
-                    (lzo_uint *)&size_out, wrkmem) == LZO_E_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_LZO);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-#ifdef CONFIG_SNAPPY
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
-                    (snappy_compress((char *)buf, s->dump_info.page_size,
-                    (char *)buf_out, &size_out) == SNAPPY_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_SNAPPY);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-            } else {
-                /*
-                 * fall back to save in plaintext, size_out should be
-                 * assigned the target's page size
-                 */
-                pd.flags = cpu_to_dump32(s, 0);
-                size_out = s->dump_info.page_size;
-                pd.size = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf,
-                                  s->dump_info.page_size, false);
+        }
+
+        share = DIV_ROUND_UP(nr, nr_threads);
+        started = 0;
+        for (i = 0; i < nr_threads - 1 && (i + 1) * share < nr; i++) {
+            threads[i].pages = &pages[(i + 1) * share];
+            threads[i].nr_pages = MIN(share, nr - (i + 1) * share);
+            qemu_sem_post(&threads[i].sem);
+            started++;
+        }
+        for (i = 0; i < MIN(share, nr); i++) {
+            dump_compress_page(s, &compressor, &pages[i]);
+        }
+        for (i = 0; i < started; i++) {
+            qemu_sem_wait(&done);
+        }
+
+        for (i = 0; i < nr; i++) {
+            DumpPage *p = &pages[i];
+
+            if (!p->size) {
+                ret = write_cache(&page_desc, &pd_zero,
+                                  sizeof(PageDescriptor), false);
                 if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
+                    error_setg(errp, "dump: failed to write page desc");
                     goto out;
                 }
+                s->written_size += s->dump_info.page_size;
+                continue;
+            }
+
+            ret = write_cache(&page_data, p->flags ? p->out : p->buf,
+                              p->size, false);
+            if (ret < 0) {
+                error_setg(errp, "dump: failed to write page data");
+                goto out;
             }
 
             /* get and write page desc here */
+            pd.flags = cpu_to_dump32(s, p->flags);
+            pd.size = cpu_to_dump32(s, p->size);
             pd.page_flags = cpu_to_dump64(s, 0);
             pd.offset = cpu_to_dump64(s, offset_data);
-            offset_data += size_out;
+            offset_data += p->size;
 
             ret = write_cache(&page_desc, &pd, sizeof(PageDescriptor), false);
             if (ret < 0) {
                 error_setg(errp, "dump: failed to write page desc");
                 goto out;
             }
+            s->written_size += s->dump_info.page_size;
         }
-        s->written_size += s->dump_info.page_size;
     }
 
     ret = write_cache(&page_desc, NULL, 0, true);
@@ -1630,11 +1774,22 @@ out:
     free_data_cache(&page_desc);
     free_data_cache(&page_data);
 
-#ifdef CONFIG_LZO
-    g_free(wrkmem);
-#endif
+    for (i = 0; i < nr_threads - 1; i++) {
+        threads[i].quit = true;
+        qemu_sem_post(&threads[i].sem);
+        qemu_thread_join(&threads[i].thread);
+        qemu_sem_destroy(&threads[i].sem);
+        dump_compressor_cleanup(&threads[i].c);
+    }
+    g_free(threads);
+    qemu_sem_destroy(&done);
+    dump_compressor_cleanup(&compressor);
 
-    g_free(buf_out);
+    for (i = 0; i < batch_size; i++) {
+        g_free(pages[i].page);
+        g_free(pages[i].out);
+    }
+    g_free(pages);
 }
 
 static void create_kdump_vmcore(DumpState *s, Error **errp)
@@ -1942,6 +2097,10 @@ static void dump_init(DumpState *s, int fd, bool has_format,
             s->flag_compress = DUMP_DH_COMPRESSED_SNAPPY;
             break;
 
+        case DUMP_GUEST_MEMORY_FORMAT_KDUMP_ZSTD:
+            s->flag_compress = DUMP_DH_COMPRESSED_ZSTD;
+            break;
+
         default:
             s->flag_compress = 0;
         }
@@ -2062,6 +2221,7 @@ void qmp_dump_guest_memory(bool paging, const char *protocol,
                            bool has_begin, int64_t begin,
                            bool has_length, int64_t length,
                            bool has_format, DumpGuestMemoryFormat format,
+                           bool has_compress_threads, int64_t compress_threads,
                            Error **errp)
 {
     ERRP_GUARD();
@@ -2101,6 +2261,10 @@ void qmp_dump_guest_memory(bool paging, const char *protocol,
             format = DUMP_GUEST_MEMORY_FORMAT_KDUMP_SNAPPY;
             kdump_raw = true;
             break;
+        case DUMP_GUEST_MEMORY_FORMAT_KDUMP_RAW_ZSTD:
+            format = DUMP_GUEST_MEMORY_FORMAT_KDUMP_ZSTD;
+            kdump_raw = true;
+            break;
         default:
             break;
         }
@@ -2124,6 +2288,19 @@ void qmp_dump_guest_memory(bool paging, const char *protocol,
         error_setg(errp, QERR_MISSING_PARAMETER, "begin");
         return;
     }
+    if (has_compress_threads) {
+        if (!has_format || format == DUMP_GUEST_MEMORY_FORMAT_ELF ||
+            format == DUMP_GUEST_MEMORY_FORMAT_WIN_DMP) {
+            error_setg(errp, "compress-threads is only supported with "
+                       "kdump-compressed formats");
+            return;
+        }
+        if (compress_threads < 1 || compress_threads > 255) {
+            error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "compress-threads",
+                       "a value between 1 and 255");
+            return;
+        }
+    }
     if (has_detach) {
         detach_p = detach;
     }
@@ -2143,6 +2320,13 @@ void qmp_dump_guest_memory(bool paging, const char *protocol,
     }
 #endif
 
+#ifndef CONFIG_ZSTD
+    if (has_format && format == DUMP_GUEST_MEMORY_FORMAT_KDUMP_ZSTD) {
+        error_setg(errp, "kdump-zstd is not available now");
+        return;
+    }
+#endif
+
     if (has_format && format == DUMP_GUEST_MEMORY_FORMAT_WIN_DMP
         && !win_dump_available(errp)) {
         return;
@@ -2186,6 +2370,7 @@ void qmp_dump_guest_memory(bool paging, const char *protocol,
 
     s = &dump_state_global;
     dump_state_prepare(s);
+    s->compress_threads = has_compress_threads ? compress_threads : 1;
 
     dump_init(s, fd, has_format, format, paging, has_begin,
               begin, length, kdump_raw, errp);
@@ -2230,6 +2415,12 @@ DumpGuestMemoryCapability *qmp_query_dump_guest_memory_capability(Error **errp)
     QAPI_LIST_APPEND(tail, DUMP_GUEST_MEMORY_FORMAT_KDUMP_RAW_SNAPPY);
 #endif
 
+    /* add new item if kdump-zstd is available */
+#ifdef CONFIG_ZSTD
+    QAPI_LIST_APPEND(tail, DUMP_GUEST_MEMORY_FORMAT_KDUMP_ZSTD);
+    QAPI_LIST_APPEND(tail, DUMP_GUEST_MEMORY_FORMAT_KDUMP_RAW_ZSTD);
+#endif
+
     if (win_dump_available(NULL)) {
         QAPI_LIST_APPEND(tail, DUMP_GUEST_MEMORY_FORMAT_WIN_DMP);
     }
@@ -117,6 +117,11 @@ static void event_loop_base_class_init(ObjectClass *klass, void *class_data)
                               event_loop_base_get_param,
                               event_loop_base_set_param,
                               NULL, &thread_pool_max_info);
+    object_class_property_add_link(klass, "thread-pool-context",
+        TYPE_THREAD_CONTEXT, offsetof(EventLoopBase, thread_pool_context),
+        object_property_allow_set_link, OBJ_PROP_LINK_STRONG);
+    object_class_property_set_description(klass, "thread-pool-context",
+        "Context with which to create the thread pool's worker threads");
 }
 
 static const TypeInfo event_loop_base_info = {
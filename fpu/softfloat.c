@@ -3079,6 +3079,35 @@ int64_t float16_to_int64_scalbn(float16 a, FloatRoundMode rmode, int scale,
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
 }
 
+/*
+ * Hardfloat conversion to a signed integer of @bits bits.  Once inexact
+ * is set, a result that is in range is the only one that raises no new
+ * exception flag, so check for it.  The caller must have checked that the
+ * input is zero or normal, so that input flushing does not apply.
+ */
+static inline bool hard_float_to_sint(double d, FloatRoundMode rmode,
+                                      int bits, int64_t *r)
+{
+    const double lim = (double)(1ull << (bits - 1));
+
+    switch (rmode) {
+    case float_round_nearest_even:
+        /* Like all of hardfloat, this relies on the host default. */
+        d = rint(d);
+        break;
+    case float_round_to_zero:
+        d = trunc(d);
+        break;
+    default:
+        return false;
+    }
+    if (d >= -lim && d < lim) {
+        *r = d;
+        return true;
+    }
+    return false;
+}
+
 int16_t float32_to_int16_scalbn(float32 a, FloatRoundMode rmode, int scale,
                                 float_status *s)
 {
@@ -3093,6 +3122,17 @@ int32_t float32_to_int32_scalbn(float32 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu(s) &&
+        float32_is_zero_or_normal(a)) {
+        union_float32 ua;
+        int64_t r;
+
+        ua.s = a;
+        if (hard_float_to_sint(ua.h, rmode, 32, &r)) {
+            return r;
+        }
+    }
+
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
 }
@@ -3102,6 +3142,17 @@ int64_t float32_to_int64_scalbn(float32 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu(s) &&
+        float32_is_zero_or_normal(a)) {
+        union_float32 ua;
+        int64_t r;
+
+        ua.s = a;
+        if (hard_float_to_sint(ua.h, rmode, 64, &r)) {
+            return r;
+        }
+    }
+
     float32_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
 }
@@ -3120,6 +3171,17 @@ int32_t float64_to_int32_scalbn(float64 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu(s) &&
+        float64_is_zero_or_normal(a)) {
+        union_float64 ua;
+        int64_t r;
+
+        ua.s = a;
+        if (hard_float_to_sint(ua.h, rmode, 32, &r)) {
+            return r;
+        }
+    }
+
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT32_MIN, INT32_MAX, s);
 }
@@ -3129,6 +3191,17 @@ int64_t float64_to_int64_scalbn(float64 a, FloatRoundMode rmode, int scale,
 {
     FloatParts64 p;
 
+    if (likely(scale == 0) && can_use_fpu(s) &&
+        float64_is_zero_or_normal(a)) {
+        union_float64 ua;
+        int64_t r;
+
+        ua.s = a;
+        if (hard_float_to_sint(ua.h, rmode, 64, &r)) {
+            return r;
+        }
+    }
+
     float64_unpack_canonical(&p, a, s);
     return parts_float_to_sint(&p, rmode, scale, INT64_MIN, INT64_MAX, s);
 }
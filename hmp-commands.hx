@@ -1087,15 +1087,16 @@ ERST
 
     {
         .name       = "dump-guest-memory",
-        .args_type  = "paging:-p,detach:-d,windmp:-w,zlib:-z,lzo:-l,snappy:-s,raw:-R,filename:F,begin:l?,length:l?",
-        .params     = "[-p] [-d] [-z|-l|-s|-w] [-R] filename [begin length]",
+        .args_type  = "paging:-p,detach:-d,windmp:-w,zlib:-z,lzo:-l,snappy:-s,zstd:-Z,raw:-R,filename:F,begin:l?,length:l?",
+        .params     = "[-p] [-d] [-z|-l|-s|-Z|-w] [-R] filename [begin length]",
         .help       = "dump guest memory into file 'filename'.\n\t\t\t"
                       "-p: do paging to get guest's memory mapping.\n\t\t\t"
                       "-d: return immediately (do not wait for completion).\n\t\t\t"
                       "-z: dump in kdump-compressed format, with zlib compression.\n\t\t\t"
                       "-l: dump in kdump-compressed format, with lzo compression.\n\t\t\t"
                       "-s: dump in kdump-compressed format, with snappy compression.\n\t\t\t"
-                      "-R: when using kdump (-z, -l, -s), use raw rather than makedumpfile-flattened\n\t\t\t"
+                      "-Z: dump in kdump-compressed format, with zstd compression.\n\t\t\t"
+                      "-R: when using kdump (-z, -l, -s, -Z), use raw rather than makedumpfile-flattened\n\t\t\t"
                       "    format\n\t\t\t"
                       "-w: dump in Windows crashdump format (can be used instead of ELF-dump converting),\n\t\t\t"
                       "    for Windows x86 and x64 guests with vmcoreinfo driver only.\n\t\t\t"
@@ -1107,9 +1108,9 @@ ERST
 SRST
 ``dump-guest-memory [-p]`` *filename* *begin* *length*
   \ 
-``dump-guest-memory [-z|-l|-s|-w]`` *filename*
+``dump-guest-memory [-z|-l|-s|-Z|-w]`` *filename*
   Dump guest memory to *protocol*. The file can be processed with crash or
-  gdb. Without ``-z|-l|-s|-w``, the dump format is ELF.
+  gdb. Without ``-z|-l|-s|-Z|-w``, the dump format is ELF.
 
   ``-p``
     do paging to get guest's memory mapping.
@@ -1119,8 +1120,10 @@ SRST
     dump in kdump-compressed format, with lzo compression.
   ``-s``
     dump in kdump-compressed format, with snappy compression.
+  ``-Z``
+    dump in kdump-compressed format, with zstd compression.
   ``-R``
-    when using kdump (-z, -l, -s), use raw rather than makedumpfile-flattened
+    when using kdump (-z, -l, -s, -Z), use raw rather than makedumpfile-flattened
     format
   ``-w``
     dump in Windows crashdump format (can be used instead of ELF-dump converting),
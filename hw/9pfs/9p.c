@@ -1583,6 +1583,8 @@ static void coroutine_fn v9fs_getattr(void *opaque)
     V9fsFidState *fidp;
     uint64_t request_mask;
     V9fsStatDotl v9stat_dotl;
+    uint64_t st_gen;
+    int gen_err;
     V9fsPDU *pdu = opaque;
 
     retval = pdu_unmarshal(pdu, offset, "dq", &fid, &request_mask);
@@ -1598,9 +1600,12 @@ static void coroutine_fn v9fs_getattr(void *opaque)
     }
     /*
      * Currently we only support BASIC fields in stat, so there is no
-     * need to look at request_mask.
+     * need to look at request_mask. st_gen is fetched along with the
+     * stat data if requested, so that a single worker hop is needed.
      */
-    retval = v9fs_co_lstat(pdu, &fidp->path, &stbuf);
+    retval = v9fs_co_lstat_gen(pdu, &fidp->path, &stbuf,
+                               (request_mask & P9_STATS_GEN) ? &st_gen : NULL,
+                               &gen_err);
     if (retval < 0) {
         goto out;
     }
@@ -1609,21 +1614,10 @@ static void coroutine_fn v9fs_getattr(void *opaque)
         goto out;
     }
 
-    /*  fill st_gen if requested and supported by underlying fs */
-    if (request_mask & P9_STATS_GEN) {
-        retval = v9fs_co_st_gen(pdu, &fidp->path, stbuf.st_mode, &v9stat_dotl);
-        switch (retval) {
-        case 0:
-            /* we have valid st_gen: update result mask */
-            v9stat_dotl.st_result_mask |= P9_STATS_GEN;
-            break;
-        case -EINTR:
-            /* request cancelled, e.g. by Tflush */
-            goto out;
-        default:
-            /* failed to get st_gen: not fatal, ignore */
-            break;
-        }
+    /* failing to get st_gen is not fatal, just leave it out of the mask */
+    if (gen_err == 0) {
+        v9stat_dotl.st_gen = st_gen;
+        v9stat_dotl.st_result_mask |= P9_STATS_GEN;
     }
     retval = pdu_marshal(pdu, offset, "A", &v9stat_dotl);
     if (retval < 0) {
@@ -18,14 +18,17 @@
 #include "qemu/module.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
+#include "qemu/bitmap.h"
 #include "block/block_int.h"
 #include "trace.h"
 #include "hw/block/block.h"
 #include "hw/qdev-properties.h"
+#include "hw/qdev-properties-system.h"
 #include "sysemu/blockdev.h"
 #include "sysemu/block-ram-registrar.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/runstate.h"
+#include "sysemu/stats.h"
 #include "hw/virtio/virtio-blk.h"
 #include "dataplane/virtio-blk.h"
 #include "scsi/constants.h"
@@ -51,7 +54,7 @@ static void virtio_blk_init_request(VirtIOBlock *s, VirtQueue *vq,
 
 static void virtio_blk_free_request(VirtIOBlockReq *req)
 {
-    g_free(req);
+    virtqueue_element_free(req->vq, &req->elem);
 }
 
 static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
@@ -235,14 +238,17 @@ out:
 
 #endif
 
-static VirtIOBlockReq *virtio_blk_get_request(VirtIOBlock *s, VirtQueue *vq)
+static unsigned int virtio_blk_get_requests(VirtIOBlock *s, VirtQueue *vq,
+                                            VirtIOBlockReq **reqs,
+                                            unsigned int max)
 {
-    VirtIOBlockReq *req = virtqueue_pop(vq, sizeof(VirtIOBlockReq));
+    unsigned int i, n;
 
-    if (req) {
-        virtio_blk_init_request(s, vq, req);
+    n = virtqueue_pop_batch(vq, sizeof(VirtIOBlockReq), (void **)reqs, max);
+    for (i = 0; i < n; i++) {
+        virtio_blk_init_request(s, vq, reqs[i]);
     }
-    return req;
+    return n;
 }
 
 static int virtio_blk_handle_scsi_req(VirtIOBlockReq *req)
@@ -491,8 +497,8 @@ static void virtio_blk_handle_flush(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 {
     VirtIOBlock *s = req->dev;
 
-    block_acct_start(blk_get_stats(s->blk), &req->acct, 0,
-                     BLOCK_ACCT_FLUSH);
+    block_acct_start_queue(blk_get_stats(s->blk), &req->acct, 0,
+                           BLOCK_ACCT_FLUSH, virtio_get_queue_index(req->vq));
 
     /*
      * Make sure all outstanding writes are posted to the backing device.
@@ -574,8 +580,9 @@ static uint8_t virtio_blk_handle_discard_write_zeroes(VirtIOBlockReq *req,
             blk_aio_flags |= BDRV_REQ_MAY_UNMAP;
         }
 
-        block_acct_start(blk_get_stats(s->blk), &req->acct, bytes,
-                         BLOCK_ACCT_WRITE);
+        block_acct_start_queue(blk_get_stats(s->blk), &req->acct, bytes,
+                               BLOCK_ACCT_WRITE,
+                               virtio_get_queue_index(req->vq));
 
         blk_aio_pwrite_zeroes(s->blk, sector << BDRV_SECTOR_BITS,
                               bytes, blk_aio_flags,
@@ -933,8 +940,9 @@ static int virtio_blk_handle_zone_append(VirtIOBlockReq *req,
     data->zone_append_data.offset = offset;
     qemu_iovec_init_external(&req->qiov, out_iov, out_num);
 
-    block_acct_start(blk_get_stats(s->blk), &req->acct, len,
-                     BLOCK_ACCT_ZONE_APPEND);
+    block_acct_start_queue(blk_get_stats(s->blk), &req->acct, len,
+                           BLOCK_ACCT_ZONE_APPEND,
+                           virtio_get_queue_index(req->vq));
 
     blk_aio_zone_append(s->blk, &data->zone_append_data.offset, &req->qiov, 0,
                         virtio_blk_zone_append_complete, data);
@@ -1015,8 +1023,10 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
             return 0;
         }
 
-        block_acct_start(blk_get_stats(s->blk), &req->acct, req->qiov.size,
-                         is_write ? BLOCK_ACCT_WRITE : BLOCK_ACCT_READ);
+        block_acct_start_queue(blk_get_stats(s->blk), &req->acct,
+                               req->qiov.size,
+                               is_write ? BLOCK_ACCT_WRITE : BLOCK_ACCT_READ,
+                               virtio_get_queue_index(req->vq));
 
         /* merge would exceed maximum number of requests or IO direction
          * changes */
@@ -1130,7 +1140,8 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 
 void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
 {
-    VirtIOBlockReq *req;
+    VirtIOBlockReq *reqs[VIRTQUEUE_POP_BATCH];
+    unsigned int i, n;
     MultiReqBuffer mrb = {};
     bool suppress_notifications = virtio_queue_get_notification(vq);
 
@@ -1142,10 +1153,18 @@ void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
             virtio_queue_set_notification(vq, 0);
         }
 
-        while ((req = virtio_blk_get_request(s, vq))) {
-            if (virtio_blk_handle_request(req, &mrb)) {
-                virtqueue_detach_element(req->vq, &req->elem, 0);
-                virtio_blk_free_request(req);
+        while ((n = virtio_blk_get_requests(s, vq, reqs, ARRAY_SIZE(reqs)))) {
+            for (i = 0; i < n; i++) {
+                if (virtio_blk_handle_request(reqs[i], &mrb)) {
+                    break;
+                }
+            }
+            if (i < n) {
+                /* The device is broken, drop the rest of the batch */
+                for (; i < n; i++) {
+                    virtqueue_detach_element(reqs[i]->vq, &reqs[i]->elem, 0);
+                    virtio_blk_free_request(reqs[i]);
+                }
                 break;
             }
         }
@@ -1512,7 +1531,6 @@ static void virtio_blk_drained_begin(void *opaque)
 {
     VirtIOBlock *s = opaque;
     VirtIODevice *vdev = VIRTIO_DEVICE(opaque);
-    AioContext *ctx = blk_get_aio_context(s->conf.conf.blk);
 
     if (!s->dataplane || !s->dataplane_started) {
         return;
@@ -1520,6 +1538,8 @@ static void virtio_blk_drained_begin(void *opaque)
 
     for (uint16_t i = 0; i < s->conf.num_queues; i++) {
         VirtQueue *vq = virtio_get_queue(vdev, i);
+        AioContext *ctx = virtio_blk_data_plane_vq_context(s->dataplane, i);
+
         virtio_queue_aio_detach_host_notifier(vq, ctx);
     }
 }
@@ -1529,7 +1549,6 @@ static void virtio_blk_drained_end(void *opaque)
 {
     VirtIOBlock *s = opaque;
     VirtIODevice *vdev = VIRTIO_DEVICE(opaque);
-    AioContext *ctx = blk_get_aio_context(s->conf.conf.blk);
 
     if (!s->dataplane || !s->dataplane_started) {
         return;
@@ -1537,16 +1556,133 @@ static void virtio_blk_drained_end(void *opaque)
 
     for (uint16_t i = 0; i < s->conf.num_queues; i++) {
         VirtQueue *vq = virtio_get_queue(vdev, i);
+        AioContext *ctx = virtio_blk_data_plane_vq_context(s->dataplane, i);
+
         virtio_queue_aio_attach_host_notifier(vq, ctx);
     }
 }
 
+static bool
+validate_iothread_vq_mapping_list(IOThreadVirtQueueMappingList *list,
+                                  uint16_t num_queues, Error **errp)
+{
+    g_autofree unsigned long *vqs = bitmap_new(num_queues);
+    g_autoptr(GHashTable) iothreads =
+        g_hash_table_new(g_str_hash, g_str_equal);
+
+    for (IOThreadVirtQueueMappingList *node = list; node; node = node->next) {
+        const char *name = node->value->iothread;
+        uint16List *vq;
+
+        if (!iothread_by_id(name)) {
+            error_setg(errp, "IOThread \"%s\" object does not exist", name);
+            return false;
+        }
+
+        if (!g_hash_table_add(iothreads, (gpointer)name)) {
+            error_setg(errp,
+                    "duplicate IOThread name \"%s\" in iothread-vq-mapping",
+                    name);
+            return false;
+        }
+
+        if (node != list) {
+            if (!!node->value->vqs != !!list->value->vqs) {
+                error_setg(errp, "either all items in iothread-vq-mapping "
+                                 "must have vqs or none of them must have it");
+                return false;
+            }
+        }
+
+        for (vq = node->value->vqs; vq; vq = vq->next) {
+            if (vq->value >= num_queues) {
+                error_setg(errp, "vq index %u for IOThread \"%s\" must be "
+                        "less than num_queues %u in iothread-vq-mapping",
+                        vq->value, name, num_queues);
+                return false;
+            }
+
+            if (test_and_set_bit(vq->value, vqs)) {
+                error_setg(errp, "cannot assign vq %u to IOThread \"%s\" "
+                        "because it is already assigned", vq->value, name);
+                return false;
+            }
+        }
+    }
+
+    if (list->value->vqs) {
+        for (uint16_t i = 0; i < num_queues; i++) {
+            if (!test_bit(i, vqs)) {
+                error_setg(errp,
+                        "missing vq %u IOThread assignment in "
+                        "iothread-vq-mapping", i);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
 static const BlockDevOps virtio_block_ops = {
     .resize_cb     = virtio_blk_resize,
     .drained_begin = virtio_blk_drained_begin,
     .drained_end   = virtio_blk_drained_end,
 };
 
+/*
+ * Give each virtqueue its own latency histogram in the BlockBackend's
+ * accounting, labelled with the IOThread that serves it, so that a
+ * saturated queue or IOThread shows up in query-blockstats.
+ */
+static void virtio_blk_setup_queue_stats(VirtIOBlock *s)
+{
+    VirtIOBlkConf *conf = &s->conf;
+    BlockAcctStats *stats = blk_get_stats(s->blk);
+    IOThreadVirtQueueMappingList *node;
+    unsigned num_iothreads = 0;
+    unsigned cur_iothread = 0;
+
+    block_acct_set_queues(stats, conf->num_queues);
+    if (!s->dataplane) {
+        return;
+    }
+
+    if (conf->iothread) {
+        const char *id =
+            object_get_canonical_path_component(OBJECT(conf->iothread));
+
+        for (unsigned i = 0; i < conf->num_queues; i++) {
+            block_acct_set_queue_iothread(stats, i, id);
+        }
+        return;
+    }
+
+    /* Same assignment as apply_vq_mapping() in the dataplane code */
+    for (node = conf->iothread_vq_mapping_list; node; node = node->next) {
+        num_iothreads++;
+    }
+
+    for (node = conf->iothread_vq_mapping_list; node; node = node->next) {
+        const char *id = node->value->iothread;
+
+        if (node->value->vqs) {
+            uint16List *vq;
+
+            for (vq = node->value->vqs; vq; vq = vq->next) {
+                block_acct_set_queue_iothread(stats, vq->value, id);
+            }
+        } else {
+            for (unsigned i = cur_iothread; i < conf->num_queues;
+                 i += num_iothreads) {
+                block_acct_set_queue_iothread(stats, i, id);
+            }
+        }
+
+        cur_iothread++;
+    }
+}
+
 static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(dev);
@@ -1583,6 +1719,19 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    if (conf->iothread_vq_mapping_list) {
+        if (conf->iothread) {
+            error_setg(errp, "iothread and iothread-vq-mapping properties "
+                             "cannot be set at the same time");
+            return;
+        }
+
+        if (!validate_iothread_vq_mapping_list(conf->iothread_vq_mapping_list,
+                                               conf->num_queues, errp)) {
+            return;
+        }
+    }
+
     if (!blkconf_apply_backend_options(&conf->conf,
                                        !blk_supports_write_perm(conf->conf.blk),
                                        true, errp)) {
@@ -1633,7 +1782,10 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
     s->sector_mask = (s->conf.conf.logical_block_size / BDRV_SECTOR_SIZE) - 1;
 
     for (i = 0; i < conf->num_queues; i++) {
-        virtio_add_queue(vdev, conf->queue_size, virtio_blk_handle_output);
+        VirtQueue *vq = virtio_add_queue(vdev, conf->queue_size,
+                                         virtio_blk_handle_output);
+
+        virtio_queue_enable_element_pool(vq);
     }
     qemu_coroutine_inc_pool_size(conf->num_queues * conf->queue_size / 2);
     virtio_blk_data_plane_create(vdev, conf, &s->dataplane, &err);
@@ -1657,6 +1809,7 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
     blk_set_dev_ops(s->blk, &virtio_block_ops, s);
 
     blk_iostatus_enable(s->blk);
+    virtio_blk_setup_queue_stats(s);
 
     add_boot_device_lchs(dev, "/disk@0,0",
                          conf->conf.lcyls,
@@ -1672,6 +1825,7 @@ static void virtio_blk_device_unrealize(DeviceState *dev)
     unsigned i;
 
     blk_drain(s->blk);
+    block_acct_set_queues(blk_get_stats(s->blk), 0);
     del_boot_device_lchs(dev, "/disk@0,0");
     virtio_blk_data_plane_destroy(s->dataplane);
     s->dataplane = NULL;
@@ -1698,6 +1852,7 @@ static const VMStateDescription vmstate_virtio_blk = {
     .name = "virtio-blk",
     .minimum_version_id = 2,
     .version_id = 2,
+    .parallel_save = true,
     .fields = (VMStateField[]) {
         VMSTATE_VIRTIO_DEVICE,
         VMSTATE_END_OF_LIST()
@@ -1723,6 +1878,8 @@ static Property virtio_blk_properties[] = {
     DEFINE_PROP_BOOL("seg-max-adjust", VirtIOBlock, conf.seg_max_adjust, true),
     DEFINE_PROP_LINK("iothread", VirtIOBlock, conf.iothread, TYPE_IOTHREAD,
                      IOThread *),
+    DEFINE_PROP_IOTHREAD_VQ_MAPPING_LIST("iothread-vq-mapping", VirtIOBlock,
+                                         conf.iothread_vq_mapping_list),
     DEFINE_PROP_BIT64("discard", VirtIOBlock, host_features,
                       VIRTIO_BLK_F_DISCARD, true),
     DEFINE_PROP_BOOL("report-discard-granularity", VirtIOBlock,
@@ -1738,6 +1895,118 @@ static Property virtio_blk_properties[] = {
     DEFINE_PROP_END_OF_LIST(),
 };
 
+static const struct {
+    const char *name;
+    enum BlockAcctType type;
+    size_t offset;
+} virtio_blk_latency_stats[] = {
+#define VIRTIO_BLK_LATENCY_STAT(name, type, field) \
+    { name, type, offsetof(BlockAcctLatencySummary, field) }
+    VIRTIO_BLK_LATENCY_STAT("rd-latency-p50", BLOCK_ACCT_READ, p50_ns),
+    VIRTIO_BLK_LATENCY_STAT("rd-latency-p99", BLOCK_ACCT_READ, p99_ns),
+    VIRTIO_BLK_LATENCY_STAT("rd-latency-p999", BLOCK_ACCT_READ, p999_ns),
+    VIRTIO_BLK_LATENCY_STAT("wr-latency-p50", BLOCK_ACCT_WRITE, p50_ns),
+    VIRTIO_BLK_LATENCY_STAT("wr-latency-p99", BLOCK_ACCT_WRITE, p99_ns),
+    VIRTIO_BLK_LATENCY_STAT("wr-latency-p999", BLOCK_ACCT_WRITE, p999_ns),
+    VIRTIO_BLK_LATENCY_STAT("flush-latency-p50", BLOCK_ACCT_FLUSH, p50_ns),
+    VIRTIO_BLK_LATENCY_STAT("flush-latency-p99", BLOCK_ACCT_FLUSH, p99_ns),
+    VIRTIO_BLK_LATENCY_STAT("flush-latency-p999", BLOCK_ACCT_FLUSH, p999_ns),
+#undef VIRTIO_BLK_LATENCY_STAT
+};
+
+typedef struct VirtIOBlkStatsArgs {
+    StatsResultList **result;
+    strList *names;
+} VirtIOBlkStatsArgs;
+
+static int virtio_blk_stats_query(Object *obj, void *opaque)
+{
+    VirtIOBlkStatsArgs *args = opaque;
+    VirtIOBlock *s;
+    BlockAcctStats *stats;
+    StatsList *stats_list = NULL;
+    g_autofree char *path = NULL;
+
+    if (!object_dynamic_cast(obj, TYPE_VIRTIO_BLK) ||
+        !DEVICE(obj)->realized) {
+        return 0;
+    }
+    s = VIRTIO_BLK(obj);
+    stats = blk_get_stats(s->blk);
+
+    for (int i = ARRAY_SIZE(virtio_blk_latency_stats) - 1; i >= 0; i--) {
+        const char *name = virtio_blk_latency_stats[i].name;
+        enum BlockAcctType type = virtio_blk_latency_stats[i].type;
+        size_t offset = virtio_blk_latency_stats[i].offset;
+        uint64List *values = NULL;
+        Stats *st;
+
+        if (!apply_str_list_filter(name, args->names)) {
+            continue;
+        }
+
+        /* One value per virtqueue */
+        for (int q = stats->nr_queues - 1; q >= 0; q--) {
+            BlockAcctLatencySummary sum;
+            uint64_t *value = (uint64_t *)((char *)&sum + offset);
+
+            block_acct_queue_latency(stats, q, type, &sum);
+            QAPI_LIST_PREPEND(values, *value);
+        }
+
+        st = g_new0(Stats, 1);
+        st->name = g_strdup(name);
+        st->value = g_new0(StatsValue, 1);
+        st->value->type = QTYPE_QLIST;
+        st->value->u.list = values;
+        QAPI_LIST_PREPEND(stats_list, st);
+    }
+
+    if (stats_list) {
+        path = object_get_canonical_path(obj);
+        add_stats_entry(args->result, STATS_PROVIDER_BLOCK, path, stats_list);
+    }
+    return 0;
+}
+
+static void virtio_blk_stats_cb(StatsResultList **result, StatsTarget target,
+                                strList *names, strList *targets,
+                                Error **errp)
+{
+    VirtIOBlkStatsArgs args = {
+        .result = result,
+        .names = names,
+    };
+
+    if (target != STATS_TARGET_BLOCK) {
+        return;
+    }
+
+    object_child_foreach_recursive(object_get_root(), virtio_blk_stats_query,
+                                   &args);
+}
+
+static void virtio_blk_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *stats_list = NULL;
+
+    for (int i = ARRAY_SIZE(virtio_blk_latency_stats) - 1; i >= 0; i--) {
+        StatsSchemaValue *value = g_new0(StatsSchemaValue, 1);
+
+        value->name = g_strdup(virtio_blk_latency_stats[i].name);
+        value->type = STATS_TYPE_INSTANT;
+        value->unit = STATS_UNIT_SECONDS;
+        value->has_unit = true;
+        value->base = 10;
+        value->has_base = true;
+        value->exponent = -9;
+        QAPI_LIST_PREPEND(stats_list, value);
+    }
+
+    add_stats_schema(result, STATS_PROVIDER_BLOCK, STATS_TARGET_BLOCK,
+                     stats_list);
+}
+
 static void virtio_blk_class_init(ObjectClass *klass, void *data)
 {
     DeviceClass *dc = DEVICE_CLASS(klass);
@@ -1757,6 +2026,9 @@ static void virtio_blk_class_init(ObjectClass *klass, void *data)
     vdc->load = virtio_blk_load_device;
     vdc->start_ioeventfd = virtio_blk_data_plane_start;
     vdc->stop_ioeventfd = virtio_blk_data_plane_stop;
+
+    add_stats_callbacks(STATS_PROVIDER_BLOCK, virtio_blk_stats_cb,
+                        virtio_blk_schemas_cb);
 }
 
 static const TypeInfo virtio_blk_info = {
@@ -13,7 +13,9 @@
 #include "qemu/osdep.h"
 #include "chardev/char-fe.h"
 #include "qemu/error-report.h"
+#include "qemu/iov.h"
 #include "qemu/module.h"
+#include "qemu/units.h"
 #include "trace.h"
 #include "hw/qdev-properties.h"
 #include "hw/qdev-properties-system.h"
@@ -27,6 +29,9 @@ typedef struct VirtConsole VirtConsole;
 DECLARE_INSTANCE_CHECKER(VirtConsole, VIRTIO_CONSOLE,
                          TYPE_VIRTIO_CONSOLE_SERIAL_PORT)
 
+/* Largest chunk of guest data gathered for a single chardev write */
+#define VIRTIO_CONSOLE_BULK_SIZE (64 * KiB)
+
 struct VirtConsole {
     VirtIOSerialPort parent_obj;
 
@@ -48,6 +53,42 @@ static gboolean chr_write_unblocked(void *do_not_use, GIOCondition cond,
     return G_SOURCE_REMOVE;
 }
 
+/* The chardev did not take all the data, wait until it is writable */
+static void flush_buf_short_write(VirtConsole *vcon)
+{
+    VirtIOSerialPort *port = VIRTIO_SERIAL_PORT(vcon);
+    VirtIOSerialPortClass *k = VIRTIO_SERIAL_PORT_GET_CLASS(port);
+
+    /* XXX we should be queuing data to send later for the
+     * console devices too rather than silently dropping
+     * console data on EAGAIN. The Linux virtio-console
+     * hvc driver though does sends with spinlocks held,
+     * so if we enable throttling that'll stall the entire
+     * guest kernel, not merely the process writing to the
+     * console.
+     *
+     * While we could queue data for later write without
+     * enabling throttling, this would result in the guest
+     * being able to trigger arbitrary memory usage in QEMU
+     * buffering data for later writes.
+     *
+     * So fixing this problem likely requires fixing the
+     * Linux virtio-console hvc driver to not hold spinlocks
+     * while writing, and instead merely block the process
+     * that's writing. QEMU would then need some way to detect
+     * if the guest had the fixed driver too, before we can
+     * use throttling on host side.
+     */
+    if (!k->is_console) {
+        virtio_serial_throttle_port(port, true);
+        if (!vcon->watch) {
+            vcon->watch = qemu_chr_fe_add_watch(&vcon->chr,
+                                                G_IO_OUT|G_IO_HUP,
+                                                chr_write_unblocked, vcon);
+        }
+    }
+}
+
 /* Callback function that's called when the guest sends us data */
 static ssize_t flush_buf(VirtIOSerialPort *port,
                          const uint8_t *buf, ssize_t len)
@@ -64,8 +105,6 @@ static ssize_t flush_buf(VirtIOSerialPort *port,
     trace_virtio_console_flush_buf(port->id, len, ret);
 
     if (ret < len) {
-        VirtIOSerialPortClass *k = VIRTIO_SERIAL_PORT_GET_CLASS(port);
-
         /*
          * Ideally we'd get a better error code than just -1, but
          * that's what the chardev interface gives us right now.  If
@@ -75,38 +114,48 @@ static ssize_t flush_buf(VirtIOSerialPort *port,
         if (ret < 0)
             ret = 0;
 
-        /* XXX we should be queuing data to send later for the
-         * console devices too rather than silently dropping
-         * console data on EAGAIN. The Linux virtio-console
-         * hvc driver though does sends with spinlocks held,
-         * so if we enable throttling that'll stall the entire
-         * guest kernel, not merely the process writing to the
-         * console.
-         *
-         * While we could queue data for later write without
-         * enabling throttling, this would result in the guest
-         * being able to trigger arbitrary memory usage in QEMU
-         * buffering data for later writes.
-         *
-         * So fixing this problem likely requires fixing the
-         * Linux virtio-console hvc driver to not hold spinlocks
-         * while writing, and instead merely block the process
-         * that's writing. QEMU would then need some way to detect
-         * if the guest had the fixed driver too, before we can
-         * use throttling on host side.
-         */
-        if (!k->is_console) {
-            virtio_serial_throttle_port(port, true);
-            if (!vcon->watch) {
-                vcon->watch = qemu_chr_fe_add_watch(&vcon->chr,
-                                                    G_IO_OUT|G_IO_HUP,
-                                                    chr_write_unblocked, vcon);
-            }
-        }
+        flush_buf_short_write(vcon);
     }
     return ret;
 }
 
+/*
+ * Callback function that's called when the guest sends us data spread
+ * over several buffers.  The data is gathered so that the chardev sees
+ * one write per VIRTIO_CONSOLE_BULK_SIZE bytes instead of one per buffer.
+ */
+static ssize_t flush_iov(VirtIOSerialPort *port,
+                         const struct iovec *iov, int iovcnt)
+{
+    VirtConsole *vcon = VIRTIO_CONSOLE(port);
+    size_t size = iov_size(iov, iovcnt);
+    size_t chunk = MIN(size, VIRTIO_CONSOLE_BULK_SIZE);
+    g_autofree uint8_t *buf = NULL;
+    size_t offset = 0, len;
+    ssize_t ret;
+
+    if (!qemu_chr_fe_backend_connected(&vcon->chr)) {
+        /* If there's no backend, we can just say we consumed all data. */
+        return size;
+    }
+
+    buf = g_malloc(chunk);
+    while (offset < size) {
+        len = iov_to_buf(iov, iovcnt, offset, buf, chunk);
+        ret = qemu_chr_fe_write(&vcon->chr, buf, len);
+        trace_virtio_console_flush_buf(port->id, len, ret);
+
+        if (ret > 0) {
+            offset += ret;
+        }
+        if (ret < (ssize_t)len) {
+            flush_buf_short_write(vcon);
+            break;
+        }
+    }
+    return offset;
+}
+
 /* Callback function that's called when the guest opens/closes the port */
 static void set_guest_connected(VirtIOSerialPort *port, int guest_connected)
 {
@@ -287,6 +336,7 @@ static void virtserialport_class_init(ObjectClass *klass, void *data)
     k->realize = virtconsole_realize;
     k->unrealize = virtconsole_unrealize;
     k->have_data = flush_buf;
+    k->have_data_iov = flush_iov;
     k->set_guest_connected = set_guest_connected;
     k->enable_backend = virtconsole_enable_backend;
     k->guest_writable = guest_writable;
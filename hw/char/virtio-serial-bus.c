@@ -157,6 +157,119 @@ static void discard_throttle_data(VirtIOSerialPort *port)
     }
 }
 
+/* Maximum number of elements handed to have_data_iov at once */
+#define VIRTIO_SERIAL_BULK_ELEMS 16
+
+/*
+ * Point port->iov_idx and port->iov_offset at byte @offset of the out
+ * buffers of port->elem.
+ */
+static void set_elem_offset(VirtIOSerialPort *port, size_t offset)
+{
+    unsigned int i;
+
+    for (i = 0; i < port->elem->out_num - 1; i++) {
+        if (offset < port->elem->out_sg[i].iov_len) {
+            break;
+        }
+        offset -= port->elem->out_sg[i].iov_len;
+    }
+    port->iov_idx = i;
+    port->iov_offset = offset;
+}
+
+/*
+ * Hand the data of up to VIRTIO_SERIAL_BULK_ELEMS elements to the port at
+ * once.  If the port gets throttled, the element it stopped in becomes
+ * port->elem and the ones after it are put back into the virtqueue.
+ */
+static void do_flush_queued_data_iov(VirtIOSerialPort *port, VirtQueue *vq,
+                                     VirtIODevice *vdev)
+{
+    VirtIOSerialPortClass *vsc = VIRTIO_SERIAL_PORT_GET_CLASS(port);
+    VirtQueueElement *elems[VIRTIO_SERIAL_BULK_ELEMS];
+    size_t len[VIRTIO_SERIAL_BULK_ELEMS];
+    struct iovec iov[VIRTQUEUE_MAX_SIZE];
+    size_t skip, done;
+    ssize_t ret;
+    int i, n, iovcnt;
+
+    while (!port->throttled) {
+        n = 0;
+        iovcnt = 0;
+        skip = 0;
+
+        /* Start with the element we left off mid-way, if any */
+        if (port->elem) {
+            for (i = 0; i < port->iov_idx; i++) {
+                skip += port->elem->out_sg[i].iov_len;
+            }
+            skip += port->iov_offset;
+            iovcnt = iov_copy(iov, ARRAY_SIZE(iov), port->elem->out_sg,
+                              port->elem->out_num, skip, SIZE_MAX);
+            len[n] = iov_size(iov, iovcnt);
+            elems[n++] = port->elem;
+        }
+
+        while (n < VIRTIO_SERIAL_BULK_ELEMS) {
+            VirtQueueElement *elem = virtqueue_pop(vq,
+                                                   sizeof(VirtQueueElement));
+
+            if (!elem) {
+                break;
+            }
+            if (iovcnt + elem->out_num > ARRAY_SIZE(iov)) {
+                virtqueue_unpop(vq, elem, 0);
+                g_free(elem);
+                break;
+            }
+            memcpy(&iov[iovcnt], elem->out_sg,
+                   elem->out_num * sizeof(struct iovec));
+            iovcnt += elem->out_num;
+            len[n] = iov_size(elem->out_sg, elem->out_num);
+            elems[n++] = elem;
+        }
+        if (!n) {
+            break;
+        }
+
+        port->elem = elems[0];
+        ret = vsc->have_data_iov(port, iov, iovcnt);
+        if (!port->elem) { /* bail if we got disconnected */
+            virtqueue_rewind(vq, n - 1);
+            for (i = 1; i < n; i++) {
+                g_free(elems[i]);
+            }
+            return;
+        }
+
+        done = ret > 0 ? ret : 0;
+        for (i = 0; i < n; i++) {
+            /* Unless throttled, the port consumed everything it was given */
+            if (port->throttled && done < len[i]) {
+                break;
+            }
+            done -= MIN(done, len[i]);
+            virtqueue_fill(vq, elems[i], 0, i);
+        }
+        virtqueue_flush(vq, i);
+
+        if (i < n) {
+            port->elem = elems[i];
+            set_elem_offset(port, (i ? 0 : skip) + done);
+            virtqueue_rewind(vq, n - i - 1);
+        } else {
+            port->elem = NULL;
+        }
+        while (n--) {
+            if (elems[n] != port->elem) {
+                g_free(elems[n]);
+            }
+        }
+    }
+    virtio_notify(vdev, vq);
+}
+
 static void do_flush_queued_data(VirtIOSerialPort *port, VirtQueue *vq,
                                  VirtIODevice *vdev)
 {
@@ -166,6 +279,10 @@ static void do_flush_queued_data(VirtIOSerialPort *port, VirtQueue *vq,
     assert(virtio_queue_ready(vq));
 
     vsc = VIRTIO_SERIAL_PORT_GET_CLASS(port);
+    if (vsc->have_data_iov) {
+        do_flush_queued_data_iov(port, vq, vdev);
+        return;
+    }
 
     while (!port->throttled) {
         unsigned int i;
@@ -88,6 +88,14 @@ static uint64_t cxl_cache_mem_read_reg(void *opaque, hwaddr offset,
     }
 }
 
+static NotifierList cxl_hdm_notifiers =
+    NOTIFIER_LIST_INITIALIZER(cxl_hdm_notifiers);
+
+void cxl_hdm_add_notifier(Notifier *n)
+{
+    notifier_list_add(&cxl_hdm_notifiers, n);
+}
+
 static void dumb_hdm_handler(CXLComponentState *cxl_cstate, hwaddr offset,
                              uint32_t value)
 {
@@ -116,6 +124,10 @@ static void dumb_hdm_handler(CXLComponentState *cxl_cstate, hwaddr offset,
         value = FIELD_DP32(value, CXL_HDM_DECODER0_CTRL, COMMITTED, 0);
     }
     stl_le_p((uint8_t *)cache_mem + offset, value);
+
+    if (should_commit || should_uncommit) {
+        notifier_list_notify(&cxl_hdm_notifiers, cxl_cstate);
+    }
 }
 
 static void cxl_cache_mem_write_reg(void *opaque, hwaddr offset, uint64_t value,
@@ -11,6 +11,7 @@
 #include "qemu/error-report.h"
 #include "qapi/error.h"
 #include "sysemu/qtest.h"
+#include "exec/address-spaces.h"
 #include "hw/boards.h"
 
 #include "qapi/qapi-visit-machine.h"
@@ -97,8 +98,12 @@ void cxl_fmws_link_targets(CXLState *cxl_state, Error **errp)
     }
 }
 
+/*
+ * If @len is not NULL, it is clamped to the number of bytes from @addr
+ * that are routed to the same target.
+ */
 static bool cxl_hdm_find_target(uint32_t *cache_mem, hwaddr addr,
-                                uint8_t *target)
+                                uint8_t *target, uint64_t *len)
 {
     int hdm_inc = R_CXL_HDM_DECODER1_BASE_LO - R_CXL_HDM_DECODER0_BASE_LO;
     unsigned int hdm_count;
@@ -133,6 +138,11 @@ static bool cxl_hdm_find_target(uint32_t *cache_mem, hwaddr addr,
         ig_enc = FIELD_EX32(ctrl, CXL_HDM_DECODER0_CTRL, IG);
         iw_enc = FIELD_EX32(ctrl, CXL_HDM_DECODER0_CTRL, IW);
         target_idx = (addr / cxl_decode_ig(ig_enc)) % (1 << iw_enc);
+        if (len) {
+            *len = MIN(*len, iw_enc ?
+                       cxl_decode_ig(ig_enc) - addr % cxl_decode_ig(ig_enc) :
+                       base + size - addr);
+        }
 
         if (target_idx < 4) {
             uint32_t val = ldl_le_p(cache_mem +
@@ -151,7 +161,8 @@ static bool cxl_hdm_find_target(uint32_t *cache_mem, hwaddr addr,
     return found;
 }
 
-static PCIDevice *cxl_cfmws_find_device(CXLFixedWindow *fw, hwaddr addr)
+static PCIDevice *cxl_cfmws_find_device(CXLFixedWindow *fw, hwaddr addr,
+                                        uint64_t *len)
 {
     CXLComponentState *hb_cstate, *usp_cstate;
     PCIHostState *hb;
@@ -166,6 +177,10 @@ static PCIDevice *cxl_cfmws_find_device(CXLFixedWindow *fw, hwaddr addr)
     addr += fw->base;
 
     rb_index = (addr / cxl_decode_ig(fw->enc_int_gran)) % fw->num_targets;
+    if (len && fw->num_targets > 1) {
+        *len = MIN(*len, cxl_decode_ig(fw->enc_int_gran) -
+                   addr % cxl_decode_ig(fw->enc_int_gran));
+    }
     hb = PCI_HOST_BRIDGE(fw->target_hbs[rb_index]->cxl_host_bridge);
     if (!hb || !hb->bus || !pci_bus_is_cxl(hb->bus)) {
         return NULL;
@@ -184,7 +199,7 @@ static PCIDevice *cxl_cfmws_find_device(CXLFixedWindow *fw, hwaddr addr)
 
         cache_mem = hb_cstate->crb.cache_mem_registers;
 
-        target_found = cxl_hdm_find_target(cache_mem, addr, &target);
+        target_found = cxl_hdm_find_target(cache_mem, addr, &target, len);
         if (!target_found) {
             return NULL;
         }
@@ -220,7 +235,7 @@ static PCIDevice *cxl_cfmws_find_device(CXLFixedWindow *fw, hwaddr addr)
 
     cache_mem = usp_cstate->crb.cache_mem_registers;
 
-    target_found = cxl_hdm_find_target(cache_mem, addr, &target);
+    target_found = cxl_hdm_find_target(cache_mem, addr, &target, len);
     if (!target_found) {
         return NULL;
     }
@@ -248,7 +263,7 @@ static MemTxResult cxl_read_cfmws(void *opaque, hwaddr addr, uint64_t *data,
     CXLFixedWindow *fw = opaque;
     PCIDevice *d;
 
-    d = cxl_cfmws_find_device(fw, addr);
+    d = cxl_cfmws_find_device(fw, addr, NULL);
     if (d == NULL) {
         *data = 0;
         /* Reads to invalid address return poison */
@@ -265,7 +280,7 @@ static MemTxResult cxl_write_cfmws(void *opaque, hwaddr addr,
     CXLFixedWindow *fw = opaque;
     PCIDevice *d;
 
-    d = cxl_cfmws_find_device(fw, addr);
+    d = cxl_cfmws_find_device(fw, addr, NULL);
     if (d == NULL) {
         /* Writes to invalid address are silent */
         return MEMTX_OK;
@@ -274,6 +289,39 @@ static MemTxResult cxl_write_cfmws(void *opaque, hwaddr addr,
     return cxl_type3_write(d, addr + fw->base, data, size, attrs);
 }
 
+/*
+ * Find the fixed memory window that contains the @size bytes at host
+ * physical address @hpa, provided that all of them are routed to @d, i.e.
+ * that neither the window nor the host bridge and switch decoders on the
+ * way interleave them.  The type 3 device can then map its memory straight
+ * into the window.
+ *
+ * Returns NULL if there is no such window.
+ */
+CXLFixedWindow *cxl_fmws_find_direct(PCIDevice *d, hwaddr hpa,
+                                     uint64_t size)
+{
+    MemoryRegionSection section;
+    CXLFixedWindow *fw = NULL;
+    uint64_t len = size;
+
+    section = memory_region_find(get_system_memory(), hpa, 1);
+    if (!section.mr) {
+        return NULL;
+    }
+    if (section.mr->ops == &cfmws_ops) {
+        fw = section.mr->opaque;
+    }
+    memory_region_unref(section.mr);
+
+    if (!fw || hpa + size > fw->base + fw->size ||
+        cxl_cfmws_find_device(fw, hpa - fw->base, &len) != d || len < size) {
+        return NULL;
+    }
+
+    return fw;
+}
+
 const MemoryRegionOps cfmws_ops = {
     .read_with_attrs = cxl_read_cfmws,
     .write_with_attrs = cxl_write_cfmws,
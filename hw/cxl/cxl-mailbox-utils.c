@@ -1000,6 +1000,8 @@ static CXLRetCode cmd_sanitize_overwrite(const struct cxl_cmd *cmd,
     *len_out = 0;
 
     cxl_dev_disable_media(&ct3d->cxl_dstate);
+    /* Guest accesses must see random data until sanitization completes */
+    cxl_type3_direct_unmap(ct3d);
 
     if (secs > 2) {
         /* sanitize when done */
@@ -9,7 +9,7 @@ bool virtio_gpu_have_udmabuf(void)
 
 void virtio_gpu_init_udmabuf(struct virtio_gpu_simple_resource *res)
 {
-    /* nothing (stub) */
+    res->dmabuf_fd = -1;
 }
 
 void virtio_gpu_fini_udmabuf(struct virtio_gpu_simple_resource *res)
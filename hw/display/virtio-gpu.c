@@ -28,6 +28,7 @@
 #include "hw/virtio/virtio-bus.h"
 #include "hw/qdev-properties.h"
 #include "qemu/log.h"
+#include "qemu/memfd.h"
 #include "qemu/module.h"
 #include "qapi/error.h"
 #include "qemu/error-report.h"
@@ -247,6 +248,46 @@ win32_pixman_image_destroy(pixman_image_t *image, void *data)
 
     qemu_win32_map_free(pixman_image_get_data(image), handle, &error_warn);
 }
+#else
+static void
+memfd_pixman_image_destroy(pixman_image_t *image, void *data)
+{
+    qemu_memfd_free(pixman_image_get_data(image),
+                    pixman_image_get_stride(image) *
+                    pixman_image_get_height(image),
+                    GPOINTER_TO_INT(data));
+}
+
+/*
+ * Allocate the host copy of a 2D resource in a memfd, so that it can be
+ * shared with out-of-process display clients.  Falls back to anonymous
+ * memory allocated by pixman if memfd is not available.
+ */
+static void *virtio_gpu_alloc_shm(struct virtio_gpu_simple_resource *res)
+{
+    res->shmfd = -1;
+    if (!res->hostmem) {
+        return NULL;
+    }
+    return qemu_memfd_alloc("virtio-gpu-res", res->hostmem, 0,
+                            &res->shmfd, NULL);
+}
+
+static void virtio_gpu_init_shm(struct virtio_gpu_simple_resource *res,
+                                void *bits)
+{
+    if (!bits) {
+        return;
+    }
+    if (res->image) {
+        pixman_image_set_destroy_function(res->image,
+                                          memfd_pixman_image_destroy,
+                                          GINT_TO_POINTER(res->shmfd));
+    } else {
+        qemu_memfd_free(bits, res->hostmem, res->shmfd);
+        res->shmfd = -1;
+    }
+}
 #endif
 
 static void virtio_gpu_resource_create_2d(VirtIOGPU *g,
@@ -301,6 +342,8 @@ static void virtio_gpu_resource_create_2d(VirtIOGPU *g,
         if (!bits) {
             goto end;
         }
+#else
+        bits = virtio_gpu_alloc_shm(res);
 #endif
         res->image = pixman_image_create_bits(
             pformat,
@@ -311,6 +354,8 @@ static void virtio_gpu_resource_create_2d(VirtIOGPU *g,
         if (res->image) {
             pixman_image_set_destroy_function(res->image, win32_pixman_image_destroy, res->handle);
         }
+#else
+        virtio_gpu_init_shm(res, bits);
 #endif
     }
 
@@ -450,6 +495,8 @@ static void virtio_gpu_transfer_to_host_2d(VirtIOGPU *g,
     pixman_format_code_t format;
     struct virtio_gpu_transfer_to_host_2d t2d;
     void *img_data;
+    unsigned int iov_idx = 0;
+    size_t iov_start = 0;
 
     VIRTIO_GPU_FILL_CMD(t2d);
     virtio_gpu_t2d_bswap(&t2d);
@@ -485,7 +532,20 @@ static void virtio_gpu_transfer_to_host_2d(VirtIOGPU *g,
             src_offset = t2d.offset + stride * h;
             dst_offset = (t2d.r.y + h) * stride + (t2d.r.x * bpp);
 
-            iov_to_buf(res->iov, res->iov_cnt, src_offset,
+            /*
+             * Rows are copied in increasing offset order, so skip the
+             * iovec elements before this row instead of walking the
+             * whole backing store, which is usually one element per
+             * guest page, again for every row.
+             */
+            while (iov_idx < res->iov_cnt &&
+                   iov_start + res->iov[iov_idx].iov_len <= src_offset) {
+                iov_start += res->iov[iov_idx].iov_len;
+                iov_idx++;
+            }
+
+            iov_to_buf(res->iov + iov_idx, res->iov_cnt - iov_idx,
+                       src_offset - iov_start,
                        (uint8_t *)img_data + dst_offset,
                        t2d.r.width * bpp);
         }
@@ -531,8 +591,19 @@ static void virtio_gpu_resource_flush(VirtIOGPU *g,
                 within_bounds = true;
 
                 if (console_has_gl(scanout->con)) {
-                    dpy_gl_update(scanout->con, 0, 0, scanout->width,
-                                  scanout->height);
+                    QemuRect rect;
+
+                    /* Only redraw the flushed part of the scanout */
+                    qemu_rect_init(&flush_rect, rf.r.x, rf.r.y,
+                                   rf.r.width, rf.r.height);
+                    qemu_rect_init(&rect, scanout->x, scanout->y,
+                                   scanout->width, scanout->height);
+                    if (qemu_rect_intersect(&flush_rect, &rect, &rect)) {
+                        qemu_rect_translate(&rect, -scanout->x,
+                                            -scanout->y);
+                        dpy_gl_update(scanout->con, rect.x, rect.y,
+                                      rect.width, rect.height);
+                    }
                     update_submitted = true;
                 }
             }
@@ -685,6 +756,12 @@ static void virtio_gpu_do_set_scanout(VirtIOGPU *g,
         }
 #ifdef WIN32
         qemu_displaysurface_win32_set_handle(scanout->ds, res->handle, fb->offset);
+#else
+        if (res->blob ? res->dmabuf_fd >= 0 : res->shmfd >= 0) {
+            qemu_displaysurface_set_shmfd(scanout->ds,
+                                          res->blob ? res->dmabuf_fd :
+                                          res->shmfd, fb->offset);
+        }
 #endif
 
         pixman_image_unref(rect);
@@ -1293,11 +1370,16 @@ static int virtio_gpu_load(QEMUFile *f, void *opaque, size_t size,
             g_free(res);
             return -EINVAL;
         }
+#else
+        bits = virtio_gpu_alloc_shm(res);
 #endif
         res->image = pixman_image_create_bits(
             pformat,
             res->width, res->height,
             bits, res->height ? res->hostmem / res->height : 0);
+#ifndef WIN32
+        virtio_gpu_init_shm(res, bits);
+#endif
         if (!res->image) {
             g_free(res);
             return -EINVAL;
@@ -1423,6 +1505,10 @@ static int virtio_gpu_post_load(void *opaque, int version_id)
         }
 #ifdef WIN32
         qemu_displaysurface_win32_set_handle(scanout->ds, res->handle, 0);
+#else
+        if (!res->blob && res->shmfd >= 0) {
+            qemu_displaysurface_set_shmfd(scanout->ds, res->shmfd, 0);
+        }
 #endif
 
         dpy_gfx_replace_surface(scanout->con, scanout->ds);
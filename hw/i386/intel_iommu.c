@@ -274,14 +274,6 @@ static guint vtd_as_hash(gconstpointer v)
     return (guint)(value << 8 | key->devfn);
 }
 
-static gboolean vtd_hash_remove_by_domain(gpointer key, gpointer value,
-                                          gpointer user_data)
-{
-    VTDIOTLBEntry *entry = (VTDIOTLBEntry *)value;
-    uint16_t domain_id = *(uint16_t *)user_data;
-    return entry->domain_id == domain_id;
-}
-
 /* The shift of an addr for a certain level of paging structure */
 static inline uint32_t vtd_slpt_level_shift(uint32_t level)
 {
@@ -307,6 +299,96 @@ static gboolean vtd_hash_remove_by_page(gpointer key, gpointer value,
              (entry->gfn == gfn_tlb));
 }
 
+/*
+ * Drop all the translations cached in VTDAddressSpace.tlb_cache.  Must be
+ * called with IOMMU lock held whenever an IOTLB, context cache or PASID
+ * cache entry may have become stale.
+ */
+static void vtd_tlb_cache_invalidate_locked(IntelIOMMUState *s)
+{
+    VTDAddressSpace *vtd_as;
+    VTDTLBCacheEntry *cached;
+    GHashTableIter as_it;
+    int i;
+
+    if (qatomic_inc_fetch(&s->tlb_cache_gen)) {
+        return;
+    }
+
+    /* The generation wrapped around, really free the old entries */
+    g_hash_table_iter_init(&as_it, s->vtd_address_spaces);
+    while (g_hash_table_iter_next(&as_it, NULL, (void **)&vtd_as)) {
+        for (i = 0; i < VTD_TLB_CACHE_SIZE; i++) {
+            cached = vtd_as->tlb_cache[i];
+            if (cached) {
+                qatomic_rcu_set(&vtd_as->tlb_cache[i], NULL);
+                g_free_rcu(cached, rcu);
+            }
+        }
+    }
+}
+
+/* Translations are indexed by their page number, in units of their size */
+static inline unsigned vtd_tlb_cache_index(hwaddr addr, hwaddr addr_mask)
+{
+    return (addr >> ctz64(addr_mask + 1)) & (VTD_TLB_CACHE_SIZE - 1);
+}
+
+/*
+ * Look up @addr in the translation cache of @vtd_as without taking the
+ * IOMMU lock.  Called from RCU critical section.
+ */
+static bool vtd_tlb_cache_lookup(VTDAddressSpace *vtd_as, hwaddr addr,
+                                 IOMMUTLBEntry *entry)
+{
+    uint32_t gen = qatomic_read(&vtd_as->iommu_state->tlb_cache_gen);
+    VTDTLBCacheEntry *cached = NULL;
+    hwaddr addr_mask;
+    uint32_t level;
+
+    /* Try each page size, there is no telling which one maps @addr */
+    for (level = VTD_SL_PT_LEVEL; level <= VTD_SL_PDP_LEVEL; level++) {
+        addr_mask = ~vtd_slpt_level_page_mask(level);
+        cached = qatomic_rcu_read(
+            &vtd_as->tlb_cache[vtd_tlb_cache_index(addr, addr_mask)]);
+        if (cached && cached->gen == gen && cached->addr_mask == addr_mask &&
+            (addr & ~addr_mask) == cached->iova) {
+            break;
+        }
+        cached = NULL;
+    }
+    if (!cached) {
+        return false;
+    }
+
+    entry->iova = cached->iova;
+    entry->translated_addr = cached->translated_addr;
+    entry->addr_mask = cached->addr_mask;
+    entry->perm = cached->perm;
+    return true;
+}
+
+/* Must be called with IOMMU lock held */
+static void vtd_tlb_cache_update_locked(VTDAddressSpace *vtd_as,
+                                        const IOMMUTLBEntry *entry)
+{
+    VTDTLBCacheEntry *cached = g_new(VTDTLBCacheEntry, 1);
+    VTDTLBCacheEntry *old;
+    unsigned idx = vtd_tlb_cache_index(entry->iova, entry->addr_mask);
+
+    cached->gen = vtd_as->iommu_state->tlb_cache_gen;
+    cached->iova = entry->iova;
+    cached->translated_addr = entry->translated_addr;
+    cached->addr_mask = entry->addr_mask;
+    cached->perm = entry->perm;
+
+    old = vtd_as->tlb_cache[idx];
+    qatomic_rcu_set(&vtd_as->tlb_cache[idx], cached);
+    if (old) {
+        g_free_rcu(old, rcu);
+    }
+}
+
 /* Reset all the gen of VTDAddressSpace to zero and set the gen of
  * IntelIOMMUState to 1.  Must be called with IOMMU lock held.
  */
@@ -323,6 +405,7 @@ static void vtd_reset_context_cache_locked(IntelIOMMUState *s)
         vtd_as->context_cache_entry.context_cache_gen = 0;
     }
     s->context_cache_gen = 1;
+    vtd_tlb_cache_invalidate_locked(s);
 }
 
 /* Must be called with IOMMU lock held. */
@@ -330,6 +413,23 @@ static void vtd_reset_iotlb_locked(IntelIOMMUState *s)
 {
     assert(s->iotlb);
     g_hash_table_remove_all(s->iotlb);
+    s->iotlb_ranges = (IntervalTreeRoot) { };
+    vtd_tlb_cache_invalidate_locked(s);
+}
+
+/* Must be called with IOMMU lock held. */
+static void vtd_iotlb_remove_locked(IntelIOMMUState *s, VTDIOTLBEntry *entry)
+{
+    struct vtd_iotlb_key key = {
+        .gfn = entry->gfn,
+        .pasid = entry->pasid,
+        .sid = entry->sid,
+        .level = entry->level,
+    };
+
+    interval_tree_remove(&entry->node, &s->iotlb_ranges);
+    /* Frees @entry */
+    g_hash_table_remove(s->iotlb, &key);
 }
 
 static void vtd_reset_iotlb(IntelIOMMUState *s)
@@ -392,6 +492,7 @@ static void vtd_update_iotlb(IntelIOMMUState *s, uint16_t source_id,
     VTDIOTLBEntry *entry = g_malloc(sizeof(*entry));
     struct vtd_iotlb_key *key = g_malloc(sizeof(*key));
     uint64_t gfn = vtd_get_iotlb_gfn(addr, level);
+    VTDIOTLBEntry *old;
 
     trace_vtd_iotlb_page_update(source_id, addr, slpte, domain_id);
     if (g_hash_table_size(s->iotlb) >= VTD_IOTLB_MAX_SIZE) {
@@ -405,13 +506,22 @@ static void vtd_update_iotlb(IntelIOMMUState *s, uint16_t source_id,
     entry->access_flags = access_flags;
     entry->mask = vtd_slpt_level_page_mask(level);
     entry->pasid = pasid;
+    entry->sid = source_id;
+    entry->level = level;
+    entry->node.start = gfn << VTD_PAGE_SHIFT_4K;
+    entry->node.last = entry->node.start | ~entry->mask;
 
     key->gfn = gfn;
     key->sid = source_id;
     key->level = level;
     key->pasid = pasid;
 
+    old = g_hash_table_lookup(s->iotlb, key);
+    if (old) {
+        interval_tree_remove(&old->node, &s->iotlb_ranges);
+    }
     g_hash_table_replace(s->iotlb, key, entry);
+    interval_tree_insert(&entry->node, &s->iotlb_ranges);
 }
 
 /* Given the reg addr of both the message data and address, generate an
@@ -2486,11 +2596,12 @@ static bool vtd_do_iommu_translate(VTDAddressSpace *vtd_as, PCIBus *bus,
     vtd_update_iotlb(s, source_id, vtd_get_domain_id(s, &ce, pasid),
                      addr, slpte, access_flags, level, pasid);
 out:
-    vtd_iommu_unlock(s);
     entry->iova = addr & page_mask;
     entry->translated_addr = vtd_get_slpte_addr(slpte, s->aw_bits) & page_mask;
     entry->addr_mask = ~page_mask;
     entry->perm = access_flags;
+    vtd_tlb_cache_update_locked(vtd_as, entry);
+    vtd_iommu_unlock(s);
     return true;
 
 error:
@@ -2552,6 +2663,7 @@ static void vtd_context_global_invalidate(IntelIOMMUState *s)
     if (s->context_cache_gen == VTD_CONTEXT_CACHE_GEN_MAX) {
         vtd_reset_context_cache_locked(s);
     }
+    vtd_tlb_cache_invalidate_locked(s);
     vtd_iommu_unlock(s);
     vtd_address_space_refresh_all(s);
     /*
@@ -3158,6 +3270,7 @@ static void vtd_context_device_invalidate(IntelIOMMUState *s,
                                          VTD_PCI_FUNC(vtd_as->devfn));
             vtd_iommu_lock(s);
             vtd_as->context_cache_entry.context_cache_gen = 0;
+            vtd_tlb_cache_invalidate_locked(s);
             vtd_iommu_unlock(s);
             /*
              * Do switch address space when needed, in case if the
@@ -3233,12 +3346,20 @@ static void vtd_iotlb_domain_invalidate(IntelIOMMUState *s, uint16_t domain_id)
 {
     VTDContextEntry ce;
     VTDAddressSpace *vtd_as;
+    VTDIOTLBEntry *entry;
+    GHashTableIter it;
 
     trace_vtd_inv_desc_iotlb_domain(domain_id);
 
     vtd_iommu_lock(s);
-    g_hash_table_foreach_remove(s->iotlb, vtd_hash_remove_by_domain,
-                                &domain_id);
+    g_hash_table_iter_init(&it, s->iotlb);
+    while (g_hash_table_iter_next(&it, NULL, (void **)&entry)) {
+        if (entry->domain_id == domain_id) {
+            interval_tree_remove(&entry->node, &s->iotlb_ranges);
+            g_hash_table_iter_remove(&it);
+        }
+    }
+    vtd_tlb_cache_invalidate_locked(s);
     vtd_iommu_unlock(s);
 
     QLIST_FOREACH(vtd_as, &s->vtd_as_with_notifiers, next) {
@@ -3298,17 +3419,26 @@ static void vtd_iotlb_page_invalidate_notify(IntelIOMMUState *s,
 static void vtd_iotlb_page_invalidate(IntelIOMMUState *s, uint16_t domain_id,
                                       hwaddr addr, uint8_t am)
 {
-    VTDIOTLBPageInvInfo info;
+    hwaddr size = VTD_PAGE_SIZE << am;
+    hwaddr start = addr & ~(size - 1);
+    IntervalTreeNode *node, *next;
+    VTDIOTLBEntry *entry;
 
     trace_vtd_inv_desc_iotlb_pages(domain_id, addr, am);
 
     assert(am <= VTD_MAMV);
-    info.is_piotlb = false;
-    info.domain_id = domain_id;
-    info.addr = addr;
-    info.mask = ~((1 << am) - 1);
     vtd_iommu_lock(s);
-    g_hash_table_foreach_remove(s->iotlb, vtd_hash_remove_by_page, &info);
+    /* Entries overlapping the range, including large pages containing it */
+    node = interval_tree_iter_first(&s->iotlb_ranges, start, start + size - 1);
+    while (node) {
+        next = interval_tree_iter_next(node, start, start + size - 1);
+        entry = container_of(node, VTDIOTLBEntry, node);
+        if (entry->domain_id == domain_id) {
+            vtd_iotlb_remove_locked(s, entry);
+        }
+        node = next;
+    }
+    vtd_tlb_cache_invalidate_locked(s);
     vtd_iommu_unlock(s);
     vtd_iotlb_page_invalidate_notify(s, domain_id, addr, am, PCI_NO_PASID);
 }
@@ -4181,6 +4311,7 @@ static void vtd_pasid_cache_sync(IntelIOMMUState *s,
      * be created during future vIOMMU DMA translation.
      */
     vtd_replay_guest_pasid_bindings(s, pc_info);
+    vtd_tlb_cache_invalidate_locked(s);
     vtd_iommu_unlock(s);
 }
 
@@ -5078,7 +5209,9 @@ static IOMMUTLBEntry vtd_iommu_translate(IOMMUMemoryRegion *iommu, hwaddr addr,
     int ret = 0;
 
     if (likely(s->dmar_enabled)) {
-        if (s->root_scalable) {
+        if (vtd_tlb_cache_lookup(vtd_as, addr, &iotlb)) {
+            success = true;
+        } else if (s->root_scalable) {
             ret = vtd_dev_to_context_entry(s, pci_bus_num(vtd_as->bus),
                                            vtd_as->devfn, &ce);
             ret = vtd_ce_get_rid2pasid_entry(s, &ce, &pe, PCI_NO_PASID);
@@ -28,6 +28,7 @@
 #include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
 
+#include "qemu/defer-call.h"
 #include "qemu/error-report.h"
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
@@ -43,6 +44,7 @@
 static void check_cmd(AHCIState *s, int port);
 static void handle_cmd(AHCIState *s, int port, uint8_t slot);
 static void ahci_reset_port(AHCIState *s, int port);
+static void ahci_cancel_fis_sdb(AHCIDevice *ad);
 static bool ahci_write_fis_d2h(AHCIDevice *ad, bool d2h_fis_i);
 static void ahci_clear_cmd_issue(AHCIDevice *ad, uint8_t slot);
 static void ahci_init_d2h(AHCIDevice *ad);
@@ -596,11 +598,14 @@ static void check_cmd(AHCIState *s, int port)
     uint8_t slot;
 
     if ((pr->cmd & PORT_CMD_START) && pr->cmd_issue) {
+        /* Submit all NCQ commands of one doorbell write as a batch */
+        defer_call_begin();
         for (slot = 0; (slot < 32) && pr->cmd_issue; slot++) {
             if (pr->cmd_issue & (1U << slot)) {
                 handle_cmd(s, port, slot);
             }
         }
+        defer_call_end();
     }
 }
 
@@ -697,6 +702,8 @@ static void ahci_reset_port(AHCIState *s, int port)
         qemu_sglist_destroy(&ncq_tfs->sglist);
         ncq_tfs->used = 0;
     }
+    /* Drop the completions of the cancelled requests */
+    ahci_cancel_fis_sdb(d);
 
     s->dev[port].port_state = STATE_RUN;
     if (ide_state->drive_kind == IDE_CD) {
@@ -781,9 +788,8 @@ static void ahci_unmap_clb_address(AHCIDevice *ad)
     ad->lst = NULL;
 }
 
-static void ahci_write_fis_sdb(AHCIState *s, NCQTransferState *ncq_tfs)
+static void ahci_write_fis_sdb(AHCIState *s, AHCIDevice *ad)
 {
-    AHCIDevice *ad = ncq_tfs->drive;
     AHCIPortRegs *pr = &ad->port_regs;
     IDEState *ide_state;
     SDBFIS *sdb_fis;
@@ -823,6 +829,35 @@ static void ahci_write_fis_sdb(AHCIState *s, NCQTransferState *ncq_tfs)
     }
 }
 
+static void ahci_write_fis_sdb_bh(void *opaque)
+{
+    AHCIDevice *ad = opaque;
+
+    qemu_bh_delete(ad->sdb_bh);
+    ad->sdb_bh = NULL;
+
+    ahci_write_fis_sdb(ad->hba, ad);
+}
+
+static void ahci_cancel_fis_sdb(AHCIDevice *ad)
+{
+    if (ad->sdb_bh) {
+        qemu_bh_delete(ad->sdb_bh);
+        ad->sdb_bh = NULL;
+    }
+    ad->finished = 0;
+}
+
+/* Post an SDB FIS for the NCQ commands completed so far */
+static void ahci_flush_fis_sdb(AHCIDevice *ad)
+{
+    if (ad->sdb_bh) {
+        qemu_bh_delete(ad->sdb_bh);
+        ad->sdb_bh = NULL;
+        ahci_write_fis_sdb(ad->hba, ad);
+    }
+}
+
 static void ahci_write_fis_pio(AHCIDevice *ad, uint16_t len, bool pio_fis_i)
 {
     AHCIPortRegs *pr = &ad->port_regs;
@@ -1025,11 +1060,28 @@ static void ncq_finish(NCQTransferState *ncq_tfs)
     /* If we didn't error out, set our finished bit. Errored commands
      * do not get a bit set for the SDB FIS ACT register, nor do they
      * clear the outstanding bit in scr_act (PxSACT). */
+    AHCIDevice *ad = ncq_tfs->drive;
+
     if (ncq_tfs->used) {
-        ncq_tfs->drive->finished |= (1 << ncq_tfs->tag);
+        ad->finished |= (1 << ncq_tfs->tag);
     }
 
-    ahci_write_fis_sdb(ncq_tfs->drive->hba, ncq_tfs);
+    /*
+     * Commands that complete together are reported with a single SDB FIS
+     * and interrupt.  Errors are reported right away, before the status
+     * can be overwritten by further completions.
+     */
+    if (ad->port.ifs[0].status & ERR_STAT) {
+        if (ad->sdb_bh) {
+            qemu_bh_delete(ad->sdb_bh);
+            ad->sdb_bh = NULL;
+        }
+        ahci_write_fis_sdb(ad->hba, ad);
+    } else if (!ad->sdb_bh) {
+        ad->sdb_bh = qemu_bh_new_guarded(ahci_write_fis_sdb_bh, ad,
+                                         &ad->mem_reentrancy_guard);
+        qemu_bh_schedule(ad->sdb_bh);
+    }
 
     trace_ncq_finish(ncq_tfs->drive->hba, ncq_tfs->drive->port_no,
                      ncq_tfs->tag);
@@ -1645,6 +1697,7 @@ void ahci_uninit(AHCIState *s)
     for (i = 0; i < s->ports; i++) {
         AHCIDevice *ad = &s->dev[i];
 
+        ahci_cancel_fis_sdb(ad);
         for (j = 0; j < 2; j++) {
             ide_exit(&ad->port.ifs[j]);
         }
@@ -1728,6 +1781,19 @@ static const VMStateDescription vmstate_ahci_device = {
     },
 };
 
+static int ahci_state_pre_save(void *opaque)
+{
+    AHCIState *s = opaque;
+    int i;
+
+    /* The pending completions are not part of the migration stream */
+    for (i = 0; i < s->ports; i++) {
+        ahci_flush_fis_sdb(&s->dev[i]);
+    }
+
+    return 0;
+}
+
 static int ahci_state_post_load(void *opaque, int version_id)
 {
     int i, j;
@@ -1816,6 +1882,7 @@ static int ahci_state_post_load(void *opaque, int version_id)
 const VMStateDescription vmstate_ahci = {
     .name = "ahci",
     .version_id = 1,
+    .pre_save = ahci_state_pre_save,
     .post_load = ahci_state_post_load,
     .fields = (VMStateField[]) {
         VMSTATE_STRUCT_VARRAY_POINTER_INT32(dev, AHCIState, ports,
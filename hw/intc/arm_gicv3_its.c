@@ -205,6 +205,27 @@ out:
     return res;
 }
 
+/*
+ * The translation cache remembers recently looked up DTEs and ITEs so
+ * that MSIs do not walk the tables in guest memory each time.  Software
+ * may only change these tables through ITS commands, so it is enough to
+ * empty the cache whenever a command updates an entry, and whenever the
+ * table registers change.
+ */
+static void its_trans_cache_flush(GICv3ITSState *s)
+{
+    memset(s->trans_cache, 0, sizeof(s->trans_cache));
+}
+
+static ITSTransCacheEntry *its_trans_cache_slot(GICv3ITSState *s,
+                                                uint32_t devid,
+                                                uint32_t eventid)
+{
+    uint32_t idx = (devid * 0x9e3779b1) ^ eventid;
+
+    return &s->trans_cache[idx & (ITS_TRANS_CACHE_SIZE - 1)];
+}
+
 /*
  * Update the Interrupt Table entry at index @evinted in the table specified
  * by the dte @dte. Returns true on success, false if there was a memory
@@ -219,6 +240,7 @@ static bool update_ite(GICv3ITSState *s, uint32_t eventid, const DTEntry *dte,
     uint64_t itel = 0;
     uint32_t iteh = 0;
 
+    its_trans_cache_flush(s);
     trace_gicv3_its_ite_write(dte->ittaddr, eventid, ite->valid,
                               ite->inttype, ite->intid, ite->icid,
                               ite->vpeid, ite->doorbell);
@@ -361,8 +383,23 @@ static ItsCmdResult lookup_ite(GICv3ITSState *s, const char *who,
                                uint32_t devid, uint32_t eventid, ITEntry *ite,
                                DTEntry *dte)
 {
+    ITSTransCacheEntry *cached = its_trans_cache_slot(s, devid, eventid);
     uint64_t num_eventids;
 
+    if (cached->valid && cached->devid == devid &&
+        cached->eventid == eventid) {
+        dte->valid = true;
+        dte->size = cached->dte_size;
+        dte->ittaddr = cached->ittaddr;
+        ite->valid = true;
+        ite->inttype = cached->inttype;
+        ite->intid = cached->intid;
+        ite->doorbell = cached->doorbell;
+        ite->icid = cached->icid;
+        ite->vpeid = cached->vpeid;
+        return CMD_CONTINUE_OK;
+    }
+
     if (devid >= s->dt.num_entries) {
         qemu_log_mask(LOG_GUEST_ERROR,
                       "%s: invalid command attributes: devid %d>=%d",
@@ -398,6 +435,18 @@ static ItsCmdResult lookup_ite(GICv3ITSState *s, const char *who,
         return CMD_CONTINUE;
     }
 
+    *cached = (ITSTransCacheEntry) {
+        .valid = true,
+        .devid = devid,
+        .eventid = eventid,
+        .dte_size = dte->size,
+        .ittaddr = dte->ittaddr,
+        .inttype = ite->inttype,
+        .intid = ite->intid,
+        .doorbell = ite->doorbell,
+        .icid = ite->icid,
+        .vpeid = ite->vpeid,
+    };
     return CMD_CONTINUE_OK;
 }
 
@@ -797,6 +846,7 @@ static bool update_dte(GICv3ITSState *s, uint32_t devid, const DTEntry *dte)
     uint64_t dteval = 0;
     MemTxResult res = MEMTX_OK;
 
+    its_trans_cache_flush(s);
     trace_gicv3_its_dte_write(devid, dte->valid, dte->size, dte->ittaddr);
 
     if (dte->valid) {
@@ -1420,6 +1470,8 @@ static void extract_table_params(GICv3ITSState *s)
     uint32_t page_sz = 0;
     uint64_t value;
 
+    its_trans_cache_flush(s);
+
     for (int i = 0; i < 8; i++) {
         TableDesc *td;
         int idbits;
@@ -1959,6 +2011,8 @@ static void gicv3_its_reset_hold(Object *obj)
         c->parent_phases.hold(obj);
     }
 
+    its_trans_cache_flush(s);
+
     /* Quiescent bit reset to 1 */
     s->ctlr = FIELD_DP32(s->ctlr, GITS_CTLR, QUIESCENT, 1);
 
@@ -1996,6 +2050,7 @@ static void gicv3_its_reset_hold(Object *obj)
 
 static void gicv3_its_post_load(GICv3ITSState *s)
 {
+    its_trans_cache_flush(s);
     if (s->ctlr & R_GITS_CTLR_ENABLED_MASK) {
         extract_table_params(s);
         extract_cmdq_params(s);
@@ -137,23 +137,39 @@ static void update_for_one_lpi(GICv3CPUState *cs, int irq,
  * LPI table sizes are architecturally specified in GICR_PROPBASER.IDBits
  * and in the VMAPP command's VPT_size field.
  */
+/* Number of 64-bit words of the LPI pending table read at once */
+#define LPI_PENDING_SCAN_WORDS 32
+
 static void update_for_all_lpis(GICv3CPUState *cs, uint64_t ptbase,
                                 uint64_t ctbase, unsigned ptsizebits,
                                 bool ds, PendingIrq *hpp)
 {
     AddressSpace *as = &cs->gic->dma_as;
-    uint8_t pend;
+    uint64_t pend[LPI_PENDING_SCAN_WORDS];
     uint32_t pendt_size = (1ULL << (ptsizebits + 1));
+    uint32_t start, len;
     int i, bit;
 
     hpp->prio = 0xff;
 
-    for (i = GICV3_LPI_INTID_START / 8; i < pendt_size / 8; i++) {
-        address_space_read(as, ptbase + i, MEMTXATTRS_UNSPECIFIED, &pend, 1);
-        while (pend) {
-            bit = ctz32(pend);
-            update_for_one_lpi(cs, i * 8 + bit, ctbase, ds, hpp);
-            pend &= ~(1 << bit);
+    /*
+     * The pending table is mostly zeroes, so read it in chunks rather
+     * than byte by byte, and only look at the words that have bits set.
+     */
+    for (start = GICV3_LPI_INTID_START; start < pendt_size;
+         start += LPI_PENDING_SCAN_WORDS * 64) {
+        len = MIN(pendt_size - start, LPI_PENDING_SCAN_WORDS * 64) / 8;
+        memset(pend, 0, sizeof(pend));
+        address_space_read(as, ptbase + start / 8, MEMTXATTRS_UNSPECIFIED,
+                           pend, len);
+        for (i = 0; i < DIV_ROUND_UP(len, 8); i++) {
+            uint64_t word = le64_to_cpu(pend[i]);
+
+            while (word) {
+                bit = ctz64(word);
+                update_for_one_lpi(cs, start + i * 64 + bit, ctbase, ds, hpp);
+                word &= word - 1;
+            }
         }
     }
 }
@@ -22,6 +22,7 @@
 #include "qemu/module.h"
 #include "qemu/error-report.h"
 #include "qemu/bswap.h"
+#include "qemu/bitmap.h"
 #include "exec/address-spaces.h"
 #include "hw/sysbus.h"
 #include "hw/pci/msi.h"
@@ -46,6 +47,24 @@
 #define IMSIC_EISTATE_ENPEND           (IMSIC_EISTATE_ENABLED | \
                                         IMSIC_EISTATE_PENDING)
 
+/* Set or clear @state for eistate[@idx], keeping eienpend in sync */
+static void riscv_imsic_set_eistate(RISCVIMSICState *imsic, uint32_t idx,
+                                    uint32_t state, bool on)
+{
+    if (on) {
+        imsic->eistate[idx] |= state;
+    } else {
+        imsic->eistate[idx] &= ~state;
+    }
+
+    if ((imsic->eistate[idx] & IMSIC_EISTATE_ENPEND) ==
+            IMSIC_EISTATE_ENPEND) {
+        set_bit(idx, imsic->eienpend);
+    } else {
+        clear_bit(idx, imsic->eienpend);
+    }
+}
+
 static uint32_t riscv_imsic_topei(RISCVIMSICState *imsic, uint32_t page)
 {
     uint32_t i, max_irq, base;
@@ -54,11 +73,9 @@ static uint32_t riscv_imsic_topei(RISCVIMSICState *imsic, uint32_t page)
     max_irq = (imsic->eithreshold[page] &&
                (imsic->eithreshold[page] <= imsic->num_irqs)) ?
                imsic->eithreshold[page] : imsic->num_irqs;
-    for (i = 1; i < max_irq; i++) {
-        if ((imsic->eistate[base + i] & IMSIC_EISTATE_ENPEND) ==
-                IMSIC_EISTATE_ENPEND) {
-            return (i << IMSIC_TOPEI_IID_SHIFT) | i;
-        }
+    i = find_next_bit(imsic->eienpend, base + max_irq, base + 1) - base;
+    if (i < max_irq) {
+        return (i << IMSIC_TOPEI_IID_SHIFT) | i;
     }
 
     return 0;
@@ -125,7 +142,8 @@ static int riscv_imsic_topei_rmw(RISCVIMSICState *imsic, uint32_t page,
         topei >>= IMSIC_TOPEI_IID_SHIFT;
         base = page * imsic->num_irqs;
         if (topei) {
-            imsic->eistate[base + topei] &= ~IMSIC_EISTATE_PENDING;
+            riscv_imsic_set_eistate(imsic, base + topei,
+                                    IMSIC_EISTATE_PENDING, false);
         }
 
         riscv_imsic_update(imsic, page);
@@ -171,11 +189,7 @@ static int riscv_imsic_eix_rmw(RISCVIMSICState *imsic,
 
         mask = (target_ulong)1 << i;
         if (wr_mask & mask) {
-            if (new_val & mask) {
-                imsic->eistate[base + i] |= state;
-            } else {
-                imsic->eistate[base + i] &= ~state;
-            }
+            riscv_imsic_set_eistate(imsic, base + i, state, new_val & mask);
         }
     }
 
@@ -302,8 +316,8 @@ static void riscv_imsic_write(void *opaque, hwaddr addr, uint64_t value,
     page = addr >> IMSIC_MMIO_PAGE_SHIFT;
     if ((addr & (IMSIC_MMIO_PAGE_SZ - 1)) == IMSIC_MMIO_PAGE_LE) {
         if (value && (value < imsic->num_irqs)) {
-            imsic->eistate[(page * imsic->num_irqs) + value] |=
-                                                    IMSIC_EISTATE_PENDING;
+            riscv_imsic_set_eistate(imsic, (page * imsic->num_irqs) + value,
+                                    IMSIC_EISTATE_PENDING, true);
         }
     }
 
@@ -340,6 +354,7 @@ static void riscv_imsic_realize(DeviceState *dev, Error **errp)
         imsic->eidelivery = g_new0(uint32_t, imsic->num_pages);
         imsic->eithreshold = g_new0(uint32_t, imsic->num_pages);
         imsic->eistate = g_new0(uint32_t, imsic->num_eistate);
+        imsic->eienpend = bitmap_new(imsic->num_eistate);
     }
 
     memory_region_init_io(&imsic->mmio, OBJECT(dev), &riscv_imsic_ops,
@@ -382,10 +397,22 @@ static Property riscv_imsic_properties[] = {
     DEFINE_PROP_END_OF_LIST(),
 };
 
+static int riscv_imsic_post_load(void *opaque, int version_id)
+{
+    RISCVIMSICState *imsic = opaque;
+    uint32_t i;
+
+    for (i = 0; i < imsic->num_eistate; i++) {
+        riscv_imsic_set_eistate(imsic, i, 0, true);
+    }
+    return 0;
+}
+
 static const VMStateDescription vmstate_riscv_imsic = {
     .name = "riscv_imsic",
     .version_id = 1,
     .minimum_version_id = 1,
+    .post_load = riscv_imsic_post_load,
     .fields = (VMStateField[]) {
             VMSTATE_VARRAY_UINT32(eidelivery, RISCVIMSICState,
                                   num_pages, 0,
@@ -27,6 +27,7 @@
 #include "sysemu/hostmem.h"
 #include "sysemu/numa.h"
 #include "hw/cxl/cxl.h"
+#include "hw/cxl/cxl_host.h"
 #include "hw/pci/msix.h"
 
 #define DWORD_BYTE 4
@@ -386,6 +387,39 @@ static void build_dvsecs(CXLType3Dev *ct3d)
                                PCIE_FLEXBUS_PORT_DVSEC_REVID_2_0, dvsec);
 }
 
+static void ct3d_direct_unmap_one(CXLType3Dev *ct3d, int which)
+{
+    if (ct3d->direct_container[which]) {
+        memory_region_del_subregion(ct3d->direct_container[which],
+                                    &ct3d->direct_mr[which]);
+        object_unparent(OBJECT(&ct3d->direct_mr[which]));
+        ct3d->direct_container[which] = NULL;
+    }
+    ct3d->direct_tried[which] = false;
+}
+
+/*
+ * Drop the direct mappings, e.g. because a decoder on the way changed, and
+ * go back to cxl_type3_read()/cxl_type3_write() until the next access.
+ */
+void cxl_type3_direct_unmap(CXLType3Dev *ct3d)
+{
+    int i;
+
+    memory_region_transaction_begin();
+    for (i = 0; i < CXL_HDM_DECODER_COUNT; i++) {
+        ct3d_direct_unmap_one(ct3d, i);
+    }
+    memory_region_transaction_commit();
+}
+
+static void ct3d_hdm_notify(Notifier *notifier, void *data)
+{
+    CXLType3Dev *ct3d = container_of(notifier, CXLType3Dev, hdm_notifier);
+
+    cxl_type3_direct_unmap(ct3d);
+}
+
 static void hdm_decoder_commit(CXLType3Dev *ct3d, int which)
 {
     int hdm_inc = R_CXL_HDM_DECODER1_BASE_LO - R_CXL_HDM_DECODER0_BASE_LO;
@@ -399,6 +433,7 @@ static void hdm_decoder_commit(CXLType3Dev *ct3d, int which)
     ctrl = FIELD_DP32(ctrl, CXL_HDM_DECODER0_CTRL, COMMITTED, 1);
 
     stl_le_p(cache_mem + R_CXL_HDM_DECODER0_CTRL + which * hdm_inc, ctrl);
+    cxl_type3_direct_unmap(ct3d);
 }
 
 static void hdm_decoder_uncommit(CXLType3Dev *ct3d, int which)
@@ -414,6 +449,7 @@ static void hdm_decoder_uncommit(CXLType3Dev *ct3d, int which)
     ctrl = FIELD_DP32(ctrl, CXL_HDM_DECODER0_CTRL, COMMITTED, 0);
 
     stl_le_p(cache_mem + R_CXL_HDM_DECODER0_CTRL + which * hdm_inc, ctrl);
+    cxl_type3_direct_unmap(ct3d);
 }
 
 static int ct3d_qmp_uncor_err_to_cxl(CxlUncorErrorType qmp_err)
@@ -752,6 +788,9 @@ static void ct3_realize(PCIDevice *pci_dev, Error **errp)
     }
     cxl_event_init(&ct3d->cxl_dstate, 2);
 
+    ct3d->hdm_notifier.notify = ct3d_hdm_notify;
+    cxl_hdm_add_notifier(&ct3d->hdm_notifier);
+
     return;
 
 err_release_cdat:
@@ -774,6 +813,8 @@ static void ct3_exit(PCIDevice *pci_dev)
     CXLComponentState *cxl_cstate = &ct3d->cxl_cstate;
     ComponentRegisters *regs = &cxl_cstate->crb;
 
+    notifier_remove(&ct3d->hdm_notifier);
+    cxl_type3_direct_unmap(ct3d);
     pcie_aer_exit(pci_dev);
     cxl_doe_cdat_release(cxl_cstate);
     g_free(regs->special_ops);
@@ -885,6 +926,80 @@ static int cxl_type3_hpa_to_as_and_dpa(CXLType3Dev *ct3d,
     return 0;
 }
 
+/*
+ * Map the range of the HDM decoder that decodes @host_addr straight to the
+ * backing memory if nothing on the way interleaves it, so that further
+ * guest accesses do not have to go through cxl_type3_read() and
+ * cxl_type3_write().  This is only tried on the first access after the
+ * decoders changed, when all of them have been committed.
+ */
+static void ct3d_direct_map(CXLType3Dev *ct3d, hwaddr host_addr)
+{
+    int hdm_inc = R_CXL_HDM_DECODER1_BASE_LO - R_CXL_HDM_DECODER0_BASE_LO;
+    uint32_t *cache_mem = ct3d->cxl_cstate.crb.cache_mem_registers;
+    MemoryRegion *vmr = NULL, *pmr = NULL, *mr;
+    CXLFixedWindow *fw;
+    uint64_t base, size, dpa;
+    uint32_t ctrl, low, high;
+    int i;
+
+    for (i = 0; i < CXL_HDM_DECODER_COUNT; i++) {
+        low = ldl_le_p(cache_mem + R_CXL_HDM_DECODER0_BASE_LO + i * hdm_inc);
+        high = ldl_le_p(cache_mem + R_CXL_HDM_DECODER0_BASE_HI + i * hdm_inc);
+        base = ((uint64_t)high << 32) | (low & 0xf0000000);
+
+        low = ldl_le_p(cache_mem + R_CXL_HDM_DECODER0_SIZE_LO + i * hdm_inc);
+        high = ldl_le_p(cache_mem + R_CXL_HDM_DECODER0_SIZE_HI + i * hdm_inc);
+        size = ((uint64_t)high << 32) | (low & 0xf0000000);
+
+        if (host_addr >= base && host_addr - base < size) {
+            break;
+        }
+    }
+    if (i == CXL_HDM_DECODER_COUNT || ct3d->direct_tried[i]) {
+        return;
+    }
+    ct3d->direct_tried[i] = true;
+
+    ctrl = ldl_le_p(cache_mem + R_CXL_HDM_DECODER0_CTRL + i * hdm_inc);
+    if (!FIELD_EX32(ctrl, CXL_HDM_DECODER0_CTRL, COMMITTED) ||
+        FIELD_EX32(ctrl, CXL_HDM_DECODER0_CTRL, IW) ||
+        !cxl_type3_dpa(ct3d, base, &dpa) ||
+        dpa + size > ct3d->cxl_dstate.mem_size) {
+        return;
+    }
+
+    if (ct3d->hostvmem) {
+        vmr = host_memory_backend_get_memory(ct3d->hostvmem);
+    }
+    if (ct3d->hostpmem) {
+        pmr = host_memory_backend_get_memory(ct3d->hostpmem);
+    }
+    if (vmr && dpa < memory_region_size(vmr)) {
+        mr = vmr;
+    } else {
+        mr = pmr;
+        if (vmr) {
+            dpa -= memory_region_size(vmr);
+        }
+    }
+    /* The range must not straddle the volatile and persistent parts */
+    if (!mr || dpa + size > memory_region_size(mr)) {
+        return;
+    }
+
+    fw = cxl_fmws_find_direct(PCI_DEVICE(ct3d), base, size);
+    if (!fw) {
+        return;
+    }
+
+    memory_region_init_alias(&ct3d->direct_mr[i], OBJECT(ct3d),
+                             "cxl-type3-direct", mr, dpa, size);
+    memory_region_add_subregion(&fw->mr, base - fw->base,
+                                &ct3d->direct_mr[i]);
+    ct3d->direct_container[i] = &fw->mr;
+}
+
 MemTxResult cxl_type3_read(PCIDevice *d, hwaddr host_addr, uint64_t *data,
                            unsigned size, MemTxAttrs attrs)
 {
@@ -904,6 +1019,7 @@ MemTxResult cxl_type3_read(PCIDevice *d, hwaddr host_addr, uint64_t *data,
         return MEMTX_OK;
     }
 
+    ct3d_direct_map(ct3d, host_addr);
     return address_space_read(as, dpa_offset, attrs, data, size);
 }
 
@@ -925,6 +1041,7 @@ MemTxResult cxl_type3_write(PCIDevice *d, hwaddr host_addr, uint64_t data,
         return MEMTX_OK;
     }
 
+    ct3d_direct_map(ct3d, host_addr);
     return address_space_write(as, dpa_offset, attrs, &data, size);
 }
 
@@ -934,6 +1051,7 @@ static void ct3d_reset(DeviceState *dev)
     uint32_t *reg_state = ct3d->cxl_cstate.crb.cache_mem_registers;
     uint32_t *write_msk = ct3d->cxl_cstate.crb.cache_mem_regs_write_mask;
 
+    cxl_type3_direct_unmap(ct3d);
     cxl_component_register_init_common(reg_state, write_msk, CXL2_TYPE3_DEVICE);
     cxl_device_register_init_t3(ct3d);
 
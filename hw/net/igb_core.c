@@ -1608,35 +1608,60 @@ igb_write_rx_descr(IGBCore *core,
     }
 }
 
-static inline void
-igb_pci_dma_write_rx_desc(IGBCore *core, PCIDevice *dev, dma_addr_t addr,
-                          union e1000_rx_desc_union *desc, dma_addr_t len)
+/* Number of RX descriptors written back with a single DMA */
+#define IGB_RX_DESC_BATCH 8
+
+/*
+ * Write back @nr descriptors that are contiguous in the guest ring at
+ * @addr.  The descriptors are written with DD clear first and DD is set
+ * afterwards, in ring order, so that the guest never sees a completed
+ * descriptor whose other fields are not written yet.
+ */
+static void
+igb_pci_dma_write_rx_descs(IGBCore *core, PCIDevice *dev, dma_addr_t addr,
+                           union e1000_rx_desc_union *desc, unsigned int nr,
+                           dma_addr_t len)
 {
-    if (igb_rx_use_legacy_descriptor(core)) {
-        struct e1000_rx_desc *d = &desc->legacy;
-        size_t offset = offsetof(struct e1000_rx_desc, status);
-        uint8_t status = d->status;
+    uint8_t buf[IGB_RX_DESC_BATCH * sizeof(union e1000_rx_desc_union)];
+    uint32_t status[IGB_RX_DESC_BATCH];
+    bool legacy = igb_rx_use_legacy_descriptor(core);
+    size_t offset, width;
+    unsigned int i;
 
-        d->status &= ~E1000_RXD_STAT_DD;
-        pci_dma_write(dev, addr, desc, len);
+    assert(nr <= IGB_RX_DESC_BATCH && len <= sizeof(*desc));
 
-        if (status & E1000_RXD_STAT_DD) {
-            d->status = status;
-            pci_dma_write(dev, addr + offset, &status, sizeof(status));
-        }
+    if (legacy) {
+        offset = offsetof(struct e1000_rx_desc, status);
+        width = sizeof(desc->legacy.status);
     } else {
-        union e1000_adv_rx_desc *d = &desc->adv;
-        size_t offset =
-            offsetof(union e1000_adv_rx_desc, wb.upper.status_error);
-        uint32_t status = d->wb.upper.status_error;
+        offset = offsetof(union e1000_adv_rx_desc, wb.upper.status_error);
+        width = sizeof(desc->adv.wb.upper.status_error);
+    }
+
+    for (i = 0; i < nr; i++) {
+        if (legacy) {
+            status[i] = desc[i].legacy.status;
+            desc[i].legacy.status &= ~E1000_RXD_STAT_DD;
+        } else {
+            status[i] = desc[i].adv.wb.upper.status_error;
+            desc[i].adv.wb.upper.status_error &= ~E1000_RXD_STAT_DD;
+        }
+        memcpy(buf + i * len, &desc[i], len);
+    }
 
-        d->wb.upper.status_error &= ~E1000_RXD_STAT_DD;
-        pci_dma_write(dev, addr, desc, len);
+    pci_dma_write(dev, addr, buf, nr * len);
 
-        if (status & E1000_RXD_STAT_DD) {
-            d->wb.upper.status_error = status;
-            pci_dma_write(dev, addr + offset, &status, sizeof(status));
+    for (i = 0; i < nr; i++) {
+        if (!(status[i] & E1000_RXD_STAT_DD)) {
+            continue;
         }
+        if (legacy) {
+            desc[i].legacy.status = status[i];
+        } else {
+            desc[i].adv.wb.upper.status_error = status[i];
+        }
+        pci_dma_write(dev, addr + i * len + offset,
+                      (uint8_t *)&desc[i] + offset, width);
     }
 }
 
@@ -1916,8 +1941,9 @@ igb_write_packet_to_guest(IGBCore *core, struct NetRxPkt *pkt,
                           uint16_t etqf, bool ts)
 {
     PCIDevice *d;
-    dma_addr_t base;
-    union e1000_rx_desc_union desc;
+    dma_addr_t base, batch_base = 0;
+    union e1000_rx_desc_union desc[IGB_RX_DESC_BATCH];
+    unsigned int nr = 0;
     const E1000ERingInfo *rxi;
     size_t rx_desc_len;
 
@@ -1943,14 +1969,24 @@ igb_write_packet_to_guest(IGBCore *core, struct NetRxPkt *pkt,
         bool is_last = false;
 
         if (igb_ring_empty(core, rxi)) {
-            return;
+            break;
         }
 
         base = igb_ring_head_descr(core, rxi);
-        pci_dma_read(d, base, &desc, rx_desc_len);
+        if (nr && (nr == IGB_RX_DESC_BATCH ||
+                   base != batch_base + nr * rx_desc_len)) {
+            igb_pci_dma_write_rx_descs(core, d, batch_base, desc, nr,
+                                       rx_desc_len);
+            nr = 0;
+        }
+        if (!nr) {
+            batch_base = base;
+        }
+
+        pci_dma_read(d, base, &desc[nr], rx_desc_len);
         trace_e1000e_rx_descr(rxi->idx, base, rx_desc_len);
 
-        igb_read_rx_descr(core, &desc, &pdma_st, rxi);
+        igb_read_rx_descr(core, &desc[nr], &pdma_st, rxi);
 
         igb_write_to_rx_buffers(core, pkt, d, &pdma_st);
         pdma_st.desc_offset += pdma_st.desc_size;
@@ -1958,16 +1994,25 @@ igb_write_packet_to_guest(IGBCore *core, struct NetRxPkt *pkt,
             is_last = true;
         }
 
-        igb_write_rx_descr(core, &desc,
+        igb_write_rx_descr(core, &desc[nr],
                            is_last ? pkt : NULL,
                            rss_info,
                            etqf, ts,
                            &pdma_st,
                            rxi);
-        igb_pci_dma_write_rx_desc(core, d, base, &desc, rx_desc_len);
+        nr++;
         igb_ring_advance(core, rxi, rx_desc_len / E1000_MIN_RX_DESC_LEN);
     } while (pdma_st.desc_offset < pdma_st.total_size);
 
+    if (nr) {
+        igb_pci_dma_write_rx_descs(core, d, batch_base, desc, nr,
+                                   rx_desc_len);
+    }
+    if (pdma_st.desc_offset < pdma_st.total_size) {
+        /* Ran out of descriptors */
+        return;
+    }
+
     igb_update_rx_stats(core, rxi, pdma_st.size, pdma_st.total_size);
 }
 
@@ -57,6 +57,17 @@
 #define VIRTIO_NET_RX_QUEUE_MIN_SIZE VIRTIO_NET_RX_QUEUE_DEFAULT_SIZE
 #define VIRTIO_NET_TX_QUEUE_MIN_SIZE VIRTIO_NET_TX_QUEUE_DEFAULT_SIZE
 
+/*
+ * Software RSS flow balancing: the flow table size, the number of packets
+ * between rebalancing passes, and the most flows pinned per pass.
+ */
+#define VIRTIO_NET_RSS_FLOWS 256
+#define VIRTIO_NET_RSS_FLOW_WINDOW 4096
+#define VIRTIO_NET_RSS_MAX_ELEPHANTS 64
+
+/* Room for the rewritten TX descriptors of a batch, at least one packet */
+#define VIRTIO_NET_TX_SG_SIZE (2 * VIRTQUEUE_MAX_SIZE)
+
 #define VIRTIO_NET_IP4_ADDR_SIZE   8        /* ipv4 saddr + daddr */
 
 #define VIRTIO_NET_TCP_FLAG         0x3F
@@ -1266,6 +1277,12 @@ static int virtio_net_handle_announce(VirtIONet *n, uint8_t cmd,
 
 static void virtio_net_detach_epbf_rss(VirtIONet *n);
 
+static bool virtio_net_rss_flow_balance(VirtIONet *n)
+{
+    /* vhost steers packets in the kernel, only eBPF RSS works there */
+    return n->rss_data.flows && !get_vhost_net(qemu_get_queue(n->nic)->peer);
+}
+
 static void virtio_net_disable_rss(VirtIONet *n)
 {
     if (n->rss_data.enabled) {
@@ -1451,8 +1468,9 @@ static uint16_t virtio_net_handle_rss(VirtIONet *n,
         goto error;
     }
     n->rss_data.enabled = true;
+    virtio_net_rss_flows_reset(n);
 
-    if (!n->rss_data.populate_hash) {
+    if (!n->rss_data.populate_hash && !virtio_net_rss_flow_balance(n)) {
         if (!virtio_net_attach_epbf_rss(n)) {
             /* EBPF must be loaded for vhost */
             if (get_vhost_net(qemu_get_queue(n->nic)->peer)) {
@@ -1464,7 +1482,7 @@ static uint16_t virtio_net_handle_rss(VirtIONet *n,
             n->rss_data.enabled_software_rss = true;
         }
     } else {
-        /* use software RSS for hash populating */
+        /* use software RSS for hash populating or flow balancing */
         /* and detach eBPF if was loaded before */
         virtio_net_detach_epbf_rss(n);
         n->rss_data.enabled_software_rss = true;
@@ -1832,6 +1850,99 @@ static void virtio_set_packet_hash(const uint8_t *buf, uint8_t report,
     hdr->hash_report = report;
 }
 
+static void virtio_net_rss_flows_reset(VirtIONet *n)
+{
+    if (n->rss_data.flows) {
+        memset(n->rss_data.flows, 0,
+               VIRTIO_NET_RSS_FLOWS * sizeof(*n->rss_data.flows));
+        memset(n->rss_data.queue_load, 0,
+               n->max_queue_pairs * sizeof(*n->rss_data.queue_load));
+        n->rss_data.window_packets = 0;
+    }
+}
+
+/*
+ * Spread the flows that carried more than their fair share of the last
+ * window over the queues, largest first onto the least loaded queue.
+ * The remaining flows go back to following the indirection table.
+ */
+static void virtio_net_rss_flows_rebalance(VirtIONet *n)
+{
+    VirtioNetRssData *rss = &n->rss_data;
+    VirtioNetRssFlow *elephants[VIRTIO_NET_RSS_MAX_ELEPHANTS], *f;
+    uint32_t threshold = VIRTIO_NET_RSS_FLOW_WINDOW /
+                         (2 * n->curr_queue_pairs);
+    unsigned int num = 0, i, j, q, best;
+
+    for (i = 0; i < VIRTIO_NET_RSS_FLOWS; i++) {
+        f = &rss->flows[i];
+        if (n->curr_queue_pairs > 1 && f->window_packets > threshold &&
+            num < ARRAY_SIZE(elephants)) {
+            /* Insertion sort, largest first */
+            for (j = num++; j > 0 &&
+                 elephants[j - 1]->window_packets < f->window_packets; j--) {
+                elephants[j] = elephants[j - 1];
+            }
+            elephants[j] = f;
+            rss->queue_load[f->queue] -= MIN(rss->queue_load[f->queue],
+                                             f->window_packets);
+        } else {
+            f->pinned = false;
+        }
+    }
+
+    for (i = 0; i < num; i++) {
+        f = elephants[i];
+        best = f->queue < n->curr_queue_pairs ? f->queue : 0;
+        for (q = 0; q < n->curr_queue_pairs; q++) {
+            if (rss->queue_load[q] + f->window_packets / 2 <
+                rss->queue_load[best]) {
+                best = q;
+            }
+        }
+        rss->queue_load[best] += f->window_packets;
+        if (!f->pinned || f->queue != best) {
+            trace_virtio_net_rss_flow_pin(f->hash, best, f->window_packets,
+                                          f->packets, f->bytes);
+        }
+        f->queue = best;
+        f->pinned = true;
+    }
+
+    for (i = 0; i < VIRTIO_NET_RSS_FLOWS; i++) {
+        rss->flows[i].window_packets = 0;
+    }
+    memset(rss->queue_load, 0, n->max_queue_pairs * sizeof(*rss->queue_load));
+    rss->window_packets = 0;
+}
+
+/* Account a packet of the flow @hash, returns the queue to steer it to */
+static unsigned int virtio_net_rss_flow_steer(VirtIONet *n, uint32_t hash,
+                                              size_t size, unsigned int index)
+{
+    VirtioNetRssData *rss = &n->rss_data;
+    VirtioNetRssFlow *f = &rss->flows[hash % VIRTIO_NET_RSS_FLOWS];
+
+    if (f->hash != hash || !f->packets) {
+        memset(f, 0, sizeof(*f));
+        f->hash = hash;
+    }
+
+    if (f->pinned && f->queue < n->curr_queue_pairs) {
+        index = f->queue;
+    }
+    f->queue = index;
+    f->packets++;
+    f->bytes += size;
+    f->window_packets++;
+    rss->queue_load[index]++;
+
+    if (++rss->window_packets >= VIRTIO_NET_RSS_FLOW_WINDOW) {
+        virtio_net_rss_flows_rebalance(n);
+    }
+    return index;
+}
+
 static int virtio_net_process_rss(NetClientState *nc, const uint8_t *buf,
                                   size_t size)
 {
@@ -1878,6 +1989,9 @@ static int virtio_net_process_rss(NetClientState *nc, const uint8_t *buf,
     if (n->rss_data.redirect) {
         new_index = hash & (n->rss_data.indirections_len - 1);
         new_index = n->rss_data.indirections_table[new_index];
+        if (n->rss_data.flows) {
+            new_index = virtio_net_rss_flow_steer(n, hash, size, new_index);
+        }
     }
 
     return (index == new_index) ? -1 : new_index;
@@ -2650,7 +2764,7 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
     virtqueue_push(q->tx_vq, q->async_tx.elem, 0);
     virtio_notify(vdev, q->tx_vq);
 
-    g_free(q->async_tx.elem);
+    virtqueue_element_free(q->tx_vq, q->async_tx.elem);
     q->async_tx.elem = NULL;
 
     virtio_queue_set_notification(q->tx_vq, 1);
@@ -2673,13 +2787,76 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
 }
 
 /* TX */
+
+/*
+ * Give back the elements of a batch that were popped but not processed,
+ * newest first so that the next pop fetches the oldest one again.
+ */
+static void virtio_net_tx_unpop(VirtIONetQueue *q, VirtQueueElement **elems,
+                                unsigned int num)
+{
+    while (num > 0) {
+        num--;
+        virtqueue_unpop(q->tx_vq, elems[num], 0);
+        virtqueue_element_free(q->tx_vq, elems[num]);
+    }
+}
+
+/*
+ * Send the prepared packets @pkts of elems[0..num) to the backend in one
+ * go and complete them.  If the backend queues one of them, the elements
+ * after it up to elems[total - 1] are given back and -EBUSY is returned.
+ * Otherwise returns @num.
+ */
+static int virtio_net_tx_send_batch(VirtIONetQueue *q,
+                                    VirtQueueElement **elems,
+                                    const NetPacketIOV *pkts,
+                                    unsigned int num, unsigned int total)
+{
+    VirtIONet *n = q->n;
+    int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
+    int i, sent;
+
+    if (!num) {
+        return 0;
+    }
+
+    sent = qemu_sendv_packet_batch(qemu_get_subqueue(n->nic, queue_index),
+                                   pkts, num, virtio_net_tx_complete);
+    if (sent) {
+        WITH_RCU_READ_LOCK_GUARD() {
+            for (i = 0; i < sent; i++) {
+                virtqueue_fill(q->tx_vq, elems[i], 0, i);
+            }
+            virtqueue_flush(q->tx_vq, sent);
+        }
+        virtio_notify(VIRTIO_DEVICE(n), q->tx_vq);
+        for (i = 0; i < sent; i++) {
+            virtqueue_element_free(q->tx_vq, elems[i]);
+        }
+    }
+
+    if (sent < num) {
+        virtio_queue_set_notification(q->tx_vq, 0);
+        q->async_tx.elem = elems[sent];
+        virtio_net_tx_unpop(q, elems + sent + 1, total - sent - 1);
+        return -EBUSY;
+    }
+    return num;
+}
+
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
 {
     VirtIONet *n = q->n;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    VirtQueueElement *elems[VIRTQUEUE_POP_BATCH];
+    NetPacketIOV pkts[VIRTQUEUE_POP_BATCH];
+    struct virtio_net_hdr_mrg_rxbuf mhdr[VIRTQUEUE_POP_BATCH];
     VirtQueueElement *elem;
+    unsigned int i = 0, num_elems = 0, batch_start = 0, sg_used = 0;
     int32_t num_packets = 0;
-    int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
+    int ret;
+
     if (!(vdev->status & VIRTIO_CONFIG_S_DRIVER_OK)) {
         return num_packets;
     }
@@ -2690,36 +2867,48 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
     }
 
     for (;;) {
-        ssize_t ret;
         unsigned int out_num;
         struct iovec sg[VIRTQUEUE_MAX_SIZE], sg2[VIRTQUEUE_MAX_SIZE + 1], *out_sg;
-        struct virtio_net_hdr_mrg_rxbuf mhdr;
 
-        elem = virtqueue_pop(q->tx_vq, sizeof(VirtQueueElement));
-        if (!elem) {
-            break;
+        if (i == num_elems) {
+            ret = virtio_net_tx_send_batch(q, elems + batch_start, pkts,
+                                           i - batch_start,
+                                           num_elems - batch_start);
+            if (ret < 0) {
+                return ret;
+            }
+            num_packets += ret;
+            if (num_packets >= n->tx_burst) {
+                break;
+            }
+
+            num_elems = virtqueue_pop_batch(q->tx_vq, sizeof(VirtQueueElement),
+                                            (void **)elems,
+                                            MIN(ARRAY_SIZE(elems),
+                                                n->tx_burst - num_packets));
+            i = batch_start = sg_used = 0;
+            if (!num_elems) {
+                break;
+            }
         }
+        elem = elems[i++];
 
         out_num = elem->out_num;
         out_sg = elem->out_sg;
         if (out_num < 1) {
             virtio_error(vdev, "virtio-net header not in first element");
-            virtqueue_detach_element(q->tx_vq, elem, 0);
-            g_free(elem);
-            return -EINVAL;
+            goto err;
         }
 
         if (n->has_vnet_hdr) {
-            if (iov_to_buf(out_sg, out_num, 0, &mhdr, n->guest_hdr_len) <
-                n->guest_hdr_len) {
+            if (iov_to_buf(out_sg, out_num, 0, &mhdr[i - 1],
+                           n->guest_hdr_len) < n->guest_hdr_len) {
                 virtio_error(vdev, "virtio-net header incorrect");
-                virtqueue_detach_element(q->tx_vq, elem, 0);
-                g_free(elem);
-                return -EINVAL;
+                goto err;
             }
             if (n->needs_vnet_hdr_swap) {
-                virtio_net_hdr_swap(vdev, (void *) &mhdr);
-                sg2[0].iov_base = &mhdr;
+                virtio_net_hdr_swap(vdev, (void *) &mhdr[i - 1]);
+                sg2[0].iov_base = &mhdr[i - 1];
                 sg2[0].iov_len = n->guest_hdr_len;
                 out_num = iov_copy(&sg2[1], ARRAY_SIZE(sg2) - 1,
                                    out_sg, out_num,
@@ -2748,24 +2937,57 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
             out_sg = sg;
         }
 
-        ret = qemu_sendv_packet_async(qemu_get_subqueue(n->nic, queue_index),
-                                      out_sg, out_num, virtio_net_tx_complete);
-        if (ret == 0) {
-            virtio_queue_set_notification(q->tx_vq, 0);
-            q->async_tx.elem = elem;
-            return -EBUSY;
+        /*
+         * Rewritten descriptors only live on the stack, keep them in the
+         * per-queue buffer until the batch is sent.
+         */
+        if (out_sg != elem->out_sg) {
+            if (sg_used + out_num > VIRTIO_NET_TX_SG_SIZE) {
+                ret = virtio_net_tx_send_batch(q, elems + batch_start, pkts,
+                                               i - 1 - batch_start,
+                                               num_elems - batch_start);
+                if (ret < 0) {
+                    return ret;
+                }
+                num_packets += ret;
+                batch_start = i - 1;
+                sg_used = 0;
+            }
+            memcpy(q->tx_sg + sg_used, out_sg, out_num * sizeof(*out_sg));
+            out_sg = q->tx_sg + sg_used;
+            sg_used += out_num;
         }
 
+        pkts[i - 1 - batch_start].iov = out_sg;
+        pkts[i - 1 - batch_start].iovcnt = out_num;
+        continue;
+
 drop:
+        /* Complete the packets before this one first to keep them in order */
+        ret = virtio_net_tx_send_batch(q, elems + batch_start, pkts,
+                                       i - 1 - batch_start,
+                                       num_elems - batch_start);
+        if (ret < 0) {
+            return ret;
+        }
+        num_packets += ret;
+        batch_start = i;
+        sg_used = 0;
+
         virtqueue_push(q->tx_vq, elem, 0);
         virtio_notify(vdev, q->tx_vq);
-        g_free(elem);
-
-        if (++num_packets >= n->tx_burst) {
-            break;
-        }
+        virtqueue_element_free(q->tx_vq, elem);
+        num_packets++;
     }
     return num_packets;
+
+err:
+    virtio_net_tx_unpop(q, elems + i, num_elems - i);
+    for (; batch_start < i; batch_start++) {
+        virtqueue_detach_element(q->tx_vq, elems[batch_start], 0);
+        virtqueue_element_free(q->tx_vq, elems[batch_start]);
+    }
+    return -EINVAL;
 }
 
 static void virtio_net_tx_timer(void *opaque);
@@ -2942,6 +3164,9 @@ static void virtio_net_add_queue(VirtIONet *n, int index)
                                                   &DEVICE(vdev)->mem_reentrancy_guard);
     }
 
+    virtio_queue_enable_element_pool(n->vqs[index].tx_vq);
+    n->vqs[index].tx_sg = g_new(struct iovec, VIRTIO_NET_TX_SG_SIZE);
+
     n->vqs[index].tx_waiting = 0;
     n->vqs[index].n = n;
 }
@@ -2963,6 +3188,8 @@ static void virtio_net_del_queue(VirtIONet *n, int index)
         q->tx_bh = NULL;
     }
     q->tx_waiting = 0;
+    g_free(q->tx_sg);
+    q->tx_sg = NULL;
     virtio_del_queue(vdev, index * 2 + 1);
 }
 
@@ -3072,8 +3299,9 @@ static int virtio_net_post_load_device(void *opaque, int version_id)
     }
 
     if (n->rss_data.enabled) {
-        n->rss_data.enabled_software_rss = n->rss_data.populate_hash;
-        if (!n->rss_data.populate_hash) {
+        n->rss_data.enabled_software_rss = n->rss_data.populate_hash ||
+                                           virtio_net_rss_flow_balance(n);
+        if (!n->rss_data.enabled_software_rss) {
             if (!virtio_net_attach_epbf_rss(n)) {
                 if (get_vhost_net(qemu_get_queue(n->nic)->peer)) {
                     warn_report("Can't post-load eBPF RSS for vhost");
@@ -3683,6 +3911,10 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
     }
     n->vqs = g_new0(VirtIONetQueue, n->max_queue_pairs);
     n->curr_queue_pairs = 1;
+    if (n->rss_flow_balance) {
+        n->rss_data.flows = g_new0(VirtioNetRssFlow, VIRTIO_NET_RSS_FLOWS);
+        n->rss_data.queue_load = g_new0(uint32_t, n->max_queue_pairs);
+    }
     n->tx_timeout = n->net_conf.txtimer;
 
     if (n->net_conf.tx && strcmp(n->net_conf.tx, "timer")
@@ -3806,6 +4038,8 @@ static void virtio_net_device_unrealize(DeviceState *dev)
     qemu_del_nic(n->nic);
     virtio_net_rsc_cleanup(n);
     g_free(n->rss_data.indirections_table);
+    g_free(n->rss_data.flows);
+    g_free(n->rss_data.queue_load);
     net_rx_pkt_uninit(n->rx_pkt);
     virtio_cleanup(vdev);
 }
@@ -3943,6 +4177,7 @@ static Property virtio_net_properties[] = {
     DEFINE_PROP_INT32("speed", VirtIONet, net_conf.speed, SPEED_UNKNOWN),
     DEFINE_PROP_STRING("duplex", VirtIONet, net_conf.duplex_str),
     DEFINE_PROP_BOOL("failover", VirtIONet, failover, false),
+    DEFINE_PROP_BOOL("rss-flow-balance", VirtIONet, rss_flow_balance, false),
     DEFINE_PROP_BIT64("guest_uso4", VirtIONet, host_features,
                       VIRTIO_NET_F_GUEST_USO4, true),
     DEFINE_PROP_BIT64("guest_uso6", VirtIONet, host_features,
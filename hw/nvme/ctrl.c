@@ -254,6 +254,8 @@ static const uint32_t nvme_feature_cap[NVME_FID_MAX] = {
     [NVME_ERROR_RECOVERY]           = NVME_FEAT_CAP_CHANGE | NVME_FEAT_CAP_NS,
     [NVME_VOLATILE_WRITE_CACHE]     = NVME_FEAT_CAP_CHANGE,
     [NVME_NUMBER_OF_QUEUES]         = NVME_FEAT_CAP_CHANGE,
+    [NVME_INTERRUPT_COALESCING]     = NVME_FEAT_CAP_CHANGE,
+    [NVME_INTERRUPT_VECTOR_CONF]    = NVME_FEAT_CAP_CHANGE,
     [NVME_ASYNCHRONOUS_EVENT_CONF]  = NVME_FEAT_CAP_CHANGE,
     [NVME_TIMESTAMP]                = NVME_FEAT_CAP_CHANGE,
     [NVME_HOST_BEHAVIOR_SUPPORT]    = NVME_FEAT_CAP_CHANGE,
@@ -644,11 +646,38 @@ static uint8_t nvme_sq_empty(NvmeSQueue *sq)
     return sq->head == sq->tail;
 }
 
+static void nvme_lock(NvmeCtrl *n)
+{
+    if (n->iothread) {
+        aio_context_acquire(n->ctx);
+    }
+}
+
+static void nvme_unlock(NvmeCtrl *n)
+{
+    if (n->iothread) {
+        aio_context_release(n->ctx);
+    }
+}
+
+/*
+ * The IOThread does not take the BQL, so it leaves interrupt delivery
+ * to irq_bh.
+ */
+static bool nvme_defer_irq(NvmeCtrl *n)
+{
+    return n->iothread && !qemu_mutex_iothread_locked();
+}
+
 static void nvme_irq_check(NvmeCtrl *n)
 {
     PCIDevice *pci = PCI_DEVICE(n);
     uint32_t intms = ldl_le_p(&n->bar.intms);
 
+    if (nvme_defer_irq(n)) {
+        qemu_bh_schedule(n->irq_bh);
+        return;
+    }
     if (msix_enabled(pci)) {
         return;
     }
@@ -665,6 +694,11 @@ static void nvme_irq_assert(NvmeCtrl *n, NvmeCQueue *cq)
 
     if (cq->irq_enabled) {
         if (msix_enabled(pci)) {
+            if (nvme_defer_irq(n)) {
+                cq->irq_pending = true;
+                qemu_bh_schedule(n->irq_bh);
+                return;
+            }
             trace_pci_nvme_irq_msix(cq->vector);
             msix_notify(pci, cq->vector);
         } else {
@@ -693,6 +727,24 @@ static void nvme_irq_deassert(NvmeCtrl *n, NvmeCQueue *cq)
     }
 }
 
+static void nvme_irq_bh(void *opaque)
+{
+    NvmeCtrl *n = opaque;
+    int i;
+
+    nvme_lock(n);
+    for (i = 0; i <= n->params.max_ioqpairs; i++) {
+        NvmeCQueue *cq = n->cq[i];
+
+        if (cq && cq->irq_pending) {
+            cq->irq_pending = false;
+            nvme_irq_assert(n, cq);
+        }
+    }
+    nvme_irq_check(n);
+    nvme_unlock(n);
+}
+
 static void nvme_req_clear(NvmeRequest *req)
 {
     req->ns = NULL;
@@ -1482,17 +1534,101 @@ static void nvme_update_cq_head(NvmeCQueue *cq)
     trace_pci_nvme_update_cq_head(cq->cqid, cq->head);
 }
 
+/*
+ * Raise the interrupt of @cq for @posted new entries, subject to the
+ * Interrupt Coalescing feature.  The admin queue and vectors that have
+ * coalescing disabled always interrupt immediately.
+ */
+static void nvme_cq_notify(NvmeCtrl *n, NvmeCQueue *cq, uint32_t posted)
+{
+    uint16_t intc = n->features.int_coalescing;
+    uint32_t thr = NVME_INTC_THR(intc) + 1;
+    uint32_t time = NVME_INTC_TIME(intc);
+
+    if (!cq->cqid || !cq->irq_enabled || !time || thr == 1 ||
+        test_bit(cq->vector, n->features.int_vector_nocoalescing)) {
+        nvme_irq_assert(n, cq);
+        return;
+    }
+
+    cq->coalesced += posted;
+    if (cq->coalesced >= thr) {
+        timer_del(cq->coalesce_timer);
+    } else if (cq->coalesced) {
+        /* TIME is in units of 100 microseconds */
+        if (!timer_pending(cq->coalesce_timer)) {
+            timer_mod(cq->coalesce_timer,
+                      qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + time * 100000);
+        }
+        return;
+    }
+
+    cq->coalesced = 0;
+    nvme_irq_assert(n, cq);
+}
+
+static void nvme_cq_coalesce_timer_cb(void *opaque)
+{
+    NvmeCQueue *cq = opaque;
+    NvmeCtrl *n = cq->ctrl;
+
+    trace_pci_nvme_cq_coalesce_timeout(cq->cqid, cq->coalesced);
+
+    nvme_lock(n);
+    cq->coalesced = 0;
+    if (cq->tail != cq->head) {
+        nvme_irq_assert(n, cq);
+    }
+    nvme_unlock(n);
+}
+
+/* Up to this many contiguous CQEs are written with a single DMA */
+#define NVME_CQE_BATCH 16
+
+static int nvme_post_cqe_batch(NvmeCtrl *n, NvmeCQueue *cq,
+                               NvmeRequest **reqs, int nr, uint32_t start)
+{
+    NvmeCqe cqes[NVME_CQE_BATCH];
+    hwaddr addr = cq->dma_addr + ((hwaddr)start << NVME_CQES);
+    int i;
+
+    for (i = 0; i < nr; i++) {
+        cqes[i] = reqs[i]->cqe;
+    }
+
+    if (pci_dma_write(PCI_DEVICE(n), addr, cqes, nr * sizeof(NvmeCqe))) {
+        trace_pci_nvme_err_addr_write(addr);
+        trace_pci_nvme_err_cfs();
+        stl_le_p(&n->bar.csts, NVME_CSTS_FAILED);
+        return -1;
+    }
+
+    for (i = 0; i < nr; i++) {
+        NvmeRequest *req = reqs[i];
+
+        QTAILQ_REMOVE(&cq->req_list, req, entry);
+        nvme_sg_unmap(&req->sg);
+        QTAILQ_INSERT_TAIL(&req->sq->req_list, req, entry);
+    }
+
+    return 0;
+}
+
 static void nvme_post_cqes(void *opaque)
 {
     NvmeCQueue *cq = opaque;
     NvmeCtrl *n = cq->ctrl;
     NvmeRequest *req, *next;
+    NvmeRequest *batch[NVME_CQE_BATCH];
     bool pending = cq->head != cq->tail;
-    int ret;
+    uint32_t start = cq->tail, posted = 0;
+    uint8_t start_phase = cq->phase;
+    bool failed = false;
+    int nr = 0;
 
+    nvme_lock(n);
     QTAILQ_FOREACH_SAFE(req, &cq->req_list, entry, next) {
         NvmeSQueue *sq;
-        hwaddr addr;
 
         if (n->dbbuf_enabled) {
             nvme_update_cq_eventidx(cq);
@@ -1507,27 +1643,40 @@ static void nvme_post_cqes(void *opaque)
         req->cqe.status = cpu_to_le16((req->status << 1) | cq->phase);
         req->cqe.sq_id = cpu_to_le16(sq->sqid);
         req->cqe.sq_head = cpu_to_le16(sq->head);
-        addr = cq->dma_addr + (cq->tail << NVME_CQES);
-        ret = pci_dma_write(PCI_DEVICE(n), addr, (void *)&req->cqe,
-                            sizeof(req->cqe));
-        if (ret) {
-            trace_pci_nvme_err_addr_write(addr);
-            trace_pci_nvme_err_cfs();
-            stl_le_p(&n->bar.csts, NVME_CSTS_FAILED);
-            break;
-        }
-        QTAILQ_REMOVE(&cq->req_list, req, entry);
+        batch[nr++] = req;
         nvme_inc_cq_tail(cq);
-        nvme_sg_unmap(&req->sg);
-        QTAILQ_INSERT_TAIL(&sq->req_list, req, entry);
+
+        /* Flush when the batch is full or the queue wraps around */
+        if (nr == NVME_CQE_BATCH || cq->tail == 0) {
+            failed = nvme_post_cqe_batch(n, cq, batch, nr, start) < 0;
+            if (failed) {
+                break;
+            }
+            posted += nr;
+            nr = 0;
+            start = cq->tail;
+            start_phase = cq->phase;
+        }
+    }
+    if (nr && !failed) {
+        failed = nvme_post_cqe_batch(n, cq, batch, nr, start) < 0;
+        if (!failed) {
+            posted += nr;
+        }
+    }
+    if (failed) {
+        /* The entries of the failed batch stay queued */
+        cq->tail = start;
+        cq->phase = start_phase;
     }
     if (cq->tail != cq->head) {
         if (cq->irq_enabled && !pending) {
             n->cq_pending++;
         }
 
-        nvme_irq_assert(n, cq);
+        nvme_cq_notify(n, cq, posted);
     }
+    nvme_unlock(n);
 }
 
 static void nvme_enqueue_req_completion(NvmeCQueue *cq, NvmeRequest *req)
@@ -1543,8 +1692,11 @@ static void nvme_enqueue_req_completion(NvmeCQueue *cq, NvmeRequest *req)
                                       req->status, req->cmd.opcode);
     }
 
+    /* Completion callbacks run without the lock in either thread */
+    nvme_lock(cq->ctrl);
     QTAILQ_REMOVE(&req->sq->out_req_list, req, entry);
     QTAILQ_INSERT_TAIL(&cq->req_list, req, entry);
+    nvme_unlock(cq->ctrl);
 
     qemu_bh_schedule(cq->bh);
 }
@@ -4495,6 +4647,7 @@ static void nvme_cq_notifier(EventNotifier *e)
         return;
     }
 
+    nvme_lock(n);
     nvme_update_cq_head(cq);
 
     if (cq->tail == cq->head) {
@@ -4504,10 +4657,23 @@ static void nvme_cq_notifier(EventNotifier *e)
 
         nvme_irq_deassert(n, cq);
     }
+    nvme_unlock(n);
 
     qemu_bh_schedule(cq->bh);
 }
 
+static void nvme_set_notifier(NvmeCtrl *n, EventNotifier *e,
+                              EventNotifierHandler *handler,
+                              AioPollFn *poll,
+                              EventNotifierHandler *poll_ready)
+{
+    if (n->iothread) {
+        aio_set_event_notifier(n->ctx, e, handler, poll, poll_ready);
+    } else {
+        event_notifier_set_handler(e, handler);
+    }
+}
+
 static int nvme_init_cq_ioeventfd(NvmeCQueue *cq)
 {
     NvmeCtrl *n = cq->ctrl;
@@ -4519,7 +4685,7 @@ static int nvme_init_cq_ioeventfd(NvmeCQueue *cq)
         return ret;
     }
 
-    event_notifier_set_handler(&cq->notifier, nvme_cq_notifier);
+    nvme_set_notifier(n, &cq->notifier, nvme_cq_notifier, NULL, NULL);
     memory_region_add_eventfd(&n->iomem,
                               0x1000 + offset, 4, false, 0, &cq->notifier);
 
@@ -4537,6 +4703,35 @@ static void nvme_sq_notifier(EventNotifier *e)
     nvme_process_sq(sq);
 }
 
+/*
+ * In an IOThread, new commands can be picked up from the shadow doorbell
+ * while polling, before the guest decides to ring the MMIO doorbell.
+ */
+static bool nvme_sq_poll(void *opaque)
+{
+    EventNotifier *e = opaque;
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+    uint32_t tail;
+    bool ready = false;
+
+    nvme_lock(sq->ctrl);
+    if (!QTAILQ_EMPTY(&sq->req_list) &&
+        !ldl_le_pci_dma(PCI_DEVICE(sq->ctrl), sq->db_addr, &tail,
+                        MEMTXATTRS_UNSPECIFIED)) {
+        ready = tail != sq->head;
+    }
+    nvme_unlock(sq->ctrl);
+
+    return ready;
+}
+
+static void nvme_sq_poll_ready(EventNotifier *e)
+{
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+
+    nvme_process_sq(sq);
+}
+
 static int nvme_init_sq_ioeventfd(NvmeSQueue *sq)
 {
     NvmeCtrl *n = sq->ctrl;
@@ -4548,13 +4743,38 @@ static int nvme_init_sq_ioeventfd(NvmeSQueue *sq)
         return ret;
     }
 
-    event_notifier_set_handler(&sq->notifier, nvme_sq_notifier);
+    nvme_set_notifier(n, &sq->notifier, nvme_sq_notifier,
+                      nvme_sq_poll, nvme_sq_poll_ready);
     memory_region_add_eventfd(&n->iomem,
                               0x1000 + offset, 4, false, 0, &sq->notifier);
 
     return 0;
 }
 
+static void nvme_stop_sq_bh(void *opaque)
+{
+    NvmeSQueue *sq = opaque;
+
+    qemu_bh_cancel(sq->bh);
+    if (sq->ioeventfd_enabled) {
+        nvme_set_notifier(sq->ctrl, &sq->notifier, NULL, NULL, NULL);
+    }
+}
+
+/*
+ * Stop picking up new commands from @sq.  An IOThread may be running one
+ * of its handlers or waiting for the lock to do so, therefore the handlers
+ * are removed from within the IOThread and none of them can touch @sq once
+ * this returns.  The caller holds the lock exactly once; it is dropped
+ * while waiting.
+ */
+static void nvme_stop_sq(NvmeSQueue *sq, NvmeCtrl *n)
+{
+    if (sq->sqid && n->iothread) {
+        aio_wait_bh_oneshot(n->ctx, nvme_stop_sq_bh, sq);
+    }
+}
+
 static void nvme_free_sq(NvmeSQueue *sq, NvmeCtrl *n)
 {
     uint16_t offset = sq->sqid << 3;
@@ -4564,7 +4784,7 @@ static void nvme_free_sq(NvmeSQueue *sq, NvmeCtrl *n)
     if (sq->ioeventfd_enabled) {
         memory_region_del_eventfd(&n->iomem,
                                   0x1000 + offset, 4, false, 0, &sq->notifier);
-        event_notifier_set_handler(&sq->notifier, NULL);
+        nvme_set_notifier(n, &sq->notifier, NULL, NULL, NULL);
         event_notifier_cleanup(&sq->notifier);
     }
     g_free(sq->io_req);
@@ -4577,9 +4797,11 @@ static uint16_t nvme_del_sq(NvmeCtrl *n, NvmeRequest *req)
 {
     NvmeDeleteQ *c = (NvmeDeleteQ *)&req->cmd;
     NvmeRequest *r, *next;
+    NvmeNamespace *ns;
     NvmeSQueue *sq;
     NvmeCQueue *cq;
     uint16_t qid = le16_to_cpu(c->qid);
+    int i;
 
     if (unlikely(!qid || nvme_check_sqid(n, qid))) {
         trace_pci_nvme_err_invalid_del_sq(qid);
@@ -4589,10 +4811,25 @@ static uint16_t nvme_del_sq(NvmeCtrl *n, NvmeRequest *req)
     trace_pci_nvme_del_sq(qid);
 
     sq = n->sq[qid];
-    while (!QTAILQ_EMPTY(&sq->out_req_list)) {
-        r = QTAILQ_FIRST(&sq->out_req_list);
-        assert(r->aiocb);
-        blk_aio_cancel(r->aiocb);
+    nvme_stop_sq(sq, n);
+    if (n->iothread) {
+        /* blk_aio_cancel() cannot poll the IOThread from here */
+        QTAILQ_FOREACH(r, &sq->out_req_list, entry) {
+            assert(r->aiocb);
+            blk_aio_cancel_async(r->aiocb);
+        }
+        for (i = 1; i <= NVME_MAX_NAMESPACES; i++) {
+            ns = nvme_ns(n, i);
+            if (ns) {
+                nvme_ns_drain(ns);
+            }
+        }
+    } else {
+        while (!QTAILQ_EMPTY(&sq->out_req_list)) {
+            r = QTAILQ_FIRST(&sq->out_req_list);
+            assert(r->aiocb);
+            blk_aio_cancel(r->aiocb);
+        }
     }
 
     assert(QTAILQ_EMPTY(&sq->out_req_list));
@@ -4635,8 +4872,13 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
         QTAILQ_INSERT_TAIL(&(sq->req_list), &sq->io_req[i], entry);
     }
 
-    sq->bh = qemu_bh_new_guarded(nvme_process_sq, sq,
-                                 &DEVICE(sq->ctrl)->mem_reentrancy_guard);
+    if (sqid && n->iothread) {
+        /* The reentrancy guard is only safe to use in the main loop */
+        sq->bh = aio_bh_new(n->ctx, nvme_process_sq, sq);
+    } else {
+        sq->bh = qemu_bh_new_guarded(nvme_process_sq, sq,
+                                     &DEVICE(sq->ctrl)->mem_reentrancy_guard);
+    }
 
     if (n->dbbuf_enabled) {
         sq->db_addr = n->dbbuf_dbs + (sqid << 3);
@@ -5209,6 +5451,25 @@ static uint16_t nvme_get_log(NvmeCtrl *n, NvmeRequest *req)
     }
 }
 
+static void nvme_stop_cq_bh(void *opaque)
+{
+    NvmeCQueue *cq = opaque;
+
+    qemu_bh_cancel(cq->bh);
+    timer_del(cq->coalesce_timer);
+    if (cq->ioeventfd_enabled) {
+        nvme_set_notifier(cq->ctrl, &cq->notifier, NULL, NULL, NULL);
+    }
+}
+
+/* Like nvme_stop_sq(), for a completion queue with no requests left */
+static void nvme_stop_cq(NvmeCQueue *cq, NvmeCtrl *n)
+{
+    if (cq->cqid && n->iothread) {
+        aio_wait_bh_oneshot(n->ctx, nvme_stop_cq_bh, cq);
+    }
+}
+
 static void nvme_free_cq(NvmeCQueue *cq, NvmeCtrl *n)
 {
     PCIDevice *pci = PCI_DEVICE(n);
@@ -5216,10 +5477,14 @@ static void nvme_free_cq(NvmeCQueue *cq, NvmeCtrl *n)
 
     n->cq[cq->cqid] = NULL;
     qemu_bh_delete(cq->bh);
+    if (cq->coalesce_timer) {
+        timer_free(cq->coalesce_timer);
+        cq->coalesce_timer = NULL;
+    }
     if (cq->ioeventfd_enabled) {
         memory_region_del_eventfd(&n->iomem,
                                   0x1000 + offset, 4, false, 0, &cq->notifier);
-        event_notifier_set_handler(&cq->notifier, NULL);
+        nvme_set_notifier(n, &cq->notifier, NULL, NULL, NULL);
         event_notifier_cleanup(&cq->notifier);
     }
     if (msix_enabled(pci)) {
@@ -5253,6 +5518,7 @@ static uint16_t nvme_del_cq(NvmeCtrl *n, NvmeRequest *req)
 
     nvme_irq_deassert(n, cq);
     trace_pci_nvme_del_cq(qid);
+    nvme_stop_cq(cq, n);
     nvme_free_cq(cq, n);
     return NVME_SUCCESS;
 }
@@ -5287,8 +5553,20 @@ static void nvme_init_cq(NvmeCQueue *cq, NvmeCtrl *n, uint64_t dma_addr,
         }
     }
     n->cq[cqid] = cq;
-    cq->bh = qemu_bh_new_guarded(nvme_post_cqes, cq,
-                                 &DEVICE(cq->ctrl)->mem_reentrancy_guard);
+    cq->coalesced = 0;
+    if (cqid && n->iothread) {
+        cq->bh = aio_bh_new(n->ctx, nvme_post_cqes, cq);
+        cq->coalesce_timer = aio_timer_new(n->ctx, QEMU_CLOCK_VIRTUAL,
+                                           SCALE_NS,
+                                           nvme_cq_coalesce_timer_cb, cq);
+    } else {
+        if (cqid) {
+            cq->coalesce_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                              nvme_cq_coalesce_timer_cb, cq);
+        }
+        cq->bh = qemu_bh_new_guarded(nvme_post_cqes, cq,
+                                     &DEVICE(cq->ctrl)->mem_reentrancy_guard);
+    }
 }
 
 static uint16_t nvme_create_cq(NvmeCtrl *n, NvmeRequest *req)
@@ -5978,6 +6256,21 @@ static uint16_t nvme_get_feature(NvmeCtrl *n, NvmeRequest *req)
         }
         trace_pci_nvme_getfeat_vwcache(result ? "enabled" : "disabled");
         goto out;
+    case NVME_INTERRUPT_COALESCING:
+        result = n->features.int_coalescing;
+        goto out;
+    case NVME_INTERRUPT_VECTOR_CONF:
+        iv = dw11 & 0xffff;
+        if (iv >= n->conf_ioqpairs + 1) {
+            return NVME_INVALID_FIELD | NVME_DNR;
+        }
+
+        result = iv;
+        if (iv == n->admin_cq.vector ||
+            test_bit(iv, n->features.int_vector_nocoalescing)) {
+            result |= NVME_INTVC_NOCOALESCING;
+        }
+        goto out;
     case NVME_ASYNCHRONOUS_EVENT_CONF:
         result = n->features.async_config;
         goto out;
@@ -6141,6 +6434,7 @@ static uint16_t nvme_set_feature(NvmeCtrl *n, NvmeRequest *req)
     uint8_t fid = NVME_GETSETFEAT_FID(dw10);
     uint8_t save = NVME_SETFEAT_SAVE(dw10);
     uint16_t status;
+    uint16_t iv;
     int i;
 
     trace_pci_nvme_setfeat(nvme_cid(req), nsid, fid, save, dw11);
@@ -6257,6 +6551,21 @@ static uint16_t nvme_set_feature(NvmeCtrl *n, NvmeRequest *req)
         req->cqe.result = cpu_to_le32((n->conf_ioqpairs - 1) |
                                       ((n->conf_ioqpairs - 1) << 16));
         break;
+    case NVME_INTERRUPT_COALESCING:
+        n->features.int_coalescing = dw11 & 0xffff;
+        break;
+    case NVME_INTERRUPT_VECTOR_CONF:
+        iv = dw11 & 0xffff;
+        if (iv >= n->conf_ioqpairs + 1) {
+            return NVME_INVALID_FIELD | NVME_DNR;
+        }
+
+        if (dw11 & NVME_INTVC_NOCOALESCING) {
+            set_bit(iv, n->features.int_vector_nocoalescing);
+        } else if (iv != n->admin_cq.vector) {
+            clear_bit(iv, n->features.int_vector_nocoalescing);
+        }
+        break;
     case NVME_ASYNCHRONOUS_EVENT_CONF:
         n->features.async_config = dw11;
         break;
@@ -7002,6 +7311,7 @@ static void nvme_process_sq(void *opaque)
     NvmeCmd cmd;
     NvmeRequest *req;
 
+    nvme_lock(n);
     if (n->dbbuf_enabled) {
         nvme_update_sq_tail(sq);
     }
@@ -7035,6 +7345,7 @@ static void nvme_process_sq(void *opaque)
             nvme_update_sq_tail(sq);
         }
     }
+    nvme_unlock(n);
 }
 
 static void nvme_update_msixcap_ts(PCIDevice *pci_dev, uint32_t table_size)
@@ -7082,6 +7393,13 @@ static void nvme_ctrl_reset(NvmeCtrl *n, NvmeResetType rst)
     NvmeNamespace *ns;
     int i;
 
+    /* Nothing else gets submitted, so draining waits for the last request */
+    for (i = 0; i < n->params.max_ioqpairs + 1; i++) {
+        if (n->sq[i] != NULL) {
+            nvme_stop_sq(n->sq[i], n);
+        }
+    }
+
     for (i = 1; i <= NVME_MAX_NAMESPACES; i++) {
         ns = nvme_ns(n, i);
         if (!ns) {
@@ -7098,6 +7416,7 @@ static void nvme_ctrl_reset(NvmeCtrl *n, NvmeResetType rst)
     }
     for (i = 0; i < n->params.max_ioqpairs + 1; i++) {
         if (n->cq[i] != NULL) {
+            nvme_stop_cq(n->cq[i], n);
             nvme_free_cq(n->cq[i], n);
         }
     }
@@ -7512,9 +7831,9 @@ static void nvme_write_bar(NvmeCtrl *n, hwaddr offset, uint64_t data,
     }
 }
 
-static uint64_t nvme_mmio_read(void *opaque, hwaddr addr, unsigned size)
+static uint64_t nvme_mmio_read_locked(NvmeCtrl *n, hwaddr addr,
+                                      unsigned size)
 {
-    NvmeCtrl *n = (NvmeCtrl *)opaque;
     uint8_t *ptr = (uint8_t *)&n->bar;
 
     trace_pci_nvme_mmio_read(addr, size);
@@ -7708,11 +8027,9 @@ static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
     }
 }
 
-static void nvme_mmio_write(void *opaque, hwaddr addr, uint64_t data,
-                            unsigned size)
+static void nvme_mmio_write_locked(NvmeCtrl *n, hwaddr addr, uint64_t data,
+                                   unsigned size)
 {
-    NvmeCtrl *n = (NvmeCtrl *)opaque;
-
     trace_pci_nvme_mmio_write(addr, data, size);
 
     if (pci_is_vf(PCI_DEVICE(n)) && !nvme_sctrl(n)->scs &&
@@ -7728,6 +8045,28 @@ static void nvme_mmio_write(void *opaque, hwaddr addr, uint64_t data,
     }
 }
 
+static uint64_t nvme_mmio_read(void *opaque, hwaddr addr, unsigned size)
+{
+    NvmeCtrl *n = (NvmeCtrl *)opaque;
+    uint64_t ret;
+
+    nvme_lock(n);
+    ret = nvme_mmio_read_locked(n, addr, size);
+    nvme_unlock(n);
+
+    return ret;
+}
+
+static void nvme_mmio_write(void *opaque, hwaddr addr, uint64_t data,
+                            unsigned size)
+{
+    NvmeCtrl *n = (NvmeCtrl *)opaque;
+
+    nvme_lock(n);
+    nvme_mmio_write_locked(n, addr, data, size);
+    nvme_unlock(n);
+}
+
 static const MemoryRegionOps nvme_mmio_ops = {
     .read = nvme_mmio_read,
     .write = nvme_mmio_write,
@@ -7778,6 +8117,11 @@ static bool nvme_check_params(NvmeCtrl *n, Error **errp)
         return false;
     }
 
+    if (n->iothread && n->subsys) {
+        error_setg(errp, "iothread is not supported with subsystems");
+        return false;
+    }
+
     if (params->max_ioqpairs < 1 ||
         params->max_ioqpairs > NVME_MAX_IOQPAIRS) {
         error_setg(errp, "max_ioqpairs must be between 1 and %d",
@@ -8319,6 +8663,14 @@ static void nvme_realize(PCIDevice *pci_dev, Error **errp)
         return;
     }
 
+    if (n->iothread) {
+        n->ctx = iothread_get_aio_context(n->iothread);
+        n->irq_bh = qemu_bh_new_guarded(nvme_irq_bh, n,
+                                        &dev->mem_reentrancy_guard);
+    } else {
+        n->ctx = qemu_get_aio_context();
+    }
+
     qbus_init(&n->bus, sizeof(NvmeBus), TYPE_NVME_BUS, dev, dev->id);
 
     if (nvme_init_subsys(n, errp)) {
@@ -8339,6 +8691,10 @@ static void nvme_realize(PCIDevice *pci_dev, Error **errp)
             return;
         }
 
+        if (nvme_ns_set_aio_context(ns, n->ctx, errp)) {
+            return;
+        }
+
         nvme_attach_ns(n, ns);
     }
 }
@@ -8349,7 +8705,16 @@ static void nvme_exit(PCIDevice *pci_dev)
     NvmeNamespace *ns;
     int i;
 
+    nvme_lock(n);
     nvme_ctrl_reset(n, NVME_RESET_FUNCTION);
+    nvme_unlock(n);
+
+    if (n->irq_bh) {
+        qemu_bh_delete(n->irq_bh);
+    }
+    if (n->namespace.blkconf.blk) {
+        nvme_ns_set_aio_context(&n->namespace, qemu_get_aio_context(), NULL);
+    }
 
     if (n->subsys) {
         for (i = 1; i <= NVME_MAX_NAMESPACES; i++) {
@@ -8400,6 +8765,8 @@ static Property nvme_props[] = {
     DEFINE_PROP_BOOL("use-intel-id", NvmeCtrl, params.use_intel_id, false),
     DEFINE_PROP_BOOL("legacy-cmb", NvmeCtrl, params.legacy_cmb, false),
     DEFINE_PROP_BOOL("ioeventfd", NvmeCtrl, params.ioeventfd, false),
+    DEFINE_PROP_LINK("iothread", NvmeCtrl, iothread, TYPE_IOTHREAD,
+                     IOThread *),
     DEFINE_PROP_UINT8("zoned.zasl", NvmeCtrl, params.zasl, 0),
     DEFINE_PROP_BOOL("zoned.auto_transition", NvmeCtrl,
                      params.auto_transition_zones, true),
@@ -8450,11 +8817,13 @@ static void nvme_set_smart_warning(Object *obj, Visitor *v, const char *name,
     n->smart_critical_warning = value;
 
     /* only inject new bits of smart critical warning */
+    nvme_lock(n);
     for (index = 0; index < NVME_SMART_WARN_MAX; index++) {
         event = 1 << index;
         if (value & ~old_value & event)
             nvme_smart_event(n, event);
     }
+    nvme_unlock(n);
 }
 
 static void nvme_pci_reset(DeviceState *qdev)
@@ -8463,7 +8832,9 @@ static void nvme_pci_reset(DeviceState *qdev)
     NvmeCtrl *n = NVME(pci_dev);
 
     trace_pci_nvme_pci_reset();
+    nvme_lock(n);
     nvme_ctrl_reset(n, NVME_RESET_FUNCTION);
+    nvme_unlock(n);
 }
 
 static void nvme_sriov_pre_write_ctrl(PCIDevice *dev, uint32_t address,
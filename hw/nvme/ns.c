@@ -702,13 +702,35 @@ void nvme_ns_cleanup(NvmeNamespace *ns)
     }
 }
 
+/* Move the namespace's BlockBackend to the AioContext of its controller */
+int nvme_ns_set_aio_context(NvmeNamespace *ns, AioContext *ctx, Error **errp)
+{
+    AioContext *old_context = blk_get_aio_context(ns->blkconf.blk);
+    int ret;
+
+    if (old_context == ctx) {
+        return 0;
+    }
+
+    aio_context_acquire(old_context);
+    ret = blk_set_aio_context(ns->blkconf.blk, ctx, errp);
+    aio_context_release(old_context);
+
+    return ret;
+}
+
 static void nvme_ns_unrealize(DeviceState *dev)
 {
     NvmeNamespace *ns = NVME_NS(dev);
+    AioContext *ctx = blk_get_aio_context(ns->blkconf.blk);
 
+    aio_context_acquire(ctx);
     nvme_ns_drain(ns);
     nvme_ns_shutdown(ns);
     nvme_ns_cleanup(ns);
+    aio_context_release(ctx);
+
+    nvme_ns_set_aio_context(ns, qemu_get_aio_context(), NULL);
 }
 
 static void nvme_ns_realize(DeviceState *dev, Error **errp)
@@ -788,6 +810,10 @@ static void nvme_ns_realize(DeviceState *dev, Error **errp)
 
     }
 
+    if (nvme_ns_set_aio_context(ns, n->ctx, errp)) {
+        return;
+    }
+
     nvme_attach_ns(n, ns);
 }
 
@@ -23,6 +23,7 @@
 #include "hw/block/block.h"
 
 #include "block/nvme.h"
+#include "sysemu/iothread.h"
 
 #define NVME_MAX_CONTROLLERS 256
 #define NVME_MAX_NAMESPACES  256
@@ -369,6 +370,7 @@ static inline void nvme_fdp_stat_inc(uint64_t *a, uint64_t b)
 
 void nvme_ns_init_format(NvmeNamespace *ns);
 int nvme_ns_setup(NvmeNamespace *ns, Error **errp);
+int nvme_ns_set_aio_context(NvmeNamespace *ns, AioContext *ctx, Error **errp);
 void nvme_ns_drain(NvmeNamespace *ns);
 void nvme_ns_shutdown(NvmeNamespace *ns);
 void nvme_ns_cleanup(NvmeNamespace *ns);
@@ -494,6 +496,9 @@ typedef struct NvmeCQueue {
     QEMUBH      *bh;
     EventNotifier notifier;
     bool        ioeventfd_enabled;
+    bool        irq_pending;        /* MSI-X to be sent by irq_bh */
+    uint32_t    coalesced;          /* entries posted without interrupt */
+    QEMUTimer   *coalesce_timer;
     QTAILQ_HEAD(, NvmeSQueue) sq_list;
     QTAILQ_HEAD(, NvmeRequest) req_list;
 } NvmeCQueue;
@@ -552,6 +557,17 @@ typedef struct NvmeCtrl {
     uint64_t    dbbuf_eis;
     bool        dbbuf_enabled;
 
+    /*
+     * With an IOThread, the I/O queues are processed in its AioContext.
+     * Queue state is only touched with the AioContext lock held, in
+     * either thread, and the IOThread handlers of an I/O queue are
+     * removed from within the IOThread before the queue is freed.
+     * Interrupts are raised from irq_bh in the main loop.
+     */
+    IOThread    *iothread;
+    AioContext  *ctx;
+    QEMUBH      *irq_bh;
+
     struct {
         MemoryRegion mem;
         uint8_t      *buf;
@@ -593,6 +609,8 @@ typedef struct NvmeCtrl {
         };
 
         uint32_t                async_config;
+        uint16_t                int_coalescing;
+        DECLARE_BITMAP(int_vector_nocoalescing, PCI_MSIX_FLAGS_QSIZE + 1);
         NvmeHostBehaviorSupport hbs;
     } features;
 
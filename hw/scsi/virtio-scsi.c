@@ -224,6 +224,21 @@ static VirtIOSCSIReq *virtio_scsi_pop_req(VirtIOSCSI *s, VirtQueue *vq)
     return req;
 }
 
+static unsigned int virtio_scsi_pop_reqs(VirtIOSCSI *s, VirtQueue *vq,
+                                         VirtIOSCSIReq **reqs,
+                                         unsigned int max)
+{
+    VirtIOSCSICommon *vs = (VirtIOSCSICommon *)s;
+    unsigned int i, n;
+
+    n = virtqueue_pop_batch(vq, sizeof(VirtIOSCSIReq) + vs->cdb_size,
+                            (void **)reqs, max);
+    for (i = 0; i < n; i++) {
+        virtio_scsi_init_req(s, vq, reqs[i]);
+    }
+    return n;
+}
+
 static void virtio_scsi_save_request(QEMUFile *f, SCSIRequest *sreq)
 {
     VirtIOSCSIReq *req = sreq->hba_private;
@@ -760,7 +775,44 @@ static void virtio_scsi_fail_cmd_req(VirtIOSCSIReq *req)
     virtio_scsi_complete_cmd_req(req);
 }
 
-static int virtio_scsi_handle_cmd_req_prepare(VirtIOSCSI *s, VirtIOSCSIReq *req)
+/*
+ * Requests popped in one virtqueue drain usually target the same LUN. Keep a
+ * reference to the last device looked up, so that walking the bus children
+ * is not needed for every request on guests with many LUNs. The cache only
+ * lives for one drain.
+ */
+typedef struct VirtIOSCSIDeviceCache {
+    uint8_t lun[8];
+    SCSIDevice *dev;
+} VirtIOSCSIDeviceCache;
+
+static SCSIDevice *virtio_scsi_device_get_cached(VirtIOSCSI *s, uint8_t *lun,
+                                                 VirtIOSCSIDeviceCache *cache)
+{
+    SCSIDevice *d;
+
+    if (cache->dev && !memcmp(cache->lun, lun, sizeof(cache->lun)) &&
+        qdev_is_realized(&cache->dev->qdev)) {
+        object_ref(cache->dev);
+        return cache->dev;
+    }
+
+    if (cache->dev) {
+        object_unref(OBJECT(cache->dev));
+        cache->dev = NULL;
+    }
+    d = virtio_scsi_device_get(s, lun);
+    if (d) {
+        object_ref(d);
+        memcpy(cache->lun, lun, sizeof(cache->lun));
+        cache->dev = d;
+    }
+    return d;
+}
+
+static int virtio_scsi_handle_cmd_req_prepare(VirtIOSCSI *s,
+                                              VirtIOSCSIReq *req,
+                                              VirtIOSCSIDeviceCache *cache)
 {
     VirtIOSCSICommon *vs = VIRTIO_SCSI_COMMON(s);
     SCSIDevice *d;
@@ -780,7 +832,7 @@ static int virtio_scsi_handle_cmd_req_prepare(VirtIOSCSI *s, VirtIOSCSIReq *req)
     trace_virtio_scsi_cmd_req(virtio_scsi_get_lun(req->req.cmd.lun),
                               req->req.cmd.tag, req->req.cmd.cdb[0]);
 
-    d = virtio_scsi_device_get(s, req->req.cmd.lun);
+    d = virtio_scsi_device_get_cached(s, req->req.cmd.lun, cache);
     if (!d) {
         req->resp.cmd.response = VIRTIO_SCSI_S_BAD_TARGET;
         virtio_scsi_complete_cmd_req(req);
@@ -818,6 +870,9 @@ static void virtio_scsi_handle_cmd_req_submit(VirtIOSCSI *s, VirtIOSCSIReq *req)
 static void virtio_scsi_handle_cmd_vq(VirtIOSCSI *s, VirtQueue *vq)
 {
     VirtIOSCSIReq *req, *next;
+    VirtIOSCSIReq *batch[VIRTQUEUE_POP_BATCH];
+    VirtIOSCSIDeviceCache cache = {};
+    unsigned int i, n;
     int ret = 0;
     bool suppress_notifications = virtio_queue_get_notification(vq);
 
@@ -828,11 +883,18 @@ static void virtio_scsi_handle_cmd_vq(VirtIOSCSI *s, VirtQueue *vq)
             virtio_queue_set_notification(vq, 0);
         }
 
-        while ((req = virtio_scsi_pop_req(s, vq))) {
-            ret = virtio_scsi_handle_cmd_req_prepare(s, req);
-            if (!ret) {
-                QTAILQ_INSERT_TAIL(&reqs, req, next);
-            } else if (ret == -EINVAL) {
+        while (ret != -EINVAL &&
+               (n = virtio_scsi_pop_reqs(s, vq, batch, ARRAY_SIZE(batch)))) {
+            for (i = 0; i < n; i++) {
+                req = batch[i];
+                ret = virtio_scsi_handle_cmd_req_prepare(s, req, &cache);
+                if (!ret) {
+                    QTAILQ_INSERT_TAIL(&reqs, req, next);
+                } else if (ret == -EINVAL) {
+                    break;
+                }
+            }
+            if (ret == -EINVAL) {
                 /* The device is broken and shouldn't process any request */
                 while (!QTAILQ_EMPTY(&reqs)) {
                     req = QTAILQ_FIRST(&reqs);
@@ -842,6 +904,10 @@ static void virtio_scsi_handle_cmd_vq(VirtIOSCSI *s, VirtQueue *vq)
                     virtqueue_detach_element(req->vq, &req->elem, 0);
                     virtio_scsi_free_req(req);
                 }
+                for (i++; i < n; i++) {
+                    virtqueue_detach_element(vq, &batch[i]->elem, 0);
+                    virtio_scsi_free_req(batch[i]);
+                }
             }
         }
 
@@ -850,6 +916,10 @@ static void virtio_scsi_handle_cmd_vq(VirtIOSCSI *s, VirtQueue *vq)
         }
     } while (ret != -EINVAL && !virtio_queue_empty(vq));
 
+    if (cache.dev) {
+        object_unref(OBJECT(cache.dev));
+    }
+
     QTAILQ_FOREACH_SAFE(req, &reqs, next, next) {
         virtio_scsi_handle_cmd_req_submit(s, req);
     }
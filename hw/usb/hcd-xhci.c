@@ -684,11 +684,63 @@ static void xhci_event(XHCIState *xhci, XHCIEvent *event, int v)
     xhci_intr_raise(xhci, v);
 }
 
+static void xhci_trb_cache_invalidate(XHCIState *xhci)
+{
+    xhci->trb_cache_len = 0;
+}
+
+/*
+ * Read the TRB at @addr of a ring whose consumer cycle state is @ccs.
+ *
+ * TRBs are prefetched XHCI_TRB_PREFETCH at a time, so that a TD is not
+ * fetched from guest memory one TRB (and one DMA translation) at a time,
+ * and twice because xhci_ring_chain_length() looks at it first.  A cached
+ * TRB is only used while its cycle bit shows it is owned by the xHC; the
+ * guest does not touch such TRBs until the dequeue pointer moves past
+ * them.  TRBs that are not owned yet are always read again.
+ */
+static bool xhci_read_trb(XHCIState *xhci, dma_addr_t addr, bool ccs,
+                          XHCITRB *trb)
+{
+    dma_addr_t off = addr - xhci->trb_cache_addr;
+    const uint8_t *p;
+
+    if (addr < xhci->trb_cache_addr ||
+        off + TRB_SIZE > xhci->trb_cache_len * TRB_SIZE ||
+        !!(ldl_le_p(xhci->trb_cache + off + 12) & TRB_C) != ccs) {
+        /* Ring segments never cross a 64k boundary */
+        unsigned int n = MIN(XHCI_TRB_PREFETCH,
+                             (0x10000 - (addr & 0xffff)) / TRB_SIZE);
+
+        xhci->trb_cache_len = 0;
+        if (n == 0 ||
+            dma_memory_read(xhci->as, addr, xhci->trb_cache, n * TRB_SIZE,
+                            MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+            /* The prefetch may extend past the end of guest memory */
+            n = 1;
+            if (dma_memory_read(xhci->as, addr, xhci->trb_cache, TRB_SIZE,
+                                MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+                return false;
+            }
+        }
+        xhci->trb_cache_addr = addr;
+        xhci->trb_cache_len = n;
+        off = 0;
+    }
+
+    p = xhci->trb_cache + off;
+    trb->parameter = ldq_le_p(p);
+    trb->status = ldl_le_p(p + 8);
+    trb->control = ldl_le_p(p + 12);
+    return true;
+}
+
 static void xhci_ring_init(XHCIState *xhci, XHCIRing *ring,
                            dma_addr_t base)
 {
     ring->dequeue = base;
     ring->ccs = 1;
+    xhci_trb_cache_invalidate(xhci);
 }
 
 static TRBType xhci_ring_fetch(XHCIState *xhci, XHCIRing *ring, XHCITRB *trb,
@@ -698,17 +750,13 @@ static TRBType xhci_ring_fetch(XHCIState *xhci, XHCIRing *ring, XHCITRB *trb,
 
     while (1) {
         TRBType type;
-        if (dma_memory_read(xhci->as, ring->dequeue, trb, TRB_SIZE,
-                            MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+        if (!xhci_read_trb(xhci, ring->dequeue, ring->ccs, trb)) {
             qemu_log_mask(LOG_GUEST_ERROR, "%s: DMA memory access failed!\n",
                           __func__);
             return 0;
         }
         trb->addr = ring->dequeue;
         trb->ccs = ring->ccs;
-        le64_to_cpus(&trb->parameter);
-        le32_to_cpus(&trb->status);
-        le32_to_cpus(&trb->control);
 
         trace_usb_xhci_fetch_trb(ring->dequeue, trb_name(trb),
                                  trb->parameter, trb->status, trb->control);
@@ -750,15 +798,11 @@ static int xhci_ring_chain_length(XHCIState *xhci, const XHCIRing *ring)
 
     do {
         TRBType type;
-        if (dma_memory_read(xhci->as, dequeue, &trb, TRB_SIZE,
-                        MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+        if (!xhci_read_trb(xhci, dequeue, ccs, &trb)) {
             qemu_log_mask(LOG_GUEST_ERROR, "%s: DMA memory access failed!\n",
                           __func__);
             return -1;
         }
-        le64_to_cpus(&trb.parameter);
-        le32_to_cpus(&trb.status);
-        le32_to_cpus(&trb.control);
 
         if ((trb.control & TRB_C) != ccs) {
             return -length;
@@ -1961,6 +2005,7 @@ static void xhci_kick_epctx(XHCIEPContext *epctx, unsigned int streamid)
     }
 
     epctx->kick_active++;
+    xhci_trb_cache_invalidate(xhci);
     while (1) {
         length = xhci_ring_chain_length(xhci, ring);
         if (length <= 0) {
@@ -2484,6 +2529,7 @@ static void xhci_process_commands(XHCIState *xhci)
     }
 
     xhci->crcr_low |= CRCR_CRR;
+    xhci_trb_cache_invalidate(xhci);
 
     while ((type = xhci_ring_fetch(xhci, &xhci->cmd_ring, &trb, &addr))) {
         event.ptr = addr;
@@ -32,6 +32,9 @@ OBJECT_DECLARE_SIMPLE_TYPE(XHCIState, XHCI)
 /* Very pessimistic, let's hope it's enough for all cases */
 #define EV_QUEUE (((3 * 24) + 16) * XHCI_MAXSLOTS)
 
+/* Number of TRBs fetched from a transfer or command ring at once */
+#define XHCI_TRB_PREFETCH 16
+
 typedef struct XHCIStreamContext XHCIStreamContext;
 typedef struct XHCIEPContext XHCIEPContext;
 
@@ -219,6 +222,11 @@ typedef struct XHCIState {
 
     XHCIRing cmd_ring;
 
+    /* raw TRBs prefetched from guest memory, see xhci_read_trb() */
+    uint8_t trb_cache[XHCI_TRB_PREFETCH * 16];
+    dma_addr_t trb_cache_addr;
+    unsigned int trb_cache_len;
+
     bool nec_quirks;
 } XHCIState;
 
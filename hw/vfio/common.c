@@ -44,6 +44,7 @@
 #include "migration/blocker.h"
 #include "migration/qemu-file.h"
 #include "sysemu/tpm.h"
+#include "sysemu/hostmem.h"
 
 VFIODeviceList vfio_device_list =
     QLIST_HEAD_INITIALIZER(vfio_device_list);
@@ -567,6 +568,40 @@ static bool vfio_get_section_iova_range(VFIOContainerBase *bcontainer,
     return true;
 }
 
+/*
+ * Pinning in VFIO_IOMMU_MAP_DMA faults in and zeroes all of the guest RAM
+ * of the section on a single thread. This is most of the startup time of
+ * large guests. Populate RAM of a memory backend with its preallocation
+ * threads first, so that pinning only needs to walk the page tables. This
+ * does not change the memory footprint, as everything gets pinned anyway.
+ */
+static void vfio_prefault_section(MemoryRegionSection *section, void *vaddr,
+                                  hwaddr size)
+{
+    Object *owner = memory_region_owner(section->mr);
+    HostMemoryBackend *backend;
+    Error *local_err = NULL;
+
+    if (section->readonly || !owner ||
+        !object_dynamic_cast(owner, TYPE_MEMORY_BACKEND)) {
+        return;
+    }
+
+    backend = MEMORY_BACKEND(owner);
+    if (backend->prealloc || backend->prealloc_threads <= 1) {
+        return;
+    }
+
+    trace_vfio_prefault_section(vaddr, size, backend->prealloc_threads);
+    qemu_prealloc_mem(memory_region_get_fd(section->mr), vaddr, size,
+                      backend->prealloc_threads, backend->prealloc_context,
+                      &local_err);
+    if (local_err) {
+        /* Not fatal, pinning will populate the memory */
+        error_free(local_err);
+    }
+}
+
 static void vfio_listener_region_add(MemoryListener *listener,
                                      MemoryRegionSection *section)
 {
@@ -691,6 +726,10 @@ static void vfio_listener_region_add(MemoryListener *listener,
         }
     }
 
+    if (!memory_region_is_ram_device(section->mr)) {
+        vfio_prefault_section(section, vaddr, int128_get64(llsize));
+    }
+
     ret = vfio_container_dma_map(bcontainer, iova, int128_get64(llsize),
                                  vaddr, section->readonly);
     if (ret) {
@@ -1094,6 +1133,45 @@ static void vfio_listener_log_global_start(MemoryListener *listener)
     }
 }
 
+/*
+ * Dirty bitmaps of large RAM sections are many MBs big. Allocating them for
+ * every query means faulting in fresh zeroed pages each time, so keep one
+ * buffer around while dirty tracking is active and only grow it. Queries
+ * are done with the BQL held.
+ */
+static unsigned long *vfio_dirty_bitmap_buf;
+static hwaddr vfio_dirty_bitmap_buf_size;
+
+static int vfio_dirty_bitmap_get(VFIOBitmap *vbmap, hwaddr size)
+{
+    assert(qemu_mutex_iothread_locked());
+
+    vbmap->pages = REAL_HOST_PAGE_ALIGN(size) / qemu_real_host_page_size();
+    vbmap->size = ROUND_UP(vbmap->pages, sizeof(__u64) * BITS_PER_BYTE) /
+                                         BITS_PER_BYTE;
+    if (vbmap->size > vfio_dirty_bitmap_buf_size) {
+        g_free(vfio_dirty_bitmap_buf);
+        vfio_dirty_bitmap_buf = g_try_malloc(vbmap->size);
+        if (!vfio_dirty_bitmap_buf) {
+            vfio_dirty_bitmap_buf_size = 0;
+            return -ENOMEM;
+        }
+        vfio_dirty_bitmap_buf_size = vbmap->size;
+    }
+
+    memset(vfio_dirty_bitmap_buf, 0, vbmap->size);
+    vbmap->bitmap = vfio_dirty_bitmap_buf;
+
+    return 0;
+}
+
+static void vfio_dirty_bitmap_release(void)
+{
+    g_free(vfio_dirty_bitmap_buf);
+    vfio_dirty_bitmap_buf = NULL;
+    vfio_dirty_bitmap_buf_size = 0;
+}
+
 static void vfio_listener_log_global_stop(MemoryListener *listener)
 {
     VFIOContainerBase *bcontainer = container_of(listener, VFIOContainerBase,
@@ -1105,6 +1183,7 @@ static void vfio_listener_log_global_stop(MemoryListener *listener)
     } else {
         ret = vfio_container_set_dirty_page_tracking(bcontainer, false);
     }
+    vfio_dirty_bitmap_release();
 
     if (ret) {
         error_report("vfio: Could not stop dirty page tracking, err: %d (%s)",
@@ -1178,7 +1257,7 @@ int vfio_get_dirty_bitmap(const VFIOContainerBase *bcontainer, uint64_t iova,
         return 0;
     }
 
-    ret = vfio_bitmap_alloc(&vbmap, size);
+    ret = vfio_dirty_bitmap_get(&vbmap, size);
     if (ret) {
         return ret;
     }
@@ -1190,17 +1269,15 @@ int vfio_get_dirty_bitmap(const VFIOContainerBase *bcontainer, uint64_t iova,
     }
 
     if (ret) {
-        goto out;
+        return ret;
     }
 
     dirty_pages = cpu_physical_memory_set_dirty_lebitmap(vbmap.bitmap, ram_addr,
                                                          vbmap.pages);
 
     trace_vfio_get_dirty_bitmap(iova, size, vbmap.size, ram_addr, dirty_pages);
-out:
-    g_free(vbmap.bitmap);
 
-    return ret;
+    return 0;
 }
 
 typedef struct {
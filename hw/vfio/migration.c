@@ -12,6 +12,7 @@
 #include "qemu/cutils.h"
 #include "qemu/units.h"
 #include "qemu/error-report.h"
+#include "qemu/thread.h"
 #include <linux/vfio.h>
 #include <sys/ioctl.h>
 
@@ -269,13 +270,12 @@ static int vfio_query_precopy_size(VFIOMigration *migration)
     return 0;
 }
 
-/* Returns the size of saved data on success and -errno on error */
-static ssize_t vfio_save_block(QEMUFile *f, VFIOMigration *migration)
+/* Returns the size of read data on success and -errno on error */
+static ssize_t vfio_read_block(VFIOMigration *migration, void *buf)
 {
     ssize_t data_size;
 
-    data_size = read(migration->data_fd, migration->data_buffer,
-                     migration->data_buffer_size);
+    data_size = read(migration->data_fd, buf, migration->data_buffer_size);
     if (data_size < 0) {
         /*
          * Pre-copy emptied all the device state for now. For more information,
@@ -287,20 +287,125 @@ static ssize_t vfio_save_block(QEMUFile *f, VFIOMigration *migration)
 
         return -errno;
     }
-    if (data_size == 0) {
-        return 0;
-    }
 
+    return data_size;
+}
+
+static void vfio_put_block(QEMUFile *f, VFIOMigration *migration,
+                           const void *buf, ssize_t data_size, bool async)
+{
     qemu_put_be64(f, VFIO_MIG_FLAG_DEV_DATA_STATE);
     qemu_put_be64(f, data_size);
-    qemu_put_buffer(f, migration->data_buffer, data_size);
+    if (async) {
+        qemu_put_buffer_async(f, buf, data_size, false);
+    } else {
+        qemu_put_buffer(f, buf, data_size);
+    }
     bytes_transferred += data_size;
 
     trace_vfio_save_block(migration->vbasedev->name, data_size);
+}
+
+/* Returns the size of saved data on success and -errno on error */
+static ssize_t vfio_save_block(QEMUFile *f, VFIOMigration *migration)
+{
+    ssize_t data_size;
+
+    data_size = vfio_read_block(migration, migration->data_buffer);
+    if (data_size <= 0) {
+        return data_size;
+    }
+
+    vfio_put_block(f, migration, migration->data_buffer, data_size, false);
 
     return qemu_file_get_error(f) ?: data_size;
 }
 
+/*
+ * In stop-copy, reading the device state from the data fd and writing it to
+ * the migration stream are both on the downtime path. A reader thread fills
+ * one buffer while the migration thread sends the other, so that the two
+ * overlap.
+ */
+typedef struct VFIOStopCopyReader {
+    VFIOMigration *migration;
+    QemuThread thread;
+    /* Posted when a buffer can be filled by the reader */
+    QemuSemaphore free_sem;
+    /* Posted when a buffer has been filled by the reader */
+    QemuSemaphore full_sem;
+    void *buf[2];
+    /* Read result for each buffer, 0 at the end and -errno on error */
+    ssize_t len[2];
+    bool stop;
+} VFIOStopCopyReader;
+
+static void *vfio_stop_copy_reader_thread(void *opaque)
+{
+    VFIOStopCopyReader *r = opaque;
+    unsigned int i = 0;
+    ssize_t len;
+
+    do {
+        qemu_sem_wait(&r->free_sem);
+        if (qatomic_read(&r->stop)) {
+            break;
+        }
+        len = vfio_read_block(r->migration, r->buf[i]);
+        r->len[i] = len;
+        qemu_sem_post(&r->full_sem);
+        i ^= 1;
+    } while (len > 0);
+
+    return NULL;
+}
+
+/* Returns 0 on success, -errno on error and 1 if the reader can't be used */
+static int vfio_save_stop_copy_threaded(QEMUFile *f, VFIOMigration *migration)
+{
+    VFIOStopCopyReader r = {
+        .migration = migration,
+        .buf = { migration->data_buffer },
+    };
+    unsigned int i = 0;
+    ssize_t len;
+    int ret;
+
+    r.buf[1] = g_try_malloc(migration->data_buffer_size);
+    if (!r.buf[1]) {
+        return 1;
+    }
+    qemu_sem_init(&r.free_sem, 2);
+    qemu_sem_init(&r.full_sem, 0);
+    qemu_thread_create(&r.thread, "vfio-stopcopy",
+                       vfio_stop_copy_reader_thread, &r, QEMU_THREAD_JOINABLE);
+
+    do {
+        qemu_sem_wait(&r.full_sem);
+        len = r.len[i];
+        if (len > 0) {
+            vfio_put_block(f, migration, r.buf[i], len, true);
+            /* The buffer is referenced by the QEMUFile until flushed */
+            ret = qemu_fflush(f);
+            if (ret) {
+                len = ret;
+            }
+        }
+        qemu_sem_post(&r.free_sem);
+        i ^= 1;
+    } while (len > 0);
+
+    qatomic_set(&r.stop, true);
+    qemu_sem_post(&r.free_sem);
+    qemu_thread_join(&r.thread);
+
+    qemu_sem_destroy(&r.full_sem);
+    qemu_sem_destroy(&r.free_sem);
+    g_free(r.buf[1]);
+
+    return len;
+}
+
 static void vfio_update_estimated_pending_data(VFIOMigration *migration,
                                                uint64_t data_size)
 {
@@ -541,12 +646,17 @@ static int vfio_save_complete_precopy(QEMUFile *f, void *opaque)
         return ret;
     }
 
-    do {
-        data_size = vfio_save_block(f, vbasedev->migration);
-        if (data_size < 0) {
-            return data_size;
-        }
-    } while (data_size);
+    ret = vfio_save_stop_copy_threaded(f, vbasedev->migration);
+    if (ret < 0) {
+        return ret;
+    } else if (ret > 0) {
+        do {
+            data_size = vfio_save_block(f, vbasedev->migration);
+            if (data_size < 0) {
+                return data_size;
+            }
+        } while (data_size);
+    }
 
     qemu_put_be64(f, VFIO_MIG_FLAG_END_OF_STATE);
     ret = qemu_file_get_error(f);
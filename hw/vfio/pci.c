@@ -468,6 +468,7 @@ static void vfio_add_kvm_msi_virq(VFIOPCIDevice *vdev, VFIOMSIVector *vector,
 
     vector->virq = kvm_irqchip_add_msi_route(&vfio_route_change,
                                              vector_n, &vdev->pdev);
+    vector->kvm_msg_valid = false;
 }
 
 static void vfio_connect_kvm_msi_virq(VFIOMSIVector *vector)
@@ -503,11 +504,24 @@ static void vfio_remove_kvm_msi_virq(VFIOMSIVector *vector)
     event_notifier_cleanup(&vector->kvm_interrupt);
 }
 
-static void vfio_update_kvm_msi_virq(VFIOMSIVector *vector, MSIMessage msg,
+/*
+ * Update the KVM route of @vector, returns true if it changed and the routes
+ * need to be committed. Guests that mask and unmask vectors around every
+ * interrupt write back the same message, so don't rebuild the KVM routing
+ * table for them.
+ */
+static bool vfio_update_kvm_msi_virq(VFIOMSIVector *vector, MSIMessage msg,
                                      PCIDevice *pdev)
 {
+    if (vector->kvm_msg_valid && vector->kvm_msg.address == msg.address &&
+        vector->kvm_msg.data == msg.data) {
+        return false;
+    }
+
     kvm_irqchip_update_msi_route(kvm_state, vector->virq, msg, pdev);
-    kvm_irqchip_commit_routes(kvm_state);
+    vector->kvm_msg = msg;
+    vector->kvm_msg_valid = true;
+    return true;
 }
 
 static int vfio_msix_vector_do_use(PCIDevice *pdev, unsigned int nr,
@@ -542,8 +556,8 @@ static int vfio_msix_vector_do_use(PCIDevice *pdev, unsigned int nr,
     if (vector->virq >= 0) {
         if (!msg) {
             vfio_remove_kvm_msi_virq(vector);
-        } else {
-            vfio_update_kvm_msi_virq(vector, *msg, pdev);
+        } else if (vfio_update_kvm_msi_virq(vector, *msg, pdev)) {
+            kvm_irqchip_commit_routes(kvm_state);
         }
     } else {
         if (msg) {
@@ -858,6 +872,7 @@ static void vfio_msi_disable(VFIOPCIDevice *vdev)
 
 static void vfio_update_msi(VFIOPCIDevice *vdev)
 {
+    bool commit = false;
     int i;
 
     for (i = 0; i < vdev->nr_vectors; i++) {
@@ -869,7 +884,12 @@ static void vfio_update_msi(VFIOPCIDevice *vdev)
         }
 
         msg = msi_get_message(&vdev->pdev, i);
-        vfio_update_kvm_msi_virq(vector, msg, &vdev->pdev);
+        commit |= vfio_update_kvm_msi_virq(vector, msg, &vdev->pdev);
+    }
+
+    /* Rebuild the KVM routing table once for all vectors */
+    if (commit) {
+        kvm_irqchip_commit_routes(kvm_state);
     }
 }
 
@@ -96,6 +96,9 @@ typedef struct VFIOMSIVector {
     struct VFIOPCIDevice *vdev; /* back pointer to device */
     int virq;
     bool use;
+    /* Last message written to the KVM route, if kvm_msg_valid */
+    MSIMessage kvm_msg;
+    bool kvm_msg_valid;
 } VFIOMSIVector;
 
 enum {
@@ -241,14 +241,14 @@ static void vhost_svq_kick(VhostShadowVirtqueue *svq)
     event_notifier_set(&svq->hdev_kick);
 }
 
-/**
- * Add an element to a SVQ.
- *
- * Return -EINVAL if element is invalid, -ENOSPC if dev queue is full
+/*
+ * Make an element available to the device without notifying it, so that a
+ * batch of them costs a single kick.
  */
-int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
-                  size_t out_num, const struct iovec *in_sg, size_t in_num,
-                  VirtQueueElement *elem)
+static int vhost_svq_add_nokick(VhostShadowVirtqueue *svq,
+                                const struct iovec *out_sg, size_t out_num,
+                                const struct iovec *in_sg, size_t in_num,
+                                VirtQueueElement *elem)
 {
     unsigned qemu_head;
     unsigned ndescs = in_num + out_num;
@@ -266,16 +266,32 @@ int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
     svq->num_free -= ndescs;
     svq->desc_state[qemu_head].elem = elem;
     svq->desc_state[qemu_head].ndescs = ndescs;
-    vhost_svq_kick(svq);
     return 0;
 }
 
-/* Convenience wrapper to add a guest's element to SVQ */
+/**
+ * Add an element to a SVQ.
+ *
+ * Return -EINVAL if element is invalid, -ENOSPC if dev queue is full
+ */
+int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
+                  size_t out_num, const struct iovec *in_sg, size_t in_num,
+                  VirtQueueElement *elem)
+{
+    int r = vhost_svq_add_nokick(svq, out_sg, out_num, in_sg, in_num, elem);
+
+    if (r == 0) {
+        vhost_svq_kick(svq);
+    }
+    return r;
+}
+
+/* Convenience wrapper to add a guest's element to SVQ, kicked by caller */
 static int vhost_svq_add_element(VhostShadowVirtqueue *svq,
                                  VirtQueueElement *elem)
 {
-    return vhost_svq_add(svq, elem->out_sg, elem->out_num, elem->in_sg,
-                         elem->in_num, elem);
+    return vhost_svq_add_nokick(svq, elem->out_sg, elem->out_num,
+                                elem->in_sg, elem->in_num, elem);
 }
 
 /**
@@ -293,6 +309,10 @@ static int vhost_svq_add_element(VhostShadowVirtqueue *svq,
  */
 static void vhost_handle_guest_kick(VhostShadowVirtqueue *svq)
 {
+    VirtQueueElement *elems[VIRTQUEUE_POP_BATCH];
+    unsigned int i = 0, num = 0;
+    bool added = false;
+
     /* Clear event notifier */
     event_notifier_test_and_clear(&svq->svq_kick);
 
@@ -307,7 +327,13 @@ static void vhost_handle_guest_kick(VhostShadowVirtqueue *svq)
             if (svq->next_guest_avail_elem) {
                 elem = g_steal_pointer(&svq->next_guest_avail_elem);
             } else {
-                elem = virtqueue_pop(svq->vq, sizeof(*elem));
+                if (i == num) {
+                    num = virtqueue_pop_batch(svq->vq, sizeof(*elem),
+                                              (void **)elems,
+                                              ARRAY_SIZE(elems));
+                    i = 0;
+                }
+                elem = i < num ? elems[i++] : NULL;
             }
 
             if (!elem) {
@@ -318,6 +344,7 @@ static void vhost_handle_guest_kick(VhostShadowVirtqueue *svq)
                 r = svq->ops->avail_handler(svq, elem, svq->ops_opaque);
             } else {
                 r = vhost_svq_add_element(svq, elem);
+                added |= r == 0;
             }
             if (unlikely(r != 0)) {
                 if (r == -ENOSPC) {
@@ -335,8 +362,15 @@ static void vhost_handle_guest_kick(VhostShadowVirtqueue *svq)
                     svq->next_guest_avail_elem = g_steal_pointer(&elem);
                 }
 
+                /* Give back the rest of the batch, newest first */
+                while (num > i) {
+                    num--;
+                    virtqueue_unpop(svq->vq, elems[num], 0);
+                    g_free(elems[num]);
+                }
+
                 /* VQ is full or broken, just return and ignore kicks */
-                return;
+                goto out;
             }
             /* elem belongs to SVQ or external caller now */
             elem = NULL;
@@ -344,6 +378,11 @@ static void vhost_handle_guest_kick(VhostShadowVirtqueue *svq)
 
         virtio_queue_set_notification(svq->vq, true);
     } while (!virtio_queue_empty(svq->vq));
+
+out:
+    if (added) {
+        vhost_svq_kick(svq);
+    }
 }
 
 /**
@@ -501,7 +540,10 @@ static void vhost_svq_flush(VhostShadowVirtqueue *svq,
         }
 
         virtqueue_flush(vq, i);
-        event_notifier_set(&svq->svq_call);
+        /* Honour the guest's interrupt suppression */
+        if (virtio_queue_should_notify(svq->vdev, vq)) {
+            event_notifier_set(&svq->svq_call);
+        }
 
         if (check_for_avail_queue && svq->next_guest_avail_elem) {
             /*
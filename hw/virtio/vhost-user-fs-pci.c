@@ -15,7 +15,9 @@
 #include "hw/qdev-properties.h"
 #include "hw/virtio/vhost-user-fs.h"
 #include "hw/virtio/virtio-pci.h"
+#include "qapi/error.h"
 #include "qom/object.h"
+#include "standard-headers/linux/virtio_fs.h"
 
 struct VHostUserFSPCI {
     VirtIOPCIProxy parent_obj;
@@ -26,6 +28,9 @@ typedef struct VHostUserFSPCI VHostUserFSPCI;
 
 #define TYPE_VHOST_USER_FS_PCI "vhost-user-fs-pci-base"
 
+/* BAR holding the DAX window */
+#define VIRTIO_FS_PCI_CACHE_BAR 2
+
 DECLARE_INSTANCE_CHECKER(VHostUserFSPCI, VHOST_USER_FS_PCI,
                          TYPE_VHOST_USER_FS_PCI)
 
@@ -45,7 +50,26 @@ static void vhost_user_fs_pci_realize(VirtIOPCIProxy *vpci_dev, Error **errp)
         vpci_dev->nvectors = dev->vdev.conf.num_request_queues + 2;
     }
 
-    qdev_realize(vdev, BUS(&vpci_dev->bus), errp);
+    if (dev->vdev.conf.cache_size &&
+        (vpci_dev->flags & VIRTIO_PCI_FLAG_MODERN_PIO_NOTIFY)) {
+        error_setg(errp, "cache-size cannot be used with modern-pio-notify");
+        return;
+    }
+
+    if (!qdev_realize(vdev, BUS(&vpci_dev->bus), errp)) {
+        return;
+    }
+
+    if (dev->vdev.conf.cache_size) {
+        pci_register_bar(&vpci_dev->pci_dev, VIRTIO_FS_PCI_CACHE_BAR,
+                         PCI_BASE_ADDRESS_SPACE_MEMORY |
+                         PCI_BASE_ADDRESS_MEM_PREFETCH |
+                         PCI_BASE_ADDRESS_MEM_TYPE_64,
+                         &dev->vdev.cache);
+        virtio_pci_add_shm_cap(vpci_dev, VIRTIO_FS_PCI_CACHE_BAR, 0,
+                               dev->vdev.conf.cache_size,
+                               VIRTIO_FS_SHMCAP_ID_CACHE);
+    }
 }
 
 static void vhost_user_fs_pci_class_init(ObjectClass *klass, void *data)
@@ -13,6 +13,7 @@
 
 #include "qemu/osdep.h"
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include "standard-headers/linux/virtio_fs.h"
 #include "qapi/error.h"
 #include "hw/qdev-properties.h"
@@ -37,6 +38,125 @@ static const int user_feature_bits[] = {
     VHOST_INVALID_FEATURE_BIT
 };
 
+static VHostUserFS *vuf_from_vhost_dev(struct vhost_dev *dev)
+{
+    if (!dev->vdev) {
+        return NULL;
+    }
+    return (VHostUserFS *)object_dynamic_cast(OBJECT(dev->vdev),
+                                              TYPE_VHOST_USER_FS);
+}
+
+/*
+ * Check that [@offset, @offset + @len) is a page aligned range inside the
+ * DAX window of @fs.
+ */
+static bool vuf_cache_range_valid(VHostUserFS *fs, uint64_t offset,
+                                  uint64_t len)
+{
+    uint64_t size = fs->conf.cache_size;
+    uint64_t page_size = qemu_real_host_page_size();
+
+    return len && len <= size && offset <= size - len &&
+           QEMU_IS_ALIGNED(offset | len, page_size);
+}
+
+/* Replace [@offset, @offset + @len) of the DAX window with a hole */
+static int vuf_cache_unmap(VHostUserFS *fs, uint64_t offset, uint64_t len)
+{
+    void *ptr;
+
+    ptr = mmap(fs->cache_ptr + offset, len, PROT_NONE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return -errno;
+    }
+    return 0;
+}
+
+/*
+ * Handle VHOST_USER_BACKEND_FS_MAP: map @msg->len bytes of @fd starting at
+ * @msg->fd_offset at @msg->c_offset in the DAX window.  Guest accesses to
+ * that part of the window then hit the page cache of the host file
+ * directly, without going through the virtqueues.
+ */
+int vhost_user_fs_backend_map(struct vhost_dev *dev,
+                              VhostUserFSBackendMsg *msg, int fd)
+{
+    VHostUserFS *fs = vuf_from_vhost_dev(dev);
+    int prot = 0;
+    void *ptr;
+
+    if (!fs || !fs->cache_ptr) {
+        error_report("vhost-user-fs: map request without a DAX window");
+        return -EINVAL;
+    }
+    if (fd < 0) {
+        error_report("vhost-user-fs: map request without a file descriptor");
+        return -EINVAL;
+    }
+    if (!vuf_cache_range_valid(fs, msg->c_offset, msg->len)) {
+        error_report("vhost-user-fs: invalid map request range "
+                     "0x%" PRIx64 "+0x%" PRIx64, msg->c_offset, msg->len);
+        return -EINVAL;
+    }
+
+    if (msg->flags & VHOST_USER_FS_FLAG_MAP_R) {
+        prot |= PROT_READ;
+    }
+    if (msg->flags & VHOST_USER_FS_FLAG_MAP_W) {
+        prot |= PROT_WRITE;
+    }
+
+    ptr = mmap(fs->cache_ptr + msg->c_offset, msg->len, prot,
+               MAP_SHARED | MAP_FIXED, fd, msg->fd_offset);
+    if (ptr == MAP_FAILED) {
+        error_report("vhost-user-fs: failed to map file range "
+                     "0x%" PRIx64 "+0x%" PRIx64 ": %s", msg->fd_offset,
+                     msg->len, strerror(errno));
+        return -errno;
+    }
+
+    return 0;
+}
+
+/*
+ * Handle VHOST_USER_BACKEND_FS_UNMAP: drop the mapping of @msg->len bytes
+ * at @msg->c_offset in the DAX window, or of the whole window if
+ * @msg->len is ~0.
+ */
+int vhost_user_fs_backend_unmap(struct vhost_dev *dev,
+                                VhostUserFSBackendMsg *msg)
+{
+    VHostUserFS *fs = vuf_from_vhost_dev(dev);
+    uint64_t offset = msg->c_offset;
+    uint64_t len = msg->len;
+    int ret;
+
+    if (!fs || !fs->cache_ptr) {
+        error_report("vhost-user-fs: unmap request without a DAX window");
+        return -EINVAL;
+    }
+
+    if (len == ~0ull) {
+        offset = 0;
+        len = fs->conf.cache_size;
+    }
+    if (!vuf_cache_range_valid(fs, offset, len)) {
+        error_report("vhost-user-fs: invalid unmap request range "
+                     "0x%" PRIx64 "+0x%" PRIx64, offset, len);
+        return -EINVAL;
+    }
+
+    ret = vuf_cache_unmap(fs, offset, len);
+    if (ret < 0) {
+        error_report("vhost-user-fs: failed to unmap DAX window range "
+                     "0x%" PRIx64 "+0x%" PRIx64 ": %s", offset, len,
+                     strerror(-ret));
+    }
+    return ret;
+}
+
 static void vuf_get_config(VirtIODevice *vdev, uint8_t *config)
 {
     VHostUserFS *fs = VHOST_USER_FS(vdev);
@@ -119,6 +239,14 @@ static void vuf_stop(VirtIODevice *vdev)
     }
 
     vhost_dev_disable_notifiers(&fs->vhost_dev, vdev);
+
+    /*
+     * The mappings belong to the session of the driver that set them up;
+     * do not leave them around for the next one.
+     */
+    if (fs->cache_ptr) {
+        vuf_cache_unmap(fs, 0, fs->conf.cache_size);
+    }
 }
 
 static void vuf_set_status(VirtIODevice *vdev, uint8_t status)
@@ -231,8 +359,30 @@ static void vuf_device_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    if (fs->conf.cache_size) {
+        if (!is_power_of_2(fs->conf.cache_size) ||
+            fs->conf.cache_size < qemu_real_host_page_size()) {
+            error_setg(errp, "cache-size property must be a power of 2 "
+                       "no smaller than the page size");
+            return;
+        }
+
+        /* Nothing is mapped yet, guest accesses to the window fault */
+        fs->cache_ptr = mmap(NULL, fs->conf.cache_size, PROT_NONE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (fs->cache_ptr == MAP_FAILED) {
+            error_setg_errno(errp, errno, "failed to reserve DAX window");
+            fs->cache_ptr = NULL;
+            return;
+        }
+        memory_region_init_ram_device_ptr(&fs->cache, OBJECT(vdev),
+                                          "virtio-fs-cache",
+                                          fs->conf.cache_size,
+                                          fs->cache_ptr);
+    }
+
     if (!vhost_user_init(&fs->vhost_user, &fs->conf.chardev, errp)) {
-        return;
+        goto err_cache;
     }
 
     virtio_init(vdev, VIRTIO_ID_FS, sizeof(struct virtio_fs_config));
@@ -266,7 +416,12 @@ err_virtio:
     g_free(fs->req_vqs);
     virtio_cleanup(vdev);
     g_free(fs->vhost_dev.vqs);
-    return;
+err_cache:
+    if (fs->cache_ptr) {
+        object_unparent(OBJECT(&fs->cache));
+        munmap(fs->cache_ptr, fs->conf.cache_size);
+        fs->cache_ptr = NULL;
+    }
 }
 
 static void vuf_device_unrealize(DeviceState *dev)
@@ -290,6 +445,11 @@ static void vuf_device_unrealize(DeviceState *dev)
     g_free(fs->req_vqs);
     virtio_cleanup(vdev);
     g_free(vhost_vqs);
+
+    if (fs->cache_ptr) {
+        munmap(fs->cache_ptr, fs->conf.cache_size);
+        fs->cache_ptr = NULL;
+    }
 }
 
 static struct vhost_dev *vuf_get_vhost(VirtIODevice *vdev)
@@ -408,6 +568,7 @@ static Property vuf_properties[] = {
     DEFINE_PROP_UINT16("num-request-queues", VHostUserFS,
                        conf.num_request_queues, 1),
     DEFINE_PROP_UINT16("queue-size", VHostUserFS, conf.queue_size, 128),
+    DEFINE_PROP_SIZE("cache-size", VHostUserFS, conf.cache_size, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -17,6 +17,7 @@
 #include "hw/virtio/vhost-backend.h"
 #include "hw/virtio/virtio.h"
 #include "hw/virtio/virtio-net.h"
+#include "hw/virtio/vhost-user-fs.h"
 #include "chardev/char-fe.h"
 #include "io/channel-socket.h"
 #include "sysemu/kvm.h"
@@ -116,6 +117,8 @@ typedef enum VhostUserBackendRequest {
     VHOST_USER_BACKEND_SHARED_OBJECT_ADD = 6,
     VHOST_USER_BACKEND_SHARED_OBJECT_REMOVE = 7,
     VHOST_USER_BACKEND_SHARED_OBJECT_LOOKUP = 8,
+    VHOST_USER_BACKEND_FS_MAP = 9,
+    VHOST_USER_BACKEND_FS_UNMAP = 10,
     VHOST_USER_BACKEND_MAX
 }  VhostUserBackendRequest;
 
@@ -225,6 +228,7 @@ typedef union {
         VhostUserInflight inflight;
         VhostUserShared object;
         VhostUserTransferDeviceState transfer_state;
+        VhostUserFSBackendMsg fs;
 } VhostUserPayload;
 
 typedef struct VhostUserMsg {
@@ -658,6 +662,57 @@ static void scrub_shadow_regions(struct vhost_dev *dev,
     return;
 }
 
+static void vhost_user_shadow_remove(struct vhost_user *u, int shadow_reg_idx)
+{
+    memmove(&u->shadow_regions[shadow_reg_idx],
+            &u->shadow_regions[shadow_reg_idx + 1],
+            sizeof(struct vhost_memory_region) *
+            (u->num_shadow_regions - shadow_reg_idx - 1));
+    u->num_shadow_regions--;
+}
+
+static void vhost_user_shadow_add(struct vhost_user *u,
+                                  struct vhost_memory_region *reg)
+{
+    u->shadow_regions[u->num_shadow_regions].guest_phys_addr =
+        reg->guest_phys_addr;
+    u->shadow_regions[u->num_shadow_regions].userspace_addr =
+        reg->userspace_addr;
+    u->shadow_regions[u->num_shadow_regions].memory_size =
+        reg->memory_size;
+    u->num_shadow_regions++;
+}
+
+/*
+ * Collect the replies to @nr_sent messages of type @msg that have been sent
+ * without waiting for each reply. All replies are read, even after a
+ * failure, to keep the channel in sync. @acked[i] tells whether the i-th
+ * message was acknowledged.
+ */
+static int vhost_user_collect_replies(struct vhost_dev *dev,
+                                      const VhostUserMsg *msg, int nr_sent,
+                                      bool *acked)
+{
+    int i, ret, err = 0;
+
+    for (i = 0; i < nr_sent; i++) {
+        ret = process_message_reply(dev, msg);
+        acked[i] = !ret;
+        if (ret && !err) {
+            err = ret;
+        }
+        if (ret && ret != -EIO) {
+            /* The channel is broken, there is no point in reading more */
+            for (i++; i < nr_sent; i++) {
+                acked[i] = false;
+            }
+            break;
+        }
+    }
+
+    return err;
+}
+
 static int send_remove_regions(struct vhost_dev *dev,
                                struct scrub_regions *remove_reg,
                                int nr_rem_reg, VhostUserMsg *msg,
@@ -665,18 +720,18 @@ static int send_remove_regions(struct vhost_dev *dev,
 {
     struct vhost_user *u = dev->opaque;
     struct vhost_memory_region *shadow_reg;
-    int i, fd, shadow_reg_idx, ret;
+    int i, fd, last, ret = 0, nr_sent = 0;
     ram_addr_t offset;
     VhostUserMemoryRegion region_buffer;
+    bool sent[VHOST_USER_MAX_RAM_SLOTS] = {};
+    bool acked[VHOST_USER_MAX_RAM_SLOTS];
 
     /*
-     * The regions in remove_reg appear in the same order they do in the
-     * shadow table. Therefore we can minimize memory copies by iterating
-     * through remove_reg backwards.
+     * Send all the requests before waiting for the replies, so that
+     * removing many regions costs a single round trip to the backend.
      */
     for (i = nr_rem_reg - 1; i >= 0; i--) {
         shadow_reg = remove_reg[i].region;
-        shadow_reg_idx = remove_reg[i].reg_idx;
 
         vhost_user_get_mr_data(shadow_reg->userspace_addr, &offset, &fd);
 
@@ -687,29 +742,36 @@ static int send_remove_regions(struct vhost_dev *dev,
 
             ret = vhost_user_write(dev, msg, NULL, 0);
             if (ret < 0) {
-                return ret;
-            }
-
-            if (reply_supported) {
-                ret = process_message_reply(dev, msg);
-                if (ret) {
-                    return ret;
-                }
+                break;
             }
+            sent[i] = true;
+            nr_sent++;
         }
+    }
+    /* Regions up to the one that could not be sent stay mapped */
+    last = i;
 
-        /*
-         * At this point we know the backend has unmapped the region. It is now
-         * safe to remove it from the shadow table.
-         */
-        memmove(&u->shadow_regions[shadow_reg_idx],
-                &u->shadow_regions[shadow_reg_idx + 1],
-                sizeof(struct vhost_memory_region) *
-                (u->num_shadow_regions - shadow_reg_idx - 1));
-        u->num_shadow_regions--;
+    if (reply_supported) {
+        msg->hdr.request = VHOST_USER_REM_MEM_REG;
+        ret = vhost_user_collect_replies(dev, msg, nr_sent, acked) ?: ret;
     }
 
-    return 0;
+    /*
+     * The regions in remove_reg appear in the same order they do in the
+     * shadow table. Therefore we can minimize memory copies by iterating
+     * through remove_reg backwards. Once a removal is acknowledged, the
+     * backend has unmapped the region and it can be dropped from the shadow
+     * table.
+     */
+    nr_sent = 0;
+    for (i = nr_rem_reg - 1; i > last; i--) {
+        if (sent[i] && reply_supported && !acked[nr_sent++]) {
+            continue;
+        }
+        vhost_user_shadow_remove(u, remove_reg[i].reg_idx);
+    }
+
+    return ret < 0 ? ret : 0;
 }
 
 static int send_add_regions(struct vhost_dev *dev,
@@ -812,18 +874,65 @@ static int send_add_regions(struct vhost_dev *dev,
          *
          * The region should now be added to the shadow table.
          */
-        u->shadow_regions[u->num_shadow_regions].guest_phys_addr =
-            reg->guest_phys_addr;
-        u->shadow_regions[u->num_shadow_regions].userspace_addr =
-            reg->userspace_addr;
-        u->shadow_regions[u->num_shadow_regions].memory_size =
-            reg->memory_size;
-        u->num_shadow_regions++;
+        vhost_user_shadow_add(u, reg);
     }
 
     return 0;
 }
 
+/*
+ * Like send_add_regions() without postcopy, but send all the requests
+ * before waiting for the replies. After a backend restart all regions are
+ * added again, and this makes it cost a single round trip instead of one
+ * per region.
+ */
+static int send_add_regions_pipelined(struct vhost_dev *dev,
+                                      struct scrub_regions *add_reg,
+                                      int nr_add_reg, VhostUserMsg *msg)
+{
+    struct vhost_user *u = dev->opaque;
+    int i, fd, ret = 0, nr_sent = 0;
+    struct vhost_memory_region *reg;
+    ram_addr_t offset;
+    VhostUserMemoryRegion region_buffer;
+    bool sent[VHOST_USER_MAX_RAM_SLOTS] = {};
+    bool acked[VHOST_USER_MAX_RAM_SLOTS];
+
+    for (i = 0; i < nr_add_reg; i++) {
+        reg = add_reg[i].region;
+
+        vhost_user_get_mr_data(reg->userspace_addr, &offset, &fd);
+
+        if (fd > 0) {
+            msg->hdr.request = VHOST_USER_ADD_MEM_REG;
+            vhost_user_fill_msg_region(&region_buffer, reg, offset);
+            msg->payload.mem_reg.region = region_buffer;
+
+            ret = vhost_user_write(dev, msg, &fd, 1);
+            if (ret < 0) {
+                break;
+            }
+            sent[i] = true;
+            nr_sent++;
+        }
+    }
+    nr_add_reg = i;
+
+    msg->hdr.request = VHOST_USER_ADD_MEM_REG;
+    ret = vhost_user_collect_replies(dev, msg, nr_sent, acked) ?: ret;
+
+    /* Only record the regions the backend has mapped in the shadow table */
+    nr_sent = 0;
+    for (i = 0; i < nr_add_reg; i++) {
+        if (sent[i] && !acked[nr_sent++]) {
+            continue;
+        }
+        vhost_user_shadow_add(u, add_reg[i].region);
+    }
+
+    return ret < 0 ? ret : 0;
+}
+
 static int vhost_user_add_remove_regions(struct vhost_dev *dev,
                                          VhostUserMsg *msg,
                                          bool reply_supported,
@@ -850,7 +959,12 @@ static int vhost_user_add_remove_regions(struct vhost_dev *dev,
         }
     }
 
-    if (nr_add_reg) {
+    if (nr_add_reg && reply_supported && !track_ramblocks) {
+        ret = send_add_regions_pipelined(dev, add_reg, nr_add_reg, msg);
+        if (ret < 0) {
+            goto err;
+        }
+    } else if (nr_add_reg) {
         ret = send_add_regions(dev, add_reg, nr_add_reg, msg, shadow_pcb,
                                reply_supported, track_ramblocks);
         if (ret < 0) {
@@ -1800,6 +1914,14 @@ static gboolean backend_read(QIOChannel *ioc, GIOCondition condition,
         ret = vhost_user_backend_handle_shared_object_lookup(dev->opaque, ioc,
                                                              &hdr, &payload);
         break;
+#ifdef CONFIG_VHOST_USER_FS
+    case VHOST_USER_BACKEND_FS_MAP:
+        ret = vhost_user_fs_backend_map(dev, &payload.fs, fd ? fd[0] : -1);
+        break;
+    case VHOST_USER_BACKEND_FS_UNMAP:
+        ret = vhost_user_fs_backend_unmap(dev, &payload.fs);
+        break;
+#endif
     default:
         error_report("Received unexpected msg type: %d.", hdr.request);
         ret = -EINVAL;
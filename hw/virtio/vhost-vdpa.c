@@ -832,7 +832,8 @@ static int vhost_vdpa_set_backend_cap(struct vhost_dev *dev)
     uint64_t f = 0x1ULL << VHOST_BACKEND_F_IOTLB_MSG_V2 |
         0x1ULL << VHOST_BACKEND_F_IOTLB_BATCH |
         0x1ULL << VHOST_BACKEND_F_IOTLB_ASID |
-        0x1ULL << VHOST_BACKEND_F_SUSPEND;
+        0x1ULL << VHOST_BACKEND_F_SUSPEND |
+        0x1ULL << VHOST_BACKEND_F_IOTLB_PERSIST;
     int r;
 
     if (vhost_vdpa_call(dev, VHOST_GET_BACKEND_FEATURES, &features)) {
@@ -1291,6 +1292,23 @@ static void vhost_vdpa_suspend(struct vhost_dev *dev)
     vhost_vdpa_reset_device(dev);
 }
 
+/*
+ * Map the guest memory for the device.  Mappings kept from a previous run
+ * of the device are reused if they are still valid, which saves pinning
+ * and mapping all of guest memory again.
+ */
+static void vhost_vdpa_listener_register(struct vhost_vdpa *v,
+                                         AddressSpace *as)
+{
+    if (v->listener.address_space) {
+        if (v->listener.address_space == as && !v->shadow_data) {
+            return;
+        }
+        memory_listener_unregister(&v->listener);
+    }
+    memory_listener_register(&v->listener, as);
+}
+
 static int vhost_vdpa_dev_start(struct vhost_dev *dev, bool started)
 {
     struct vhost_vdpa *v = dev->opaque;
@@ -1319,7 +1337,7 @@ static int vhost_vdpa_dev_start(struct vhost_dev *dev, bool started)
                          "IOMMU and try again");
             return -1;
         }
-        memory_listener_register(&v->listener, dev->vdev->dma_as);
+        vhost_vdpa_listener_register(v, dev->vdev->dma_as);
 
         return vhost_vdpa_add_status(dev, VIRTIO_CONFIG_S_DRIVER_OK);
     }
@@ -1338,7 +1356,15 @@ static void vhost_vdpa_reset_status(struct vhost_dev *dev)
     vhost_vdpa_reset_device(dev);
     vhost_vdpa_add_status(dev, VIRTIO_CONFIG_S_ACKNOWLEDGE |
                                VIRTIO_CONFIG_S_DRIVER);
-    memory_listener_unregister(&v->listener);
+
+    /*
+     * Without IOTLB_PERSIST the reset dropped the mappings.  Shadow data
+     * mappings are built from the IOVA tree of this run and go too.
+     */
+    if (!(dev->backend_cap & BIT_ULL(VHOST_BACKEND_F_IOTLB_PERSIST)) ||
+        v->shadow_data) {
+        memory_listener_unregister(&v->listener);
+    }
 }
 
 static int vhost_vdpa_set_log_base(struct vhost_dev *dev, uint64_t base,
@@ -1132,10 +1132,57 @@ static int vhost_memory_region_lookup(struct vhost_dev *hdev,
     return -EFAULT;
 }
 
+/*
+ * Number of IOMMU pages that an IOTLB miss maps at once if they translate
+ * to contiguous guest memory, so that a DMA buffer spanning several pages
+ * costs a single update.
+ */
+#define VHOST_IOTLB_PREFETCH_PAGES 16
+
+/*
+ * Called within rcu_read_lock().  Extend the @len bytes at @iova, which
+ * the IOMMU translated to @iotlb, by as much of the following guest
+ * memory as translates contiguously with the same permissions, without
+ * exceeding @max_len.  Returns the new length.
+ */
+static uint64_t vhost_iotlb_prefetch(struct vhost_dev *dev, uint64_t iova,
+                                     const IOMMUTLBEntry *iotlb, uint64_t len,
+                                     uint64_t max_len, int write)
+{
+    IOMMUTLBEntry next;
+    MemoryRegion *mr;
+    hwaddr xlat, plen = max_len;
+    int i;
+
+    /*
+     * Translations are clamped to the IOMMU page, so a longer one means
+     * that the IOMMU passes this range through untranslated (e.g. in
+     * passthrough mode): map all of it.
+     */
+    mr = address_space_translate(dev->vdev->dma_as, iova, &xlat, &plen,
+                                 write, MEMTXATTRS_UNSPECIFIED);
+    if (memory_region_is_ram(mr) && plen > len) {
+        return MIN(plen, max_len);
+    }
+
+    for (i = 1; i < VHOST_IOTLB_PREFETCH_PAGES && len < max_len; i++) {
+        next = address_space_get_iotlb_entry(dev->vdev->dma_as, iova + len,
+                                             write, MEMTXATTRS_UNSPECIFIED);
+        if (!next.target_as || next.perm != iotlb->perm ||
+            next.iova != iova + len ||
+            next.translated_addr != iotlb->translated_addr + len) {
+            break;
+        }
+        len = MIN(len + next.addr_mask + 1, max_len);
+    }
+
+    return len;
+}
+
 int vhost_device_iotlb_miss(struct vhost_dev *dev, uint64_t iova, int write)
 {
     IOMMUTLBEntry iotlb;
-    uint64_t uaddr, len;
+    uint64_t uaddr, len, max_len;
     int ret = -EFAULT;
 
     RCU_READ_LOCK_GUARD();
@@ -1155,8 +1202,10 @@ int vhost_device_iotlb_miss(struct vhost_dev *dev, uint64_t iova, int write)
             goto out;
         }
 
+        max_len = len;
         len = MIN(iotlb.addr_mask + 1, len);
         iova = iova & ~iotlb.addr_mask;
+        len = vhost_iotlb_prefetch(dev, iova, &iotlb, len, max_len, write);
 
         ret = vhost_backend_update_device_iotlb(dev, iova, uaddr,
                                                 len, iotlb.perm);
@@ -17,6 +17,7 @@
 #include "qemu/iov.h"
 #include "qemu/module.h"
 #include "qemu/timer.h"
+#include "qemu/lockable.h"
 #include "qemu/madvise.h"
 #include "hw/virtio/virtio.h"
 #include "hw/mem/pc-dimm.h"
@@ -325,14 +326,60 @@ static void balloon_stats_set_poll_interval(Object *obj, Visitor *v,
     balloon_stats_change_timer(s, 0);
 }
 
-static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
+typedef struct BalloonReportRange {
+    RAMBlock *rb;
+    ram_addr_t offset;
+    size_t size;
+} BalloonReportRange;
+
+static gint balloon_report_range_cmp(gconstpointer a, gconstpointer b)
 {
-    VirtIOBalloon *dev = VIRTIO_BALLOON(vdev);
-    VirtQueueElement *elem;
+    const BalloonReportRange *ra = a, *rb = b;
 
-    while ((elem = virtqueue_pop(vq, sizeof(VirtQueueElement)))) {
-        unsigned int i;
+    if (ra->rb != rb->rb) {
+        return (uintptr_t)ra->rb < (uintptr_t)rb->rb ? -1 : 1;
+    }
+    return ra->offset < rb->offset ? -1 : ra->offset > rb->offset;
+}
 
+/*
+ * Discard the reported ranges, merging the ones that are adjacent in the
+ * same RAMBlock so that each contiguous run costs a single madvise or
+ * fallocate.
+ */
+static void virtio_balloon_discard_ranges(GArray *ranges)
+{
+    BalloonReportRange *cur = NULL, *r;
+    guint i;
+
+    g_array_sort(ranges, balloon_report_range_cmp);
+    for (i = 0; i < ranges->len; i++) {
+        r = &g_array_index(ranges, BalloonReportRange, i);
+        if (cur && cur->rb == r->rb && cur->offset + cur->size >= r->offset) {
+            cur->size = MAX(cur->size, r->offset + r->size - cur->offset);
+            continue;
+        }
+        if (cur) {
+            ram_block_discard_range(cur->rb, cur->offset, cur->size);
+        }
+        cur = r;
+    }
+    if (cur) {
+        ram_block_discard_range(cur->rb, cur->offset, cur->size);
+    }
+}
+
+static void virtio_balloon_process_reports(VirtIOBalloon *dev)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(dev);
+    VirtQueue *vq = dev->reporting_vq;
+    VirtQueueElement *elems[VIRTQUEUE_POP_BATCH];
+    g_autoptr(GArray) ranges = g_array_new(false, false,
+                                           sizeof(BalloonReportRange));
+    unsigned int num, i, j;
+
+    while ((num = virtqueue_pop_batch(vq, sizeof(VirtQueueElement),
+                                      (void **)elems, ARRAY_SIZE(elems)))) {
         /*
          * When we discard the page it has the effect of removing the page
          * from the hypervisor itself and causing it to be zeroed when it
@@ -341,49 +388,90 @@ static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
          * expecting it to retain a non-zero value.
          */
         if (virtio_balloon_inhibited() || dev->poison_val) {
-            goto skip_element;
+            goto skip_elements;
         }
 
-        for (i = 0; i < elem->in_num; i++) {
-            void *addr = elem->in_sg[i].iov_base;
-            size_t size = elem->in_sg[i].iov_len;
-            ram_addr_t ram_offset;
-            RAMBlock *rb;
-
-            /*
-             * There is no need to check the memory section to see if
-             * it is ram/readonly/romd like there is for handle_output
-             * below. If the region is not meant to be written to then
-             * address_space_map will have allocated a bounce buffer
-             * and it will be freed in address_space_unmap and trigger
-             * and unassigned_mem_write before failing to copy over the
-             * buffer. If more than one bad descriptor is provided it
-             * will return NULL after the first bounce buffer and fail
-             * to map any resources.
-             */
-            rb = qemu_ram_block_from_host(addr, false, &ram_offset);
-            if (!rb) {
-                trace_virtio_balloon_bad_addr(elem->in_addr[i]);
-                continue;
+        WITH_RCU_READ_LOCK_GUARD() {
+            for (i = 0; i < num; i++) {
+                for (j = 0; j < elems[i]->in_num; j++) {
+                    void *addr = elems[i]->in_sg[j].iov_base;
+                    size_t size = elems[i]->in_sg[j].iov_len;
+                    BalloonReportRange range;
+
+                    /*
+                     * There is no need to check the memory section to see if
+                     * it is ram/readonly/romd like there is for handle_output
+                     * below. If the region is not meant to be written to then
+                     * address_space_map will have allocated a bounce buffer
+                     * and it will be freed in address_space_unmap and trigger
+                     * and unassigned_mem_write before failing to copy over the
+                     * buffer. If more than one bad descriptor is provided it
+                     * will return NULL after the first bounce buffer and fail
+                     * to map any resources.
+                     */
+                    range.rb = qemu_ram_block_from_host(addr, false,
+                                                        &range.offset);
+                    if (!range.rb) {
+                        trace_virtio_balloon_bad_addr(elems[i]->in_addr[j]);
+                        continue;
+                    }
+
+                    /*
+                     * For now we will simply ignore unaligned memory regions,
+                     * or regions that overrun the end of the RAMBlock.
+                     */
+                    if (!QEMU_IS_ALIGNED(range.offset | size,
+                                         qemu_ram_pagesize(range.rb)) ||
+                        (range.offset + size) >
+                        qemu_ram_get_used_length(range.rb)) {
+                        continue;
+                    }
+
+                    range.size = size;
+                    g_array_append_val(ranges, range);
+                }
             }
+        }
 
-            /*
-             * For now we will simply ignore unaligned memory regions, or
-             * regions that overrun the end of the RAMBlock.
-             */
-            if (!QEMU_IS_ALIGNED(ram_offset | size, qemu_ram_pagesize(rb)) ||
-                (ram_offset + size) > qemu_ram_get_used_length(rb)) {
-                continue;
-            }
+        virtio_balloon_discard_ranges(ranges);
+        g_array_set_size(ranges, 0);
 
-            ram_block_discard_range(rb, ram_offset, size);
+skip_elements:
+        WITH_RCU_READ_LOCK_GUARD() {
+            for (i = 0; i < num; i++) {
+                virtqueue_fill(vq, elems[i], 0, i);
+            }
+            virtqueue_flush(vq, num);
         }
-
-skip_element:
-        virtqueue_push(vq, elem, 0);
         virtio_notify(vdev, vq);
-        g_free(elem);
+        for (i = 0; i < num; i++) {
+            g_free(elems[i]);
+        }
+    }
+}
+
+static void virtio_balloon_report_bh(void *opaque)
+{
+    VirtIOBalloon *dev = opaque;
+
+    QEMU_LOCK_GUARD(&dev->report_lock);
+    /* virtio_reset() clears the status before it resets the queues */
+    if (VIRTIO_DEVICE(dev)->status & VIRTIO_CONFIG_S_DRIVER_OK) {
+        virtio_balloon_process_reports(dev);
+    }
+}
+
+static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
+{
+    VirtIOBalloon *dev = VIRTIO_BALLOON(vdev);
+
+    /* Discarding can take long, keep it off the main loop if possible */
+    if (dev->report_bh) {
+        qemu_bh_schedule(dev->report_bh);
+        return;
     }
+
+    virtio_balloon_process_reports(dev);
 }
 
 static void virtio_balloon_handle_output(VirtIODevice *vdev, VirtQueue *vq)
@@ -894,6 +982,12 @@ static void virtio_balloon_device_realize(DeviceState *dev, Error **errp)
     if (virtio_has_feature(s->host_features, VIRTIO_BALLOON_F_REPORTING)) {
         s->reporting_vq = virtio_add_queue(vdev, 32,
                                            virtio_balloon_handle_report);
+        if (s->iothread) {
+            object_ref(OBJECT(s->iothread));
+            s->report_bh = aio_bh_new_guarded(
+                iothread_get_aio_context(s->iothread),
+                virtio_balloon_report_bh, s, &dev->mem_reentrancy_guard);
+        }
     }
 
     reset_stats(s);
@@ -910,6 +1004,14 @@ static void virtio_balloon_device_unrealize(DeviceState *dev)
         virtio_balloon_free_page_stop(s);
         precopy_remove_notifier(&s->free_page_hint_notify);
     }
+    if (s->report_bh) {
+        /* Wait for reports being processed */
+        WITH_QEMU_LOCK_GUARD(&s->report_lock) {
+            qemu_bh_delete(s->report_bh);
+            s->report_bh = NULL;
+        }
+        object_unref(OBJECT(s->iothread));
+    }
     balloon_stats_destroy_timer(s);
     qemu_remove_balloon_handler(s);
 
@@ -933,6 +1035,15 @@ static void virtio_balloon_device_reset(VirtIODevice *vdev)
         virtio_balloon_free_page_stop(s);
     }
 
+    if (s->report_bh) {
+        /*
+         * The status is already cleared, so once the reports in flight are
+         * done the iothread no longer touches the queue.
+         */
+        qemu_mutex_lock(&s->report_lock);
+        qemu_mutex_unlock(&s->report_lock);
+    }
+
     if (s->stats_vq_elem != NULL) {
         virtqueue_unpop(s->svq, s->stats_vq_elem, 0);
         g_free(s->stats_vq_elem);
@@ -980,6 +1091,7 @@ static void virtio_balloon_instance_init(Object *obj)
 
     qemu_mutex_init(&s->free_page_lock);
     qemu_cond_init(&s->free_page_cond);
+    qemu_mutex_init(&s->report_lock);
     s->free_page_hint_cmd_id = VIRTIO_BALLOON_FREE_PAGE_HINT_CMD_ID_MIN;
     s->free_page_hint_notify.notify = virtio_balloon_free_page_hint_notify;
 
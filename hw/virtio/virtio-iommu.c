@@ -127,12 +127,20 @@ static bool virtio_iommu_switch_address_space(IOMMUDevice *sdev)
     return use_remapping;
 }
 
+/* Drop the translations cached by all endpoints */
+static void virtio_iommu_flush_iotlb_cache(VirtIOIOMMU *s)
+{
+    qatomic_inc(&s->iotlb_gen);
+}
+
 static void virtio_iommu_switch_address_space_all(VirtIOIOMMU *s)
 {
     GHashTableIter iter;
     IOMMUPciBus *iommu_pci_bus;
     int i;
 
+    virtio_iommu_flush_iotlb_cache(s);
+
     g_hash_table_iter_init(&iter, s->as_by_busptr);
     while (g_hash_table_iter_next(&iter, NULL, (void **)&iommu_pci_bus)) {
         for (i = 0; i < PCI_DEVFN_MAX; i++) {
@@ -812,6 +820,7 @@ static void virtio_iommu_handle_command(VirtIODevice *vdev, VirtQueue *vq)
         default:
             tail.status = VIRTIO_IOMMU_S_UNSUPP;
         }
+        virtio_iommu_flush_iotlb_cache(s);
         qemu_rec_mutex_unlock(&s->mutex);
 
 out:
@@ -869,6 +878,65 @@ static void virtio_iommu_report_fault(VirtIOIOMMU *viommu, uint8_t reason,
 
 }
 
+static bool virtio_iommu_block_ok(IOMMUDevice *sdev,
+                                  const VirtIOIOMMUInterval *key,
+                                  uint64_t delta, hwaddr start, uint64_t size)
+{
+    Range block;
+    GList *l;
+
+    if ((delta & (size - 1)) || start < key->low ||
+        start + size - 1 > key->high) {
+        return false;
+    }
+
+    range_init_nofail(&block, start, size);
+    for (l = sdev->resv_regions; l; l = l->next) {
+        ReservedRegion *reg = l->data;
+
+        if (range_overlaps_range(&block, &reg->range)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Describe the translation of @addr by @mapping in @entry as the largest
+ * naturally aligned block around it that the mapping translates linearly,
+ * so that callers do not come back for every page of a large mapping.
+ *
+ * Returns false if the mapping is not granule aligned, in which case only
+ * the exact address is translated.
+ */
+static bool virtio_iommu_fill_entry(IOMMUDevice *sdev, IOMMUTLBEntry *entry,
+                                    hwaddr addr,
+                                    const VirtIOIOMMUInterval *key,
+                                    const VirtIOIOMMUMapping *mapping,
+                                    int granule)
+{
+    uint64_t delta = mapping->phys_addr - key->low;
+    int bits = granule;
+
+    if (!virtio_iommu_block_ok(sdev, key, delta, addr & ~(BIT_ULL(bits) - 1),
+                               BIT_ULL(bits))) {
+        entry->translated_addr = addr + delta;
+        return false;
+    }
+
+    while (bits < 63 &&
+           virtio_iommu_block_ok(sdev, key, delta,
+                                 addr & ~(BIT_ULL(bits + 1) - 1),
+                                 BIT_ULL(bits + 1))) {
+        bits++;
+    }
+
+    entry->addr_mask = BIT_ULL(bits) - 1;
+    entry->iova = addr & ~entry->addr_mask;
+    entry->translated_addr = entry->iova + delta;
+    return true;
+}
+
 static IOMMUTLBEntry virtio_iommu_translate(IOMMUMemoryRegion *mr, hwaddr addr,
                                             IOMMUAccessFlags flag,
                                             int iommu_idx)
@@ -904,6 +972,16 @@ static IOMMUTLBEntry virtio_iommu_translate(IOMMUMemoryRegion *mr, hwaddr addr,
     trace_virtio_iommu_translate(mr->parent_obj.name, sid, addr, flag);
     qemu_rec_mutex_lock(&s->mutex);
 
+    if (sdev->iotlb_gen == qatomic_read(&s->iotlb_gen) &&
+        (addr & ~sdev->iotlb.addr_mask) == sdev->iotlb.iova &&
+        !(flag & ~sdev->iotlb.perm)) {
+        entry = sdev->iotlb;
+        entry.perm = flag;
+        trace_virtio_iommu_translate_out(addr, entry.translated_addr +
+                                         (addr - entry.iova), sid);
+        goto unlock;
+    }
+
     ep = g_tree_lookup(s->endpoints, GUINT_TO_POINTER(sid));
 
     if (bypass_allowed)
@@ -985,9 +1063,18 @@ static IOMMUTLBEntry virtio_iommu_translate(IOMMUMemoryRegion *mr, hwaddr addr,
                                   sid, addr);
         goto unlock;
     }
-    entry.translated_addr = addr - mapping_key->low + mapping_value->phys_addr;
+    if (virtio_iommu_fill_entry(sdev, &entry, addr, mapping_key,
+                                mapping_value, granule)) {
+        /* Remember the block with all the permissions it allows */
+        sdev->iotlb = entry;
+        sdev->iotlb.perm = IOMMU_ACCESS_FLAG(
+            mapping_value->flags & VIRTIO_IOMMU_MAP_F_READ,
+            mapping_value->flags & VIRTIO_IOMMU_MAP_F_WRITE);
+        sdev->iotlb_gen = qatomic_read(&s->iotlb_gen);
+    }
     entry.perm = flag;
-    trace_virtio_iommu_translate_out(addr, entry.translated_addr, sid);
+    trace_virtio_iommu_translate_out(addr, entry.translated_addr +
+                                     (addr - entry.iova), sid);
 
 unlock:
     qemu_rec_mutex_unlock(&s->mutex);
@@ -1167,6 +1254,8 @@ static int rebuild_resv_regions(IOMMUDevice *sdev)
     GList *l;
     int i = 0;
 
+    virtio_iommu_flush_iotlb_cache(sdev->viommu);
+
     /* free the existing list and rebuild it from scratch */
     g_list_free_full(sdev->resv_regions, g_free);
     sdev->resv_regions = NULL;
@@ -1313,6 +1402,7 @@ static void virtio_iommu_device_realize(DeviceState *dev, Error **errp)
      * in vfio realize
      */
     s->config.bypass = s->boot_bypass;
+    s->iotlb_gen = 1;
     s->config.page_size_mask = qemu_target_page_mask();
     s->config.input_range.end = UINT64_MAX;
     s->config.domain_range.end = UINT32_MAX;
@@ -1373,6 +1463,7 @@ static void virtio_iommu_device_reset(VirtIODevice *vdev)
 
     trace_virtio_iommu_device_reset();
 
+    virtio_iommu_flush_iotlb_cache(s);
     if (s->domains) {
         g_tree_destroy(s->domains);
     }
@@ -1483,6 +1574,7 @@ static int iommu_post_load(void *opaque, int version_id)
     VirtIOIOMMU *s = opaque;
 
     g_tree_foreach(s->domains, reconstruct_endpoints, s);
+    virtio_iommu_flush_iotlb_cache(s);
 
     /*
      * Memory regions are dynamically turned on/off depending on
@@ -576,6 +576,23 @@ static void virtio_mem_deactivate_unplugged_memslots(VirtIOMEM *vmem,
     memory_region_transaction_commit();
 }
 
+/*
+ * Preallocate using the threads and thread context configured for the memory
+ * backend, so large plug requests are populated in parallel and, with a
+ * NUMA-bound context, close to where the memory will be used. Small requests
+ * are still preallocated in the calling thread, see get_memset_num_threads().
+ */
+static void virtio_mem_prealloc_range(VirtIOMEM *vmem, uint64_t offset,
+                                      uint64_t size, Error **errp)
+{
+    HostMemoryBackend *backend = vmem->memdev;
+    void *area = memory_region_get_ram_ptr(&backend->mr) + offset;
+    int fd = memory_region_get_fd(&backend->mr);
+
+    qemu_prealloc_mem(fd, area, size, MAX(backend->prealloc_threads, 1),
+                      backend->prealloc_context, errp);
+}
+
 static int virtio_mem_set_block_state(VirtIOMEM *vmem, uint64_t start_gpa,
                                       uint64_t size, bool plug)
 {
@@ -601,11 +618,9 @@ static int virtio_mem_set_block_state(VirtIOMEM *vmem, uint64_t start_gpa,
     }
 
     if (vmem->prealloc) {
-        void *area = memory_region_get_ram_ptr(&vmem->memdev->mr) + offset;
-        int fd = memory_region_get_fd(&vmem->memdev->mr);
         Error *local_err = NULL;
 
-        qemu_prealloc_mem(fd, area, size, 1, NULL, &local_err);
+        virtio_mem_prealloc_range(vmem, offset, size, &local_err);
         if (local_err) {
             static bool warned;
 
@@ -1245,11 +1260,9 @@ static int virtio_mem_post_load(void *opaque, int version_id)
 static int virtio_mem_prealloc_range_cb(VirtIOMEM *vmem, void *arg,
                                         uint64_t offset, uint64_t size)
 {
-    void *area = memory_region_get_ram_ptr(&vmem->memdev->mr) + offset;
-    int fd = memory_region_get_fd(&vmem->memdev->mr);
     Error *local_err = NULL;
 
-    qemu_prealloc_mem(fd, area, size, 1, NULL, &local_err);
+    virtio_mem_prealloc_range(vmem, offset, size, &local_err);
     if (local_err) {
         error_report_err(local_err);
         return -ENOMEM;
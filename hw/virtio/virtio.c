@@ -20,6 +20,7 @@
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "qemu/thread-stats.h"
 #include "qom/object_interfaces.h"
 #include "hw/core/cpu.h"
 #include "hw/virtio/virtio.h"
@@ -116,6 +117,13 @@ typedef struct VRingPackedDescEvent {
     uint16_t flags;
 } VRingPackedDescEvent ;
 
+/*
+ * Size classes of the element pool: VIRTQUEUE_ELEM_POOL_MIN_SIZE bytes and
+ * its doublings.  Larger elements are always allocated from the heap.
+ */
+#define VIRTQUEUE_ELEM_POOL_CLASSES 6
+#define VIRTQUEUE_ELEM_POOL_MIN_SIZE 256
+
 struct VirtQueue
 {
     VRing vring;
@@ -152,6 +160,21 @@ struct VirtQueue
     EventNotifier host_notifier;
     bool host_notifier_enabled;
     QLIST_ENTRY(VirtQueue) node;
+
+    /*
+     * Free elements kept for reuse by virtqueue_element_free(), one list
+     * per size class, linked through their first word.  NULL-terminated.
+     */
+    bool elem_pool_enabled;
+    void *elem_pool[VIRTQUEUE_ELEM_POOL_CLASSES];
+    unsigned int elem_pool_len[VIRTQUEUE_ELEM_POOL_CLASSES];
+
+    /* Interrupt moderation state, see virtio_irq_coalesce() */
+    QEMUTimer *irq_coalesce_timer;
+    AioContext *irq_coalesce_ctx;
+    uint32_t irq_coalesce_count;
+    bool irq_coalesce_pending;
+    bool irq_coalesce_irqfd;
 };
 
 const char *virtio_device_names[] = {
@@ -980,6 +1003,8 @@ void virtqueue_flush(VirtQueue *vq, unsigned int count)
         return;
     }
 
+    qemu_thread_stat_add(QEMU_STAT_VIRTQUEUE_PUSHES, count);
+
     if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
         virtqueue_packed_flush(vq, count);
     } else {
@@ -1473,7 +1498,66 @@ void virtqueue_map(VirtIODevice *vdev, VirtQueueElement *elem)
                                                                         false);
 }
 
-static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_num)
+/* Size of the elements in pool class @class, which starts at 1 */
+static size_t virtqueue_elem_pool_size(unsigned int class)
+{
+    return (size_t)VIRTQUEUE_ELEM_POOL_MIN_SIZE << (class - 1);
+}
+
+static unsigned int virtqueue_elem_pool_class(size_t size)
+{
+    unsigned int class;
+
+    for (class = 1; class <= VIRTQUEUE_ELEM_POOL_CLASSES; class++) {
+        if (size <= virtqueue_elem_pool_size(class)) {
+            return class;
+        }
+    }
+    return 0;
+}
+
+static void virtqueue_elem_pool_drain(VirtQueue *vq)
+{
+    unsigned int i;
+
+    for (i = 0; i < VIRTQUEUE_ELEM_POOL_CLASSES; i++) {
+        while (vq->elem_pool[i]) {
+            void *elem = vq->elem_pool[i];
+
+            vq->elem_pool[i] = *(void **)elem;
+            g_free(elem);
+        }
+        vq->elem_pool_len[i] = 0;
+    }
+}
+
+void virtio_queue_enable_element_pool(VirtQueue *vq)
+{
+    vq->elem_pool_enabled = true;
+}
+
+void virtqueue_element_free(VirtQueue *vq, VirtQueueElement *elem)
+{
+    unsigned int class;
+
+    if (!elem) {
+        return;
+    }
+
+    class = elem->pool_class;
+    if (!class || !vq->elem_pool_enabled ||
+        vq->elem_pool_len[class - 1] >= MAX(vq->vring.num, 1)) {
+        g_free(elem);
+        return;
+    }
+
+    *(void **)elem = vq->elem_pool[class - 1];
+    vq->elem_pool[class - 1] = elem;
+    vq->elem_pool_len[class - 1]++;
+}
+
+static void *virtqueue_alloc_element(VirtQueue *vq, size_t sz,
+                                     unsigned out_num, unsigned in_num)
 {
     VirtQueueElement *elem;
     size_t in_addr_ofs = QEMU_ALIGN_UP(sz, __alignof__(elem->in_addr[0]));
@@ -1483,9 +1567,21 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     size_t out_sg_ofs = in_sg_ofs + in_num * sizeof(elem->in_sg[0]);
     size_t out_sg_end = out_sg_ofs + out_num * sizeof(elem->out_sg[0]);
 
+    unsigned int class = 0;
+
     assert(sz >= sizeof(VirtQueueElement));
-    elem = g_malloc(out_sg_end);
+    if (vq && vq->elem_pool_enabled) {
+        class = virtqueue_elem_pool_class(out_sg_end);
+    }
+    if (class && vq->elem_pool[class - 1]) {
+        elem = vq->elem_pool[class - 1];
+        vq->elem_pool[class - 1] = *(void **)elem;
+        vq->elem_pool_len[class - 1]--;
+    } else {
+        elem = g_malloc(class ? virtqueue_elem_pool_size(class) : out_sg_end);
+    }
     trace_virtqueue_alloc_element(elem, sz, in_num, out_num);
+    elem->pool_class = class;
     elem->out_num = out_num;
     elem->in_num = in_num;
     elem->in_addr = (void *)elem + in_addr_ofs;
@@ -1495,31 +1591,29 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     return elem;
 }
 
-static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
+/*
+ * Pop the element at vq->last_avail_idx, which the caller has checked to
+ * be available.  @addr and @iov are scratch arrays of VIRTQUEUE_MAX_SIZE
+ * entries that are reused across the elements of a batch.
+ *
+ * Called within rcu_read_lock().
+ */
+static void *virtqueue_split_pop_one(VirtQueue *vq, size_t sz,
+                                     VRingMemoryRegionCaches *caches,
+                                     hwaddr *addr, struct iovec *iov)
 {
     unsigned int i, head, max;
-    VRingMemoryRegionCaches *caches;
     MemoryRegionCache indirect_desc_cache;
     MemoryRegionCache *desc_cache;
     int64_t len;
     VirtIODevice *vdev = vq->vdev;
     VirtQueueElement *elem = NULL;
     unsigned out_num, in_num, elem_entries;
-    hwaddr addr[VIRTQUEUE_MAX_SIZE];
-    struct iovec iov[VIRTQUEUE_MAX_SIZE];
     VRingDesc desc;
     int rc;
 
     address_space_cache_init_empty(&indirect_desc_cache);
 
-    RCU_READ_LOCK_GUARD();
-    if (virtio_queue_empty_rcu(vq)) {
-        goto done;
-    }
-    /* Needed after virtio_queue_empty(), see comment in
-     * virtqueue_num_heads(). */
-    smp_rmb();
-
     /* When we start there are none of either input nor output. */
     out_num = in_num = elem_entries = 0;
 
@@ -1534,23 +1628,8 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
         goto done;
     }
 
-    if (virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
-        vring_set_avail_event(vq, vq->last_avail_idx);
-    }
-
     i = head;
 
-    caches = vring_get_region_caches(vq);
-    if (!caches) {
-        virtio_error(vdev, "Region caches not initialized");
-        goto done;
-    }
-
-    if (caches->desc.len < max * sizeof(VRingDesc)) {
-        virtio_error(vdev, "Cannot map descriptor ring");
-        goto done;
-    }
-
     desc_cache = &caches->desc;
     vring_split_desc_read(vdev, &desc, desc_cache, i);
     if (desc.flags & VRING_DESC_F_INDIRECT) {
@@ -1609,7 +1688,7 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
     }
 
     /* Now copy what we have collected and mapped */
-    elem = virtqueue_alloc_element(sz, out_num, in_num);
+    elem = virtqueue_alloc_element(vq, sz, out_num, in_num);
     elem->index = head;
     elem->ndescs = 1;
     for (i = 0; i < out_num; i++) {
@@ -1634,6 +1713,69 @@ err_undo_map:
     goto done;
 }
 
+/*
+ * Pop up to @max elements with a single read of the avail index, a single
+ * lookup of the region caches and a single update of the avail event.
+ */
+static unsigned int virtqueue_split_pop_batch(VirtQueue *vq, size_t sz,
+                                              void **elems, unsigned int max)
+{
+    VRingMemoryRegionCaches *caches;
+    VirtIODevice *vdev = vq->vdev;
+    hwaddr addr[VIRTQUEUE_MAX_SIZE];
+    struct iovec iov[VIRTQUEUE_MAX_SIZE];
+    uint16_t start = vq->last_avail_idx;
+    unsigned int count = 0;
+    int num_heads;
+
+    RCU_READ_LOCK_GUARD();
+    if (virtio_device_disabled(vdev) || unlikely(!vq->vring.avail)) {
+        return 0;
+    }
+
+    /* Includes the barrier needed before reading the descriptors */
+    num_heads = virtqueue_num_heads(vq, vq->last_avail_idx);
+    if (num_heads <= 0) {
+        return 0;
+    }
+
+    caches = vring_get_region_caches(vq);
+    if (!caches) {
+        virtio_error(vdev, "Region caches not initialized");
+        return 0;
+    }
+
+    if (caches->desc.len < vq->vring.num * sizeof(VRingDesc)) {
+        virtio_error(vdev, "Cannot map descriptor ring");
+        return 0;
+    }
+
+    max = MIN(max, num_heads);
+    while (count < max) {
+        void *elem = virtqueue_split_pop_one(vq, sz, caches, addr, iov);
+
+        if (!elem) {
+            break;
+        }
+        elems[count++] = elem;
+    }
+
+    if (vq->last_avail_idx != start &&
+        virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+
+    return count;
+}
+
+static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
+{
+    void *elem = NULL;
+
+    virtqueue_split_pop_batch(vq, sz, &elem, 1);
+    return elem;
+}
+
 static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
 {
     unsigned int i, max;
@@ -1737,7 +1879,7 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
     } while (rc == VIRTQUEUE_READ_DESC_MORE);
 
     /* Now copy what we have collected and mapped */
-    elem = virtqueue_alloc_element(sz, out_num, in_num);
+    elem = virtqueue_alloc_element(vq, sz, out_num, in_num);
     for (i = 0; i < out_num; i++) {
         elem->out_addr[i] = addr[i];
         elem->out_sg[i] = iov[i];
@@ -1773,15 +1915,45 @@ err_undo_map:
 
 void *virtqueue_pop(VirtQueue *vq, size_t sz)
 {
+    void *elem;
+
     if (virtio_device_disabled(vq->vdev)) {
         return NULL;
     }
 
     if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
-        return virtqueue_packed_pop(vq, sz);
+        elem = virtqueue_packed_pop(vq, sz);
     } else {
-        return virtqueue_split_pop(vq, sz);
+        elem = virtqueue_split_pop(vq, sz);
+    }
+    if (elem) {
+        qemu_thread_stat_add(QEMU_STAT_VIRTQUEUE_POPS, 1);
+    }
+    return elem;
+}
+
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max)
+{
+    unsigned int count = 0;
+
+    if (virtio_device_disabled(vq->vdev)) {
+        return 0;
+    }
+
+    if (!virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
+        return virtqueue_split_pop_batch(vq, sz, elems, max);
+    }
+
+    while (count < max) {
+        void *elem = virtqueue_packed_pop(vq, sz);
+
+        if (!elem) {
+            break;
+        }
+        elems[count++] = elem;
     }
+    return count;
 }
 
 static unsigned int virtqueue_packed_drop_all(VirtQueue *vq)
@@ -1919,7 +2091,7 @@ void *qemu_get_virtqueue_element(VirtIODevice *vdev, QEMUFile *f, size_t sz)
     assert(ARRAY_SIZE(data.in_addr) >= data.in_num);
     assert(ARRAY_SIZE(data.out_addr) >= data.out_num);
 
-    elem = virtqueue_alloc_element(sz, data.out_num, data.in_num);
+    elem = virtqueue_alloc_element(NULL, sz, data.out_num, data.in_num);
     elem->index = data.index;
 
     for (i = 0; i < elem->in_num; i++) {
@@ -2070,6 +2242,24 @@ static enum virtio_device_endian virtio_current_cpu_endian(void)
     }
 }
 
+static void virtio_irq_coalesce_discard(VirtQueue *vq)
+{
+    if (vq->irq_coalesce_timer) {
+        timer_del(vq->irq_coalesce_timer);
+    }
+    qatomic_set(&vq->irq_coalesce_pending, false);
+    vq->irq_coalesce_count = 0;
+}
+
+static void virtio_irq_coalesce_free(VirtQueue *vq)
+{
+    virtio_irq_coalesce_discard(vq);
+    if (vq->irq_coalesce_timer) {
+        timer_free(vq->irq_coalesce_timer);
+        vq->irq_coalesce_timer = NULL;
+    }
+}
+
 static void __virtio_queue_reset(VirtIODevice *vdev, uint32_t i)
 {
     vdev->vq[i].vring.desc = 0;
@@ -2087,6 +2277,7 @@ static void __virtio_queue_reset(VirtIODevice *vdev, uint32_t i)
     vdev->vq[i].notification = true;
     vdev->vq[i].vring.num = vdev->vq[i].vring.num_default;
     vdev->vq[i].inuse = 0;
+    virtio_irq_coalesce_discard(&vdev->vq[i]);
     virtio_virtqueue_reset_region_cache(&vdev->vq[i]);
 }
 
@@ -2345,6 +2536,9 @@ void virtio_delete_queue(VirtQueue *vq)
     vq->handle_output = NULL;
     g_free(vq->used_elems);
     vq->used_elems = NULL;
+    virtqueue_elem_pool_drain(vq);
+    vq->elem_pool_enabled = false;
+    virtio_irq_coalesce_free(vq);
     virtio_virtqueue_reset_region_cache(vq);
 }
 
@@ -2446,6 +2640,16 @@ static bool virtio_should_notify(VirtIODevice *vdev, VirtQueue *vq)
     }
 }
 
+/*
+ * Returns whether the guest wants an interrupt for the buffers used since
+ * the last notification, for callers that deliver it themselves.
+ */
+bool virtio_queue_should_notify(VirtIODevice *vdev, VirtQueue *vq)
+{
+    RCU_READ_LOCK_GUARD();
+    return virtio_should_notify(vdev, vq);
+}
+
 /* Batch irqs while inside a defer_call_begin()/defer_call_end() section */
 static void virtio_notify_irqfd_deferred_fn(void *opaque)
 {
@@ -2456,6 +2660,93 @@ static void virtio_notify_irqfd_deferred_fn(void *opaque)
     event_notifier_set(notifier);
 }
 
+static void virtio_irq(VirtQueue *vq)
+{
+    virtio_set_isr(vq->vdev, 0x1);
+    virtio_notify_vector(vq->vdev, vq->vector);
+}
+
+static void virtio_irq_coalesce_fire(VirtQueue *vq)
+{
+    /* The timer and virtio_irq_coalesce_flush() may race */
+    if (!qatomic_xchg(&vq->irq_coalesce_pending, false)) {
+        return;
+    }
+
+    vq->irq_coalesce_count = 0;
+    trace_virtio_irq_coalesce_fire(vq->vdev, vq);
+    if (vq->irq_coalesce_irqfd) {
+        virtio_set_isr(vq->vdev, 0x1);
+        event_notifier_set(&vq->guest_notifier);
+    } else {
+        virtio_irq(vq);
+    }
+}
+
+static void virtio_irq_coalesce_timer_cb(void *opaque)
+{
+    virtio_irq_coalesce_fire(opaque);
+}
+
+/* Deliver a held back notification immediately */
+static void virtio_irq_coalesce_flush(VirtQueue *vq)
+{
+    if (vq->irq_coalesce_timer) {
+        timer_del(vq->irq_coalesce_timer);
+    }
+    virtio_irq_coalesce_fire(vq);
+}
+
+/*
+ * Host side interrupt moderation, like interrupt throttling on physical
+ * NICs: the first notification arms a timer and further ones until it
+ * expires are merged into it, unless irq-coalesce-frames of them pile up
+ * first. The timer lives in the AioContext of the thread that notifies.
+ *
+ * Returns true if the notification has been held back, false if it must be
+ * delivered now.
+ */
+static bool virtio_irq_coalesce(VirtIODevice *vdev, VirtQueue *vq, bool irqfd)
+{
+    AioContext *ctx;
+
+    if (!vdev->irq_coalesce_usecs || !vdev->vm_running) {
+        return false;
+    }
+
+    if (vdev->irq_coalesce_frames &&
+        ++vq->irq_coalesce_count >= vdev->irq_coalesce_frames) {
+        /* Delivering this one covers the pending ones too */
+        virtio_irq_coalesce_discard(vq);
+        return false;
+    }
+
+    ctx = qemu_get_current_aio_context();
+    if (vq->irq_coalesce_timer && vq->irq_coalesce_ctx != ctx) {
+        /* The queue moved to another thread, e.g. dataplane was started */
+        virtio_irq_coalesce_flush(vq);
+        timer_free(vq->irq_coalesce_timer);
+        vq->irq_coalesce_timer = NULL;
+    }
+
+    if (qatomic_read(&vq->irq_coalesce_pending)) {
+        return true;
+    }
+
+    if (!vq->irq_coalesce_timer) {
+        vq->irq_coalesce_timer = aio_timer_new(ctx, QEMU_CLOCK_VIRTUAL,
+                                               SCALE_US,
+                                               virtio_irq_coalesce_timer_cb,
+                                               vq);
+        vq->irq_coalesce_ctx = ctx;
+    }
+    vq->irq_coalesce_irqfd = irqfd;
+    qatomic_set(&vq->irq_coalesce_pending, true);
+    timer_mod(vq->irq_coalesce_timer, qemu_clock_get_us(QEMU_CLOCK_VIRTUAL) +
+                                      vdev->irq_coalesce_usecs);
+    return true;
+}
+
 void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
 {
     WITH_RCU_READ_LOCK_GUARD() {
@@ -2465,6 +2756,11 @@ void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
     }
 
     trace_virtio_notify_irqfd(vdev, vq);
+    qemu_thread_stat_add(QEMU_STAT_VIRTQUEUE_NOTIFIES, 1);
+
+    if (virtio_irq_coalesce(vdev, vq, true)) {
+        return;
+    }
 
     /*
      * virtio spec 1.0 says ISR bit 0 should be ignored with MSI, but
@@ -2485,12 +2781,6 @@ void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
     defer_call(virtio_notify_irqfd_deferred_fn, &vq->guest_notifier);
 }
 
-static void virtio_irq(VirtQueue *vq)
-{
-    virtio_set_isr(vq->vdev, 0x1);
-    virtio_notify_vector(vq->vdev, vq->vector);
-}
-
 void virtio_notify(VirtIODevice *vdev, VirtQueue *vq)
 {
     WITH_RCU_READ_LOCK_GUARD() {
@@ -2500,6 +2790,10 @@ void virtio_notify(VirtIODevice *vdev, VirtQueue *vq)
     }
 
     trace_virtio_notify(vdev, vq);
+    qemu_thread_stat_add(QEMU_STAT_VIRTQUEUE_NOTIFIES, 1);
+    if (virtio_irq_coalesce(vdev, vq, false)) {
+        return;
+    }
     virtio_irq(vq);
 }
 
@@ -3188,8 +3482,17 @@ static void virtio_vmstate_change(void *opaque, bool running, RunState state)
     BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
     VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
     bool backend_run = running && virtio_device_started(vdev, vdev->status);
+    int i;
+
     vdev->vm_running = running;
 
+    /* Held back interrupts are not migrated, deliver them before stopping */
+    if (!running && vdev->irq_coalesce_usecs) {
+        for (i = 0; i < VIRTIO_QUEUE_MAX; i++) {
+            virtio_irq_coalesce_flush(&vdev->vq[i]);
+        }
+    }
+
     if (backend_run) {
         virtio_set_status(vdev, vdev->status);
     }
@@ -3706,6 +4009,9 @@ static void virtio_device_free_virtqueues(VirtIODevice *vdev)
         return;
     }
 
+    for (i = 0; i < VIRTIO_QUEUE_MAX; i++) {
+        virtio_irq_coalesce_free(&vdev->vq[i]);
+    }
     for (i = 0; i < VIRTIO_QUEUE_MAX; i++) {
         if (vdev->vq[i].vring.num == 0) {
             break;
@@ -3731,6 +4037,10 @@ static Property virtio_properties[] = {
     DEFINE_PROP_BOOL("use-disabled-flag", VirtIODevice, use_disabled_flag, true),
     DEFINE_PROP_BOOL("x-disable-legacy-check", VirtIODevice,
                      disable_legacy_check, false),
+    DEFINE_PROP_UINT32("irq-coalesce-usecs", VirtIODevice,
+                       irq_coalesce_usecs, 0),
+    DEFINE_PROP_UINT32("irq-coalesce-frames", VirtIODevice,
+                       irq_coalesce_frames, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -27,6 +27,7 @@
 
 #include "qemu/timed-average.h"
 #include "qemu/thread.h"
+#include "qemu/stats64.h"
 #include "qapi/qapi-types-common.h"
 
 typedef struct BlockAcctTimedStats BlockAcctTimedStats;
@@ -79,6 +80,37 @@ typedef struct BlockLatencyHistogram {
     uint64_t *bins;
 } BlockLatencyHistogram;
 
+/*
+ * Per-queue latency histograms use fixed log-linear buckets: latencies
+ * below 2^BLOCK_ACCT_LAT_SUB_BITS ns get one bucket each, and every
+ * larger power of two is split into 2^BLOCK_ACCT_LAT_SUB_BITS equal
+ * sub-buckets.  This keeps the relative error of a percentile below
+ * 1/8 from nanoseconds up to 2^BLOCK_ACCT_LAT_MAX_BITS ns (about 18
+ * minutes); anything slower is counted in the last bucket.
+ */
+#define BLOCK_ACCT_LAT_SUB_BITS 3
+#define BLOCK_ACCT_LAT_MAX_BITS 40
+#define BLOCK_ACCT_LAT_BUCKETS \
+    ((BLOCK_ACCT_LAT_MAX_BITS - BLOCK_ACCT_LAT_SUB_BITS + 1) << \
+     BLOCK_ACCT_LAT_SUB_BITS)
+
+typedef struct BlockAcctQueueStats {
+    /* id of the IOThread serving the queue, NULL for the main loop */
+    char *iothread;
+    /*
+     * Written without stats->lock by whichever thread completes requests
+     * of this queue, so that queues never contend with each other.
+     */
+    Stat64 latency[BLOCK_MAX_IOTYPE][BLOCK_ACCT_LAT_BUCKETS];
+} BlockAcctQueueStats;
+
+typedef struct BlockAcctLatencySummary {
+    uint64_t ops;
+    uint64_t p50_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+} BlockAcctLatencySummary;
+
 struct BlockAcctStats {
     QemuMutex lock;
     uint64_t nr_bytes[BLOCK_MAX_IOTYPE];
@@ -92,12 +124,20 @@ struct BlockAcctStats {
     bool account_invalid;
     bool account_failed;
     BlockLatencyHistogram latency_histogram[BLOCK_MAX_IOTYPE];
+    /* Set up by devices with multiple request queues, see
+     * block_acct_set_queues() */
+    BlockAcctQueueStats *queues;
+    unsigned nr_queues;
 };
 
+/* Queue of requests started with block_acct_start() */
+#define BLOCK_ACCT_NO_QUEUE UINT_MAX
+
 typedef struct BlockAcctCookie {
     int64_t bytes;
     int64_t start_time_ns;
     enum BlockAcctType type;
+    unsigned queue;
 } BlockAcctCookie;
 
 void block_acct_init(BlockAcctStats *stats);
@@ -109,6 +149,9 @@ BlockAcctTimedStats *block_acct_interval_next(BlockAcctStats *stats,
                                               BlockAcctTimedStats *s);
 void block_acct_start(BlockAcctStats *stats, BlockAcctCookie *cookie,
                       int64_t bytes, enum BlockAcctType type);
+void block_acct_start_queue(BlockAcctStats *stats, BlockAcctCookie *cookie,
+                            int64_t bytes, enum BlockAcctType type,
+                            unsigned queue);
 void block_acct_done(BlockAcctStats *stats, BlockAcctCookie *cookie);
 void block_acct_failed(BlockAcctStats *stats, BlockAcctCookie *cookie);
 void block_acct_invalid(BlockAcctStats *stats, enum BlockAcctType type);
@@ -120,5 +163,14 @@ double block_acct_queue_depth(BlockAcctTimedStats *stats,
 int block_latency_histogram_set(BlockAcctStats *stats, enum BlockAcctType type,
                                 uint64List *boundaries);
 void block_latency_histograms_clear(BlockAcctStats *stats);
+void block_acct_set_queues(BlockAcctStats *stats, unsigned nr_queues);
+void block_acct_set_queue_iothread(BlockAcctStats *stats, unsigned queue,
+                                   const char *iothread);
+void block_acct_queue_latency(BlockAcctStats *stats, unsigned queue,
+                              enum BlockAcctType type,
+                              BlockAcctLatencySummary *sum);
+void block_acct_iothread_latency(BlockAcctStats *stats, const char *iothread,
+                                 enum BlockAcctType type,
+                                 BlockAcctLatencySummary *sum);
 
 #endif
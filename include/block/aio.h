@@ -203,6 +203,8 @@ struct AioContext {
 
     int thread_pool_min;
     int thread_pool_max;
+    /* Thread context for creating thread pool workers, if any */
+    struct ThreadContext *thread_pool_context;
     /* Thread pool for performing work and receiving completion callbacks.
      * Has its own locking.
      */
@@ -217,6 +219,8 @@ struct AioContext {
     /* State for file descriptor monitoring using Linux io_uring */
     struct io_uring fdmon_io_uring;
     AioHandlerSList submit_list;
+    /* Whether poll sqes stay armed, see fdmon-io_uring.c */
+    bool fdmon_io_uring_multishot;
 #endif
 
     /* TimerLists for calling timers - one per clock type.  Has its own
@@ -232,6 +236,9 @@ struct AioContext {
     int64_t poll_max_ns;    /* maximum polling time in nanoseconds */
     int64_t poll_grow;      /* polling time growth factor */
     int64_t poll_shrink;    /* polling time shrink factor */
+    int64_t poll_cpu_budget; /* max. percentage of time spent polling */
+    int64_t poll_budget_start; /* start of the current budget window */
+    int64_t poll_budget_used;  /* ns spent polling in the current window */
 
     /* AIO engine parameters */
     int64_t aio_max_batch;  /* maximum number of requests in a batch */
@@ -710,6 +717,17 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
                                  int64_t grow, int64_t shrink,
                                  Error **errp);
 
+/**
+ * aio_context_set_poll_cpu_budget:
+ * @ctx: the aio context
+ * @budget: maximum percentage of time to spend busy polling, 0 means no
+ *          limit
+ *
+ * Polling is skipped for the rest of a short accounting window once the
+ * budget for that window has been used up.
+ */
+void aio_context_set_poll_cpu_budget(AioContext *ctx, int64_t budget);
+
 /**
  * aio_context_set_aio_params:
  * @ctx: the aio context
@@ -727,4 +745,15 @@ void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch,
  */
 void aio_context_set_thread_pool_params(AioContext *ctx, int64_t min,
                                         int64_t max, Error **errp);
+
+/**
+ * aio_context_set_thread_pool_context:
+ * @ctx: the aio context
+ * @tc: thread context used to create worker threads of the thread pool,
+ *      e.g. to give them a CPU affinity; NULL to create them directly
+ *
+ * Applies to worker threads that are created afterwards.
+ */
+void aio_context_set_thread_pool_context(AioContext *ctx,
+                                         struct ThreadContext *tc);
 #endif
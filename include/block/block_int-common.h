@@ -1049,22 +1049,40 @@ struct BdrvChild {
     QLIST_ENTRY(BdrvChild GRAPH_RDLOCK_PTR) next_parent;
 };
 
+#define BDRV_BSC_ENTRIES 16
+
 /*
- * Allows bdrv_co_block_status() to cache one data region for a
- * protocol node.
+ * One extent in the block-status cache.
  *
- * @valid: Whether the cache is valid (should be accessed with atomic
+ * @valid: Whether the entry is valid (should be accessed with atomic
  *         functions so this can be reset by RCU readers)
- * @data_start: Offset where we know (or strongly assume) is data
- * @data_end: Offset where the data region ends (which is not necessarily
- *            the start of a zeroed region)
+ * @zero: If true, the extent is a hole that reads as zeroes, otherwise
+ *        it is (or is strongly assumed to be) data
+ * @start: Offset where the extent starts
+ * @end: Offset where the extent ends (which is not necessarily the start
+ *       of an extent of the other kind)
+ */
+typedef struct BdrvBlockStatusCacheEntry {
+    bool valid;
+    bool zero;
+    int64_t start;
+    int64_t end;
+} BdrvBlockStatusCacheEntry;
+
+/*
+ * Allows bdrv_co_block_status() to cache the most recently identified
+ * data and zero extents of a protocol node.
+ *
+ * @next: Entry to replace on the next fill, in round-robin order
+ * @has_zero: Whether any entry has been filled as a zero extent, so
+ *            writes have something to invalidate
  */
 typedef struct BdrvBlockStatusCache {
     struct rcu_head rcu;
 
-    bool valid;
-    int64_t data_start;
-    int64_t data_end;
+    unsigned int next;
+    bool has_zero;
+    BdrvBlockStatusCacheEntry entries[BDRV_BSC_ENTRIES];
 } BdrvBlockStatusCache;
 
 struct BlockDriverState {
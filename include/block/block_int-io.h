@@ -166,19 +166,17 @@ bdrv_primary_bs(BlockDriverState *bs)
 }
 
 /**
- * Check whether the given offset is in the cached block-status data
- * region.
+ * Look up the given offset in the block-status cache.
  *
- * If it is, and @pnum is not NULL, *pnum is set to
- * `bsc.data_end - offset`, i.e. how many bytes, starting from
- * @offset, are data (according to the cache).
- * Otherwise, *pnum is not touched.
+ * If it is in a cached extent, *pnum is set to how many bytes, starting
+ * from @offset, belong to the extent, and BDRV_BLOCK_DATA or
+ * BDRV_BLOCK_ZERO, together with BDRV_BLOCK_OFFSET_VALID, is returned.
+ * Otherwise, 0 is returned and *pnum is not touched.
  */
-bool bdrv_bsc_is_data(BlockDriverState *bs, int64_t offset, int64_t *pnum);
+int bdrv_bsc_lookup(BlockDriverState *bs, int64_t offset, int64_t *pnum);
 
 /**
- * If [offset, offset + bytes) overlaps with the currently cached
- * block-status region, invalidate the cache.
+ * Invalidate the cached data extents that overlap [offset, offset + bytes).
  *
  * (To be used by I/O paths that cause data regions to be zero or
  * holes.)
@@ -186,9 +184,27 @@ bool bdrv_bsc_is_data(BlockDriverState *bs, int64_t offset, int64_t *pnum);
 void bdrv_bsc_invalidate_range(BlockDriverState *bs,
                                int64_t offset, int64_t bytes);
 
+/**
+ * Invalidate the cached zero extents that overlap [offset, offset + bytes).
+ *
+ * (To be used once a write to the range has completed, after
+ * bs->write_gen has been incremented.)
+ */
+void coroutine_fn bdrv_bsc_invalidate_zero_range(BlockDriverState *bs,
+                                                 int64_t offset,
+                                                 int64_t bytes);
+
 /**
  * Mark the range [offset, offset + bytes) as a data region.
  */
 void bdrv_bsc_fill(BlockDriverState *bs, int64_t offset, int64_t bytes);
 
+/**
+ * Mark the range [offset, offset + bytes) as a zero region, if no write
+ * has completed since bs->write_gen was @write_gen.  @write_gen must have
+ * been read before the block status of the range was determined.
+ */
+void bdrv_bsc_fill_zero(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                        unsigned int write_gen);
+
 #endif /* BLOCK_INT_IO_H */
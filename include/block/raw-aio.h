@@ -66,14 +66,44 @@ void laio_attach_aio_context(LinuxAioState *s, AioContext *new_context);
 /* io_uring.c - Linux io_uring implementation */
 #ifdef CONFIG_LINUX_IO_URING
 typedef struct LuringState LuringState;
-LuringState *luring_init(Error **errp);
+
+/* luring_init() flags */
+#define LURING_SQPOLL   0x1     /* submission queue polling kernel thread */
+#define LURING_IOPOLL   0x2     /* completion polling, needs O_DIRECT */
+
+LuringState *luring_init(unsigned int flags, Error **errp);
 void luring_cleanup(LuringState *s);
 
-/* luring_co_submit: submit I/O requests in the thread's current AioContext. */
-int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
+/*
+ * luring_co_submit: submit I/O requests on @s, or on the ring of the
+ * thread's current AioContext if @s is NULL.  A ring set up with
+ * LURING_IOPOLL cannot process QEMU_AIO_FLUSH.
+ */
+int coroutine_fn luring_co_submit(BlockDriverState *bs, LuringState *s,
+                                  int fd, uint64_t offset,
                                   QEMUIOVector *qiov, int type);
+
+/*
+ * luring_co_fallocate: run fallocate(@fd, @mode, @offset, @len) on the
+ * ring of the thread's current AioContext.  Returns -ENOSYS if the kernel
+ * or liburing cannot do this, in which case the caller must fall back to
+ * a synchronous fallocate() in the thread pool.
+ */
+int coroutine_fn luring_co_fallocate(BlockDriverState *bs, int fd, int mode,
+                                     uint64_t offset, uint64_t len);
 void luring_detach_aio_context(LuringState *s, AioContext *old_context);
 void luring_attach_aio_context(LuringState *s, AioContext *new_context);
+
+/*
+ * Register file descriptors and guest memory with all io_uring rings, so
+ * that requests on them can use fixed files and fixed buffers.  This is
+ * best effort: everything that cannot be registered keeps working as
+ * before.  A file descriptor must be unregistered before it is closed.
+ */
+void luring_register_fd(int fd);
+void luring_unregister_fd(int fd);
+void luring_register_buf(void *host, size_t size);
+void luring_unregister_buf(void *host, size_t size);
 #endif
 
 #ifdef _WIN32
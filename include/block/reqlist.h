@@ -67,6 +67,12 @@ void coroutine_fn reqlist_wait_all(BlockReqList *reqs, int64_t offset,
  */
 void coroutine_fn reqlist_shrink_req(BlockReq *req, int64_t new_bytes);
 
+/*
+ * Extend request to @new_bytes. Caller must be sure that there are no
+ * conflicting requests in the added region.
+ */
+void coroutine_fn reqlist_extend_req(BlockReq *req, int64_t new_bytes);
+
 /*
  * Remove request and wake all waiting coroutines. Do not release any memory.
  */
@@ -49,6 +49,13 @@ typedef struct ThrottleGroupMember {
      */
     unsigned int restart_pending;
 
+    /* Tokens that were taken from the group's buckets in advance and that
+     * requests of this member can use without the ThrottleGroup lock.
+     * Accessed with atomic operations.
+     */
+    uint32_t credit_ops[THROTTLE_MAX];
+    uint32_t credit_bytes[THROTTLE_MAX];
+
     /* The following fields are protected by the ThrottleGroup lock.
      * See the ThrottleGroup documentation for details.
      * throttle_state tells us if I/O limits are configured. */
@@ -213,6 +213,17 @@ typedef int (*walk_memory_regions_fn)(void *, target_ulong,
 int walk_memory_regions(void *, walk_memory_regions_fn);
 
 int page_get_flags(target_ulong address);
+
+/**
+ * page_get_flags_range:
+ * @start: first byte of range
+ * @last: last byte of range
+ * Context: holding mmap lock
+ *
+ * Return the union of the flags of every page in [@start, @last],
+ * or 0 if the entire range is unmapped.
+ */
+int page_get_flags_range(target_ulong start, target_ulong last);
 void page_set_flags(target_ulong start, target_ulong last, int flags);
 void page_reset_target_data(target_ulong start, target_ulong last);
 
@@ -223,6 +223,40 @@ void cpu_stq_mmu(CPUArchState *env, abi_ptr ptr, uint64_t val,
 void cpu_st16_mmu(CPUArchState *env, abi_ptr addr, Int128 val,
                   MemOpIdx oi, uintptr_t ra);
 
+/**
+ * cpu_memset_mmuidx_ra:
+ * @env: CPUArchState
+ * @addr: guest virtual address of the first byte
+ * @val: byte value to store
+ * @len: number of bytes to store
+ * @mmu_idx: MMU index to use for the access
+ * @ra: host unwind address
+ *
+ * Store @val to the bytes from @addr with a single host memset, stopping
+ * early at the end of the page.  Any guest exception for the range is
+ * raised before anything is written.  Return the number of bytes
+ * written, which is 0 if the page is not RAM that can be accessed
+ * directly (e.g. MMIO), or if plugins are watching memory accesses:
+ * the caller must then fall back to individual stores.
+ */
+size_t cpu_memset_mmuidx_ra(CPUArchState *env, abi_ptr addr, int val,
+                            size_t len, int mmu_idx, uintptr_t ra);
+
+/**
+ * cpu_memmove_mmuidx_ra:
+ * @env: CPUArchState
+ * @dst: guest virtual address of the destination
+ * @src: guest virtual address of the source
+ * @len: number of bytes to copy
+ * @mmu_idx: MMU index to use for both accesses
+ * @ra: host unwind address
+ *
+ * Like cpu_memset_mmuidx_ra(), but copy with host memmove from @src
+ * to @dst, stopping early at the end of the first of the two pages.
+ */
+size_t cpu_memmove_mmuidx_ra(CPUArchState *env, abi_ptr dst, abi_ptr src,
+                             size_t len, int mmu_idx, uintptr_t ra);
+
 uint32_t cpu_atomic_cmpxchgb_mmu(CPUArchState *env, abi_ptr addr,
                                  uint32_t cmpv, uint32_t newv,
                                  MemOpIdx oi, uintptr_t retaddr);
@@ -96,6 +96,15 @@ void tlb_flush_page_all_cpus_synced(CPUState *src, vaddr addr);
  * use one of the other functions for efficiency.
  */
 void tlb_flush(CPUState *cpu);
+/**
+ * tlb_flush_generation:
+ * @cpu: the current CPU
+ *
+ * Return a value that changes whenever any part of the TLB of @cpu is
+ * flushed, so that targets can tag their own page table walk caches
+ * with it.  Must be called from the thread of @cpu.
+ */
+uint32_t tlb_flush_generation(CPUState *cpu);
 /**
  * tlb_flush_all_cpus:
  * @cpu: src CPU of the flush
@@ -545,21 +554,6 @@ extern __thread uintptr_t tci_tb_ptr;
    smaller than 4 bytes, so we don't worry about special-casing this.  */
 #define GETPC_ADJ   2
 
-#if !defined(CONFIG_USER_ONLY)
-
-/**
- * iotlb_to_section:
- * @cpu: CPU performing the access
- * @index: TCG CPU IOTLB entry
- *
- * Given a TCG CPU IOTLB entry, return the MemoryRegionSection that
- * it refers to. @index will have been initially created and returned
- * by memory_region_section_get_iotlb().
- */
-struct MemoryRegionSection *iotlb_to_section(CPUState *cpu,
-                                             hwaddr index, MemTxAttrs attrs);
-#endif
-
 /**
  * get_page_addr_code_hostp()
  * @env: CPUArchState
@@ -599,15 +593,36 @@ void TSA_NO_TSA mmap_lock(void);
 void TSA_NO_TSA mmap_unlock(void);
 bool have_mmap_lock(void);
 
+/*
+ * Take mmap_lock shared: the guest address space does not change
+ * until mmap_read_unlock(), but other readers may run concurrently.
+ */
+void TSA_NO_TSA mmap_read_lock(void);
+void TSA_NO_TSA mmap_read_unlock(void);
+/* Return true if holding mmap_lock either exclusively or shared. */
+bool have_mmap_read_lock(void);
+/* Drop every level of mmap_lock held, e.g. after a siglongjmp. */
+void TSA_NO_TSA mmap_unlock_all(void);
+
 static inline void mmap_unlock_guard(void *unused)
 {
     mmap_unlock();
 }
 
+static inline void mmap_read_unlock_guard(void *unused)
+{
+    mmap_read_unlock();
+}
+
 #define WITH_MMAP_LOCK_GUARD()                                            \
     for (int _mmap_lock_iter __attribute__((cleanup(mmap_unlock_guard)))  \
          = (mmap_lock(), 0); _mmap_lock_iter == 0; _mmap_lock_iter = 1)
 
+#define WITH_MMAP_READ_LOCK_GUARD()                                       \
+    for (int _mmap_lock_iter                                              \
+         __attribute__((cleanup(mmap_read_unlock_guard)))                 \
+         = (mmap_read_lock(), 0); _mmap_lock_iter == 0; _mmap_lock_iter = 1)
+
 /**
  * adjust_signal_pc:
  * @pc: raw pc from the host signal ucontext_t.
@@ -662,7 +677,10 @@ G_NORETURN void cpu_loop_exit_sigbus(CPUState *cpu, target_ulong addr,
 #else
 static inline void mmap_lock(void) {}
 static inline void mmap_unlock(void) {}
+static inline void mmap_read_lock(void) {}
+static inline void mmap_read_unlock(void) {}
 #define WITH_MMAP_LOCK_GUARD()
+#define WITH_MMAP_READ_LOCK_GUARD()
 
 void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length);
 void tlb_set_dirty(CPUState *cpu, vaddr addr);
@@ -109,6 +109,16 @@ typedef enum MemOp {
     MO_ATOM_NONE          = 5 << MO_ATOM_SHIFT,
     MO_ATOM_MASK          = 7 << MO_ATOM_SHIFT,
 
+    /*
+     * MO_ORDERED: the load has acquire semantics, i.e. no later memory
+     * access may be observed before it, or the store has release
+     * semantics, i.e. no earlier memory access may be observed after it.
+     * This is set by tcg itself when it emulates the guest memory model
+     * this way, instead of with barriers, and only for backends with
+     * TCG_TARGET_HAS_qemu_ldst_ordered.
+     */
+    MO_ORDERED = 1 << 11,
+
     /* Combinations of the above, for ease of use.  */
     MO_UB    = MO_8,
     MO_UW    = MO_16,
@@ -795,6 +795,7 @@ struct MemoryRegion {
     bool nonvolatile;
     bool rom_device;
     bool flush_coalesced_mmio;
+    bool global_locking;
     bool unmergeable;
     uint8_t dirty_log_mask;
     bool is_iommu;
@@ -1123,6 +1124,8 @@ struct AddressSpace {
     struct MemoryRegionIoeventfd *ioeventfds;
     QTAILQ_HEAD(, MemoryListener) listeners;
     QTAILQ_ENTRY(AddressSpace) address_spaces_link;
+    /* Set while committing a transaction that changes the FlatView */
+    bool flatview_changed;
 };
 
 typedef struct AddressSpaceDispatch AddressSpaceDispatch;
@@ -2236,6 +2239,28 @@ void memory_region_set_flush_coalesced(MemoryRegion *mr);
  */
 void memory_region_clear_flush_coalesced(MemoryRegion *mr);
 
+/**
+ * memory_region_clear_global_locking: Declares that access processing does
+ *                                     not depend on the QEMU global lock.
+ *
+ * By clearing this property, accesses to the memory region will be processed
+ * outside of QEMU's global lock (unless the lock is held on when issuing the
+ * access request).  In this case, the device model implementing the access
+ * handlers is responsible for synchronization of concurrency.
+ *
+ * Only the registers that need it should be put into such a region, e.g. a
+ * region of doorbells that each vCPU hits on its own.  The handlers may take
+ * the global lock themselves for the paths that are not lockless.
+ *
+ * The handlers run within an RCU read-side critical section, which keeps
+ * the owner of @mr alive, but nothing else: any other state they use,
+ * such as file descriptors or child devices that are torn down under the
+ * global lock, needs its own protection against concurrent teardown.
+ *
+ * @mr: the memory region to be updated.
+ */
+void memory_region_clear_global_locking(MemoryRegion *mr);
+
 /**
  * memory_region_add_eventfd: Request an eventfd to be triggered when a word
  *                            is written to a location.
@@ -2942,6 +2967,15 @@ MemTxResult flatview_read_continue(FlatView *fv, hwaddr addr,
                                    MemoryRegion *mr);
 void *qemu_map_ram_ptr(RAMBlock *ram_block, ram_addr_t addr);
 
+/*
+ * Write counterpart of flatview_read_continue(), for callers that resolve
+ * @addr with flatview_translate() themselves.
+ */
+MemTxResult flatview_write_continue(FlatView *fv, hwaddr addr,
+                                    MemTxAttrs attrs, const void *buf,
+                                    hwaddr len, hwaddr addr1, hwaddr l,
+                                    MemoryRegion *mr);
+
 /* Internal functions, part of the implementation of address_space_read_cached
  * and address_space_write_cached.  */
 MemTxResult address_space_read_cached_slow(MemoryRegionCache *cache,
@@ -75,6 +75,25 @@ struct RAMBlock {
      * could not have been valid on the source.
      */
     ram_addr_t postcopy_length;
+
+    /*
+     * On the destination, when postcopy pages are placed through minor
+     * faults, a second shared mapping of the backing file.  Received
+     * pages are written through it, which makes them visible to the
+     * guest only once the fault on the guest mapping is resolved with
+     * UFFDIO_CONTINUE.  NULL when the block uses UFFDIO_COPY.
+     */
+    void *postcopy_alias;
+
+    /*
+     * With the mapped-ram capability every page of the block has a fixed
+     * location in the migration file.  file_bmap tracks which pages hold
+     * valid data there; it is written to bitmap_offset at the end of
+     * migration.  Pages live from pages_offset on.
+     */
+    unsigned long *file_bmap;
+    off_t bitmap_offset;
+    uint64_t pages_offset;
 };
 #endif
 #endif
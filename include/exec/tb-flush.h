@@ -23,6 +23,19 @@
  */
 void tb_flush(CPUState *cs);
 
+/**
+ * tb_evict() - make room in the code buffer
+ * @cs: CPUState (must be valid, but treated as anonymous pointer)
+ *
+ * Invalidate the translation blocks of the oldest full region of the
+ * code buffer, so that it can be reused.  Translations in the other
+ * regions are kept.  If no region can be evicted, this is the same as
+ * tb_flush().
+ *
+ * Like tb_flush(), the eviction runs in an exclusive context.
+ */
+void tb_evict(CPUState *cs);
+
 void tcg_flush_jmp_cache(CPUState *cs);
 
 #endif /* _TB_FLUSH_H_ */
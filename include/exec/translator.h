@@ -159,6 +159,19 @@ void translator_loop(CPUState *cpu, TranslationBlock *tb, int *max_insns,
  */
 bool translator_use_goto_tb(DisasContextBase *db, vaddr dest);
 
+/**
+ * translator_follow_jump
+ * @db: Disassembly context
+ * @dest: target pc of an unconditional direct jump
+ *
+ * Return true if translation may continue at @dest within the current
+ * TB, instead of ending the TB with a goto_tb to @dest.  On success
+ * the target is responsible for updating db->pc_next to @dest and
+ * leaving db->is_jmp as DISAS_NEXT.  The bytes skipped by the jump
+ * remain part of the range covered by the TB.
+ */
+bool translator_follow_jump(DisasContextBase *db, vaddr dest);
+
 /**
  * translator_io_start
  * @db: Disassembly context
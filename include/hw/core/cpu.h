@@ -199,8 +199,13 @@ struct CPUClass {
  */
 #define NB_MMU_MODES 16
 
-/* Use a fully associative victim tlb of 8 entries. */
-#define CPU_VTLB_SIZE 8
+/*
+ * The victim tlb is set associative, with CPU_VTLB_WAYS entries per set.
+ * Its number of sets follows the size of the main tlb, up to
+ * CPU_VTLB_MAX_SETS.
+ */
+#define CPU_VTLB_WAYS 4
+#define CPU_VTLB_MAX_SETS 256
 
 /*
  * The full TLB entry, which is not accessed by generated TCG code,
@@ -219,6 +224,15 @@ typedef struct CPUTLBEntryFull {
      */
     hwaddr xlat_section;
 
+    /*
+     * @section is, for I/O and ROMD pages, the section numbered in
+     * @xlat_section; it is NULL for RAM, and for pages behind an IOMMU.
+     * This is valid for the lifetime of the entry, since any change to
+     * the cpu's memory map flushes the tlb before the old sections are
+     * freed.
+     */
+    MemoryRegionSection *section;
+
     /*
      * @phys_addr contains the physical address in the address space
      * given by cpu_asidx_from_attrs(cpu, @attrs).
@@ -253,11 +267,15 @@ typedef struct CPUTLBEntryFull {
          * Otherwise, pte_attrs is the same as the MAIR_EL1 8-bit format.
          * For shareability and guarded, as in the SH and GP fields respectively
          * of the VMSAv8-64 PTEs.
+         *
+         * tag_mem caches the host address of the MTE allocation tags of
+         * the page, filled in on the first tag check; NULL if not known.
          */
         struct {
             uint8_t pte_attrs;
             uint8_t shareability;
             bool guarded;
+            uint8_t *tag_mem;
         } arm;
     } extra;
 } CPUTLBEntryFull;
@@ -280,14 +298,27 @@ typedef struct CPUTLBDesc {
     /* maximum number of entries observed in the window */
     size_t window_max_entries;
     size_t n_used_entries;
-    /* The next index to use in the tlb victim table.  */
+    /* Round-robin counter selecting the way to replace in a full set.  */
     size_t vindex;
+    /* The number of sets in the tlb victim table, minus one.  */
+    size_t vmask;
     /* The tlb victim table, in two parts.  */
-    CPUTLBEntry vtable[CPU_VTLB_SIZE];
-    CPUTLBEntryFull vfulltlb[CPU_VTLB_SIZE];
+    CPUTLBEntry *vtable;
+    CPUTLBEntryFull *vfulltlb;
     CPUTLBEntryFull *fulltlb;
 } CPUTLBDesc;
 
+/*
+ * Maximum number of distinct pages queued for flushing by other vCPUs
+ * before falling back to flushing the affected mmu_idx entirely.
+ */
+#define CPU_TLB_PENDING_SIZE 16
+
+typedef struct CPUTLBPendingFlush {
+    vaddr addr;
+    uint16_t idxmap;
+} CPUTLBPendingFlush;
+
 /*
  * Data elements that are shared between all MMU modes.
  */
@@ -300,6 +331,16 @@ typedef struct CPUTLBCommon {
      * Protected by tlb_c.lock.
      */
     uint16_t dirty;
+    /*
+     * Page flushes requested by other vCPUs which have not yet been
+     * processed.  They are all handled by a single queued work item.
+     * pending_full is the set of mmu_idx to be flushed entirely.
+     * Protected by pending_lock.
+     */
+    QemuSpin pending_lock;
+    uint16_t pending_full;
+    uint16_t pending_n;
+    CPUTLBPendingFlush pending[CPU_TLB_PENDING_SIZE];
     /*
      * Statistics.  These are not lock protected, but are read and
      * written atomically.  This allows the monitor to print a snapshot
@@ -308,6 +349,15 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    size_t coalesced_flush_count;
+    size_t vtlb_hit_count;
+    size_t vtlb_miss_count;
+    /*
+     * Incremented by every flush, whole or by page, so that targets can
+     * validate their own caches of page table walks against it.
+     * Only accessed by the owning cpu.
+     */
+    uint32_t flush_gen;
 } CPUTLBCommon;
 
 /*
@@ -421,6 +471,12 @@ struct qemu_work_item;
  * @crash_occurred: Indicates the OS reported a crash (panic) for this CPU
  * @singlestep_enabled: Flags for single-stepping.
  * @icount_extra: Instructions until next timer event.
+ * @icount_local: With parallel icount, instructions executed by this vCPU.
+ * @icount_deferred_irq: With parallel icount, interrupts raised by other
+ *                       threads that are delivered at the next quantum end.
+ * @icount_io_pending: With parallel icount, the vCPU stopped at an I/O
+ *                     access that waits for the end of the quantum.
+ * @icount_io_granted: With parallel icount, the vCPU may do I/O right away.
  * @neg.can_do_io: True if memory-mapped IO is allowed.
  * @cpu_ases: Pointer to array of CPUAddressSpaces (which define the
  *            AddressSpaces this CPU has)
@@ -465,6 +521,8 @@ struct CPUState {
     int nr_threads;
 
     struct QemuThread *thread;
+    /* Context with which to create @thread, may be NULL */
+    struct ThreadContext *thread_context;
 #ifdef _WIN32
     QemuSemaphore sem;
 #endif
@@ -489,6 +547,10 @@ struct CPUState {
     int singlestep_enabled;
     int64_t icount_budget;
     int64_t icount_extra;
+    int64_t icount_local;
+    uint32_t icount_deferred_irq;
+    bool icount_io_pending;
+    bool icount_io_granted;
     uint64_t random_seed;
     sigjmp_buf jmp_env;
 
@@ -400,6 +400,15 @@ struct CXLType3Dev {
     /* State */
     AddressSpace hostvmem_as;
     AddressSpace hostpmem_as;
+    /*
+     * Aliases of the backing memory for HDM decoders that are not
+     * interleaved, mapped into @direct_container[i] when not NULL.
+     * @direct_tried[i] is set once decoder i has been considered.
+     */
+    MemoryRegion direct_mr[CXL_HDM_DECODER_COUNT];
+    MemoryRegion *direct_container[CXL_HDM_DECODER_COUNT];
+    bool direct_tried[CXL_HDM_DECODER_COUNT];
+    Notifier hdm_notifier;
     CXLComponentState cxl_cstate;
     CXLDeviceState cxl_dstate;
     CXLCCI cci; /* Primary PCI mailbox CCI */
@@ -453,6 +462,7 @@ MemTxResult cxl_type3_read(PCIDevice *d, hwaddr host_addr, uint64_t *data,
                            unsigned size, MemTxAttrs attrs);
 MemTxResult cxl_type3_write(PCIDevice *d, hwaddr host_addr, uint64_t data,
                             unsigned size, MemTxAttrs attrs);
+void cxl_type3_direct_unmap(CXLType3Dev *ct3d);
 
 uint64_t cxl_device_get_timestamp(CXLDeviceState *cxlds);
 
@@ -16,6 +16,8 @@
 void cxl_machine_init(Object *obj, CXLState *state);
 void cxl_fmws_link_targets(CXLState *stat, Error **errp);
 void cxl_hook_up_pxb_registers(PCIBus *bus, CXLState *state, Error **errp);
+CXLFixedWindow *cxl_fmws_find_direct(PCIDevice *d, hwaddr hpa,
+                                     uint64_t size);
 
 extern const MemoryRegionOps cfmws_ops;
 
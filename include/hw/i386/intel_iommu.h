@@ -23,6 +23,7 @@
 #define INTEL_IOMMU_H
 
 #include "hw/i386/x86-iommu.h"
+#include "qemu/interval-tree.h"
 #include "qemu/iova-tree.h"
 #include "qom/object.h"
 
@@ -144,6 +145,23 @@ struct VTDPASIDAddressSpace {
     VTDPASIDCacheEntry pasid_cache_entry;
 };
 
+/* Number of translations cached per VTDAddressSpace, must be a power of 2 */
+#define VTD_TLB_CACHE_SIZE 16
+
+/*
+ * A translation cached in VTDAddressSpace.tlb_cache.  Entries are read
+ * without the IOMMU lock, under RCU, and are valid as long as @gen is
+ * equal to IntelIOMMUState.tlb_cache_gen.
+ */
+typedef struct VTDTLBCacheEntry {
+    struct rcu_head rcu;
+    uint32_t gen;
+    hwaddr iova;
+    hwaddr translated_addr;
+    hwaddr addr_mask;
+    IOMMUAccessFlags perm;
+} VTDTLBCacheEntry;
+
 struct VTDAddressSpace {
     PCIBus *bus;
     uint8_t devfn;
@@ -156,6 +174,8 @@ struct VTDAddressSpace {
     MemoryRegion iommu_ir_fault; /* Interrupt region for catching fault */
     IntelIOMMUState *iommu_state;
     VTDContextCacheEntry context_cache_entry;
+    /* Recent translations, indexed by page number at their page size */
+    VTDTLBCacheEntry *tlb_cache[VTD_TLB_CACHE_SIZE];
     QLIST_ENTRY(VTDAddressSpace) next;
     /* Superset of notifier flags that this address space has */
     IOMMUNotifierFlag notifier_flags;
@@ -214,6 +234,10 @@ struct VTDIOTLBEntry {
     uint64_t pte;
     uint64_t mask;
     uint8_t access_flags;
+    /* Only used by the second-level IOTLB */
+    uint16_t sid;
+    uint8_t level;
+    IntervalTreeNode node;          /* in IntelIOMMUState.iotlb_ranges */
 };
 
 /* VT-d Source-ID Qualifier types */
@@ -350,6 +374,8 @@ struct IntelIOMMUState {
 
     uint32_t context_cache_gen;     /* Should be in [1,MAX] */
     GHashTable *iotlb;              /* IOTLB */
+    IntervalTreeRoot iotlb_ranges;  /* IOTLB entries by IOVA range */
+    uint32_t tlb_cache_gen;         /* Generation of VTDAddressSpace caches */
     GHashTable *p_iotlb;            /* pasid based IOTLB */
 
     GHashTable *vtd_address_spaces;             /* VTD address spaces */
@@ -54,6 +54,26 @@ typedef struct {
     uint64_t base_addr;
 } CmdQDesc;
 
+/* Number of cached event translations, must be a power of 2 */
+#define ITS_TRANS_CACHE_SIZE 64
+
+/*
+ * The DTE and ITE fields for a (DeviceID, EventID) pair, as looked up in
+ * guest memory by the emulated ITS.  Only valid translations are cached.
+ */
+typedef struct {
+    bool valid;
+    uint32_t devid;
+    uint32_t eventid;
+    unsigned dte_size;
+    uint64_t ittaddr;
+    int inttype;
+    uint32_t intid;
+    uint32_t doorbell;
+    uint32_t icid;
+    uint32_t vpeid;
+} ITSTransCacheEntry;
+
 struct GICv3ITSState {
     SysBusDevice parent_obj;
 
@@ -81,6 +101,9 @@ struct GICv3ITSState {
     TableDesc  vpet;
     CmdQDesc   cq;
 
+    /* Emptied whenever the ITS writes a table or its layout changes */
+    ITSTransCacheEntry trans_cache[ITS_TRANS_CACHE_SIZE];
+
     Error *migration_blocker;
 };
 
@@ -54,6 +54,8 @@ struct RISCVIMSICState {
     uint32_t *eidelivery;
     uint32_t *eithreshold;
     uint32_t *eistate;
+    /* Bitmap of the interrupts that are both enabled and pending */
+    unsigned long *eienpend;
 
     /* config */
     bool mmode;
@@ -28,8 +28,29 @@ typedef struct {
     char *tag;
     uint16_t num_request_queues;
     uint16_t queue_size;
+    uint64_t cache_size;
 } VHostUserFSConf;
 
+/* Flags of VhostUserFSBackendMsg */
+#define VHOST_USER_FS_FLAG_MAP_R (1ull << 0)
+#define VHOST_USER_FS_FLAG_MAP_W (1ull << 1)
+
+/*
+ * Payload of the VHOST_USER_BACKEND_FS_MAP/UNMAP messages, which map the
+ * file descriptor sent along with the message into the DAX window, or
+ * unmap part of the window.
+ */
+typedef struct {
+    /* Offset into the file */
+    uint64_t fd_offset;
+    /* Offset into the DAX window */
+    uint64_t c_offset;
+    /* Length of the range, ~0 in an unmap message means the whole window */
+    uint64_t len;
+    /* VHOST_USER_FS_FLAG_* */
+    uint64_t flags;
+} VhostUserFSBackendMsg;
+
 struct VHostUserFS {
     /*< private >*/
     VirtIODevice parent;
@@ -40,8 +61,16 @@ struct VHostUserFS {
     VirtQueue **req_vqs;
     VirtQueue *hiprio_vq;
     int32_t bootindex;
+    /* DAX window, exposed as a shared memory region of the device */
+    MemoryRegion cache;
+    void *cache_ptr;
 
     /*< public >*/
 };
 
+int vhost_user_fs_backend_map(struct vhost_dev *dev,
+                              VhostUserFSBackendMsg *msg, int fd);
+int vhost_user_fs_backend_unmap(struct vhost_dev *dev,
+                                VhostUserFSBackendMsg *msg);
+
 #endif /* QEMU_VHOST_USER_FS_H */
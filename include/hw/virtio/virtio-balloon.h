@@ -64,6 +64,9 @@ struct VirtIOBalloon {
      * stopped.
      */
     bool block_iothread;
+    /* Processes free page reports in the iothread, if there is one */
+    QEMUBH *report_bh;
+    QemuMutex report_lock;
     NotifierWithReturn free_page_hint_notify;
     int64_t stats_last_update;
     int64_t stats_poll_interval;
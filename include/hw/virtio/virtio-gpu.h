@@ -53,6 +53,9 @@ struct virtio_gpu_simple_resource {
     pixman_image_t *image;
 #ifdef WIN32
     HANDLE handle;
+#else
+    /* memfd backing @image of 2D resources, or -1 */
+    int shmfd;
 #endif
     uint64_t hostmem;
 
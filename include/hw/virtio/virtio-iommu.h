@@ -42,6 +42,9 @@ typedef struct IOMMUDevice {
     GList *resv_regions;
     GList *host_resv_ranges;
     bool probe_done;
+    /* Last translated block, valid while iotlb_gen matches the IOMMU's */
+    IOMMUTLBEntry iotlb;
+    uint64_t iotlb_gen;
 } IOMMUDevice;
 
 typedef struct IOMMUPciBus {
@@ -66,6 +69,8 @@ struct VirtIOIOMMU {
     bool boot_bypass;
     Notifier machine_done;
     bool granule_frozen;
+    /* Bumped on every change that can affect translations */
+    uint64_t iotlb_gen;
 };
 
 #endif
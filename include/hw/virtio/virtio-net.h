@@ -139,6 +139,19 @@ typedef struct VirtioNetRscChain {
 #define VIRTIO_NET_RSS_MAX_KEY_SIZE     40
 #define VIRTIO_NET_RSS_MAX_TABLE_LEN    128
 
+/* A flow seen by software RSS, kept in a table indexed by its hash */
+typedef struct VirtioNetRssFlow {
+    uint32_t hash;
+    /* Queue the flow was last steered to */
+    uint16_t queue;
+    /* Steered to @queue regardless of the indirection table */
+    bool pinned;
+    /* Packets since the last rebalancing */
+    uint32_t window_packets;
+    uint64_t packets;
+    uint64_t bytes;
+} VirtioNetRssFlow;
+
 typedef struct VirtioNetRssData {
     bool    enabled;
     bool    enabled_software_rss;
@@ -149,6 +162,11 @@ typedef struct VirtioNetRssData {
     uint16_t indirections_len;
     uint16_t *indirections_table;
     uint16_t default_queue;
+    /* Flow table for rss-flow-balance, NULL if disabled */
+    VirtioNetRssFlow *flows;
+    /* Packets steered to each queue since the last rebalancing */
+    uint32_t *queue_load;
+    uint32_t window_packets;
 } VirtioNetRssData;
 
 typedef struct VirtIONetQueue {
@@ -160,6 +178,8 @@ typedef struct VirtIONetQueue {
     struct {
         VirtQueueElement *elem;
     } async_tx;
+    /* Rewritten TX descriptors of the packets of a batch being prepared */
+    struct iovec *tx_sg;
     struct VirtIONet *n;
 } VirtIONetQueue;
 
@@ -184,6 +204,14 @@ struct VirtIONet {
     uint8_t rsc6_enabled;
     uint8_t has_ufo;
     uint32_t mergeable_rx_bufs;
+    /*
+     * RX filter state: promisc down to nobcast, mac_table and vlans, as
+     * well as mac above.  receive_filter() reads it for every packet.  The
+     * control virtqueue, config space writes, feature negotiation, reset
+     * and vmstate load write it.  All of them run under the BQL, and so
+     * must the RX path: a queue pair cannot be moved to an IOThread until
+     * every one of these writers takes a lock that the RX path shares.
+     */
     uint8_t promisc;
     uint8_t allmulti;
     uint8_t alluni;
@@ -215,6 +243,7 @@ struct VirtIONet {
     AnnounceTimer announce_timer;
     bool needs_vnet_hdr_swap;
     bool mtu_bypass_backend;
+    bool rss_flow_balance;
     /* primary failover device is hidden*/
     bool failover_primary_hidden;
     bool failover;
@@ -32,6 +32,10 @@ struct VirtIOPMEM {
     VirtQueue *rq_vq;
     uint64_t start;
     HostMemoryBackend *memdev;
+
+    /* Requests waiting for the fsync() after the one in flight */
+    QSIMPLEQ_HEAD(, VirtIODeviceRequest) flush_pending;
+    bool flush_in_flight;
 };
 
 struct VirtIOPMEMClass {
@@ -80,6 +80,14 @@ struct VirtIOSerialPortClass {
      */
     ssize_t (*have_data)(VirtIOSerialPort *port, const uint8_t *buf,
                          ssize_t len);
+
+    /*
+     * Optional: like have_data, but for data spread over several
+     * buffers, possibly of several queued elements, so that the app
+     * can write it in bulk.  Used instead of have_data when set.
+     */
+    ssize_t (*have_data_iov)(VirtIOSerialPort *port, const struct iovec *iov,
+                             int iovcnt);
 };
 
 /*
@@ -61,6 +61,9 @@ typedef struct VirtQueue VirtQueue;
 
 #define VIRTQUEUE_MAX_SIZE 1024
 
+/* Number of elements devices pop at once with virtqueue_pop_batch() */
+#define VIRTQUEUE_POP_BATCH 32
+
 typedef struct VirtQueueElement
 {
     unsigned int index;
@@ -72,6 +75,8 @@ typedef struct VirtQueueElement
     hwaddr *out_addr;
     struct iovec *in_sg;
     struct iovec *out_sg;
+    /* Element pool size class, 0 if allocated directly from the heap */
+    unsigned int pool_class;
 } VirtQueueElement;
 
 #define VIRTIO_QUEUE_MAX 1024
@@ -147,6 +152,13 @@ struct VirtIODevice
     bool start_on_kick; /* when virtio 1.0 feature has not been negotiated */
     bool disable_legacy_check;
     bool vhost_started;
+    /*
+     * Interrupt moderation: hold back used buffer notifications of each
+     * queue for up to @irq_coalesce_usecs, or until @irq_coalesce_frames of
+     * them are pending. 0 disables either limit.
+     */
+    uint32_t irq_coalesce_usecs;
+    uint32_t irq_coalesce_frames;
     VMChangeStateEntry *vmstate;
     char *bus_name;
     uint8_t device_endian;
@@ -264,6 +276,39 @@ void virtqueue_fill(VirtQueue *vq, const VirtQueueElement *elem,
 
 void virtqueue_map(VirtIODevice *vdev, VirtQueueElement *elem);
 void *virtqueue_pop(VirtQueue *vq, size_t sz);
+/**
+ * virtio_queue_enable_element_pool:
+ * @vq: The #VirtQueue
+ *
+ * Let virtqueue_element_free() keep freed elements of @vq for reuse by
+ * later pops instead of returning them to the heap.  Elements of a queue
+ * must only be freed in the thread that pops them.
+ */
+void virtio_queue_enable_element_pool(VirtQueue *vq);
+/**
+ * virtqueue_element_free:
+ * @vq: The #VirtQueue the element was popped from
+ * @elem: The element, or NULL
+ *
+ * Free an element returned by virtqueue_pop() or virtqueue_pop_batch().
+ * Calling g_free() directly instead is still allowed but bypasses the pool.
+ */
+void virtqueue_element_free(VirtQueue *vq, VirtQueueElement *elem);
+/**
+ * virtqueue_pop_batch:
+ * @vq: The #VirtQueue
+ * @sz: The size of each element, as for virtqueue_pop()
+ * @elems: Array that receives the popped elements
+ * @max: Maximum number of elements to pop
+ *
+ * Pop up to @max available elements at once.  For split virtqueues this
+ * reads the avail index, looks up the vring region caches and updates the
+ * avail event only once for the whole batch.
+ *
+ * Returns: the number of elements stored in @elems
+ */
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max);
 unsigned int virtqueue_drop_all(VirtQueue *vq);
 void *qemu_get_virtqueue_element(VirtIODevice *vdev, QEMUFile *f, size_t sz);
 void qemu_put_virtqueue_element(VirtIODevice *vdev, QEMUFile *f,
@@ -275,6 +320,7 @@ void virtqueue_get_avail_bytes(VirtQueue *vq, unsigned int *in_bytes,
                                unsigned max_in_bytes, unsigned max_out_bytes);
 
 void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq);
+bool virtio_queue_should_notify(VirtIODevice *vdev, VirtQueue *vq);
 void virtio_notify(VirtIODevice *vdev, VirtQueue *vq);
 
 int virtio_save(VirtIODevice *vdev, QEMUFile *f);
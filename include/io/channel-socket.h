@@ -261,5 +261,26 @@ QIOChannelSocket *
 qio_channel_socket_accept(QIOChannelSocket *ioc,
                           Error **errp);
 
+/**
+ * qio_channel_socket_zero_copy_poll:
+ * @sioc: the socket channel object
+ * @copied: set to true if the kernel had to copy the data of any
+ *          of the writes that completed during this call
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Collect the completion notifications of zero copy writes that are
+ * already available, without waiting for more.  Unlike
+ * qio_channel_flush(), this can be called from a coroutine.  The
+ * memory passed to a zero copy write may be reused once the returned
+ * count reaches the value that @sioc->zero_copy_queued had right after
+ * that write.
+ *
+ * Returns: the number of zero copy writes on @sioc that have
+ * completed so far, or -1 on error
+ */
+ssize_t qio_channel_socket_zero_copy_poll(QIOChannelSocket *sioc,
+                                          bool *copied,
+                                          Error **errp);
+
 
 #endif /* QIO_CHANNEL_SOCKET_H */
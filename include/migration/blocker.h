@@ -65,6 +65,9 @@ void migrate_del_blocker(Error **reasonp);
 /**
  * @migrate_add_blocker_normal - prevent normal migration mode from proceeding
  *
+ * This also blocks the cpr-transfer mode, which migrates all device state
+ * and any RAM that is not shared like normal mode does.
+ *
  * @reasonp - address of an error to be returned whenever migration is attempted
  *
  * @errp - [out] The reason (if any) we cannot block migration right now.
@@ -198,6 +198,15 @@ struct VMStateDescription {
      * a QEMU_VM_SECTION_START section.
      */
     bool early_setup;
+    /*
+     * The state described by this VMSD can be saved at switchover by a
+     * worker thread, concurrently with other such VMSDs of the same
+     * priority.  The thread doesn't hold the BQL (the migration thread
+     * holds it on its behalf), so pre_save/post_save and the field
+     * marshalling must only touch state private to the device.  The order
+     * of sections in the stream is unchanged.
+     */
+    bool parallel_save;
     int version_id;
     int minimum_version_id;
     MigrationPriority priority;
@@ -1203,6 +1212,8 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
                          int version_id, Error **errp);
 
 bool vmstate_section_needed(const VMStateDescription *vmsd, void *opaque);
+uint64_t vmstate_save_size_estimate(const VMStateDescription *vmsd,
+                                    void *opaque, int version_id);
 
 #define  VMSTATE_INSTANCE_ID_ANY  -1
 
@@ -12,6 +12,7 @@
 #include "qapi/qapi-types-net.h"
 #include "qemu/queue.h"
 #include "qom/object.h"
+#include "net/net.h"
 #include "net/queue.h"
 
 #define TYPE_NETFILTER "netfilter"
@@ -31,6 +32,19 @@ typedef ssize_t (FilterReceiveIOV)(NetFilterState *nc,
                                    int iovcnt,
                                    NetPacketSent *sent_cb);
 
+/*
+ * Batched variant of FilterReceiveIOV, for filters that either let all
+ * packets through or steal all of them.
+ * Return:
+ *   0: finished handling the packets, we should continue
+ *   count: filter stolen all packets, we stop pass them further
+ */
+typedef int (FilterReceiveBatch)(NetFilterState *nf,
+                                 NetClientState *sender,
+                                 unsigned flags,
+                                 const NetPacketIOV *pkts,
+                                 int count);
+
 typedef void (FilterStatusChanged) (NetFilterState *nf, Error **errp);
 
 typedef void (FilterHandleEvent) (NetFilterState *nf, int event, Error **errp);
@@ -43,6 +57,7 @@ struct NetFilterClass {
     FilterCleanup *cleanup;
     FilterStatusChanged *status_changed;
     FilterHandleEvent *handle_event;
+    FilterReceiveBatch *receive_batch;
     /* mandatory */
     FilterReceiveIOV *receive_iov;
 };
@@ -70,6 +85,16 @@ ssize_t qemu_netfilter_receive(NetFilterState *nf,
                                int iovcnt,
                                NetPacketSent *sent_cb);
 
+bool qemu_netfilter_can_batch(NetFilterState *nf,
+                              NetFilterDirection direction);
+
+int qemu_netfilter_receive_batch(NetFilterState *nf,
+                                 NetFilterDirection direction,
+                                 NetClientState *sender,
+                                 unsigned flags,
+                                 const NetPacketIOV *pkts,
+                                 int count);
+
 /* pass the packet to the next filter */
 ssize_t qemu_netfilter_pass_to_next(NetClientState *sender,
                                     unsigned flags,
@@ -49,6 +49,14 @@ typedef int (NetLoad)(NetClientState *);
 typedef void (NetStop)(NetClientState *);
 typedef ssize_t (NetReceive)(NetClientState *, const uint8_t *, size_t);
 typedef ssize_t (NetReceiveIOV)(NetClientState *, const struct iovec *, int);
+
+/* One packet of a batch passed to qemu_sendv_packet_batch() */
+typedef struct NetPacketIOV {
+    const struct iovec *iov;
+    int iovcnt;
+} NetPacketIOV;
+
+typedef int (NetReceiveBatch)(NetClientState *, const NetPacketIOV *, int);
 typedef void (NetCleanup) (NetClientState *);
 typedef void (LinkStatusChanged)(NetClientState *);
 typedef void (NetClientDestructor)(NetClientState *);
@@ -76,6 +84,12 @@ typedef struct NetClientInfo {
     NetReceive *receive;
     NetReceive *receive_raw;
     NetReceiveIOV *receive_iov;
+    /*
+     * Transmit several packets at once.  Returns the number of packets
+     * that were sent or dropped; the rest are given to the regular
+     * receive path, which takes care of queueing them.
+     */
+    NetReceiveBatch *receive_batch;
     NetCanReceive *can_receive;
     NetStart *start;
     NetLoad *load;
@@ -176,6 +190,8 @@ ssize_t qemu_sendv_packet(NetClientState *nc, const struct iovec *iov,
                           int iovcnt);
 ssize_t qemu_sendv_packet_async(NetClientState *nc, const struct iovec *iov,
                                 int iovcnt, NetPacketSent *sent_cb);
+int qemu_sendv_packet_batch(NetClientState *nc, const NetPacketIOV *pkts,
+                            int count, NetPacketSent *sent_cb);
 ssize_t qemu_send_packet(NetClientState *nc, const uint8_t *buf, int size);
 ssize_t qemu_receive_packet(NetClientState *nc, const uint8_t *buf, int size);
 ssize_t qemu_receive_packet_iov(NetClientState *nc,
@@ -14,7 +14,12 @@
 #ifndef JSON_WRITER_H
 #define JSON_WRITER_H
 
+typedef void JSONWriterFlushFunc(void *opaque, const char *buf, size_t len);
+
 JSONWriter *json_writer_new(bool pretty);
+JSONWriter *json_writer_new_stream(bool pretty, JSONWriterFlushFunc *flush,
+                                   void *opaque);
+void json_writer_flush(JSONWriter *);
 const char *json_writer_get(JSONWriter *);
 GString *json_writer_get_and_free(JSONWriter *);
 void json_writer_free(JSONWriter *);
@@ -31,5 +36,6 @@ void json_writer_int64(JSONWriter *, const char *name, int64_t val);
 void json_writer_uint64(JSONWriter *, const char *name, uint64_t val);
 void json_writer_double(JSONWriter *, const char *name, double val);
 void json_writer_str(JSONWriter *, const char *name, const char *str);
+void json_writer_raw(JSONWriter *, const char *name, const char *json);
 
 #endif
@@ -14,6 +14,8 @@
 #ifndef QJSON_H
 #define QJSON_H
 
+#include "qapi/qmp/json-writer.h"
+
 QObject *qobject_from_json(const char *string, Error **errp);
 
 QObject *qobject_from_vjsonf_nofail(const char *string, va_list ap)
@@ -27,5 +29,7 @@ QDict *qdict_from_jsonf_nofail(const char *string, ...)
 
 GString *qobject_to_json(const QObject *obj);
 GString *qobject_to_json_pretty(const QObject *obj, bool pretty);
+void qobject_to_json_stream(const QObject *obj, bool pretty,
+                            JSONWriterFlushFunc *flush, void *opaque);
 
 #endif /* QJSON_H */
@@ -48,6 +48,8 @@ struct Coroutine {
 
     /* Only used when the coroutine has terminated.  */
     QSLIST_ENTRY(Coroutine) pool_next;
+    /* Release pool this coroutine goes back to, see qemu-coroutine.c */
+    unsigned int pool_node;
 
     size_t locks_held;
 
@@ -187,9 +187,35 @@ char *freq_to_str(uint64_t freq_hz);
 /* used to print char* safely */
 #define STR_OR_NULL(str) ((str) ? (str) : "null")
 
-bool buffer_is_zero(const void *buf, size_t len);
+bool buffer_is_zero_ool(const void *buf, size_t len);
 bool test_buffer_is_zero_next_accel(void);
 
+/*
+ * Checks if a buffer is all zeroes
+ */
+static inline bool buffer_is_zero(const void *vbuf, size_t len)
+{
+    const unsigned char *buf = vbuf;
+
+    if (len == 0) {
+        return true;
+    }
+
+    /*
+     * Most buffers that are not zero, such as guest pages being migrated,
+     * have a nonzero byte at the start, middle or end.  Catch those
+     * inline, without the cost of a call into the accelerated code.
+     */
+    if (buf[0] || buf[len - 1] || buf[len / 2]) {
+        return false;
+    }
+    /* All bytes are covered for any len <= 3.  */
+    if (len <= 3) {
+        return true;
+    }
+    return buffer_is_zero_ool(vbuf, len);
+}
+
 /*
  * Implementation of ULEB128 (http://en.wikipedia.org/wiki/LEB128)
  * Input is limited to 14-bit numbers
@@ -74,9 +74,40 @@ enum plugin_dyn_cb_type {
 enum plugin_dyn_cb_subtype {
     PLUGIN_CB_REGULAR,
     PLUGIN_CB_INLINE,
+    PLUGIN_CB_COND,
+    PLUGIN_CB_BATCH,
     PLUGIN_N_CB_SUBTYPES,
 };
 
+/*
+ * A scoreboard holds one entry per vCPU. @data is resized when a vCPU
+ * with a higher index is created; see plugin_grow_scoreboards__locked.
+ */
+struct qemu_plugin_scoreboard {
+    GArray *data;
+    QLIST_ENTRY(qemu_plugin_scoreboard) entry;
+};
+
+/*
+ * Per-vCPU ring of a memory access batch. Generated code appends at
+ * @seq; @flushed is how far the plugin has been handed the records.
+ */
+struct qemu_plugin_mem_ring {
+    uint64_t seq;
+    uint64_t flushed;
+    qemu_plugin_mem_record records[];
+};
+
+struct qemu_plugin_mem_batch {
+    /* one struct qemu_plugin_mem_ring per vCPU */
+    struct qemu_plugin_scoreboard *rings;
+    /* capacity of each ring, a power of 2 */
+    size_t n_records;
+    qemu_plugin_vcpu_mem_batch_cb_t cb;
+    void *userdata;
+    QLIST_ENTRY(qemu_plugin_mem_batch) entry;
+};
+
 /*
  * A dynamic callback has an insertion point that is determined at run-time.
  * Usually the insertion point is somewhere in the code cache; think for
@@ -91,12 +122,40 @@ struct qemu_plugin_dyn_cb {
     /* fields specific to each dyn_cb type go here */
     union {
         struct {
+            qemu_plugin_u64 entry;
             enum qemu_plugin_op op;
             uint64_t imm;
         } inline_insn;
+        struct {
+            qemu_plugin_u64 entry;
+            enum qemu_plugin_cond cond;
+            uint64_t imm;
+        } cond;
+        struct {
+            struct qemu_plugin_mem_batch *batch;
+            uint64_t pc;
+        } mem_batch;
     };
 };
 
+/*
+ * Inline ops and conditional callbacks act on one uint64_t per vCPU,
+ * found at base + cpu_index * stride. Ops registered with a plain
+ * pointer have no scoreboard and use @userp with a stride of 0.
+ */
+static inline void *plugin_u64_base(const qemu_plugin_u64 *entry, void *userp)
+{
+    if (entry->score) {
+        return entry->score->data->data + entry->offset;
+    }
+    return userp;
+}
+
+static inline size_t plugin_u64_stride(const qemu_plugin_u64 *entry)
+{
+    return entry->score ? g_array_get_element_size(entry->score->data) : 0;
+}
+
 /* Internal context for instrumenting an instruction */
 struct qemu_plugin_insn {
     GByteArray *data;
@@ -199,6 +258,9 @@ void qemu_plugin_vcpu_syscall_ret(CPUState *cpu, int64_t num, int64_t ret);
 void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                              MemOpIdx oi, enum qemu_plugin_mem_rw rw);
 
+void qemu_plugin_mem_batch_flush_vcpu(struct qemu_plugin_mem_batch *batch,
+                                      unsigned int cpu_index);
+
 void qemu_plugin_flush_cb(void);
 
 void qemu_plugin_atexit_cb(void);
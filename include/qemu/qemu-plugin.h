@@ -54,7 +54,7 @@ typedef uint64_t qemu_plugin_id_t;
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 1
+#define QEMU_PLUGIN_VERSION 2
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -293,6 +293,44 @@ enum qemu_plugin_op {
     QEMU_PLUGIN_INLINE_ADD_U64,
 };
 
+/**
+ * struct qemu_plugin_scoreboard - Opaque handle for a scoreboard
+ *
+ * A scoreboard is an array of plugin defined entries, one per vCPU,
+ * which inline ops can index by the vcpu_index of the executing vCPU.
+ */
+struct qemu_plugin_scoreboard;
+
+/**
+ * typedef qemu_plugin_u64 - uint64_t member of a scoreboard entry
+ * @score: the scoreboard
+ * @offset: offset of the member within each entry
+ *
+ * Names the same uint64_t in the entry of every vCPU. Per-vCPU inline
+ * ops and conditional callbacks take one of these as their target.
+ */
+typedef struct {
+    struct qemu_plugin_scoreboard *score;
+    size_t offset;
+} qemu_plugin_u64;
+
+/**
+ * enum qemu_plugin_cond - condition for a conditional callback
+ *
+ * Comparisons are unsigned and are made between the counter (on the
+ * left) and the immediate given at registration (on the right).
+ */
+enum qemu_plugin_cond {
+    QEMU_PLUGIN_COND_NEVER,
+    QEMU_PLUGIN_COND_ALWAYS,
+    QEMU_PLUGIN_COND_EQ,
+    QEMU_PLUGIN_COND_NE,
+    QEMU_PLUGIN_COND_LT,
+    QEMU_PLUGIN_COND_LE,
+    QEMU_PLUGIN_COND_GT,
+    QEMU_PLUGIN_COND_GE,
+};
+
 /**
  * qemu_plugin_register_vcpu_tb_exec_inline() - execution inline op
  * @tb: the opaque qemu_plugin_tb handle for the translation
@@ -312,6 +350,48 @@ void qemu_plugin_register_vcpu_tb_exec_inline(struct qemu_plugin_tb *tb,
                                               enum qemu_plugin_op op,
                                               void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu() - per-vCPU inline op
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: entry of a scoreboard to run @op on
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_tb_exec_inline(), but the op applies
+ * to the @entry of the vCPU executing the translated unit, so results
+ * are exact even when several vCPUs run concurrently.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_tb_exec_inline_per_vcpu(
+    struct qemu_plugin_tb *tb,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
+/**
+ * qemu_plugin_register_vcpu_tb_exec_cond_cb() - conditional execution cb
+ * @tb: the opaque qemu_plugin_tb handle for the translation
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition to check before calling @cb
+ * @entry: scoreboard entry compared against @imm
+ * @imm: the value @entry is compared with
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * The @cb function is called when a translated unit executes and the
+ * executing vCPU's @entry satisfies @cond with respect to @imm. The
+ * comparison is generated inline so the call is skipped cheaply
+ * otherwise.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_tb_exec_cond_cb(struct qemu_plugin_tb *tb,
+                                               qemu_plugin_vcpu_udata_cb_t cb,
+                                               enum qemu_plugin_cb_flags flags,
+                                               enum qemu_plugin_cond cond,
+                                               qemu_plugin_u64 entry,
+                                               uint64_t imm,
+                                               void *userdata);
+
 /**
  * qemu_plugin_register_vcpu_insn_exec_cb() - register insn execution cb
  * @insn: the opaque qemu_plugin_insn handle for an instruction
@@ -342,6 +422,46 @@ void qemu_plugin_register_vcpu_insn_exec_inline(struct qemu_plugin_insn *insn,
                                                 enum qemu_plugin_op op,
                                                 void *ptr, uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu() - per-vCPU inline op
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @op: the type of qemu_plugin_op (e.g. ADD_U64)
+ * @entry: entry of a scoreboard to run @op on
+ * @imm: the op data (e.g. 1)
+ *
+ * Like qemu_plugin_register_vcpu_insn_exec_inline(), but the op applies
+ * to the @entry of the vCPU executing the instruction.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_insn_exec_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
+
+/**
+ * qemu_plugin_register_vcpu_insn_exec_cond_cb() - conditional insn cb
+ * @insn: the opaque qemu_plugin_insn handle for an instruction
+ * @cb: callback function
+ * @flags: does the plugin read or write the CPU's registers?
+ * @cond: condition to check before calling @cb
+ * @entry: scoreboard entry compared against @imm
+ * @imm: the value @entry is compared with
+ * @userdata: any plugin data to pass to the @cb?
+ *
+ * The @cb function is called when the instruction executes and the
+ * executing vCPU's @entry satisfies @cond with respect to @imm.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_insn_exec_cond_cb(
+    struct qemu_plugin_insn *insn,
+    qemu_plugin_vcpu_udata_cb_t cb,
+    enum qemu_plugin_cb_flags flags,
+    enum qemu_plugin_cond cond,
+    qemu_plugin_u64 entry,
+    uint64_t imm,
+    void *userdata);
+
 /**
  * qemu_plugin_tb_n_insns() - query helper for number of insns in TB
  * @tb: opaque handle to TB passed to callback
@@ -567,7 +687,114 @@ void qemu_plugin_register_vcpu_mem_inline(struct qemu_plugin_insn *insn,
                                           enum qemu_plugin_op op, void *ptr,
                                           uint64_t imm);
 
+/**
+ * qemu_plugin_register_vcpu_mem_inline_per_vcpu() - per-vCPU memory inline op
+ * @insn: handle for instruction to instrument
+ * @rw: apply to reads, writes or both
+ * @op: the op, of type qemu_plugin_op
+ * @entry: entry of a scoreboard to run @op on
+ * @imm: immediate data for @op
+ *
+ * Like qemu_plugin_register_vcpu_mem_inline(), but the op applies to
+ * the @entry of the vCPU performing the access, which makes it safe
+ * to use for exact counts under MTTCG.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
+    struct qemu_plugin_insn *insn,
+    enum qemu_plugin_mem_rw rw,
+    enum qemu_plugin_op op,
+    qemu_plugin_u64 entry,
+    uint64_t imm);
 
+/**
+ * typedef qemu_plugin_mem_record - one memory access of a batch
+ * @vaddr: virtual address of the access
+ * @pc: virtual address of the instruction that made the access
+ * @info: meminfo handle, see qemu_plugin_mem_size_shift() and friends
+ */
+typedef struct {
+    uint64_t vaddr;
+    uint64_t pc;
+    qemu_plugin_meminfo_t info;
+} qemu_plugin_mem_record;
+
+/**
+ * typedef qemu_plugin_vcpu_mem_batch_cb_t - batched memory access callback
+ * @vcpu_index: the vCPU that made the accesses
+ * @records: the accesses, oldest first
+ * @n: number of entries in @records
+ * @lost: number of older accesses that were overwritten before they
+ *        could be delivered
+ * @userdata: the @userdata given to qemu_plugin_mem_batch_new()
+ */
+typedef void (*qemu_plugin_vcpu_mem_batch_cb_t)(
+    unsigned int vcpu_index, const qemu_plugin_mem_record *records,
+    size_t n, uint64_t lost, void *userdata);
+
+/**
+ * struct qemu_plugin_mem_batch - Opaque handle for a memory access batch
+ *
+ * A batch owns one ring buffer of qemu_plugin_mem_record per vCPU.
+ */
+struct qemu_plugin_mem_batch;
+
+/**
+ * qemu_plugin_mem_batch_new() - allocate per-vCPU memory access buffers
+ * @n_records: capacity of each vCPU's buffer, rounded up to a power of 2
+ * @cb: callback receiving the buffered accesses
+ * @userdata: any plugin data to pass to @cb
+ *
+ * Accesses recorded with qemu_plugin_register_vcpu_mem_batch() are
+ * stored by the generated code without leaving it. @cb is called at
+ * the start of an instrumented instruction once a vCPU's buffer is
+ * half full, when the vCPU exits, before atexit callbacks run and
+ * from qemu_plugin_mem_batch_flush(). A single flush may call @cb
+ * twice if the buffer wrapped around.
+ */
+QEMU_PLUGIN_API
+struct qemu_plugin_mem_batch *
+qemu_plugin_mem_batch_new(size_t n_records,
+                          qemu_plugin_vcpu_mem_batch_cb_t cb,
+                          void *userdata);
+
+/**
+ * qemu_plugin_mem_batch_free() - free a memory access batch
+ * @batch: batch to free
+ *
+ * As for scoreboards, no instrumentation recording into @batch may
+ * run anymore, e.g. free it from an atexit callback.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_batch_free(struct qemu_plugin_mem_batch *batch);
+
+/**
+ * qemu_plugin_register_vcpu_mem_batch() - record memory accesses in a batch
+ * @insn: handle for instruction to instrument
+ * @rw: record reads, writes or both
+ * @batch: batch the accesses are recorded into
+ *
+ * This is a cheaper alternative to qemu_plugin_register_vcpu_mem_cb()
+ * for plugins that can process accesses some time after they happen:
+ * the access is appended to the executing vCPU's buffer inline and the
+ * callback of @batch is only invoked for a whole buffer at a time.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_mem_batch(struct qemu_plugin_insn *insn,
+                                         enum qemu_plugin_mem_rw rw,
+                                         struct qemu_plugin_mem_batch *batch);
+
+/**
+ * qemu_plugin_mem_batch_flush() - deliver the pending accesses of a vCPU
+ * @batch: batch to flush
+ * @vcpu_index: vCPU whose buffer is flushed
+ *
+ * Must be called from the vCPU itself (e.g. from one of its callbacks)
+ * or while it is not running.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_batch_flush(struct qemu_plugin_mem_batch *batch,
+                                 unsigned int vcpu_index);
 
 typedef void
 (*qemu_plugin_vcpu_syscall_cb_t)(qemu_plugin_id_t id, unsigned int vcpu_index,
@@ -708,4 +935,77 @@ uint64_t qemu_plugin_end_code(void);
 QEMU_PLUGIN_API
 uint64_t qemu_plugin_entry_code(void);
 
+/**
+ * qemu_plugin_scoreboard_new() - alloc a new scoreboard
+ * @element_size: size (in bytes) of each vCPU's entry
+ *
+ * Returns a pointer to a new scoreboard. Entries of every vCPU,
+ * including vCPUs created later on, are zero-initialized.
+ */
+QEMU_PLUGIN_API
+struct qemu_plugin_scoreboard *qemu_plugin_scoreboard_new(size_t element_size);
+
+/**
+ * qemu_plugin_scoreboard_free() - free a scoreboard
+ * @score: scoreboard to free
+ *
+ * The scoreboard must no longer be the target of any instrumentation
+ * that can still execute, e.g. free it from an atexit callback.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_scoreboard_free(struct qemu_plugin_scoreboard *score);
+
+/**
+ * qemu_plugin_scoreboard_find() - get pointer to an entry of a scoreboard
+ * @score: scoreboard to query
+ * @vcpu_index: entry index
+ *
+ * Returns the address of the entry of vCPU @vcpu_index. The address may
+ * change when new vCPUs are created, so do not cache it.
+ */
+QEMU_PLUGIN_API
+void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
+                                  unsigned int vcpu_index);
+
+/* Macros to define a qemu_plugin_u64 */
+#define qemu_plugin_scoreboard_u64(score) \
+    (qemu_plugin_u64) {score, 0}
+#define qemu_plugin_scoreboard_u64_in_struct(score, type, member) \
+    (qemu_plugin_u64) {score, offsetof(type, member)}
+
+/**
+ * qemu_plugin_u64_add() - add a value to a qemu_plugin_u64 for a given vCPU
+ * @entry: entry to update
+ * @vcpu_index: index of the vCPU whose entry is updated
+ * @added: value to add
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_u64_add(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t added);
+
+/**
+ * qemu_plugin_u64_get() - get the value of a qemu_plugin_u64 for a given vCPU
+ * @entry: entry to read
+ * @vcpu_index: index of the vCPU whose entry is read
+ */
+QEMU_PLUGIN_API
+uint64_t qemu_plugin_u64_get(qemu_plugin_u64 entry, unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_u64_set() - set the value of a qemu_plugin_u64 for a given vCPU
+ * @entry: entry to write
+ * @vcpu_index: index of the vCPU whose entry is written
+ * @val: new value
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_u64_set(qemu_plugin_u64 entry, unsigned int vcpu_index,
+                         uint64_t val);
+
+/**
+ * qemu_plugin_u64_sum() - return the sum of a qemu_plugin_u64 over all vCPUs
+ * @entry: entry to sum
+ */
+QEMU_PLUGIN_API
+uint64_t qemu_plugin_u64_sum(qemu_plugin_u64 entry);
+
 #endif /* QEMU_QEMU_PLUGIN_H */
@@ -29,6 +29,8 @@ struct qht {
  *         chain, excluding empty chains.
  * @occupancy: frequency distribution representing chain occupancy rate.
  *             Valid range: from 0.0 (empty) to 1.0 (full occupancy).
+ * @lookup_retries: number of times a lookup had to be retried because of
+ *                  a concurrent update to its bucket chain.
  *
  * An entry is a pointer-hash pair.
  * Each bucket can host several entries.
@@ -40,6 +42,7 @@ struct qht_stats {
     size_t entries;
     struct qdist chain;
     struct qdist occupancy;
+    size_t lookup_retries;
 };
 
 typedef bool (*qht_lookup_func_t)(const void *obj, const void *userp);
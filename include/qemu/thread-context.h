@@ -47,6 +47,11 @@ struct ThreadContext {
     /* CPU affinity bitmap used for initialization. */
     unsigned long *init_cpu_bitmap;
     int init_cpu_nbits;
+
+    /* Scheduling policy (ThreadContextSchedPolicy) and priority. */
+    bool sched_set;
+    int sched_policy;
+    uint8_t sched_priority;
 };
 
 void thread_context_create_thread(ThreadContext *tc, QemuThread *thread,
@@ -0,0 +1,51 @@
+/*
+ * Per-thread event counters
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_THREAD_STATS_H
+#define QEMU_THREAD_STATS_H
+
+/*
+ * Counters for events on QEMU's hot paths.  Each thread updates its own
+ * copy of the counters, so they can stay enabled all the time without
+ * bouncing cache lines between threads; qemu_thread_stats_get() sums
+ * the copies of all threads, including those that have exited.
+ */
+typedef enum QemuThreadStat {
+    QEMU_STAT_TB_TRANSLATIONS,
+    QEMU_STAT_TB_TRANSLATE_NS,
+    QEMU_STAT_TB_UNOPTIMIZED,
+    QEMU_STAT_TB_INVALIDATIONS,
+    QEMU_STAT_TB_JMP_CACHE_MISSES,
+    QEMU_STAT_VIRTQUEUE_POPS,
+    QEMU_STAT_VIRTQUEUE_PUSHES,
+    QEMU_STAT_VIRTQUEUE_NOTIFIES,
+    QEMU_STAT_AIO_POLL_HITS,
+    QEMU_STAT_RCU_GRACE_PERIODS,
+    QEMU_STAT_BQL_ACQUISITIONS,
+    QEMU_STAT_BQL_HOLD_NS,
+    QEMU_STAT__MAX
+} QemuThreadStat;
+
+/**
+ * qemu_thread_stat_add:
+ * @stat: the counter to update
+ * @val: the amount to add to it
+ *
+ * Add @val to the calling thread's copy of @stat.
+ */
+void qemu_thread_stat_add(QemuThreadStat stat, uint64_t val);
+
+/**
+ * qemu_thread_stats_get:
+ * @vals: array of QEMU_STAT__MAX elements, filled with the totals
+ *
+ * Sum the counters of all threads.  The totals are not a consistent
+ * snapshot, since other threads keep updating their counters meanwhile.
+ */
+void qemu_thread_stats_get(uint64_t *vals);
+
+#endif
@@ -158,6 +158,11 @@ bool throttle_schedule_timer(ThrottleState *ts,
 
 void throttle_account(ThrottleState *ts, ThrottleDirection direction,
                       uint64_t size);
+void throttle_reserve(ThrottleState *ts, ThrottleDirection direction,
+                      int64_t now, int64_t slice_ns,
+                      uint32_t *ops, uint32_t *bytes);
+void throttle_unreserve(ThrottleState *ts, ThrottleDirection direction,
+                        uint32_t ops, uint32_t bytes);
 void throttle_limits_to_config(ThrottleLimits *arg, ThrottleConfig *cfg,
                                Error **errp);
 void throttle_config_to_limits(ThrottleConfig *cfg, ThrottleLimits *var);
@@ -86,7 +86,10 @@ struct QEMUTimer {
     QEMUTimerList *timer_list;
     QEMUTimerCB *cb;
     void *opaque;
-    QEMUTimer *next;
+    /* Position in the timer list's heap, valid while the timer is pending */
+    size_t heap_index;
+    /* Orders timers with the same expire_time by insertion */
+    uint64_t seq;
     int attributes;
     int scale;
 };
@@ -43,6 +43,8 @@ struct AccelOpsClass {
     void (*synchronize_pre_resume)(bool step_pending);
 
     void (*handle_interrupt)(CPUState *cpu, int mask);
+    /* called by a vCPU thread before it accesses a device */
+    void (*prepare_io)(CPUState *cpu);
 
     int64_t (*get_virtual_clock)(void);
     int64_t (*get_elapsed_ticks)(void);
@@ -31,6 +31,13 @@ extern int use_icount;
 #define icount_enabled() 0
 #endif
 
+/*
+ * Number of instructions that each vCPU executes between two
+ * synchronizations when icount is used with multi-threaded TCG,
+ * 0 if the vCPUs are run round-robin.
+ */
+extern int64_t icount_quantum;
+
 /*
  * Update the icount with the executed instructions. Called by
  * cpus-tcg vCPU thread so the main-loop can see time has moved forward.
@@ -39,6 +46,8 @@ void icount_update(CPUState *cpu);
 
 /* get raw icount value */
 int64_t icount_get_raw(void);
+/* parallel icount: move the time seen outside the vCPUs to @icount */
+void icount_set_raw(int64_t icount);
 
 /* return the virtual CPU time in ns, based on the instruction counter. */
 int64_t icount_get(void);
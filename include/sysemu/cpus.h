@@ -19,6 +19,8 @@ void dummy_start_vcpu_thread(CPUState *);
 /* For temporary buffers for forming a name */
 #define VCPU_THREAD_NAME_SIZE 16
 
+void qemu_vcpu_thread_create(CPUState *cpu, const char *name,
+                             void *(*start_routine)(void *));
 void cpus_kick_thread(CPUState *cpu);
 bool cpu_work_list_empty(CPUState *cpu);
 bool cpu_thread_is_idle(CPUState *cpu);
@@ -29,6 +31,8 @@ void qemu_wait_io_event(CPUState *cpu);
 void cpu_thread_signal_created(CPUState *cpu);
 void cpu_thread_signal_destroyed(CPUState *cpu);
 void cpu_handle_guest_debug(CPUState *cpu);
+/* Called by a vCPU thread before a device access outside translated code */
+void cpu_prepare_io(CPUState *cpu);
 
 /* end interface for cpus accelerator threads */
 
@@ -33,6 +33,9 @@ void dirtylimit_set_vcpu(int cpu_index,
                          bool enable);
 void dirtylimit_set_all(uint64_t quota,
                         bool enable);
+void dirtylimit_set_top_vcpus(int top_n,
+                              uint64_t target,
+                              uint64_t min_quota);
 void dirtylimit_vcpu_execute(CPUState *cpu);
 uint64_t dirtylimit_throttle_time_per_round(void);
 uint64_t dirtylimit_ring_full_time(void);
@@ -14,6 +14,7 @@
 
 #include "qom/object.h"
 #include "block/aio.h"
+#include "qemu/thread-context.h"
 
 #define TYPE_EVENT_LOOP_BASE         "event-loop-base"
 OBJECT_DECLARE_TYPE(EventLoopBase, EventLoopBaseClass,
@@ -36,5 +37,6 @@ struct EventLoopBase {
     /* AioContext thread pool parameters */
     int64_t thread_pool_min;
     int64_t thread_pool_max;
+    ThreadContext *thread_pool_context;
 };
 #endif
@@ -38,6 +38,10 @@ struct IOThread {
     int64_t poll_max_ns;
     int64_t poll_grow;
     int64_t poll_shrink;
+    int64_t poll_cpu_budget;
+
+    /* Context with which to create the event loop thread */
+    ThreadContext *thread_context;
 };
 typedef struct IOThread IOThread;
 
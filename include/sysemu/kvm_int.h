@@ -77,6 +77,9 @@ struct KVMState
     int coalesced_pio;
     struct kvm_coalesced_mmio_ring *coalesced_mmio_ring;
     bool coalesced_flush_in_progress;
+    /* Coalesced ring entries written, and FlatView lookups needed for them */
+    uint64_t coalesced_entries;
+    uint64_t coalesced_lookups;
     int vcpu_events;
 #ifdef KVM_CAP_SET_GUEST_DEBUG
     QTAILQ_HEAD(, kvm_sw_breakpoint) kvm_sw_breakpoints;
@@ -25,6 +25,12 @@ void add_stats_callbacks(StatsProvider provider,
                          StatRetrieveFunc *stats_fn,
                          SchemaRetrieveFunc *schemas_fn);
 
+/*
+ * Register the "qemu" provider, which reports the counters from
+ * qemu/thread-stats.h.
+ */
+void qemu_stats_init(void);
+
 /*
  * Helper routines for adding stats entries to the results lists.
  */
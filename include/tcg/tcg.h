@@ -491,6 +491,7 @@ struct TCGContext {
     uint8_t tlb_dyn_max_bits;
     uint8_t insn_start_words;
     TCGBar guest_mo;
+    bool optimize;                /* run tcg_optimize on the opcode stream */
 
     TCGRegSet reserved_regs;
     intptr_t current_frame_offset;
@@ -557,6 +558,13 @@ struct TCGContext {
        It does not take into account fixed registers */
     TCGTemp *reg_to_temp[TCG_TARGET_NB_REGS];
 
+    /* Register allocator statistics for the TB, shown with -d out_asm. */
+    struct {
+        unsigned loads;         /* temps loaded from memory */
+        unsigned stores;        /* temps synced or spilled to memory */
+        unsigned call_moves;    /* temps kept live across calls by a mov */
+    } reg_stats;
+
     uint16_t gen_insn_end_off[TCG_MAX_INSNS];
     uint64_t *gen_insn_data;
 
@@ -575,6 +583,18 @@ extern bool tcg_use_softmmu;
 #define tcg_use_softmmu  true
 #endif
 
+/*
+ * Emulate parallel compare-and-swap wider than the host supports under
+ * hashed address locks, instead of with exclusive execution.
+ */
+extern bool tcg_atomic_locks;
+
+/*
+ * Emulate the guest memory model with load-acquire and store-release
+ * instead of barriers, where the backend supports MO_ORDERED.
+ */
+extern bool tcg_acq_rel;
+
 extern __thread TCGContext *tcg_ctx;
 extern const void *tcg_code_gen_epilogue;
 extern uintptr_t tcg_splitwx_diff;
@@ -755,6 +775,7 @@ void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_reset_all(void);
+bool tcg_region_evict(void (*invalidate)(TranslationBlock *tb));
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -410,6 +410,18 @@ qio_channel_socket_accept(QIOChannelSocket *ioc,
     }
 #endif /* WIN32 */
 
+#ifdef QEMU_MSG_ZEROCOPY
+    {
+        int v = 1;
+
+        if (setsockopt(cioc->fd, SOL_SOCKET, SO_ZEROCOPY,
+                       &v, sizeof(v)) == 0) {
+            qio_channel_set_feature(QIO_CHANNEL(cioc),
+                                    QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY);
+        }
+    }
+#endif
+
     qio_channel_set_feature(QIO_CHANNEL(cioc),
                             QIO_CHANNEL_FEATURE_READ_MSG_PEEK);
 
@@ -725,79 +737,135 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
 
 
 #ifdef QEMU_MSG_ZEROCOPY
-static int qio_channel_socket_flush(QIOChannel *ioc,
-                                    Error **errp)
+/*
+ * Read one zero copy notification from the error queue of @sioc.
+ * *@copied is set if the kernel had to copy the data of the writes
+ * that it covers.
+ *
+ * Returns: 1 if a notification was read, 0 if none is available,
+ *          -1 on error
+ */
+static int qio_channel_socket_read_errqueue(QIOChannelSocket *sioc,
+                                            bool *copied,
+                                            Error **errp)
 {
-    QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
     struct msghdr msg = {};
     struct sock_extended_err *serr;
     struct cmsghdr *cm;
     char control[CMSG_SPACE(sizeof(*serr))];
     int received;
-    int ret;
-
-    if (sioc->zero_copy_queued == sioc->zero_copy_sent) {
-        return 0;
-    }
 
     msg.msg_control = control;
     msg.msg_controllen = sizeof(control);
     memset(control, 0, sizeof(control));
 
-    ret = 1;
+ retry:
+    received = recvmsg(sioc->fd, &msg, MSG_ERRQUEUE);
+    if (received < 0) {
+        switch (errno) {
+        case EAGAIN:
+            return 0;
+        case EINTR:
+            goto retry;
+        default:
+            error_setg_errno(errp, errno,
+                             "Unable to read errqueue");
+            return -1;
+        }
+    }
+
+    cm = CMSG_FIRSTHDR(&msg);
+    if (cm->cmsg_level != SOL_IP   && cm->cmsg_type != IP_RECVERR &&
+        cm->cmsg_level != SOL_IPV6 && cm->cmsg_type != IPV6_RECVERR) {
+        error_setg_errno(errp, EPROTOTYPE,
+                         "Wrong cmsg in errqueue");
+        return -1;
+    }
+
+    serr = (void *) CMSG_DATA(cm);
+    if (serr->ee_errno != SO_EE_ORIGIN_NONE) {
+        error_setg_errno(errp, serr->ee_errno,
+                         "Error on socket");
+        return -1;
+    }
+    if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+        error_setg_errno(errp, serr->ee_origin,
+                         "Error not from zero copy");
+        return -1;
+    }
+    if (serr->ee_data < serr->ee_info) {
+        error_setg_errno(errp, serr->ee_origin,
+                         "Wrong notification bounds");
+        return -1;
+    }
+
+    /* No errors, count successfully finished sendmsg()*/
+    sioc->zero_copy_sent += serr->ee_data - serr->ee_info + 1;
+    *copied = serr->ee_code == SO_EE_CODE_ZEROCOPY_COPIED;
+
+    return 1;
+}
+
+static int qio_channel_socket_flush(QIOChannel *ioc,
+                                    Error **errp)
+{
+    QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
+    bool copied;
+    int ret = 1;
+
+    if (sioc->zero_copy_queued == sioc->zero_copy_sent) {
+        return 0;
+    }
 
     while (sioc->zero_copy_sent < sioc->zero_copy_queued) {
-        received = recvmsg(sioc->fd, &msg, MSG_ERRQUEUE);
-        if (received < 0) {
-            switch (errno) {
-            case EAGAIN:
-                /* Nothing on errqueue, wait until something is available */
-                qio_channel_wait(ioc, G_IO_ERR);
-                continue;
-            case EINTR:
-                continue;
-            default:
-                error_setg_errno(errp, errno,
-                                 "Unable to read errqueue");
-                return -1;
+        switch (qio_channel_socket_read_errqueue(sioc, &copied, errp)) {
+        case 0:
+            /* Nothing on errqueue, wait until something is available */
+            qio_channel_wait(ioc, G_IO_ERR);
+            break;
+        case 1:
+            /* If any sendmsg() succeeded using zero copy, return 0 */
+            if (!copied) {
+                ret = 0;
             }
-        }
-
-        cm = CMSG_FIRSTHDR(&msg);
-        if (cm->cmsg_level != SOL_IP   && cm->cmsg_type != IP_RECVERR &&
-            cm->cmsg_level != SOL_IPV6 && cm->cmsg_type != IPV6_RECVERR) {
-            error_setg_errno(errp, EPROTOTYPE,
-                             "Wrong cmsg in errqueue");
+            break;
+        default:
             return -1;
         }
+    }
 
-        serr = (void *) CMSG_DATA(cm);
-        if (serr->ee_errno != SO_EE_ORIGIN_NONE) {
-            error_setg_errno(errp, serr->ee_errno,
-                             "Error on socket");
-            return -1;
-        }
-        if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
-            error_setg_errno(errp, serr->ee_origin,
-                             "Error not from zero copy");
-            return -1;
-        }
-        if (serr->ee_data < serr->ee_info) {
-            error_setg_errno(errp, serr->ee_origin,
-                             "Wrong notification bounds");
-            return -1;
-        }
+    return ret;
+}
 
-        /* No errors, count successfully finished sendmsg()*/
-        sioc->zero_copy_sent += serr->ee_data - serr->ee_info + 1;
+ssize_t qio_channel_socket_zero_copy_poll(QIOChannelSocket *sioc,
+                                          bool *copied,
+                                          Error **errp)
+{
+    bool one_copied;
+    int ret;
 
-        /* If any sendmsg() succeeded using zero copy, return 0 at the end */
-        if (serr->ee_code != SO_EE_CODE_ZEROCOPY_COPIED) {
-            ret = 0;
+    *copied = false;
+    while (sioc->zero_copy_sent < sioc->zero_copy_queued) {
+        ret = qio_channel_socket_read_errqueue(sioc, &one_copied, errp);
+        if (ret < 0) {
+            return -1;
+        } else if (ret == 0) {
+            break;
         }
+        *copied |= one_copied;
     }
 
-    return ret;
+    return sioc->zero_copy_sent;
+}
+
+#else /* QEMU_MSG_ZEROCOPY */
+
+ssize_t qio_channel_socket_zero_copy_poll(QIOChannelSocket *sioc,
+                                          bool *copied,
+                                          Error **errp)
+{
+    *copied = false;
+    return sioc->zero_copy_sent;
 }
 
 #endif /* QEMU_MSG_ZEROCOPY */
@@ -169,12 +169,16 @@ static void iothread_set_aio_context_params(EventLoopBase *base, Error **errp)
         return;
     }
 
+    aio_context_set_poll_cpu_budget(iothread->ctx, iothread->poll_cpu_budget);
+
     aio_context_set_aio_params(iothread->ctx,
                                iothread->parent_obj.aio_max_batch,
                                errp);
 
     aio_context_set_thread_pool_params(iothread->ctx, base->thread_pool_min,
                                        base->thread_pool_max, errp);
+    aio_context_set_thread_pool_context(iothread->ctx,
+                                        base->thread_pool_context);
 }
 
 
@@ -208,11 +212,19 @@ static void iothread_init(EventLoopBase *base, Error **errp)
         return;
     }
 
-    /* This assumes we are called from a thread with useful CPU affinity for us
-     * to inherit.
+    /*
+     * Without a thread context, this assumes we are called from a thread
+     * with useful CPU affinity for us to inherit.
      */
-    qemu_thread_create(&iothread->thread, thread_name, iothread_run,
-                       iothread, QEMU_THREAD_JOINABLE);
+    if (iothread->thread_context) {
+        thread_context_create_thread(iothread->thread_context,
+                                     &iothread->thread, thread_name,
+                                     iothread_run, iothread,
+                                     QEMU_THREAD_JOINABLE);
+    } else {
+        qemu_thread_create(&iothread->thread, thread_name, iothread_run,
+                           iothread, QEMU_THREAD_JOINABLE);
+    }
 
     /* Wait for initialization to complete */
     while (iothread->thread_id == -1) {
@@ -234,6 +246,9 @@ static IOThreadParamInfo poll_grow_info = {
 static IOThreadParamInfo poll_shrink_info = {
     "poll-shrink", offsetof(IOThread, poll_shrink),
 };
+static IOThreadParamInfo poll_cpu_budget_info = {
+    "poll-cpu-budget", offsetof(IOThread, poll_cpu_budget),
+};
 
 static void iothread_get_param(Object *obj, Visitor *v,
         const char *name, IOThreadParamInfo *info, Error **errp)
@@ -293,6 +308,40 @@ static void iothread_set_poll_param(Object *obj, Visitor *v,
     }
 }
 
+static void iothread_set_poll_cpu_budget(Object *obj, Visitor *v,
+        const char *name, void *opaque, Error **errp)
+{
+    IOThread *iothread = IOTHREAD(obj);
+    int64_t value;
+
+    if (!visit_type_int64(v, name, &value, errp)) {
+        return;
+    }
+
+    if (value < 0 || value > 100) {
+        error_setg(errp, "poll-cpu-budget value must be in range [0, 100]");
+        return;
+    }
+
+    iothread->poll_cpu_budget = value;
+
+    if (iothread->ctx) {
+        aio_context_set_poll_cpu_budget(iothread->ctx, value);
+    }
+}
+
+static void iothread_check_thread_context(const Object *obj,
+                                          const char *name,
+                                          Object *val, Error **errp)
+{
+    const IOThread *iothread = IOTHREAD(obj);
+
+    if (iothread->ctx) {
+        error_setg(errp, "cannot change thread-context of a running "
+                   "IOThread");
+    }
+}
+
 static void iothread_class_init(ObjectClass *klass, void *class_data)
 {
     EventLoopBaseClass *bc = EVENT_LOOP_BASE_CLASS(klass);
@@ -312,6 +361,15 @@ static void iothread_class_init(ObjectClass *klass, void *class_data)
                               iothread_get_poll_param,
                               iothread_set_poll_param,
                               NULL, &poll_shrink_info);
+    object_class_property_add(klass, "poll-cpu-budget", "int",
+                              iothread_get_poll_param,
+                              iothread_set_poll_cpu_budget,
+                              NULL, &poll_cpu_budget_info);
+    object_class_property_add_link(klass, "thread-context",
+        TYPE_THREAD_CONTEXT, offsetof(IOThread, thread_context),
+        iothread_check_thread_context, OBJ_PROP_LINK_STRONG);
+    object_class_property_set_description(klass, "thread-context",
+        "Context with which to create the event loop thread");
 }
 
 static const TypeInfo iothread_info = {
@@ -357,6 +415,7 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_max_ns = iothread->poll_max_ns;
     info->poll_grow = iothread->poll_grow;
     info->poll_shrink = iothread->poll_shrink;
+    info->poll_cpu_budget = iothread->poll_cpu_budget;
     info->aio_max_batch = iothread->parent_obj.aio_max_batch;
 
     QAPI_LIST_APPEND(*tail, info);
@@ -3247,6 +3247,54 @@ static bool parse_elf_properties(const ImageSource *src,
     }
 }
 
+/**
+ * elf_host_page_skew: Choose the load bias modulo the host page size.
+ * @ehdr: the ELF header, bswapped.
+ * @phdr: the program headers, bswapped.
+ * @align: the alignment required by the segments.
+ *
+ * When host pages are larger than target pages, target_mmap can only map
+ * a segment from the file if its file offset and its address agree
+ * modulo the host page size.  Otherwise it reads the segment into
+ * anonymous memory, which is neither lazy nor shared with the page cache
+ * and with other processes running the same binary.  The load bias of
+ * an ET_DYN image is ours to choose, so choose it such that the largest
+ * executable segment can be mapped.
+ *
+ * Return the offset of the load bias from a host page boundary, or 0 if
+ * there is nothing to adjust.
+ */
+static abi_ulong elf_host_page_skew(const struct elfhdr *ehdr,
+                                    const struct elf_phdr *phdr,
+                                    abi_ulong align)
+{
+    const struct elf_phdr *text = NULL;
+    abi_ulong skew;
+    int i;
+
+    if (ehdr->e_type != ET_DYN || qemu_host_page_size <= TARGET_PAGE_SIZE) {
+        return 0;
+    }
+
+    for (i = 0; i < ehdr->e_phnum; i++) {
+        if (phdr[i].p_type == PT_LOAD && (phdr[i].p_flags & PF_X) &&
+            phdr[i].p_filesz &&
+            (!text || phdr[i].p_filesz > text->p_filesz)) {
+            text = &phdr[i];
+        }
+    }
+    if (!text) {
+        return 0;
+    }
+
+    /* The bias must stay a multiple of the segment alignment. */
+    skew = (text->p_offset - text->p_vaddr) & ~qemu_host_page_mask;
+    if (align && (skew & (align - 1))) {
+        return 0;
+    }
+    return skew;
+}
+
 /**
  * load_elf_image: Load an ELF image into the address space.
  * @image_name: the filename of the image, to use in error messages.
@@ -3263,7 +3311,7 @@ static void load_elf_image(const char *image_name, const ImageSource *src,
                            char **pinterp_name)
 {
     g_autofree struct elf_phdr *phdr = NULL;
-    abi_ulong load_addr, load_bias, loaddr, hiaddr, error;
+    abi_ulong load_addr, load_bias, loaddr, hiaddr, error, skew;
     int i, prot_exec;
     Error *err = NULL;
 
@@ -3400,14 +3448,23 @@ static void load_elf_image(const char *image_name, const ImageSource *src,
      *
      * In both cases, we will overwrite pages in this range with mappings
      * from the executable.
+     *
+     * If the load bias is to be moved off a host page boundary, reserve
+     * an extra host page for it.
      */
-    load_addr = target_mmap(load_addr, (size_t)hiaddr - loaddr + 1, PROT_NONE,
+    skew = elf_host_page_skew(ehdr, phdr, pow2ceil(info->alignment));
+    load_addr = target_mmap(load_addr, (size_t)hiaddr - loaddr + 1 +
+                            (skew ? qemu_host_page_size : 0), PROT_NONE,
                             MAP_PRIVATE | MAP_ANON | MAP_NORESERVE |
                             (ehdr->e_type == ET_EXEC ? MAP_FIXED_NOREPLACE : 0),
                             -1, 0);
     if (load_addr == -1) {
         goto exit_mmap;
     }
+    if (skew) {
+        load_addr += (skew - ((load_addr - loaddr) & ~qemu_host_page_mask))
+                     & ~qemu_host_page_mask;
+    }
     load_bias = load_addr - loaddr;
 
     if (elf_is_fdpic(ehdr)) {
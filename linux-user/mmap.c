@@ -30,13 +30,21 @@
 #include "target/arm/cpu-features.h"
 #endif
 
-static pthread_mutex_t mmap_mutex = PTHREAD_MUTEX_INITIALIZER;
+/*
+ * Changes to the guest address space take mmap_lock exclusively, while
+ * threads that only need lookups to stay valid take it shared.  Both are
+ * recursive; the shared lock may be taken while already holding the
+ * exclusive one, but it cannot be upgraded.
+ */
+static pthread_rwlock_t mmap_rwlock = PTHREAD_RWLOCK_INITIALIZER;
 static __thread int mmap_lock_count;
+static __thread int mmap_read_lock_count;
 
 void mmap_lock(void)
 {
     if (mmap_lock_count++ == 0) {
-        pthread_mutex_lock(&mmap_mutex);
+        assert(mmap_read_lock_count == 0);
+        pthread_rwlock_wrlock(&mmap_rwlock);
     }
 }
 
@@ -44,7 +52,37 @@ void mmap_unlock(void)
 {
     assert(mmap_lock_count > 0);
     if (--mmap_lock_count == 0) {
-        pthread_mutex_unlock(&mmap_mutex);
+        /* Shared levels taken inside must not outlive the rwlock. */
+        assert(mmap_read_lock_count == 0);
+        pthread_rwlock_unlock(&mmap_rwlock);
+    }
+}
+
+void mmap_read_lock(void)
+{
+    if (mmap_read_lock_count++ == 0 && mmap_lock_count == 0) {
+        pthread_rwlock_rdlock(&mmap_rwlock);
+    }
+}
+
+void mmap_read_unlock(void)
+{
+    assert(mmap_read_lock_count > 0);
+    if (--mmap_read_lock_count == 0 && mmap_lock_count == 0) {
+        pthread_rwlock_unlock(&mmap_rwlock);
+    }
+}
+
+/*
+ * Release mmap_lock however deeply it is nested, shared or exclusive:
+ * the thread holds the rwlock itself only once.
+ */
+void mmap_unlock_all(void)
+{
+    if (mmap_lock_count || mmap_read_lock_count) {
+        mmap_lock_count = 0;
+        mmap_read_lock_count = 0;
+        pthread_rwlock_unlock(&mmap_rwlock);
     }
 }
 
@@ -53,20 +91,25 @@ bool have_mmap_lock(void)
     return mmap_lock_count > 0 ? true : false;
 }
 
+bool have_mmap_read_lock(void)
+{
+    return mmap_lock_count > 0 || mmap_read_lock_count > 0;
+}
+
 /* Grab lock to make sure things are in a consistent state after fork().  */
 void mmap_fork_start(void)
 {
-    if (mmap_lock_count)
+    if (mmap_lock_count || mmap_read_lock_count)
         abort();
-    pthread_mutex_lock(&mmap_mutex);
+    pthread_rwlock_wrlock(&mmap_rwlock);
 }
 
 void mmap_fork_end(int child)
 {
     if (child) {
-        pthread_mutex_init(&mmap_mutex, NULL);
+        pthread_rwlock_init(&mmap_rwlock, NULL);
     } else {
-        pthread_mutex_unlock(&mmap_mutex);
+        pthread_rwlock_unlock(&mmap_rwlock);
     }
 }
 
@@ -198,11 +241,11 @@ int target_mprotect(abi_ulong start, abi_ulong len, int target_prot)
     if (host_last - host_start < qemu_host_page_size) {
         /* Single host page contains all guest pages: sum the prot. */
         prot1 = target_prot;
-        for (abi_ulong a = host_start; a < start; a += TARGET_PAGE_SIZE) {
-            prot1 |= page_get_flags(a);
+        if (host_start < start) {
+            prot1 |= page_get_flags_range(host_start, start - 1);
         }
-        for (abi_ulong a = last; a < host_last; a += TARGET_PAGE_SIZE) {
-            prot1 |= page_get_flags(a + 1);
+        if (last < host_last) {
+            prot1 |= page_get_flags_range(last + 1, host_last);
         }
         starts[nranges] = host_start;
         lens[nranges] = qemu_host_page_size;
@@ -211,10 +254,7 @@ int target_mprotect(abi_ulong start, abi_ulong len, int target_prot)
     } else {
         if (host_start < start) {
             /* Host page contains more than one guest page: sum the prot. */
-            prot1 = target_prot;
-            for (abi_ulong a = host_start; a < start; a += TARGET_PAGE_SIZE) {
-                prot1 |= page_get_flags(a);
-            }
+            prot1 = target_prot | page_get_flags_range(host_start, start - 1);
             /* If the resulting sum differs, create a new range. */
             if (prot1 != target_prot) {
                 starts[nranges] = host_start;
@@ -227,10 +267,7 @@ int target_mprotect(abi_ulong start, abi_ulong len, int target_prot)
 
         if (last < host_last) {
             /* Host page contains more than one guest page: sum the prot. */
-            prot1 = target_prot;
-            for (abi_ulong a = last; a < host_last; a += TARGET_PAGE_SIZE) {
-                prot1 |= page_get_flags(a + 1);
-            }
+            prot1 = target_prot | page_get_flags_range(last + 1, host_last);
             /* If the resulting sum differs, create a new range. */
             if (prot1 != target_prot) {
                 host_last -= qemu_host_page_size;
@@ -291,11 +328,11 @@ static bool mmap_frag(abi_ulong real_start, abi_ulong start, abi_ulong last,
 
     /* Get the protection of the target pages outside the mapping. */
     prot_old = 0;
-    for (abi_ulong a = real_start; a < start; a += TARGET_PAGE_SIZE) {
-        prot_old |= page_get_flags(a);
+    if (real_start < start) {
+        prot_old |= page_get_flags_range(real_start, start - 1);
     }
-    for (abi_ulong a = real_last; a > last; a -= TARGET_PAGE_SIZE) {
-        prot_old |= page_get_flags(a);
+    if (last < real_last) {
+        prot_old |= page_get_flags_range(last + 1, real_last);
     }
 
     if (prot_old == 0) {
@@ -788,7 +825,6 @@ static int mmap_reserve_or_unmap(abi_ulong start, abi_ulong len)
     abi_ulong real_last;
     abi_ulong real_len;
     abi_ulong last;
-    abi_ulong a;
     void *host_start;
     int prot;
 
@@ -804,27 +840,23 @@ static int mmap_reserve_or_unmap(abi_ulong start, abi_ulong len)
      */
     if (real_last - real_start < qemu_host_page_size) {
         prot = 0;
-        for (a = real_start; a < start; a += TARGET_PAGE_SIZE) {
-            prot |= page_get_flags(a);
+        if (real_start < start) {
+            prot |= page_get_flags_range(real_start, start - 1);
         }
-        for (a = last; a < real_last; a += TARGET_PAGE_SIZE) {
-            prot |= page_get_flags(a + 1);
+        if (last < real_last) {
+            prot |= page_get_flags_range(last + 1, real_last);
         }
         if (prot != 0) {
             return 0;
         }
     } else {
-        for (prot = 0, a = real_start; a < start; a += TARGET_PAGE_SIZE) {
-            prot |= page_get_flags(a);
-        }
-        if (prot != 0) {
+        if (real_start < start &&
+            page_get_flags_range(real_start, start - 1) != 0) {
             real_start += qemu_host_page_size;
         }
 
-        for (prot = 0, a = last; a < real_last; a += TARGET_PAGE_SIZE) {
-            prot |= page_get_flags(a + 1);
-        }
-        if (prot != 0) {
+        if (last < real_last &&
+            page_get_flags_range(last + 1, real_last) != 0) {
             real_last -= qemu_host_page_size;
         }
 
@@ -920,12 +952,8 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
     } else {
         int page_flags = 0;
         if (reserved_va && old_size < new_size) {
-            abi_ulong addr;
-            for (addr = old_addr + old_size;
-                 addr < old_addr + new_size;
-                 addr++) {
-                page_flags |= page_get_flags(addr);
-            }
+            page_flags = page_get_flags_range(old_addr + old_size,
+                                              old_addr + new_size - 1);
         }
         if (page_flags == 0) {
             host_addr = mremap(g2h_untagged(old_addr),
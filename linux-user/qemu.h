@@ -145,6 +145,9 @@ typedef struct TaskState {
     sigset_t sigsuspend_mask;
     /* Nonzero if we're leaving a sigsuspend and sigsuspend_mask is valid. */
     int in_sigsuspend;
+    /* signal_mask and its target representation, as last converted */
+    sigset_t cached_signal_mask;
+    target_sigset_t cached_target_signal_mask;
 
     /*
      * Nonzero if process_pending_signals() needs to do something (either
@@ -155,6 +158,15 @@ typedef struct TaskState {
      */
     int signal_pending;
 
+    /*
+     * Nonzero if all host signals except SIGSEGV and SIGBUS are known to
+     * be blocked, after block_signals() or host_signal_handler(), until
+     * process_pending_signals() restores the guest's mask.  It may be
+     * zero while they are blocked, but never the other way round.
+     * Also written from a signal handler.
+     */
+    int host_signals_blocked;
+
     /* This thread's sigaltstack, if it has one */
     struct target_sigaltstack sigaltstack_used;
 
@@ -35,6 +35,12 @@
 #include "tcg/tcg.h"
 
 static struct target_sigaction sigact_table[TARGET_NSIG];
+/*
+ * The host signals to block while the guest handler of each signal runs,
+ * i.e. its sa_mask plus the signal itself unless SA_NODEFER is set.
+ * Converted once in do_sigaction() rather than on every delivery.
+ */
+static sigset_t sigact_host_mask[TARGET_NSIG];
 
 static void host_signal_handler(int host_signum, siginfo_t *info,
                                 void *puc);
@@ -170,6 +176,18 @@ void target_to_host_old_sigset(sigset_t *sigset,
     target_to_host_sigset(sigset, &d);
 }
 
+/* Convert the guest's signal mask, reusing the last result if unchanged */
+static void signal_mask_to_target(TaskState *ts, target_sigset_t *d)
+{
+    if (memcmp(&ts->cached_signal_mask, &ts->signal_mask,
+               sizeof(sigset_t))) {
+        ts->cached_signal_mask = ts->signal_mask;
+        host_to_target_sigset_internal(&ts->cached_target_signal_mask,
+                                       &ts->signal_mask);
+    }
+    *d = ts->cached_target_signal_mask;
+}
+
 int block_signals(void)
 {
     TaskState *ts = (TaskState *)thread_cpu->opaque;
@@ -181,6 +199,7 @@ int block_signals(void)
      */
     sigfillset(&set);
     sigprocmask(SIG_SETMASK, &set, 0);
+    qatomic_set(&ts->host_signals_blocked, 1);
 
     return qatomic_xchg(&ts->signal_pending, 1);
 }
@@ -569,6 +588,19 @@ static void signal_table_init(void)
     trace_signal_table_init(count);
 }
 
+static void sigact_update_host_mask(int sig)
+{
+    struct target_sigaction *sa = &sigact_table[sig - 1];
+    sigset_t *set = &sigact_host_mask[sig - 1];
+
+    target_to_host_sigset(set, &sa->sa_mask);
+    /* SA_NODEFER indicates that the current signal should not be
+       blocked during the handler */
+    if (!(sa->sa_flags & TARGET_SA_NODEFER)) {
+        sigaddset(set, target_to_host_signal(sig));
+    }
+}
+
 void signal_init(void)
 {
     TaskState *ts = (TaskState *)thread_cpu->opaque;
@@ -596,6 +628,7 @@ void signal_init(void)
         int hsig = target_to_host_signal(tsig);
         abi_ptr thand = TARGET_SIG_IGN;
 
+        sigact_update_host_mask(tsig);
         if (hsig >= _NSIG) {
             continue;
         }
@@ -1026,6 +1059,7 @@ static void host_signal_handler(int host_sig, siginfo_t *info, void *puc)
     memset(sigmask, 0xff, SIGSET_T_SIZE);
     sigdelset(sigmask, SIGSEGV);
     sigdelset(sigmask, SIGBUS);
+    qatomic_set(&ts->host_signals_blocked, 1);
 
     /* interrupt the virtual CPU as soon as possible */
     cpu_exit(thread_cpu);
@@ -1116,6 +1150,7 @@ int do_sigaction(int sig, const struct target_sigaction *act,
 #endif
         /* To be swapped in target_to_host_sigset.  */
         k->sa_mask = act->sa_mask;
+        sigact_update_host_mask(sig);
 
         /* we update the host linux signal state */
         host_sig = target_to_host_signal(sig);
@@ -1170,7 +1205,6 @@ static void handle_pending_signal(CPUArchState *cpu_env, int sig,
 {
     CPUState *cpu = env_cpu(cpu_env);
     abi_ulong handler;
-    sigset_t set;
     target_sigset_t target_old_set;
     struct target_sigaction *sa;
     TaskState *ts = cpu->opaque;
@@ -1210,20 +1244,14 @@ static void handle_pending_signal(CPUArchState *cpu_env, int sig,
         /* compute the blocked signals during the handler execution */
         sigset_t *blocked_set;
 
-        target_to_host_sigset(&set, &sa->sa_mask);
-        /* SA_NODEFER indicates that the current signal should not be
-           blocked during the handler */
-        if (!(sa->sa_flags & TARGET_SA_NODEFER))
-            sigaddset(&set, target_to_host_signal(sig));
-
         /* save the previous blocked signal state to restore it at the
            end of the signal execution (see do_sigreturn) */
-        host_to_target_sigset_internal(&target_old_set, &ts->signal_mask);
+        signal_mask_to_target(ts, &target_old_set);
 
         /* block signals in the handler */
         blocked_set = ts->in_sigsuspend ?
             &ts->sigsuspend_mask : &ts->signal_mask;
-        sigorset(&ts->signal_mask, blocked_set, &set);
+        sigorset(&ts->signal_mask, blocked_set, &sigact_host_mask[sig - 1]);
         ts->in_sigsuspend = 0;
 
         /* if the CPU is in VM86 mode, we restore the 32 bit values */
@@ -1260,8 +1288,17 @@ void process_pending_signals(CPUArchState *cpu_env)
     sigset_t *blocked_set;
 
     while (qatomic_read(&ts->signal_pending)) {
-        sigfillset(&set);
-        sigprocmask(SIG_SETMASK, &set, 0);
+        /*
+         * Signals are usually still blocked, by host_signal_handler()
+         * or block_signals(), so there is no need to block them again.
+         * SIGSEGV and SIGBUS may stay unblocked, nothing here runs guest
+         * code.
+         */
+        if (!qatomic_read(&ts->host_signals_blocked)) {
+            sigfillset(&set);
+            sigprocmask(SIG_SETMASK, &set, 0);
+            qatomic_set(&ts->host_signals_blocked, 1);
+        }
 
     restart_scan:
         sig = ts->sync_signal.pending;
@@ -1307,6 +1344,7 @@ void process_pending_signals(CPUArchState *cpu_env)
         set = ts->signal_mask;
         sigdelset(&set, SIGSEGV);
         sigdelset(&set, SIGBUS);
+        qatomic_set(&ts->host_signals_blocked, 0);
         sigprocmask(SIG_SETMASK, &set, 0);
     }
     ts->in_sigsuspend = 0;
@@ -10198,24 +10198,6 @@ static abi_long do_syscall1(CPUArchState *cpu_env, int num, abi_long arg1,
             }
         }
         return ret;
-#if defined(TARGET_NR_gettimeofday)
-    case TARGET_NR_gettimeofday:
-        {
-            struct timeval tv;
-            struct timezone tz;
-
-            ret = get_errno(gettimeofday(&tv, &tz));
-            if (!is_error(ret)) {
-                if (arg1 && copy_to_user_timeval(arg1, &tv)) {
-                    return -TARGET_EFAULT;
-                }
-                if (arg2 && copy_to_user_timezone(arg2, &tz)) {
-                    return -TARGET_EFAULT;
-                }
-            }
-        }
-        return ret;
-#endif
 #if defined(TARGET_NR_settimeofday)
     case TARGET_NR_settimeofday:
         {
@@ -11183,23 +11165,6 @@ static abi_long do_syscall1(CPUArchState *cpu_env, int num, abi_long arg1,
 
             return get_errno(sys_sched_setaffinity(arg1, mask_size, mask));
         }
-    case TARGET_NR_getcpu:
-        {
-            unsigned cpuid, node;
-            ret = get_errno(sys_getcpu(arg1 ? &cpuid : NULL,
-                                       arg2 ? &node : NULL,
-                                       NULL));
-            if (is_error(ret)) {
-                return ret;
-            }
-            if (arg1 && put_user_u32(cpuid, arg1)) {
-                return -TARGET_EFAULT;
-            }
-            if (arg2 && put_user_u32(node, arg2)) {
-                return -TARGET_EFAULT;
-            }
-        }
-        return ret;
     case TARGET_NR_sched_setparam:
         {
             struct target_sched_param *target_schp;
@@ -12571,28 +12536,6 @@ static abi_long do_syscall1(CPUArchState *cpu_env, int num, abi_long arg1,
         return ret;
     }
 #endif
-#ifdef TARGET_NR_clock_gettime
-    case TARGET_NR_clock_gettime:
-    {
-        struct timespec ts;
-        ret = get_errno(clock_gettime(arg1, &ts));
-        if (!is_error(ret)) {
-            ret = host_to_target_timespec(arg2, &ts);
-        }
-        return ret;
-    }
-#endif
-#ifdef TARGET_NR_clock_gettime64
-    case TARGET_NR_clock_gettime64:
-    {
-        struct timespec ts;
-        ret = get_errno(clock_gettime(arg1, &ts));
-        if (!is_error(ret)) {
-            ret = host_to_target_timespec64(arg2, &ts);
-        }
-        return ret;
-    }
-#endif
 #ifdef TARGET_NR_clock_getres
     case TARGET_NR_clock_getres:
     {
@@ -13626,6 +13569,84 @@ static abi_long do_syscall1(CPUArchState *cpu_env, int num, abi_long arg1,
     return ret;
 }
 
+/*
+ * Time queries are made at a very high rate by some guests, and the
+ * guest vdso turns them into plain syscalls.  Keep them out of the
+ * generic dispatcher: do_syscall1() is huge, and its prologue alone is a
+ * measurable part of the cost.  The host side of clock_gettime(),
+ * gettimeofday() and sched_getcpu() is answered by the host vDSO.
+ * Return true if @num was handled, with the result in @ret.
+ */
+static bool do_syscall_time(int num, abi_long arg1, abi_long arg2,
+                            abi_long *ret)
+{
+    switch (num) {
+#ifdef TARGET_NR_clock_gettime
+    case TARGET_NR_clock_gettime:
+    {
+        struct timespec ts;
+        *ret = get_errno(clock_gettime(arg1, &ts));
+        if (!is_error(*ret)) {
+            *ret = host_to_target_timespec(arg2, &ts);
+        }
+        return true;
+    }
+#endif
+#ifdef TARGET_NR_clock_gettime64
+    case TARGET_NR_clock_gettime64:
+    {
+        struct timespec ts;
+        *ret = get_errno(clock_gettime(arg1, &ts));
+        if (!is_error(*ret)) {
+            *ret = host_to_target_timespec64(arg2, &ts);
+        }
+        return true;
+    }
+#endif
+#if defined(TARGET_NR_gettimeofday)
+    case TARGET_NR_gettimeofday:
+    {
+        struct timeval tv;
+        struct timezone tz;
+
+        *ret = get_errno(gettimeofday(&tv, &tz));
+        if (!is_error(*ret)) {
+            if (arg1 && copy_to_user_timeval(arg1, &tv)) {
+                *ret = -TARGET_EFAULT;
+            } else if (arg2 && copy_to_user_timezone(arg2, &tz)) {
+                *ret = -TARGET_EFAULT;
+            }
+        }
+        return true;
+    }
+#endif
+    case TARGET_NR_getcpu:
+    {
+        unsigned cpuid, node;
+
+        if (!arg2) {
+            /* Without the node, libc can answer without a syscall. */
+            int cpu = sched_getcpu();
+            *ret = cpu < 0 ? -host_to_target_errno(errno) : 0;
+            cpuid = cpu;
+        } else {
+            *ret = get_errno(sys_getcpu(arg1 ? &cpuid : NULL, &node, NULL));
+        }
+        if (is_error(*ret)) {
+            return true;
+        }
+        if (arg1 && put_user_u32(cpuid, arg1)) {
+            *ret = -TARGET_EFAULT;
+        } else if (arg2 && put_user_u32(node, arg2)) {
+            *ret = -TARGET_EFAULT;
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
 abi_long do_syscall(CPUArchState *cpu_env, int num, abi_long arg1,
                     abi_long arg2, abi_long arg3, abi_long arg4,
                     abi_long arg5, abi_long arg6, abi_long arg7,
@@ -13655,8 +13676,10 @@ abi_long do_syscall(CPUArchState *cpu_env, int num, abi_long arg1,
         print_syscall(cpu_env, num, arg1, arg2, arg3, arg4, arg5, arg6);
     }
 
-    ret = do_syscall1(cpu_env, num, arg1, arg2, arg3, arg4,
-                      arg5, arg6, arg7, arg8);
+    if (!do_syscall_time(num, arg1, arg2, &ret)) {
+        ret = do_syscall1(cpu_env, num, arg1, arg2, arg3, arg4,
+                          arg5, arg6, arg7, arg8);
+    }
 
     if (unlikely(qemu_loglevel_mask(LOG_STRACE))) {
         print_syscall_ret(cpu_env, num, ret, arg1, arg2,
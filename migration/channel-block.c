@@ -21,9 +21,28 @@
 #include "qemu/osdep.h"
 #include "migration/channel-block.h"
 #include "qapi/error.h"
+#include "qemu/coroutine.h"
+#include "qemu/memalign.h"
 #include "block/block.h"
+#include "block/graph-lock.h"
 #include "trace.h"
 
+/*
+ * Size of the write-behind buffers and how many of them may be written
+ * concurrently.  Large requests let the format driver allocate and write
+ * many clusters in parallel, which matters because the VM is stopped
+ * while its state is saved.
+ */
+#define QIO_CHANNEL_BLOCK_BUF_SIZE (4 * 1024 * 1024)
+#define QIO_CHANNEL_BLOCK_MAX_WRITES 4
+
+typedef struct QIOChannelBlockWrite {
+    QIOChannelBlock *bioc;
+    uint8_t *buf;
+    size_t len;
+    off_t offset;
+} QIOChannelBlockWrite;
+
 QIOChannelBlock *
 qio_channel_block_new(BlockDriverState *bs)
 {
@@ -38,11 +57,84 @@ qio_channel_block_new(BlockDriverState *bs)
 }
 
 
+static void coroutine_fn
+qio_channel_block_write_entry(void *opaque)
+{
+    QIOChannelBlockWrite *w = opaque;
+    QIOChannelBlock *bioc = w->bioc;
+    QEMUIOVector qiov;
+    int ret;
+
+    qemu_iovec_init_buf(&qiov, w->buf, w->len);
+    bdrv_graph_co_rdlock();
+    ret = bdrv_writev_vmstate(bioc->bs, &qiov, w->offset);
+    bdrv_graph_co_rdunlock();
+    if (ret < 0 && !bioc->write_error) {
+        bioc->write_error = ret;
+    }
+
+    qemu_vfree(w->buf);
+    g_free(w);
+    bioc->writes_in_flight--;
+    aio_wait_kick();
+}
+
+
+static void
+qio_channel_block_submit(QIOChannelBlock *bioc)
+{
+    QIOChannelBlockWrite *w;
+    Coroutine *co;
+
+    if (!bioc->buf_used) {
+        return;
+    }
+
+    BDRV_POLL_WHILE(bioc->bs,
+                    bioc->writes_in_flight >= QIO_CHANNEL_BLOCK_MAX_WRITES);
+
+    w = g_new(QIOChannelBlockWrite, 1);
+    *w = (QIOChannelBlockWrite) {
+        .bioc = bioc,
+        .buf = bioc->buf,
+        .len = bioc->buf_used,
+        .offset = bioc->offset - bioc->buf_used,
+    };
+    bioc->buf = NULL;
+    bioc->buf_used = 0;
+
+    bioc->writes_in_flight++;
+    co = qemu_coroutine_create(qio_channel_block_write_entry, w);
+    aio_co_enter(bdrv_get_aio_context(bioc->bs), co);
+}
+
+
+/*
+ * Submit the buffered data and wait for all writes to complete.
+ * Returns 0 or the first error of any of the writes.
+ */
+static int
+qio_channel_block_drain_writes(QIOChannelBlock *bioc)
+{
+    int ret;
+
+    qio_channel_block_submit(bioc);
+    BDRV_POLL_WHILE(bioc->bs, bioc->writes_in_flight > 0);
+
+    ret = bioc->write_error;
+    bioc->write_error = 0;
+    return ret;
+}
+
+
 static void
 qio_channel_block_finalize(Object *obj)
 {
     QIOChannelBlock *ioc = QIO_CHANNEL_BLOCK(obj);
 
+    if (ioc->bs) {
+        qio_channel_block_drain_writes(ioc);
+    }
     g_clear_pointer(&ioc->bs, bdrv_unref);
 }
 
@@ -60,6 +152,14 @@ qio_channel_block_readv(QIOChannel *ioc,
     QEMUIOVector qiov;
     int ret;
 
+    if (bioc->buf || bioc->writes_in_flight) {
+        ret = qio_channel_block_drain_writes(bioc);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "bdrv_writev_vmstate failed");
+            return -1;
+        }
+    }
+
     qemu_iovec_init_external(&qiov, (struct iovec *)iov, niov);
     ret = bdrv_readv_vmstate(bioc->bs, &qiov, bioc->offset);
     if (ret < 0) {
@@ -83,16 +183,46 @@ qio_channel_block_writev(QIOChannel *ioc,
 {
     QIOChannelBlock *bioc = QIO_CHANNEL_BLOCK(ioc);
     QEMUIOVector qiov;
+    size_t done, len;
     int ret;
 
-    qemu_iovec_init_external(&qiov, (struct iovec *)iov, niov);
-    ret = bdrv_writev_vmstate(bioc->bs, &qiov, bioc->offset);
-    if (ret < 0) {
+    if (bioc->write_error) {
+        ret = bioc->write_error;
         error_setg_errno(errp, -ret, "bdrv_writev_vmstate failed");
         return -1;
     }
 
-    bioc->offset += qiov.size;
+    qemu_iovec_init_external(&qiov, (struct iovec *)iov, niov);
+
+    /*
+     * In coroutine context the caller may not be able to wait for
+     * asynchronous writes, so write through.
+     */
+    if (qemu_in_coroutine()) {
+        ret = bdrv_writev_vmstate(bioc->bs, &qiov, bioc->offset);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "bdrv_writev_vmstate failed");
+            return -1;
+        }
+        bioc->offset += qiov.size;
+        return qiov.size;
+    }
+
+    for (done = 0; done < qiov.size; done += len) {
+        if (!bioc->buf) {
+            bioc->buf = qemu_blockalign(bioc->bs, QIO_CHANNEL_BLOCK_BUF_SIZE);
+        }
+        len = MIN(qiov.size - done,
+                  QIO_CHANNEL_BLOCK_BUF_SIZE - bioc->buf_used);
+        qemu_iovec_to_buf(&qiov, done, bioc->buf + bioc->buf_used, len);
+        bioc->buf_used += len;
+        bioc->offset += len;
+
+        if (bioc->buf_used == QIO_CHANNEL_BLOCK_BUF_SIZE) {
+            qio_channel_block_submit(bioc);
+        }
+    }
+
     return qiov.size;
 }
 
@@ -118,6 +248,9 @@ qio_channel_block_seek(QIOChannel *ioc,
 {
     QIOChannelBlock *bioc = QIO_CHANNEL_BLOCK(ioc);
 
+    /* The write-behind buffer must stay contiguous */
+    qio_channel_block_submit(bioc);
+
     switch (whence) {
     case SEEK_SET:
         bioc->offset = offset;
@@ -141,8 +274,14 @@ qio_channel_block_close(QIOChannel *ioc,
                         Error **errp)
 {
     QIOChannelBlock *bioc = QIO_CHANNEL_BLOCK(ioc);
-    int rv = bdrv_flush(bioc->bs);
+    int rv = qio_channel_block_drain_writes(bioc);
+
+    if (rv < 0) {
+        error_setg_errno(errp, -rv, "bdrv_writev_vmstate failed");
+        return -1;
+    }
 
+    rv = bdrv_flush(bioc->bs);
     if (rv < 0) {
         error_setg_errno(errp, -rv,
                          "Unable to flush VMState");
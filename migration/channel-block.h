@@ -40,6 +40,16 @@ struct QIOChannelBlock {
     QIOChannel parent;
     BlockDriverState *bs;
     off_t offset;
+
+    /*
+     * Writes outside of coroutine context are collected in @buf and
+     * submitted asynchronously once it is full; @buf covers the range
+     * of the VMState region that ends at @offset.
+     */
+    uint8_t *buf;
+    size_t buf_used;
+    unsigned int writes_in_flight;
+    int write_error;
 };
 
 
@@ -845,6 +845,9 @@ static void *colo_process_incoming_thread(void *opaque)
      */
     qemu_file_set_blocking(mis->from_src_file, true);
 
+    if (migrate_multifd()) {
+        colo_fill_ram_cache();
+    }
     colo_incoming_start_dirty_log();
 
     bioc = qio_channel_buffer_new(COLO_BUFFER_BASE_SIZE);
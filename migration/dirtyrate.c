@@ -30,6 +30,7 @@
 #include "sysemu/runstate.h"
 #include "exec/memory.h"
 #include "qemu/xxhash.h"
+#include "migration/misc.h"
 
 /*
  * total_dirty_pages is procted by BQL and is used
@@ -605,10 +606,24 @@ static inline void dirtyrate_manual_reset_protect(void)
     }
 }
 
+/*
+ * With the ram_dirty_range trace event enabled, dirty bitmap mode also
+ * reports which pages were written during the measurement, so that the
+ * write pattern of a workload can be replayed against the migration code
+ * later (see tests/migration/dirty-replay.py).  This consumes the
+ * migration dirty bitmap, so it is not done while a migration runs.
+ */
+static bool dirtyrate_record_pages(void)
+{
+    return trace_event_get_state_backends(TRACE_RAM_DIRTY_RANGE) &&
+           migration_is_idle();
+}
+
 static void calculate_dirtyrate_dirty_bitmap(struct DirtyRateConfig config)
 {
     int64_t start_time;
     DirtyPageRecord dirty_pages;
+    bool record;
 
     qemu_mutex_lock_iothread();
     memory_global_dirty_log_start(GLOBAL_DIRTY_DIRTY_RATE);
@@ -627,6 +642,12 @@ static void calculate_dirtyrate_dirty_bitmap(struct DirtyRateConfig config)
      * KVM_DIRTY_LOG_MANUAL_PROTECT_ENABLE cap is enabled.
      */
     dirtyrate_manual_reset_protect();
+
+    /* Forget the pages dirtied before the measurement started */
+    record = dirtyrate_record_pages();
+    if (record) {
+        ram_trace_dirty_pages(false);
+    }
     qemu_mutex_unlock_iothread();
 
     record_dirtypages_bitmap(&dirty_pages, true);
@@ -645,6 +666,14 @@ static void calculate_dirtyrate_dirty_bitmap(struct DirtyRateConfig config)
 
     record_dirtypages_bitmap(&dirty_pages, false);
 
+    if (record) {
+        qemu_mutex_lock_iothread();
+        if (migration_is_idle()) {
+            ram_trace_dirty_pages(true);
+        }
+        qemu_mutex_unlock_iothread();
+    }
+
     DirtyStat.dirty_rate = do_calculate_dirtyrate(dirty_pages,
                                                   DirtyStat.calc_time_ms);
 }
@@ -146,6 +146,12 @@ migration_channels_and_transport_compatible(MigrationAddress *addr,
         return false;
     }
 
+    if (migrate_mapped_ram() &&
+        addr->transport != MIGRATION_ADDRESS_TYPE_FILE) {
+        error_setg(errp, "Migration requires seekable transport (e.g. file)");
+        return false;
+    }
+
     return true;
 }
 
@@ -1055,6 +1061,8 @@ static void populate_time_info(MigrationInfo *info, MigrationState *s)
     if (migrate_show_downtime(s)) {
         info->has_downtime = true;
         info->downtime = s->downtime;
+        info->downtime_devices = qemu_savevm_state_downtime_devices();
+        info->has_downtime_devices = info->downtime_devices != NULL;
     } else {
         info->has_expected_downtime = true;
         info->expected_downtime = s->expected_downtime;
@@ -1671,7 +1679,9 @@ int migrate_add_blocker(Error **reasonp, Error **errp)
 
 int migrate_add_blocker_normal(Error **reasonp, Error **errp)
 {
-    return migrate_add_blocker_modes(reasonp, errp, MIG_MODE_NORMAL, -1);
+    /* cpr-transfer migrates device state and unshared RAM like normal mode */
+    return migrate_add_blocker_modes(reasonp, errp, MIG_MODE_NORMAL,
+                                     MIG_MODE_CPR_TRANSFER, -1);
 }
 
 int migrate_add_blocker_modes(Error **reasonp, Error **errp, MigMode mode, ...)
@@ -2992,6 +3002,28 @@ static void update_iteration_initial_status(MigrationState *s)
     s->iteration_initial_pages = ram_get_total_transferred_pages();
 }
 
+/*
+ * What saving the non-iterable device state takes out of the downtime
+ * budget, in bytes at the expected switchover bandwidth: its estimated
+ * size, or what could be sent in the time it took to save it the last
+ * time, whichever is larger.
+ */
+static uint64_t migration_switchover_device_cost(MigrationState *s)
+{
+    uint64_t downtime_limit = migrate_downtime_limit();
+    uint64_t bytes, time_us, time_bytes = 0;
+
+    qemu_savevm_state_switchover_estimate(&bytes, &time_us);
+    if (downtime_limit) {
+        /* threshold_size is what can be sent in downtime_limit ms */
+        time_bytes = (double)s->threshold_size * time_us /
+                     (downtime_limit * 1000);
+    }
+    trace_migrate_switchover_device_cost(bytes, time_us, time_bytes);
+
+    return MAX(bytes, time_bytes);
+}
+
 static void migration_update_counters(MigrationState *s,
                                       int64_t current_time)
 {
@@ -3040,7 +3072,8 @@ static void migration_update_counters(MigrationState *s,
     if (stat64_get(&mig_stats.dirty_pages_rate) &&
         transferred > 10000) {
         s->expected_downtime =
-            stat64_get(&mig_stats.dirty_bytes_last_sync) / expected_bw_per_ms;
+            (stat64_get(&mig_stats.dirty_bytes_last_sync) +
+             migration_switchover_device_cost(s)) / expected_bw_per_ms;
     }
 
     migration_rate_reset();
@@ -3080,31 +3113,41 @@ typedef enum {
  */
 static MigIterateState migration_iteration_run(MigrationState *s)
 {
-    uint64_t must_precopy, can_postcopy;
+    uint64_t must_precopy, can_postcopy, device_cost = 0;
     Error *local_err = NULL;
     bool in_postcopy = s->state == MIGRATION_STATUS_POSTCOPY_ACTIVE;
     bool can_switchover = migration_can_switchover(s);
 
+    /*
+     * The non-iterable device state is sent while the guest is stopped,
+     * either at completion or when postcopy starts, so it shares the
+     * downtime budget with what is still pending.
+     */
+    if (!in_postcopy) {
+        device_cost = migration_switchover_device_cost(s);
+    }
+
     qemu_savevm_state_pending_estimate(&must_precopy, &can_postcopy);
     uint64_t pending_size = must_precopy + can_postcopy;
 
     trace_migrate_pending_estimate(pending_size, must_precopy, can_postcopy);
 
-    if (must_precopy <= s->threshold_size) {
+    if (must_precopy + device_cost <= s->threshold_size) {
         qemu_savevm_state_pending_exact(&must_precopy, &can_postcopy);
         pending_size = must_precopy + can_postcopy;
         trace_migrate_pending_exact(pending_size, must_precopy, can_postcopy);
     }
 
-    if ((!pending_size || pending_size < s->threshold_size) && can_switchover) {
+    if ((!pending_size || pending_size + device_cost < s->threshold_size) &&
+        can_switchover) {
         trace_migration_thread_low_pending(pending_size);
         migration_completion(s);
         return MIG_ITERATE_BREAK;
     }
 
     /* Still a significant amount to transfer */
-    if (!in_postcopy && must_precopy <= s->threshold_size && can_switchover &&
-        qatomic_read(&s->start_postcopy)) {
+    if (!in_postcopy && must_precopy + device_cost <= s->threshold_size &&
+        can_switchover && qatomic_read(&s->start_postcopy)) {
         if (postcopy_start(s, &local_err)) {
             migrate_set_error(s, local_err);
             error_report_err(local_err);
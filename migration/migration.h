@@ -105,6 +105,8 @@ struct MigrationIncomingState {
 
     /* For the kernel to send us notifications */
     int       userfault_fd;
+    /* UFFD_FEATURE_MINOR_* bits enabled on userfault_fd */
+    uint64_t  userfault_minor_features;
     /* To notify the fault_thread to wake, e.g., when need to quit */
     int       userfault_event_fd;
     QEMUFile *to_src_file;
@@ -445,6 +447,14 @@ struct MigrationState {
      * Default value is false. (since 8.1)
      */
     bool multifd_flush_after_each_section;
+    /*
+     * When true, multifd sender threads check pages for being zero and
+     * only send their offsets, instead of the migration thread sending
+     * them on the main channel.  Older destinations don't know about
+     * zero pages in multifd packets, so this is off for older machine
+     * types.  Default value is true. (since 9.0)
+     */
+    bool multifd_zero_page;
     /*
      * This decides the size of guest memory chunk that will be used
      * to track dirty bitmap clearing.  The size of memory chunk will
@@ -455,6 +465,31 @@ struct MigrationState {
      */
     uint8_t clear_bitmap_shift;
 
+    /*
+     * Number of host pages after a postcopy page fault that the source
+     * queues for sending right after the faulted page, so that
+     * neighbouring accesses of the guest find their page already
+     * there.  0 disables the prefetch.
+     */
+    uint32_t postcopy_prefetch_pages;
+
+    /*
+     * Whether the destination places postcopy pages of shared file
+     * backed RAM (memfd, hugetlbfs) through userfaultfd minor faults:
+     * pages are written straight into the backing file and the fault
+     * is resolved with UFFDIO_CONTINUE, instead of being copied in
+     * with UFFDIO_COPY.
+     */
+    bool postcopy_minor_fault;
+
+    /*
+     * With the dirty-limit capability, only limit this many vCPUs with
+     * the highest dirty page rate, in proportion to their rate, instead
+     * of applying vcpu-dirty-limit to every vCPU.  0 keeps the uniform
+     * limit.
+     */
+    uint32_t dirty_limit_top_vcpus;
+
     /*
      * This save hostname when out-going migration starts
      */
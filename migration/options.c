@@ -96,8 +96,16 @@ Property migration_properties[] = {
                       decompress_error_check, true),
     DEFINE_PROP_BOOL("multifd-flush-after-each-section", MigrationState,
                       multifd_flush_after_each_section, false),
+    DEFINE_PROP_BOOL("multifd-zero-page", MigrationState,
+                      multifd_zero_page, true),
     DEFINE_PROP_UINT8("x-clear-bitmap-shift", MigrationState,
                       clear_bitmap_shift, CLEAR_BITMAP_SHIFT_DEFAULT),
+    DEFINE_PROP_UINT32("x-postcopy-prefetch-pages", MigrationState,
+                       postcopy_prefetch_pages, 0),
+    DEFINE_PROP_BOOL("x-postcopy-minor-fault", MigrationState,
+                     postcopy_minor_fault, false),
+    DEFINE_PROP_UINT32("x-dirty-limit-top-vcpus", MigrationState,
+                       dirty_limit_top_vcpus, 0),
     DEFINE_PROP_BOOL("x-preempt-pre-7-2", MigrationState,
                      preempt_pre_7_2, false),
 
@@ -204,6 +212,11 @@ Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-switchover-ack",
                         MIGRATION_CAPABILITY_SWITCHOVER_ACK),
     DEFINE_PROP_MIG_CAP("x-dirty-limit", MIGRATION_CAPABILITY_DIRTY_LIMIT),
+    DEFINE_PROP_MIG_CAP("x-mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
+    DEFINE_PROP_MIG_CAP("x-mapped-ram-mmap",
+                        MIGRATION_CAPABILITY_MAPPED_RAM_MMAP),
+    DEFINE_PROP_MIG_CAP("x-mapped-ram-prefetch",
+                        MIGRATION_CAPABILITY_MAPPED_RAM_PREFETCH),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -256,6 +269,27 @@ bool migrate_dirty_limit(void)
     return s->capabilities[MIGRATION_CAPABILITY_DIRTY_LIMIT];
 }
 
+bool migrate_mapped_ram(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
+}
+
+bool migrate_mapped_ram_mmap(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM_MMAP];
+}
+
+bool migrate_mapped_ram_prefetch(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM_PREFETCH];
+}
+
 bool migrate_events(void)
 {
     MigrationState *s = migrate_get_current();
@@ -377,6 +411,34 @@ bool migrate_multifd_flush_after_each_section(void)
     return s->multifd_flush_after_each_section;
 }
 
+bool migrate_multifd_zero_page(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->multifd_zero_page;
+}
+
+uint32_t migrate_postcopy_prefetch_pages(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->postcopy_prefetch_pages;
+}
+
+bool migrate_postcopy_minor_fault(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->postcopy_minor_fault;
+}
+
+uint32_t migrate_dirty_limit_top_vcpus(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->dirty_limit_top_vcpus;
+}
+
 bool migrate_postcopy(void)
 {
     return migrate_postcopy_ram() || migrate_dirty_bitmaps();
@@ -454,6 +516,19 @@ INITIALIZE_MIGRATE_CAPS_SET(check_caps_background_snapshot,
     MIGRATION_CAPABILITY_VALIDATE_UUID,
     MIGRATION_CAPABILITY_ZERO_COPY_SEND);
 
+/* Mapped-ram compatibility check list */
+static const
+INITIALIZE_MIGRATE_CAPS_SET(check_caps_mapped_ram,
+    MIGRATION_CAPABILITY_MULTIFD,
+    MIGRATION_CAPABILITY_XBZRLE,
+    MIGRATION_CAPABILITY_COMPRESS,
+    MIGRATION_CAPABILITY_POSTCOPY_RAM,
+    MIGRATION_CAPABILITY_RELEASE_RAM,
+    MIGRATION_CAPABILITY_RDMA_PIN_ALL,
+    MIGRATION_CAPABILITY_X_COLO,
+    MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT,
+    MIGRATION_CAPABILITY_ZERO_COPY_SEND);
+
 static bool migrate_incoming_started(void)
 {
     return !!migration_incoming_get_current()->transport_data;
@@ -645,6 +720,33 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
+    if (new_caps[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        int idx;
+
+        for (idx = 0; idx < check_caps_mapped_ram.size; idx++) {
+            int incomp_cap = check_caps_mapped_ram.caps[idx];
+            if (new_caps[incomp_cap]) {
+                error_setg(errp,
+                           "Mapped-ram migration is incompatible with %s",
+                           MigrationCapability_str(incomp_cap));
+                return false;
+            }
+        }
+    }
+
+    if (new_caps[MIGRATION_CAPABILITY_MAPPED_RAM_MMAP] &&
+        !new_caps[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        error_setg(errp, "Capability mapped-ram-mmap requires mapped-ram");
+        return false;
+    }
+
+    if (new_caps[MIGRATION_CAPABILITY_MAPPED_RAM_PREFETCH] &&
+        !new_caps[MIGRATION_CAPABILITY_MAPPED_RAM_MMAP]) {
+        error_setg(errp,
+                   "Capability mapped-ram-prefetch requires mapped-ram-mmap");
+        return false;
+    }
+
     return true;
 }
 
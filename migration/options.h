@@ -33,6 +33,9 @@ bool migrate_dirty_limit(void);
 bool migrate_events(void);
 bool migrate_ignore_shared(void);
 bool migrate_late_block_activate(void);
+bool migrate_mapped_ram(void);
+bool migrate_mapped_ram_mmap(void);
+bool migrate_mapped_ram_prefetch(void);
 bool migrate_multifd(void);
 bool migrate_pause_before_switchover(void);
 bool migrate_postcopy_blocktime(void);
@@ -55,6 +58,10 @@ bool migrate_zero_copy_send(void);
  */
 
 bool migrate_multifd_flush_after_each_section(void);
+bool migrate_multifd_zero_page(void);
+uint32_t migrate_postcopy_prefetch_pages(void);
+bool migrate_postcopy_minor_fault(void);
+uint32_t migrate_dirty_limit_top_vcpus(void);
 bool migrate_postcopy(void);
 bool migrate_rdma(void);
 bool migrate_tls(void);
@@ -313,6 +313,14 @@ static bool ufd_check_and_apply(int ufd, MigrationIncomingState *mis,
     }
 #endif
 
+#ifdef UFFD_FEATURE_MINOR_SHMEM
+    if (migrate_postcopy_minor_fault()) {
+        asked_features |= supported_features &
+                          (UFFD_FEATURE_MINOR_SHMEM |
+                           UFFD_FEATURE_MINOR_HUGETLBFS);
+    }
+#endif
+
     /*
      * request features, even if asked_features is 0, due to
      * kernel expects UFFD_API before UFFDIO_REGISTER, per
@@ -322,6 +330,11 @@ static bool ufd_check_and_apply(int ufd, MigrationIncomingState *mis,
         error_setg(errp, "Failed features %" PRIu64, asked_features);
         return false;
     }
+#ifdef UFFD_FEATURE_MINOR_SHMEM
+    mis->userfault_minor_features = asked_features &
+                                    (UFFD_FEATURE_MINOR_SHMEM |
+                                     UFFD_FEATURE_MINOR_HUGETLBFS);
+#endif
 
     if (qemu_real_host_page_size() != ram_pagesize_summary()) {
         bool have_hp = false;
@@ -550,6 +563,11 @@ static int cleanup_range(RAMBlock *rb, void *opaque)
         return -1;
     }
 
+    if (rb->postcopy_alias) {
+        munmap(rb->postcopy_alias, length);
+        rb->postcopy_alias = NULL;
+    }
+
     return 0;
 }
 
@@ -710,6 +728,56 @@ int postcopy_ram_prepare_discard(MigrationIncomingState *mis)
     return 0;
 }
 
+/*
+ * Whether faults on @rb may be resolved with UFFDIO_CONTINUE: the block
+ * must be a shared mapping of a shmem or hugetlbfs file, and nobody else
+ * may be mapping that file and handling faults on it (vhost-user), as
+ * they would see pages while they are still being written.
+ */
+static bool ram_block_can_minor_fault(MigrationIncomingState *mis,
+                                      RAMBlock *rb)
+{
+    uint64_t feature;
+
+    if (!mis->userfault_minor_features || !qemu_ram_is_shared(rb) ||
+        rb->fd < 0) {
+        return false;
+    }
+    if (!QLIST_EMPTY(&postcopy_notifier_list.notifiers)) {
+        return false;
+    }
+#ifdef UFFD_FEATURE_MINOR_SHMEM
+    if (qemu_ram_pagesize(rb) == qemu_real_host_page_size()) {
+        feature = UFFD_FEATURE_MINOR_SHMEM;
+    } else {
+        feature = UFFD_FEATURE_MINOR_HUGETLBFS;
+    }
+#else
+    feature = 0;
+#endif
+    return mis->userfault_minor_features & feature;
+}
+
+/*
+ * Map the backing file of @rb a second time, so that received pages
+ * can be written into it without faulting.
+ */
+static void ram_block_setup_alias(RAMBlock *rb)
+{
+    void *alias;
+
+    alias = mmap(NULL, rb->postcopy_length, PROT_READ | PROT_WRITE,
+                 MAP_SHARED, rb->fd, rb->fd_offset);
+    if (alias == MAP_FAILED) {
+        warn_report("%s: mmap of %s failed, placing its pages with "
+                    "UFFDIO_COPY: %s", __func__, qemu_ram_get_idstr(rb),
+                    strerror(errno));
+        return;
+    }
+    rb->postcopy_alias = alias;
+    trace_postcopy_ram_block_alias(qemu_ram_get_idstr(rb), alias);
+}
+
 /*
  * Mark the given area of RAM as requiring notification to unwritten areas
  * Used as a  callback on foreach_not_ignored_block.
@@ -723,13 +791,27 @@ static int ram_block_enable_notify(RAMBlock *rb, void *opaque)
 {
     MigrationIncomingState *mis = opaque;
     struct uffdio_register reg_struct;
+    bool minor = ram_block_can_minor_fault(mis, rb);
 
     reg_struct.range.start = (uintptr_t)qemu_ram_get_host_addr(rb);
     reg_struct.range.len = rb->postcopy_length;
     reg_struct.mode = UFFDIO_REGISTER_MODE_MISSING;
 
+    /*
+     * Pages discarded for postcopy are holes in the file and still raise
+     * missing faults, so minor fault mode is registered on top of it.
+     */
+    if (minor) {
+        reg_struct.mode |= UFFDIO_REGISTER_MODE_MINOR;
+        if (ioctl(mis->userfault_fd, UFFDIO_REGISTER, &reg_struct)) {
+            /* e.g. a file on a filesystem without minor fault support */
+            minor = false;
+            reg_struct.mode = UFFDIO_REGISTER_MODE_MISSING;
+        }
+    }
+
     /* Now tell our userfault_fd that it's responsible for this area */
-    if (ioctl(mis->userfault_fd, UFFDIO_REGISTER, &reg_struct)) {
+    if (!minor && ioctl(mis->userfault_fd, UFFDIO_REGISTER, &reg_struct)) {
         error_report("%s userfault register: %s", __func__, strerror(errno));
         return -1;
     }
@@ -740,6 +822,9 @@ static int ram_block_enable_notify(RAMBlock *rb, void *opaque)
     if (reg_struct.ioctls & ((__u64)1 << _UFFDIO_ZEROPAGE)) {
         qemu_ram_set_uf_zeroable(rb);
     }
+    if (minor && (reg_struct.ioctls & ((__u64)1 << _UFFDIO_CONTINUE))) {
+        ram_block_setup_alias(rb);
+    }
 
     return 0;
 }
@@ -954,6 +1039,34 @@ static void mark_postcopy_blocktime_end(uintptr_t addr)
                                       affected_cpu);
 }
 
+static int qemu_ufd_continue_ioctl(MigrationIncomingState *mis,
+                                   void *host_addr, uint64_t pagesize)
+{
+    struct uffdio_continue continue_struct;
+
+    continue_struct.range.start = (uint64_t)(uintptr_t)host_addr;
+    continue_struct.range.len = pagesize;
+    continue_struct.mode = 0;
+    return ioctl(mis->userfault_fd, UFFDIO_CONTINUE, &continue_struct);
+}
+
+/*
+ * Map again a host page that was already placed but got unmapped from
+ * the guest; only called from the fault thread.
+ */
+static void postcopy_ram_remap_page(MigrationIncomingState *mis, RAMBlock *rb,
+                                    ram_addr_t offset)
+{
+    void *host = qemu_ram_get_host_addr(rb) + offset;
+
+    /* EEXIST: someone else mapped it meanwhile, the fault retries anyway */
+    if (qemu_ufd_continue_ioctl(mis, host, qemu_ram_pagesize(rb)) &&
+        errno != EEXIST) {
+        error_report("%s: %s continue host: %p", __func__, strerror(errno),
+                     host);
+    }
+}
+
 static void postcopy_pause_fault_thread(MigrationIncomingState *mis)
 {
     trace_postcopy_pause_fault_thread();
@@ -1075,6 +1188,22 @@ static void *postcopy_ram_fault_thread(void *opaque)
             }
 
             rb_offset = ROUND_DOWN(rb_offset, qemu_ram_pagesize(rb));
+
+            /*
+             * A minor fault on a page we already have means it was only
+             * unmapped from the guest (e.g. by reclaim) and is still in
+             * the backing file: map it again, the source has nothing to
+             * send for it.
+             */
+            if ((msg.arg.pagefault.flags & UFFD_PAGEFAULT_FLAG_MINOR) &&
+                ramblock_recv_bitmap_test_byte_offset(rb, rb_offset)) {
+                trace_postcopy_ram_fault_thread_remap(
+                    msg.arg.pagefault.address, qemu_ram_get_idstr(rb),
+                    rb_offset);
+                postcopy_ram_remap_page(mis, rb, rb_offset);
+                continue;
+            }
+
             trace_postcopy_ram_fault_thread_request(msg.arg.pagefault.address,
                                                 qemu_ram_get_idstr(rb),
                                                 rb_offset,
@@ -1271,6 +1400,39 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
     return 0;
 }
 
+/* Book-keeping after a host page got placed by one of the ufd ioctls */
+static void postcopy_ufd_page_placed(MigrationIncomingState *mis,
+                                     void *host_addr, uint64_t pagesize,
+                                     RAMBlock *rb)
+{
+    qemu_mutex_lock(&mis->page_request_mutex);
+    ramblock_recv_bitmap_set_range(rb, host_addr,
+                                   pagesize / qemu_target_page_size());
+    /*
+     * If this page resolves a page fault for a previous recorded faulted
+     * address, take a special note to maintain the requested page list.
+     */
+    if (g_tree_lookup(mis->page_requested, host_addr)) {
+        g_tree_remove(mis->page_requested, host_addr);
+        int left_pages = qatomic_dec_fetch(&mis->page_requested_count);
+
+        trace_postcopy_page_req_del(host_addr, mis->page_requested_count);
+        /* Order the update of count and read of preempt status */
+        smp_mb();
+        if (mis->preempt_thread_status == PREEMPT_THREAD_QUIT &&
+            left_pages == 0) {
+            /*
+             * This probably means the main thread is waiting for us.
+             * Notify that we've finished receiving the last requested
+             * page.
+             */
+            qemu_cond_signal(&mis->page_request_cond);
+        }
+    }
+    qemu_mutex_unlock(&mis->page_request_mutex);
+    mark_postcopy_blocktime_end((uintptr_t)host_addr);
+}
+
 static int qemu_ufd_copy_ioctl(MigrationIncomingState *mis, void *host_addr,
                                void *from_addr, uint64_t pagesize, RAMBlock *rb)
 {
@@ -1292,32 +1454,7 @@ static int qemu_ufd_copy_ioctl(MigrationIncomingState *mis, void *host_addr,
         ret = ioctl(userfault_fd, UFFDIO_ZEROPAGE, &zero_struct);
     }
     if (!ret) {
-        qemu_mutex_lock(&mis->page_request_mutex);
-        ramblock_recv_bitmap_set_range(rb, host_addr,
-                                       pagesize / qemu_target_page_size());
-        /*
-         * If this page resolves a page fault for a previous recorded faulted
-         * address, take a special note to maintain the requested page list.
-         */
-        if (g_tree_lookup(mis->page_requested, host_addr)) {
-            g_tree_remove(mis->page_requested, host_addr);
-            int left_pages = qatomic_dec_fetch(&mis->page_requested_count);
-
-            trace_postcopy_page_req_del(host_addr, mis->page_requested_count);
-            /* Order the update of count and read of preempt status */
-            smp_mb();
-            if (mis->preempt_thread_status == PREEMPT_THREAD_QUIT &&
-                left_pages == 0) {
-                /*
-                 * This probably means the main thread is waiting for us.
-                 * Notify that we've finished receiving the last requested
-                 * page.
-                 */
-                qemu_cond_signal(&mis->page_request_cond);
-            }
-        }
-        qemu_mutex_unlock(&mis->page_request_mutex);
-        mark_postcopy_blocktime_end((uintptr_t)host_addr);
+        postcopy_ufd_page_placed(mis, host_addr, pagesize, rb);
     }
     return ret;
 }
@@ -1365,6 +1502,29 @@ int postcopy_place_page(MigrationIncomingState *mis, void *host, void *from,
                                        qemu_ram_block_host_offset(rb, host));
 }
 
+/*
+ * Place a host page (host) whose content has already been written
+ * through rb->postcopy_alias, by mapping it into the guest.
+ * returns 0 on success
+ */
+int postcopy_place_page_in_place(MigrationIncomingState *mis, void *host,
+                                 RAMBlock *rb)
+{
+    size_t pagesize = qemu_ram_pagesize(rb);
+
+    if (qemu_ufd_continue_ioctl(mis, host, pagesize)) {
+        int e = errno;
+        error_report("%s: %s continue host: %p (size: %zd)",
+                     __func__, strerror(e), host, pagesize);
+
+        return -e;
+    }
+    postcopy_ufd_page_placed(mis, host, pagesize, rb);
+
+    trace_postcopy_place_page_in_place(host);
+    return 0;
+}
+
 /*
  * Place a zero page at (host) atomically
  * returns 0 on success
@@ -1451,6 +1611,13 @@ int postcopy_place_page_zero(MigrationIncomingState *mis, void *host,
     return -1;
 }
 
+int postcopy_place_page_in_place(MigrationIncomingState *mis, void *host,
+                                 RAMBlock *rb)
+{
+    assert(0);
+    return -1;
+}
+
 int postcopy_wake_shared(struct PostCopyFD *pcfd,
                          uint64_t client_addr,
                          RAMBlock *rb)
@@ -79,6 +79,14 @@ int postcopy_place_page(MigrationIncomingState *mis, void *host, void *from,
 int postcopy_place_page_zero(MigrationIncomingState *mis, void *host,
                              RAMBlock *rb);
 
+/*
+ * Place a host page (host) whose content was already written through
+ * rb->postcopy_alias, resolving any fault on it with UFFDIO_CONTINUE
+ * returns 0 on success
+ */
+int postcopy_place_page_in_place(MigrationIncomingState *mis, void *host,
+                                 RAMBlock *rb);
+
 /* The current postcopy state is read/set by postcopy_state_get/set
  * which update it atomically.
  * The state is updated as postcopy messages are received, and
@@ -51,6 +51,11 @@ struct QEMUFile {
 
     int last_error;
     Error *last_error_obj;
+
+    /* Whether file descriptors can be passed over @ioc */
+    bool can_pass_fd;
+    /* Received file descriptors not yet taken by qemu_file_get_fd() */
+    GQueue fds;
 };
 
 /*
@@ -106,6 +111,8 @@ static QEMUFile *qemu_file_new_impl(QIOChannel *ioc, bool is_writable)
     object_ref(ioc);
     f->ioc = ioc;
     f->is_writable = is_writable;
+    f->can_pass_fd = qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_FD_PASS);
+    g_queue_init(&f->fds);
 
     return f;
 }
@@ -303,6 +310,8 @@ static ssize_t coroutine_mixed_fn qemu_fill_buffer(QEMUFile *f)
     int len;
     int pending;
     Error *local_error = NULL;
+    int *fds = NULL;
+    size_t nfds = 0, i;
 
     assert(!qemu_file_is_writable(f));
 
@@ -318,10 +327,19 @@ static ssize_t coroutine_mixed_fn qemu_fill_buffer(QEMUFile *f)
     }
 
     do {
-        len = qio_channel_read(f->ioc,
-                               (char *)f->buf + pending,
-                               IO_BUF_SIZE - pending,
-                               &local_error);
+        struct iovec iov = {
+            .iov_base = f->buf + pending,
+            .iov_len = IO_BUF_SIZE - pending,
+        };
+
+        /*
+         * Always collect passed file descriptors when the channel can
+         * carry them; reading their data without them would drop them.
+         */
+        len = qio_channel_readv_full(f->ioc, &iov, 1,
+                                     f->can_pass_fd ? &fds : NULL,
+                                     f->can_pass_fd ? &nfds : NULL,
+                                     0, &local_error);
         if (len == QIO_CHANNEL_ERR_BLOCK) {
             if (qemu_in_coroutine()) {
                 qio_channel_yield(f->ioc, G_IO_IN);
@@ -333,6 +351,11 @@ static ssize_t coroutine_mixed_fn qemu_fill_buffer(QEMUFile *f)
         }
     } while (len == QIO_CHANNEL_ERR_BLOCK);
 
+    for (i = 0; i < nfds; i++) {
+        g_queue_push_tail(&f->fds, GINT_TO_POINTER(fds[i]));
+    }
+    g_free(fds);
+
     if (len > 0) {
         f->buf_size += len;
     } else if (len == 0) {
@@ -359,6 +382,9 @@ int qemu_fclose(QEMUFile *f)
     if (ret >= 0) {
         ret = ret2;
     }
+    while (!g_queue_is_empty(&f->fds)) {
+        close(GPOINTER_TO_INT(g_queue_pop_head(&f->fds)));
+    }
     g_clear_pointer(&f->ioc, object_unref);
     error_free(f->last_error_obj);
     g_free(f);
@@ -834,3 +860,176 @@ int qemu_file_get_to_fd(QEMUFile *f, int fd, size_t size)
 
     return 0;
 }
+
+/* Marker byte that carries a file descriptor in the stream */
+#define QEMU_FILE_FD_MARKER 0xfd
+
+/*
+ * Send a copy of @fd over the channel, which must support passing file
+ * descriptors.  The descriptor travels with a marker byte, so it is
+ * received in stream order by qemu_file_get_fd().
+ *
+ * Returns 0 on success or a negative error, which is also set on @f.
+ */
+int qemu_file_put_fd(QEMUFile *f, int fd)
+{
+    uint8_t marker = QEMU_FILE_FD_MARKER;
+    struct iovec iov = { .iov_base = &marker, .iov_len = 1 };
+    Error *local_error = NULL;
+    int ret;
+
+    if (!f->can_pass_fd) {
+        error_setg(&local_error, "Channel cannot pass file descriptors");
+        qemu_file_set_error_obj(f, -EINVAL, local_error);
+        return -EINVAL;
+    }
+
+    ret = qemu_fflush(f);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (qio_channel_writev_full_all(f->ioc, &iov, 1, &fd, 1, 0,
+                                    &local_error) < 0) {
+        qemu_file_set_error_obj(f, -EIO, local_error);
+        return -EIO;
+    }
+    stat64_add(&mig_stats.qemu_file_transferred, 1);
+    return 0;
+}
+
+/*
+ * Receive a file descriptor sent with qemu_file_put_fd().
+ *
+ * Returns the descriptor, which the caller owns, or -1 on error.
+ */
+int qemu_file_get_fd(QEMUFile *f)
+{
+    int marker = qemu_get_byte(f);
+
+    if (qemu_file_get_error(f)) {
+        return -1;
+    }
+    if (marker != QEMU_FILE_FD_MARKER || g_queue_is_empty(&f->fds)) {
+        Error *local_error = NULL;
+
+        error_setg(&local_error, "Expected a file descriptor in the stream");
+        qemu_file_set_error_obj(f, -EINVAL, local_error);
+        return -1;
+    }
+
+    return GPOINTER_TO_INT(g_queue_pop_head(&f->fds));
+}
+
+/*
+ * Write @buflen bytes from @buf at absolute position @pos of the
+ * underlying channel, bypassing the stream buffer.  The stream
+ * position is not affected.
+ */
+void qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t buflen,
+                        off_t pos)
+{
+    Error *err = NULL;
+    ssize_t ret;
+
+    if (f->last_error) {
+        return;
+    }
+
+    qemu_fflush(f);
+    ret = qio_channel_pwrite(f->ioc, (char *)buf, buflen, pos, &err);
+
+    if (err) {
+        qemu_file_set_error_obj(f, -EIO, err);
+        return;
+    }
+
+    if ((ssize_t)buflen != ret) {
+        error_setg(&err, "Partial write of size %zd, expected %zu", ret,
+                   buflen);
+        qemu_file_set_error_obj(f, -EIO, err);
+        return;
+    }
+
+    stat64_add(&mig_stats.qemu_file_transferred, buflen);
+}
+
+/*
+ * Read @buflen bytes into @buf from absolute position @pos of the
+ * underlying channel, bypassing the stream buffer.  The stream
+ * position is not affected.
+ *
+ * Returns the number of bytes read, 0 on error.
+ */
+size_t qemu_get_buffer_at(QEMUFile *f, const uint8_t *buf, size_t buflen,
+                          off_t pos)
+{
+    Error *err = NULL;
+    ssize_t ret;
+
+    if (f->last_error) {
+        return 0;
+    }
+
+    ret = qio_channel_pread(f->ioc, (char *)buf, buflen, pos, &err);
+
+    if (ret == -1 || err) {
+        goto error;
+    }
+
+    if ((ssize_t)buflen != ret) {
+        error_setg(&err, "Partial read of size %zd, expected %zu", ret,
+                   buflen);
+        goto error;
+    }
+
+    return buflen;
+
+ error:
+    qemu_file_set_error_obj(f, -EIO, err);
+    return 0;
+}
+
+/*
+ * Move the stream position to absolute position @pos of the
+ * underlying channel.  Pending writes are flushed and buffered input
+ * is discarded first.
+ */
+void qemu_set_offset(QEMUFile *f, off_t pos)
+{
+    Error *err = NULL;
+    off_t ret;
+
+    if (qemu_file_is_writable(f)) {
+        qemu_fflush(f);
+    } else {
+        /* Drop all cached buffers if existed; will trigger a re-fill later */
+        f->buf_index = 0;
+        f->buf_size = 0;
+    }
+
+    ret = qio_channel_io_seek(f->ioc, pos, SEEK_SET, &err);
+    if (ret < 0) {
+        qemu_file_set_error_obj(f, -EIO, err);
+    }
+}
+
+/* Returns the stream position as an absolute channel offset. */
+off_t qemu_get_offset(QEMUFile *f)
+{
+    Error *err = NULL;
+    off_t ret;
+
+    qemu_fflush(f);
+
+    ret = qio_channel_io_seek(f->ioc, 0, SEEK_CUR, &err);
+    if (ret < 0) {
+        qemu_file_set_error_obj(f, -EIO, err);
+        return ret;
+    }
+
+    if (!qemu_file_is_writable(f)) {
+        ret -= f->buf_size - f->buf_index;
+    }
+    return ret;
+}
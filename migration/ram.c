@@ -31,6 +31,7 @@
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/madvise.h"
+#include "qemu/units.h"
 #include "qemu/main-loop.h"
 #include "xbzrle.h"
 #include "ram-compress.h"
@@ -68,6 +69,7 @@
 
 #if defined(__linux__)
 #include "qemu/userfaultfd.h"
+#include "io/channel-file.h"
 #endif /* defined(__linux__) */
 
 /***********************************************************/
@@ -94,6 +96,54 @@
 #define RAM_SAVE_FLAG_MULTIFD_FLUSH    0x200
 /* We can't use any flag that is bigger than 0x200 */
 
+/*
+ * mapped-ram migration supports O_DIRECT, so we need to make sure the
+ * userspace buffer, the IO operation size and the file offset are
+ * aligned according to the underlying device's block size.  The first
+ * two are already aligned to page size, but we need to add padding to
+ * the file to align the offset.  We cannot read the block size
+ * dynamically because the migration file can be moved between
+ * different systems, so use 1M to cover most block sizes and to keep
+ * the file offset aligned at page size as well.
+ */
+#define MAPPED_RAM_FILE_OFFSET_ALIGNMENT 0x100000
+
+/*
+ * When doing mapped-ram migration, this is the amount we read from
+ * the pages region in the migration file at a time.
+ */
+#define MAPPED_RAM_LOAD_BUF_SIZE 0x100000
+
+/*
+ * With mapped-ram-mmap, runs of pages shorter than this are still read,
+ * so that a fragmented bitmap does not end up as thousands of mappings.
+ */
+#define MAPPED_RAM_MMAP_MIN_SIZE 0x200000
+
+/* Amount of mapped guest memory prefetched at a time */
+#define MAPPED_RAM_PREFETCH_CHUNK 0x200000
+
+#define MAPPED_RAM_HDR_VERSION 1
+struct MappedRamHeader {
+    uint32_t version;
+    /*
+     * The target's page size, so we know how many pages are in the
+     * bitmap.
+     */
+    uint64_t page_size;
+    /*
+     * The offset in the migration file where the pages bitmap is
+     * stored.
+     */
+    uint64_t bitmap_offset;
+    /*
+     * The offset in the migration file where the actual pages (data)
+     * are stored.
+     */
+    uint64_t pages_offset;
+} QEMU_PACKED;
+typedef struct MappedRamHeader MappedRamHeader;
+
 XBZRLECacheStats xbzrle_counters;
 
 /* used by the search for pages to send */
@@ -198,11 +248,22 @@ static bool postcopy_preempt_active(void)
     return migrate_postcopy_preempt() && migration_in_postcopy();
 }
 
+/*
+ * In cpr-transfer mode, RAM backed by shared memory is passed to the
+ * destination by file descriptor instead of being copied.
+ */
+static bool migrate_ram_is_cpr_shared(RAMBlock *block)
+{
+    return migrate_mode() == MIG_MODE_CPR_TRANSFER &&
+           qemu_ram_is_shared(block) && qemu_ram_get_fd(block) >= 0;
+}
+
 bool migrate_ram_is_ignored(RAMBlock *block)
 {
     return !qemu_ram_is_migratable(block) ||
            (migrate_ignore_shared() && qemu_ram_is_shared(block)
-                                    && qemu_ram_is_named_file(block));
+                                    && qemu_ram_is_named_file(block)) ||
+           migrate_ram_is_cpr_shared(block);
 }
 
 #undef RAMBLOCK_FOREACH
@@ -904,6 +965,131 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
     rs->num_dirty_pages_period += new_dirty_pages;
 }
 
+/*
+ * For multi-terabyte guests walking the dirty bitmaps takes long enough
+ * to show up in the downtime.  Above BITMAP_SYNC_PARALLEL_MIN bytes of
+ * RAM, split the RAMBlocks in chunks and let a few helper threads sync
+ * them together with the migration thread.  Chunks are page-word
+ * aligned, so each one touches its own words of rb->bmap and the
+ * global dirty bitmap is consumed with atomic exchanges.
+ */
+#define BITMAP_SYNC_CHUNK_SIZE      (1ULL << 30)
+#define BITMAP_SYNC_PARALLEL_MIN    (64ULL << 30)
+#define BITMAP_SYNC_MAX_THREADS     8
+
+typedef struct {
+    RAMBlock *block;
+    ram_addr_t start;
+    ram_addr_t length;
+} BitmapSyncChunk;
+
+typedef struct {
+    BitmapSyncChunk *chunks;
+    unsigned int nr_chunks;
+    /* next chunk to be synced, updated atomically */
+    unsigned int next;
+} BitmapSyncJob;
+
+typedef struct {
+    BitmapSyncJob *job;
+    QemuThread thread;
+    uint64_t new_dirty_pages;
+} BitmapSyncWorker;
+
+static void bitmap_sync_run(BitmapSyncWorker *w)
+{
+    BitmapSyncJob *job = w->job;
+    unsigned int i;
+
+    while ((i = qatomic_fetch_inc(&job->next)) < job->nr_chunks) {
+        BitmapSyncChunk *c = &job->chunks[i];
+
+        w->new_dirty_pages +=
+            cpu_physical_memory_sync_dirty_bitmap(c->block, c->start,
+                                                  c->length);
+    }
+}
+
+static void *bitmap_sync_thread(void *opaque)
+{
+    rcu_register_thread();
+    WITH_RCU_READ_LOCK_GUARD() {
+        bitmap_sync_run(opaque);
+    }
+    rcu_unregister_thread();
+    return NULL;
+}
+
+/*
+ * Called with RCU critical section.  Returns false if the RAM is too
+ * small to be worth it, the caller then syncs block by block.
+ */
+static bool ramblock_sync_dirty_bitmap_parallel(RAMState *rs)
+{
+    g_autofree BitmapSyncChunk *chunks = NULL;
+    BitmapSyncWorker workers[BITMAP_SYNC_MAX_THREADS] = { };
+    BitmapSyncJob job = { };
+    uint64_t total = 0, new_dirty_pages = 0;
+    unsigned int nr_threads, i;
+    RAMBlock *block;
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        /*
+         * Without a clear bitmap the sync clears the dirty log in the
+         * accelerator, which must not run concurrently per block.
+         */
+        if (!block->clear_bmap) {
+            return false;
+        }
+        total += block->used_length;
+        job.nr_chunks += DIV_ROUND_UP(block->used_length,
+                                      BITMAP_SYNC_CHUNK_SIZE);
+    }
+    if (total < BITMAP_SYNC_PARALLEL_MIN) {
+        return false;
+    }
+
+    chunks = g_new(BitmapSyncChunk, job.nr_chunks);
+    i = 0;
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        ram_addr_t start;
+
+        for (start = 0; start < block->used_length;
+             start += BITMAP_SYNC_CHUNK_SIZE) {
+            chunks[i].block = block;
+            chunks[i].start = start;
+            chunks[i].length = MIN(BITMAP_SYNC_CHUNK_SIZE,
+                                   block->used_length - start);
+            i++;
+        }
+    }
+    job.chunks = chunks;
+
+    nr_threads = MIN(MIN(g_get_num_processors(), BITMAP_SYNC_MAX_THREADS),
+                     job.nr_chunks);
+
+    /* Worker 0 is the migration thread itself */
+    for (i = 0; i < nr_threads; i++) {
+        workers[i].job = &job;
+    }
+    for (i = 1; i < nr_threads; i++) {
+        qemu_thread_create(&workers[i].thread, "bitmap-sync",
+                           bitmap_sync_thread, &workers[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+    bitmap_sync_run(&workers[0]);
+    for (i = 1; i < nr_threads; i++) {
+        qemu_thread_join(&workers[i].thread);
+    }
+
+    for (i = 0; i < nr_threads; i++) {
+        new_dirty_pages += workers[i].new_dirty_pages;
+    }
+    rs->migration_dirty_pages += new_dirty_pages;
+    rs->num_dirty_pages_period += new_dirty_pages;
+    return true;
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -996,6 +1182,43 @@ static void migration_dirty_limit_guest(void)
     trace_migration_dirty_limit_guest(quota_dirtyrate);
 }
 
+/*
+ * Limit only the vCPUs that dirty memory the fastest
+ *
+ * The target dirty page rate is the one at which sending the current
+ * backlog leaves no more than the downtime limit worth of dirty pages
+ * behind, so it relaxes as migration gets closer to converging.  It is
+ * never looser than the throttle trigger threshold.
+ */
+static void migration_dirty_limit_top_vcpus(RAMState *rs,
+                                            uint64_t bytes_xfer_period,
+                                            uint64_t threshold)
+{
+    MigrationState *s = migrate_get_current();
+    int64_t period = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) -
+                     rs->time_last_bitmap_sync;
+    uint64_t remaining = ram_bytes_remaining();
+    uint64_t bandwidth, target;
+
+    if (period <= 0) {
+        return;
+    }
+
+    /* bytes per second */
+    bandwidth = bytes_xfer_period * 1000 / period;
+    target = bandwidth * threshold / 100;
+    if (remaining > s->threshold_size) {
+        target = MIN(target,
+                     (double)bandwidth * s->threshold_size / remaining);
+    }
+    target /= MiB;
+
+    dirtylimit_set_top_vcpus(migrate_dirty_limit_top_vcpus(), target,
+                             s->parameters.vcpu_dirty_limit);
+    trace_migration_dirty_limit_top_vcpus(migrate_dirty_limit_top_vcpus(),
+                                          target);
+}
+
 static void migration_trigger_throttle(RAMState *rs)
 {
     uint64_t threshold = migrate_throttle_trigger_threshold();
@@ -1025,6 +1248,10 @@ static void migration_trigger_throttle(RAMState *rs)
             trace_migration_throttle();
             mig_throttle_guest_down(bytes_dirty_period,
                                     bytes_dirty_threshold);
+        } else if (migrate_dirty_limit() &&
+                   migrate_dirty_limit_top_vcpus()) {
+            migration_dirty_limit_top_vcpus(rs, bytes_xfer_period,
+                                            threshold);
         } else if (migrate_dirty_limit()) {
             migration_dirty_limit_guest();
         }
@@ -1047,8 +1274,10 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 
     qemu_mutex_lock(&rs->bitmap_mutex);
     WITH_RCU_READ_LOCK_GUARD() {
-        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-            ramblock_sync_dirty_bitmap(rs, block);
+        if (!ramblock_sync_dirty_bitmap_parallel(rs)) {
+            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+                ramblock_sync_dirty_bitmap(rs, block);
+            }
         }
         stat64_set(&mig_stats.dirty_bytes_last_sync, ram_bytes_remaining());
     }
@@ -1098,6 +1327,54 @@ static void migration_bitmap_sync_precopy(RAMState *rs, bool last_stage)
     }
 }
 
+/**
+ * ram_trace_dirty_pages: report the pages dirtied since the last call
+ *
+ * Consumes the DIRTY_MEMORY_MIGRATION bitmap of all migratable RAMBlocks
+ * and, if @report, emits one ram_dirty_range trace event per run of dirty
+ * pages.  Used by calc-dirty-rate to record the write pattern of a guest
+ * and must not be called while migrating, since the migration code owns
+ * that bitmap then.
+ *
+ * Called with the iothread lock held.
+ *
+ * @report: whether to trace the dirty pages or just forget about them
+ */
+void ram_trace_dirty_pages(bool report)
+{
+    RAMBlock *block;
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_MIGRATABLE(block) {
+            unsigned long pages = block->used_length >> TARGET_PAGE_BITS;
+            unsigned long page, first = 0;
+            DirtyBitmapSnapshot *snap;
+            bool in_run = false;
+
+            snap = cpu_physical_memory_snapshot_and_clear_dirty(
+                block->mr, 0, block->used_length, DIRTY_MEMORY_MIGRATION);
+
+            for (page = 0; report && page <= pages; page++) {
+                bool dirty = page < pages &&
+                    cpu_physical_memory_snapshot_get_dirty(
+                        snap, block->offset + (page << TARGET_PAGE_BITS),
+                        TARGET_PAGE_SIZE);
+
+                if (dirty && !in_run) {
+                    first = page;
+                } else if (!dirty && in_run) {
+                    trace_ram_dirty_range(block->idstr,
+                                          (uint64_t)first << TARGET_PAGE_BITS,
+                                          (uint64_t)(page - first) <<
+                                          TARGET_PAGE_BITS);
+                }
+                in_run = dirty;
+            }
+            g_free(snap);
+        }
+    }
+}
+
 void ram_release_page(const char *rbname, uint64_t offset)
 {
     if (!migrate_release_ram() || !migration_in_postcopy()) {
@@ -1127,6 +1404,16 @@ static int save_zero_page(RAMState *rs, PageSearchStatus *pss,
         return 0;
     }
 
+    if (migrate_mapped_ram()) {
+        /*
+         * Zero pages are not written to the file, the destination
+         * leaves the page alone when its bit is clear.
+         */
+        clear_bit(offset >> TARGET_PAGE_BITS, pss->block->file_bmap);
+        stat64_add(&mig_stats.zero_pages, 1);
+        return 1;
+    }
+
     len += save_page_header(pss, file, pss->block, offset | RAM_SAVE_FLAG_ZERO);
     qemu_put_byte(file, 0);
     len += 1;
@@ -1190,14 +1477,20 @@ static int save_normal_page(PageSearchStatus *pss, RAMBlock *block,
 {
     QEMUFile *file = pss->pss_channel;
 
-    ram_transferred_add(save_page_header(pss, pss->pss_channel, block,
-                                         offset | RAM_SAVE_FLAG_PAGE));
-    if (async) {
-        qemu_put_buffer_async(file, buf, TARGET_PAGE_SIZE,
-                              migrate_release_ram() &&
-                              migration_in_postcopy());
+    if (migrate_mapped_ram()) {
+        qemu_put_buffer_at(file, buf, TARGET_PAGE_SIZE,
+                           block->pages_offset + offset);
+        set_bit(offset >> TARGET_PAGE_BITS, block->file_bmap);
     } else {
-        qemu_put_buffer(file, buf, TARGET_PAGE_SIZE);
+        ram_transferred_add(save_page_header(pss, pss->pss_channel, block,
+                                             offset | RAM_SAVE_FLAG_PAGE));
+        if (async) {
+            qemu_put_buffer_async(file, buf, TARGET_PAGE_SIZE,
+                                  migrate_release_ram() &&
+                                  migration_in_postcopy());
+        } else {
+            qemu_put_buffer(file, buf, TARGET_PAGE_SIZE);
+        }
     }
     ram_transferred_add(TARGET_PAGE_SIZE);
     stat64_add(&mig_stats.normal_pages, 1);
@@ -1256,7 +1549,10 @@ static int ram_save_multifd_page(QEMUFile *file, RAMBlock *block,
     if (multifd_queue_page(file, block, offset) < 0) {
         return -1;
     }
-    stat64_add(&mig_stats.normal_pages, 1);
+    /* With zero page detection the sender threads account the page */
+    if (!migrate_multifd_zero_page()) {
+        stat64_add(&mig_stats.normal_pages, 1);
+    }
 
     return 1;
 }
@@ -1886,6 +2182,35 @@ static void migration_page_queue_free(RAMState *rs)
     }
 }
 
+static void ram_save_queue_request(RAMState *rs, RAMBlock *ramblock,
+                                   ram_addr_t start, ram_addr_t len)
+{
+    struct RAMSrcPageRequest *new_entry =
+        g_new0(struct RAMSrcPageRequest, 1);
+    new_entry->rb = ramblock;
+    new_entry->offset = start;
+    new_entry->len = len;
+
+    memory_region_ref(ramblock->mr);
+    qemu_mutex_lock(&rs->src_page_req_mutex);
+    QSIMPLEQ_INSERT_TAIL(&rs->src_page_requests, new_entry, next_req);
+    migration_make_urgent_request();
+    qemu_mutex_unlock(&rs->src_page_req_mutex);
+}
+
+/*
+ * Length of the range following a requested page that is sent along,
+ * bounded by the end of the block.  Pages that are already clean are
+ * skipped when the queue is consumed.
+ */
+static ram_addr_t ram_save_prefetch_len(RAMBlock *ramblock, ram_addr_t end)
+{
+    ram_addr_t len = (ram_addr_t)migrate_postcopy_prefetch_pages() *
+                     qemu_ram_pagesize(ramblock);
+
+    return MIN(len, ramblock->used_length - end);
+}
+
 /**
  * ram_save_queue_pages: queue the page for transmission
  *
@@ -1946,6 +2271,8 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len,
         ram_addr_t page_start = start >> TARGET_PAGE_BITS;
         size_t page_size = qemu_ram_pagesize(ramblock);
         PageSearchStatus *pss = &ram_state->pss[RAM_CHANNEL_POSTCOPY];
+        ram_addr_t end = start + len;
+        ram_addr_t prefetch_len = ram_save_prefetch_len(ramblock, end);
         int ret = 0;
 
         qemu_mutex_lock(&rs->bitmap_mutex);
@@ -1985,20 +2312,19 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len,
         };
         qemu_mutex_unlock(&rs->bitmap_mutex);
 
+        /*
+         * Keep the preempt channel free for the next fault: the pages
+         * following this one go through the main channel instead.
+         */
+        if (!ret && prefetch_len) {
+            ram_save_queue_request(rs, ramblock, end, prefetch_len);
+        }
+
         return ret;
     }
 
-    struct RAMSrcPageRequest *new_entry =
-        g_new0(struct RAMSrcPageRequest, 1);
-    new_entry->rb = ramblock;
-    new_entry->offset = start;
-    new_entry->len = len;
-
-    memory_region_ref(ramblock->mr);
-    qemu_mutex_lock(&rs->src_page_req_mutex);
-    QSIMPLEQ_INSERT_TAIL(&rs->src_page_requests, new_entry, next_req);
-    migration_make_urgent_request();
-    qemu_mutex_unlock(&rs->src_page_req_mutex);
+    ram_save_queue_request(rs, ramblock, start,
+                           len + ram_save_prefetch_len(ramblock, start + len));
 
     return 0;
 }
@@ -2046,6 +2372,7 @@ static int ram_save_target_page_legacy(RAMState *rs, PageSearchStatus *pss)
 {
     RAMBlock *block = pss->block;
     ram_addr_t offset = ((ram_addr_t)pss->page) << TARGET_PAGE_BITS;
+    bool use_multifd;
     int res;
 
     if (control_save_page(pss, offset, &res)) {
@@ -2056,17 +2383,21 @@ static int ram_save_target_page_legacy(RAMState *rs, PageSearchStatus *pss)
         return 1;
     }
 
-    if (save_zero_page(rs, pss, offset)) {
-        return 1;
-    }
-
     /*
      * Do not use multifd in postcopy as one whole host page should be
      * placed.  Meanwhile postcopy requires atomic update of pages, so even
      * if host page size == guest page size the dest guest during run may
      * still see partially copied pages which is data corruption.
      */
-    if (migrate_multifd() && !migration_in_postcopy()) {
+    use_multifd = migrate_multifd() && !migration_in_postcopy();
+
+    /* Multifd sender threads do the zero page check themselves */
+    if (!(use_multifd && migrate_multifd_zero_page()) &&
+        save_zero_page(rs, pss, offset)) {
+        return 1;
+    }
+
+    if (use_multifd) {
         return ram_save_multifd_page(pss->pss_channel, block, offset);
     }
 
@@ -2415,6 +2746,11 @@ static void ram_save_cleanup(void *opaque)
         block->bmap = NULL;
     }
 
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        g_free(block->file_bmap);
+        block->file_bmap = NULL;
+    }
+
     xbzrle_cleanup();
     compress_threads_save_cleanup();
     ram_state_cleanup(rsp);
@@ -2924,6 +3260,60 @@ void qemu_guest_free_page_hint(void *addr, size_t len)
  * granularity of these critical sections.
  */
 
+static size_t mapped_ram_bitmap_size(RAMBlock *block)
+{
+    long num_pages = block->used_length >> TARGET_PAGE_BITS;
+
+    return BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+}
+
+/*
+ * Reserve the file regions of @block: the header goes in the stream
+ * right after the block description, then the bitmap, then the pages
+ * at an aligned offset.  The stream continues after the pages.
+ */
+static void mapped_ram_setup_ramblock(QEMUFile *file, RAMBlock *block)
+{
+    MappedRamHeader header = { };
+    size_t header_size = sizeof(header);
+    size_t bitmap_size = mapped_ram_bitmap_size(block);
+
+    block->file_bmap = bitmap_new(block->used_length >> TARGET_PAGE_BITS);
+
+    /*
+     * Save the file offsets of where the bitmap and the pages should
+     * go as they are written at the end of migration and during the
+     * iterative phase, respectively.
+     */
+    block->bitmap_offset = qemu_get_offset(file) + header_size;
+    block->pages_offset = ROUND_UP(block->bitmap_offset + bitmap_size,
+                                   MAPPED_RAM_FILE_OFFSET_ALIGNMENT);
+
+    header.version = cpu_to_be32(MAPPED_RAM_HDR_VERSION);
+    header.page_size = cpu_to_be64(TARGET_PAGE_SIZE);
+    header.bitmap_offset = cpu_to_be64(block->bitmap_offset);
+    header.pages_offset = cpu_to_be64(block->pages_offset);
+
+    qemu_put_buffer(file, (uint8_t *)&header, header_size);
+
+    /* prepare offset for next ramblock */
+    qemu_set_offset(file, block->pages_offset + block->used_length);
+}
+
+/* Write the bitmaps of valid pages once no more pages will be saved. */
+static void mapped_ram_save_bitmaps(QEMUFile *file)
+{
+    RAMBlock *block;
+
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        size_t bitmap_size = mapped_ram_bitmap_size(block);
+
+        qemu_put_buffer_at(file, (uint8_t *)block->file_bmap, bitmap_size,
+                           block->bitmap_offset);
+        ram_transferred_add(bitmap_size);
+    }
+}
+
 /**
  * ram_save_setup: Setup RAM for migration
  *
@@ -2966,6 +3356,21 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
             if (migrate_ignore_shared()) {
                 qemu_put_be64(f, block->mr->addr);
             }
+            if (migrate_mode() == MIG_MODE_CPR_TRANSFER) {
+                bool shared = migrate_ram_is_cpr_shared(block);
+
+                qemu_put_byte(f, shared);
+                if (shared) {
+                    qemu_put_be64(f, block->fd_offset);
+                    ret = qemu_file_put_fd(f, qemu_ram_get_fd(block));
+                    if (ret < 0) {
+                        return ret;
+                    }
+                }
+            }
+            if (migrate_mapped_ram()) {
+                mapped_ram_setup_ramblock(f, block);
+            }
         }
     }
 
@@ -3181,6 +3586,10 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
             qemu_file_set_error(f, ret);
             return ret;
         }
+
+        if (migrate_mapped_ram()) {
+            mapped_ram_save_bitmaps(f);
+        }
     }
 
     ret = multifd_send_sync_main(rs->pss[RAM_CHANNEL_PRECOPY].pss_channel);
@@ -3448,6 +3857,22 @@ int colo_init_ram_cache(void)
     return 0;
 }
 
+/*
+ * Multifd channels load the pages of the initial migration into RAM only,
+ * so the cache has to be filled before the first checkpoint.  It is need
+ * to hold the global lock or to have the VM stopped to call this helper.
+ */
+void colo_fill_ram_cache(void)
+{
+    RAMBlock *block;
+
+    WITH_RCU_READ_LOCK_GUARD() {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            memcpy(block->colo_cache, block->host, block->used_length);
+        }
+    }
+}
+
 /* TODO: duplicated with ram_init_bitmaps */
 void colo_incoming_start_dirty_log(void)
 {
@@ -3566,6 +3991,7 @@ int ram_load_postcopy(QEMUFile *f, int channel)
         void *page_buffer = NULL;
         void *place_source = NULL;
         RAMBlock *block = NULL;
+        bool in_place = false;
         uint8_t ch;
         int len;
 
@@ -3614,9 +4040,17 @@ int ram_load_postcopy(QEMUFile *f, int channel)
              * The migration protocol uses,  possibly smaller, target-pages
              * however the source ensures it always sends all the components
              * of a host page in one chunk.
+             * With minor fault placement the data goes straight into the
+             * backing file instead, through the alias mapping; the guest
+             * doesn't see it before the page is placed with UFFDIO_CONTINUE.
              */
-            page_buffer = tmp_page->tmp_huge_page +
-                          host_page_offset_from_ram_block_offset(block, addr);
+            in_place = block->postcopy_alias != NULL;
+            if (in_place) {
+                page_buffer = block->postcopy_alias + addr;
+            } else {
+                page_buffer = tmp_page->tmp_huge_page +
+                    host_page_offset_from_ram_block_offset(block, addr);
+            }
             /* If all TP are zero then we can optimise the place */
             if (tmp_page->target_pages == 1) {
                 tmp_page->host_addr =
@@ -3656,16 +4090,20 @@ int ram_load_postcopy(QEMUFile *f, int channel)
             /*
              * Can skip to set page_buffer when
              * this is a zero page and (block->page_size == TARGET_PAGE_SIZE).
+             * Placing in place needs the page in the backing file though.
              */
-            if (!matches_target_page_size) {
+            if (!matches_target_page_size || in_place) {
                 memset(page_buffer, ch, TARGET_PAGE_SIZE);
             }
             break;
 
         case RAM_SAVE_FLAG_PAGE:
             tmp_page->all_zero = false;
-            if (!matches_target_page_size) {
-                /* For huge pages, we always use temporary buffer */
+            if (!matches_target_page_size || in_place) {
+                /*
+                 * For huge pages, we always use temporary buffer, unless
+                 * the page is placed in place.
+                 */
                 qemu_get_buffer(f, page_buffer, TARGET_PAGE_SIZE);
             } else {
                 /*
@@ -3718,7 +4156,10 @@ int ram_load_postcopy(QEMUFile *f, int channel)
         }
 
         if (!ret && place_needed) {
-            if (tmp_page->all_zero) {
+            if (in_place) {
+                ret = postcopy_place_page_in_place(mis, tmp_page->host_addr,
+                                                   block);
+            } else if (tmp_page->all_zero) {
                 ret = postcopy_place_page_zero(mis, tmp_page->host_addr, block);
             } else {
                 ret = postcopy_place_page(mis, tmp_page->host_addr,
@@ -3789,6 +4230,372 @@ void colo_flush_ram_cache(void)
     trace_colo_flush_ram_cache_end();
 }
 
+static bool mapped_ram_read_header(QEMUFile *file, MappedRamHeader *header,
+                                   Error **errp)
+{
+    size_t ret, header_size = sizeof(MappedRamHeader);
+
+    ret = qemu_get_buffer(file, (uint8_t *)header, header_size);
+    if (ret != header_size) {
+        error_setg(errp, "Could not read whole mapped-ram migration header "
+                   "(expected %zd, got %zd bytes)", header_size, ret);
+        return false;
+    }
+
+    /* migration stream is big-endian */
+    header->version = be32_to_cpu(header->version);
+
+    if (header->version > MAPPED_RAM_HDR_VERSION) {
+        error_setg(errp, "Migration mapped-ram capability version not "
+                   "supported (expected <= %d, got %d)",
+                   MAPPED_RAM_HDR_VERSION, header->version);
+        return false;
+    }
+
+    header->page_size = be64_to_cpu(header->page_size);
+    header->bitmap_offset = be64_to_cpu(header->bitmap_offset);
+    header->pages_offset = be64_to_cpu(header->pages_offset);
+
+    return true;
+}
+
+#ifndef _WIN32
+typedef struct MappedRamPrefetchRange {
+    RAMBlock *block;
+    ram_addr_t offset;
+    size_t size;
+} MappedRamPrefetchRange;
+
+/* Runs mapped by the current load, in the order they were mapped */
+static GArray *mapped_ram_prefetch_ranges;
+
+/*
+ * Return the file descriptor to map the pages of @block from, or -1 if
+ * they have to be read.  Mapping the file over guest memory is only
+ * done for private anonymous RAM: anything else has its contents or
+ * sharing semantics defined by its backend.
+ */
+static int mapped_ram_mmap_fd(QEMUFile *f, RAMBlock *block)
+{
+    static bool discard_disabled;
+    QIOChannel *ioc = qemu_file_get_ioc(f);
+
+    if (!migrate_mapped_ram_mmap() ||
+        !object_dynamic_cast(OBJECT(ioc), TYPE_QIO_CHANNEL_FILE)) {
+        return -1;
+    }
+    if (qemu_ram_get_fd(block) >= 0 || qemu_ram_is_shared(block) ||
+        qemu_ram_pagesize(block) != qemu_real_host_page_size() ||
+        !QEMU_IS_ALIGNED(block->pages_offset, qemu_real_host_page_size())) {
+        return -1;
+    }
+
+    /*
+     * Discarding a range of a private file mapping brings the file
+     * contents back instead of zeroes, so discards must stay disabled
+     * for as long as the mappings exist, i.e. until QEMU exits.
+     */
+    if (!discard_disabled) {
+        if (ram_block_discard_disable(true)) {
+            return -1;
+        }
+        discard_disabled = true;
+    }
+
+    return QIO_CHANNEL_FILE(ioc)->fd;
+}
+
+/*
+ * Map @size bytes at @offset of @block copy-on-write from the file.
+ * Returns true on success; on failure the memory is left as it was.
+ */
+static bool map_ramblock_mapped_ram(RAMBlock *block, int fd, void *host,
+                                    ram_addr_t offset, size_t size)
+{
+    void *ptr;
+
+    if (!QEMU_IS_ALIGNED((uintptr_t)host | size, qemu_real_host_page_size())) {
+        return false;
+    }
+
+    ptr = mmap(host, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+               fd, block->pages_offset + offset);
+    if (ptr == MAP_FAILED) {
+        return false;
+    }
+
+    if (!machine_dump_guest_core(current_machine)) {
+        qemu_madvise(host, size, QEMU_MADV_DONTDUMP);
+    }
+    if (machine_mem_merge(current_machine)) {
+        qemu_madvise(host, size, QEMU_MADV_MERGEABLE);
+    }
+    trace_ram_load_mapped_ram_mmap(block->idstr, offset, size);
+
+    if (migrate_mapped_ram_prefetch()) {
+        MappedRamPrefetchRange range = {
+            .block = block, .offset = offset, .size = size,
+        };
+
+        if (!mapped_ram_prefetch_ranges) {
+            mapped_ram_prefetch_ranges =
+                g_array_new(false, false, sizeof(MappedRamPrefetchRange));
+        }
+        g_array_append_val(mapped_ram_prefetch_ranges, range);
+    }
+    return true;
+}
+
+/*
+ * Fault in a chunk of @range, unless its RAMBlock went away in the
+ * meantime.  Returns false once there is nothing left to prefetch.
+ */
+static bool mapped_ram_prefetch_chunk(MappedRamPrefetchRange *range,
+                                      int *advice)
+{
+    RAMBlock *block;
+    size_t len = MIN(range->size, MAPPED_RAM_PREFETCH_CHUNK);
+
+    RCU_READ_LOCK_GUARD();
+
+    RAMBLOCK_FOREACH(block) {
+        if (block == range->block) {
+            break;
+        }
+    }
+    if (!block || range->offset + len > block->used_length) {
+        return false;
+    }
+
+    /*
+     * MADV_POPULATE_READ maps the page cache pages into the guest without
+     * breaking the sharing; older kernels only get the readahead.
+     */
+    if (qemu_madvise(block->host + range->offset, len, *advice)) {
+        if (*advice != QEMU_MADV_POPULATE_READ) {
+            return false;
+        }
+        *advice = QEMU_MADV_WILLNEED;
+        return true;
+    }
+
+    range->offset += len;
+    range->size -= len;
+    return range->size > 0;
+}
+
+static void *mapped_ram_prefetch_thread(void *opaque)
+{
+    GArray *ranges = opaque;
+    int advice = QEMU_MADV_POPULATE_READ;
+    guint i;
+
+    rcu_register_thread();
+
+    for (i = 0; i < ranges->len; i++) {
+        MappedRamPrefetchRange *range =
+            &g_array_index(ranges, MappedRamPrefetchRange, i);
+
+        while (mapped_ram_prefetch_chunk(range, &advice)) {
+            /* nothing */
+        }
+    }
+    trace_ram_load_mapped_ram_prefetch_done(ranges->len);
+
+    rcu_unregister_thread();
+    g_array_free(ranges, true);
+    return NULL;
+}
+
+/*
+ * Start faulting in the runs mapped from the file in the background, so
+ * that the guest does not have to take a page fault on first access to
+ * each of them.  The guest does not wait for this.
+ */
+static void mapped_ram_prefetch_start(void)
+{
+    QemuThread thread;
+
+    if (!mapped_ram_prefetch_ranges) {
+        return;
+    }
+
+    qemu_thread_create(&thread, "mapped-ram-prefetch",
+                       mapped_ram_prefetch_thread,
+                       mapped_ram_prefetch_ranges, QEMU_THREAD_DETACHED);
+    mapped_ram_prefetch_ranges = NULL;
+}
+#else
+static int mapped_ram_mmap_fd(QEMUFile *f, RAMBlock *block)
+{
+    return -1;
+}
+
+static bool map_ramblock_mapped_ram(RAMBlock *block, int fd, void *host,
+                                    ram_addr_t offset, size_t size)
+{
+    return false;
+}
+
+static void mapped_ram_prefetch_start(void)
+{
+}
+#endif
+
+/*
+ * Load every run of pages marked valid in @bitmap from the file, or map
+ * the long ones if mapped-ram-mmap is enabled.
+ */
+static bool read_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
+                                     long num_pages, unsigned long *bitmap,
+                                     Error **errp)
+{
+    ERRP_GUARD();
+    unsigned long set_bit_idx, clear_bit_idx;
+    ram_addr_t offset;
+    void *host;
+    size_t read, unread, size;
+    int fd = mapped_ram_mmap_fd(f, block);
+
+    for (set_bit_idx = find_first_bit(bitmap, num_pages);
+         set_bit_idx < num_pages;
+         set_bit_idx = find_next_bit(bitmap, num_pages, clear_bit_idx + 1)) {
+
+        clear_bit_idx = find_next_zero_bit(bitmap, num_pages, set_bit_idx + 1);
+
+        unread = TARGET_PAGE_SIZE * (clear_bit_idx - set_bit_idx);
+        offset = set_bit_idx << TARGET_PAGE_BITS;
+
+        if (fd >= 0 && unread >= MAPPED_RAM_MMAP_MIN_SIZE &&
+            offset + unread <= block->used_length) {
+            host = host_from_ram_block_offset(block, offset);
+            if (host && map_ramblock_mapped_ram(block, fd, host, offset,
+                                                unread)) {
+                continue;
+            }
+        }
+
+        while (unread > 0) {
+            host = host_from_ram_block_offset(block, offset);
+            if (!host) {
+                error_setg(errp, "page outside of ramblock %s range",
+                           block->idstr);
+                return false;
+            }
+
+            size = MIN(unread, MAPPED_RAM_LOAD_BUF_SIZE);
+
+            read = qemu_get_buffer_at(f, host, size,
+                                      block->pages_offset + offset);
+            if (!read) {
+                goto err;
+            }
+            offset += read;
+            unread -= read;
+        }
+    }
+
+    return true;
+
+err:
+    qemu_file_get_error_obj(f, errp);
+    error_prepend(errp, "(%s) failed to read page " RAM_ADDR_FMT
+                  " from file offset %" PRIx64 ": ", block->idstr, offset,
+                  block->pages_offset + offset);
+    return false;
+}
+
+static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
+                                      ram_addr_t length, Error **errp)
+{
+    g_autofree unsigned long *bitmap = NULL;
+    MappedRamHeader header;
+    size_t bitmap_size;
+    long num_pages;
+
+    if (!mapped_ram_read_header(f, &header, errp)) {
+        return;
+    }
+
+    if (header.page_size != TARGET_PAGE_SIZE) {
+        error_setg(errp, "Mapped-ram migration page size mismatch "
+                   "(source %" PRIu64 ", destination %d)",
+                   header.page_size, TARGET_PAGE_SIZE);
+        return;
+    }
+
+    block->pages_offset = header.pages_offset;
+
+    /*
+     * Check the alignment of the file region that contains pages. We
+     * don't enforce MAPPED_RAM_FILE_OFFSET_ALIGNMENT to allow that
+     * value to change in the future. Do only a sanity check with page
+     * size alignment.
+     */
+    if (!QEMU_IS_ALIGNED(block->pages_offset, TARGET_PAGE_SIZE)) {
+        error_setg(errp,
+                   "Error reading ramblock %s pages, region has bad alignment",
+                   block->idstr);
+        return;
+    }
+
+    num_pages = length / header.page_size;
+    bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+
+    bitmap = g_malloc0(bitmap_size);
+    if (qemu_get_buffer_at(f, (uint8_t *)bitmap, bitmap_size,
+                           header.bitmap_offset) != bitmap_size) {
+        error_setg(errp, "Error reading dirty bitmap");
+        return;
+    }
+
+    if (!read_ramblock_mapped_ram(f, block, num_pages, bitmap, errp)) {
+        return;
+    }
+
+    /* Skip pages array */
+    qemu_set_offset(f, block->pages_offset + length);
+}
+
+/*
+ * Take over the shared memory of @block from the source, see
+ * migrate_ram_is_cpr_shared().
+ */
+static int parse_ramblock_cpr_transfer(QEMUFile *f, RAMBlock *block)
+{
+    bool shared = qemu_get_byte(f);
+    Error *local_err = NULL;
+    uint64_t fd_offset;
+    int fd;
+
+    if (shared != migrate_ram_is_cpr_shared(block)) {
+        error_report("RAM block %s is backed by shared memory only on the %s",
+                     block->idstr, shared ? "source" : "destination");
+        return -EINVAL;
+    }
+    if (!shared) {
+        return 0;
+    }
+
+    fd_offset = qemu_get_be64(f);
+    fd = qemu_file_get_fd(f);
+    if (fd < 0) {
+        return qemu_file_get_error(f);
+    }
+
+#ifndef _WIN32
+    if (qemu_ram_replace_fd(block, fd, fd_offset, &local_err)) {
+        trace_ram_load_cpr_transfer_fd(block->idstr, fd);
+        return 0;
+    }
+#else
+    error_setg(&local_err, "RAM block %s cannot be passed", block->idstr);
+#endif
+    close(fd);
+    error_report_err(local_err);
+    return -EINVAL;
+}
+
 static int parse_ramblock(QEMUFile *f, RAMBlock *block, ram_addr_t length)
 {
     int ret = 0;
@@ -3832,6 +4639,22 @@ static int parse_ramblock(QEMUFile *f, RAMBlock *block, ram_addr_t length)
             return -EINVAL;
         }
     }
+    if (migrate_mode() == MIG_MODE_CPR_TRANSFER) {
+        ret = parse_ramblock_cpr_transfer(f, block);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    if (migrate_mapped_ram()) {
+        Error *local_err = NULL;
+
+        parse_ramblock_mapped_ram(f, block, length, &local_err);
+        if (local_err) {
+            error_report_err(local_err);
+            return -EINVAL;
+        }
+        return 0;
+    }
     ret = rdma_block_notification_handle(f, block->idstr);
     if (ret < 0) {
         qemu_file_set_error(f, ret);
@@ -3961,6 +4784,9 @@ static int ram_load_precopy(QEMUFile *f)
         switch (flags & ~RAM_SAVE_FLAG_CONTINUE) {
         case RAM_SAVE_FLAG_MEM_SIZE:
             ret = parse_ramblocks(f, addr);
+            if (!ret && migrate_mapped_ram()) {
+                mapped_ram_prefetch_start();
+            }
             break;
 
         case RAM_SAVE_FLAG_ZERO:
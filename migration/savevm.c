@@ -217,6 +217,16 @@ typedef struct SaveStateEntry {
     void *opaque;
     CompatEntry *compat;
     int is_ram;
+    /*
+     * State saved by this entry while the guest was stopped, measured at
+     * the last switchover.  switchover_saved tells whether it was measured
+     * by the current migration.
+     */
+    uint64_t switchover_bytes;
+    uint64_t switchover_time_us;
+    bool switchover_saved;
+    /* Estimated size of the non-iterable state, computed at setup */
+    uint64_t switchover_estimate;
 } SaveStateEntry;
 
 typedef struct SaveState {
@@ -1311,6 +1321,39 @@ int qemu_savevm_state_prepare(Error **errp)
     return 0;
 }
 
+/*
+ * Estimate of the bytes vmstate_save() will send for @se at switchover;
+ * old style handlers are only known once measured.
+ */
+static uint64_t vmstate_save_size(SaveStateEntry *se)
+{
+    if (!se->vmsd || se->vmsd->early_setup ||
+        !vmstate_section_needed(se->vmsd, se->opaque)) {
+        return 0;
+    }
+
+    /* Section header (type, id, idstr, instance and version) and footer */
+    return 1 + 4 + 1 + strlen(se->idstr) + 4 + 4 + 1 + 4 +
+           vmstate_save_size_estimate(se->vmsd, se->opaque,
+                                      se->vmsd->version_id);
+}
+
+/* Account state saved by @se while the guest is stopped */
+static void savevm_switchover_account(SaveStateEntry *se, uint64_t bytes,
+                                      int64_t time_us)
+{
+    if (!bytes) {
+        return;
+    }
+    if (!se->switchover_saved) {
+        se->switchover_saved = true;
+        se->switchover_bytes = 0;
+        se->switchover_time_us = 0;
+    }
+    se->switchover_bytes += bytes;
+    se->switchover_time_us += time_us;
+}
+
 void qemu_savevm_state_setup(QEMUFile *f)
 {
     MigrationState *ms = migrate_get_current();
@@ -1323,6 +1366,9 @@ void qemu_savevm_state_setup(QEMUFile *f)
 
     trace_savevm_state_setup();
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        se->switchover_saved = false;
+        se->switchover_estimate = vmstate_save_size(se);
+
         if (se->vmsd && se->vmsd->early_setup) {
             ret = vmstate_save(f, se, ms->vmdesc);
             if (ret) {
@@ -1492,6 +1538,7 @@ static
 int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
 {
     int64_t start_ts_each, end_ts_each;
+    uint64_t start_bytes;
     SaveStateEntry *se;
     int ret;
 
@@ -1510,6 +1557,7 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
         }
 
         start_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        start_bytes = qemu_file_transferred(f);
         trace_savevm_section_start(se->idstr, se->section_id);
 
         save_section_header(f, se, QEMU_VM_SECTION_END);
@@ -1522,6 +1570,8 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
             return -1;
         }
         end_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        savevm_switchover_account(se, qemu_file_transferred(f) - start_bytes,
+                                  end_ts_each - start_ts_each);
         trace_vmstate_downtime_save("iterable", se->idstr, se->instance_id,
                                     end_ts_each - start_ts_each);
     }
@@ -1531,12 +1581,145 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
     return 0;
 }
 
+/*
+ * Entries whose VMSD has parallel_save set are saved by a few threads at
+ * once into memory buffers, which are then written to the stream in the
+ * usual order.  A batch is a run of consecutive such entries with the
+ * same priority, so the save order across priorities and with the other
+ * entries is kept.
+ */
+#define SAVEVM_PARALLEL_MAX_THREADS 8
+
+typedef struct {
+    SaveStateEntry *se;
+    QIOChannelBuffer *bioc;
+    QEMUFile *file;
+    JSONWriter *vmdesc;
+    int64_t time_us;
+    int ret;
+} SaveParallelEntry;
+
+typedef struct {
+    SaveParallelEntry *entries;
+    unsigned int nr_entries;
+    /* next entry to be saved, updated atomically */
+    unsigned int next;
+} SaveParallelJob;
+
+typedef struct {
+    SaveParallelJob *job;
+    QemuThread thread;
+} SaveParallelWorker;
+
+static bool vmstate_can_save_parallel(SaveStateEntry *se)
+{
+    return se->vmsd && se->vmsd->parallel_save && !se->vmsd->early_setup;
+}
+
+static void vmstate_save_parallel_run(SaveParallelJob *job)
+{
+    unsigned int i;
+
+    while ((i = qatomic_fetch_inc(&job->next)) < job->nr_entries) {
+        SaveParallelEntry *e = &job->entries[i];
+        int64_t start_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+
+        e->bioc = qio_channel_buffer_new(4096);
+        e->file = qemu_file_new_output(QIO_CHANNEL(e->bioc));
+        e->vmdesc = json_writer_new(false);
+        e->ret = vmstate_save(e->file, e->se, e->vmdesc);
+        if (!e->ret) {
+            e->ret = qemu_fflush(e->file);
+        }
+        e->time_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME) - start_ts;
+    }
+}
+
+static void *vmstate_save_parallel_thread(void *opaque)
+{
+    SaveParallelWorker *w = opaque;
+
+    rcu_register_thread();
+    vmstate_save_parallel_run(w->job);
+    rcu_unregister_thread();
+    return NULL;
+}
+
+/*
+ * Save the batch starting at *@sep, and point *@sep at its last entry.
+ * Called with the BQL held, which the workers rely on.
+ */
+static int vmstate_save_parallel(QEMUFile *f, SaveStateEntry **sep,
+                                 JSONWriter *vmdesc)
+{
+    SaveParallelWorker workers[SAVEVM_PARALLEL_MAX_THREADS] = { };
+    g_autofree SaveParallelEntry *entries = NULL;
+    SaveParallelJob job = { };
+    SaveStateEntry *first = *sep, *se;
+    unsigned int nr_threads, i;
+    int ret = 0;
+
+    for (se = first; se && vmstate_can_save_parallel(se) &&
+         save_state_priority(se) == save_state_priority(first);
+         se = QTAILQ_NEXT(se, entry)) {
+        job.nr_entries++;
+    }
+    entries = g_new0(SaveParallelEntry, job.nr_entries);
+    for (i = 0, se = first; i < job.nr_entries; i++) {
+        entries[i].se = se;
+        *sep = se;
+        se = QTAILQ_NEXT(se, entry);
+    }
+    job.entries = entries;
+
+    nr_threads = MIN(MIN(g_get_num_processors(), SAVEVM_PARALLEL_MAX_THREADS),
+                     job.nr_entries);
+
+    /* Worker 0 is the migration thread itself */
+    for (i = 0; i < nr_threads; i++) {
+        workers[i].job = &job;
+    }
+    for (i = 1; i < nr_threads; i++) {
+        qemu_thread_create(&workers[i].thread, "savevm-device",
+                           vmstate_save_parallel_thread, &workers[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+    vmstate_save_parallel_run(&job);
+    for (i = 1; i < nr_threads; i++) {
+        qemu_thread_join(&workers[i].thread);
+    }
+
+    for (i = 0; i < job.nr_entries; i++) {
+        SaveParallelEntry *e = &entries[i];
+        const char *desc = json_writer_get(e->vmdesc);
+
+        if (!ret) {
+            ret = e->ret;
+        }
+        if (!ret) {
+            qemu_put_buffer(f, e->bioc->data, e->bioc->usage);
+            if (*desc) {
+                json_writer_raw(vmdesc, NULL, desc);
+            }
+            savevm_switchover_account(e->se, e->bioc->usage, e->time_us);
+            trace_vmstate_downtime_save("non-iterable", e->se->idstr,
+                                        e->se->instance_id, e->time_us);
+        }
+        qemu_fclose(e->file);
+        object_unref(OBJECT(e->bioc));
+        json_writer_free(e->vmdesc);
+    }
+
+    return ret;
+}
+
 int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
                                                     bool in_postcopy,
                                                     bool inactivate_disks)
 {
     MigrationState *ms = migrate_get_current();
     int64_t start_ts_each, end_ts_each;
+    uint64_t start_bytes;
     JSONWriter *vmdesc = ms->vmdesc;
     int vmdesc_len;
     SaveStateEntry *se;
@@ -1548,7 +1731,17 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
             continue;
         }
 
+        if (vmstate_can_save_parallel(se)) {
+            ret = vmstate_save_parallel(f, &se, vmdesc);
+            if (ret) {
+                qemu_file_set_error(f, ret);
+                return ret;
+            }
+            continue;
+        }
+
         start_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        start_bytes = qemu_file_transferred(f);
 
         ret = vmstate_save(f, se, vmdesc);
         if (ret) {
@@ -1557,6 +1750,8 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
         }
 
         end_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        savevm_switchover_account(se, qemu_file_transferred(f) - start_bytes,
+                                  end_ts_each - start_ts_each);
         trace_vmstate_downtime_save("non-iterable", se->idstr, se->instance_id,
                                     end_ts_each - start_ts_each);
     }
@@ -1681,6 +1876,53 @@ void qemu_savevm_state_pending_exact(uint64_t *must_precopy,
     }
 }
 
+/*
+ * Estimate what saving the non-iterable state costs at switchover:
+ * @bytes to send, and the @time_us it took to save it the last time, if
+ * that was measured.  Iterable handlers report their own share through
+ * state_pending_*().
+ */
+void qemu_savevm_state_switchover_estimate(uint64_t *bytes,
+                                           uint64_t *time_us)
+{
+    SaveStateEntry *se;
+
+    *bytes = 0;
+    *time_us = 0;
+
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        if (se->ops && se->ops->save_live_iterate) {
+            continue;
+        }
+        /* A measurement beats the estimate */
+        *bytes += se->switchover_bytes ?: se->switchover_estimate;
+        *time_us += se->switchover_time_us;
+    }
+}
+
+/* Per section breakdown of the state saved at the switchover */
+MigrationDeviceDowntimeList *qemu_savevm_state_downtime_devices(void)
+{
+    MigrationDeviceDowntimeList *head = NULL, **tail = &head;
+    SaveStateEntry *se;
+
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        MigrationDeviceDowntime *dev;
+
+        if (!se->switchover_saved) {
+            continue;
+        }
+        dev = g_new0(MigrationDeviceDowntime, 1);
+        dev->idstr = g_strdup(se->idstr);
+        dev->instance_id = se->instance_id;
+        dev->bytes = se->switchover_bytes;
+        dev->time = se->switchover_time_us;
+        QAPI_LIST_APPEND(tail, dev);
+    }
+
+    return head;
+}
+
 void qemu_savevm_state_cleanup(void)
 {
     SaveStateEntry *se;
@@ -45,6 +45,9 @@ void qemu_savevm_state_pending_exact(uint64_t *must_precopy,
                                      uint64_t *can_postcopy);
 void qemu_savevm_state_pending_estimate(uint64_t *must_precopy,
                                         uint64_t *can_postcopy);
+void qemu_savevm_state_switchover_estimate(uint64_t *bytes,
+                                           uint64_t *time_us);
+MigrationDeviceDowntimeList *qemu_savevm_state_downtime_devices(void);
 void qemu_savevm_send_ping(QEMUFile *f, uint32_t value);
 void qemu_savevm_send_open_return_path(QEMUFile *f);
 int qemu_savevm_send_packaged(QEMUFile *f, const uint8_t *buf, size_t len);
@@ -451,6 +451,65 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
     return ret;
 }
 
+/*
+ * Estimate the number of bytes vmstate_save_state_v() would write for
+ * @opaque.  No pre_save hook is run, so this is safe to call while the
+ * VM is running, and fields with their own marshalling are counted at
+ * their in-memory size: the result is only an approximation.
+ */
+uint64_t vmstate_save_size_estimate(const VMStateDescription *vmsd,
+                                    void *opaque, int version_id)
+{
+    const VMStateDescription **sub = vmsd->subsections;
+    const VMStateField *field = vmsd->fields;
+    uint64_t total = 0;
+
+    while (field->name) {
+        if (vmstate_field_exists(vmsd, field, opaque, version_id)) {
+            void *first_elem = opaque + field->offset;
+            int i, n_elems = vmstate_n_elems(opaque, field);
+            int size = vmstate_size(opaque, field);
+
+            if (field->flags & VMS_POINTER) {
+                first_elem = *(void **)first_elem;
+            }
+            for (i = 0; i < n_elems && first_elem; i++) {
+                void *curr_elem = first_elem + size * i;
+
+                if (field->flags & VMS_ARRAY_OF_POINTER) {
+                    curr_elem = *(void **)curr_elem;
+                }
+                if (!curr_elem) {
+                    /* vmstate_info_nullptr placeholder */
+                    total += 1;
+                } else if (field->flags & (VMS_STRUCT | VMS_VSTRUCT)) {
+                    int struct_version = field->flags & VMS_VSTRUCT ?
+                                         field->struct_version_id :
+                                         field->vmsd->version_id;
+
+                    total += vmstate_save_size_estimate(field->vmsd, curr_elem,
+                                                        struct_version);
+                } else {
+                    total += size;
+                }
+            }
+        }
+        field++;
+    }
+
+    while (sub && *sub) {
+        if (vmstate_section_needed(*sub, opaque)) {
+            /* QEMU_VM_SUBSECTION, name length, name, version */
+            total += 1 + 1 + strlen((*sub)->name) + 4;
+            total += vmstate_save_size_estimate(*sub, opaque,
+                                                (*sub)->version_id);
+        }
+        sub++;
+    }
+
+    return total;
+}
+
 static const VMStateDescription *
 vmstate_get_subsection(const VMStateDescription **sub, char *idstr)
 {
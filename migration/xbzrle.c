@@ -15,13 +15,45 @@
 #include "qemu/host-utils.h"
 #include "xbzrle.h"
 
-#if defined(CONFIG_AVX512BW_OPT)
+#if defined(CONFIG_AVX512BW_OPT) || defined(CONFIG_AVX2_OPT) || \
+    defined(__aarch64__)
+#define XBZRLE_ACCEL
+#endif
+
+#ifdef XBZRLE_ACCEL
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#else
 #include <immintrin.h>
 #include "host/cpuinfo.h"
+#endif
 
-static int __attribute__((target("avx512bw")))
-xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                            uint8_t *dst, int dlen)
+/*
+ * The vector encoders compare 64 bytes at a time into a mask with one
+ * bit set per equal byte, and build the runs from the mask.  Bits past
+ * @len, at the tail of the page, must be set.
+ */
+typedef uint64_t (*xbzrle_cmp64_fn)(const uint8_t *old_buf,
+                                    const uint8_t *new_buf, uint32_t len);
+
+static inline uint64_t xbzrle_cmp64_tail(const uint8_t *old_buf,
+                                         const uint8_t *new_buf,
+                                         uint32_t len)
+{
+    uint64_t comp = -1;
+    uint32_t i;
+
+    for (i = 0; i < len; i++) {
+        if (old_buf[i] != new_buf[i]) {
+            comp &= ~(1ULL << i);
+        }
+    }
+    return comp;
+}
+
+static inline __attribute__((always_inline)) int
+xbzrle_encode_buffer_vec(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen, xbzrle_cmp64_fn cmp64)
 {
     uint32_t zrun_len = 0, nzrun_len = 0;
     int d = 0, i = 0, num = 0;
@@ -31,23 +63,13 @@ xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf, int slen,
     /* countResidual is tail of data, i.e., countResidual = slen % 64 */
     uint32_t count_residual = slen & 0b111111;
     bool never_same = true;
-    uint64_t mask_residual = 1;
-    mask_residual <<= count_residual;
-    mask_residual -= 1;
-    __m512i r = _mm512_set1_epi32(0);
 
     while (count512s) {
         int bytes_to_check = 64;
-        uint64_t mask = 0xffffffffffffffff;
         if (count512s == 1) {
             bytes_to_check = count_residual;
-            mask = mask_residual;
         }
-        __m512i old_data = _mm512_mask_loadu_epi8(r,
-                                                  mask, old_buf + i);
-        __m512i new_data = _mm512_mask_loadu_epi8(r,
-                                                  mask, new_buf + i);
-        uint64_t comp = _mm512_cmpeq_epi8_mask(old_data, new_data);
+        uint64_t comp = cmp64(old_buf + i, new_buf + i, bytes_to_check);
         count512s--;
 
         bool is_same = (comp & 0x1);
@@ -137,6 +159,98 @@ xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf, int slen,
     return d;
 }
 
+
+#if defined(CONFIG_AVX512BW_OPT)
+static inline uint64_t __attribute__((target("avx512bw")))
+xbzrle_cmp64_avx512(const uint8_t *old_buf, const uint8_t *new_buf,
+                    uint32_t len)
+{
+    uint64_t mask = len == 64 ? -1 : (1ULL << len) - 1;
+    __m512i r = _mm512_set1_epi32(0);
+    __m512i old_data = _mm512_mask_loadu_epi8(r, mask, old_buf);
+    __m512i new_data = _mm512_mask_loadu_epi8(r, mask, new_buf);
+
+    /* Bytes past len are loaded as zero on both sides, so they match */
+    return _mm512_cmpeq_epi8_mask(old_data, new_data);
+}
+
+static int __attribute__((target("avx512bw")))
+xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                            uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_buffer_vec(old_buf, new_buf, slen, dst, dlen,
+                                    xbzrle_cmp64_avx512);
+}
+#endif
+
+#if defined(CONFIG_AVX2_OPT)
+static inline uint64_t __attribute__((target("avx2")))
+xbzrle_cmp64_avx2(const uint8_t *old_buf, const uint8_t *new_buf,
+                  uint32_t len)
+{
+    __m256i lo, hi;
+
+    if (len != 64) {
+        return xbzrle_cmp64_tail(old_buf, new_buf, len);
+    }
+    lo = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)old_buf),
+                           _mm256_loadu_si256((const __m256i *)new_buf));
+    hi = _mm256_cmpeq_epi8(
+        _mm256_loadu_si256((const __m256i *)(old_buf + 32)),
+        _mm256_loadu_si256((const __m256i *)(new_buf + 32)));
+    return (uint32_t)_mm256_movemask_epi8(lo) |
+           ((uint64_t)(uint32_t)_mm256_movemask_epi8(hi) << 32);
+}
+
+static int __attribute__((target("avx2")))
+xbzrle_encode_buffer_avx2(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                          uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_buffer_vec(old_buf, new_buf, slen, dst, dlen,
+                                    xbzrle_cmp64_avx2);
+}
+#endif
+
+#if defined(__aarch64__)
+/* Gather the top bit of each byte of a 16 byte comparison */
+static inline uint64_t xbzrle_neon_mask16(uint8x16_t eq)
+{
+    static const uint8_t weights[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128,
+    };
+    uint8x16_t bits = vandq_u8(eq, vld1q_u8(weights));
+
+    return vaddv_u8(vget_low_u8(bits)) |
+           ((uint64_t)vaddv_u8(vget_high_u8(bits)) << 8);
+}
+
+static inline uint64_t
+xbzrle_cmp64_neon(const uint8_t *old_buf, const uint8_t *new_buf,
+                  uint32_t len)
+{
+    uint64_t comp = 0;
+    int j;
+
+    if (len != 64) {
+        return xbzrle_cmp64_tail(old_buf, new_buf, len);
+    }
+    for (j = 0; j < 4; j++) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(old_buf + j * 16),
+                                 vld1q_u8(new_buf + j * 16));
+
+        comp |= xbzrle_neon_mask16(eq) << (j * 16);
+    }
+    return comp;
+}
+
+static int xbzrle_encode_buffer_neon(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_buffer_vec(old_buf, new_buf, slen, dst, dlen,
+                                    xbzrle_cmp64_neon);
+}
+#endif
+
 static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
                                     int slen, uint8_t *dst, int dlen);
 
@@ -144,12 +258,24 @@ static int (*accel_func)(uint8_t *, uint8_t *, int, uint8_t *, int);
 
 static void __attribute__((constructor)) init_accel(void)
 {
+#if defined(__aarch64__)
+    /* Advanced SIMD is always there on AArch64 */
+    accel_func = xbzrle_encode_buffer_neon;
+#else
     unsigned info = cpuinfo_init();
+
+    accel_func = xbzrle_encode_buffer_int;
+#if defined(CONFIG_AVX2_OPT)
+    if (info & CPUINFO_AVX2) {
+        accel_func = xbzrle_encode_buffer_avx2;
+    }
+#endif
+#if defined(CONFIG_AVX512BW_OPT)
     if (info & CPUINFO_AVX512BW) {
         accel_func = xbzrle_encode_buffer_avx512;
-    } else {
-        accel_func = xbzrle_encode_buffer_int;
     }
+#endif
+#endif
 }
 
 int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
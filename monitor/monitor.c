@@ -189,21 +189,21 @@ void monitor_flush(Monitor *mon)
 /* flush at every end of line */
 int monitor_puts_locked(Monitor *mon, const char *str)
 {
-    int i;
-    char c;
+    const char *p = str;
+    const char *nl;
 
-    for (i = 0; str[i]; i++) {
-        c = str[i];
-        if (c == '\n') {
-            g_string_append_c(mon->outbuf, '\r');
-        }
-        g_string_append_c(mon->outbuf, c);
-        if (c == '\n') {
-            monitor_flush_locked(mon);
-        }
+    /* Copy whole lines at a time, and flush once they are all in */
+    while ((nl = strchr(p, '\n'))) {
+        g_string_append_len(mon->outbuf, p, nl - p);
+        g_string_append(mon->outbuf, "\r\n");
+        p = nl + 1;
+    }
+    g_string_append(mon->outbuf, p);
+    if (p != str) {
+        monitor_flush_locked(mon);
     }
 
-    return i;
+    return p - str + strlen(p);
 }
 
 int monitor_puts(Monitor *mon, const char *str)
@@ -129,19 +129,43 @@ static void monitor_qmp_cleanup_queue_and_resume(MonitorQMP *mon)
 
 }
 
+/* Called with mon->mon_lock held.  */
+static void qmp_send_response_chunk(void *opaque, const char *buf, size_t len)
+{
+    Monitor *mon = opaque;
+
+    monitor_puts_locked(mon, buf);
+    monitor_flush_locked(mon);
+}
+
 void qmp_send_response(MonitorQMP *mon, const QDict *rsp)
 {
     const QObject *data = QOBJECT(rsp);
     GString *json;
 
-    json = qobject_to_json_pretty(data, mon->pretty);
-    assert(json != NULL);
-    trace_monitor_qmp_respond(mon, json->str);
+    if (trace_event_get_state_backends(TRACE_MONITOR_QMP_RESPOND)) {
+        json = qobject_to_json_pretty(data, mon->pretty);
+        assert(json != NULL);
+        trace_monitor_qmp_respond(mon, json->str);
 
-    g_string_append_c(json, '\n');
-    monitor_puts(&mon->common, json->str);
+        g_string_append_c(json, '\n');
+        monitor_puts(&mon->common, json->str);
 
-    g_string_free(json, true);
+        g_string_free(json, true);
+        return;
+    }
+
+    /*
+     * Responses such as query-block with many devices can be megabytes
+     * large.  Rather than building the whole text and then copying it,
+     * serialize straight into the output buffer and start writing it
+     * while the rest is being produced.  mon_lock is held throughout so
+     * that nothing else is interleaved with the response.
+     */
+    QEMU_LOCK_GUARD(&mon->common.mon_lock);
+    qobject_to_json_stream(data, mon->pretty, qmp_send_response_chunk,
+                           &mon->common);
+    monitor_puts_locked(&mon->common, "\n");
 }
 
 /*
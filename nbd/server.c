@@ -42,6 +42,24 @@
  */
 #define NBD_MAX_BLOCK_STATUS_EXTENTS (1 * MiB / 8)
 
+/*
+ * Read payloads of at least NBD_ZERO_COPY_MIN_SIZE are sent with
+ * MSG_ZEROCOPY when the socket supports it; below that, pinning the
+ * pages and reaping the completion costs more than the copy.  Request
+ * buffers can only be freed once the kernel is done with them, so stop
+ * using zero copy while more than NBD_ZERO_COPY_MAX_PENDING bytes are
+ * waiting for that.
+ */
+#define NBD_ZERO_COPY_MIN_SIZE (64 * KiB)
+#define NBD_ZERO_COPY_MAX_PENDING (64 * MiB)
+
+/*
+ * After a client is gone, its deferred request buffers are kept until
+ * the kernel reports the last zero copy write as completed; they are
+ * checked every NBD_ZERO_COPY_DRAIN_INTERVAL milliseconds.
+ */
+#define NBD_ZERO_COPY_DRAIN_INTERVAL 100
+
 static int system_errno_to_nbd_errno(int err)
 {
     switch (err) {
@@ -82,9 +100,25 @@ typedef struct NBDRequestData NBDRequestData;
 struct NBDRequestData {
     NBDClient *client;
     uint8_t *data;
+    size_t data_size;
     bool complete;
 };
 
+/* A request buffer that may still be referenced by a zero copy write */
+typedef struct NBDZeroCopyBuf {
+    void *buf;
+    size_t size;
+    ssize_t seq; /* free once sioc->zero_copy_sent reaches this value */
+    QSIMPLEQ_ENTRY(NBDZeroCopyBuf) next;
+} NBDZeroCopyBuf;
+
+/* The buffers of a closed client that wait for zero copy completions */
+typedef struct NBDZeroCopyDrain {
+    QIOChannelSocket *sioc;
+    QSIMPLEQ_HEAD(, NBDZeroCopyBuf) bufs;
+    QEMUTimer *timer;
+} NBDZeroCopyDrain;
+
 struct NBDExport {
     BlockExport common;
 
@@ -136,6 +170,10 @@ struct NBDClient {
     CoMutex send_lock;
     Coroutine *send_coroutine;
 
+    bool zero_copy; /* Send large read payloads with MSG_ZEROCOPY */
+    QSIMPLEQ_HEAD(, NBDZeroCopyBuf) zero_copy_bufs;
+    size_t zero_copy_pending; /* Bytes in zero_copy_bufs */
+
     bool read_yielding;
     bool quiescing;
 
@@ -154,6 +192,7 @@ struct NBDClient {
 };
 
 static void nbd_client_receive_next_request(NBDClient *client);
+static void nbd_client_drain_zero_copy(NBDClient *client);
 
 /* Basic flow for negotiation
 
@@ -1514,6 +1553,7 @@ void nbd_client_put(NBDClient *client)
          */
         assert(client->closing);
 
+        nbd_client_drain_zero_copy(client);
         object_unref(OBJECT(client->sioc));
         object_unref(OBJECT(client->ioc));
         if (client->tlscreds) {
@@ -1562,11 +1602,154 @@ static NBDRequestData *nbd_request_get(NBDClient *client)
     return req;
 }
 
+/*
+ * Free the deferred request buffers that no zero copy write references
+ * any more, i.e. those released before the first @sent zero copy
+ * writes completed.
+ */
+static void nbd_client_free_zero_copy_bufs(NBDClient *client, ssize_t sent)
+{
+    NBDZeroCopyBuf *zbuf;
+
+    while ((zbuf = QSIMPLEQ_FIRST(&client->zero_copy_bufs)) &&
+           zbuf->seq <= sent) {
+        QSIMPLEQ_REMOVE_HEAD(&client->zero_copy_bufs, next);
+        client->zero_copy_pending -= zbuf->size;
+        qemu_vfree(zbuf->buf);
+        g_free(zbuf);
+    }
+}
+
+static void nbd_client_disable_zero_copy(NBDClient *client,
+                                         const char *reason)
+{
+    if (client->zero_copy) {
+        trace_nbd_client_disable_zero_copy(reason);
+        client->zero_copy = false;
+    }
+}
+
+/*
+ * Collect the zero copy completions that are available and free the
+ * buffers they unpin.  Buffers are left alone on error; they are
+ * freed together with the client.
+ */
+static void nbd_client_reap_zero_copy(NBDClient *client)
+{
+    Error *local_err = NULL;
+    bool copied;
+    ssize_t sent;
+
+    sent = qio_channel_socket_zero_copy_poll(client->sioc, &copied,
+                                             &local_err);
+    if (sent < 0) {
+        nbd_client_disable_zero_copy(client, error_get_pretty(local_err));
+        error_free(local_err);
+        return;
+    }
+    if (copied) {
+        /* e.g. loopback: the pinning bought nothing */
+        nbd_client_disable_zero_copy(client, "kernel copied the data");
+    }
+    nbd_client_free_zero_copy_bufs(client, sent);
+}
+
+static void nbd_zero_copy_drain_free(NBDZeroCopyDrain *drain)
+{
+    timer_free(drain->timer);
+    object_unref(OBJECT(drain->sioc));
+    g_free(drain);
+}
+
+static void nbd_zero_copy_drain_cb(void *opaque)
+{
+    NBDZeroCopyDrain *drain = opaque;
+    NBDZeroCopyBuf *zbuf;
+    Error *local_err = NULL;
+    bool copied;
+    ssize_t sent;
+
+    sent = qio_channel_socket_zero_copy_poll(drain->sioc, &copied,
+                                             &local_err);
+    if (sent < 0) {
+        /*
+         * Nothing tells any more when the kernel is done with the
+         * buffers; leak them rather than let the memory be reused
+         * while it may still be sent.
+         */
+        trace_nbd_zero_copy_drain_error(error_get_pretty(local_err));
+        error_free(local_err);
+        while ((zbuf = QSIMPLEQ_FIRST(&drain->bufs))) {
+            QSIMPLEQ_REMOVE_HEAD(&drain->bufs, next);
+            g_free(zbuf);
+        }
+        nbd_zero_copy_drain_free(drain);
+        return;
+    }
+
+    while ((zbuf = QSIMPLEQ_FIRST(&drain->bufs)) && zbuf->seq <= sent) {
+        QSIMPLEQ_REMOVE_HEAD(&drain->bufs, next);
+        qemu_vfree(zbuf->buf);
+        g_free(zbuf);
+    }
+
+    if (QSIMPLEQ_EMPTY(&drain->bufs)) {
+        nbd_zero_copy_drain_free(drain);
+    } else {
+        timer_mod(drain->timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                                NBD_ZERO_COPY_DRAIN_INTERVAL);
+    }
+}
+
+/*
+ * Called when the client is freed.  The kernel may still be sending
+ * from the deferred request buffers, so hand them over, together with
+ * a reference to the socket, to a timer that frees them as the zero
+ * copy completions arrive.
+ */
+static void nbd_client_drain_zero_copy(NBDClient *client)
+{
+    NBDZeroCopyDrain *drain;
+
+    if (QSIMPLEQ_EMPTY(&client->zero_copy_bufs)) {
+        return;
+    }
+    nbd_client_reap_zero_copy(client);
+    if (QSIMPLEQ_EMPTY(&client->zero_copy_bufs)) {
+        return;
+    }
+
+    drain = g_new0(NBDZeroCopyDrain, 1);
+    drain->sioc = client->sioc;
+    object_ref(OBJECT(drain->sioc));
+    QSIMPLEQ_INIT(&drain->bufs);
+    QSIMPLEQ_CONCAT(&drain->bufs, &client->zero_copy_bufs);
+    client->zero_copy_pending = 0;
+
+    drain->timer = timer_new_ms(QEMU_CLOCK_REALTIME, nbd_zero_copy_drain_cb,
+                                drain);
+    timer_mod(drain->timer, qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                            NBD_ZERO_COPY_DRAIN_INTERVAL);
+}
+
 static void nbd_request_put(NBDRequestData *req)
 {
     NBDClient *client = req->client;
+    QIOChannelSocket *sioc = client->sioc;
+
+    if (sioc->zero_copy_queued != sioc->zero_copy_sent) {
+        nbd_client_reap_zero_copy(client);
+    }
+    if (req->data && sioc->zero_copy_queued != sioc->zero_copy_sent) {
+        /* A zero copy write in flight may point into req->data */
+        NBDZeroCopyBuf *zbuf = g_new(NBDZeroCopyBuf, 1);
 
-    if (req->data) {
+        zbuf->buf = req->data;
+        zbuf->size = req->data_size;
+        zbuf->seq = sioc->zero_copy_queued;
+        QSIMPLEQ_INSERT_TAIL(&client->zero_copy_bufs, zbuf, next);
+        client->zero_copy_pending += zbuf->size;
+    } else if (req->data) {
         qemu_vfree(req->data);
     }
     g_free(req);
@@ -1931,6 +2114,80 @@ static int coroutine_fn nbd_co_send_iov(NBDClient *client, struct iovec *iov,
     return ret;
 }
 
+static bool nbd_client_use_zero_copy(NBDClient *client, size_t len)
+{
+    return client->zero_copy &&
+           client->ioc == QIO_CHANNEL(client->sioc) &&
+           len >= NBD_ZERO_COPY_MIN_SIZE &&
+           client->zero_copy_pending < NBD_ZERO_COPY_MAX_PENDING;
+}
+
+/*
+ * Like nbd_co_send_iov(), but the last element of @iov is read data
+ * from a request buffer, which is sent with MSG_ZEROCOPY if it is
+ * large enough.  nbd_request_put() keeps the buffer alive until the
+ * kernel is done with it.  If the zero copy write fails, e.g. because
+ * of the locked memory limit, the rest is copied and zero copy is not
+ * used for this client any more.
+ */
+static int coroutine_fn nbd_co_send_iov_data(NBDClient *client,
+                                             struct iovec *iov,
+                                             unsigned niov, Error **errp)
+{
+    struct iovec *data = &iov[niov - 1];
+    size_t done = 0;
+    int ret = 0;
+
+    if (!nbd_client_use_zero_copy(client, data->iov_len)) {
+        return nbd_co_send_iov(client, iov, niov, errp);
+    }
+
+    g_assert(qemu_in_coroutine());
+    qemu_co_mutex_lock(&client->send_lock);
+    client->send_coroutine = qemu_coroutine_self();
+
+    /* The headers live on the stack, so they must be copied */
+    if (qio_channel_writev_all(client->ioc, iov, niov - 1, errp) < 0) {
+        ret = -EIO;
+        goto out;
+    }
+
+    while (done < data->iov_len) {
+        struct iovec rest = {
+            .iov_base = (char *)data->iov_base + done,
+            .iov_len = data->iov_len - done,
+        };
+        Error *local_err = NULL;
+        ssize_t len;
+
+        len = qio_channel_writev_full(client->ioc, &rest, 1, NULL, 0,
+                                      QIO_CHANNEL_WRITE_FLAG_ZERO_COPY,
+                                      &local_err);
+        if (len == QIO_CHANNEL_ERR_BLOCK) {
+            qio_channel_yield(client->ioc, G_IO_OUT);
+            continue;
+        } else if (len < 0) {
+            nbd_client_disable_zero_copy(client,
+                                         error_get_pretty(local_err));
+            error_free(local_err);
+            break;
+        }
+        done += len;
+    }
+
+    if (done < data->iov_len &&
+        qio_channel_write_all(client->ioc, (char *)data->iov_base + done,
+                              data->iov_len - done, errp) < 0) {
+        ret = -EIO;
+    }
+
+out:
+    client->send_coroutine = NULL;
+    qemu_co_mutex_unlock(&client->send_lock);
+
+    return ret;
+}
+
 static inline void set_be_simple_reply(NBDSimpleReply *reply, uint64_t error,
                                        uint64_t cookie)
 {
@@ -1962,7 +2219,7 @@ static int coroutine_fn nbd_co_send_simple_reply(NBDClient *client,
                                    nbd_err_lookup(nbd_err), len);
     set_be_simple_reply(&reply, nbd_err, request->cookie);
 
-    return nbd_co_send_iov(client, iov, 2, errp);
+    return nbd_co_send_iov_data(client, iov, 2, errp);
 }
 
 /*
@@ -2043,7 +2300,7 @@ static int coroutine_fn nbd_co_send_chunk_read(NBDClient *client,
                  NBD_REPLY_TYPE_OFFSET_DATA, request);
     stq_be_p(&chunk.offset, offset);
 
-    return nbd_co_send_iov(client, iov, 3, errp);
+    return nbd_co_send_iov_data(client, iov, 3, errp);
 }
 
 static int coroutine_fn nbd_co_send_chunk_error(NBDClient *client,
@@ -2650,6 +2907,7 @@ static int coroutine_fn nbd_co_receive_request(NBDRequestData *req,
             error_setg(errp, "No memory");
             return -ENOMEM;
         }
+        req->data_size = request->len;
     }
     if (payload_len) {
         if (payload_okay) {
@@ -3082,6 +3340,10 @@ void nbd_client_new(QIOChannelSocket *sioc,
     client->ioc = QIO_CHANNEL(sioc);
     object_ref(OBJECT(client->ioc));
     client->close_fn = close_fn;
+    client->zero_copy =
+        qio_channel_has_feature(client->ioc,
+                                QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY);
+    QSIMPLEQ_INIT(&client->zero_copy_bufs);
 
     co = qemu_coroutine_create(nbd_co_client_start, client);
     qemu_coroutine_enter(co);
@@ -17,6 +17,7 @@
 #include <linux/if_link.h>
 #include <linux/if_xdp.h>
 #include <net/if.h>
+#include <sys/socket.h>
 #include <xdp/xsk.h>
 
 #include "clients.h"
@@ -44,6 +45,9 @@ typedef struct AFXDPState {
     bool                 read_poll;
     bool                 write_poll;
     uint32_t             outstanding_tx;
+    /* Packets submitted for Tx since the completion queue was last reaped */
+    uint32_t             tx_since_complete;
+    bool                 busy_poll;
 
     uint64_t             *pool;
     uint32_t             n_pool;
@@ -57,6 +61,9 @@ typedef struct AFXDPState {
 
 #define AF_XDP_BATCH_SIZE 64
 
+/* Busy polling timeout for SO_BUSY_POLL, in microseconds */
+#define AF_XDP_BUSY_POLL_USECS 20
+
 static void af_xdp_send(void *opaque);
 static void af_xdp_writable(void *opaque);
 
@@ -115,6 +122,20 @@ static void af_xdp_complete_tx(AFXDPState *s)
     if (done) {
         xsk_ring_cons__release(&s->cq, done);
     }
+    s->tx_since_complete = 0;
+}
+
+/*
+ * Kick the kernel to process the Tx ring.  With busy polling the kernel
+ * does not process rings on its own, so this also drives the NAPI loop.
+ */
+static void af_xdp_kick_tx(AFXDPState *s)
+{
+    if (sendto(xsk_socket__fd(s->xsk), NULL, 0, MSG_DONTWAIT, NULL, 0) < 0
+        && errno != EAGAIN && errno != EBUSY && errno != ENOBUFS
+        && errno != ENETDOWN) {
+        af_xdp_write_poll(s, true);
+    }
 }
 
 /*
@@ -140,16 +161,22 @@ static void af_xdp_writable(void *opaque)
     qemu_flush_queued_packets(&s->nc);
 }
 
-static ssize_t af_xdp_receive(NetClientState *nc,
-                              const uint8_t *buf, size_t size)
+static ssize_t af_xdp_receive_iov(NetClientState *nc,
+                                  const struct iovec *iov, int iovcnt)
 {
     AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+    size_t size = iov_size(iov, iovcnt);
     struct xdp_desc *desc;
     uint32_t idx;
     void *data;
 
-    /* Try to recover buffers that are already sent. */
-    af_xdp_complete_tx(s);
+    /*
+     * Recover buffers that are already sent once per batch, or when we
+     * are out of them.
+     */
+    if (!s->n_pool || s->tx_since_complete >= AF_XDP_BATCH_SIZE) {
+        af_xdp_complete_tx(s);
+    }
 
     if (size > XSK_UMEM__DEFAULT_FRAME_SIZE) {
         /* We can't transmit packet this size... */
@@ -169,19 +196,78 @@ static ssize_t af_xdp_receive(NetClientState *nc,
     desc->addr = s->pool[--s->n_pool];
     desc->len = size;
 
+    /* Gather straight into the UMEM frame, no intermediate linear copy */
     data = xsk_umem__get_data(s->buffer, desc->addr);
-    memcpy(data, buf, size);
+    iov_to_buf(iov, iovcnt, 0, data, size);
 
     xsk_ring_prod__submit(&s->tx, 1);
     s->outstanding_tx++;
+    s->tx_since_complete++;
 
-    if (xsk_ring_prod__needs_wakeup(&s->tx)) {
+    if (s->busy_poll) {
+        if (s->tx_since_complete >= AF_XDP_BATCH_SIZE) {
+            af_xdp_kick_tx(s);
+        }
+    } else if (xsk_ring_prod__needs_wakeup(&s->tx)) {
         af_xdp_write_poll(s, true);
     }
 
     return size;
 }
 
+static int af_xdp_receive_batch(NetClientState *nc,
+                                const NetPacketIOV *pkts, int count)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+    struct xdp_desc *desc;
+    uint32_t idx, n, i;
+    size_t size;
+
+    af_xdp_complete_tx(s);
+
+    /* Stop at the first packet that is too big, the caller drops it */
+    for (n = 0; n < count && n < s->n_pool; n++) {
+        if (iov_size(pkts[n].iov, pkts[n].iovcnt) >
+            XSK_UMEM__DEFAULT_FRAME_SIZE) {
+            break;
+        }
+    }
+    n = n ? xsk_ring_prod__reserve(&s->tx, n, &idx) : 0;
+    if (!n) {
+        return 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        size = iov_size(pkts[i].iov, pkts[i].iovcnt);
+        desc = xsk_ring_prod__tx_desc(&s->tx, idx + i);
+        desc->addr = s->pool[--s->n_pool];
+        desc->len = size;
+        iov_to_buf(pkts[i].iov, pkts[i].iovcnt, 0,
+                   xsk_umem__get_data(s->buffer, desc->addr), size);
+    }
+
+    xsk_ring_prod__submit(&s->tx, n);
+    s->outstanding_tx += n;
+    s->tx_since_complete += n;
+
+    if (s->busy_poll || xsk_ring_prod__needs_wakeup(&s->tx)) {
+        af_xdp_kick_tx(s);
+    }
+
+    return n;
+}
+
+static ssize_t af_xdp_receive(NetClientState *nc,
+                              const uint8_t *buf, size_t size)
+{
+    struct iovec iov = {
+        .iov_base = (void *)buf,
+        .iov_len = size,
+    };
+
+    return af_xdp_receive_iov(nc, &iov, 1);
+}
+
 /*
  * Complete a previous send (backend --> guest) and enable the
  * fd_read callback.
@@ -224,6 +310,11 @@ static void af_xdp_send(void *opaque)
 
     n_rx = xsk_ring_cons__peek(&s->rx, AF_XDP_BATCH_SIZE, &idx);
     if (!n_rx) {
+        if (s->busy_poll || xsk_ring_prod__needs_wakeup(&s->fq)) {
+            /* Let the kernel run its Rx processing. */
+            recvfrom(xsk_socket__fd(s->xsk), NULL, 0, MSG_DONTWAIT,
+                     NULL, NULL);
+        }
         return;
     }
 
@@ -334,6 +425,32 @@ static int af_xdp_umem_create(AFXDPState *s, int sock_fd, Error **errp)
     return 0;
 }
 
+static int af_xdp_busy_poll_setup(AFXDPState *s, int64_t budget,
+                                  Error **errp)
+{
+#ifdef SO_PREFER_BUSY_POLL
+    int fd = xsk_socket__fd(s->xsk);
+    int prefer = 1, usecs = AF_XDP_BUSY_POLL_USECS, value = budget;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+                   &prefer, sizeof(prefer)) ||
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) ||
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET,
+                   &value, sizeof(value))) {
+        error_setg_errno(errp, errno,
+                         "failed to enable busy polling for %s queue: %d",
+                         s->ifname, s->nc.queue_index);
+        return -1;
+    }
+
+    s->busy_poll = true;
+    return 0;
+#else
+    error_setg(errp, "busy polling is not supported by this host");
+    return -1;
+#endif
+}
+
 static int af_xdp_socket_create(AFXDPState *s,
                                 const NetdevAFXDPOptions *opts, Error **errp)
 {
@@ -394,6 +511,10 @@ static int af_xdp_socket_create(AFXDPState *s,
 
     s->xdp_flags = cfg.xdp_flags;
 
+    if (opts->has_busy_poll_budget) {
+        return af_xdp_busy_poll_setup(s, opts->busy_poll_budget, errp);
+    }
+
     return 0;
 }
 
@@ -402,6 +523,8 @@ static NetClientInfo net_af_xdp_info = {
     .type = NET_CLIENT_DRIVER_AF_XDP,
     .size = sizeof(AFXDPState),
     .receive = af_xdp_receive,
+    .receive_iov = af_xdp_receive_iov,
+    .receive_batch = af_xdp_receive_batch,
     .poll = af_xdp_poll,
     .cleanup = af_xdp_cleanup,
 };
@@ -466,6 +589,13 @@ int net_init_af_xdp(const Netdev *netdev,
         return -1;
     }
 
+    if (opts->has_busy_poll_budget &&
+        (opts->busy_poll_budget < 1 || opts->busy_poll_budget > UINT16_MAX)) {
+        error_setg(errp, "invalid busy-poll-budget (%" PRIi64 ") for '%s'",
+                   opts->busy_poll_budget, opts->ifname);
+        return -1;
+    }
+
     if ((opts->has_inhibit && opts->inhibit) != !!opts->sock_fds) {
         error_setg(errp, "'inhibit=on' requires 'sock-fds' and vice versa");
         return -1;
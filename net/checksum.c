@@ -19,24 +19,57 @@
 #include "net/checksum.h"
 #include "net/eth.h"
 
+/*
+ * The one's complement sum does not depend on the byte order it is done
+ * in, so add up the buffer in host order, eight bytes at a time with
+ * end-around carry, and only byte swap the folded result if needed.
+ */
 uint32_t net_checksum_add_cont(int len, uint8_t *buf, int seq)
 {
-    uint32_t sum1 = 0, sum2 = 0;
-    int i;
+    uint64_t sum = 0, sum2 = 0;
+    uint64_t w;
+    uint32_t res;
+    int i = 0;
 
-    for (i = 0; i < len - 1; i += 2) {
-        sum1 += (uint32_t)buf[i];
-        sum2 += (uint32_t)buf[i + 1];
-    }
-    if (i < len) {
-        sum1 += (uint32_t)buf[i];
+    if (len <= 0) {
+        return 0;
     }
 
-    if (seq & 1) {
-        return sum1 + (sum2 << 8);
-    } else {
-        return sum2 + (sum1 << 8);
+    /* Two independent accumulators to shorten the carry chain */
+    for (; i + 16 <= len; i += 16) {
+        w = ldq_he_p(buf + i);
+        sum += w;
+        sum += sum < w;
+        w = ldq_he_p(buf + i + 8);
+        sum2 += w;
+        sum2 += sum2 < w;
     }
+    if (i + 8 <= len) {
+        w = ldq_he_p(buf + i);
+        sum2 += w;
+        sum2 += sum2 < w;
+        i += 8;
+    }
+    sum += sum2;
+    sum += sum < sum2;
+
+    /* Less than eight bytes left, zero-padded in memory order */
+    w = 0;
+    memcpy(&w, buf + i, len - i);
+    sum += w;
+    sum += sum < w;
+
+    /* Fold to 16 bits */
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    res = (sum & 0xffff) + (sum >> 16);
+
+    /* Big endian words for an even @seq, little endian ones otherwise */
+    if (HOST_BIG_ENDIAN == !!(seq & 1)) {
+        res = bswap16(res);
+    }
+    return res;
 }
 
 uint16_t net_checksum_finish(uint32_t sum)
@@ -36,6 +36,10 @@
 #include "qemu/main-loop.h"
 #include "qemu/cutils.h"
 
+#ifdef CONFIG_LINUX
+#define NET_DGRAM_BATCH_SIZE 32
+#endif
+
 typedef struct NetDgramState {
     NetClientState nc;
     int fd;
@@ -45,6 +49,15 @@ typedef struct NetDgramState {
     /* contains destination iff connectionless */
     struct sockaddr *dest_addr;
     socklen_t dest_len;
+#ifdef CONFIG_LINUX
+    /* recvmmsg() buffers */
+    uint8_t *rx_buf;
+    struct iovec rx_iov[NET_DGRAM_BATCH_SIZE];
+    struct mmsghdr rx_msgs[NET_DGRAM_BATCH_SIZE];
+    /* received datagrams [rx_next, rx_count) are not delivered yet */
+    int rx_next;
+    int rx_count;
+#endif
 } NetDgramState;
 
 static void net_dgram_send(void *opaque);
@@ -100,10 +113,82 @@ static ssize_t net_dgram_receive(NetClientState *nc,
     return ret;
 }
 
+#ifdef CONFIG_LINUX
+static int net_dgram_receive_batch(NetClientState *nc,
+                                   const NetPacketIOV *pkts, int count)
+{
+    NetDgramState *s = DO_UPCAST(NetDgramState, nc, nc);
+    struct mmsghdr msgs[NET_DGRAM_BATCH_SIZE];
+    int done = 0;
+    int i, n, ret;
+
+    while (done < count) {
+        n = MIN(count - done, NET_DGRAM_BATCH_SIZE);
+        memset(msgs, 0, n * sizeof(msgs[0]));
+        for (i = 0; i < n; i++) {
+            msgs[i].msg_hdr.msg_name = s->dest_addr;
+            msgs[i].msg_hdr.msg_namelen = s->dest_addr ? s->dest_len : 0;
+            msgs[i].msg_hdr.msg_iov = (struct iovec *)pkts[done + i].iov;
+            msgs[i].msg_hdr.msg_iovlen = pkts[done + i].iovcnt;
+        }
+
+        ret = RETRY_ON_EINTR(sendmmsg(s->fd, msgs, n, 0));
+        if (ret < 0) {
+            if (errno == EAGAIN) {
+                net_dgram_write_poll(s, true);
+                break;
+            }
+            /* Drop the packet that failed, like net_dgram_receive() */
+            ret = 1;
+        }
+        done += ret;
+    }
+
+    return done;
+}
+#endif
+
+#ifdef CONFIG_LINUX
+static void net_dgram_send_completed(NetClientState *nc, ssize_t len);
+
+/* Pass the datagrams received by the last recvmmsg() to the peer */
+static void net_dgram_deliver(NetDgramState *s)
+{
+    NetPacketIOV pkts[NET_DGRAM_BATCH_SIZE];
+    struct iovec iov[NET_DGRAM_BATCH_SIZE];
+    int n = s->rx_count - s->rx_next;
+    int i, done;
+
+    for (i = 0; i < n; i++) {
+        iov[i].iov_base = s->rx_iov[s->rx_next + i].iov_base;
+        iov[i].iov_len = s->rx_msgs[s->rx_next + i].msg_len;
+        pkts[i].iov = &iov[i];
+        pkts[i].iovcnt = 1;
+    }
+
+    done = qemu_sendv_packet_batch(&s->nc, pkts, n, net_dgram_send_completed);
+    if (done < n) {
+        /* Datagram @done was queued, keep the rest until it is sent */
+        s->rx_next += done + 1;
+        net_dgram_read_poll(s, false);
+    } else {
+        s->rx_next = s->rx_count;
+    }
+}
+#endif
+
 static void net_dgram_send_completed(NetClientState *nc, ssize_t len)
 {
     NetDgramState *s = DO_UPCAST(NetDgramState, nc, nc);
 
+#ifdef CONFIG_LINUX
+    if (s->rx_next < s->rx_count) {
+        net_dgram_deliver(s);
+        if (s->rx_next < s->rx_count) {
+            return;
+        }
+    }
+#endif
     if (!s->read_poll) {
         net_dgram_read_poll(s, true);
     }
@@ -125,6 +210,22 @@ static void net_dgram_send(void *opaque)
     NetDgramState *s = opaque;
     int size;
 
+#ifdef CONFIG_LINUX
+    size = RETRY_ON_EINTR(recvmmsg(s->fd, s->rx_msgs, NET_DGRAM_BATCH_SIZE,
+                                   MSG_DONTWAIT, NULL));
+    if (size <= 0) {
+        return;
+    }
+    if (s->rx_msgs[0].msg_len == 0) {
+        /* end of connection */
+        net_dgram_read_poll(s, false);
+        net_dgram_write_poll(s, false);
+        return;
+    }
+    s->rx_next = 0;
+    s->rx_count = size;
+    net_dgram_deliver(s);
+#else
     size = recv(s->fd, s->rs.buf, sizeof(s->rs.buf), 0);
     if (size < 0) {
         return;
@@ -139,6 +240,7 @@ static void net_dgram_send(void *opaque)
                                net_dgram_send_completed) == 0) {
         net_dgram_read_poll(s, false);
     }
+#endif
 }
 
 static int net_dgram_mcast_create(struct sockaddr_in *mcastaddr,
@@ -247,23 +349,47 @@ static void net_dgram_cleanup(NetClientState *nc)
     g_free(s->dest_addr);
     s->dest_addr = NULL;
     s->dest_len = 0;
+#ifdef CONFIG_LINUX
+    g_free(s->rx_buf);
+    s->rx_buf = NULL;
+#endif
 }
 
 static NetClientInfo net_dgram_socket_info = {
     .type = NET_CLIENT_DRIVER_DGRAM,
     .size = sizeof(NetDgramState),
     .receive = net_dgram_receive,
+#ifdef CONFIG_LINUX
+    .receive_batch = net_dgram_receive_batch,
+#endif
     .cleanup = net_dgram_cleanup,
 };
 
 static NetDgramState *net_dgram_fd_init(NetClientState *peer,
                                         const char *model,
                                         const char *name,
-                                        int fd,
+                                        int fd, uint32_t busy_poll,
                                         Error **errp)
 {
     NetClientState *nc;
     NetDgramState *s;
+#ifdef CONFIG_LINUX
+    int usecs = busy_poll;
+    int i;
+
+    if (busy_poll &&
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usecs, sizeof(usecs)) < 0) {
+        error_setg_errno(errp, errno, "can't enable busy polling");
+        closesocket(fd);
+        return NULL;
+    }
+#else
+    if (busy_poll) {
+        error_setg(errp, "busy-poll is only supported on Linux");
+        closesocket(fd);
+        return NULL;
+    }
+#endif
 
     nc = qemu_new_net_client(&net_dgram_socket_info, peer, model, name);
 
@@ -271,6 +397,15 @@ static NetDgramState *net_dgram_fd_init(NetClientState *peer,
 
     s->fd = fd;
     net_socket_rs_init(&s->rs, net_dgram_rs_finalize, false);
+#ifdef CONFIG_LINUX
+    s->rx_buf = g_malloc(NET_DGRAM_BATCH_SIZE * NET_BUFSIZE);
+    for (i = 0; i < NET_DGRAM_BATCH_SIZE; i++) {
+        s->rx_iov[i].iov_base = s->rx_buf + i * NET_BUFSIZE;
+        s->rx_iov[i].iov_len = NET_BUFSIZE;
+        s->rx_msgs[i].msg_hdr.msg_iov = &s->rx_iov[i];
+        s->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+#endif
     net_dgram_read_poll(s, true);
 
     return s;
@@ -281,6 +416,7 @@ static int net_dgram_mcast_init(NetClientState *peer,
                                 const char *name,
                                 SocketAddress *remote,
                                 SocketAddress *local,
+                                uint32_t busy_poll,
                                 Error **errp)
 {
     NetDgramState *s;
@@ -382,7 +518,7 @@ static int net_dgram_mcast_init(NetClientState *peer,
         }
     }
 
-    s = net_dgram_fd_init(peer, model, name, fd, errp);
+    s = net_dgram_fd_init(peer, model, name, fd, busy_poll, errp);
     if (!s) {
         g_free(saddr);
         return -1;
@@ -428,11 +564,13 @@ int net_init_dgram(const Netdev *netdev, const char *name,
     struct sockaddr_in laddr_in, raddr_in;
     struct sockaddr_un laddr_un, raddr_un;
     socklen_t dest_len;
+    uint32_t busy_poll;
 
     assert(netdev->type == NET_CLIENT_DRIVER_DGRAM);
 
     remote = netdev->u.dgram.remote;
     local = netdev->u.dgram.local;
+    busy_poll = netdev->u.dgram.has_busy_poll ? netdev->u.dgram.busy_poll : 0;
 
     /* detect multicast address */
     if (remote && remote->type == SOCKET_ADDRESS_TYPE_INET) {
@@ -445,7 +583,7 @@ int net_init_dgram(const Netdev *netdev, const char *name,
 
         if (IN_MULTICAST(ntohl(mcastaddr.sin_addr.s_addr))) {
             return net_dgram_mcast_init(peer, "dram", name, remote, local,
-                                           errp);
+                                        busy_poll, errp);
         }
     }
 
@@ -576,8 +714,9 @@ int net_init_dgram(const Netdev *netdev, const char *name,
         return -1;
     }
 
-    s = net_dgram_fd_init(peer, "dgram", name, fd, errp);
+    s = net_dgram_fd_init(peer, "dgram", name, fd, busy_poll, errp);
     if (!s) {
+        g_free(dest_addr);
         return -1;
     }
 
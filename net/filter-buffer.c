@@ -84,6 +84,22 @@ static ssize_t filter_buffer_receive_iov(NetFilterState *nf,
     return iov_size(iov, iovcnt);
 }
 
+static int filter_buffer_receive_batch(NetFilterState *nf,
+                                       NetClientState *sender,
+                                       unsigned flags,
+                                       const NetPacketIOV *pkts,
+                                       int count)
+{
+    FilterBufferState *s = FILTER_BUFFER(nf);
+    int i;
+
+    for (i = 0; i < count; i++) {
+        qemu_net_queue_append_iov(s->incoming_queue, sender, flags,
+                                  pkts[i].iov, pkts[i].iovcnt, NULL);
+    }
+    return count;
+}
+
 static void filter_buffer_cleanup(NetFilterState *nf)
 {
     FilterBufferState *s = FILTER_BUFFER(nf);
@@ -183,6 +199,7 @@ static void filter_buffer_class_init(ObjectClass *oc, void *data)
     nfc->setup = filter_buffer_setup;
     nfc->cleanup = filter_buffer_cleanup;
     nfc->receive_iov = filter_buffer_receive_iov;
+    nfc->receive_batch = filter_buffer_receive_batch;
     nfc->status_changed = filter_buffer_status_changed;
 }
 
@@ -10,6 +10,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bswap.h"
 #include "net/filter.h"
 #include "net/net.h"
 #include "qapi/error.h"
@@ -45,86 +46,85 @@ struct MirrorState {
 
 typedef struct FilterSendCo {
     MirrorState *s;
-    char *buf;
-    ssize_t size;
+    uint8_t *buf;
+    size_t size;
     bool done;
     int ret;
 } FilterSendCo;
 
-static int _filter_send(MirrorState *s,
-                       char *buf,
-                       ssize_t size)
+/*
+ * Serialize the non-empty packets of @pkts into a single buffer, so that
+ * they reach the chardev with one write.  Each packet is preceded by its
+ * length and, with vnet_hdr = on, by the vnet header length, to make
+ * other modules (like colo-compare) know how to parse it correctly.
+ */
+static uint8_t *filter_pack(MirrorState *s, const NetPacketIOV *pkts,
+                            int count, size_t *size)
 {
     NetFilterState *nf = NETFILTER(s);
-    int ret = 0;
-    uint32_t len = 0;
-
-    len = htonl(size);
-    ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)&len, sizeof(len));
-    if (ret != sizeof(len)) {
-        goto err;
-    }
-
-    if (s->vnet_hdr) {
-        /*
-         * If vnet_hdr = on, we send vnet header len to make other
-         * module(like colo-compare) know how to parse net
-         * packet correctly.
-         */
-        ssize_t vnet_hdr_len;
-
-        vnet_hdr_len = nf->netdev->vnet_hdr_len;
-
-        len = htonl(vnet_hdr_len);
-        ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)&len, sizeof(len));
-        if (ret != sizeof(len)) {
-            goto err;
+    size_t hdr_len = s->vnet_hdr ? 2 * sizeof(uint32_t) : sizeof(uint32_t);
+    size_t total = 0, offset = 0, len;
+    uint8_t *buf;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        len = iov_size(pkts[i].iov, pkts[i].iovcnt);
+        if (len) {
+            total += hdr_len + len;
         }
     }
 
-    ret = qemu_chr_fe_write_all(&s->chr_out, (uint8_t *)buf, size);
-    if (ret != size) {
-        goto err;
+    *size = total;
+    if (!total) {
+        return NULL;
     }
 
-    return size;
+    buf = g_malloc(total);
+    for (i = 0; i < count; i++) {
+        len = iov_size(pkts[i].iov, pkts[i].iovcnt);
+        if (!len) {
+            continue;
+        }
+        stl_be_p(buf + offset, len);
+        offset += sizeof(uint32_t);
+        if (s->vnet_hdr) {
+            stl_be_p(buf + offset, nf->netdev->vnet_hdr_len);
+            offset += sizeof(uint32_t);
+        }
+        iov_to_buf(pkts[i].iov, pkts[i].iovcnt, 0, buf + offset, len);
+        offset += len;
+    }
 
-err:
-    return ret < 0 ? ret : -EIO;
+    return buf;
 }
 
 static void coroutine_fn filter_send_co(void *opaque)
 {
     FilterSendCo *data = opaque;
+    int ret;
 
-    data->ret = _filter_send(data->s, data->buf, data->size);
+    ret = qemu_chr_fe_write_all(&data->s->chr_out, data->buf, data->size);
+    data->ret = ret == data->size ? 0 : ret < 0 ? ret : -EIO;
     data->done = true;
     g_free(data->buf);
     aio_wait_kick();
 }
 
-static int filter_send(MirrorState *s,
-                       const struct iovec *iov,
-                       int iovcnt)
+/* Returns 0 on success, -errno on failure */
+static int filter_send(MirrorState *s, const NetPacketIOV *pkts, int count)
 {
-    ssize_t size = iov_size(iov, iovcnt);
-    char *buf = NULL;
-
-    if (!size) {
-        return 0;
-    }
-
-    buf = g_malloc(size);
-    iov_to_buf(iov, iovcnt, 0, buf, size);
-
     FilterSendCo data = {
         .s = s,
-        .size = size,
-        .buf = buf,
         .ret = 0,
     };
+    Coroutine *co;
 
-    Coroutine *co = qemu_coroutine_create(filter_send_co, &data);
+    data.buf = filter_pack(s, pkts, count, &data.size);
+    if (!data.buf) {
+        return 0;
+    }
+
+    co = qemu_coroutine_create(filter_send_co, &data);
     qemu_coroutine_enter(co);
 
     while (!data.done) {
@@ -196,9 +196,10 @@ static ssize_t filter_mirror_receive_iov(NetFilterState *nf,
                                          NetPacketSent *sent_cb)
 {
     MirrorState *s = FILTER_MIRROR(nf);
+    NetPacketIOV pkt = { .iov = iov, .iovcnt = iovcnt };
     int ret;
 
-    ret = filter_send(s, iov, iovcnt);
+    ret = filter_send(s, &pkt, 1);
     if (ret < 0) {
         error_report("filter mirror send failed(%s)", strerror(-ret));
     }
@@ -210,6 +211,23 @@ static ssize_t filter_mirror_receive_iov(NetFilterState *nf,
     return 0;
 }
 
+static int filter_mirror_receive_batch(NetFilterState *nf,
+                                       NetClientState *sender,
+                                       unsigned flags,
+                                       const NetPacketIOV *pkts,
+                                       int count)
+{
+    MirrorState *s = FILTER_MIRROR(nf);
+    int ret;
+
+    ret = filter_send(s, pkts, count);
+    if (ret < 0) {
+        error_report("filter mirror send failed(%s)", strerror(-ret));
+    }
+
+    return 0;
+}
+
 static ssize_t filter_redirector_receive_iov(NetFilterState *nf,
                                              NetClientState *sender,
                                              unsigned flags,
@@ -218,19 +236,41 @@ static ssize_t filter_redirector_receive_iov(NetFilterState *nf,
                                              NetPacketSent *sent_cb)
 {
     MirrorState *s = FILTER_REDIRECTOR(nf);
+    NetPacketIOV pkt = { .iov = iov, .iovcnt = iovcnt };
     int ret;
 
     if (qemu_chr_fe_backend_connected(&s->chr_out)) {
-        ret = filter_send(s, iov, iovcnt);
+        ret = filter_send(s, &pkt, 1);
         if (ret < 0) {
             error_report("filter redirector send failed(%s)", strerror(-ret));
+            return ret;
         }
-        return ret;
+        return iov_size(iov, iovcnt);
     } else {
         return 0;
     }
 }
 
+static int filter_redirector_receive_batch(NetFilterState *nf,
+                                           NetClientState *sender,
+                                           unsigned flags,
+                                           const NetPacketIOV *pkts,
+                                           int count)
+{
+    MirrorState *s = FILTER_REDIRECTOR(nf);
+    int ret;
+
+    if (!qemu_chr_fe_backend_connected(&s->chr_out)) {
+        return 0;
+    }
+
+    ret = filter_send(s, pkts, count);
+    if (ret < 0) {
+        error_report("filter redirector send failed(%s)", strerror(-ret));
+    }
+    return count;
+}
+
 static void filter_mirror_cleanup(NetFilterState *nf)
 {
     MirrorState *s = FILTER_MIRROR(nf);
@@ -423,6 +463,7 @@ static void filter_mirror_class_init(ObjectClass *oc, void *data)
     nfc->setup = filter_mirror_setup;
     nfc->cleanup = filter_mirror_cleanup;
     nfc->receive_iov = filter_mirror_receive_iov;
+    nfc->receive_batch = filter_mirror_receive_batch;
 }
 
 static void filter_redirector_class_init(ObjectClass *oc, void *data)
@@ -440,6 +481,7 @@ static void filter_redirector_class_init(ObjectClass *oc, void *data)
     nfc->setup = filter_redirector_setup;
     nfc->cleanup = filter_redirector_cleanup;
     nfc->receive_iov = filter_redirector_receive_iov;
+    nfc->receive_batch = filter_redirector_receive_batch;
 }
 
 static void filter_mirror_init(Object *obj)
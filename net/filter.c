@@ -45,6 +45,43 @@ ssize_t qemu_netfilter_receive(NetFilterState *nf,
     return 0;
 }
 
+/*
+ * Whether packets going in @direction can be passed to @nf in batches,
+ * i.e. @nf ignores them or implements receive_batch.
+ */
+bool qemu_netfilter_can_batch(NetFilterState *nf,
+                              NetFilterDirection direction)
+{
+    if (qemu_can_skip_netfilter(nf)) {
+        return true;
+    }
+    if (nf->direction == direction ||
+        nf->direction == NET_FILTER_DIRECTION_ALL) {
+        return NETFILTER_GET_CLASS(OBJECT(nf))->receive_batch != NULL;
+    }
+
+    return true;
+}
+
+int qemu_netfilter_receive_batch(NetFilterState *nf,
+                                 NetFilterDirection direction,
+                                 NetClientState *sender,
+                                 unsigned flags,
+                                 const NetPacketIOV *pkts,
+                                 int count)
+{
+    if (qemu_can_skip_netfilter(nf)) {
+        return 0;
+    }
+    if (nf->direction == direction ||
+        nf->direction == NET_FILTER_DIRECTION_ALL) {
+        return NETFILTER_GET_CLASS(OBJECT(nf))->receive_batch(
+                                   nf, sender, flags, pkts, count);
+    }
+
+    return 0;
+}
+
 static NetFilterState *netfilter_next(NetFilterState *nf,
                                       NetFilterDirection dir)
 {
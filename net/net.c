@@ -655,6 +655,52 @@ static ssize_t filter_receive_iov(NetClientState *nc,
     return ret;
 }
 
+static bool filter_can_batch(NetClientState *nc,
+                             NetFilterDirection direction)
+{
+    NetFilterState *nf;
+
+    QTAILQ_FOREACH(nf, &nc->filters, next) {
+        if (!qemu_netfilter_can_batch(nf, direction)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static int filter_receive_batch(NetClientState *nc,
+                                NetFilterDirection direction,
+                                NetClientState *sender,
+                                const NetPacketIOV *pkts,
+                                int count)
+{
+    int ret = 0;
+    NetFilterState *nf = NULL;
+
+    if (direction == NET_FILTER_DIRECTION_TX) {
+        QTAILQ_FOREACH(nf, &nc->filters, next) {
+            ret = qemu_netfilter_receive_batch(nf, direction, sender,
+                                               QEMU_NET_PACKET_FLAG_NONE,
+                                               pkts, count);
+            if (ret) {
+                return ret;
+            }
+        }
+    } else {
+        QTAILQ_FOREACH_REVERSE(nf, &nc->filters, next) {
+            ret = qemu_netfilter_receive_batch(nf, direction, sender,
+                                               QEMU_NET_PACKET_FLAG_NONE,
+                                               pkts, count);
+            if (ret) {
+                return ret;
+            }
+        }
+    }
+
+    return ret;
+}
+
 static ssize_t filter_receive(NetClientState *nc,
                               NetFilterDirection direction,
                               NetClientState *sender,
@@ -889,6 +935,62 @@ ssize_t qemu_sendv_packet_async(NetClientState *sender,
                                    iov, iovcnt, sent_cb);
 }
 
+/*
+ * Send @count packets like qemu_sendv_packet_async() would.  If the peer
+ * implements receive_batch and all the filters on the way implement it as
+ * well, the packets are handed to them in one go.
+ *
+ * Returns the number of packets that were sent or dropped.  If that is
+ * less than @count, the next packet has been queued and @sent_cb will be
+ * called for it, just like for a zero return from
+ * qemu_sendv_packet_async(); the remaining packets were not sent.
+ */
+int qemu_sendv_packet_batch(NetClientState *sender, const NetPacketIOV *pkts,
+                            int count, NetPacketSent *sent_cb)
+{
+    NetClientState *peer = sender->peer;
+    int done = 0;
+    int n;
+
+    if (peer && !sender->link_down && !peer->link_down &&
+        !peer->receive_disabled && peer->info->receive_batch &&
+        filter_can_batch(sender, NET_FILTER_DIRECTION_TX) &&
+        filter_can_batch(peer, NET_FILTER_DIRECTION_RX) &&
+        qemu_net_queue_is_idle(peer->incoming_queue)) {
+        for (n = 0; n < count; n++) {
+            if (iov_size(pkts[n].iov, pkts[n].iovcnt) > NET_BUFSIZE) {
+                break;
+            }
+        }
+        if (n && (filter_receive_batch(sender, NET_FILTER_DIRECTION_TX,
+                                       sender, pkts, n) ||
+                  filter_receive_batch(peer, NET_FILTER_DIRECTION_RX,
+                                       sender, pkts, n))) {
+            done = n;
+        } else if (n) {
+            done = peer->info->receive_batch(peer, pkts, n);
+            /* The filters have already seen these ones */
+            for (; done < n; done++) {
+                if (!qemu_net_queue_send_iov(peer->incoming_queue, sender,
+                                             QEMU_NET_PACKET_FLAG_NONE,
+                                             pkts[done].iov,
+                                             pkts[done].iovcnt, sent_cb)) {
+                    return done;
+                }
+            }
+        }
+    }
+
+    for (; done < count; done++) {
+        if (!qemu_sendv_packet_async(sender, pkts[done].iov,
+                                     pkts[done].iovcnt, sent_cb)) {
+            break;
+        }
+    }
+
+    return done;
+}
+
 ssize_t
 qemu_sendv_packet(NetClientState *nc, const struct iovec *iov, int iovcnt)
 {
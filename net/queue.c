@@ -302,3 +302,12 @@ bool qemu_net_queue_flush(NetQueue *queue)
     }
     return true;
 }
+
+/*
+ * Returns true if there are no packets queued and no delivery in progress,
+ * i.e. packets can be handed to the receiver directly without reordering.
+ */
+bool qemu_net_queue_is_idle(NetQueue *queue)
+{
+    return !queue->delivering && QTAILQ_EMPTY(&queue->packets);
+}
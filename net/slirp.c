@@ -139,6 +139,37 @@ static ssize_t net_slirp_receive(NetClientState *nc, const uint8_t *buf, size_t
     return size;
 }
 
+/*
+ * Hand a whole burst of guest packets to libslirp without going through
+ * the net queue for each of them.  slirp_input() consumes the packet
+ * synchronously, so only fragmented packets need to be linearized.
+ */
+static int net_slirp_receive_batch(NetClientState *nc,
+                                   const NetPacketIOV *pkts, int count)
+{
+    SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
+    g_autofree uint8_t *buf = NULL;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        const struct iovec *iov = pkts[i].iov;
+        size_t size;
+
+        if (pkts[i].iovcnt == 1) {
+            slirp_input(s->slirp, iov->iov_base, iov->iov_len);
+            continue;
+        }
+
+        if (!buf) {
+            buf = g_malloc(NET_BUFSIZE);
+        }
+        size = iov_to_buf(iov, pkts[i].iovcnt, 0, buf, NET_BUFSIZE);
+        slirp_input(s->slirp, buf, size);
+    }
+
+    return count;
+}
+
 static void slirp_smb_exit(Notifier *n, void *data)
 {
     SlirpState *s = container_of(n, SlirpState, exit_notifier);
@@ -172,6 +203,7 @@ static NetClientInfo net_slirp_info = {
     .type = NET_CLIENT_DRIVER_USER,
     .size = sizeof(SlirpState),
     .receive = net_slirp_receive,
+    .receive_batch = net_slirp_receive_batch,
     .cleanup = net_slirp_cleanup,
 };
 
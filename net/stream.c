@@ -113,6 +113,68 @@ static ssize_t net_stream_receive(NetClientState *nc, const uint8_t *buf,
     return size;
 }
 
+#define NET_STREAM_BATCH_IOV 64
+
+/*
+ * Write as many length-prefixed packets as possible with one writev().
+ * A packet that was only partly written is finished by net_stream_receive()
+ * thanks to send_index.
+ */
+static int net_stream_receive_batch(NetClientState *nc,
+                                    const NetPacketIOV *pkts, int count)
+{
+    NetStreamState *s = DO_UPCAST(NetStreamState, nc, nc);
+    struct iovec iov[NET_STREAM_BATCH_IOV];
+    uint32_t len[NET_STREAM_BATCH_IOV / 2];
+    size_t size[NET_STREAM_BATCH_IOV / 2];
+    int done = 0;
+
+    if (s->send_index) {
+        return 0;
+    }
+
+    while (done < count) {
+        unsigned int niov = 0;
+        ssize_t ret;
+        int n = 0, i;
+
+        while (done + n < count && n < ARRAY_SIZE(len) &&
+               niov + 1 + pkts[done + n].iovcnt <= NET_STREAM_BATCH_IOV) {
+            const NetPacketIOV *pkt = &pkts[done + n];
+
+            size[n] = iov_size(pkt->iov, pkt->iovcnt);
+            len[n] = htonl(size[n]);
+            iov[niov].iov_base = &len[n];
+            iov[niov].iov_len = sizeof(len[n]);
+            memcpy(&iov[niov + 1], pkt->iov, pkt->iovcnt * sizeof(*iov));
+            niov += 1 + pkt->iovcnt;
+            n++;
+        }
+        if (!n) {
+            break;
+        }
+
+        ret = qio_channel_writev(s->ioc, iov, niov, NULL);
+        if (ret == QIO_CHANNEL_ERR_BLOCK) {
+            ret = 0;
+        }
+        if (ret < 0) {
+            /* let net_stream_receive() report the error */
+            break;
+        }
+        for (i = 0; i < n && (size_t)ret >= sizeof(uint32_t) + size[i]; i++) {
+            ret -= sizeof(uint32_t) + size[i];
+        }
+        done += i;
+        if (i < n) {
+            s->send_index = ret;
+            break;
+        }
+    }
+
+    return done;
+}
+
 static gboolean net_stream_send(QIOChannel *ioc,
                                 GIOCondition condition,
                                 gpointer data);
@@ -231,6 +293,7 @@ static NetClientInfo net_stream_info = {
     .type = NET_CLIENT_DRIVER_STREAM,
     .size = sizeof(NetStreamState),
     .receive = net_stream_receive,
+    .receive_batch = net_stream_receive_batch,
     .cleanup = net_stream_cleanup,
 };
 
@@ -0,0 +1,116 @@
+/*
+ * Batched tap I/O with io_uring
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * A tap file descriptor only moves one packet per read() or write(), so
+ * the userspace data path pays one system call per packet.  Here a batch
+ * of reads or writes is queued on a private io_uring and submitted with a
+ * single system call.  The requests use RWF_NOWAIT, so they complete
+ * inline, with -EAGAIN when the tap device has no packet to read or no
+ * room to write, and io_uring_submit_and_wait() never blocks.
+ */
+
+#include "qemu/osdep.h"
+#include <liburing.h>
+#include "qapi/error.h"
+#include "tap_int.h"
+
+struct TapIOUring {
+    struct io_uring ring;
+};
+
+TapIOUring *tap_io_uring_new(Error **errp)
+{
+    TapIOUring *u = g_new0(TapIOUring, 1);
+    int ret;
+
+    ret = io_uring_queue_init(TAP_IO_URING_BATCH, &u->ring, 0);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "failed to create io_uring");
+        g_free(u);
+        return NULL;
+    }
+    return u;
+}
+
+void tap_io_uring_free(TapIOUring *u)
+{
+    if (u) {
+        io_uring_queue_exit(&u->ring);
+        g_free(u);
+    }
+}
+
+static int tap_io_uring_rw(TapIOUring *u, int fd, bool write,
+                           unsigned link_flag, struct iovec *const *iov,
+                           const int *iovcnt, int count, ssize_t *res)
+{
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    int i, ret;
+
+    assert(count > 0 && count <= TAP_IO_URING_BATCH);
+
+    for (i = 0; i < count; i++) {
+        sqe = io_uring_get_sqe(&u->ring);
+        assert(sqe);
+        if (write) {
+            io_uring_prep_writev(sqe, fd, iov[i], iovcnt[i], 0);
+        } else {
+            io_uring_prep_readv(sqe, fd, iov[i], iovcnt[i], 0);
+        }
+        sqe->rw_flags = RWF_NOWAIT;
+        if (i < count - 1) {
+            sqe->flags |= link_flag;
+        }
+        io_uring_sqe_set_data(sqe, (void *)(uintptr_t)i);
+    }
+
+    ret = io_uring_submit_and_wait(&u->ring, count);
+    if (ret < 0) {
+        return ret;
+    }
+
+    for (i = 0; i < count; i++) {
+        ret = io_uring_wait_cqe(&u->ring, &cqe);
+        if (ret < 0) {
+            return ret;
+        }
+        res[(uintptr_t)io_uring_cqe_get_data(cqe)] = cqe->res;
+        io_uring_cqe_seen(&u->ring, cqe);
+    }
+    return 0;
+}
+
+/*
+ * Read up to @count packets from @fd, one into each of @iov[0..count-1].
+ * The reads are hard-linked, so they are issued in order but all of them
+ * run even if some find no packet.  @res[i] receives the length of the
+ * i-th packet or -errno.
+ *
+ * Returns 0 on success, -errno if the batch could not be submitted.
+ */
+int tap_io_uring_readv(TapIOUring *u, int fd, struct iovec *const *iov,
+                       const int *iovcnt, int count, ssize_t *res)
+{
+    return tap_io_uring_rw(u, fd, false, IOSQE_IO_HARDLINK, iov, iovcnt,
+                           count, res);
+}
+
+/*
+ * Write @count packets to @fd.  The writes are linked: after the first
+ * one that fails, the others are not attempted and complete with
+ * -ECANCELED.  @res[i] receives the result of the i-th write.
+ *
+ * Returns 0 on success, -errno if the batch could not be submitted.
+ */
+int tap_io_uring_writev(TapIOUring *u, int fd, struct iovec *const *iov,
+                        const int *iovcnt, int count, ssize_t *res)
+{
+    return tap_io_uring_rw(u, fd, true, IOSQE_IO_LINK, iov, iovcnt,
+                           count, res);
+}
@@ -62,6 +62,16 @@ typedef struct TAPState {
     VHostNetState *vhost_net;
     unsigned host_vnet_hdr_len;
     Notifier exit;
+#ifdef CONFIG_LINUX_IO_URING
+    TapIOUring *uring;
+    /* Buffers for batched reads, NET_BUFSIZE bytes each */
+    uint8_t *rx_buf;
+    struct iovec rx_iov[TAP_IO_URING_BATCH];
+    /* Packets read by the last batch, [rx_next, rx_count) not sent yet */
+    struct iovec rx_pkt[TAP_IO_URING_BATCH];
+    int rx_next;
+    int rx_count;
+#endif
 } TAPState;
 
 static void launch_script(const char *setup_script, const char *ifname,
@@ -175,9 +185,141 @@ ssize_t tap_read_packet(int tapfd, uint8_t *buf, int maxlen)
 }
 #endif
 
+#ifdef CONFIG_LINUX_IO_URING
+static int tap_receive_batch(NetClientState *nc, const NetPacketIOV *pkts,
+                             int count)
+{
+    TAPState *s = DO_UPCAST(TAPState, nc, nc);
+    struct virtio_net_hdr_mrg_rxbuf hdr = { };
+    struct iovec *iovp[TAP_IO_URING_BATCH];
+    int iovcnt[TAP_IO_URING_BATCH];
+    ssize_t res[TAP_IO_URING_BATCH];
+    g_autofree struct iovec *iov = NULL;
+    bool add_hdr = s->host_vnet_hdr_len && !s->using_vnet_hdr;
+    int i, n = 0, done;
+
+    if (!s->uring) {
+        return 0;
+    }
+
+    count = MIN(count, TAP_IO_URING_BATCH);
+    for (i = 0; i < count; i++) {
+        n += pkts[i].iovcnt + 1;
+    }
+
+    iov = g_new(struct iovec, n);
+    for (i = 0, n = 0; i < count; i++) {
+        iovp[i] = &iov[n];
+        iovcnt[i] = pkts[i].iovcnt;
+        if (add_hdr) {
+            iov[n].iov_base = &hdr;
+            iov[n].iov_len = s->host_vnet_hdr_len;
+            n++;
+            iovcnt[i]++;
+        }
+        memcpy(&iov[n], pkts[i].iov, pkts[i].iovcnt * sizeof(*iov));
+        n += pkts[i].iovcnt;
+    }
+
+    if (tap_io_uring_writev(s->uring, s->fd, iovp, iovcnt, count, res) < 0) {
+        return 0;
+    }
+
+    /*
+     * The first failed write cancels the following ones; that packet is
+     * retried through tap_receive_iov(), which takes care of -EAGAIN.
+     */
+    for (done = 0; done < count && res[done] >= 0; done++) {
+        /* nothing */
+    }
+    return done;
+}
+
+static void tap_send_completed(NetClientState *nc, ssize_t len);
+
+/* Pass the packets read by the last batch to the peer */
+static void tap_deliver(TAPState *s)
+{
+    NetPacketIOV pkts[TAP_IO_URING_BATCH];
+    int n = s->rx_count - s->rx_next;
+    int i, done;
+
+    for (i = 0; i < n; i++) {
+        pkts[i].iov = &s->rx_pkt[s->rx_next + i];
+        pkts[i].iovcnt = 1;
+    }
+
+    done = qemu_sendv_packet_batch(&s->nc, pkts, n, tap_send_completed);
+    if (done < n) {
+        /* Packet @done was queued, keep the rest until it is sent */
+        s->rx_next += done + 1;
+        tap_read_poll(s, false);
+    } else {
+        s->rx_next = s->rx_count;
+    }
+}
+
+/* Returns false if the batch could not be submitted */
+static bool tap_send_batch(TAPState *s)
+{
+    struct iovec *iovp[TAP_IO_URING_BATCH];
+    int iovcnt[TAP_IO_URING_BATCH];
+    ssize_t res[TAP_IO_URING_BATCH];
+    bool pad = net_peer_needs_padding(&s->nc);
+    int i, n = 0;
+
+    for (i = 0; i < TAP_IO_URING_BATCH; i++) {
+        iovp[i] = &s->rx_iov[i];
+        iovcnt[i] = 1;
+    }
+    if (tap_io_uring_readv(s->uring, s->fd, iovp, iovcnt,
+                           TAP_IO_URING_BATCH, res) < 0) {
+        return false;
+    }
+
+    /* A packet may arrive after a read found the device empty */
+    for (i = 0; i < TAP_IO_URING_BATCH; i++) {
+        uint8_t *buf = s->rx_iov[i].iov_base;
+        ssize_t size = res[i];
+
+        if (size <= 0) {
+            continue;
+        }
+        if (s->host_vnet_hdr_len && !s->using_vnet_hdr) {
+            buf  += s->host_vnet_hdr_len;
+            size -= s->host_vnet_hdr_len;
+        }
+        /* The buffers have room to pad short frames in place */
+        if (pad && size < ETH_ZLEN) {
+            memset(buf + size, 0, ETH_ZLEN - size);
+            size = ETH_ZLEN;
+        }
+        s->rx_pkt[n].iov_base = buf;
+        s->rx_pkt[n].iov_len = size;
+        n++;
+    }
+
+    s->rx_next = 0;
+    s->rx_count = n;
+    if (n) {
+        tap_deliver(s);
+    }
+    return true;
+}
+#endif
+
 static void tap_send_completed(NetClientState *nc, ssize_t len)
 {
     TAPState *s = DO_UPCAST(TAPState, nc, nc);
+
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->rx_next < s->rx_count) {
+        tap_deliver(s);
+        if (s->rx_next < s->rx_count) {
+            return;
+        }
+    }
+#endif
     tap_read_poll(s, true);
 }
 
@@ -187,6 +329,12 @@ static void tap_send(void *opaque)
     int size;
     int packets = 0;
 
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->uring && tap_send_batch(s)) {
+        return;
+    }
+#endif
+
     while (true) {
         uint8_t *buf = s->buf;
         uint8_t min_pkt[ETH_ZLEN];
@@ -360,6 +508,12 @@ static void tap_cleanup(NetClientState *nc)
     tap_write_poll(s, false);
     close(s->fd);
     s->fd = -1;
+#ifdef CONFIG_LINUX_IO_URING
+    tap_io_uring_free(s->uring);
+    s->uring = NULL;
+    g_free(s->rx_buf);
+    s->rx_buf = NULL;
+#endif
 }
 
 static void tap_poll(NetClientState *nc, bool enable)
@@ -392,6 +546,9 @@ static NetClientInfo net_tap_info = {
     .receive = tap_receive,
     .receive_raw = tap_receive_raw,
     .receive_iov = tap_receive_iov,
+#ifdef CONFIG_LINUX_IO_URING
+    .receive_batch = tap_receive_batch,
+#endif
     .poll = tap_poll,
     .cleanup = tap_cleanup,
     .has_ufo = tap_has_ufo,
@@ -713,6 +870,25 @@ static void net_init_tap_one(const NetdevTapOptions *tap, NetClientState *peer,
         goto failed;
     }
 
+    if (tap->has_io_uring && tap->io_uring) {
+#ifdef CONFIG_LINUX_IO_URING
+        int i;
+
+        s->uring = tap_io_uring_new(errp);
+        if (!s->uring) {
+            goto failed;
+        }
+        s->rx_buf = g_malloc(TAP_IO_URING_BATCH * NET_BUFSIZE);
+        for (i = 0; i < TAP_IO_URING_BATCH; i++) {
+            s->rx_iov[i].iov_base = s->rx_buf + i * NET_BUFSIZE;
+            s->rx_iov[i].iov_len = NET_BUFSIZE;
+        }
+#else
+        error_setg(errp, "io-uring is not supported by this QEMU build");
+        goto failed;
+#endif
+    }
+
     if (tap->fd || tap->fds) {
         qemu_set_info_str(&s->nc, "fd=%d", fd);
     } else if (tap->helper) {
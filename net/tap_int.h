@@ -48,4 +48,18 @@ int tap_fd_disable(int fd);
 int tap_fd_get_ifname(int fd, char *ifname);
 int tap_fd_set_steering_ebpf(int fd, int prog_fd);
 
+/* Maximum number of packets read or written at once with io_uring */
+#define TAP_IO_URING_BATCH 32
+
+typedef struct TapIOUring TapIOUring;
+
+#ifdef CONFIG_LINUX_IO_URING
+TapIOUring *tap_io_uring_new(Error **errp);
+void tap_io_uring_free(TapIOUring *u);
+int tap_io_uring_readv(TapIOUring *u, int fd, struct iovec *const *iov,
+                       const int *iovcnt, int count, ssize_t *res);
+int tap_io_uring_writev(TapIOUring *u, int fd, struct iovec *const *iov,
+                        const int *iovcnt, int count, ssize_t *res);
+#endif
+
 #endif /* NET_TAP_INT_H */
@@ -19,6 +19,8 @@
 #include "qemu/option.h"
 #include "qemu/rcu_queue.h"
 #include "qemu/xxhash.h"
+#include "qemu/units.h"
+#include "qemu/host-utils.h"
 #include "qemu/rcu.h"
 #include "hw/core/cpu.h"
 
@@ -209,6 +211,53 @@ plugin_register_cb_udata(qemu_plugin_id_t id, enum qemu_plugin_event ev,
     do_plugin_register_cb(id, ev, func, udata);
 }
 
+/*
+ * Make room for @cpu in every scoreboard. Translated code embeds the
+ * address of each scoreboard, so resizing them requires stopping all
+ * vCPUs and flushing the code cache.
+ */
+static void plugin_grow_scoreboards__locked(CPUState *cpu)
+{
+    size_t scoreboard_size = plugin.scoreboard_alloc_size;
+    struct qemu_plugin_scoreboard *score;
+
+    if (cpu->cpu_index < scoreboard_size) {
+        return;
+    }
+    while (cpu->cpu_index >= scoreboard_size) {
+        scoreboard_size *= 2;
+    }
+
+    if (QLIST_EMPTY(&plugin.scoreboards)) {
+        /* just update size for future scoreboards */
+        plugin.scoreboard_alloc_size = scoreboard_size;
+        return;
+    }
+
+    /*
+     * Once guest code runs, new vCPUs are only created from vCPU threads
+     * (e.g. clone in linux-user); system emulation sizes scoreboards for
+     * max_cpus up front and never gets here without a current_cpu.
+     */
+    g_assert(current_cpu);
+
+    /* Don't hold the plugin lock while waiting for others to stop. */
+    qemu_rec_mutex_unlock(&plugin.lock);
+    start_exclusive();
+    qemu_rec_mutex_lock(&plugin.lock);
+
+    /* another vCPU may have grown the scoreboards in the meantime */
+    if (scoreboard_size > plugin.scoreboard_alloc_size) {
+        QLIST_FOREACH(score, &plugin.scoreboards, entry) {
+            g_array_set_size(score->data, scoreboard_size);
+        }
+        plugin.scoreboard_alloc_size = scoreboard_size;
+        /* we are in an exclusive context, so this flushes synchronously */
+        tb_flush(current_cpu);
+    }
+    end_exclusive();
+}
+
 void qemu_plugin_vcpu_init_hook(CPUState *cpu)
 {
     bool success;
@@ -218,15 +267,34 @@ void qemu_plugin_vcpu_init_hook(CPUState *cpu)
     success = g_hash_table_insert(plugin.cpu_ht, &cpu->cpu_index,
                                   &cpu->cpu_index);
     g_assert(success);
+    plugin_grow_scoreboards__locked(cpu);
     qemu_rec_mutex_unlock(&plugin.lock);
 
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_INIT);
 }
 
+static void plugin_mem_batch_flush_all(CPUState *cpu)
+{
+    struct qemu_plugin_mem_batch *batch;
+    unsigned int i;
+
+    QEMU_LOCK_GUARD(&plugin.lock);
+    QLIST_FOREACH(batch, &plugin.mem_batches, entry) {
+        if (cpu) {
+            qemu_plugin_mem_batch_flush_vcpu(batch, cpu->cpu_index);
+            continue;
+        }
+        for (i = 0; i < batch->rings->data->len; i++) {
+            qemu_plugin_mem_batch_flush_vcpu(batch, i);
+        }
+    }
+}
+
 void qemu_plugin_vcpu_exit_hook(CPUState *cpu)
 {
     bool success;
 
+    plugin_mem_batch_flush_all(cpu);
     plugin_vcpu_cb__simple(cpu, QEMU_PLUGIN_EV_VCPU_EXIT);
 
     qemu_rec_mutex_lock(&plugin.lock);
@@ -289,6 +357,24 @@ void plugin_register_inline_op(GArray **arr,
     dyn_cb->userp = ptr;
     dyn_cb->type = PLUGIN_CB_INLINE;
     dyn_cb->rw = rw;
+    dyn_cb->inline_insn.entry = (qemu_plugin_u64) { NULL, 0 };
+    dyn_cb->inline_insn.op = op;
+    dyn_cb->inline_insn.imm = imm;
+}
+
+void plugin_register_inline_op_on_entry(GArray **arr,
+                                        enum qemu_plugin_mem_rw rw,
+                                        enum qemu_plugin_op op,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = NULL;
+    dyn_cb->type = PLUGIN_CB_INLINE;
+    dyn_cb->rw = rw;
+    dyn_cb->inline_insn.entry = entry;
     dyn_cb->inline_insn.op = op;
     dyn_cb->inline_insn.imm = imm;
 }
@@ -306,6 +392,40 @@ void plugin_register_dyn_cb__udata(GArray **arr,
     dyn_cb->type = PLUGIN_CB_REGULAR;
 }
 
+void plugin_register_dyn_cond_cb__udata(GArray **arr,
+                                        qemu_plugin_vcpu_udata_cb_t cb,
+                                        enum qemu_plugin_cb_flags flags,
+                                        enum qemu_plugin_cond cond,
+                                        qemu_plugin_u64 entry,
+                                        uint64_t imm,
+                                        void *udata)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+
+    dyn_cb->userp = udata;
+    /* Note flags are discarded as unused. */
+    dyn_cb->f.vcpu_udata = cb;
+    dyn_cb->type = PLUGIN_CB_COND;
+    dyn_cb->cond.entry = entry;
+    dyn_cb->cond.cond = cond;
+    dyn_cb->cond.imm = imm;
+}
+
+void plugin_register_vcpu_mem_batch(GArray **arr,
+                                    enum qemu_plugin_mem_rw rw,
+                                    struct qemu_plugin_mem_batch *batch,
+                                    uint64_t pc)
+{
+    struct qemu_plugin_dyn_cb *dyn_cb;
+
+    dyn_cb = plugin_get_dyn_cb(arr);
+    dyn_cb->userp = NULL;
+    dyn_cb->type = PLUGIN_CB_BATCH;
+    dyn_cb->rw = rw;
+    dyn_cb->mem_batch.batch = batch;
+    dyn_cb->mem_batch.pc = pc;
+}
+
 void plugin_register_vcpu_mem_cb(GArray **arr,
                                  void *cb,
                                  enum qemu_plugin_cb_flags flags,
@@ -431,9 +551,11 @@ void qemu_plugin_flush_cb(void)
     plugin_cb__simple(QEMU_PLUGIN_EV_FLUSH);
 }
 
-void exec_inline_op(struct qemu_plugin_dyn_cb *cb)
+void exec_inline_op(struct qemu_plugin_dyn_cb *cb, int cpu_index)
 {
-    uint64_t *val = cb->userp;
+    const qemu_plugin_u64 *entry = &cb->inline_insn.entry;
+    char *base = plugin_u64_base(entry, cb->userp);
+    uint64_t *val = (uint64_t *)(base + cpu_index * plugin_u64_stride(entry));
 
     switch (cb->inline_insn.op) {
     case QEMU_PLUGIN_INLINE_ADD_U64:
@@ -444,6 +566,96 @@ void exec_inline_op(struct qemu_plugin_dyn_cb *cb)
     }
 }
 
+static struct qemu_plugin_mem_ring *
+plugin_mem_ring(struct qemu_plugin_mem_batch *batch, unsigned int cpu_index)
+{
+    GArray *data = batch->rings->data;
+
+    return (void *)(data->data + cpu_index * g_array_get_element_size(data));
+}
+
+/*
+ * Hand the records a vCPU appended since the last flush to the plugin.
+ * Only the vCPU itself, or anyone while it is stopped, may flush.
+ */
+void qemu_plugin_mem_batch_flush_vcpu(struct qemu_plugin_mem_batch *batch,
+                                      unsigned int cpu_index)
+{
+    struct qemu_plugin_mem_ring *ring = plugin_mem_ring(batch, cpu_index);
+    uint64_t seq = ring->seq;
+    uint64_t start = ring->flushed;
+    uint64_t lost = 0;
+
+    if (seq - start > batch->n_records) {
+        /* the oldest records were overwritten */
+        lost = seq - start - batch->n_records;
+        start = seq - batch->n_records;
+    }
+    while (start != seq) {
+        size_t idx = start & (batch->n_records - 1);
+        size_t n = MIN(seq - start, batch->n_records - idx);
+
+        batch->cb(cpu_index, &ring->records[idx], n, lost, batch->userdata);
+        lost = 0;
+        start += n;
+    }
+    ring->flushed = seq;
+}
+
+/* The C equivalent of the inline code, for accesses made by helpers */
+static void plugin_mem_batch_record(const struct qemu_plugin_dyn_cb *cb,
+                                    unsigned int cpu_index, uint64_t vaddr,
+                                    qemu_plugin_meminfo_t info)
+{
+    struct qemu_plugin_mem_batch *batch = cb->mem_batch.batch;
+    struct qemu_plugin_mem_ring *ring = plugin_mem_ring(batch, cpu_index);
+    qemu_plugin_mem_record *rec;
+
+    rec = &ring->records[ring->seq & (batch->n_records - 1)];
+    rec->vaddr = vaddr;
+    rec->pc = cb->mem_batch.pc;
+    rec->info = info;
+    ring->seq++;
+
+    if (ring->seq - ring->flushed >= batch->n_records / 2) {
+        qemu_plugin_mem_batch_flush_vcpu(batch, cpu_index);
+    }
+}
+
+struct qemu_plugin_mem_batch *
+plugin_mem_batch_new(size_t n_records, qemu_plugin_vcpu_mem_batch_cb_t cb,
+                     void *userdata)
+{
+    struct qemu_plugin_mem_batch *batch = g_new0(struct qemu_plugin_mem_batch,
+                                                 1);
+
+    /* generated code indexes the rings with 32-bit arithmetic */
+    n_records = pow2ceil(MIN(MAX(n_records, 64), 64 * KiB));
+
+    batch->n_records = n_records;
+    batch->rings = plugin_scoreboard_new(sizeof(struct qemu_plugin_mem_ring) +
+                                         n_records *
+                                         sizeof(qemu_plugin_mem_record));
+    batch->cb = cb;
+    batch->userdata = userdata;
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_INSERT_HEAD(&plugin.mem_batches, batch, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    return batch;
+}
+
+void plugin_mem_batch_free(struct qemu_plugin_mem_batch *batch)
+{
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_REMOVE(batch, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    plugin_scoreboard_free(batch->rings);
+    g_free(batch);
+}
+
 void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                              MemOpIdx oi, enum qemu_plugin_mem_rw rw)
 {
@@ -466,7 +678,11 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                            vaddr, cb->userp);
             break;
         case PLUGIN_CB_INLINE:
-            exec_inline_op(cb);
+            exec_inline_op(cb, cpu->cpu_index);
+            break;
+        case PLUGIN_CB_BATCH:
+            plugin_mem_batch_record(cb, cpu->cpu_index, vaddr,
+                                    make_plugin_meminfo(oi, rw));
             break;
         default:
             g_assert_not_reached();
@@ -474,8 +690,39 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
     }
 }
 
+struct qemu_plugin_scoreboard *plugin_scoreboard_new(size_t element_size)
+{
+    struct qemu_plugin_scoreboard *score =
+        g_new0(struct qemu_plugin_scoreboard, 1);
+    int max_vcpus = qemu_plugin_n_max_vcpus();
+
+    score->data = g_array_new(FALSE, TRUE, element_size);
+
+    qemu_rec_mutex_lock(&plugin.lock);
+    if (max_vcpus > 0 && max_vcpus > plugin.scoreboard_alloc_size) {
+        /* size for all possible vCPUs so that hotplug never grows them */
+        plugin.scoreboard_alloc_size = max_vcpus;
+    }
+    g_array_set_size(score->data, plugin.scoreboard_alloc_size);
+    QLIST_INSERT_HEAD(&plugin.scoreboards, score, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    return score;
+}
+
+void plugin_scoreboard_free(struct qemu_plugin_scoreboard *score)
+{
+    qemu_rec_mutex_lock(&plugin.lock);
+    QLIST_REMOVE(score, entry);
+    qemu_rec_mutex_unlock(&plugin.lock);
+
+    g_array_free(score->data, TRUE);
+    g_free(score);
+}
+
 void qemu_plugin_atexit_cb(void)
 {
+    plugin_mem_batch_flush_all(NULL);
     plugin_cb__udata(QEMU_PLUGIN_EV_ATEXIT);
 }
 
@@ -569,5 +816,9 @@ static void __attribute__((__constructor__)) plugin_init(void)
     QTAILQ_INIT(&plugin.ctxs);
     qht_init(&plugin.dyn_cb_arr_ht, plugin_dyn_cb_arr_cmp, 16,
              QHT_MODE_AUTO_RESIZE);
+    QLIST_INIT(&plugin.scoreboards);
+    QLIST_INIT(&plugin.mem_batches);
+    /* start with a few entries to avoid early resizes in linux-user */
+    plugin.scoreboard_alloc_size = 16;
     atexit(qemu_plugin_atexit_cb);
 }
@@ -16,9 +16,9 @@ SRST
 ERST
 
 DEF("bench", img_bench,
-    "bench [-c count] [-d depth] [-f fmt] [--flush-interval=flush_interval] [-i aio] [-n] [--no-drain] [-o offset] [--pattern=pattern] [-q] [-s buffer_size] [-S step_size] [-t cache] [-w] [-U] filename")
+    "bench [-c count] [-d depth[,depth...]] [-f fmt] [--flush-interval=flush_interval] [-i aio] [--jobs=jobs] [-n] [--no-drain] [-o offset] [--output=ofmt] [--pattern=pattern] [-q] [--random] [--rwmix=read_percent] [-s buffer_size] [-S step_size] [-t cache] [-w] [-U] filename")
 SRST
-.. option:: bench [-c COUNT] [-d DEPTH] [-f FMT] [--flush-interval=FLUSH_INTERVAL] [-i AIO] [-n] [--no-drain] [-o OFFSET] [--pattern=PATTERN] [-q] [-s BUFFER_SIZE] [-S STEP_SIZE] [-t CACHE] [-w] [-U] FILENAME
+.. option:: bench [-c COUNT] [-d DEPTH[,DEPTH...]] [-f FMT] [--flush-interval=FLUSH_INTERVAL] [-i AIO] [--jobs=JOBS] [-n] [--no-drain] [-o OFFSET] [--output=OFMT] [--pattern=PATTERN] [-q] [--random] [--rwmix=READ_PERCENT] [-s BUFFER_SIZE] [-S STEP_SIZE] [-t CACHE] [-w] [-U] FILENAME
 ERST
 
 DEF("bitmap", img_bitmap,
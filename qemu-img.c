@@ -34,6 +34,8 @@
 #include "qapi/qobject-output-visitor.h"
 #include "qapi/qmp/qjson.h"
 #include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+#include "qapi/qmp/qnum.h"
 #include "qemu/cutils.h"
 #include "qemu/config-file.h"
 #include "qemu/option.h"
@@ -86,6 +88,9 @@ enum {
     OPTION_BITMAPS = 275,
     OPTION_FORCE = 276,
     OPTION_SKIP_BROKEN = 277,
+    OPTION_RWMIX = 278,
+    OPTION_RANDOM = 279,
+    OPTION_JOBS = 280,
 };
 
 typedef enum OutputFormat {
@@ -1671,6 +1676,13 @@ enum ImgConvertBlockStatus {
 #define MAX_COROUTINES 16
 #define CONVERT_THROTTLE_GROUP "img_convert"
 
+/* A run of sectors with the same allocation status in the source */
+typedef struct ImgConvertExtent {
+    int64_t sector_num;
+    int64_t nb_sectors;
+    enum ImgConvertBlockStatus status;
+} ImgConvertExtent;
+
 typedef struct ImgConvertState {
     BlockBackend **src;
     int64_t *src_sectors;
@@ -1683,6 +1695,8 @@ typedef struct ImgConvertState {
     int64_t wr_offs;
     enum ImgConvertBlockStatus status;
     int64_t sector_next_status;
+    GArray *extents; /* ImgConvertExtent, covering the whole source */
+    guint extent_index;
     BlockBackend *target;
     bool has_zero_init;
     bool compressed;
@@ -1824,6 +1838,66 @@ convert_iteration_sectors(ImgConvertState *s, int64_t sector_num)
     return n;
 }
 
+static void convert_add_extent(ImgConvertState *s, int64_t sector_num, int n,
+                               enum ImgConvertBlockStatus status)
+{
+    ImgConvertExtent extent = {
+        .sector_num = sector_num,
+        .nb_sectors = n,
+        .status = status,
+    };
+    ImgConvertExtent *last;
+
+    if (s->extents->len) {
+        last = &g_array_index(s->extents, ImgConvertExtent,
+                              s->extents->len - 1);
+        if (last->status == status &&
+            last->sector_num + last->nb_sectors == sector_num) {
+            last->nb_sectors += n;
+            return;
+        }
+    }
+    g_array_append_val(s->extents, extent);
+}
+
+/*
+ * Like convert_iteration_sectors(), but use the extent map built before
+ * the copy started instead of querying the block status again.
+ * @sector_num must not be smaller than in the previous call.
+ */
+static int convert_next_extent(ImgConvertState *s, int64_t sector_num)
+{
+    ImgConvertExtent *extent;
+    int64_t n;
+
+    assert(s->total_sectors > sector_num);
+    extent = &g_array_index(s->extents, ImgConvertExtent, s->extent_index);
+    while (sector_num >= extent->sector_num + extent->nb_sectors) {
+        s->extent_index++;
+        assert(s->extent_index < s->extents->len);
+        extent = &g_array_index(s->extents, ImgConvertExtent,
+                                s->extent_index);
+    }
+
+    s->status = extent->status;
+    n = MIN(extent->sector_num + extent->nb_sectors - sector_num,
+            BDRV_REQUEST_MAX_SECTORS);
+    if (s->status == BLK_DATA) {
+        n = MIN(n, s->buf_sectors);
+    }
+
+    /*
+     * The extents of a compressed conversion cover whole clusters, see
+     * convert_iteration_sectors(); keep the chunks split from them
+     * aligned as well.  Only the last cluster may be shorter.
+     */
+    if (s->compressed && n > s->cluster_sectors) {
+        n = QEMU_ALIGN_DOWN(n, s->cluster_sectors);
+    }
+
+    return n;
+}
+
 static int coroutine_fn convert_co_read(ImgConvertState *s, int64_t sector_num,
                                         int nb_sectors, uint8_t *buf)
 {
@@ -2002,14 +2076,7 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
             qemu_co_mutex_unlock(&s->lock);
             break;
         }
-        WITH_GRAPH_RDLOCK_GUARD() {
-            n = convert_iteration_sectors(s, s->sector_num);
-        }
-        if (n < 0) {
-            qemu_co_mutex_unlock(&s->lock);
-            s->ret = n;
-            break;
-        }
+        n = convert_next_extent(s, s->sector_num);
         /* save current sector and allocation status to local variables */
         sector_num = s->sector_num;
         status = s->status;
@@ -2119,22 +2186,30 @@ static int convert_do_copy(ImgConvertState *s)
         s->buf_sectors = s->cluster_sectors;
     }
 
+    /*
+     * Map the allocation status of the whole source up front.  The copy
+     * coroutines then only look up the map, rather than repeating the
+     * block status queries while holding s->lock.
+     */
+    s->extents = g_array_new(FALSE, FALSE, sizeof(ImgConvertExtent));
     while (sector_num < s->total_sectors) {
         bdrv_graph_rdlock_main_loop();
         n = convert_iteration_sectors(s, sector_num);
         bdrv_graph_rdunlock_main_loop();
         if (n < 0) {
-            return n;
+            ret = n;
+            goto out;
         }
         if (s->status == BLK_DATA || (!s->min_sparse && s->status == BLK_ZERO))
         {
             s->allocated_sectors += n;
         }
+        convert_add_extent(s, sector_num, n, s->status);
         sector_num += n;
     }
 
     /* Do the copy */
-    s->sector_next_status = 0;
+    s->extent_index = 0;
     s->ret = -EINPROGRESS;
 
     qemu_co_mutex_init(&s->lock);
@@ -2152,11 +2227,15 @@ static int convert_do_copy(ImgConvertState *s)
         /* signal EOF to align */
         ret = blk_pwrite_compressed(s->target, 0, 0, NULL);
         if (ret < 0) {
-            return ret;
+            goto out;
         }
     }
+    ret = s->ret;
 
-    return s->ret;
+out:
+    g_array_free(s->extents, true);
+    s->extents = NULL;
+    return ret;
 }
 
 /* Check that bitmaps can be copied, or output an error */
@@ -4414,23 +4493,109 @@ out_no_progress:
     return 0;
 }
 
-typedef struct BenchData {
+/*
+ * Request latencies are kept in a log-linear histogram: values below
+ * 2^BENCH_LAT_SUB_BITS ns have a bucket each, and every power of two
+ * above that is split into 2^BENCH_LAT_SUB_BITS buckets, which bounds
+ * the error of the reported percentiles to about 1.5%.
+ */
+#define BENCH_LAT_SUB_BITS  6
+#define BENCH_LAT_BUCKETS   (64 << BENCH_LAT_SUB_BITS)
+
+typedef struct BenchLatency {
+    uint64_t buckets[BENCH_LAT_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+} BenchLatency;
+
+typedef struct BenchData BenchData;
+
+typedef struct BenchReq {
+    BenchData *b;
+    QEMUIOVector qiov;
+    int64_t start_ns;
+} BenchReq;
+
+struct BenchData {
     BlockBackend *blk;
     uint64_t image_size;
     bool write;
+    /* Percentage of reads if >= 0, overrides @write */
+    int read_percent;
+    bool random;
+    GRand *rand;
     int bufsize;
     int step;
     int nrreq;
     int n;
     int flush_interval;
     bool drain_on_flush;
-    uint8_t *buf;
-    QEMUIOVector *qiov;
+    BenchReq *reqs;
+    BenchReq **free_reqs;
+    int nr_free;
+    BenchLatency *lat;
 
     int in_flight;
     bool in_flush;
     uint64_t offset;
-} BenchData;
+    uint64_t reads;
+    uint64_t writes;
+};
+
+static unsigned bench_lat_bucket(uint64_t ns)
+{
+    int msb;
+
+    if (ns < (1 << BENCH_LAT_SUB_BITS)) {
+        return ns;
+    }
+    msb = 63 - clz64(ns);
+    return ((msb - BENCH_LAT_SUB_BITS + 1) << BENCH_LAT_SUB_BITS) |
+           ((ns >> (msb - BENCH_LAT_SUB_BITS)) &
+            ((1 << BENCH_LAT_SUB_BITS) - 1));
+}
+
+/* Lowest value that falls into bucket @idx */
+static uint64_t bench_lat_value(unsigned idx)
+{
+    unsigned exp = idx >> BENCH_LAT_SUB_BITS;
+    uint64_t mant = idx & ((1 << BENCH_LAT_SUB_BITS) - 1);
+
+    if (exp == 0) {
+        return mant;
+    }
+    return (mant | (1 << BENCH_LAT_SUB_BITS)) << (exp - 1);
+}
+
+static void bench_lat_add(BenchLatency *lat, uint64_t ns)
+{
+    lat->buckets[bench_lat_bucket(ns)]++;
+    lat->min = lat->count ? MIN(lat->min, ns) : ns;
+    lat->max = MAX(lat->max, ns);
+    lat->sum += ns;
+    lat->count++;
+}
+
+static uint64_t bench_lat_percentile(BenchLatency *lat, double p)
+{
+    uint64_t rank, seen = 0;
+    unsigned i;
+
+    if (!lat->count) {
+        return 0;
+    }
+
+    rank = (uint64_t)(p * (lat->count - 1)) + 1;
+    for (i = 0; i < BENCH_LAT_BUCKETS; i++) {
+        seen += lat->buckets[i];
+        if (seen >= rank) {
+            break;
+        }
+    }
+    return MIN(MAX(bench_lat_value(i), lat->min), lat->max);
+}
 
 static void bench_undrained_flush_cb(void *opaque, int ret)
 {
@@ -4440,6 +4605,8 @@ static void bench_undrained_flush_cb(void *opaque, int ret)
     }
 }
 
+static void bench_req_cb(void *opaque, int ret);
+
 static void bench_cb(void *opaque, int ret)
 {
     BenchData *b = opaque;
@@ -4486,17 +4653,36 @@ static void bench_cb(void *opaque, int ret)
 
     while (b->n > b->in_flight && b->in_flight < b->nrreq) {
         int64_t offset = b->offset;
+        BenchReq *req = b->free_reqs[--b->nr_free];
+        bool write = b->write;
+
         /* blk_aio_* might look for completed I/Os and kick bench_cb
          * again, so make sure this operation is counted by in_flight
          * and b->offset is ready for the next submission.
          */
         b->in_flight++;
-        b->offset += b->step;
-        b->offset %= b->image_size;
-        if (b->write) {
-            acb = blk_aio_pwritev(b->blk, offset, b->qiov, 0, bench_cb, b);
+        if (b->random) {
+            uint64_t blocks = MAX(b->image_size / b->bufsize, 1);
+
+            b->offset = (uint64_t)(g_rand_double(b->rand) * blocks) *
+                        b->bufsize;
         } else {
-            acb = blk_aio_preadv(b->blk, offset, b->qiov, 0, bench_cb, b);
+            b->offset += b->step;
+            b->offset %= b->image_size;
+        }
+        if (b->read_percent >= 0) {
+            write = g_rand_int_range(b->rand, 0, 100) >= b->read_percent;
+        }
+
+        req->start_ns = get_clock();
+        if (write) {
+            b->writes++;
+            acb = blk_aio_pwritev(b->blk, offset, &req->qiov, 0,
+                                  bench_req_cb, req);
+        } else {
+            b->reads++;
+            acb = blk_aio_preadv(b->blk, offset, &req->qiov, 0,
+                                 bench_req_cb, req);
         }
         if (!acb) {
             error_report("Failed to issue request");
@@ -4505,6 +4691,78 @@ static void bench_cb(void *opaque, int ret)
     }
 }
 
+static void bench_req_cb(void *opaque, int ret)
+{
+    BenchReq *req = opaque;
+    BenchData *b = req->b;
+
+    bench_lat_add(b->lat, get_clock() - req->start_ns);
+    b->free_reqs[b->nr_free++] = req;
+    bench_cb(b, ret);
+}
+
+static QDict *bench_result(int depth, int64_t ns, uint64_t bytes,
+                           uint64_t reads, uint64_t writes,
+                           BenchLatency *lat)
+{
+    QDict *res = qdict_new();
+    QDict *lat_dict = qdict_new();
+
+    qdict_put_int(lat_dict, "min", lat->min);
+    qdict_put_int(lat_dict, "mean", lat->count ? lat->sum / lat->count : 0);
+    qdict_put_int(lat_dict, "max", lat->max);
+    qdict_put_int(lat_dict, "p50", bench_lat_percentile(lat, 0.5));
+    qdict_put_int(lat_dict, "p99", bench_lat_percentile(lat, 0.99));
+    qdict_put_int(lat_dict, "p99.9", bench_lat_percentile(lat, 0.999));
+
+    qdict_put_int(res, "depth", depth);
+    qdict_put_int(res, "reads", reads);
+    qdict_put_int(res, "writes", writes);
+    qdict_put_int(res, "time-ns", ns);
+    qdict_put(res, "iops", qnum_from_double((reads + writes) * 1e9 / ns));
+    qdict_put(res, "bytes-per-second", qnum_from_double(bytes * 1e9 / ns));
+    qdict_put(res, "latency-ns", lat_dict);
+    return res;
+}
+
+static void bench_print_result(QDict *res)
+{
+    QDict *lat = qdict_get_qdict(res, "latency-ns");
+
+    printf("Run completed in %3.3f seconds.\n",
+           qdict_get_int(res, "time-ns") / 1e9);
+    printf("%.0f IOPS, %.2f MiB/s\n", qdict_get_double(res, "iops"),
+           qdict_get_double(res, "bytes-per-second") / MiB);
+    printf("Latency (us): min %.1f, avg %.1f, max %.1f, "
+           "p50 %.1f, p99 %.1f, p99.9 %.1f\n",
+           qdict_get_int(lat, "min") / 1e3, qdict_get_int(lat, "mean") / 1e3,
+           qdict_get_int(lat, "max") / 1e3, qdict_get_int(lat, "p50") / 1e3,
+           qdict_get_int(lat, "p99") / 1e3,
+           qdict_get_int(lat, "p99.9") / 1e3);
+}
+
+/* Parse a comma separated list of queue depths */
+static int bench_parse_depths(const char *str, int **depths)
+{
+    g_auto(GStrv) list = g_strsplit(str, ",", 0);
+    int n = g_strv_length(list);
+    int i;
+
+    *depths = g_new(int, n);
+    for (i = 0; i < n; i++) {
+        unsigned long res;
+
+        if (qemu_strtoul(list[i], NULL, 0, &res) < 0 || res == 0 ||
+            res > INT_MAX) {
+            g_free(*depths);
+            *depths = NULL;
+            return -1;
+        }
+        (*depths)[i] = res;
+    }
+    return n;
+}
+
 static int img_bench(int argc, char **argv)
 {
     int c, ret = 0;
@@ -4512,8 +4770,14 @@ static int img_bench(int argc, char **argv)
     bool quiet = false;
     bool image_opts = false;
     bool is_write = false;
+    int read_percent = -1;
+    bool is_random = false;
     int count = 75000;
-    int depth = 64;
+    int default_depth = 64;
+    int *depths = NULL;
+    int nr_depths = 1;
+    int max_depth;
+    int nr_jobs = 1;
     int64_t offset = 0;
     size_t bufsize = 4096;
     int pattern = 0;
@@ -4522,13 +4786,17 @@ static int img_bench(int argc, char **argv)
     bool drain_on_flush = true;
     int64_t image_size;
     BlockBackend *blk = NULL;
-    BenchData data = {};
+    BenchData *jobs = NULL;
+    BenchLatency *lat = NULL;
+    QList *results = NULL;
+    uint8_t *buf = NULL;
     int flags = 0;
     bool writethrough = false;
-    struct timeval t1, t2;
-    int i;
+    int i, j, k;
     bool force_share = false;
     size_t buf_size = 0;
+    OutputFormat output_format = OFORMAT_HUMAN;
+    const char *output = NULL;
 
     for (;;) {
         static const struct option long_options[] = {
@@ -4538,6 +4806,10 @@ static int img_bench(int argc, char **argv)
             {"pattern", required_argument, 0, OPTION_PATTERN},
             {"no-drain", no_argument, 0, OPTION_NO_DRAIN},
             {"force-share", no_argument, 0, 'U'},
+            {"rwmix", required_argument, 0, OPTION_RWMIX},
+            {"random", no_argument, 0, OPTION_RANDOM},
+            {"jobs", required_argument, 0, OPTION_JOBS},
+            {"output", required_argument, 0, OPTION_OUTPUT},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hc:d:f:ni:o:qs:S:t:wU", long_options,
@@ -4568,16 +4840,13 @@ static int img_bench(int argc, char **argv)
             break;
         }
         case 'd':
-        {
-            unsigned long res;
-
-            if (qemu_strtoul(optarg, NULL, 0, &res) < 0 || res > INT_MAX) {
+            g_free(depths);
+            nr_depths = bench_parse_depths(optarg, &depths);
+            if (nr_depths < 0) {
                 error_report("Invalid queue depth specified");
                 return 1;
             }
-            depth = res;
             break;
-        }
         case 'f':
             fmt = optarg;
             break;
@@ -4671,6 +4940,35 @@ static int img_bench(int argc, char **argv)
         case OPTION_IMAGE_OPTS:
             image_opts = true;
             break;
+        case OPTION_RWMIX:
+        {
+            unsigned long res;
+
+            if (qemu_strtoul(optarg, NULL, 0, &res) < 0 || res > 100) {
+                error_report("Invalid read percentage specified");
+                return 1;
+            }
+            read_percent = res;
+            break;
+        }
+        case OPTION_RANDOM:
+            is_random = true;
+            break;
+        case OPTION_JOBS:
+        {
+            unsigned long res;
+
+            if (qemu_strtoul(optarg, NULL, 0, &res) < 0 || res == 0 ||
+                res > INT_MAX) {
+                error_report("Invalid number of jobs specified");
+                return 1;
+            }
+            nr_jobs = res;
+            break;
+        }
+        case OPTION_OUTPUT:
+            output = optarg;
+            break;
         }
     }
 
@@ -4679,16 +4977,49 @@ static int img_bench(int argc, char **argv)
     }
     filename = argv[argc - 1];
 
-    if (!is_write && flush_interval) {
+    if (output && !strcmp(output, "json")) {
+        output_format = OFORMAT_JSON;
+    } else if (output && !strcmp(output, "human")) {
+        output_format = OFORMAT_HUMAN;
+    } else if (output) {
+        error_report("--output must be used with human or json as argument.");
+        ret = -1;
+        goto out;
+    }
+
+    if (!depths) {
+        depths = g_memdup2(&default_depth, sizeof(default_depth));
+    }
+    max_depth = 0;
+    for (i = 0; i < nr_depths; i++) {
+        max_depth = MAX(max_depth, depths[i]);
+    }
+
+    if (read_percent >= 0) {
+        if (is_write) {
+            error_report("-w and --rwmix are mutually exclusive");
+            ret = -1;
+            goto out;
+        }
+        if (read_percent < 100) {
+            flags |= BDRV_O_RDWR;
+        }
+    }
+    if (!is_write && read_percent < 0 && flush_interval) {
         error_report("--flush-interval is only available in write tests");
         ret = -1;
         goto out;
     }
-    if (flush_interval && flush_interval < depth) {
+    if (flush_interval && flush_interval < max_depth) {
         error_report("Flush interval can't be smaller than depth");
         ret = -1;
         goto out;
     }
+    if (is_random && !bufsize) {
+        error_report("--random needs a non-zero buffer size");
+        ret = -1;
+        goto out;
+    }
 
     blk = img_open(image_opts, filename, fmt, flags, writethrough, quiet,
                    force_share);
@@ -4703,56 +5034,154 @@ static int img_bench(int argc, char **argv)
         goto out;
     }
 
-    data = (BenchData) {
-        .blk            = blk,
-        .image_size     = image_size,
-        .bufsize        = bufsize,
-        .step           = step ?: bufsize,
-        .nrreq          = depth,
-        .n              = count,
-        .offset         = offset,
-        .write          = is_write,
-        .flush_interval = flush_interval,
-        .drain_on_flush = drain_on_flush,
-    };
-    printf("Sending %d %s requests, %d bytes each, %d in parallel "
-           "(starting at offset %" PRId64 ", step size %d)\n",
-           data.n, data.write ? "write" : "read", data.bufsize, data.nrreq,
-           data.offset, data.step);
-    if (flush_interval) {
-        printf("Sending flush every %d requests\n", flush_interval);
-    }
+    buf_size = (size_t)nr_jobs * max_depth * bufsize;
+    buf = blk_blockalign(blk, buf_size);
+    memset(buf, pattern, buf_size);
+
+    blk_register_buf(blk, buf, buf_size, &error_fatal);
+
+    lat = g_new(BenchLatency, 1);
+    jobs = g_new0(BenchData, nr_jobs);
+    for (j = 0; j < nr_jobs; j++) {
+        BenchData *b = &jobs[j];
+
+        b->reqs = g_new0(BenchReq, max_depth);
+        b->free_reqs = g_new(BenchReq *, max_depth);
+        b->rand = g_rand_new_with_seed(j);
+        for (k = 0; k < max_depth; k++) {
+            BenchReq *req = &b->reqs[k];
+
+            req->b = b;
+            qemu_iovec_init(&req->qiov, 1);
+            qemu_iovec_add(&req->qiov,
+                           buf + ((size_t)j * max_depth + k) * bufsize,
+                           bufsize);
+        }
+    }
+
+    results = qlist_new();
+    for (i = 0; i < nr_depths; i++) {
+        uint64_t reads = 0, writes = 0;
+        int64_t start_ns, ns;
+        bool busy;
+        QDict *res;
+
+        memset(lat, 0, sizeof(*lat));
+        for (j = 0; j < nr_jobs; j++) {
+            BenchData *b = &jobs[j];
+            /* Sequential jobs each start in their own part of the image */
+            int64_t job_offset = offset + QEMU_ALIGN_DOWN(
+                image_size / nr_jobs * j, MAX(bufsize, 1));
+
+            *b = (BenchData) {
+                .blk            = blk,
+                .image_size     = image_size,
+                .bufsize        = bufsize,
+                .step           = step ?: bufsize,
+                .nrreq          = depths[i],
+                .n              = count,
+                .offset         = image_size ? job_offset % image_size
+                                             : job_offset,
+                .write          = is_write,
+                .read_percent   = read_percent,
+                .random         = is_random,
+                .rand           = b->rand,
+                .flush_interval = flush_interval,
+                .drain_on_flush = drain_on_flush,
+                .reqs           = b->reqs,
+                .free_reqs      = b->free_reqs,
+                .nr_free        = max_depth,
+                .lat            = lat,
+            };
+            for (k = 0; k < max_depth; k++) {
+                b->free_reqs[k] = &b->reqs[k];
+            }
+        }
 
-    buf_size = data.nrreq * data.bufsize;
-    data.buf = blk_blockalign(blk, buf_size);
-    memset(data.buf, pattern, data.nrreq * data.bufsize);
+        if (output_format == OFORMAT_HUMAN) {
+            printf("Sending %d %s%s requests, %d bytes each, %d in parallel",
+                   count, is_random ? "random " : "",
+                   read_percent >= 0 ? "mixed" : is_write ? "write" : "read",
+                   (int)bufsize, depths[i]);
+            if (nr_jobs > 1) {
+                printf(" by each of %d jobs", nr_jobs);
+            }
+            if (read_percent >= 0) {
+                printf(" (%d%% reads)", read_percent);
+            }
+            if (!is_random) {
+                printf(" (starting at offset %" PRId64 ", step size %d)",
+                       offset, jobs[0].step);
+            }
+            printf("\n");
+            if (flush_interval) {
+                printf("Sending flush every %d requests\n", flush_interval);
+            }
+        }
 
-    blk_register_buf(blk, data.buf, buf_size, &error_fatal);
+        start_ns = get_clock();
+        for (j = 0; j < nr_jobs; j++) {
+            bench_cb(&jobs[j], 0);
+        }
+        do {
+            main_loop_wait(false);
+            busy = false;
+            for (j = 0; j < nr_jobs; j++) {
+                busy |= jobs[j].n > 0;
+            }
+        } while (busy);
+        ns = MAX(get_clock() - start_ns, 1);
 
-    data.qiov = g_new(QEMUIOVector, data.nrreq);
-    for (i = 0; i < data.nrreq; i++) {
-        qemu_iovec_init(&data.qiov[i], 1);
-        qemu_iovec_add(&data.qiov[i],
-                       data.buf + i * data.bufsize, data.bufsize);
+        for (j = 0; j < nr_jobs; j++) {
+            reads += jobs[j].reads;
+            writes += jobs[j].writes;
+        }
+        res = bench_result(depths[i], ns, (reads + writes) * bufsize,
+                           reads, writes, lat);
+        if (output_format == OFORMAT_HUMAN) {
+            bench_print_result(res);
+        }
+        qlist_append(results, res);
     }
 
-    gettimeofday(&t1, NULL);
-    bench_cb(&data, 0);
+    if (output_format == OFORMAT_JSON) {
+        QDict *report = qdict_new();
+        GString *str;
 
-    while (data.n > 0) {
-        main_loop_wait(false);
-    }
-    gettimeofday(&t2, NULL);
+        qdict_put_int(report, "requests", count);
+        qdict_put_int(report, "jobs", nr_jobs);
+        qdict_put_int(report, "request-size", bufsize);
+        qdict_put_bool(report, "random", is_random);
+        qdict_put_int(report, "read-percent",
+                      read_percent >= 0 ? read_percent : is_write ? 0 : 100);
+        qdict_put(report, "runs", results);
+        results = NULL;
 
-    printf("Run completed in %3.3f seconds.\n",
-           (t2.tv_sec - t1.tv_sec)
-           + ((double)(t2.tv_usec - t1.tv_usec) / 1000000));
+        str = qobject_to_json_pretty(QOBJECT(report), true);
+        printf("%s\n", str->str);
+        g_string_free(str, true);
+        qobject_unref(report);
+    }
 
 out:
-    if (data.buf) {
-        blk_unregister_buf(blk, data.buf, buf_size);
+    qobject_unref(results);
+    if (jobs) {
+        for (j = 0; j < nr_jobs; j++) {
+            for (k = 0; k < max_depth; k++) {
+                qemu_iovec_destroy(&jobs[j].reqs[k].qiov);
+            }
+            g_free(jobs[j].reqs);
+            g_free(jobs[j].free_reqs);
+            g_rand_free(jobs[j].rand);
+        }
+        g_free(jobs);
     }
-    qemu_vfree(data.buf);
+    g_free(lat);
+    g_free(depths);
+    if (buf) {
+        blk_unregister_buf(blk, buf, buf_size);
+    }
+    qemu_vfree(buf);
     blk_unref(blk);
 
     if (ret) {
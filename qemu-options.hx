@@ -183,6 +183,8 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
+    "                atomic-locks=on|off (emulate wide atomics under address locks)\n"
+    "                acq-rel=on|off (order guest memory accesses with host acquire/release)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
     "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
@@ -218,6 +220,23 @@ SRST
         can be useful in some situations, such as when trying to analyse
         the logs produced by the ``-d`` option.
 
+    ``atomic-locks=on|off``
+        Controls how the TCG accelerator emulates 16-byte compare-and-swap
+        operations of a multi-threaded guest on hosts that lack them. By
+        default (off) all other vCPUs are stopped while the operation is
+        performed. With on, the operation only takes a lock hashed by its
+        address; this scales much better, but is not atomic with respect
+        to plain stores of other vCPUs to the same memory.
+
+    ``acq-rel=on|off``
+        Controls how the TCG accelerator emulates a guest memory model
+        that is stronger than the host's, e.g. x86 on Arm. By default
+        (off) barriers are inserted before guest loads and stores. With
+        on, and where the TCG backend supports it (currently aarch64),
+        guest loads and stores up to 64 bits are instead performed as
+        host load-acquire and store-release. Memory accesses done by
+        instruction helpers are not ordered against later loads then.
+
     ``split-wx=on|off``
         Controls the use of split w^x mapping for the TCG code generation
         buffer. Some operating systems require this to be enabled, and in
@@ -233,7 +252,7 @@ SRST
         additional host cores. The default is to enable multi-threading
         where both the back-end and front-ends support it and no
         incompatible TCG features have been enabled (e.g.
-        icount/replay).
+        icount without ``quantum``, or replay).
 
     ``dirty-ring-size=n``
         When the KVM accelerator is used, it controls the size of the per-vCPU
@@ -2897,6 +2916,7 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
 #ifdef CONFIG_AF_XDP
     "-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off]\n"
     "         [,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z]\n"
+    "         [,busy-poll-budget=n]\n"
     "                attach to the existing network interface 'name' with AF_XDP socket\n"
     "                use 'mode=MODE' to specify an XDP program attach mode\n"
     "                use 'force-copy=on|off' to force XDP copy mode even if device supports zero-copy (default: off)\n"
@@ -2906,6 +2926,7 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                  added to a socket map in XDP program.  One socket per queue.\n"
     "                use 'queues=n' to specify how many queues of a multiqueue interface should be used\n"
     "                use 'start-queue=m' to specify the first queue that should be used\n"
+    "                use 'busy-poll-budget=n' to busy poll the device queues n packets at a time\n"
 #endif
 #ifdef CONFIG_POSIX
     "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off]\n"
@@ -3407,7 +3428,7 @@ SRST
         # launch QEMU instance
         |qemu_system| linux.img -nic vde,sock=/tmp/myswitch
 
-``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z]``
+``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z][,busy-poll-budget=n]``
     Configure AF_XDP backend to connect to a network interface 'name'
     using AF_XDP socket.  A specific program attach mode for a default
     XDP program can be forced with 'mode', defaults to best-effort,
@@ -3456,6 +3477,12 @@ SRST
         |qemu_system| linux.img -device virtio-net-pci,netdev=n1 \\
             -netdev af-xdp,id=n1,ifname=eth0,queues=3,inhibit=on,sock-fds=15:16:17
 
+    'busy-poll-budget' enables preferred busy polling of the device queues.
+    The kernel then stops processing them from interrupts and instead does
+    up to 'n' packets at a time whenever QEMU polls the socket.  This is
+    usually combined with a non-zero ``napi_defer_hard_irqs`` and
+    ``gro_flush_timeout`` for the interface.
+
 ``-netdev vhost-user,chardev=id[,vhostforce=on|off][,queues=n]``
     Establish a vhost-user netdev, backed by a chardev id. The chardev
     should be a unix domain socket backed one. The vhost-user uses a
@@ -4641,13 +4668,14 @@ SRST
 ERST
 
 DEF("icount", HAS_ARG, QEMU_OPTION_icount, \
-    "-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=<filename>[,rrsnapshot=<snapshot>]]\n" \
+    "-icount [shift=N|auto][,align=on|off][,sleep=on|off][,quantum=N][,rr=record|replay,rrfile=<filename>[,rrsnapshot=<snapshot>]]\n" \
     "                enable virtual instruction counter with 2^N clock ticks per\n" \
     "                instruction, enable aligning the host and virtual clocks\n" \
-    "                or disable real time cpu sleeping, and optionally enable\n" \
-    "                record-and-replay mode\n", QEMU_ARCH_ALL)
+    "                or disable real time cpu sleeping, run the vCPUs in\n" \
+    "                parallel for quanta of N instructions, and optionally\n" \
+    "                enable record-and-replay mode\n", QEMU_ARCH_ALL)
 SRST
-``-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=filename[,rrsnapshot=snapshot]]``
+``-icount [shift=N|auto][,align=on|off][,sleep=on|off][,quantum=N][,rr=record|replay,rrfile=filename[,rrsnapshot=snapshot]]``
     Enable virtual instruction counter. The virtual cpu will execute one
     instruction every 2^N ns of virtual time. If ``auto`` is specified
     then the virtual cpu speed will be automatically adjusted to keep
@@ -4681,6 +4709,15 @@ SRST
     depends on the host machine). The default if icount is enabled
     is ``align=off``.
 
+    ``quantum=N`` lets the vCPUs of multi-threaded TCG run in parallel
+    with icount. Each vCPU counts its own instructions, and all of them
+    synchronize after every N instructions. Timers only expire at these
+    synchronization points, and accesses to devices as well as interrupts
+    sent between vCPUs are also delayed until the end of the quantum and
+    then done in a fixed order. Execution is reproducible as long as the
+    vCPUs do not race on shared memory within a quantum. ``quantum``
+    requires ``sleep=off`` and cannot be used with ``rr``.
+
     When the ``rr`` option is specified deterministic record/replay is
     enabled. The ``rrfile=`` option must also be provided to
     specify the path to the replay log. In record mode data is written
@@ -5812,7 +5849,7 @@ SRST
 
             CN=laptop.example.com,O=Example Home,L=London,ST=London,C=GB
 
-    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,aio-max-batch=aio-max-batch``
+    ``-object iothread,id=id,poll-max-ns=poll-max-ns,poll-grow=poll-grow,poll-shrink=poll-shrink,poll-cpu-budget=poll-cpu-budget,aio-max-batch=aio-max-batch,thread-context=context``
         Creates a dedicated event loop thread that devices can be
         assigned to. This is known as an IOThread. By default device
         emulation happens in vCPU threads or the main event loop thread.
@@ -5848,10 +5885,21 @@ SRST
         the polling time when the algorithm detects it is spending too
         long polling without encountering events.
 
+        The ``poll-cpu-budget`` parameter caps the percentage of time
+        that is spent busy waiting, from 0 to 100. Once the budget has
+        been used up, the IOThread stops polling for the rest of a 100
+        millisecond window. 0 means no limit.
+
         The ``aio-max-batch`` parameter is the maximum number of requests
         in a batch for the AIO engine, 0 means that the engine will use
         its default.
 
+        The ``thread-context`` parameter is the ID of a ``thread-context``
+        object with which the IOThread's thread is created. The thread
+        then starts out with the CPU affinity and scheduling policy of
+        the context, instead of having to be pinned after it has been
+        started. It cannot be changed at run-time.
+
         The IOThread parameters can be modified at run-time using the
         ``qom-set`` command (where ``iothread1`` is the IOThread's
         ``id``):
@@ -342,12 +342,47 @@ static void json_lexer_feed_char(JSONLexer *lexer, char ch, bool flush)
     }
 }
 
+/*
+ * Inside a string, most characters just extend the token.  Append the
+ * longest such run at the start of @buffer in one go instead of running
+ * each character through the state machine.
+ *
+ * Returns the number of characters consumed.
+ */
+static size_t json_lexer_feed_string(JSONLexer *lexer, const char *buffer,
+                                     size_t size)
+{
+    const uint8_t *next;
+    size_t n;
+
+    if (lexer->state != IN_DQ_STRING && lexer->state != IN_SQ_STRING) {
+        return 0;
+    }
+
+    /* Leave the token size check to json_lexer_feed_char() */
+    size = MIN(size, MAX_TOKEN_SIZE - lexer->token->len);
+    next = json_lexer[lexer->state];
+    n = 0;
+    while (n < size && next[(uint8_t)buffer[n]] == lexer->state) {
+        n++;
+    }
+
+    /* Strings cannot contain newlines, so only the column changes */
+    g_string_append_len(lexer->token, buffer, n);
+    lexer->x += n;
+    return n;
+}
+
 void json_lexer_feed(JSONLexer *lexer, const char *buffer, size_t size)
 {
-    size_t i;
+    size_t i, n;
 
-    for (i = 0; i < size; i++) {
-        json_lexer_feed_char(lexer, buffer[i], false);
+    for (i = 0; i < size; i += n) {
+        n = json_lexer_feed_string(lexer, buffer + i, size - i);
+        if (!n) {
+            json_lexer_feed_char(lexer, buffer[i], false);
+            n = 1;
+        }
     }
 }
 
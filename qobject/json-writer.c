@@ -17,11 +17,16 @@
 #include "qapi/qmp/json-writer.h"
 #include "qemu/unicode.h"
 
+/* A streaming writer passes on its output once it has this much */
+#define JSON_WRITER_CHUNK_SIZE (64 * 1024)
+
 struct JSONWriter {
     bool pretty;
     bool need_comma;
     GString *contents;
     GByteArray *container_is_array;
+    JSONWriterFlushFunc *flush;
+    void *opaque;
 };
 
 JSONWriter *json_writer_new(bool pretty)
@@ -32,12 +37,46 @@ JSONWriter *json_writer_new(bool pretty)
     writer->need_comma = false;
     writer->contents = g_string_new(NULL);
     writer->container_is_array = g_byte_array_new();
+    writer->flush = NULL;
+    writer->opaque = NULL;
     return writer;
 }
 
+/*
+ * Create a writer that does not accumulate the whole output, but hands
+ * it to @flush in chunks of roughly JSON_WRITER_CHUNK_SIZE bytes as it
+ * is produced.  The last chunk is only passed on by json_writer_flush().
+ */
+JSONWriter *json_writer_new_stream(bool pretty, JSONWriterFlushFunc *flush,
+                                   void *opaque)
+{
+    JSONWriter *writer = json_writer_new(pretty);
+
+    g_string_set_size(writer->contents, JSON_WRITER_CHUNK_SIZE);
+    g_string_truncate(writer->contents, 0);
+    writer->flush = flush;
+    writer->opaque = opaque;
+    return writer;
+}
+
+/*
+ * Pass the buffered output of a streaming writer to its flush function.
+ * The buffer is NUL-terminated.
+ */
+void json_writer_flush(JSONWriter *writer)
+{
+    assert(writer->flush);
+    if (writer->contents->len) {
+        writer->flush(writer->opaque, writer->contents->str,
+                      writer->contents->len);
+        g_string_truncate(writer->contents, 0);
+    }
+}
+
 const char *json_writer_get(JSONWriter *writer)
 {
     g_assert(!writer->container_is_array->len);
+    g_assert(!writer->flush);
     return writer->contents->str;
 }
 
@@ -156,11 +195,16 @@ static void quoted_str(JSONWriter *writer, const char *str)
 
 static void maybe_comma_name(JSONWriter *writer, const char *name)
 {
+    if (writer->flush && writer->contents->len >= JSON_WRITER_CHUNK_SIZE) {
+        json_writer_flush(writer);
+    }
+
     if (writer->need_comma) {
         g_string_append_c(writer->contents, ',');
         pretty_newline_or_space(writer);
     } else {
-        if (writer->contents->len) {
+        /* Only the very first value is not preceded by anything */
+        if (writer->container_is_array->len) {
             pretty_newline(writer);
         }
         writer->need_comma = true;
@@ -245,3 +289,13 @@ void json_writer_str(JSONWriter *writer, const char *name, const char *str)
     maybe_comma_name(writer, name);
     quoted_str(writer, str);
 }
+
+/*
+ * Append @json, a complete JSON value such as the output of another
+ * JSONWriter, as is.
+ */
+void json_writer_raw(JSONWriter *writer, const char *name, const char *json)
+{
+    maybe_comma_name(writer, name);
+    g_string_append(writer->contents, json);
+}
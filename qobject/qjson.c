@@ -230,3 +230,17 @@ GString *qobject_to_json(const QObject *obj)
 {
     return qobject_to_json_pretty(obj, false);
 }
+
+/*
+ * Serialize @obj without building the whole text in memory: it is passed
+ * to @flush piecewise, in order, as it is produced.
+ */
+void qobject_to_json_stream(const QObject *obj, bool pretty,
+                            JSONWriterFlushFunc *flush, void *opaque)
+{
+    JSONWriter *writer = json_writer_new_stream(pretty, flush, opaque);
+
+    to_json(writer, NULL, obj);
+    json_writer_flush(writer);
+    json_writer_free(writer);
+}
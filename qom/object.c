@@ -69,6 +69,13 @@ struct TypeImpl
     const char *parent;
     TypeImpl *parent_type;
 
+    /*
+     * Set up by type_initialize(): @ancestors[i] is the ancestor of this
+     * type at depth @i in the hierarchy, @ancestors[@depth] the type itself.
+     */
+    unsigned depth;
+    TypeImpl **ancestors;
+
     ObjectClass *class;
 
     int num_interfaces;
@@ -287,6 +294,11 @@ static bool type_is_ancestor(TypeImpl *type, TypeImpl *target_type)
 {
     assert(target_type);
 
+    if (type->ancestors && target_type->ancestors) {
+        return target_type->depth <= type->depth &&
+               type->ancestors[target_type->depth] == target_type;
+    }
+
     /* Check if target_type is a direct ancestor of type */
     while (type) {
         if (type == target_type) {
@@ -406,6 +418,14 @@ static void type_initialize(TypeImpl *ti)
         }
     }
 
+    ti->depth = parent ? parent->depth + 1 : 0;
+    ti->ancestors = g_new(TypeImpl *, ti->depth + 1);
+    if (parent) {
+        memcpy(ti->ancestors, parent->ancestors,
+               ti->depth * sizeof(*ti->ancestors));
+    }
+    ti->ancestors[ti->depth] = ti;
+
     ti->class->properties = g_hash_table_new_full(g_str_hash, g_str_equal, NULL,
                                                   object_property_free);
 
@@ -913,6 +933,29 @@ bool object_set_propv(Object *obj,
 }
 
 
+static bool class_cast_cache_lookup(ObjectClass *class, const char *typename)
+{
+    int i;
+
+    for (i = 0; i < OBJECT_CLASS_CAST_CACHE; i++) {
+        if (qatomic_read(&class->class_cast_cache[i]) == typename) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void class_cast_cache_insert(ObjectClass *class, const char *typename)
+{
+    int i;
+
+    for (i = 1; i < OBJECT_CLASS_CAST_CACHE; i++) {
+        qatomic_set(&class->class_cast_cache[i - 1],
+                    qatomic_read(&class->class_cast_cache[i]));
+    }
+    qatomic_set(&class->class_cast_cache[i - 1], typename);
+}
+
 Object *object_dynamic_cast(Object *obj, const char *typename)
 {
     if (obj && object_class_dynamic_cast(object_get_class(obj), typename)) {
@@ -1019,21 +1062,24 @@ ObjectClass *object_class_dynamic_cast_assert(ObjectClass *class,
     trace_object_class_dynamic_cast_assert(class ? class->type->name : "(null)",
                                            typename, file, line, func);
 
-#ifdef CONFIG_QOM_CAST_DEBUG
-    int i;
-
-    for (i = 0; class && i < OBJECT_CLASS_CAST_CACHE; i++) {
-        if (qatomic_read(&class->class_cast_cache[i]) == typename) {
-            ret = class;
-            goto out;
-        }
-    }
-#else
+#ifndef CONFIG_QOM_CAST_DEBUG
     if (!class || !class->interfaces) {
         return class;
     }
 #endif
 
+    /*
+     * Casts to a parent class name recently seen for this class, which
+     * avoids hashing @typename.  The cast macros pass string literals, so
+     * the pointer identifies the type; object_class_dynamic_cast() may be
+     * handed a string that is freed and reused, and does not use the
+     * cache.  Interface casts are not cached because their result is a
+     * different class.
+     */
+    if (class && class_cast_cache_lookup(class, typename)) {
+        return class;
+    }
+
     ret = object_class_dynamic_cast(class, typename);
     if (!ret && class) {
         fprintf(stderr, "%s:%d:%s: Object %p is not an instance of type %s\n",
@@ -1041,16 +1087,10 @@ ObjectClass *object_class_dynamic_cast_assert(ObjectClass *class,
         abort();
     }
 
-#ifdef CONFIG_QOM_CAST_DEBUG
     if (class && ret == class) {
-        for (i = 1; i < OBJECT_CLASS_CAST_CACHE; i++) {
-            qatomic_set(&class->class_cast_cache[i - 1],
-                       qatomic_read(&class->class_cast_cache[i]));
-        }
-        qatomic_set(&class->class_cast_cache[i - 1], typename);
+        class_cast_cache_insert(class, typename);
     }
-out:
-#endif
+
     return ret;
 }
 
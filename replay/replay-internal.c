@@ -30,14 +30,127 @@ static unsigned long mutex_head, mutex_tail;
 static bool write_error;
 FILE *replay_file;
 
+/*
+ * In record mode the log is collected in memory and written to the file
+ * by a separate thread, so that the vCPU does not wait for the file
+ * system while holding the replay mutex.  There are two buffers: the one
+ * being filled under the replay mutex, and the one being written.
+ */
+#define REPLAY_WRITE_BUF_SIZE   (1 << 20)
+
+static struct {
+    bool active;
+    QemuThread thread;
+    QemuMutex lock;
+    QemuCond cond;
+    uint8_t *buf[2];
+    /* Index and fill level of the buffer being filled */
+    int cur;
+    size_t len;
+    /* File offset of the start of the buffer being filled */
+    int64_t offset;
+    /* Buffer handed to the writer thread, protected by lock */
+    uint8_t *pending;
+    size_t pending_len;
+    bool quit;
+} replay_writer;
+
 static void replay_write_error(void)
 {
-    if (!write_error) {
+    if (!qatomic_xchg(&write_error, true)) {
         error_report("replay write error");
-        write_error = true;
     }
 }
 
+static void *replay_writer_thread(void *opaque)
+{
+    qemu_mutex_lock(&replay_writer.lock);
+    for (;;) {
+        if (replay_writer.pending) {
+            uint8_t *buf = replay_writer.pending;
+            size_t len = replay_writer.pending_len;
+
+            qemu_mutex_unlock(&replay_writer.lock);
+            if (fwrite(buf, 1, len, replay_file) != len) {
+                replay_write_error();
+            }
+            qemu_mutex_lock(&replay_writer.lock);
+            replay_writer.pending = NULL;
+            qemu_cond_broadcast(&replay_writer.cond);
+        } else if (replay_writer.quit) {
+            break;
+        } else {
+            qemu_cond_wait(&replay_writer.cond, &replay_writer.lock);
+        }
+    }
+    qemu_mutex_unlock(&replay_writer.lock);
+    return NULL;
+}
+
+/* Pass the current buffer to the writer thread and switch to the other */
+static void replay_writer_submit(void)
+{
+    qemu_mutex_lock(&replay_writer.lock);
+    while (replay_writer.pending) {
+        qemu_cond_wait(&replay_writer.cond, &replay_writer.lock);
+    }
+    replay_writer.pending = replay_writer.buf[replay_writer.cur];
+    replay_writer.pending_len = replay_writer.len;
+    qemu_cond_broadcast(&replay_writer.cond);
+    qemu_mutex_unlock(&replay_writer.lock);
+
+    replay_writer.offset += replay_writer.len;
+    replay_writer.cur ^= 1;
+    replay_writer.len = 0;
+}
+
+void replay_writer_start(void)
+{
+    assert(!replay_writer.active);
+
+    replay_writer.buf[0] = g_malloc(REPLAY_WRITE_BUF_SIZE);
+    replay_writer.buf[1] = g_malloc(REPLAY_WRITE_BUF_SIZE);
+    replay_writer.cur = 0;
+    replay_writer.len = 0;
+    replay_writer.offset = ftell(replay_file);
+    replay_writer.quit = false;
+    qemu_mutex_init(&replay_writer.lock);
+    qemu_cond_init(&replay_writer.cond);
+    qemu_thread_create(&replay_writer.thread, "replay-writer",
+                       replay_writer_thread, NULL, QEMU_THREAD_JOINABLE);
+    replay_writer.active = true;
+}
+
+void replay_writer_stop(void)
+{
+    if (!replay_writer.active) {
+        return;
+    }
+
+    if (replay_writer.len) {
+        replay_writer_submit();
+    }
+    qemu_mutex_lock(&replay_writer.lock);
+    replay_writer.quit = true;
+    qemu_cond_broadcast(&replay_writer.cond);
+    qemu_mutex_unlock(&replay_writer.lock);
+    qemu_thread_join(&replay_writer.thread);
+
+    qemu_cond_destroy(&replay_writer.cond);
+    qemu_mutex_destroy(&replay_writer.lock);
+    g_free(replay_writer.buf[0]);
+    g_free(replay_writer.buf[1]);
+    replay_writer.active = false;
+}
+
+int64_t replay_file_tell(void)
+{
+    if (replay_writer.active) {
+        return replay_writer.offset + replay_writer.len;
+    }
+    return ftell(replay_file);
+}
+
 static void replay_read_error(void)
 {
     error_report("error reading the replay data");
@@ -46,7 +159,12 @@ static void replay_read_error(void)
 
 void replay_put_byte(uint8_t byte)
 {
-    if (replay_file) {
+    if (replay_writer.active) {
+        if (replay_writer.len == REPLAY_WRITE_BUF_SIZE) {
+            replay_writer_submit();
+        }
+        replay_writer.buf[replay_writer.cur][replay_writer.len++] = byte;
+    } else if (replay_file) {
         if (putc(byte, replay_file) == EOF) {
             replay_write_error();
         }
@@ -80,7 +198,22 @@ void replay_put_qword(int64_t qword)
 
 void replay_put_array(const uint8_t *buf, size_t size)
 {
-    if (replay_file) {
+    if (replay_writer.active) {
+        replay_put_dword(size);
+        while (size) {
+            size_t n;
+
+            if (replay_writer.len == REPLAY_WRITE_BUF_SIZE) {
+                replay_writer_submit();
+            }
+            n = MIN(size, REPLAY_WRITE_BUF_SIZE - replay_writer.len);
+            memcpy(replay_writer.buf[replay_writer.cur] + replay_writer.len,
+                   buf, n);
+            replay_writer.len += n;
+            buf += n;
+            size -= n;
+        }
+    } else if (replay_file) {
         replay_put_dword(size);
         if (fwrite(buf, 1, size, replay_file) != size) {
             replay_write_error();
@@ -94,6 +94,13 @@ extern uint64_t replay_break_icount;
 /* Timer for the replay breakpoint callback */
 extern QEMUTimer *replay_break_timer;
 
+/*! Starts writing the log from a separate thread, for record mode */
+void replay_writer_start(void);
+/*! Writes out the buffered log and stops the writer thread */
+void replay_writer_stop(void);
+/*! Returns the current position in the log */
+int64_t replay_file_tell(void);
+
 void replay_put_byte(uint8_t byte);
 void replay_put_event(uint8_t event);
 void replay_put_word(uint16_t word);
@@ -22,7 +22,7 @@
 static int replay_pre_save(void *opaque)
 {
     ReplayState *state = opaque;
-    state->file_offset = ftell(replay_file);
+    state->file_offset = replay_file_tell();
 
     return 0;
 }
@@ -263,6 +263,7 @@ static void replay_enable(const char *fname, int mode)
     /* skip file header for RECORD and check it for PLAY */
     if (replay_mode == REPLAY_MODE_RECORD) {
         fseek(replay_file, HEADER_SIZE, SEEK_SET);
+        replay_writer_start();
     } else if (replay_mode == REPLAY_MODE_PLAY) {
         unsigned int version = replay_get_dword();
         if (version != REPLAY_VERSION) {
@@ -356,6 +357,7 @@ void replay_finish(void)
             replay_shutdown_request(SHUTDOWN_CAUSE_HOST_SIGNAL);
             /* write end event */
             replay_put_event(EVENT_END);
+            replay_writer_stop();
 
             /* write header */
             fseek(replay_file, 0, SEEK_SET);
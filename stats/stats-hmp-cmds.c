@@ -157,6 +157,8 @@ static StatsFilter *stats_filter(StatsTarget target, const char *names,
     }
     case STATS_TARGET_CRYPTODEV:
         break;
+    case STATS_TARGET_BLOCK:
+        break;
     default:
         break;
     }
@@ -229,6 +231,7 @@ void hmp_info_stats(Monitor *mon, const QDict *qdict)
         filter = stats_filter(target, names, cpu_index, provider);
         break;
     case STATS_TARGET_CRYPTODEV:
+    case STATS_TARGET_BLOCK:
         filter = stats_filter(target, names, -1, provider);
         break;
     default:
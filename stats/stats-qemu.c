@@ -0,0 +1,91 @@
+/*
+ * query-stats provider for QEMU's own hot-path counters
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/thread-stats.h"
+#include "sysemu/stats.h"
+
+static const struct {
+    const char *name;
+    StatsUnit unit;
+    int exponent;
+} qemu_stats_desc[QEMU_STAT__MAX] = {
+    [QEMU_STAT_TB_TRANSLATIONS]     = { "tb-translations" },
+    [QEMU_STAT_TB_TRANSLATE_NS]     = { "tb-translate-time",
+                                        STATS_UNIT_SECONDS, -9 },
+    [QEMU_STAT_TB_UNOPTIMIZED]      = { "tb-unoptimized-translations" },
+    [QEMU_STAT_TB_INVALIDATIONS]    = { "tb-invalidations" },
+    [QEMU_STAT_TB_JMP_CACHE_MISSES] = { "tb-jmp-cache-misses" },
+    [QEMU_STAT_VIRTQUEUE_POPS]      = { "virtqueue-pops" },
+    [QEMU_STAT_VIRTQUEUE_PUSHES]    = { "virtqueue-pushes" },
+    [QEMU_STAT_VIRTQUEUE_NOTIFIES]  = { "virtqueue-notifies" },
+    [QEMU_STAT_AIO_POLL_HITS]       = { "aio-poll-hits" },
+    [QEMU_STAT_RCU_GRACE_PERIODS]   = { "rcu-grace-periods" },
+    [QEMU_STAT_BQL_ACQUISITIONS]    = { "bql-acquisitions" },
+    [QEMU_STAT_BQL_HOLD_NS]         = { "bql-hold-time",
+                                        STATS_UNIT_SECONDS, -9 },
+};
+
+static void qemu_stats_cb(StatsResultList **result, StatsTarget target,
+                          strList *names, strList *targets, Error **errp)
+{
+    uint64_t vals[QEMU_STAT__MAX];
+    StatsList *stats_list = NULL;
+
+    if (target != STATS_TARGET_VM) {
+        return;
+    }
+
+    qemu_thread_stats_get(vals);
+    for (int i = QEMU_STAT__MAX - 1; i >= 0; i--) {
+        Stats *st;
+
+        if (!apply_str_list_filter(qemu_stats_desc[i].name, names)) {
+            continue;
+        }
+
+        st = g_new0(Stats, 1);
+        st->name = g_strdup(qemu_stats_desc[i].name);
+        st->value = g_new0(StatsValue, 1);
+        st->value->type = QTYPE_QNUM;
+        st->value->u.scalar = vals[i];
+        QAPI_LIST_PREPEND(stats_list, st);
+    }
+
+    if (stats_list) {
+        add_stats_entry(result, STATS_PROVIDER_QEMU, NULL, stats_list);
+    }
+}
+
+static void qemu_stats_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *stats_list = NULL;
+
+    for (int i = QEMU_STAT__MAX - 1; i >= 0; i--) {
+        StatsSchemaValue *value = g_new0(StatsSchemaValue, 1);
+
+        value->name = g_strdup(qemu_stats_desc[i].name);
+        value->type = STATS_TYPE_CUMULATIVE;
+        if (qemu_stats_desc[i].exponent) {
+            value->unit = qemu_stats_desc[i].unit;
+            value->has_unit = true;
+            value->base = 10;
+            value->has_base = true;
+            value->exponent = qemu_stats_desc[i].exponent;
+        }
+        QAPI_LIST_PREPEND(stats_list, value);
+    }
+
+    add_stats_schema(result, STATS_PROVIDER_QEMU, STATS_TARGET_VM,
+                     stats_list);
+}
+
+void qemu_stats_init(void)
+{
+    add_stats_callbacks(STATS_PROVIDER_QEMU, qemu_stats_cb,
+                        qemu_stats_schemas_cb);
+}
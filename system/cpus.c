@@ -34,10 +34,13 @@
 #include "sysemu/hw_accel.h"
 #include "exec/cpu-common.h"
 #include "qemu/thread.h"
+#include "qemu/thread-context.h"
 #include "qemu/main-loop.h"
 #include "qemu/plugin.h"
 #include "sysemu/cpus.h"
 #include "qemu/guest-random.h"
+#include "qemu/host-utils.h"
+#include "qemu/thread-stats.h"
 #include "hw/nmi.h"
 #include "sysemu/replay.h"
 #include "sysemu/runstate.h"
@@ -67,6 +70,9 @@
 
 static QemuMutex qemu_global_mutex;
 
+/* When the BQL was last taken, protected by the BQL itself */
+static int64_t qemu_global_mutex_since;
+
 /*
  * The chosen accelerator is supposed to register this.
  */
@@ -259,6 +265,13 @@ void cpu_interrupt(CPUState *cpu, int mask)
     }
 }
 
+void cpu_prepare_io(CPUState *cpu)
+{
+    if (cpus_accel && cpus_accel->prepare_io) {
+        cpus_accel->prepare_io(cpu);
+    }
+}
+
 static int do_vm_stop(RunState state, bool send_stop)
 {
     int ret = 0;
@@ -428,7 +441,7 @@ void qemu_wait_io_event(CPUState *cpu)
             slept = true;
             qemu_plugin_vcpu_idle_cb(cpu);
         }
-        qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
+        qemu_cond_wait_iothread(cpu->halt_cond);
     }
     if (slept) {
         qemu_plugin_vcpu_resume_cb(cpu);
@@ -437,6 +450,24 @@ void qemu_wait_io_event(CPUState *cpu)
     qemu_wait_io_event_common(cpu);
 }
 
+/*
+ * Create the thread that runs @cpu.  If the "thread-context" property of
+ * @cpu is set, the thread is created in that context and inherits its CPU
+ * affinity and scheduling policy from the start.
+ */
+void qemu_vcpu_thread_create(CPUState *cpu, const char *name,
+                             void *(*start_routine)(void *))
+{
+    if (cpu->thread_context) {
+        thread_context_create_thread(cpu->thread_context, cpu->thread, name,
+                                     start_routine, cpu,
+                                     QEMU_THREAD_JOINABLE);
+    } else {
+        qemu_thread_create(cpu->thread, name, start_routine, cpu,
+                           QEMU_THREAD_JOINABLE);
+    }
+}
+
 void cpus_kick_thread(CPUState *cpu)
 {
     if (cpu->thread_kicked) {
@@ -493,6 +524,132 @@ bool qemu_in_main_thread(void)
     return qemu_mutex_iothread_locked();
 }
 
+/*
+ * Sampling BQL profiler.  One in every sample_interval acquisitions by
+ * each thread measures how long it waited for the lock and how long it
+ * held it, and charges the hold time to the call site that took the
+ * lock.  Everything but the enabled flag and the interval is only
+ * updated with the BQL held, so the profiler needs no lock of its own.
+ */
+#define BQL_PROFILE_BUCKETS     32
+#define BQL_PROFILE_TOP_SITES   10
+
+typedef struct BQLProfileSite {
+    const char *file;
+    int line;
+    uint64_t samples;
+    uint64_t hold_ns;
+    uint64_t max_hold_ns;
+} BQLProfileSite;
+
+static struct {
+    bool enabled;
+    uint32_t sample_interval;
+    uint64_t samples;
+    /* Bucket i counts times in [2^i, 2^(i+1)) ns, the last is unbounded */
+    uint64_t wait_hist[BQL_PROFILE_BUCKETS];
+    uint64_t hold_hist[BQL_PROFILE_BUCKETS];
+    GHashTable *sites;
+
+    /* The acquisition being sampled, if site_file is not NULL */
+    const char *site_file;
+    int site_line;
+} bql_profile;
+
+QEMU_DEFINE_STATIC_CO_TLS(uint32_t, bql_sample_countdown)
+
+static guint bql_profile_site_hash(gconstpointer key)
+{
+    const BQLProfileSite *site = key;
+
+    return g_direct_hash(site->file) ^ site->line;
+}
+
+static gboolean bql_profile_site_equal(gconstpointer a, gconstpointer b)
+{
+    const BQLProfileSite *sa = a, *sb = b;
+
+    return sa->file == sb->file && sa->line == sb->line;
+}
+
+static void bql_profile_hist_add(uint64_t *hist, int64_t ns)
+{
+    int bucket = ns > 1 ? 63 - clz64(ns) : 0;
+
+    hist[MIN(bucket, BQL_PROFILE_BUCKETS - 1)]++;
+}
+
+/* Decide whether the acquisition that is about to start is sampled. */
+static bool bql_profile_should_sample(void)
+{
+    uint32_t n;
+
+    if (likely(!qatomic_read(&bql_profile.enabled))) {
+        return false;
+    }
+
+    n = get_bql_sample_countdown();
+    if (n) {
+        set_bql_sample_countdown(n - 1);
+        return false;
+    }
+    set_bql_sample_countdown(qatomic_read(&bql_profile.sample_interval) - 1);
+    return true;
+}
+
+static void bql_profile_acquired(const char *file, int line, int64_t wait_ns)
+{
+    /* Profiling may have been disabled while we waited */
+    if (!bql_profile.enabled) {
+        return;
+    }
+    bql_profile_hist_add(bql_profile.wait_hist, wait_ns);
+    bql_profile.site_file = file;
+    bql_profile.site_line = line;
+}
+
+static void bql_profile_released(int64_t hold_ns)
+{
+    BQLProfileSite key = {
+        .file = bql_profile.site_file,
+        .line = bql_profile.site_line,
+    };
+    BQLProfileSite *site;
+
+    bql_profile.site_file = NULL;
+    if (!bql_profile.enabled) {
+        return;
+    }
+
+    bql_profile.samples++;
+    bql_profile_hist_add(bql_profile.hold_hist, hold_ns);
+
+    site = g_hash_table_lookup(bql_profile.sites, &key);
+    if (!site) {
+        site = g_memdup2(&key, sizeof(key));
+        g_hash_table_add(bql_profile.sites, site);
+    }
+    site->samples++;
+    site->hold_ns += hold_ns;
+    site->max_hold_ns = MAX(site->max_hold_ns, hold_ns);
+}
+
+static void bql_hold_start(void)
+{
+    qemu_global_mutex_since = get_clock();
+    qemu_thread_stat_add(QEMU_STAT_BQL_ACQUISITIONS, 1);
+}
+
+static void bql_hold_end(void)
+{
+    int64_t hold_ns = get_clock() - qemu_global_mutex_since;
+
+    qemu_thread_stat_add(QEMU_STAT_BQL_HOLD_NS, hold_ns);
+    if (unlikely(bql_profile.site_file)) {
+        bql_profile_released(hold_ns);
+    }
+}
+
 /*
  * The BQL is taken from so many places that it is worth profiling the
  * callers directly, instead of funneling them all through a single function.
@@ -500,27 +657,39 @@ bool qemu_in_main_thread(void)
 void qemu_mutex_lock_iothread_impl(const char *file, int line)
 {
     QemuMutexLockFunc bql_lock = qatomic_read(&qemu_bql_mutex_lock_func);
+    bool sample = bql_profile_should_sample();
+    int64_t wait_start = sample ? get_clock() : 0;
 
     g_assert(!qemu_mutex_iothread_locked());
     bql_lock(&qemu_global_mutex, file, line);
     set_iothread_locked(true);
+    bql_hold_start();
+    if (unlikely(sample)) {
+        bql_profile_acquired(file, line,
+                             qemu_global_mutex_since - wait_start);
+    }
 }
 
 void qemu_mutex_unlock_iothread(void)
 {
     g_assert(qemu_mutex_iothread_locked());
+    bql_hold_end();
     set_iothread_locked(false);
     qemu_mutex_unlock(&qemu_global_mutex);
 }
 
 void qemu_cond_wait_iothread(QemuCond *cond)
 {
+    bql_hold_end();
     qemu_cond_wait(cond, &qemu_global_mutex);
+    bql_hold_start();
 }
 
 void qemu_cond_timedwait_iothread(QemuCond *cond, int ms)
 {
+    bql_hold_end();
     qemu_cond_timedwait(cond, &qemu_global_mutex, ms);
+    bql_hold_start();
 }
 
 /* signal CPU creation */
@@ -571,7 +740,7 @@ void pause_all_vcpus(void)
     replay_mutex_unlock();
 
     while (!all_vcpus_paused()) {
-        qemu_cond_wait(&qemu_pause_cond, &qemu_global_mutex);
+        qemu_cond_wait_iothread(&qemu_pause_cond);
         CPU_FOREACH(cpu) {
             qemu_cpu_kick(cpu);
         }
@@ -649,7 +818,7 @@ void qemu_init_vcpu(CPUState *cpu)
     cpus_accel->create_vcpu_thread(cpu);
 
     while (!cpu->created) {
-        qemu_cond_wait(&qemu_cpu_cond, &qemu_global_mutex);
+        qemu_cond_wait_iothread(&qemu_cpu_cond);
     }
 }
 
@@ -822,6 +991,87 @@ exit:
     fclose(f);
 }
 
+void qmp_set_bql_profile(bool enable, bool has_sample_interval,
+                         uint32_t sample_interval, Error **errp)
+{
+    if (has_sample_interval) {
+        if (sample_interval == 0) {
+            error_setg(errp, "sample-interval must be positive");
+            return;
+        }
+        qatomic_set(&bql_profile.sample_interval, sample_interval);
+    } else if (!bql_profile.sample_interval) {
+        qatomic_set(&bql_profile.sample_interval, 64);
+    }
+
+    if (enable && !bql_profile.enabled) {
+        /* Start from scratch */
+        bql_profile.samples = 0;
+        memset(bql_profile.wait_hist, 0, sizeof(bql_profile.wait_hist));
+        memset(bql_profile.hold_hist, 0, sizeof(bql_profile.hold_hist));
+        if (bql_profile.sites) {
+            g_hash_table_remove_all(bql_profile.sites);
+        } else {
+            bql_profile.sites = g_hash_table_new_full(bql_profile_site_hash,
+                                                      bql_profile_site_equal,
+                                                      g_free, NULL);
+        }
+    }
+    qatomic_set(&bql_profile.enabled, enable);
+}
+
+static gint bql_profile_site_cmp(gconstpointer a, gconstpointer b)
+{
+    const BQLProfileSite *sa = a, *sb = b;
+
+    if (sa->hold_ns != sb->hold_ns) {
+        return sa->hold_ns < sb->hold_ns ? 1 : -1;
+    }
+    return 0;
+}
+
+static uint64List *bql_profile_hist_list(const uint64_t *hist)
+{
+    uint64List *list = NULL;
+    int i;
+
+    for (i = BQL_PROFILE_BUCKETS - 1; i >= 0; i--) {
+        QAPI_LIST_PREPEND(list, hist[i]);
+    }
+    return list;
+}
+
+BqlProfile *qmp_query_bql_profile(Error **errp)
+{
+    BqlProfile *info = g_new0(BqlProfile, 1);
+    BqlProfileSiteList **tail = &info->top_holders;
+    g_autoptr(GList) sites = NULL;
+    GList *l;
+    int n;
+
+    info->enabled = bql_profile.enabled;
+    info->sample_interval = bql_profile.sample_interval;
+    info->samples = bql_profile.samples;
+    info->wait_histogram = bql_profile_hist_list(bql_profile.wait_hist);
+    info->hold_histogram = bql_profile_hist_list(bql_profile.hold_hist);
+
+    if (bql_profile.sites) {
+        sites = g_hash_table_get_keys(bql_profile.sites);
+        sites = g_list_sort(sites, bql_profile_site_cmp);
+    }
+    for (l = sites, n = 0; l && n < BQL_PROFILE_TOP_SITES; l = l->next, n++) {
+        BQLProfileSite *site = l->data;
+        BqlProfileSite *value = g_new0(BqlProfileSite, 1);
+
+        value->site = g_strdup_printf("%s:%d", site->file, site->line);
+        value->samples = site->samples;
+        value->hold_ns = site->hold_ns;
+        value->max_hold_ns = site->max_hold_ns;
+        QAPI_LIST_APPEND(tail, value);
+    }
+    return info;
+}
+
 void qmp_inject_nmi(Error **errp)
 {
     nmi_monitor_handle(monitor_get_cpu_index(monitor_cur()), errp);
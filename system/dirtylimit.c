@@ -444,6 +444,69 @@ static void dirtylimit_cleanup(void)
     dirtylimit_state_finalize();
 }
 
+static int dirtylimit_rate_cmp(const void *a, const void *b)
+{
+    const DirtyRateVcpu *ra = a, *rb = b;
+
+    if (ra->dirty_rate == rb->dirty_rate) {
+        return ra->id < rb->id ? -1 : 1;
+    }
+    return ra->dirty_rate > rb->dirty_rate ? -1 : 1;
+}
+
+/*
+ * Limit only the @top_n vCPUs with the highest dirty page rate, so that
+ * the dirty page rate of the whole VM drops to @target MB/s.  Each of
+ * them gives up a share of the excess in proportion to its own rate,
+ * but is never limited below @min_quota; all other vCPUs run unlimited.
+ * The rates are measured with the limits in place, so calling this
+ * again once the totals have settled loosens or tightens the quotas.
+ */
+void dirtylimit_set_top_vcpus(int top_n,
+                              uint64_t target,
+                              uint64_t min_quota)
+{
+    MachineState *ms = MACHINE(qdev_get_machine());
+    int max_cpus = ms->smp.max_cpus;
+    g_autofree DirtyRateVcpu *rates = g_new(DirtyRateVcpu, max_cpus);
+    uint64_t total = 0, top = 0;
+    int i;
+
+    dirtylimit_state_lock();
+
+    if (!dirtylimit_in_service()) {
+        dirtylimit_init();
+    }
+
+    for (i = 0; i < max_cpus; i++) {
+        rates[i].id = i;
+        rates[i].dirty_rate = MAX(vcpu_dirty_rate_get(i), 0);
+        total += rates[i].dirty_rate;
+    }
+    qsort(rates, max_cpus, sizeof(*rates), dirtylimit_rate_cmp);
+
+    top_n = MIN(top_n, max_cpus);
+    for (i = 0; i < top_n; i++) {
+        top += rates[i].dirty_rate;
+    }
+
+    for (i = 0; i < max_cpus; i++) {
+        uint64_t quota = min_quota;
+
+        if (i >= top_n || !top) {
+            dirtylimit_set_vcpu(rates[i].id, 0, false);
+            continue;
+        }
+        if (top + target > total) {
+            quota = MAX(min_quota, rates[i].dirty_rate *
+                        (top + target - total) / top);
+        }
+        dirtylimit_set_vcpu(rates[i].id, quota, true);
+    }
+
+    dirtylimit_state_unlock();
+}
+
 /*
  * dirty page rate limit is not allowed to set if migration
  * is running with dirty-limit capability enabled.
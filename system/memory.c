@@ -22,6 +22,7 @@
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 #include "qemu/qemu-print.h"
+#include "qemu/timer.h"
 #include "qom/object.h"
 #include "trace.h"
 
@@ -50,6 +51,14 @@ static QTAILQ_HEAD(, AddressSpace) address_spaces
 
 static GHashTable *flat_views;
 
+/* Cost of the topology updates done by memory_region_transaction_commit() */
+static struct {
+    uint64_t commits;
+    uint64_t views;
+    uint64_t views_reused;
+    uint64_t ns;
+} memory_commit_stats;
+
 typedef struct AddrRange AddrRange;
 
 /*
@@ -127,6 +136,22 @@ enum ListenerDirection { Forward, Reverse };
         }                                                               \
     } while (0)
 
+/*
+ * Like MEMORY_LISTENER_CALL_GLOBAL(..., Forward), but skip listeners whose
+ * address space keeps its FlatView in the transaction being committed.
+ */
+#define MEMORY_LISTENER_CALL_CHANGED(_callback)                         \
+    do {                                                                \
+        MemoryListener *_listener;                                      \
+                                                                        \
+        QTAILQ_FOREACH(_listener, &memory_listeners, link) {            \
+            if (_listener->_callback &&                                 \
+                _listener->address_space->flatview_changed) {           \
+                _listener->_callback(_listener);                        \
+            }                                                           \
+        }                                                               \
+    } while (0)
+
 #define MEMORY_LISTENER_CALL(_as, _callback, _direction, _section, _args...) \
     do {                                                                \
         MemoryListener *_listener;                                      \
@@ -749,8 +774,32 @@ static MemoryRegion *memory_region_get_flatview_root(MemoryRegion *mr)
     return NULL;
 }
 
-/* Render a memory topology into a list of disjoint absolute ranges. */
-static FlatView *generate_memory_topology(MemoryRegion *mr)
+static bool flatview_ranges_equal(FlatView *a, FlatView *b)
+{
+    unsigned i;
+
+    if (a->nr != b->nr) {
+        return false;
+    }
+    for (i = 0; i < a->nr; i++) {
+        if (!flatrange_equal(&a->ranges[i], &b->ranges[i]) ||
+            a->ranges[i].dirty_log_mask != b->ranges[i].dirty_log_mask) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Render a memory topology into a list of disjoint absolute ranges.
+ *
+ * If @old_view is not NULL and the rendered ranges are identical to it,
+ * @old_view is reused instead, which skips building the dispatch tree and
+ * lets address_space_set_flatview() return early for all address spaces
+ * that share it.
+ */
+static FlatView *generate_memory_topology_reuse(MemoryRegion *mr,
+                                                FlatView *old_view)
 {
     int i;
     FlatView *view;
@@ -764,6 +813,15 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
     }
     flatview_simplify(view);
 
+    if (old_view && old_view->dispatch &&
+        flatview_ranges_equal(old_view, view)) {
+        trace_flatview_reuse(old_view, mr);
+        flatview_unref(view);
+        flatview_ref(old_view);
+        g_hash_table_replace(flat_views, mr, old_view);
+        return old_view;
+    }
+
     view->dispatch = address_space_dispatch_new(view);
     for (i = 0; i < view->nr; i++) {
         MemoryRegionSection mrs =
@@ -776,6 +834,11 @@ static FlatView *generate_memory_topology(MemoryRegion *mr)
     return view;
 }
 
+static FlatView *generate_memory_topology(MemoryRegion *mr)
+{
+    return generate_memory_topology_reuse(mr, NULL);
+}
+
 static void address_space_add_del_ioeventfds(AddressSpace *as,
                                              MemoryRegionIoeventfd *fds_new,
                                              unsigned fds_new_nb,
@@ -1030,26 +1093,41 @@ static void flatviews_init(void)
     }
 }
 
-static void flatviews_reset(void)
+/*
+ * Returns the number of unique FlatViews and, in @reused, how many of them
+ * were carried over unchanged from the previous topology.
+ */
+static unsigned flatviews_reset(unsigned *reused)
 {
     AddressSpace *as;
+    GHashTable *old_views = flat_views;
+    unsigned rendered = 0;
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    *reused = 0;
+    flat_views = NULL;
     flatviews_init();
 
     /* Render unique FVs */
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
+        FlatView *old_view, *view;
 
         if (g_hash_table_lookup(flat_views, physmr)) {
             continue;
         }
 
-        generate_memory_topology(physmr);
+        old_view = old_views ? g_hash_table_lookup(old_views, physmr) : NULL;
+        view = generate_memory_topology_reuse(physmr, old_view);
+        rendered++;
+        if (view == old_view) {
+            (*reused)++;
+        }
+    }
+
+    if (old_views) {
+        g_hash_table_unref(old_views);
     }
+    return rendered;
 }
 
 static void address_space_set_flatview(AddressSpace *as)
@@ -1124,17 +1202,53 @@ void memory_region_transaction_commit(void)
     --memory_region_transaction_depth;
     if (!memory_region_transaction_depth) {
         if (memory_region_update_pending) {
-            flatviews_reset();
+            int64_t start = get_clock(), elapsed;
+            unsigned views, reused;
+
+            views = flatviews_reset(&reused);
+
+            /*
+             * Listeners of an address space whose FlatView was reused get
+             * no region callbacks, so do not bother them with begin and
+             * commit either.  Some of them (vhost, the remote proxy)
+             * rebuild their state from the callbacks seen in between, and
+             * others (virtio, TCG) redo per-device work on every commit.
+             */
+            QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
+                MemoryRegion *physmr;
+
+                physmr = memory_region_get_flatview_root(as->root);
+                as->flatview_changed = address_space_to_flatview(as) !=
+                    g_hash_table_lookup(flat_views, physmr);
+            }
 
-            MEMORY_LISTENER_CALL_GLOBAL(begin, Forward);
+            MEMORY_LISTENER_CALL_CHANGED(begin);
 
+            /*
+             * The ioeventfds of an address space are derived from its
+             * FlatView, so a reused view only needs a new walk when
+             * eventfds were added or removed in this transaction.
+             */
             QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
                 address_space_set_flatview(as);
-                address_space_update_ioeventfds(as);
+                if (as->flatview_changed || ioeventfd_update_pending) {
+                    address_space_update_ioeventfds(as);
+                }
             }
             memory_region_update_pending = false;
             ioeventfd_update_pending = false;
-            MEMORY_LISTENER_CALL_GLOBAL(commit, Forward);
+            MEMORY_LISTENER_CALL_CHANGED(commit);
+
+            QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
+                as->flatview_changed = false;
+            }
+
+            elapsed = get_clock() - start;
+            memory_commit_stats.commits++;
+            memory_commit_stats.views += views;
+            memory_commit_stats.views_reused += reused;
+            memory_commit_stats.ns += elapsed;
+            trace_memory_region_transaction_commit(views, reused, elapsed);
         } else if (ioeventfd_update_pending) {
             QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
                 address_space_update_ioeventfds(as);
@@ -1276,6 +1390,7 @@ static void memory_region_initfn(Object *obj)
     mr->ops = &unassigned_mem_ops;
     mr->enabled = true;
     mr->romd_mode = true;
+    mr->global_locking = true;
     mr->destructor = memory_region_destructor_none;
     QTAILQ_INIT(&mr->subregions);
     QTAILQ_INIT(&mr->coalesced);
@@ -2540,6 +2655,11 @@ void memory_region_clear_flush_coalesced(MemoryRegion *mr)
     }
 }
 
+void memory_region_clear_global_locking(MemoryRegion *mr)
+{
+    mr->global_locking = false;
+}
+
 void memory_region_add_eventfd(MemoryRegion *mr,
                                hwaddr addr,
                                unsigned size,
@@ -3115,6 +3235,7 @@ void address_space_init(AddressSpace *as, MemoryRegion *root, const char *name)
     as->current_map = NULL;
     as->ioeventfd_nb = 0;
     as->ioeventfds = NULL;
+    as->flatview_changed = false;
     QTAILQ_INIT(&as->listeners);
     QTAILQ_INSERT_TAIL(&address_spaces, as, address_spaces_link);
     as->name = g_strdup(name ? name : "anonymous");
@@ -3465,6 +3586,12 @@ static void mtree_info_flatview(bool dispatch_tree, bool owner)
     /* Print */
     g_hash_table_foreach(views, mtree_print_flatview, &fvi);
 
+    qemu_printf("Topology updates: %" PRIu64 ", FlatViews rendered: %" PRIu64
+                " (%" PRIu64 " reused), total time: %" PRIu64 " us\n\n",
+                memory_commit_stats.commits, memory_commit_stats.views,
+                memory_commit_stats.views_reused,
+                memory_commit_stats.ns / SCALE_US);
+
     /* Free */
     g_hash_table_foreach_remove(views, mtree_info_flatview_free, 0);
     g_hash_table_unref(views);
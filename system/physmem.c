@@ -39,6 +39,7 @@
 #include "sysemu/kvm.h"
 #include "sysemu/tcg.h"
 #include "sysemu/qtest.h"
+#include "sysemu/cpus.h"
 #include "qemu/timer.h"
 #include "qemu/config-file.h"
 #include "qemu/error-report.h"
@@ -2145,6 +2146,55 @@ void qemu_ram_remap(ram_addr_t addr, ram_addr_t length)
         }
     }
 }
+
+/*
+ * Map @fd at @fd_offset in place of the shared backing memory of @block,
+ * and take ownership of it.  The guest physical layout, the host address
+ * and therefore all existing users of the block stay valid; only the
+ * memory behind them is replaced.
+ */
+bool qemu_ram_replace_fd(RAMBlock *block, int fd, uint64_t fd_offset,
+                         Error **errp)
+{
+    size_t size = ROUND_UP(block->max_length, block->page_size);
+    int prot = PROT_READ;
+    int flags = MAP_SHARED | MAP_FIXED;
+    struct stat st;
+    void *area;
+
+    if (block->fd < 0 || !qemu_ram_is_shared(block) ||
+        (block->flags & RAM_PREALLOC)) {
+        error_setg(errp, "RAM block %s is not backed by shared memory",
+                   block->idstr);
+        return false;
+    }
+    if (qemu_fd_getpagesize(fd) != block->page_size) {
+        error_setg(errp, "RAM block %s page size mismatch", block->idstr);
+        return false;
+    }
+    if (fstat(fd, &st) < 0 ||
+        (S_ISREG(st.st_mode) && st.st_size < fd_offset + size)) {
+        error_setg(errp, "RAM block %s: backing memory too small",
+                   block->idstr);
+        return false;
+    }
+
+    prot |= block->flags & RAM_READONLY ? 0 : PROT_WRITE;
+    flags |= block->flags & RAM_NORESERVE ? MAP_NORESERVE : 0;
+    area = mmap(block->host, size, prot, flags, fd, fd_offset);
+    if (area != block->host) {
+        error_setg_errno(errp, errno, "RAM block %s: cannot map memory",
+                         block->idstr);
+        return false;
+    }
+    memory_try_enable_merging(block->host, size);
+    qemu_ram_setup_dump(block->host, size);
+
+    close(block->fd);
+    block->fd = fd;
+    block->fd_offset = fd_offset;
+    return true;
+}
 #endif /* !_WIN32 */
 
 /* Return a host pointer to ram allocated with qemu_ram_alloc.
@@ -2432,23 +2482,6 @@ static uint16_t dummy_section(PhysPageMap *map, FlatView *fv, MemoryRegion *mr)
     return phys_section_add(map, &section);
 }
 
-MemoryRegionSection *iotlb_to_section(CPUState *cpu,
-                                      hwaddr index, MemTxAttrs attrs)
-{
-    int asidx = cpu_asidx_from_attrs(cpu, attrs);
-    CPUAddressSpace *cpuas = &cpu->cpu_ases[asidx];
-    AddressSpaceDispatch *d = cpuas->memory_dispatch;
-    int section_index = index & ~TARGET_PAGE_MASK;
-    MemoryRegionSection *ret;
-
-    assert(section_index < d->map.sections_nb);
-    ret = d->map.sections + section_index;
-    assert(ret->mr);
-    assert(ret->mr->ops);
-
-    return ret;
-}
-
 static void io_mem_init(void)
 {
     memory_region_init_io(&io_mem_unassigned, NULL, &unassigned_mem_ops, NULL,
@@ -2639,11 +2672,15 @@ bool prepare_mmio_access(MemoryRegion *mr)
 {
     bool release_lock = false;
 
-    if (!qemu_mutex_iothread_locked()) {
+    if (current_cpu) {
+        cpu_prepare_io(current_cpu);
+    }
+    if (mr->global_locking && !qemu_mutex_iothread_locked()) {
         qemu_mutex_lock_iothread();
         release_lock = true;
     }
     if (mr->flush_coalesced_mmio) {
+        QEMU_IOTHREAD_LOCK_GUARD();
         qemu_flush_coalesced_mmio_buffer();
     }
 
@@ -2678,11 +2715,11 @@ static bool flatview_access_allowed(MemoryRegion *mr, MemTxAttrs attrs,
 }
 
 /* Called within RCU critical section.  */
-static MemTxResult flatview_write_continue(FlatView *fv, hwaddr addr,
-                                           MemTxAttrs attrs,
-                                           const void *ptr,
-                                           hwaddr len, hwaddr addr1,
-                                           hwaddr l, MemoryRegion *mr)
+/* Called within RCU critical section.  */
+MemTxResult flatview_write_continue(FlatView *fv, hwaddr addr,
+                                    MemTxAttrs attrs, const void *ptr,
+                                    hwaddr len, hwaddr addr1, hwaddr l,
+                                    MemoryRegion *mr)
 {
     uint8_t *ram_ptr;
     uint64_t val;
@@ -27,6 +27,7 @@
 #include "qemu/datadir.h"
 #include "qemu/units.h"
 #include "exec/cpu-common.h"
+#include "exec/memory.h"
 #include "exec/page-vary.h"
 #include "hw/qdev-properties.h"
 #include "qapi/compat-policy.h"
@@ -439,6 +440,9 @@ static QemuOptsList qemu_icount_opts = {
         }, {
             .name = "sleep",
             .type = QEMU_OPT_BOOL,
+        }, {
+            .name = "quantum",
+            .type = QEMU_OPT_NUMBER,
         }, {
             .name = "rr",
             .type = QEMU_OPT_STRING,
@@ -2632,8 +2636,19 @@ static void qemu_create_cli_devices(void)
             exit(1);
     }
 
-    /* init generic devices */
+    /*
+     * init generic devices
+     *
+     * Every device that maps a region, registers a memory listener or
+     * assigns an ioeventfd commits a memory transaction of its own, and
+     * each commit re-renders all address spaces and notifies all
+     * listeners registered so far.  With hundreds of devices this is
+     * quadratic, so batch the whole lot into one transaction.  Listeners
+     * registered meanwhile are replayed the current layout and get the
+     * changes when the transaction ends.
+     */
     rom_set_order_override(FW_CFG_ORDER_OVERRIDE_DEVICE);
+    memory_region_transaction_begin();
     qemu_opts_foreach(qemu_find_opts("device"),
                       device_init_func, NULL, &error_fatal);
     QTAILQ_FOREACH(opt, &device_opts, next) {
@@ -2650,6 +2665,7 @@ static void qemu_create_cli_devices(void)
         object_unref(OBJECT(dev));
         loc_pop(&opt->loc);
     }
+    memory_region_transaction_commit();
     rom_reset_order_override();
 }
 
@@ -228,6 +228,31 @@ typedef struct CPUARMTBFlags {
 
 typedef struct ARMMMUFaultInfo ARMMMUFaultInfo;
 
+/* Table levels 0 to 3 of a long-descriptor translation table walk */
+#define ARM_WALK_CACHE_LEVELS 4
+
+/*
+ * A cached table descriptor walk: a walk of the regime with inputs
+ * @ttbr, @tcr, @select, @in_space and @in_ptw_idx reaches the table at
+ * @descaddr, in @table_space via @table_ptw_idx, at one level for the
+ * input address bits @vtag above that level.  Valid while the tlb flush
+ * generation is still @gen.
+ */
+typedef struct ARMWalkCacheEntry {
+    uint64_t ttbr;
+    uint64_t tcr;
+    uint64_t vtag;
+    uint64_t descaddr;
+    uint32_t gen;
+    uint32_t tableattrs;
+    uint8_t select;
+    uint8_t in_space;
+    uint8_t in_ptw_idx;
+    uint8_t table_space;
+    uint8_t table_ptw_idx;
+    bool valid;
+} ARMWalkCacheEntry;
+
 typedef struct NVICState NVICState;
 
 typedef struct CPUArchState {
@@ -743,6 +768,9 @@ typedef struct CPUArchState {
     /* Optional fault info across tlb lookup. */
     ARMMMUFaultInfo *tlb_fi;
 
+    /* Table walk cache, indexed by core mmu_idx and table level. */
+    ARMWalkCacheEntry walk_cache[NB_MMU_MODES][ARM_WALK_CACHE_LEVELS];
+
     /* Fields up to this point are cleared by a CPU reset */
     struct {} end_reset_fields;
 
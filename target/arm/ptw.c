@@ -1581,6 +1581,37 @@ static bool lpae_block_desc_valid(ARMCPU *cpu, bool ds,
     }
 }
 
+#ifdef CONFIG_TCG
+/*
+ * The input address bits above those that index the table at @level,
+ * which together with the regime select that table.
+ */
+static uint64_t walk_cache_vtag(uint64_t address, int stride,
+                                int inputsize, int level)
+{
+    int shift = stride * (5 - level) + 3;
+
+    if (shift >= inputsize) {
+        return 0;
+    }
+    return extract64(address, shift, inputsize - shift);
+}
+
+static bool walk_cache_match(CPUARMState *env, ARMWalkCacheEntry *e,
+                             S1Translate *ptw, uint64_t ttbr, uint64_t tcr,
+                             int select, uint64_t vtag)
+{
+    return e->valid
+        && e->gen == tlb_flush_generation(env_cpu(env))
+        && e->vtag == vtag
+        && e->ttbr == ttbr
+        && e->tcr == tcr
+        && e->select == select
+        && e->in_space == ptw->in_space
+        && e->in_ptw_idx == ptw->in_ptw_idx;
+}
+#endif
+
 /**
  * get_phys_addr_lpae: perform one stage of page table walk, LPAE format
  *
@@ -1620,6 +1651,12 @@ static bool get_phys_addr_lpae(CPUARMState *env, S1Translate *ptw,
     bool aarch64 = arm_el_is_aa64(env, el);
     uint64_t descriptor, new_descriptor;
     ARMSecuritySpace out_space;
+#ifdef CONFIG_TCG
+    ARMWalkCacheEntry *walk_cache =
+        env->walk_cache[mmu_idx & ARM_MMU_IDX_COREIDX_MASK];
+    ARMSecuritySpace walk_in_space = ptw->in_space;
+    ARMMMUIdx walk_in_ptw_idx = ptw->in_ptw_idx;
+#endif
 
     /* TODO: This code does not support shareability levels. */
     if (aarch64) {
@@ -1783,6 +1820,35 @@ static bool get_phys_addr_lpae(CPUARMState *env, S1Translate *ptw,
     descaddrmask &= ~indexmask_grainsize;
     tableattrs = 0;
 
+#ifdef CONFIG_TCG
+    /*
+     * Resume the walk from the deepest table level that an earlier walk
+     * with the same inputs reached.  Only the next level addresses are
+     * cached: the stage 2 translation of each remaining descriptor
+     * address is still looked up, so stage 2 permissions are honoured.
+     * Like the architectural walk caches, entries live until a TLB flush.
+     */
+    if (likely(!ptw->in_debug)) {
+        int l;
+
+        for (l = ARM_WALK_CACHE_LEVELS - 1; l > level; l--) {
+            ARMWalkCacheEntry *e = &walk_cache[l];
+
+            if (walk_cache_match(env, e, ptw, ttbr, tcr, param.select,
+                                 walk_cache_vtag(address, stride,
+                                                 inputsize, l))) {
+                descaddr = e->descaddr;
+                tableattrs = e->tableattrs;
+                ptw->in_space = e->table_space;
+                ptw->in_ptw_idx = e->table_ptw_idx;
+                level = l;
+                indexmask = indexmask_grainsize;
+                break;
+            }
+        }
+    }
+#endif
+
  next_level:
     descaddr |= (address >> (stride * (4 - level))) & indexmask;
     descaddr &= ~7ULL;
@@ -1852,6 +1918,24 @@ static bool get_phys_addr_lpae(CPUARMState *env, S1Translate *ptw,
         tableattrs |= extract64(descriptor, 59, 5);
         level++;
         indexmask = indexmask_grainsize;
+#ifdef CONFIG_TCG
+        if (likely(!ptw->in_debug)) {
+            ARMWalkCacheEntry *e = &walk_cache[level];
+
+            e->ttbr = ttbr;
+            e->tcr = tcr;
+            e->vtag = walk_cache_vtag(address, stride, inputsize, level);
+            e->descaddr = descaddr;
+            e->gen = tlb_flush_generation(env_cpu(env));
+            e->tableattrs = tableattrs;
+            e->select = param.select;
+            e->in_space = walk_in_space;
+            e->in_ptw_idx = walk_in_ptw_idx;
+            e->table_space = ptw->in_space;
+            e->table_ptw_idx = ptw->in_ptw_idx;
+            e->valid = true;
+        }
+#endif
         goto next_level;
     }
 
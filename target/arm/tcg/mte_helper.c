@@ -81,6 +81,58 @@ static int choose_nonexcluded_tag(int tag, int offset, uint16_t exclude)
  *     traps and watchpoint traps.
  * (probe = true, ra != 0 is invalid and will assert.)
  */
+#ifndef CONFIG_USER_ONLY
+/*
+ * Return the host address of the allocation tags for the start of the
+ * page described by @full, or NULL if there is no tag ram for it.  For
+ * tag reads, cache the result in @full for later checks on the page.
+ */
+static uint8_t *allocation_tag_mem_lookup(CPUARMState *env,
+                                          CPUTLBEntryFull *full,
+                                          MemTxAttrs attrs,
+                                          MMUAccessType tag_access)
+{
+    hwaddr tag_paddr, xlat;
+    MemoryRegion *mr;
+    ARMASIdx tag_asi;
+    AddressSpace *tag_as;
+    uint8_t *tag_mem;
+
+    /* Convert to the physical address in tag space.  */
+    tag_paddr = full->phys_addr >> (LOG2_TAG_GRANULE + 1);
+
+    /* Look up the address in tag space. */
+    tag_asi = attrs.secure ? ARMASIdx_TagS : ARMASIdx_TagNS;
+    tag_as = cpu_get_address_space(env_cpu(env), tag_asi);
+    mr = address_space_translate(tag_as, tag_paddr, &xlat, NULL,
+                                 tag_access == MMU_DATA_STORE, attrs);
+
+    /*
+     * Note that @mr will never be NULL.  If there is nothing in the address
+     * space at @tag_paddr, the translation will return the unallocated memory
+     * region.  For our purposes, the result must be ram.
+     */
+    if (unlikely(!memory_region_is_ram(mr))) {
+        return NULL;
+    }
+
+    /*
+     * Ensure the tag memory is dirty on write, for migration.
+     * Tag memory can never contain code or display memory (vga).
+     */
+    if (tag_access == MMU_DATA_STORE) {
+        ram_addr_t tag_ra = memory_region_get_ram_addr(mr) + xlat;
+        cpu_physical_memory_set_dirty_flag(tag_ra, DIRTY_MEMORY_MIGRATION);
+    }
+
+    tag_mem = memory_region_get_ram_ptr(mr) + xlat;
+    if (tag_access == MMU_DATA_LOAD) {
+        full->extra.arm.tag_mem = tag_mem;
+    }
+    return tag_mem;
+}
+#endif
+
 static uint8_t *allocation_tag_mem_probe(CPUARMState *env, int ptr_mmu_idx,
                                          uint64_t ptr, MMUAccessType ptr_access,
                                          int ptr_size, MMUAccessType tag_access,
@@ -113,10 +165,8 @@ static uint8_t *allocation_tag_mem_probe(CPUARMState *env, int ptr_mmu_idx,
     CPUTLBEntryFull *full;
     MemTxAttrs attrs;
     int in_page, flags;
-    hwaddr ptr_paddr, tag_paddr, xlat;
-    MemoryRegion *mr;
-    ARMASIdx tag_asi;
-    AddressSpace *tag_as;
+    hwaddr ptr_paddr;
+    uint8_t *tag_mem;
     void *host;
 
     /*
@@ -155,9 +205,16 @@ static uint8_t *allocation_tag_mem_probe(CPUARMState *env, int ptr_mmu_idx,
     /*
      * Remember these values across the second lookup below,
      * which may invalidate this pointer via tlb resize.
+     * The tag memory of a page does not change while the page is in
+     * the tlb, so the cached pointer can be used for all but stores
+     * to the tags, which need to mark the tag memory dirty.
      */
     ptr_paddr = full->phys_addr | (ptr & ~TARGET_PAGE_MASK);
     attrs = full->attrs;
+    tag_mem = tag_access == MMU_DATA_LOAD ? full->extra.arm.tag_mem : NULL;
+    if (!tag_mem) {
+        tag_mem = allocation_tag_mem_lookup(env, full, attrs, tag_access);
+    }
     full = NULL;
 
     /*
@@ -180,39 +237,16 @@ static uint8_t *allocation_tag_mem_probe(CPUARMState *env, int ptr_mmu_idx,
         cpu_check_watchpoint(env_cpu(env), ptr, ptr_size, attrs, wp, ra);
     }
 
-    /* Convert to the physical address in tag space.  */
-    tag_paddr = ptr_paddr >> (LOG2_TAG_GRANULE + 1);
-
-    /* Look up the address in tag space. */
-    tag_asi = attrs.secure ? ARMASIdx_TagS : ARMASIdx_TagNS;
-    tag_as = cpu_get_address_space(env_cpu(env), tag_asi);
-    mr = address_space_translate(tag_as, tag_paddr, &xlat, NULL,
-                                 tag_access == MMU_DATA_STORE, attrs);
-
-    /*
-     * Note that @mr will never be NULL.  If there is nothing in the address
-     * space at @tag_paddr, the translation will return the unallocated memory
-     * region.  For our purposes, the result must be ram.
-     */
-    if (unlikely(!memory_region_is_ram(mr))) {
+    if (unlikely(!tag_mem)) {
         /* ??? Failure is a board configuration error. */
         qemu_log_mask(LOG_UNIMP,
                       "Tag Memory @ 0x%" HWADDR_PRIx " not found for "
                       "Normal Memory @ 0x%" HWADDR_PRIx "\n",
-                      tag_paddr, ptr_paddr);
+                      ptr_paddr >> (LOG2_TAG_GRANULE + 1), ptr_paddr);
         return NULL;
     }
 
-    /*
-     * Ensure the tag memory is dirty on write, for migration.
-     * Tag memory can never contain code or display memory (vga).
-     */
-    if (tag_access == MMU_DATA_STORE) {
-        ram_addr_t tag_ra = memory_region_get_ram_addr(mr) + xlat;
-        cpu_physical_memory_set_dirty_flag(tag_ra, DIRTY_MEMORY_MIGRATION);
-    }
-
-    return memory_region_get_ram_ptr(mr) + xlat;
+    return tag_mem + ((ptr & ~TARGET_PAGE_MASK) >> (LOG2_TAG_GRANULE + 1));
 #endif
 }
 
@@ -5381,6 +5381,39 @@ bool sve_probe_page(SVEHostPage *info, bool nofault, CPUARMState *env,
     return true;
 }
 
+/*
+ * Return true if every element of the vector is active in @vg.
+ */
+static bool sve_pred_all_active(uint64_t *vg, intptr_t reg_max, int esz)
+{
+    intptr_t i;
+
+    for (i = 0; i * 64 < reg_max; i++) {
+        uint64_t mask = pred_esz_masks[esz];
+
+        if (reg_max - i * 64 < 64) {
+            mask &= MAKE_64BIT_MASK(0, reg_max - i * 64);
+        }
+        if ((vg[i] & mask) != mask) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * For a non-extending, non-structure access to RAM with all elements
+ * active, the vector register and guest memory have the same layout on
+ * a little-endian host.  Return true if the access may be performed with
+ * a plain copy to or from info->page[].host, split at the page boundary.
+ */
+static inline bool sve_cont_ldst_is_linear(uint64_t *vg, intptr_t reg_max,
+                                           int esz, int msz, int N)
+{
+    return !HOST_BIG_ENDIAN && N == 1 && esz == msz &&
+           sve_pred_all_active(vg, reg_max, esz);
+}
+
 /*
  * Find first active element on each page, and a loose bound for the
  * final element on each page.  Identify any single element that spans
@@ -5728,6 +5761,17 @@ void sve_ldN_r(CPUARMState *env, uint64_t *vg, const target_ulong addr,
 
     /* The entire operation is in RAM, on valid pages. */
 
+    if (sve_cont_ldst_is_linear(vg, reg_max, esz, msz, N)) {
+        void *vd = &env->vfp.zregs[rd];
+        intptr_t split = info.page_split < 0 ? reg_max : info.page_split;
+
+        memcpy(vd, info.page[0].host, split);
+        if (split < reg_max) {
+            memcpy(vd + split, info.page[1].host + split, reg_max - split);
+        }
+        return;
+    }
+
     for (i = 0; i < N; ++i) {
         memset(&env->vfp.zregs[(rd + i) & 31], 0, reg_max);
     }
@@ -6342,6 +6386,17 @@ void sve_stN_r(CPUARMState *env, uint64_t *vg, target_ulong addr,
 #endif
     }
 
+    if (sve_cont_ldst_is_linear(vg, reg_max, esz, msz, N)) {
+        void *vd = &env->vfp.zregs[rd];
+        intptr_t split = info.page_split < 0 ? reg_max : info.page_split;
+
+        memcpy(info.page[0].host, vd, split);
+        if (split < reg_max) {
+            memcpy(info.page[1].host + split, vd + split, reg_max - split);
+        }
+        return;
+    }
+
     mem_off = info.mem_off_first[0];
     reg_off = info.reg_off_first[0];
     reg_last = info.reg_off_last[0];
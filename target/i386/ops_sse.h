@@ -1581,17 +1581,6 @@ void glue(helper_palignr, SUFFIX)(CPUX86State *env, Reg *d, Reg *v, Reg *s,
         }                                                               \
     }
 
-#define SSE_HELPER_I(name, elem, num, F)                                \
-    void glue(name, SUFFIX)(CPUX86State *env, Reg *d, Reg *v, Reg *s,   \
-                            uint32_t imm)                               \
-    {                                                                   \
-        int i;                                                          \
-        for (i = 0; i < num; i++) {                                     \
-            int j = i & 7;                                              \
-            d->elem(i) = F(v->elem(i), s->elem(i), (imm >> j) & 1);     \
-        }                                                               \
-    }
-
 /* SSE4.1 op helpers */
 #define FBLENDVB(v, s, m) ((m & 0x80) ? s : v)
 #define FBLENDVPS(v, s, m) ((m & 0x80000000) ? s : v)
@@ -1806,11 +1795,6 @@ void glue(helper_roundsd, SUFFIX)(CPUX86State *env, Reg *d, Reg *v, Reg *s,
 }
 #endif
 
-#define FBLENDP(v, s, m) (m ? s : v)
-SSE_HELPER_I(helper_blendps, L, 2 << SHIFT, FBLENDP)
-SSE_HELPER_I(helper_blendpd, Q, 1 << SHIFT, FBLENDP)
-SSE_HELPER_I(helper_pblendw, W, 4 << SHIFT, FBLENDP)
-
 void glue(helper_dpps, SUFFIX)(CPUX86State *env, Reg *d, Reg *v, Reg *s,
                                uint32_t mask)
 {
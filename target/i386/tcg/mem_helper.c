@@ -55,3 +55,99 @@ void helper_boundl(CPUX86State *env, target_ulong a0, int v)
         raise_exception_ra(env, EXCP05_BOUND, GETPC());
     }
 }
+
+/*
+ * Perform as many iterations of REP MOVS or REP STOS as possible with
+ * a single host memmove or memset.  A bulk operation may neither wrap
+ * the index register at the address size nor cross a page, so that the
+ * linear addresses are contiguous.  Return the number of iterations
+ * done and update rCX, rSI and rDI accordingly; 0 means the translated
+ * code must perform one iteration itself.
+ */
+static target_ulong rep_bulk_count(CPUX86State *env, target_ulong addr,
+                                   int reg, target_ulong count,
+                                   int ot, int aflag)
+{
+    target_ulong mask = MAKE_64BIT_MASK(0, 8 << aflag);
+    target_ulong room = mask - (env->regs[reg] & mask);
+    int size = 1 << ot;
+
+    if (room < size - 1) {
+        return 0;
+    }
+    count = MIN(count - 1, (room - (size - 1)) >> ot) + 1;
+    return MIN(count, (TARGET_PAGE_SIZE - (addr & ~TARGET_PAGE_MASK)) >> ot);
+}
+
+static void rep_set_reg(CPUX86State *env, int reg, target_ulong val,
+                        int aflag)
+{
+    switch (aflag) {
+    case MO_16:
+        env->regs[reg] = (env->regs[reg] & ~0xffff) | (val & 0xffff);
+        break;
+    case MO_32:
+        env->regs[reg] = (uint32_t)val;
+        break;
+    default:
+        env->regs[reg] = val;
+        break;
+    }
+}
+
+target_ulong helper_rep_movs(CPUX86State *env, target_ulong dst,
+                             target_ulong src, uint32_t ot, uint32_t aflag)
+{
+    target_ulong count = env->regs[R_ECX] & MAKE_64BIT_MASK(0, 8 << aflag);
+    size_t len;
+
+    if (env->df != 1) {
+        return 0;
+    }
+    count = rep_bulk_count(env, src, R_ESI, count, ot, aflag);
+    count = rep_bulk_count(env, dst, R_EDI, count, ot, aflag);
+    if (count == 0) {
+        return 0;
+    }
+    /* Copying forward element by element is a memmove, except here. */
+    if (dst > src && dst - src < (count << ot)) {
+        return 0;
+    }
+
+    len = cpu_memmove_mmuidx_ra(env, dst, src, count << ot,
+                                cpu_mmu_index(env, false), GETPC());
+    count = len >> ot;
+    if (count) {
+        rep_set_reg(env, R_ECX, env->regs[R_ECX] - count, aflag);
+        rep_set_reg(env, R_ESI, env->regs[R_ESI] + len, aflag);
+        rep_set_reg(env, R_EDI, env->regs[R_EDI] + len, aflag);
+    }
+    return count;
+}
+
+target_ulong helper_rep_stos(CPUX86State *env, target_ulong dst,
+                             uint32_t ot, uint32_t aflag)
+{
+    target_ulong count = env->regs[R_ECX] & MAKE_64BIT_MASK(0, 8 << aflag);
+    uint64_t vmask = MAKE_64BIT_MASK(0, 8 << ot);
+    uint64_t val = env->regs[R_EAX] & vmask;
+    size_t len;
+
+    /* memset can only store a repeated byte. */
+    if (env->df != 1 || val != (uint8_t)val * (vmask / 0xff)) {
+        return 0;
+    }
+    count = rep_bulk_count(env, dst, R_EDI, count, ot, aflag);
+    if (count == 0) {
+        return 0;
+    }
+
+    len = cpu_memset_mmuidx_ra(env, dst, val, count << ot,
+                               cpu_mmu_index(env, false), GETPC());
+    count = len >> ot;
+    if (count) {
+        rep_set_reg(env, R_ECX, env->regs[R_ECX] - count, aflag);
+        rep_set_reg(env, R_EDI, env->regs[R_EDI] + len, aflag);
+    }
+    return count;
+}
@@ -1017,6 +1017,7 @@ static CCPrepare gen_prepare_eflags_o(DisasContext *s, TCGv reg)
     case CC_OP_ADCOX:
         return (CCPrepare) { .cond = TCG_COND_NE, .reg = cpu_cc_src2,
                              .mask = -1, .no_setcond = true };
+    case CC_OP_LOGICB ... CC_OP_LOGICQ:
     case CC_OP_CLR:
     case CC_OP_POPCNT:
         return (CCPrepare) { .cond = TCG_COND_NEVER, .mask = -1 };
@@ -1097,6 +1098,31 @@ static CCPrepare gen_prepare_cc(DisasContext *s, int b, TCGv reg)
         }
         break;
 
+    case CC_OP_LOGICB ... CC_OP_LOGICQ:
+        /*
+         * We optimize the test/jcc case: CF and OF are clear, so BE is
+         * just ZF and L/LE are a signed comparison of the result with 0,
+         * which avoids computing all of EFLAGS in a helper.
+         */
+        size = s->cc_op - CC_OP_LOGICB;
+        switch (jcc_op) {
+        case JCC_BE:
+            t0 = gen_ext_tl(s->tmp4, cpu_cc_dst, size, false);
+            cc = (CCPrepare) { .cond = TCG_COND_EQ, .reg = t0, .mask = -1 };
+            break;
+        case JCC_L:
+            t0 = gen_ext_tl(s->tmp4, cpu_cc_dst, size, true);
+            cc = (CCPrepare) { .cond = TCG_COND_LT, .reg = t0, .mask = -1 };
+            break;
+        case JCC_LE:
+            t0 = gen_ext_tl(s->tmp4, cpu_cc_dst, size, true);
+            cc = (CCPrepare) { .cond = TCG_COND_LE, .reg = t0, .mask = -1 };
+            break;
+        default:
+            goto slow_jcc;
+        }
+        break;
+
     default:
     slow_jcc:
         /* This actually generates good code for JC, JZ and JS.  */
@@ -1342,6 +1368,54 @@ static void gen_repz(DisasContext *s, MemOp ot,
     static inline void gen_repz_ ## op(DisasContext *s, MemOp ot) \
     { gen_repz(s, ot, gen_##op); }
 
+static void gen_movs_bulk(DisasContext *s, MemOp ot)
+{
+    gen_string_movl_A0_ESI(s);
+    tcg_gen_mov_tl(s->T1, s->A0);
+    gen_string_movl_A0_EDI(s);
+    gen_helper_rep_movs(s->T0, tcg_env, s->A0, s->T1,
+                        tcg_constant_i32(ot), tcg_constant_i32(s->aflag));
+}
+
+static void gen_stos_bulk(DisasContext *s, MemOp ot)
+{
+    gen_string_movl_A0_EDI(s);
+    gen_helper_rep_stos(s->T0, tcg_env, s->A0,
+                        tcg_constant_i32(ot), tcg_constant_i32(s->aflag));
+}
+
+/*
+ * Like gen_repz, but let @bulk perform as many iterations as it can at
+ * once, leaving the number it did in T0; if none, do one with @fn.
+ * Each iteration must be visible when single-stepping or counting
+ * instructions, so only do this when neither applies.
+ */
+static void gen_repz_bulk(DisasContext *s, MemOp ot,
+                          void (*bulk)(DisasContext *s, MemOp ot),
+                          void (*fn)(DisasContext *s, MemOp ot))
+{
+    TCGLabel *l3;
+
+    if (!s->jmp_opt || (tb_cflags(s->base.tb) & CF_USE_ICOUNT)) {
+        gen_repz(s, ot, fn);
+        return;
+    }
+
+    gen_update_cc_op(s);
+    gen_jz_ecx_string(s);
+    l3 = gen_new_label();
+    bulk(s, ot);
+    tcg_gen_brcondi_tl(TCG_COND_NE, s->T0, 0, l3);
+    fn(s, ot);
+    gen_op_add_reg_im(s, s->aflag, R_ECX, -1);
+    gen_set_label(l3);
+    gen_jmp_rel_csize(s, -cur_insn_len(s), 0);
+}
+
+#define GEN_REPZ_BULK(op) \
+    static inline void gen_repz_ ## op(DisasContext *s, MemOp ot) \
+    { gen_repz_bulk(s, ot, gen_##op##_bulk, gen_##op); }
+
 static void gen_repz2(DisasContext *s, MemOp ot, int nz,
                       void (*fn)(DisasContext *s, MemOp ot))
 {
@@ -1362,8 +1436,8 @@ static void gen_repz2(DisasContext *s, MemOp ot, int nz,
     static inline void gen_repz_ ## op(DisasContext *s, MemOp ot, int nz) \
     { gen_repz2(s, ot, nz, gen_##op); }
 
-GEN_REPZ(movs)
-GEN_REPZ(stos)
+GEN_REPZ_BULK(movs)
+GEN_REPZ_BULK(stos)
 GEN_REPZ(lods)
 GEN_REPZ(ins)
 GEN_REPZ(outs)
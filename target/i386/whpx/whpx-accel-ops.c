@@ -69,8 +69,7 @@ static void whpx_start_vcpu_thread(CPUState *cpu)
     qemu_cond_init(cpu->halt_cond);
     snprintf(thread_name, VCPU_THREAD_NAME_SIZE, "CPU %d/WHPX",
              cpu->cpu_index);
-    qemu_thread_create(cpu->thread, thread_name, whpx_cpu_thread_fn,
-                       cpu, QEMU_THREAD_JOINABLE);
+    qemu_vcpu_thread_create(cpu, thread_name, whpx_cpu_thread_fn);
 }
 
 static void whpx_kick_vcpu_thread(CPUState *cpu)
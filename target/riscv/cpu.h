@@ -122,6 +122,23 @@ FIELD(VTYPE, VMA, 7, 1)
 FIELD(VTYPE, VEDIV, 8, 2)
 FIELD(VTYPE, RESERVED, 10, sizeof(target_ulong) * 8 - 11)
 
+/* Up to four non-leaf levels, for Sv57 */
+#define RISCV_PWC_LEVELS 4
+
+/*
+ * A page walk cache entry: the table base that a walk from @root under
+ * translation mode @vm reaches at one level for the virtual page number
+ * bits @vpn above that level.
+ */
+typedef struct RISCVPWCEntry {
+    hwaddr root;
+    hwaddr base;
+    target_ulong vpn;
+    uint8_t vm;
+    bool pbmte;
+    bool valid;
+} RISCVPWCEntry;
+
 typedef struct PMUCTRState {
     /* Current value of a counter */
     target_ulong mhpmcounter_val;
@@ -340,6 +357,9 @@ struct CPUArchState {
     pmp_table_t pmp_state;
     target_ulong mseccfg;
 
+    /* page walk cache, indexed by [!first_stage][level - 1] */
+    RISCVPWCEntry pwc[2][RISCV_PWC_LEVELS];
+
     /* trigger module */
     target_ulong trigger_cur;
     target_ulong tdata1[RV_MAX_TRIGGERS];
@@ -482,6 +502,7 @@ target_ulong riscv_cpu_get_geilen(CPURISCVState *env);
 void riscv_cpu_set_geilen(CPURISCVState *env, target_ulong geilen);
 bool riscv_cpu_vector_enabled(CPURISCVState *env);
 void riscv_cpu_set_virt_enabled(CPURISCVState *env, bool enable);
+void riscv_pwc_flush(CPURISCVState *env);
 int riscv_cpu_mmu_index(CPURISCVState *env, bool ifetch);
 G_NORETURN void  riscv_cpu_do_unaligned_access(CPUState *cs, vaddr addr,
                                                MMUAccessType access_type,
@@ -792,6 +792,16 @@ static int get_physical_address_pmp(CPURISCVState *env, int *prot, hwaddr addr,
  * @two_stage: Are we going to perform two stage translation
  * @is_debug: Is this access from a debugger or the monitor?
  */
+/*
+ * Drop the cached non-leaf page table entries.  Must be called whenever
+ * the tlb is flushed for a change of the page tables or of the PMP
+ * configuration that guards the page table accesses.
+ */
+void riscv_pwc_flush(CPURISCVState *env)
+{
+    memset(env->pwc, 0, sizeof(env->pwc));
+}
+
 static int get_physical_address(CPURISCVState *env, hwaddr *physical,
                                 int *ret_prot, vaddr addr,
                                 target_ulong *fault_pte_addr,
@@ -831,7 +841,7 @@ static int get_physical_address(CPURISCVState *env, hwaddr *physical,
 
     *ret_prot = 0;
 
-    hwaddr base;
+    hwaddr base, root;
     int levels, ptidxbits, ptesize, vm, widened;
 
     if (first_stage == true) {
@@ -911,15 +921,35 @@ static int get_physical_address(CPURISCVState *env, hwaddr *physical,
         adue = adue && (env->henvcfg & HENVCFG_ADUE);
     }
 
-    int ptshift = (levels - 1) * ptidxbits;
+    RISCVPWCEntry *pwc = env->pwc[!first_stage];
+    int ptshift;
     target_ulong pte;
     hwaddr pte_addr;
     int i;
 
+    root = base;
+
 #if !TCG_OVERSIZED_GUEST
 restart:
 #endif
-    for (i = 0; i < levels; i++, ptshift -= ptidxbits) {
+    /* Start from the deepest table that the page walk cache knows. */
+    base = root;
+    ptshift = (levels - 1) * ptidxbits;
+    i = 0;
+    for (int l = levels - 1; l > 0; l--) {
+        RISCVPWCEntry *e = &pwc[l - 1];
+        int shift = PGSHIFT + (levels - l) * ptidxbits;
+
+        if (e->valid && e->root == root && e->vm == vm &&
+            e->pbmte == pbmte && e->vpn == addr >> shift) {
+            base = e->base;
+            ptshift = (levels - 1 - l) * ptidxbits;
+            i = l;
+            break;
+        }
+    }
+
+    for (; i < levels; i++, ptshift -= ptidxbits) {
         target_ulong idx;
         if (i == 0) {
             idx = (addr >> (PGSHIFT + ptshift)) &
@@ -1002,6 +1032,17 @@ restart:
             return TRANSLATE_FAIL;
         }
         base = ppn << PGSHIFT;
+
+        if (i + 1 < levels) {
+            RISCVPWCEntry *e = &pwc[i];
+
+            e->root = root;
+            e->base = base;
+            e->vpn = addr >> (PGSHIFT + ptshift);
+            e->vm = vm;
+            e->pbmte = pbmte;
+            e->valid = true;
+        }
     }
 
     /* No leaf pte at any translation level. */
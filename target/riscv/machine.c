@@ -268,6 +268,8 @@ static int riscv_cpu_post_load(void *opaque, int version_id)
 
     env->xl = cpu_recompute_xl(env);
     riscv_cpu_update_mask(env);
+    /* The cached page table entries belong to the state we replaced */
+    riscv_pwc_flush(env);
     return 0;
 }
 
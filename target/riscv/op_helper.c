@@ -391,13 +391,28 @@ void helper_tlb_flush(CPURISCVState *env)
                (env->priv == PRV_U || get_field(env->hstatus, HSTATUS_VTVM))) {
         riscv_raise_exception(env, RISCV_EXCP_VIRT_INSTRUCTION_FAULT, GETPC());
     } else {
+        riscv_pwc_flush(env);
         tlb_flush(cs);
     }
 }
 
+static void do_pwc_flush(CPUState *cs, run_on_cpu_data data)
+{
+    riscv_pwc_flush(cpu_env(cs));
+}
+
 void helper_tlb_flush_all(CPURISCVState *env)
 {
     CPUState *cs = env_cpu(env);
+    CPUState *other;
+
+    CPU_FOREACH(other) {
+        if (other == cs) {
+            riscv_pwc_flush(env);
+        } else {
+            async_run_on_cpu(other, do_pwc_flush, RUN_ON_CPU_NULL);
+        }
+    }
     tlb_flush_all_cpus_synced(cs);
 }
 
@@ -411,6 +426,7 @@ void helper_hyp_tlb_flush(CPURISCVState *env)
 
     if (env->priv == PRV_M ||
         (env->priv == PRV_S && !env->virt_enabled)) {
+        riscv_pwc_flush(env);
         tlb_flush(cs);
         return;
     }
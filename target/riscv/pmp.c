@@ -142,12 +142,12 @@ static bool pmp_write_cfg(CPURISCVState *env, uint32_t pmp_index, uint8_t val)
 
 void pmp_unlock_entries(CPURISCVState *env)
 {
-    uint32_t pmp_num = pmp_get_num_rules(env);
     int i;
 
-    for (i = 0; i < pmp_num; i++) {
+    for (i = 0; i < MAX_RISCV_PMPS; i++) {
         env->pmp_state.pmp[i].cfg_reg &= ~(PMP_LOCK | PMP_AMATCH);
     }
+    pmp_update_rule_nums(env);
 }
 
 static void pmp_decode_napot(target_ulong a, target_ulong *sa,
@@ -222,7 +222,7 @@ void pmp_update_rule_nums(CPURISCVState *env)
         const uint8_t a_field =
             pmp_get_a_field(env->pmp_state.pmp[i].cfg_reg);
         if (PMP_AMATCH_OFF != a_field) {
-            env->pmp_state.num_rules++;
+            env->pmp_state.active[env->pmp_state.num_rules++] = i;
         }
     }
 }
@@ -310,6 +310,7 @@ bool pmp_hart_has_privs(CPURISCVState *env, target_ulong addr,
                         pmp_priv_t *allowed_privs, target_ulong mode)
 {
     int i = 0;
+    int j;
     int pmp_size = 0;
     target_ulong s = 0;
     target_ulong e = 0;
@@ -335,9 +336,10 @@ bool pmp_hart_has_privs(CPURISCVState *env, target_ulong addr,
 
     /*
      * 1.10 draft priv spec states there is an implicit order
-     * from low to high
+     * from low to high.  Only the entries that are not off can match.
      */
-    for (i = 0; i < MAX_RISCV_PMPS; i++) {
+    for (j = 0; j < env->pmp_state.num_rules; j++) {
+        i = env->pmp_state.active[j];
         s = pmp_is_in_range(env, i, addr);
         e = pmp_is_in_range(env, i, addr + pmp_size - 1);
 
@@ -482,6 +484,7 @@ void pmpcfg_csr_write(CPURISCVState *env, uint32_t reg_index,
     /* If PMP permission of any addr has been changed, flush TLB pages. */
     if (modified) {
         pmp_update_rule_nums(env);
+        riscv_pwc_flush(env);
         tlb_flush(env_cpu(env));
     }
 }
@@ -539,6 +542,7 @@ void pmpaddr_csr_write(CPURISCVState *env, uint32_t addr_index,
                 if (is_next_cfg_tor) {
                     pmp_update_rule_addr(env, addr_index + 1);
                 }
+                riscv_pwc_flush(env);
                 tlb_flush(env_cpu(env));
             }
         } else {
@@ -593,6 +597,7 @@ void mseccfg_csr_write(CPURISCVState *env, target_ulong val)
         /* Sticky bits */
         val |= (env->mseccfg & (MSECCFG_MMWP | MSECCFG_MML));
         if ((val ^ env->mseccfg) & (MSECCFG_MMWP | MSECCFG_MML)) {
+            riscv_pwc_flush(env);
             tlb_flush(env_cpu(env));
         }
     } else {
@@ -641,13 +646,11 @@ target_ulong pmp_get_tlb_size(CPURISCVState *env, target_ulong addr)
         return TARGET_PAGE_SIZE;
     }
 
-    for (i = 0; i < MAX_RISCV_PMPS; i++) {
-        if (pmp_get_a_field(env->pmp_state.pmp[i].cfg_reg) == PMP_AMATCH_OFF) {
-            continue;
-        }
+    for (i = 0; i < pmp_get_num_rules(env); i++) {
+        int idx = env->pmp_state.active[i];
 
-        pmp_sa = env->pmp_state.addr[i].sa;
-        pmp_ea = env->pmp_state.addr[i].ea;
+        pmp_sa = env->pmp_state.addr[idx].sa;
+        pmp_ea = env->pmp_state.addr[idx].ea;
 
         /*
          * Only the first PMP entry that covers (whole or partial of) the TLB
@@ -61,6 +61,8 @@ typedef struct {
     pmp_entry_t pmp[MAX_RISCV_PMPS];
     pmp_addr_t  addr[MAX_RISCV_PMPS];
     uint32_t num_rules;
+    /* Indexes of the num_rules entries that are not off, lowest first */
+    uint8_t active[MAX_RISCV_PMPS];
 } pmp_table_t;
 
 void pmpcfg_csr_write(CPURISCVState *env, uint32_t reg_index,
@@ -571,6 +571,13 @@ static void gen_jal(DisasContext *ctx, int rd, target_ulong imm)
     gen_pc_plus_diff(succ_pc, ctx, ctx->cur_insn_len);
     gen_set_gpr(ctx, rd, succ_pc);
 
+    if (!ctx->itrigger &&
+        translator_follow_jump(&ctx->base, ctx->base.pc_next + imm)) {
+        /* Continue at the target; translate_insn adds the insn length. */
+        ctx->base.pc_next += imm - ctx->cur_insn_len;
+        return;
+    }
+
     gen_goto_tb(ctx, 0, imm); /* must use this for safety */
     ctx->base.is_jmp = DISAS_NORETURN;
 }
@@ -250,17 +250,74 @@ GEN_VEXT_ST_STRIDE(vsse64_v, int64_t, ste_d)
  * unit-stride: access elements stored contiguously in memory
  */
 
+/*
+ * Fast path for a unit-stride access with a single field: if the elements
+ * from vstart to evl live on one guest page backed by host RAM, they are
+ * laid out in the vector register exactly as in guest memory, so copy them
+ * in one go.  Returns false if the caller must fall back to the element
+ * loop.
+ */
+static bool
+vext_ldst_us_host(void *vd, target_ulong base, CPURISCVState *env,
+                  uint32_t log2_esz, uint32_t evl,
+                  MMUAccessType access_type, uintptr_t ra)
+{
+#if HOST_BIG_ENDIAN
+    /* Elements are stored in host order within each uint64_t. */
+    return false;
+#else
+    uint32_t start = env->vstart << log2_esz;
+    uint32_t end = evl << log2_esz;
+    target_ulong addr, len;
+    void *host;
+
+    if (start >= end || cpu_plugin_mem_cbs_enabled(env_cpu(env))) {
+        return false;
+    }
+    addr = adjust_addr(env, base + start);
+    len = end - start;
+    if (-(addr | TARGET_PAGE_MASK) < len) {
+        return false;
+    }
+
+    /*
+     * Do not fault here: a PMP region may end inside the page, and only
+     * the element loop reports the first inaccessible element in vstart.
+     * A successful probe has checked PMP over the whole range.
+     */
+    if (probe_access_flags(env, addr, len, access_type,
+                           cpu_mmu_index(env, false), true, &host, ra) ||
+        !host) {
+        return false;
+    }
+
+    if (access_type == MMU_DATA_LOAD) {
+        memcpy(vd + start, host, len);
+    } else {
+        memcpy(host, vd + start, len);
+    }
+    return true;
+#endif
+}
+
 /* unmasked unit-stride load and store operation */
 static void
 vext_ldst_us(void *vd, target_ulong base, CPURISCVState *env, uint32_t desc,
              vext_ldst_elem_fn *ldst_elem, uint32_t log2_esz, uint32_t evl,
-             uintptr_t ra)
+             MMUAccessType access_type, uintptr_t ra)
 {
     uint32_t i, k;
     uint32_t nf = vext_nf(desc);
     uint32_t max_elems = vext_max_elems(desc, log2_esz);
     uint32_t esz = 1 << log2_esz;
 
+    if (nf == 1 &&
+        vext_ldst_us_host(vd, base, env, log2_esz, evl, access_type, ra)) {
+        env->vstart = 0;
+        vext_set_tail_elems_1s(evl, vd, desc, nf, esz, max_elems);
+        return;
+    }
+
     /* load bytes from guest memory */
     for (i = env->vstart; i < evl; i++, env->vstart++) {
         k = 0;
@@ -293,7 +350,7 @@ void HELPER(NAME)(void *vd, void *v0, target_ulong base,                \
                   CPURISCVState *env, uint32_t desc)                    \
 {                                                                       \
     vext_ldst_us(vd, base, env, desc, LOAD_FN,                          \
-                 ctzl(sizeof(ETYPE)), env->vl, GETPC());                \
+                 ctzl(sizeof(ETYPE)), env->vl, MMU_DATA_LOAD, GETPC()); \
 }
 
 GEN_VEXT_LD_US(vle8_v,  int8_t,  lde_b)
@@ -314,7 +371,7 @@ void HELPER(NAME)(void *vd, void *v0, target_ulong base,                 \
                   CPURISCVState *env, uint32_t desc)                     \
 {                                                                        \
     vext_ldst_us(vd, base, env, desc, STORE_FN,                          \
-                 ctzl(sizeof(ETYPE)), env->vl, GETPC());                 \
+                 ctzl(sizeof(ETYPE)), env->vl, MMU_DATA_STORE, GETPC()); \
 }
 
 GEN_VEXT_ST_US(vse8_v,  int8_t,  ste_b)
@@ -331,7 +388,7 @@ void HELPER(vlm_v)(void *vd, void *v0, target_ulong base,
     /* evl = ceil(vl/8) */
     uint8_t evl = (env->vl + 7) >> 3;
     vext_ldst_us(vd, base, env, desc, lde_b,
-                 0, evl, GETPC());
+                 0, evl, MMU_DATA_LOAD, GETPC());
 }
 
 void HELPER(vsm_v)(void *vd, void *v0, target_ulong base,
@@ -340,7 +397,7 @@ void HELPER(vsm_v)(void *vd, void *v0, target_ulong base,
     /* evl = ceil(vl/8) */
     uint8_t evl = (env->vl + 7) >> 3;
     vext_ldst_us(vd, base, env, desc, ste_b,
-                 0, evl, GETPC());
+                 0, evl, MMU_DATA_STORE, GETPC());
 }
 
 /*
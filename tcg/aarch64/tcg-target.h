@@ -60,6 +60,7 @@ typedef enum {
 
 #define have_lse    (cpuinfo & CPUINFO_LSE)
 #define have_lse2   (cpuinfo & CPUINFO_LSE2)
+#define have_lrcpc  (cpuinfo & CPUINFO_LRCPC)
 
 /* optional instructions */
 #define TCG_TARGET_HAS_div_i32          1
@@ -138,6 +139,9 @@ typedef enum {
 #define TCG_TARGET_HAS_qemu_ldst_i128   1
 #endif
 
+/* LDAR/LDAPR and STLR.  */
+#define TCG_TARGET_HAS_qemu_ldst_ordered 1
+
 #define TCG_TARGET_HAS_v64              1
 #define TCG_TARGET_HAS_v128             1
 #define TCG_TARGET_HAS_v256             0
@@ -116,6 +116,9 @@ typedef enum {
 #define have_avx2         (cpuinfo & CPUINFO_AVX2)
 #define have_movbe        (cpuinfo & CPUINFO_MOVBE)
 
+/* We only use the VEX encoded forms of the GFNI instructions. */
+#define have_gfni         ((cpuinfo & CPUINFO_GFNI) && have_avx1)
+
 /*
  * There are interesting instructions in AVX512, so long as we have AVX512VL,
  * which indicates support for EVEX on sizes smaller than 512 bits.
@@ -197,6 +200,7 @@ typedef enum {
 
 #define TCG_TARGET_HAS_qemu_ldst_i128 \
     (TCG_TARGET_REG_BITS == 64 && (cpuinfo & CPUINFO_ATOMIC_VMOVDQA))
+#define TCG_TARGET_HAS_qemu_ldst_ordered 0
 
 /* We do not support older SSE systems, only beginning with AVX1.  */
 #define TCG_TARGET_HAS_v64              have_avx1
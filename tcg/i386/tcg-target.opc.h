@@ -36,3 +36,4 @@ DEF(x86_punpckh_vec, 1, 2, 0, IMPLVEC)
 DEF(x86_vpshldi_vec, 1, 2, 1, IMPLVEC)
 DEF(x86_vpshldv_vec, 1, 3, 0, IMPLVEC)
 DEF(x86_vpshrdv_vec, 1, 3, 0, IMPLVEC)
+DEF(x86_vgf2p8affineqb_vec, 1, 2, 1, IMPLVEC)
@@ -142,6 +142,7 @@ typedef enum {
 
 #define TCG_TARGET_HAS_qemu_ldst_i128   \
     (TCG_TARGET_REG_BITS == 64 && have_isa_2_07)
+#define TCG_TARGET_HAS_qemu_ldst_ordered 0
 
 /*
  * While technically Altivec could support V64, it has no 64-bit store
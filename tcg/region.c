@@ -29,6 +29,7 @@
 #include "qemu/memalign.h"
 #include "qemu/cacheinfo.h"
 #include "qemu/qtree.h"
+#include "qemu/bitmap.h"
 #include "qapi/error.h"
 #include "tcg/tcg.h"
 #include "exec/translation-block.h"
@@ -72,6 +73,10 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    uint64_t *seq; /* allocation order of each region */
+    uint64_t next_seq;
+    unsigned long *full; /* regions that filled up and were left */
+    unsigned long *evicted; /* regions that tcg_region_evict() freed */
 };
 
 static struct tcg_region_state region;
@@ -191,6 +196,21 @@ static void tcg_region_trees_init(void)
     }
 }
 
+/* Return the index of the region containing @p, a pointer to the rw buffer */
+static size_t tcg_region_idx(const void *p)
+{
+    ptrdiff_t offset;
+
+    if (p < region.start_aligned) {
+        return 0;
+    }
+    offset = p - region.start_aligned;
+    if (offset > region.stride * (region.n - 1)) {
+        return region.n - 1;
+    }
+    return offset / region.stride;
+}
+
 static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
 {
     size_t region_idx;
@@ -206,17 +226,7 @@ static struct tcg_region_tree *tc_ptr_to_region_tree(const void *p)
         }
     }
 
-    if (p < region.start_aligned) {
-        region_idx = 0;
-    } else {
-        ptrdiff_t offset = p - region.start_aligned;
-
-        if (offset > region.stride * (region.n - 1)) {
-            region_idx = region.n - 1;
-        } else {
-            region_idx = offset / region.stride;
-        }
-    }
+    region_idx = tcg_region_idx(p);
     return region_trees + region_idx * tree_size;
 }
 
@@ -359,11 +369,20 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
-        return true;
+    size_t i;
+
+    if (region.current < region.n) {
+        i = region.current++;
+    } else {
+        /* Reuse a region that tcg_region_evict() has emptied */
+        i = find_first_bit(region.evicted, region.n);
+        if (i == region.n) {
+            return true;
+        }
+        clear_bit(i, region.evicted);
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, i);
+    region.seq[i] = ++region.next_seq;
     return false;
 }
 
@@ -376,11 +395,13 @@ bool tcg_region_alloc(TCGContext *s)
     bool err;
     /* read the region size now; alloc__locked will overwrite it on success */
     size_t size_full = s->code_gen_buffer_size;
+    size_t old = tcg_region_idx(s->code_gen_buffer);
 
     qemu_mutex_lock(&region.lock);
     err = tcg_region_alloc__locked(s);
     if (!err) {
         region.agg_size_full += size_full - TCG_HIGHWATER;
+        set_bit(old, region.full);
     }
     qemu_mutex_unlock(&region.lock);
     return err;
@@ -412,6 +433,9 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    region.next_seq = 0;
+    bitmap_zero(region.full, region.n);
+    bitmap_zero(region.evicted, region.n);
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
@@ -422,6 +446,72 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+static gboolean tcg_region_collect_tb(gpointer key, gpointer value,
+                                      gpointer data)
+{
+    g_ptr_array_add(data, value);
+    return FALSE;
+}
+
+/*
+ * Free the region that was handed out first among those that have filled
+ * up and that no context is generating code into anymore, so that
+ * tcg_region_alloc() can reuse it.
+ * @invalidate is called on every TB of the region beforehand; it must
+ * unlink the TB from the lookup structures and from the TBs jumping to it.
+ *
+ * Call from a safe-work context.  Returns false if there is no region
+ * that can be evicted.
+ */
+bool tcg_region_evict(void (*invalidate)(TranslationBlock *tb))
+{
+    g_autoptr(GPtrArray) tbs = NULL;
+    struct tcg_region_tree *rt;
+    size_t i, victim = region.n;
+    void *start, *end;
+
+    qemu_mutex_lock(&region.lock);
+    for (i = find_first_bit(region.full, region.n); i < region.n;
+         i = find_next_bit(region.full, region.n, i + 1)) {
+        if (victim == region.n || region.seq[i] < region.seq[victim]) {
+            victim = i;
+        }
+    }
+    if (victim != region.n) {
+        clear_bit(victim, region.full);
+    }
+    qemu_mutex_unlock(&region.lock);
+
+    if (victim == region.n) {
+        return false;
+    }
+
+    rt = region_trees + victim * tree_size;
+    tbs = g_ptr_array_new();
+    qemu_mutex_lock(&rt->lock);
+    q_tree_foreach(rt->tree, tcg_region_collect_tb, tbs);
+    qemu_mutex_unlock(&rt->lock);
+
+    for (i = 0; i < tbs->len; i++) {
+        invalidate(g_ptr_array_index(tbs, i));
+    }
+
+    qemu_mutex_lock(&rt->lock);
+    q_tree_ref(rt->tree);
+    q_tree_destroy(rt->tree);
+    qemu_mutex_unlock(&rt->lock);
+
+    tcg_region_bounds(victim, &start, &end);
+    qemu_mutex_lock(&region.lock);
+    set_bit(victim, region.evicted);
+    region.agg_size_full -= (end - start) - TCG_HIGHWATER;
+    qemu_mutex_unlock(&region.lock);
+    return true;
+}
+
+/* Number of regions used when a single thread generates code */
+#define TCG_EVICT_REGIONS 8
+
 static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
 {
 #ifdef CONFIG_USER_ONLY
@@ -435,9 +525,13 @@ static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
      * being of reasonable size. If that's not possible we make do by evenly
      * dividing the code_gen_buffer among the vCPUs.
      */
-    /* Use a single region if all we have is one vCPU thread */
+    /*
+     * With a single vCPU thread, still split the buffer in a few regions
+     * so that tcg_region_evict() can free part of it instead of flushing
+     * everything when it fills up.
+     */
     if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
+        return MAX(1, MIN(tb_size / (2 * MiB), TCG_EVICT_REGIONS));
     }
 
     /*
@@ -810,6 +904,9 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
 
     /* init the region struct */
     qemu_mutex_init(&region.lock);
+    region.seq = g_new0(uint64_t, region.n);
+    region.full = bitmap_new(region.n);
+    region.evicted = bitmap_new(region.n);
 
     /*
      * Set guard pages in the rw buffer, as that's the one into which
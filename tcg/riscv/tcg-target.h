@@ -157,6 +157,7 @@ extern bool have_zbb;
 #define TCG_TARGET_HAS_mulsh_i64        1
 
 #define TCG_TARGET_HAS_qemu_ldst_i128   0
+#define TCG_TARGET_HAS_qemu_ldst_ordered 0
 
 #define TCG_TARGET_DEFAULT_MO (0)
 
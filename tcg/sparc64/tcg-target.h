@@ -148,6 +148,7 @@ extern bool use_vis3_instructions;
 #define TCG_TARGET_HAS_mulsh_i64        0
 
 #define TCG_TARGET_HAS_qemu_ldst_i128   0
+#define TCG_TARGET_HAS_qemu_ldst_ordered 0
 
 #define TCG_AREG0 TCG_REG_I0
 
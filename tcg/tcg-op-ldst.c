@@ -130,6 +130,47 @@ static void tcg_gen_req_mo(TCGBar type)
     }
 }
 
+static bool tcg_use_acq_rel(void)
+{
+#ifdef CONFIG_USER_ONLY
+    /* As for tcg_gen_mb, no ordering is required in serial mode. */
+    if (!(tcg_ctx->gen_tb->cflags & CF_PARALLEL)) {
+        return false;
+    }
+#endif
+    return TCG_TARGET_HAS_qemu_ldst_ordered && qatomic_read(&tcg_acq_rel);
+}
+
+/*
+ * Emit the barrier that the guest memory model requires before a load
+ * or store of at most 64 bits.  With tcg_acq_rel, mark the access
+ * MO_ORDERED instead wherever that provides the same ordering, and
+ * return the updated @memop.
+ *
+ * Every load being an acquire, the LD_LD ordering with respect to the
+ * loads before it is already provided by those, and the LD_ST ordering
+ * of later stores likewise.  Every store being a release, it is ordered
+ * after all earlier accesses.  Only ST_LD remains, as the host may
+ * satisfy a load-acquire before an earlier store-release is visible.
+ */
+static MemOp tcg_gen_req_mo_ldst(MemOp memop, bool is_ld)
+{
+    TCGBar type = tcg_ctx->guest_mo & ~TCG_TARGET_DEFAULT_MO;
+
+    if (!tcg_use_acq_rel()) {
+        tcg_gen_req_mo(is_ld ? TCG_MO_LD_LD | TCG_MO_ST_LD
+                             : TCG_MO_LD_ST | TCG_MO_ST_ST);
+    } else if (is_ld) {
+        if (type & (TCG_MO_LD_LD | TCG_MO_LD_ST)) {
+            memop |= MO_ORDERED;
+        }
+        tcg_gen_req_mo(TCG_MO_ST_LD);
+    } else if (type & (TCG_MO_LD_ST | TCG_MO_ST_ST)) {
+        memop |= MO_ORDERED;
+    }
+    return memop;
+}
+
 /* Only required for loads, where value might overlap addr. */
 static TCGv_i64 plugin_maybe_preserve_addr(TCGTemp *addr)
 {
@@ -183,7 +224,7 @@ static void tcg_gen_qemu_ld_i32_int(TCGv_i32 val, TCGTemp *addr,
     TCGv_i64 copy_addr;
     TCGOpcode opc;
 
-    tcg_gen_req_mo(TCG_MO_LD_LD | TCG_MO_ST_LD);
+    memop = tcg_gen_req_mo_ldst(memop, true);
     orig_memop = memop = tcg_canonicalize_memop(memop, 0, 0);
     orig_oi = oi = make_memop_idx(memop, idx);
 
@@ -236,7 +277,7 @@ static void tcg_gen_qemu_st_i32_int(TCGv_i32 val, TCGTemp *addr,
     MemOpIdx orig_oi, oi;
     TCGOpcode opc;
 
-    tcg_gen_req_mo(TCG_MO_LD_ST | TCG_MO_ST_ST);
+    memop = tcg_gen_req_mo_ldst(memop, false);
     memop = tcg_canonicalize_memop(memop, 0, 1);
     orig_oi = oi = make_memop_idx(memop, idx);
 
@@ -304,7 +345,7 @@ static void tcg_gen_qemu_ld_i64_int(TCGv_i64 val, TCGTemp *addr,
         return;
     }
 
-    tcg_gen_req_mo(TCG_MO_LD_LD | TCG_MO_ST_LD);
+    memop = tcg_gen_req_mo_ldst(memop, true);
     orig_memop = memop = tcg_canonicalize_memop(memop, 1, 0);
     orig_oi = oi = make_memop_idx(memop, idx);
 
@@ -366,7 +407,7 @@ static void tcg_gen_qemu_st_i64_int(TCGv_i64 val, TCGTemp *addr,
         return;
     }
 
-    tcg_gen_req_mo(TCG_MO_LD_ST | TCG_MO_ST_ST);
+    memop = tcg_gen_req_mo_ldst(memop, false);
     memop = tcg_canonicalize_memop(memop, 1, 1);
     orig_oi = oi = make_memop_idx(memop, idx);
 
@@ -606,6 +647,14 @@ static void tcg_gen_qemu_ld_i128_int(TCGv_i128 val, TCGTemp *addr,
                            tcg_constant_i32(orig_oi));
     }
 
+    /*
+     * This load is not an acquire, but the loads that follow rely
+     * on being ordered after it as if it were.
+     */
+    if (tcg_use_acq_rel()) {
+        tcg_gen_req_mo(TCG_MO_LD_LD | TCG_MO_LD_ST);
+    }
+
     plugin_gen_mem_callbacks(ext_addr, addr, orig_oi, QEMU_PLUGIN_MEM_R);
 }
 
@@ -1080,6 +1129,17 @@ static void tcg_gen_atomic_cmpxchg_i128_int(TCGv_i128 retv, TCGTemp *addr,
         return;
     }
 
+#if !HAVE_CMPXCHG128
+    if (qatomic_read(&tcg_atomic_locks)) {
+        MemOpIdx oi = make_memop_idx(memop, idx);
+        TCGv_i64 a64 = maybe_extend_addr64(addr);
+        gen_helper_locked_cmpxchgo(retv, tcg_env, a64, cmpv, newv,
+                                   tcg_constant_i32(oi));
+        maybe_free_addr64(a64);
+        return;
+    }
+#endif
+
     gen_helper_exit_atomic(tcg_env);
 
     /*
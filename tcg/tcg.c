@@ -233,6 +233,8 @@ static TCGAtomAlign atom_and_align_for_opc(TCGContext *s, MemOp opc,
 #ifdef CONFIG_USER_ONLY
 bool tcg_use_softmmu;
 #endif
+bool tcg_atomic_locks;
+bool tcg_acq_rel;
 
 TCGContext tcg_init_ctx;
 __thread TCGContext *tcg_ctx;
@@ -2416,6 +2418,7 @@ static void tcg_reg_alloc_start(TCGContext *s)
     }
 
     memset(s->reg_to_temp, 0, sizeof(s->reg_to_temp));
+    memset(&s->reg_stats, 0, sizeof(s->reg_stats));
 }
 
 static char *tcg_get_arg_str_ptr(TCGContext *s, char *buf, int buf_size,
@@ -2659,7 +2662,7 @@ static void tcg_dump_ops(TCGContext *s, FILE *f, bool have_prefs)
             case INDEX_op_qemu_st_a32_i128:
             case INDEX_op_qemu_st_a64_i128:
                 {
-                    const char *s_al, *s_op, *s_at;
+                    const char *s_al, *s_op, *s_at, *s_ord;
                     MemOpIdx oi = op->args[k++];
                     MemOp mop = get_memop(oi);
                     unsigned ix = get_mmuidx(oi);
@@ -2667,12 +2670,14 @@ static void tcg_dump_ops(TCGContext *s, FILE *f, bool have_prefs)
                     s_al = alignment_name[(mop & MO_AMASK) >> MO_ASHIFT];
                     s_op = ldst_name[mop & (MO_BSWAP | MO_SSIZE)];
                     s_at = atom_name[(mop & MO_ATOM_MASK) >> MO_ATOM_SHIFT];
-                    mop &= ~(MO_AMASK | MO_BSWAP | MO_SSIZE | MO_ATOM_MASK);
+                    s_ord = mop & MO_ORDERED ? "ord+" : "";
+                    mop &= ~(MO_AMASK | MO_BSWAP | MO_SSIZE |
+                             MO_ATOM_MASK | MO_ORDERED);
 
                     /* If all fields are accounted for, print symbolically. */
                     if (!mop && s_al && s_op && s_at) {
-                        col += ne_fprintf(f, ",%s%s%s,%u",
-                                          s_at, s_al, s_op, ix);
+                        col += ne_fprintf(f, ",%s%s%s%s,%u",
+                                          s_ord, s_at, s_al, s_op, ix);
                     } else {
                         mop = get_memop(oi);
                         col += ne_fprintf(f, ",$0x%x,%u", mop, ix);
@@ -4237,6 +4242,7 @@ static void temp_sync(TCGContext *s, TCGTemp *ts, TCGRegSet allocated_regs,
             if (free_or_dead
                 && tcg_out_sti(s, ts->type, ts->val,
                                ts->mem_base->reg, ts->mem_offset)) {
+                s->reg_stats.stores++;
                 break;
             }
             temp_load(s, ts, tcg_target_available_regs[ts->type],
@@ -4246,6 +4252,7 @@ static void temp_sync(TCGContext *s, TCGTemp *ts, TCGRegSet allocated_regs,
         case TEMP_VAL_REG:
             tcg_out_st(s, ts->type, ts->reg,
                        ts->mem_base->reg, ts->mem_offset);
+            s->reg_stats.stores++;
             break;
 
         case TEMP_VAL_MEM:
@@ -4271,6 +4278,39 @@ static void tcg_reg_free(TCGContext *s, TCGReg reg, TCGRegSet allocated_regs)
     }
 }
 
+/*
+ * Free call-clobbered register 'reg' ahead of a call.  Any temp still in
+ * a register is live after the call; if it is not yet coherent with its
+ * memory slot, moving it to a free call-saved register replaces a store
+ * now and a load later with a single move.
+ */
+static void tcg_reg_free_for_call(TCGContext *s, TCGReg reg,
+                                  TCGRegSet allocated_regs)
+{
+    TCGTemp *ts = s->reg_to_temp[reg];
+    TCGRegSet set;
+
+    if (ts == NULL) {
+        return;
+    }
+    if (!temp_readonly(ts) && !ts->mem_coherent
+        && ts->type == ts->base_type) {
+        set = tcg_target_available_regs[ts->type]
+            & ~tcg_target_call_clobber_regs & ~allocated_regs;
+        for (int i = 0; i < ARRAY_SIZE(tcg_target_reg_alloc_order); i++) {
+            TCGReg r = tcg_target_reg_alloc_order[i];
+
+            if (tcg_regset_test_reg(set, r) && s->reg_to_temp[r] == NULL
+                && tcg_out_mov(s, ts->type, r, reg)) {
+                set_temp_val_reg(s, ts, r);
+                s->reg_stats.call_moves++;
+                return;
+            }
+        }
+    }
+    tcg_reg_free(s, reg, allocated_regs);
+}
+
 /**
  * tcg_reg_alloc:
  * @required_regs: Set of registers in which we must allocate.
@@ -4429,6 +4469,7 @@ static void temp_load(TCGContext *s, TCGTemp *ts, TCGRegSet desired_regs,
         reg = tcg_reg_alloc(s, desired_regs, allocated_regs,
                             preferred_regs, ts->indirect_base);
         tcg_out_ld(s, ts->type, reg, ts->mem_base->reg, ts->mem_offset);
+        s->reg_stats.loads++;
         ts->mem_coherent = 1;
         break;
     case TEMP_VAL_DEAD:
@@ -4605,6 +4646,7 @@ static void tcg_reg_alloc_mov(TCGContext *s, const TCGOp *op)
             temp_allocate_frame(s, ots);
         }
         tcg_out_st(s, otype, ireg, ots->mem_base->reg, ots->mem_offset);
+        s->reg_stats.stores++;
         if (IS_DEAD_ARG(1)) {
             temp_dead(s, ts);
         }
@@ -4640,6 +4682,7 @@ static void tcg_reg_alloc_mov(TCGContext *s, const TCGOp *op)
                 temp_allocate_frame(s, ots);
             }
             tcg_out_st(s, ts->type, ireg, ots->mem_base->reg, ots->mem_offset);
+            s->reg_stats.stores++;
             set_temp_val_nonreg(s, ts, TEMP_VAL_MEM);
             ots->mem_coherent = 1;
             return;
@@ -4741,6 +4784,7 @@ static void tcg_reg_alloc_dup(TCGContext *s, const TCGOp *op)
         }
         /* Load the input into the destination vector register. */
         tcg_out_ld(s, itype, ots->reg, its->mem_base->reg, its->mem_offset);
+        s->reg_stats.loads++;
         break;
 
     default:
@@ -4978,6 +5022,7 @@ static void tcg_reg_alloc_op(TCGContext *s, const TCGOp *op)
                 temp_sync(s, ts, i_allocated_regs, 0, 0);
                 tcg_out_ld(s, ts->type, reg,
                            ts->mem_base->reg, ts->mem_offset);
+                s->reg_stats.loads++;
             }
         }
         new_args[i] = reg;
@@ -5233,6 +5278,7 @@ static void load_arg_reg(TCGContext *s, TCGReg reg, TCGTemp *ts,
                 temp_sync(s, ts, allocated_regs, 0, 0);
                 tcg_out_ld(s, ts->type, reg,
                            ts->mem_base->reg, ts->mem_offset);
+                s->reg_stats.loads++;
             }
         }
     } else {
@@ -5335,7 +5381,7 @@ static void tcg_reg_alloc_call(TCGContext *s, TCGOp *op)
     /* Clobber call registers.  */
     for (i = 0; i < TCG_TARGET_NB_REGS; i++) {
         if (tcg_regset_test_reg(tcg_target_call_clobber_regs, i)) {
-            tcg_reg_free(s, i, allocated_regs);
+            tcg_reg_free_for_call(s, i, allocated_regs);
         }
     }
 
@@ -6052,7 +6098,14 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
     }
 #endif
 
-    tcg_optimize(s);
+    /*
+     * The optimizer is not required for correctness.  Skip it for code
+     * that will be executed only once, where the translation cost cannot
+     * be amortized.
+     */
+    if (likely(s->optimize)) {
+        tcg_optimize(s);
+    }
 
     reachable_code_pass(s);
     liveness_pass_0(s);
@@ -116,6 +116,7 @@
 #endif /* TCG_TARGET_REG_BITS == 64 */
 
 #define TCG_TARGET_HAS_qemu_ldst_i128   0
+#define TCG_TARGET_HAS_qemu_ldst_ordered 0
 
 /* Number of registers available. */
 #define TCG_TARGET_NB_REGS 16
@@ -0,0 +1,161 @@
+/*
+ * Benchmark for the read side of the block graph lock
+ *
+ * Each thread runs its own AioContext, like an IOThread, and a coroutine
+ * that takes and releases the graph reader lock in a loop, as every
+ * request in block/io.c does.  Configure with --enable-membarrier to see
+ * the read side without full memory barriers.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qemu/coroutine.h"
+#include "qemu/processor.h"
+#include "qemu/thread.h"
+#include "block/aio.h"
+#include "block/graph-lock.h"
+
+struct thread_info {
+    uint64_t ops;
+} QEMU_ALIGNED(64);
+
+static QemuThread *threads;
+static struct thread_info *th_info;
+static unsigned int n_threads = 1;
+static unsigned int n_ready_threads;
+static unsigned int duration = 1;
+static bool test_start;
+static bool test_stop;
+
+static const char commands_string[] =
+    " -n = number of threads\n"
+    " -d = duration in seconds";
+
+static void usage_complete(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+}
+
+static void coroutine_fn reader_co(void *opaque)
+{
+    struct thread_info *info = opaque;
+    uint64_t ops = 0;
+
+    while (!qatomic_read(&test_stop)) {
+        bdrv_graph_co_rdlock();
+        bdrv_graph_co_rdunlock();
+        ops++;
+    }
+    info->ops = ops;
+}
+
+static void *thread_func(void *arg)
+{
+    struct thread_info *info = arg;
+    AioContext *ctx = aio_context_new(&error_abort);
+    Coroutine *co;
+
+    qemu_set_current_aio_context(ctx);
+    co = qemu_coroutine_create(reader_co, info);
+
+    qatomic_inc(&n_ready_threads);
+    while (!qatomic_read(&test_start)) {
+        cpu_relax();
+    }
+
+    qemu_coroutine_enter(co);
+    aio_context_unref(ctx);
+    return NULL;
+}
+
+static void run_test(void)
+{
+    unsigned int i;
+
+    while (qatomic_read(&n_ready_threads) != n_threads) {
+        cpu_relax();
+    }
+
+    qatomic_set(&test_start, true);
+    g_usleep(duration * G_USEC_PER_SEC);
+    qatomic_set(&test_stop, true);
+
+    for (i = 0; i < n_threads; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+}
+
+static void create_threads(void)
+{
+    unsigned int i;
+
+    threads = g_new(QemuThread, n_threads);
+    th_info = g_new0(struct thread_info, n_threads);
+
+    for (i = 0; i < n_threads; i++) {
+        qemu_thread_create(&threads[i], NULL, thread_func, &th_info[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void pr_params(void)
+{
+    printf("Parameters:\n");
+    printf(" # of threads:      %u\n", n_threads);
+    printf(" duration:          %u\n", duration);
+}
+
+static void pr_stats(void)
+{
+    unsigned long long val = 0;
+    unsigned int i;
+    double tx;
+
+    for (i = 0; i < n_threads; i++) {
+        val += th_info[i].ops;
+    }
+    tx = val / duration / 1e6;
+
+    printf("Results:\n");
+    printf("Duration:            %u s\n", duration);
+    printf(" Throughput:         %.2f Mlocks/s\n", tx);
+    printf(" Throughput/thread:  %.2f Mlocks/s/thread\n", tx / n_threads);
+    printf(" Latency:            %.2f ns/lock\n", 1e3 / (tx / n_threads));
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "hd:n:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'h':
+            usage_complete(argv);
+            exit(0);
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'n':
+            n_threads = atoi(optarg);
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+    pr_params();
+    create_threads();
+    run_test();
+    pr_stats();
+    return 0;
+}
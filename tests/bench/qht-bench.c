@@ -9,6 +9,7 @@
 #include "qemu/atomic.h"
 #include "qemu/qht.h"
 #include "qemu/rcu.h"
+#include "qemu/timer.h"
 #include "qemu/xxhash.h"
 #include "qemu/memalign.h"
 
@@ -21,6 +22,8 @@ struct thread_stats {
     size_t not_rm;
     size_t rz;
     size_t not_rz;
+    int64_t rz_ns;
+    int64_t rz_max_ns;
 };
 
 struct thread_info {
@@ -142,13 +145,18 @@ static void do_rz(struct thread_info *info)
 
     if (r < resize_threshold) {
         size_t size = info->resize_down ? resize_min : resize_max;
+        int64_t t0, ns;
         bool resized;
 
+        t0 = get_clock();
         resized = qht_resize(&ht, size);
+        ns = get_clock() - t0;
         info->resize_down = !info->resize_down;
 
         if (resized) {
             stats->rz++;
+            stats->rz_ns += ns;
+            stats->rz_max_ns = MAX(stats->rz_max_ns, ns);
         } else {
             stats->not_rz++;
         }
@@ -384,12 +392,15 @@ static void add_stats(struct thread_stats *s, struct thread_info *info, int n)
 
         s->rz += stats->rz;
         s->not_rz += stats->not_rz;
+        s->rz_ns += stats->rz_ns;
+        s->rz_max_ns = MAX(s->rz_max_ns, stats->rz_max_ns);
     }
 }
 
 static void pr_stats(void)
 {
     struct thread_stats s = {};
+    struct qht_stats hs;
     double tx;
 
     add_stats(&s, rw_info, n_rw_threads);
@@ -400,6 +411,10 @@ static void pr_stats(void)
     if (resize_rate) {
         printf(" Resizes:           %zu (%.2f%% of %zu)\n",
                s.rz, (double)s.rz / (s.rz + s.not_rz) * 100, s.rz + s.not_rz);
+        if (s.rz) {
+            printf(" Resize latency:    %.2f us avg, %.2f us max\n",
+                   (double)s.rz_ns / s.rz / 1e3, (double)s.rz_max_ns / 1e3);
+        }
     }
 
     printf(" Read:              %.2f M (%.2f%% of %.2fM)\n",
@@ -418,6 +433,10 @@ static void pr_stats(void)
     tx = (s.rd + s.not_rd + s.in + s.not_in + s.rm + s.not_rm) / 1e6 / duration;
     printf(" Throughput:        %.2f MT/s\n", tx);
     printf(" Throughput/thread: %.2f MT/s/thread\n", tx / n_rw_threads);
+
+    qht_statistics_init(&ht, &hs);
+    printf(" Lookup retries:    %zu\n", hs.lookup_retries);
+    qht_statistics_destroy(&hs);
 }
 
 static void run_test(void)
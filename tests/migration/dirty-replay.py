@@ -0,0 +1,306 @@
+#!/usr/bin/env python3
+#
+# Record the dirty page pattern of a guest and replay it against migration
+#
+# "record" connects to the QMP socket of a running VM and repeatedly runs
+# calc-dirty-rate in dirty-bitmap mode.  With the ram_dirty_range trace
+# event enabled and the log trace backend, every measurement also logs
+# the pages that were written, which are collected into a trace file:
+#
+#   qemu-system-x86_64 ... -qmp unix:/tmp/qmp.sock,server=on,wait=off \
+#       -trace ram_dirty_range -trace dirtyrate_calculate -D /tmp/dirty.log
+#   dirty-replay.py record --qmp /tmp/qmp.sock --log /tmp/dirty.log \
+#       --period 1000 --count 60 > workload.trace
+#
+# "replay" starts a guest without any CPU (qtest accelerator) and the same
+# RAM layout as the recorded one, migrates it to a second such process or
+# to a null sink, and writes the recorded pages over qtest while the real
+# RAM migration code sends them.  The progress of each iteration over RAM,
+# the downtime and whether the migration converged are printed as JSON:
+#
+#   dirty-replay.py replay --binary ./qemu-system-x86_64 \
+#       --args "-M q35 -m 4G" --cap multifd --param multifd-channels=4 \
+#       workload.trace
+#
+# The replayed dirty rate is bounded by the speed of the qtest protocol,
+# so workloads with many small scattered writes are replayed slower than
+# they were recorded.  Each record reports the time its writes took.
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+import argparse
+import json
+import os
+import re
+import shlex
+import sys
+import time
+
+sys.path.append(os.path.join(os.path.dirname(__file__),
+                             '..', '..', 'python'))
+from qemu.machine.qtest import QEMUQtestMachine
+from qemu.qmp.legacy import QEMUMonitorProtocol
+
+
+TRACE_VERSION = 1
+
+RANGE_RE = re.compile(r"ram_dirty_range (\S+): offset: 0x([0-9a-f]+) "
+                      r"length: 0x([0-9a-f]+)")
+CALC_RE = re.compile(r"dirtyrate_calculate dirty rate: (\d+)")
+FLAT_RE = re.compile(r"^\s+([0-9a-f]+)-([0-9a-f]+) \(prio -?\d+, "
+                     r"(?:ram|rom)\): (\S+)(?: @([0-9a-f]+))?")
+
+
+def wait_log(logfh, timeout):
+    "Collect the ranges logged up to the end of a measurement."
+    ranges = []
+    buf = ""
+    deadline = time.monotonic() + timeout
+    while time.monotonic() < deadline:
+        buf += logfh.read()
+        while "\n" in buf:
+            line, buf = buf.split("\n", 1)
+            m = RANGE_RE.search(line)
+            if m:
+                ranges.append([m.group(1), int(m.group(2), 16),
+                               int(m.group(3), 16)])
+                continue
+            m = CALC_RE.search(line)
+            if m:
+                return ranges, int(m.group(1))
+        time.sleep(0.01)
+    raise Exception("no dirtyrate_calculate event in the log, is the log "
+                    "trace backend enabled?")
+
+
+def record(args):
+    qmp = QEMUMonitorProtocol(args.qmp)
+    qmp.connect()
+    qmp.cmd_raw("trace-event-set-state",
+                {"name": "ram_dirty_range", "enable": True})
+    qmp.cmd_raw("trace-event-set-state",
+                {"name": "dirtyrate_calculate", "enable": True})
+
+    print(json.dumps({"version": TRACE_VERSION, "period-ms": args.period}))
+    with open(args.log, "r", encoding="utf-8") as logfh:
+        logfh.seek(0, os.SEEK_END)
+        start = time.monotonic()
+        for _ in range(args.count):
+            now = time.monotonic() - start
+            resp = qmp.cmd_obj({"execute": "calc-dirty-rate",
+                                "arguments": {"calc-time": args.period,
+                                              "calc-time-unit": "millisecond",
+                                              "mode": "dirty-bitmap"}})
+            if "error" in resp:
+                raise Exception(resp["error"]["desc"])
+            ranges, rate = wait_log(logfh, args.period / 1000 + 10)
+            print(json.dumps({"time": round(now, 3), "dirty-rate": rate,
+                              "ranges": ranges}))
+            sys.stdout.flush()
+    qmp.close()
+    return 0
+
+
+def ram_map(vm):
+    "Map RAM block names to (offset, length, guest address) triples."
+    mtree = vm.cmd("human-monitor-command", command_line="info mtree -f")
+    ram = {}
+    want = False
+    for line in mtree.splitlines():
+        if line.startswith("FlatView"):
+            want = False
+        elif line.startswith(' AS "memory"'):
+            want = True
+        elif want:
+            m = FLAT_RE.match(line)
+            if m:
+                start, end = int(m.group(1), 16), int(m.group(2), 16)
+                offset = int(m.group(4) or "0", 16)
+                ram.setdefault(m.group(3), []).append(
+                    (offset, end - start + 1, start))
+    return ram
+
+
+def to_guest(ram, name, offset, length):
+    "Yield the guest physical ranges a recorded range maps to."
+    # Device RAM blocks are named "<device path>/<memory region name>"
+    regions = ram.get(name) or ram.get(name.rsplit("/", 1)[-1], [])
+    for mr_offset, size, gpa in regions:
+        lo = max(offset, mr_offset)
+        hi = min(offset + length, mr_offset + size)
+        if lo < hi:
+            yield gpa + lo - mr_offset, hi - lo
+
+
+def load_trace(path, ram):
+    with open(path, "r", encoding="utf-8") as fh:
+        header = json.loads(fh.readline())
+        if header.get("version") != TRACE_VERSION:
+            raise Exception("%s: unsupported trace version" % path)
+        records = []
+        for line in fh:
+            rec = json.loads(line)
+            writes = []
+            for name, offset, length in rec["ranges"]:
+                writes.extend(to_guest(ram, name, offset, length))
+            records.append((rec["time"], writes))
+    return header["period-ms"] / 1000, records
+
+
+def migrate_setup(vm, args):
+    if args.cap:
+        vm.cmd("migrate-set-capabilities",
+               capabilities=[{"capability": c, "state": True}
+                             for c in args.cap])
+    for param in args.param:
+        key, value = param.split("=", 1)
+        try:
+            value = int(value)
+        except ValueError:
+            if value in ("on", "off"):
+                value = value == "on"
+        vm.cmd("migrate-set-parameters", args_dict={key: value})
+
+
+def progress(vm):
+    info = vm.cmd("query-migrate")
+    ram = info.get("ram", {})
+    return info.get("status", "active"), {
+        "iteration": ram.get("dirty-sync-count", 0),
+        "transferred": ram.get("transferred", 0),
+        "remaining": ram.get("remaining", 0),
+        "dirty-pages-rate": ram.get("dirty-pages-rate", 0),
+        "mbps": ram.get("mbps", 0),
+        "expected-downtime": info.get("expected-downtime", 0),
+    }, info
+
+
+def replay(args):
+    vmargs = shlex.split(args.args) + ["-nodefaults", "-display", "none"]
+    src = QEMUQtestMachine(args.binary, vmargs, name="replay-src-%d" %
+                           os.getpid())
+    dst = None
+    if args.sink == "null":
+        uri = "exec:cat > /dev/null"
+    else:
+        uri = "unix:/var/tmp/qemu-replay-%d.sock" % os.getpid()
+        dst = QEMUQtestMachine(args.binary, vmargs + ["-incoming", "defer"],
+                               name="replay-dst-%d" % os.getpid())
+
+    try:
+        src.launch()
+        ram = ram_map(src)
+        period, records = load_trace(args.trace, ram)
+        if not records:
+            raise Exception("%s: empty trace" % args.trace)
+
+        # Give every page non-zero contents, like a guest that has run
+        if not args.no_fill:
+            for regions in ram.values():
+                for _, size, gpa in regions:
+                    src.qtest("memset 0x%x 0x%x 0x5a" % (gpa, size))
+
+        migrate_setup(src, args)
+        if dst:
+            dst.launch()
+            migrate_setup(dst, args)
+            dst.cmd("migrate-incoming", uri=uri)
+        src.cmd("migrate", uri=uri)
+
+        iterations = []
+        start = time.monotonic()
+        status, last, info = progress(src)
+        n = 0
+        while status in ("setup", "active", "device"):
+            rec_time, writes = records[n % len(records)]
+            epoch = n // len(records)
+            due = start + epoch * (records[-1][0] + period) + rec_time
+            n += 1
+            if not args.loop and n > len(records):
+                writes = []
+
+            time.sleep(max(0, due - time.monotonic()))
+            value = 1 + n % 255
+            for gpa, size in writes:
+                src.qtest("memset 0x%x 0x%x 0x%x" % (gpa, size, value))
+            late = time.monotonic() - due
+
+            status, cur, info = progress(src)
+            if cur["iteration"] != last["iteration"]:
+                cur["time"] = round(time.monotonic() - start, 3)
+                cur["replay-lag"] = round(late, 3)
+                iterations.append(cur)
+                last = cur
+            if cur["iteration"] > args.max_iters:
+                src.cmd("migrate_cancel")
+                status = "cancelled"
+
+        while status in ("active", "device", "cancelling"):
+            time.sleep(0.05)
+            status, _, info = progress(src)
+
+        print(json.dumps({
+            "trace": os.path.basename(args.trace),
+            "capabilities": args.cap,
+            "parameters": args.param,
+            "status": status,
+            "converged": status == "completed",
+            "total-time": info.get("total-time"),
+            "downtime": info.get("downtime"),
+            "setup-time": info.get("setup-time"),
+            "iterations": iterations,
+        }, indent=2))
+        return 0 if status == "completed" else 1
+    finally:
+        src.shutdown()
+        if dst:
+            dst.shutdown()
+        if uri.startswith("unix:") and os.path.exists(uri[5:]):
+            os.remove(uri[5:])
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Dirty page trace "
+                                     "recording and migration replay")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    rec = sub.add_parser("record", help="Record a trace from a running VM")
+    rec.add_argument("--qmp", required=True, help="QMP socket of the VM")
+    rec.add_argument("--log", required=True,
+                     help="Log file of the VM (-D option)")
+    rec.add_argument("--period", type=int, default=1000,
+                     help="Length of each measurement in milliseconds")
+    rec.add_argument("--count", type=int, default=60,
+                     help="Number of measurements")
+
+    rep = sub.add_parser("replay", help="Replay a trace during migration")
+    rep.add_argument("--binary", required=True, help="QEMU binary")
+    rep.add_argument("--args", default="",
+                     help="Machine options, must give the same RAM layout "
+                     "as the recorded VM")
+    rep.add_argument("--sink", choices=["loopback", "null"],
+                     default="loopback",
+                     help="Migrate to a second QEMU or to /dev/null")
+    rep.add_argument("--cap", action="append", default=[],
+                     help="Migration capability to enable")
+    rep.add_argument("--param", action="append", default=[],
+                     help="Migration parameter, as NAME=VALUE")
+    rep.add_argument("--max-iters", type=int, default=30,
+                     help="Cancel migration after this many iterations")
+    rep.add_argument("--loop", action="store_true",
+                     help="Restart the trace when it ends")
+    rep.add_argument("--no-fill", action="store_true",
+                     help="Start with zeroed RAM")
+    rep.add_argument("trace", help="Trace file written by 'record'")
+
+    args = parser.parse_args()
+    if args.command == "record":
+        return record(args)
+    return replay(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -2066,6 +2066,83 @@ static void test_precopy_file(void)
     test_file_common(&args, true);
 }
 
+static void *migrate_mapped_ram_start(QTestState *from, QTestState *to)
+{
+    migrate_set_capability(from, "mapped-ram", true);
+    migrate_set_capability(to, "mapped-ram", true);
+
+    return NULL;
+}
+
+static void test_precopy_file_mapped_ram_live(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_mapped_ram_start,
+    };
+
+    test_file_common(&args, false);
+}
+
+static void test_precopy_file_mapped_ram(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_mapped_ram_start,
+    };
+
+    test_file_common(&args, true);
+}
+
+static void *migrate_mapped_ram_mmap_start(QTestState *from, QTestState *to)
+{
+    migrate_mapped_ram_start(from, to);
+    migrate_set_capability(to, "mapped-ram-mmap", true);
+
+    return NULL;
+}
+
+static void test_precopy_file_mapped_ram_mmap(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_mapped_ram_mmap_start,
+    };
+
+    test_file_common(&args, true);
+}
+
+static void *migrate_mapped_ram_prefetch_start(QTestState *from,
+                                               QTestState *to)
+{
+    migrate_mapped_ram_mmap_start(from, to);
+    migrate_set_capability(to, "mapped-ram-prefetch", true);
+
+    return NULL;
+}
+
+static void test_precopy_file_mapped_ram_prefetch(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_mapped_ram_prefetch_start,
+    };
+
+    test_file_common(&args, true);
+}
+
 static void file_offset_finish_hook(QTestState *from, QTestState *to,
                                     void *opaque)
 {
@@ -2149,6 +2226,27 @@ static void test_mode_reboot(void)
     test_file_common(&args, true);
 }
 
+static void *test_mode_transfer_start(QTestState *from, QTestState *to)
+{
+    migrate_set_parameter_str(from, "mode", "cpr-transfer");
+    migrate_set_parameter_str(to, "mode", "cpr-transfer");
+
+    return NULL;
+}
+
+static void test_mode_transfer(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .start.use_shmem = true,
+        .listen_uri = uri,
+        .connect_uri = uri,
+        .start_hook = test_mode_transfer_start,
+    };
+
+    test_precopy_common(&args);
+}
+
 static void test_precopy_tcp_plain(void)
 {
     MigrateCommon args = {
@@ -2572,6 +2670,15 @@ test_migrate_precopy_tcp_multifd_zstd_start(QTestState *from,
 }
 #endif /* CONFIG_ZSTD */
 
+#ifdef CONFIG_LZ4
+static void *
+test_migrate_precopy_tcp_multifd_lz4_start(QTestState *from,
+                                           QTestState *to)
+{
+    return test_migrate_precopy_tcp_multifd_start_common(from, to, "lz4");
+}
+#endif /* CONFIG_LZ4 */
+
 static void test_multifd_tcp_none(void)
 {
     MigrateCommon args = {
@@ -2607,6 +2714,17 @@ static void test_multifd_tcp_zstd(void)
 }
 #endif
 
+#ifdef CONFIG_LZ4
+static void test_multifd_tcp_lz4(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_lz4_start,
+    };
+    test_precopy_common(&args);
+}
+#endif
+
 #ifdef CONFIG_GNUTLS
 static void *
 test_migrate_multifd_tcp_tls_psk_start_match(QTestState *from,
@@ -3381,6 +3499,14 @@ int main(int argc, char **argv)
                    test_precopy_file_offset);
     qtest_add_func("/migration/precopy/file/offset/bad",
                    test_precopy_file_offset_bad);
+    qtest_add_func("/migration/precopy/file/mapped-ram",
+                   test_precopy_file_mapped_ram);
+    qtest_add_func("/migration/precopy/file/mapped-ram/live",
+                   test_precopy_file_mapped_ram_live);
+    qtest_add_func("/migration/precopy/file/mapped-ram/mmap",
+                   test_precopy_file_mapped_ram_mmap);
+    qtest_add_func("/migration/precopy/file/mapped-ram/prefetch",
+                   test_precopy_file_mapped_ram_prefetch);
 
     /*
      * Our CI system has problems with shared memory.
@@ -3388,6 +3514,7 @@ int main(int argc, char **argv)
      */
     if (getenv("QEMU_TEST_FLAKY_TESTS")) {
         qtest_add_func("/migration/mode/reboot", test_mode_reboot);
+        qtest_add_func("/migration/mode/transfer", test_mode_transfer);
     }
 
 #ifdef CONFIG_GNUTLS
@@ -3480,6 +3607,10 @@ int main(int argc, char **argv)
     qtest_add_func("/migration/multifd/tcp/plain/zstd",
                    test_multifd_tcp_zstd);
 #endif
+#ifdef CONFIG_LZ4
+    qtest_add_func("/migration/multifd/tcp/plain/lz4",
+                   test_multifd_tcp_lz4);
+#endif
 #ifdef CONFIG_GNUTLS
     qtest_add_func("/migration/multifd/tcp/tls/psk/match",
                    test_multifd_tcp_tls_psk_match);
@@ -0,0 +1,310 @@
+/*
+ * QTest benchmark for the virtio-blk, virtio-net and virtio-scsi dataplanes
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * Each benchmark keeps a fixed number of requests in flight against a
+ * backend that does no real work (null-co for the block devices, a hub
+ * port with no peer for virtio-net), resubmitting every request as soon
+ * as it shows up in the used ring.  What is measured is therefore the
+ * cost of device emulation, virtqueue_pop()/virtqueue_push() and the
+ * notification path, plus the constant overhead of the qtest protocol.
+ * Only the former changes between builds, so compare results taken on
+ * the same host.
+ *
+ * The benchmarks are only registered in perf mode, e.g.:
+ *
+ *   QTEST_QEMU_BINARY=./qemu-system-x86_64 ./tests/qtest/qos-test -m perf \
+ *       -p /x86_64/pc/i440FX-pcihost/pci-bus-pc/pci-bus/virtio-blk-pci
+ *
+ * The number of requests per run defaults to BENCH_REQUESTS and can be
+ * changed with the QTEST_VIRTIO_BENCH_REQUESTS environment variable.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest-single.h"
+#include "qemu/bswap.h"
+#include "qemu/cutils.h"
+#include "qemu/module.h"
+#include "standard-headers/linux/virtio_blk.h"
+#include "standard-headers/linux/virtio_net.h"
+#include "standard-headers/linux/virtio_scsi.h"
+#include "libqos/qgraph.h"
+#include "libqos/virtio-blk.h"
+#include "libqos/virtio-net.h"
+#include "libqos/virtio-scsi.h"
+
+#define BENCH_REQUESTS      100000
+#define BENCH_DEPTH         16
+#define BENCH_TIMEOUT_US    (30 * 1000 * 1000)
+#define BENCH_SECTOR_SIZE   512
+
+/* Set in QOSGraphTestOptions.arg for the variants that use an IOThread */
+#define BENCH_IOTHREAD      ((void *)"iothread")
+
+static unsigned long bench_requests(void)
+{
+    const char *str = g_getenv("QTEST_VIRTIO_BENCH_REQUESTS");
+    unsigned long n;
+
+    if (!str || qemu_strtoul(str, NULL, 0, &n) < 0 || n == 0) {
+        return BENCH_REQUESTS;
+    }
+    return n;
+}
+
+/*
+ * Submit the descriptor chains starting at @heads and keep resubmitting
+ * them until bench_requests() requests have completed.
+ */
+static void bench_run(const char *name, void *data, QVirtioDevice *dev,
+                      QVirtQueue *vq, const uint32_t *heads)
+{
+    QTestState *qts = global_qtest;
+    unsigned long n = bench_requests();
+    unsigned long submitted, completed = 0;
+    gint64 start, last;
+    double ns;
+    uint32_t head;
+
+    start = last = g_get_monotonic_time();
+    for (submitted = 0; submitted < BENCH_DEPTH && submitted < n;
+         submitted++) {
+        qvirtqueue_kick(qts, dev, vq, heads[submitted]);
+    }
+
+    while (completed < n) {
+        if (!qvirtqueue_get_buf(qts, vq, &head, NULL)) {
+            g_assert(g_get_monotonic_time() - last <= BENCH_TIMEOUT_US);
+            continue;
+        }
+        last = g_get_monotonic_time();
+        completed++;
+        if (submitted < n) {
+            qvirtqueue_kick(qts, dev, vq, head);
+            submitted++;
+        }
+    }
+
+    ns = (last - start) * 1000.0 / n;
+    g_test_minimized_result(ns, "%s, %d IOThread(s): %lu requests, "
+                            "%.0f ns/request, %.0f requests/s",
+                            name, data == BENCH_IOTHREAD, n, ns, 1e9 / ns);
+}
+
+static void bench_blk_run(QVirtioDevice *dev, void *data,
+                          QGuestAllocator *t_alloc)
+{
+    QTestState *qts = global_qtest;
+    uint64_t addr[BENCH_DEPTH];
+    uint32_t heads[BENCH_DEPTH];
+    uint64_t features;
+    QVirtQueue *vq;
+    int i;
+
+    features = qvirtio_get_features(dev);
+    features &= ~(QVIRTIO_F_BAD_FEATURE |
+                  (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                  (1u << VIRTIO_RING_F_EVENT_IDX) |
+                  (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(dev, features);
+
+    vq = qvirtqueue_setup(dev, t_alloc, 0);
+    g_assert_cmpint(vq->size, >=, 3 * BENCH_DEPTH);
+    qvirtio_set_driver_ok(dev);
+
+    for (i = 0; i < BENCH_DEPTH; i++) {
+        struct virtio_blk_outhdr hdr = {
+            .type = VIRTIO_BLK_T_IN,
+            .sector = i,
+        };
+
+        if (qvirtio_is_big_endian(dev) != HOST_BIG_ENDIAN) {
+            hdr.type = bswap32(hdr.type);
+            hdr.sector = bswap64(hdr.sector);
+        }
+
+        addr[i] = guest_alloc(t_alloc, sizeof(hdr) + BENCH_SECTOR_SIZE + 1);
+        memwrite(addr[i], &hdr, sizeof(hdr));
+
+        heads[i] = qvirtqueue_add(qts, vq, addr[i], sizeof(hdr),
+                                  false, true);
+        qvirtqueue_add(qts, vq, addr[i] + sizeof(hdr), BENCH_SECTOR_SIZE,
+                       true, true);
+        qvirtqueue_add(qts, vq, addr[i] + sizeof(hdr) + BENCH_SECTOR_SIZE,
+                       1, true, false);
+    }
+
+    bench_run("virtio-blk", data, dev, vq, heads);
+
+    for (i = 0; i < BENCH_DEPTH; i++) {
+        guest_free(t_alloc, addr[i]);
+    }
+    qvirtqueue_cleanup(dev->bus, vq, t_alloc);
+}
+
+static void bench_blk(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioBlk *blk_if = obj;
+
+    bench_blk_run(blk_if->vdev, data, t_alloc);
+}
+
+static void bench_blk_pci(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioBlkPCI *blk_pci = obj;
+
+    bench_blk_run(blk_pci->blk.vdev, data, t_alloc);
+}
+
+static void bench_net_tx(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioNet *net = obj;
+    QVirtQueue *vq = net->queues[1];
+    QTestState *qts = global_qtest;
+    size_t len = sizeof(struct virtio_net_hdr_mrg_rxbuf) + 64;
+    uint64_t addr[BENCH_DEPTH];
+    uint32_t heads[BENCH_DEPTH];
+    int i;
+
+    g_assert_cmpint(vq->size, >=, BENCH_DEPTH);
+
+    for (i = 0; i < BENCH_DEPTH; i++) {
+        addr[i] = guest_alloc(t_alloc, len);
+        qtest_memset(qts, addr[i], 0, len);
+        heads[i] = qvirtqueue_add(qts, vq, addr[i], len, false, false);
+    }
+
+    bench_run("virtio-net tx", data, net->vdev, vq, heads);
+
+    for (i = 0; i < BENCH_DEPTH; i++) {
+        guest_free(t_alloc, addr[i]);
+    }
+}
+
+static void bench_scsi_run(QVirtioDevice *dev, void *data,
+                           QGuestAllocator *t_alloc)
+{
+    QTestState *qts = global_qtest;
+    QVirtQueue *vq[3];
+    uint64_t addr[BENCH_DEPTH];
+    uint32_t heads[BENCH_DEPTH];
+    uint64_t features;
+    int i;
+
+    features = qvirtio_get_features(dev);
+    features &= ~(QVIRTIO_F_BAD_FEATURE | (1ull << VIRTIO_RING_F_EVENT_IDX));
+    qvirtio_set_features(dev, features);
+
+    /* Only the control, event and first request queue are used */
+    g_assert_cmpint(qvirtio_config_readl(dev, 0), >=, 1);
+    for (i = 0; i < ARRAY_SIZE(vq); i++) {
+        vq[i] = qvirtqueue_setup(dev, t_alloc, i);
+    }
+    g_assert_cmpint(vq[2]->size, >=, 3 * BENCH_DEPTH);
+    qvirtio_set_driver_ok(dev);
+
+    for (i = 0; i < BENCH_DEPTH; i++) {
+        /* READ(10) of one block, LUN 0 on target 1 */
+        struct virtio_scsi_cmd_req req = {
+            .lun = { 1, 1 },
+            .cdb = { 0x28, 0, 0, 0, 0, i, 0, 0, 1, 0 },
+        };
+        uint64_t resp;
+
+        addr[i] = guest_alloc(t_alloc, sizeof(req) +
+                              sizeof(struct virtio_scsi_cmd_resp) +
+                              BENCH_SECTOR_SIZE);
+        resp = addr[i] + sizeof(req);
+        memwrite(addr[i], &req, sizeof(req));
+
+        heads[i] = qvirtqueue_add(qts, vq[2], addr[i], sizeof(req),
+                                  false, true);
+        qvirtqueue_add(qts, vq[2], resp, sizeof(struct virtio_scsi_cmd_resp),
+                       true, true);
+        qvirtqueue_add(qts, vq[2], resp + sizeof(struct virtio_scsi_cmd_resp),
+                       BENCH_SECTOR_SIZE, true, false);
+    }
+
+    bench_run("virtio-scsi", data, dev, vq[2], heads);
+
+    for (i = 0; i < BENCH_DEPTH; i++) {
+        guest_free(t_alloc, addr[i]);
+    }
+    for (i = 0; i < ARRAY_SIZE(vq); i++) {
+        qvirtqueue_cleanup(dev->bus, vq[i], t_alloc);
+    }
+}
+
+static void bench_scsi(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioSCSI *scsi = obj;
+
+    bench_scsi_run(scsi->vdev, data, t_alloc);
+}
+
+static void bench_scsi_pci(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioSCSIPCI *scsi_pci = obj;
+
+    bench_scsi_run(scsi_pci->scsi.vdev, data, t_alloc);
+}
+
+static void *bench_blk_setup(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line,
+                    " -drive if=none,id=drive0,file=null-co://,format=raw");
+    if (arg == BENCH_IOTHREAD) {
+        g_string_append(cmd_line, " -object iothread,id=thread0");
+    }
+    return arg;
+}
+
+static void *bench_net_setup(GString *cmd_line, void *arg)
+{
+    /* A hub with a single port drops everything sent to it */
+    g_string_append(cmd_line, " -netdev hubport,hubid=0,id=hs0");
+    return arg;
+}
+
+static void *bench_scsi_setup(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line,
+                    " -drive if=none,id=dr1,file=null-co://,format=raw"
+                    " -device scsi-hd,drive=dr1,lun=0,scsi-id=1");
+    if (arg == BENCH_IOTHREAD) {
+        g_string_append(cmd_line, " -object iothread,id=thread0");
+    }
+    return arg;
+}
+
+static void register_virtio_bench(void)
+{
+    QOSGraphTestOptions opts = { };
+
+    if (!g_test_perf()) {
+        return;
+    }
+
+    opts.before = bench_blk_setup;
+    qos_add_test("bench", "virtio-blk", bench_blk, &opts);
+    opts.before = bench_net_setup;
+    qos_add_test("bench-tx", "virtio-net", bench_net_tx, &opts);
+    opts.before = bench_scsi_setup;
+    qos_add_test("bench", "virtio-scsi", bench_scsi, &opts);
+
+    opts.arg = BENCH_IOTHREAD;
+    opts.edge = (QOSGraphEdgeOptions) {
+        .extra_device_opts = "iothread=thread0",
+    };
+    opts.before = bench_blk_setup;
+    qos_add_test("bench-iothread", "virtio-blk-pci", bench_blk_pci, &opts);
+    opts.before = bench_scsi_setup;
+    qos_add_test("bench-iothread", "virtio-scsi-pci", bench_scsi_pci,
+                 &opts);
+}
+
+libqos_init(register_virtio_bench);
@@ -0,0 +1,96 @@
+#!/usr/bin/env python3
+#
+# Run TCG benchmarks and report the results as JSON
+#
+# Each benchmark binary is run several times under QEMU and the fastest
+# wall clock time is kept.  If the bb plugin is available, one more run
+# counts the guest instructions executed and the blocks translated, from
+# which the guest MIPS rate is derived.
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+
+import argparse
+import json
+import os
+import re
+import shlex
+import subprocess
+import sys
+import time
+from tempfile import TemporaryDirectory
+
+
+def get_args():
+    parser = argparse.ArgumentParser(description="TCG benchmark runner")
+    parser.add_argument("--qemu", help="QEMU binary to benchmark",
+                        required=True)
+    parser.add_argument("--qargs", help="Additional QEMU arguments",
+                        default="")
+    parser.add_argument("--plugin", help="Path to the bb plugin, for counts")
+    parser.add_argument("--target", help="Target name for the report",
+                        default="")
+    parser.add_argument("--repeat", help="Timed runs per benchmark",
+                        type=int, default=3)
+    parser.add_argument("benchmarks", nargs="+",
+                        help="Guest binaries to run")
+    return parser.parse_args()
+
+
+def run(cmd):
+    start = time.monotonic()
+    subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL)
+    return time.monotonic() - start
+
+
+def count(args, qemu, bench):
+    "Return the plugin's counts for one run of @bench."
+    with TemporaryDirectory() as tmpdir:
+        log = os.path.join(tmpdir, "plugin.log")
+        run(qemu + ["-plugin", args.plugin + ",inline=on",
+                    "-d", "plugin", "-D", log, bench])
+        with open(log, encoding="utf-8") as f:
+            text = f.read()
+
+    counts = {}
+    m = re.search(r"^bb's: (\d+), insns: (\d+)$", text, re.M)
+    if m:
+        counts["executed_tbs"] = int(m.group(1))
+        counts["guest_insns"] = int(m.group(2))
+    m = re.search(r"^translated bb's: (\d+), insns: (\d+)$", text, re.M)
+    if m:
+        counts["translated_tbs"] = int(m.group(1))
+        counts["translated_insns"] = int(m.group(2))
+    return counts
+
+
+def main():
+    args = get_args()
+    qemu = [args.qemu] + shlex.split(args.qargs)
+
+    for bench in args.benchmarks:
+        result = {
+            "target": args.target,
+            "benchmark": os.path.basename(bench),
+        }
+        try:
+            result["wall_time_s"] = min(run(qemu + [bench])
+                                        for _ in range(max(args.repeat, 1)))
+            if args.plugin:
+                result.update(count(args, qemu, bench))
+        except subprocess.CalledProcessError as e:
+            print(f"{bench}: {e}", file=sys.stderr)
+            result["error"] = str(e)
+
+        if "guest_insns" in result:
+            result["mips"] = result["guest_insns"] / result["wall_time_s"] / 1e6
+        print(json.dumps(result, sort_keys=True))
+        sys.stdout.flush()
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
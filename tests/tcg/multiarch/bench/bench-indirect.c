@@ -0,0 +1,42 @@
+/*
+ * TCG benchmark: indirect calls and returns
+ *
+ * Calls through a table of function pointers with an unpredictable
+ * index, stressing the lookup of the next translation block for
+ * computed jumps and returns.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ITERATIONS 5000000
+
+typedef uint32_t fn(uint32_t);
+
+static __attribute__((noinline)) uint32_t f0(uint32_t x) { return x + 1; }
+static __attribute__((noinline)) uint32_t f1(uint32_t x) { return x ^ 0x55; }
+static __attribute__((noinline)) uint32_t f2(uint32_t x) { return x * 7; }
+static __attribute__((noinline)) uint32_t f3(uint32_t x) { return x >> 1; }
+static __attribute__((noinline)) uint32_t f4(uint32_t x) { return x - 3; }
+static __attribute__((noinline)) uint32_t f5(uint32_t x) { return ~x; }
+static __attribute__((noinline)) uint32_t f6(uint32_t x) { return x << 2; }
+static __attribute__((noinline)) uint32_t f7(uint32_t x) { return x | 9; }
+
+static fn * volatile table[8] = { f0, f1, f2, f3, f4, f5, f6, f7 };
+
+int main(void)
+{
+    uint32_t x = 1, seed = 12345;
+    unsigned i;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        /* LCG, using the high bits as the unpredictable index */
+        seed = seed * 1103515245 + 12345;
+        x = table[seed >> 29](x);
+    }
+
+    printf("%08x\n", x);
+    return 0;
+}
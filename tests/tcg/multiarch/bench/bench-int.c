@@ -0,0 +1,34 @@
+/*
+ * TCG benchmark: integer arithmetic and branches
+ *
+ * A mix of multiplies, shifts, compares and data-dependent branches,
+ * in a loop that stays within a handful of translation blocks.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ITERATIONS 20000000
+
+int main(void)
+{
+    uint64_t x = 0x123456789abcdefull, acc = 0;
+    unsigned i;
+
+    for (i = 0; i < ITERATIONS; i++) {
+        /* xorshift64 */
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        if (x & 1) {
+            acc += x * 3;
+        } else {
+            acc ^= x >> 3;
+        }
+    }
+
+    printf("%016llx\n", (unsigned long long)acc);
+    return 0;
+}
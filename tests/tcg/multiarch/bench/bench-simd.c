@@ -0,0 +1,58 @@
+/*
+ * TCG benchmark: vectorizable loops
+ *
+ * Simple integer and floating point array kernels, which the compiler
+ * turns into guest SIMD instructions where the target has them.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#define ITERATIONS 100000
+#define N          1024
+
+static float fa[N], fb[N], fc[N];
+static int32_t ia[N], ib[N], ic[N];
+
+static __attribute__((noinline)) void saxpy(float a)
+{
+    int i;
+
+    for (i = 0; i < N; i++) {
+        fc[i] = a * fa[i] + fb[i];
+    }
+}
+
+static __attribute__((noinline)) void imix(void)
+{
+    int i;
+
+    for (i = 0; i < N; i++) {
+        int32_t t = ia[i] + ib[i];
+        ic[i] = (t > ic[i] ? t : ic[i]) ^ (ia[i] >> 3);
+    }
+}
+
+int main(void)
+{
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i < N; i++) {
+        fa[i] = i * 0.5f;
+        fb[i] = N - i;
+        ia[i] = i * 3;
+        ib[i] = -i;
+    }
+
+    for (i = 0; i < ITERATIONS; i++) {
+        saxpy(1.0f / (i + 1));
+        imix();
+        sum += (uint32_t)fc[i % N] + ic[(i * 7) % N];
+    }
+
+    printf("%08x\n", sum);
+    return 0;
+}
@@ -0,0 +1,40 @@
+/*
+ * TCG benchmark: system calls
+ *
+ * Issues many cheap system calls, measuring the cost of the exits
+ * from the cpu loop and of the linux-user syscall layer.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define ITERATIONS 500000
+
+int main(void)
+{
+    unsigned long sum = 0;
+    char buf[16];
+    unsigned i;
+    int fd;
+
+    fd = open("/dev/zero", O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return 1;
+    }
+
+    for (i = 0; i < ITERATIONS; i++) {
+        if (i & 1) {
+            sum += getppid() != 0;
+        } else {
+            sum += read(fd, buf, sizeof(buf));
+        }
+    }
+    close(fd);
+
+    printf("%lu\n", sum);
+    return 0;
+}
@@ -0,0 +1,214 @@
+/*
+ * Block-status cache tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "block/block.h"
+#include "block/block_int.h"
+#include "sysemu/block-backend.h"
+#include "qapi/error.h"
+#include "qemu/main-loop.h"
+#include "qemu/units.h"
+
+#define TEST_SIZE (1 * MiB)
+
+typedef struct BDRVTestState {
+    /* Everything is data once something was written, zeroes before */
+    bool written;
+    int status_calls;
+
+    /* Make the next block-status query yield after determining its result */
+    bool pause;
+    Coroutine *paused_co;
+} BDRVTestState;
+
+static int coroutine_fn bdrv_test_co_block_status(BlockDriverState *bs,
+                                                  bool want_zero,
+                                                  int64_t offset,
+                                                  int64_t bytes,
+                                                  int64_t *pnum,
+                                                  int64_t *map,
+                                                  BlockDriverState **file)
+{
+    BDRVTestState *s = bs->opaque;
+    int ret = s->written ? BDRV_BLOCK_DATA : BDRV_BLOCK_ZERO;
+
+    s->status_calls++;
+    if (s->pause) {
+        s->pause = false;
+        s->paused_co = qemu_coroutine_self();
+        qemu_coroutine_yield();
+    }
+
+    *pnum = bytes;
+    *map = offset;
+    *file = bs;
+    return ret | BDRV_BLOCK_OFFSET_VALID;
+}
+
+static int coroutine_fn bdrv_test_co_pwritev(BlockDriverState *bs,
+                                             int64_t offset, int64_t bytes,
+                                             QEMUIOVector *qiov,
+                                             BdrvRequestFlags flags)
+{
+    BDRVTestState *s = bs->opaque;
+
+    s->written = true;
+    return 0;
+}
+
+static int64_t coroutine_fn bdrv_test_co_getlength(BlockDriverState *bs)
+{
+    return TEST_SIZE;
+}
+
+static BlockDriver bdrv_test = {
+    .format_name            = "test",
+    .instance_size          = sizeof(BDRVTestState),
+
+    .bdrv_co_block_status   = bdrv_test_co_block_status,
+    .bdrv_co_pwritev        = bdrv_test_co_pwritev,
+    .bdrv_co_getlength      = bdrv_test_co_getlength,
+};
+
+/*
+ * Zero extents are only cached while the parents do not share the WRITE
+ * permission, so do not share it.
+ */
+static BlockBackend *test_blk_new(BlockDriverState **pbs)
+{
+    BlockBackend *blk = blk_new(qemu_get_aio_context(),
+                                BLK_PERM_CONSISTENT_READ | BLK_PERM_WRITE,
+                                BLK_PERM_ALL & ~BLK_PERM_WRITE);
+    BlockDriverState *bs;
+
+    bs = bdrv_new_open_driver(&bdrv_test, "test-node", BDRV_O_RDWR,
+                              &error_abort);
+    blk_insert_bs(blk, bs, &error_abort);
+    bdrv_unref(bs);
+
+    *pbs = bs;
+    return blk;
+}
+
+static int test_block_status(BlockDriverState *bs, int64_t offset)
+{
+    int64_t pnum;
+    int ret;
+
+    ret = bdrv_block_status(bs, offset, TEST_SIZE - offset, &pnum, NULL,
+                            NULL);
+    g_assert_cmpint(ret, >=, 0);
+    g_assert_cmpint(pnum, ==, TEST_SIZE - offset);
+    return ret & (BDRV_BLOCK_DATA | BDRV_BLOCK_ZERO);
+}
+
+static void test_write_invalidates_zero(void)
+{
+    BlockDriverState *bs;
+    BlockBackend *blk = test_blk_new(&bs);
+    BDRVTestState *s = bs->opaque;
+    uint8_t buf[4096] = { 1 };
+
+    g_assert_cmpint(test_block_status(bs, 0), ==, BDRV_BLOCK_ZERO);
+    g_assert_cmpint(s->status_calls, ==, 1);
+
+    /* The hole is served from the cache */
+    g_assert_cmpint(test_block_status(bs, 0), ==, BDRV_BLOCK_ZERO);
+    g_assert_cmpint(s->status_calls, ==, 1);
+
+    /* Writing into it must drop the cached extent */
+    g_assert_cmpint(blk_pwrite(blk, 64 * KiB, sizeof(buf), buf, 0), ==, 0);
+    g_assert_cmpint(test_block_status(bs, 0), ==, BDRV_BLOCK_DATA);
+    g_assert_cmpint(s->status_calls, ==, 2);
+
+    blk_unref(blk);
+}
+
+typedef struct BlockStatusData {
+    BlockDriverState *bs;
+    int ret;
+    bool done;
+} BlockStatusData;
+
+static void coroutine_fn block_status_entry(void *opaque)
+{
+    BlockStatusData *data = opaque;
+    int64_t pnum;
+
+    bdrv_graph_co_rdlock();
+    data->ret = bdrv_co_block_status(data->bs, 0, TEST_SIZE, &pnum, NULL,
+                                     NULL);
+    bdrv_graph_co_rdunlock();
+    data->done = true;
+}
+
+/*
+ * A write that completes while the block status of a hole is being queried
+ * must keep the outdated result of the query out of the cache.
+ */
+static void test_write_during_fill(void)
+{
+    BlockDriverState *bs;
+    BlockBackend *blk = test_blk_new(&bs);
+    BDRVTestState *s = bs->opaque;
+    BlockStatusData data = { .bs = bs };
+    uint8_t buf[4096] = { 1 };
+    Coroutine *co;
+
+    s->pause = true;
+    co = qemu_coroutine_create(block_status_entry, &data);
+    qemu_coroutine_enter(co);
+    g_assert(s->paused_co && !data.done);
+
+    g_assert_cmpint(blk_pwrite(blk, 0, sizeof(buf), buf, 0), ==, 0);
+
+    qemu_coroutine_enter(s->paused_co);
+    g_assert(data.done);
+    g_assert_cmpint(data.ret & BDRV_BLOCK_ZERO, ==, BDRV_BLOCK_ZERO);
+
+    g_assert_cmpint(test_block_status(bs, 0), ==, BDRV_BLOCK_DATA);
+    g_assert_cmpint(s->status_calls, ==, 2);
+
+    blk_unref(blk);
+}
+
+/*
+ * Caching a data extent copies the cache, which must not bring back a zero
+ * extent that a write has invalidated.
+ */
+static void test_fill_after_write(void)
+{
+    BlockDriverState *bs;
+    BlockBackend *blk = test_blk_new(&bs);
+    BDRVTestState *s = bs->opaque;
+    uint8_t buf[4096] = { 1 };
+
+    g_assert_cmpint(test_block_status(bs, 512 * KiB), ==, BDRV_BLOCK_ZERO);
+    g_assert_cmpint(blk_pwrite(blk, 512 * KiB, sizeof(buf), buf, 0), ==, 0);
+    g_assert_cmpint(test_block_status(bs, 0), ==, BDRV_BLOCK_DATA);
+    g_assert_cmpint(test_block_status(bs, 512 * KiB), ==, BDRV_BLOCK_DATA);
+    g_assert_cmpint(s->status_calls, ==, 2);
+
+    blk_unref(blk);
+}
+
+int main(int argc, char **argv)
+{
+    bdrv_init();
+    qemu_init_main_loop(&error_abort);
+
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/block-status-cache/write-invalidates-zero",
+                    test_write_invalidates_zero);
+    g_test_add_func("/block-status-cache/write-during-fill",
+                    test_write_during_fill);
+    g_test_add_func("/block-status-cache/fill-after-write",
+                    test_fill_after_write);
+
+    return g_test_run();
+}
@@ -0,0 +1,75 @@
+/*
+ * QEMU crc32c test
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/crc32c.h"
+
+/*
+ * The hardware version processes three interleaved blocks of 8 KiB, then
+ * three of 256 bytes, then the tail.  Cover a few rounds of each.
+ */
+#define LONG_BLOCKS     (3 * 8192)
+#define SHORT_BLOCKS    (3 * 256)
+#define MAX_LEN         (3 * LONG_BLOCKS + 4 * SHORT_BLOCKS + 64)
+#define MAX_ALIGN       8
+
+static uint8_t buffer[MAX_LEN + MAX_ALIGN];
+
+static const unsigned lengths[] = {
+    0, 1, 7, 8, 9, 15, 16, 63, 64, 255, 256, 257,
+    SHORT_BLOCKS - 1, SHORT_BLOCKS, SHORT_BLOCKS + 1, SHORT_BLOCKS + 7,
+    2 * SHORT_BLOCKS + 13, 4 * SHORT_BLOCKS + 63,
+    LONG_BLOCKS - 1, LONG_BLOCKS, LONG_BLOCKS + 1,
+    LONG_BLOCKS + SHORT_BLOCKS + 5, 2 * LONG_BLOCKS + 3 * SHORT_BLOCKS + 31,
+    3 * LONG_BLOCKS, MAX_LEN - 1, MAX_LEN,
+};
+
+static uint32_t expected[MAX_ALIGN][ARRAY_SIZE(lengths)];
+
+static void test_check(void)
+{
+    static const char check[] = "123456789";
+
+    g_assert_cmphex(crc32c(0xffffffff, (const uint8_t *)check,
+                           sizeof(check) - 1), ==, 0xe3069283);
+}
+
+static void test_lengths(void)
+{
+    bool first = true;
+    unsigned a, i;
+
+    for (i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = g_test_rand_int();
+    }
+
+    /* Every implementation must agree with the first one */
+    do {
+        test_check();
+        for (a = 0; a < MAX_ALIGN; a++) {
+            for (i = 0; i < ARRAY_SIZE(lengths); i++) {
+                uint32_t crc = crc32c(0xffffffff, buffer + a, lengths[i]);
+
+                if (first) {
+                    expected[a][i] = crc;
+                } else {
+                    g_assert_cmphex(crc, ==, expected[a][i]);
+                }
+            }
+        }
+        first = false;
+    } while (test_crc32c_next_accel());
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/crc32c/lengths", test_lengths);
+
+    return g_test_run();
+}
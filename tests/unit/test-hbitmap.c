@@ -899,6 +899,18 @@ static void test_hbitmap_next_x_do(TestHBitmapData *data, int granularity)
 
     hbitmap_set(data->hb, 0, L3);
     test_hbitmap_next_x_check(data, 0);
+
+    /* Single zero bits behind long runs of full words, at various offsets */
+    hbitmap_reset(data->hb, L1 * 3 + 7, 1);
+    hbitmap_reset(data->hb, L1 * 17, 1);
+    hbitmap_reset(data->hb, L2 - 1, 1);
+    test_hbitmap_next_x_check(data, 0);
+    test_hbitmap_next_x_check(data, L1);
+    test_hbitmap_next_x_check(data, L1 * 3 + 8);
+    test_hbitmap_next_x_check(data, L1 * 9 + 1);
+    test_hbitmap_next_x_check(data, L1 * 17 + 1);
+    test_hbitmap_next_x_check_range(data, L1 * 17 + 1, L2 - L1 * 18 - 1);
+    test_hbitmap_next_x_check(data, L2);
 }
 
 static void test_hbitmap_next_x_0(TestHBitmapData *data, const void *unused)
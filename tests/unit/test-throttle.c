@@ -734,6 +734,48 @@ static void test_accounting(void)
                                 (64.0 / 13)));
 }
 
+static void test_reserve(void)
+{
+    int64_t now;
+    uint32_t ops, bytes;
+
+    throttle_config_init(&cfg);
+    cfg.buckets[THROTTLE_BPS_READ].avg = 1000;
+    cfg.buckets[THROTTLE_OPS_READ].avg = 100;
+
+    throttle_init(&ts);
+    throttle_config(&ts, QEMU_CLOCK_VIRTUAL, &cfg);
+    now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+
+    /* without bursts the buckets take a tenth of the average rate */
+    throttle_reserve(&ts, THROTTLE_READ, now, NANOSECONDS_PER_SECOND,
+                     &ops, &bytes);
+    g_assert_cmpuint(ops, ==, 10);
+    g_assert_cmpuint(bytes, ==, 100);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_READ].level, 10));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_READ].level, 100));
+
+    /* the buckets are full now */
+    throttle_reserve(&ts, THROTTLE_READ, now, NANOSECONDS_PER_SECOND,
+                     &ops, &bytes);
+    g_assert_cmpuint(ops, ==, 0);
+    g_assert_cmpuint(bytes, ==, 0);
+
+    throttle_unreserve(&ts, THROTTLE_READ, 10, 100);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_READ].level, 0));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_READ].level, 0));
+
+    /* the time slice caps the reservation */
+    throttle_reserve(&ts, THROTTLE_READ, now, 10 * SCALE_MS, &ops, &bytes);
+    g_assert_cmpuint(ops, ==, 1);
+    g_assert_cmpuint(bytes, ==, 10);
+
+    /* writes are not limited */
+    throttle_reserve(&ts, THROTTLE_WRITE, now, 10 * SCALE_MS, &ops, &bytes);
+    g_assert_cmpuint(ops, ==, UINT32_MAX);
+    g_assert_cmpuint(bytes, ==, UINT32_MAX);
+}
+
 static void test_groups(void)
 {
     ThrottleConfig cfg1, cfg2;
@@ -829,6 +871,7 @@ int main(int argc, char **argv)
                     test_iops_size_is_missing_limit);
     g_test_add_func("/throttle/config_functions",   test_config_functions);
     g_test_add_func("/throttle/accounting",         test_accounting);
+    g_test_add_func("/throttle/reserve",            test_reserve);
     g_test_add_func("/throttle/groups",             test_groups);
     return g_test_run();
 }
@@ -81,14 +81,12 @@ static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size
 
 static void clear_buffer_range(unsigned int idx, size_t len)
 {
-    uint32_t num = 0;
-    while (num < len) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = 0;
-        num++;
-    }
+    size_t first;
+
+    idx %= TRACE_BUF_LEN;
+    first = MIN(len, TRACE_BUF_LEN - idx);
+    memset(&trace_buf[idx], 0, first);
+    memset(trace_buf, 0, len - first);
 }
 /**
  * Read a trace record from the trace buffer
@@ -241,41 +239,51 @@ int trace_record_start(TraceBufferRecord *rec, uint32_t event, size_t datasize)
     return 0;
 }
 
+/*
+ * Copy in and out of the ring buffer with at most two memcpy calls, one
+ * for each side of the wrap-around point.
+ */
 static void read_from_buffer(unsigned int idx, void *dataptr, size_t size)
 {
     uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        data_ptr[x++] = trace_buf[idx++];
-    }
+    size_t first;
+
+    idx %= TRACE_BUF_LEN;
+    first = MIN(size, TRACE_BUF_LEN - idx);
+    memcpy(data_ptr, &trace_buf[idx], first);
+    memcpy(data_ptr + first, trace_buf, size - first);
 }
 
 static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size)
 {
     uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = data_ptr[x++];
-    }
-    return idx; /* most callers wants to know where to write next */
+    size_t first;
+
+    idx %= TRACE_BUF_LEN;
+    first = MIN(size, TRACE_BUF_LEN - idx);
+    memcpy(&trace_buf[idx], data_ptr, first);
+    memcpy(trace_buf, data_ptr + first, size - first);
+
+    /* most callers wants to know where to write next */
+    return (idx + size) % TRACE_BUF_LEN;
 }
 
 void trace_record_finish(TraceBufferRecord *rec)
 {
-    TraceRecord record;
-    read_from_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
+    uint64_t event;
+
+    /* Only the event ID carries the valid flag, leave the rest alone */
+    read_from_buffer(rec->tbuf_idx, &event, sizeof(event));
     smp_wmb(); /* write barrier before marking as valid */
-    record.event |= TRACE_RECORD_VALID;
-    write_to_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
+    event |= TRACE_RECORD_VALID;
+    write_to_buffer(rec->tbuf_idx, &event, sizeof(event));
 
+    /*
+     * Kick the writeout thread once; until it has run, other threads
+     * need not take trace_lock again just to repeat the request.
+     */
     if (((unsigned int)g_atomic_int_get(&trace_idx) - writeout_idx)
-        > TRACE_BUF_FLUSH_THRESHOLD) {
+        > TRACE_BUF_FLUSH_THRESHOLD && !qatomic_read(&trace_available)) {
         flush_trace_file(false);
     }
 }
@@ -31,6 +31,7 @@
 #include "qemu/coroutine.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
+#include "qemu/memfd.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "chardev/char.h"
@@ -522,6 +523,24 @@ win32_pixman_image_destroy(pixman_image_t *image, void *data)
         &error_warn
     );
 }
+#else
+void qemu_displaysurface_set_shmfd(DisplaySurface *surface,
+                                   int fd, uint32_t offset)
+{
+    assert(surface->shmfd == -1);
+
+    surface->shmfd = fd;
+    surface->shmfd_offset = offset;
+}
+
+static void
+memfd_pixman_image_destroy(pixman_image_t *image, void *data)
+{
+    qemu_memfd_free(pixman_image_get_data(image),
+                    pixman_image_get_stride(image) *
+                    pixman_image_get_height(image),
+                    GPOINTER_TO_INT(data));
+}
 #endif
 
 DisplaySurface *qemu_create_displaysurface(int width, int height)
@@ -530,12 +549,20 @@ DisplaySurface *qemu_create_displaysurface(int width, int height)
     void *bits = NULL;
 #ifdef WIN32
     HANDLE handle = NULL;
+#else
+    int fd = -1;
 #endif
 
     trace_displaysurface_create(width, height);
 
 #ifdef WIN32
     bits = qemu_win32_map_alloc(width * height * 4, &handle, &error_abort);
+#else
+    /* Shareable with out-of-process display clients; optional */
+    if (width && height) {
+        bits = qemu_memfd_alloc("displaysurface", width * height * 4, 0,
+                                &fd, NULL);
+    }
 #endif
 
     surface = qemu_create_displaysurface_from(
@@ -547,6 +574,13 @@ DisplaySurface *qemu_create_displaysurface(int width, int height)
 
 #ifdef WIN32
     qemu_displaysurface_win32_set_handle(surface, handle, 0);
+#else
+    if (bits) {
+        pixman_image_set_destroy_function(surface->image,
+                                          memfd_pixman_image_destroy,
+                                          GINT_TO_POINTER(fd));
+        qemu_displaysurface_set_shmfd(surface, fd, 0);
+    }
 #endif
     return surface;
 }
@@ -565,6 +599,8 @@ DisplaySurface *qemu_create_displaysurface_from(int width, int height,
 #ifdef WIN32
     pixman_image_set_destroy_function(surface->image,
                                       win32_pixman_image_destroy, surface);
+#else
+    surface->shmfd = -1;
 #endif
 
     return surface;
@@ -576,6 +612,9 @@ DisplaySurface *qemu_create_displaysurface_pixman(pixman_image_t *image)
 
     trace_displaysurface_create_pixman(surface);
     surface->image = pixman_image_ref(image);
+#ifndef WIN32
+    surface->shmfd = -1;
+#endif
 
     return surface;
 }
@@ -51,22 +51,28 @@
  * its own output buffer.
  * When the encoding job is done, the worker thread will hold the output lock
  * and copy its output buffer in vs->output.
+ *
+ * Several worker threads take jobs from the queue.  The jobs of one client
+ * are still encoded one at a time and in order, because the encoders keep
+ * per-client state (e.g. zlib streams), so clients are encoded in parallel
+ * with each other.  Clients of the same display are serialized by the
+ * VncDisplay lock.
  */
 
+#define VNC_WORKER_THREADS 4
+
 struct VncJobQueue {
     QemuCond cond;
     QemuMutex mutex;
-    QemuThread thread;
+    QemuThread threads[VNC_WORKER_THREADS];
+    int nr_threads;
     bool exit;
     QTAILQ_HEAD(, VncJob) jobs;
 };
 
 typedef struct VncJobQueue VncJobQueue;
 
-/*
- * We use a single global queue, but most of the functions are
- * already reentrant, so we can easily add more than one encoding thread
- */
+/* We use a single global queue, shared by all the encoding threads */
 static VncJobQueue *queue;
 
 static void vnc_lock_queue(VncJobQueue *queue)
@@ -235,6 +241,32 @@ static bool vnc_worker_clamp_rect(VncState *vs, VncJob *job, VncRect *rect)
     return false;
 }
 
+/*
+ * Return the oldest job whose client has no earlier job in the queue,
+ * i.e. that is not being encoded by another thread and that can be
+ * encoded without reordering the updates of its client.
+ */
+static VncJob *vnc_next_job_locked(VncJobQueue *queue)
+{
+    VncJob *job, *prev;
+
+    QTAILQ_FOREACH(job, &queue->jobs, next) {
+        if (job->running) {
+            continue;
+        }
+        for (prev = QTAILQ_FIRST(&queue->jobs); prev != job;
+             prev = QTAILQ_NEXT(prev, next)) {
+            if (prev->vs == job->vs) {
+                break;
+            }
+        }
+        if (prev == job) {
+            return job;
+        }
+    }
+    return NULL;
+}
+
 static int vnc_worker_thread_loop(VncJobQueue *queue)
 {
     VncJob *job;
@@ -244,11 +276,13 @@ static int vnc_worker_thread_loop(VncJobQueue *queue)
     int saved_offset;
 
     vnc_lock_queue(queue);
-    while (QTAILQ_EMPTY(&queue->jobs) && !queue->exit) {
+    while (!(job = vnc_next_job_locked(queue)) && !queue->exit) {
         qemu_cond_wait(&queue->cond, &queue->mutex);
     }
     /* Here job can only be NULL if queue->exit is true */
-    job = QTAILQ_FIRST(&queue->jobs);
+    if (job) {
+        job->running = true;
+    }
     vnc_unlock_queue(queue);
 
     if (queue->exit) {
@@ -347,6 +381,14 @@ static VncJobQueue *vnc_queue_init(void)
 
 static void vnc_queue_clear(VncJobQueue *q)
 {
+    vnc_lock_queue(q);
+    if (--q->nr_threads) {
+        /* Not the last worker */
+        vnc_unlock_queue(q);
+        return;
+    }
+    vnc_unlock_queue(q);
+
     qemu_cond_destroy(&queue->cond);
     qemu_mutex_destroy(&queue->mutex);
     g_free(q);
@@ -357,8 +399,6 @@ static void *vnc_worker_thread(void *arg)
 {
     VncJobQueue *queue = arg;
 
-    qemu_thread_get_self(&queue->thread);
-
     while (!vnc_worker_thread_loop(queue)) ;
     vnc_queue_clear(queue);
     return NULL;
@@ -372,12 +412,16 @@ static bool vnc_worker_thread_running(void)
 void vnc_start_worker_thread(void)
 {
     VncJobQueue *q;
+    int i;
 
     if (vnc_worker_thread_running())
         return;
 
     q = vnc_queue_init();
-    qemu_thread_create(&q->thread, "vnc_worker", vnc_worker_thread, q,
-                       QEMU_THREAD_DETACHED);
+    q->nr_threads = VNC_WORKER_THREADS;
     queue = q; /* Set global queue */
+    for (i = 0; i < VNC_WORKER_THREADS; i++) {
+        qemu_thread_create(&q->threads[i], "vnc_worker", vnc_worker_thread,
+                           q, QEMU_THREAD_DETACHED);
+    }
 }
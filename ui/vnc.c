@@ -3094,7 +3094,9 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
     int height = MIN(pixman_image_get_height(vd->guest.fb),
                      pixman_image_get_height(vd->server));
     int cmp_bytes, server_stride, line_bytes, guest_ll, guest_stride, y = 0;
+    int nr_bits = DIV_ROUND_UP(width, VNC_DIRTY_PIXELS_PER_BIT);
     uint8_t *guest_row0 = NULL, *server_row0;
+    uint8_t *guest_row, *server_row;
     VncState *vs;
     int has_dirty = 0;
     pixman_image_t *tmpbuf = NULL;
@@ -3143,38 +3145,59 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
         y = offset / VNC_DIRTY_BPL(&vd->guest);
         x = offset % VNC_DIRTY_BPL(&vd->guest);
 
-        server_ptr = server_row0 + y * server_stride + x * cmp_bytes;
+        server_row = server_row0 + y * server_stride;
 
         if (vd->guest.format != VNC_SERVER_FB_FORMAT) {
             qemu_pixman_linebuf_fill(tmpbuf, vd->guest.fb, width, 0, y);
-            guest_ptr = (uint8_t *)pixman_image_get_data(tmpbuf);
+            guest_row = (uint8_t *)pixman_image_get_data(tmpbuf);
         } else {
-            guest_ptr = guest_row0 + y * guest_stride;
+            guest_row = guest_row0 + y * guest_stride;
         }
-        guest_ptr += x * cmp_bytes;
 
-        for (; x < DIV_ROUND_UP(width, VNC_DIRTY_PIXELS_PER_BIT);
-             x++, guest_ptr += cmp_bytes, server_ptr += cmp_bytes) {
-            int _cmp_bytes = cmp_bytes;
-            if (!test_and_clear_bit(x, vd->guest.dirty[y])) {
-                continue;
-            }
-            if ((x + 1) * cmp_bytes > line_bytes) {
-                _cmp_bytes = line_bytes - x * cmp_bytes;
-            }
-            assert(_cmp_bytes >= 0);
-            if (memcmp(server_ptr, guest_ptr, _cmp_bytes) == 0) {
+        /*
+         * Compare runs of up to VNC_DIRTY_CMP_RUN dirty chunks with a
+         * single memcmp first.  Most of the area the guest reports as
+         * dirty is usually unchanged, so this avoids comparing it one
+         * small chunk at a time.
+         */
+        while ((x = find_next_bit(vd->guest.dirty[y], nr_bits, x)) <
+               nr_bits) {
+            int end = find_next_zero_bit(vd->guest.dirty[y], nr_bits, x);
+            int run_bytes;
+
+            end = MIN(end, x + VNC_DIRTY_CMP_RUN);
+            bitmap_clear(vd->guest.dirty[y], x, end - x);
+
+            run_bytes = MIN(end * cmp_bytes, line_bytes) - x * cmp_bytes;
+            if (run_bytes <= 0 ||
+                memcmp(server_row + x * cmp_bytes, guest_row + x * cmp_bytes,
+                       run_bytes) == 0) {
+                x = end;
                 continue;
             }
-            memcpy(server_ptr, guest_ptr, _cmp_bytes);
-            if (!vd->non_adaptive) {
-                vnc_rect_updated(vd, x * VNC_DIRTY_PIXELS_PER_BIT,
-                                 y, &tv);
-            }
-            QTAILQ_FOREACH(vs, &vd->clients, next) {
-                set_bit(x, vs->dirty[y]);
+
+            for (; x < end; x++) {
+                int _cmp_bytes = cmp_bytes;
+
+                guest_ptr = guest_row + x * cmp_bytes;
+                server_ptr = server_row + x * cmp_bytes;
+                if ((x + 1) * cmp_bytes > line_bytes) {
+                    _cmp_bytes = line_bytes - x * cmp_bytes;
+                }
+                assert(_cmp_bytes >= 0);
+                if (memcmp(server_ptr, guest_ptr, _cmp_bytes) == 0) {
+                    continue;
+                }
+                memcpy(server_ptr, guest_ptr, _cmp_bytes);
+                if (!vd->non_adaptive) {
+                    vnc_rect_updated(vd, x * VNC_DIRTY_PIXELS_PER_BIT,
+                                     y, &tv);
+                }
+                QTAILQ_FOREACH(vs, &vd->clients, next) {
+                    set_bit(x, vs->dirty[y]);
+                }
+                has_dirty++;
             }
-            has_dirty++;
         }
 
         y++;
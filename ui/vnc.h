@@ -79,6 +79,9 @@ typedef void VncSendHextileTile(VncState *vs,
  * by one bit in the dirty bitmap, should be a power of 2 */
 #define VNC_DIRTY_PIXELS_PER_BIT 16
 
+/* Maximum number of dirty bits whose pixels are compared in one go */
+#define VNC_DIRTY_CMP_RUN 16
+
 /* VNC_MAX_WIDTH must be a multiple of VNC_DIRTY_PIXELS_PER_BIT. */
 
 #define VNC_MAX_WIDTH ROUND_UP(2560, VNC_DIRTY_PIXELS_PER_BIT)
@@ -249,6 +252,8 @@ struct VncRectEntry
 struct VncJob
 {
     VncState *vs;
+    /* A worker thread is encoding this job */
+    bool running;
 
     QLIST_HEAD(, VncRectEntry) rectangles;
     QTAILQ_ENTRY(VncJob) next;
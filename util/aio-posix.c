@@ -21,12 +21,16 @@
 #include "qemu/rcu_queue.h"
 #include "qemu/sockets.h"
 #include "qemu/cutils.h"
+#include "qemu/thread-stats.h"
 #include "trace.h"
 #include "aio-posix.h"
 
 /* Stop userspace polling on a handler if it isn't active for some time */
 #define POLL_IDLE_INTERVAL_NS (7 * NANOSECONDS_PER_SECOND)
 
+/* Accounting window for AioContext::poll_cpu_budget */
+#define POLL_BUDGET_WINDOW_NS (100 * SCALE_MS)
+
 bool aio_poll_disabled(AioContext *ctx)
 {
     return qatomic_read(&ctx->poll_disable_cnt);
@@ -548,6 +552,12 @@ static bool run_poll_handlers(AioContext *ctx, AioHandlerList *ready_list,
         assert(!(max_ns && progress));
     } while (elapsed_time < max_ns && !ctx->fdmon_ops->need_wait(ctx));
 
+    if (progress) {
+        qemu_thread_stat_add(QEMU_STAT_AIO_POLL_HITS, 1);
+    }
+
+    ctx->poll_budget_used += elapsed_time;
+
     if (remove_idle_poll_handlers(ctx, ready_list,
                                   start_time + elapsed_time)) {
         *timeout = 0;
@@ -565,6 +575,31 @@ static bool run_poll_handlers(AioContext *ctx, AioHandlerList *ready_list,
     return progress;
 }
 
+/*
+ * Returns how long polling may still run in the current budget window, or
+ * -1 if there is no limit.
+ */
+static int64_t poll_budget_remaining(AioContext *ctx)
+{
+    int64_t now, budget;
+
+    if (!ctx->poll_cpu_budget || ctx->poll_cpu_budget >= 100) {
+        return -1;
+    }
+
+    now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    if (now - ctx->poll_budget_start >= POLL_BUDGET_WINDOW_NS) {
+        ctx->poll_budget_start = now;
+        ctx->poll_budget_used = 0;
+    }
+
+    budget = POLL_BUDGET_WINDOW_NS / 100 * ctx->poll_cpu_budget;
+    if (ctx->poll_budget_used >= budget) {
+        return 0;
+    }
+    return budget - ctx->poll_budget_used;
+}
+
 /* try_poll_mode:
  * @ctx: the AioContext
  * @ready_list: list to add handlers that need to be run
@@ -585,6 +620,14 @@ static bool try_poll_mode(AioContext *ctx, AioHandlerList *ready_list,
     }
 
     max_ns = qemu_soonest_timeout(*timeout, ctx->poll_ns);
+    if (max_ns) {
+        int64_t remaining = poll_budget_remaining(ctx);
+
+        if (remaining == 0) {
+            trace_poll_budget_exhausted(ctx, ctx->poll_budget_used);
+        }
+        max_ns = qemu_soonest_timeout(max_ns, remaining);
+    }
     if (max_ns && !ctx->fdmon_ops->need_wait(ctx)) {
         /*
          * Enable poll mode. It pairs with the poll_set_started() in
@@ -777,6 +820,15 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
     aio_notify(ctx);
 }
 
+void aio_context_set_poll_cpu_budget(AioContext *ctx, int64_t budget)
+{
+    ctx->poll_cpu_budget = budget;
+    ctx->poll_budget_start = 0;
+    ctx->poll_budget_used = 0;
+
+    aio_notify(ctx);
+}
+
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch,
                                 Error **errp)
 {
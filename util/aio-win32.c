@@ -438,6 +438,10 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
     }
 }
 
+void aio_context_set_poll_cpu_budget(AioContext *ctx, int64_t budget)
+{
+}
+
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch,
                                 Error **errp)
 {
@@ -34,6 +34,7 @@
 #include "block/raw-aio.h"
 #include "qemu/coroutine_int.h"
 #include "qemu/coroutine-tls.h"
+#include "qemu/thread-context.h"
 #include "sysemu/cpu-timers.h"
 #include "trace.h"
 
@@ -367,6 +368,7 @@ aio_ctx_finalize(GSource     *source)
     unsigned flags;
 
     thread_pool_free(ctx->thread_pool);
+    aio_context_set_thread_pool_context(ctx, NULL);
 
 #ifdef CONFIG_LINUX_AIO
     if (ctx->linux_aio) {
@@ -466,7 +468,7 @@ LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
         return ctx->linux_io_uring;
     }
 
-    ctx->linux_io_uring = luring_init(errp);
+    ctx->linux_io_uring = luring_init(0, errp);
     if (!ctx->linux_io_uring) {
         return NULL;
     }
@@ -612,6 +614,7 @@ AioContext *aio_context_new(Error **errp)
     ctx->poll_max_ns = 0;
     ctx->poll_grow = 0;
     ctx->poll_shrink = 0;
+    ctx->poll_cpu_budget = 0;
 
     ctx->aio_max_batch = 0;
 
@@ -770,3 +773,22 @@ void aio_context_set_thread_pool_params(AioContext *ctx, int64_t min,
         thread_pool_update_params(ctx->thread_pool, ctx);
     }
 }
+
+void aio_context_set_thread_pool_context(AioContext *ctx, ThreadContext *tc)
+{
+    if (ctx->thread_pool_context == tc) {
+        return;
+    }
+
+    if (tc) {
+        object_ref(OBJECT(tc));
+    }
+    if (ctx->thread_pool_context) {
+        object_unref(OBJECT(ctx->thread_pool_context));
+    }
+    ctx->thread_pool_context = tc;
+
+    if (ctx->thread_pool) {
+        thread_pool_update_params(ctx->thread_pool, ctx);
+    }
+}
@@ -264,6 +264,58 @@ static bool select_accel_fn(const void *buf, size_t len)
     return buffer_zero_int(buf, len);
 }
 
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+
+/* Like buffer_zero_sse2, this requires len >= 64.  */
+static bool buffer_zero_neon(const void *buf, size_t len)
+{
+    uint64x2_t t = vld1q_u64(buf);
+    const uint64x2_t *p = (uint64x2_t *)(((uintptr_t)buf + 5 * 16) & -16);
+    const uint64x2_t *e = (uint64x2_t *)(((uintptr_t)buf + len) & -16);
+
+    /* Loop over 16-byte aligned blocks of 64.  */
+    while (likely(p <= e)) {
+        __builtin_prefetch(p);
+        if (unlikely(vmaxvq_u32(vreinterpretq_u32_u64(t)) != 0)) {
+            return false;
+        }
+        t = p[-4] | p[-3] | p[-2] | p[-1];
+        p += 4;
+    }
+
+    /* Finish the aligned tail.  */
+    t |= e[-3];
+    t |= e[-2];
+    t |= e[-1];
+
+    /* Finish the unaligned tail.  */
+    t |= vld1q_u64(buf + len - 16);
+
+    return vmaxvq_u32(vreinterpretq_u32_u64(t)) == 0;
+}
+
+/* Advanced SIMD is part of the base architecture, so no cpuinfo needed.  */
+static bool (*buffer_accel)(const void *, size_t) = buffer_zero_neon;
+
+bool test_buffer_is_zero_next_accel(void)
+{
+    /* Test the integer version in the second round.  */
+    if (buffer_accel == buffer_zero_neon) {
+        buffer_accel = buffer_zero_int;
+        return true;
+    }
+    return false;
+}
+
+static bool select_accel_fn(const void *buf, size_t len)
+{
+    if (likely(len >= 64)) {
+        return buffer_accel(buf, len);
+    }
+    return buffer_zero_int(buf, len);
+}
+
 #else
 #define select_accel_fn  buffer_zero_int
 bool test_buffer_is_zero_next_accel(void)
@@ -272,15 +324,8 @@ bool test_buffer_is_zero_next_accel(void)
 }
 #endif
 
-/*
- * Checks if a buffer is all zeroes
- */
-bool buffer_is_zero(const void *buf, size_t len)
+bool buffer_is_zero_ool(const void *buf, size_t len)
 {
-    if (unlikely(len == 0)) {
-        return true;
-    }
-
     /* Fetch the beginning of the buffer while we select the accelerator.  */
     __builtin_prefetch(buf);
 
@@ -26,8 +26,30 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bswap.h"
 #include "qemu/crc32c.h"
 
+#if defined(__x86_64__) && defined(CONFIG_AVX2_OPT)
+/*
+ * The crc32 instruction is part of SSE4.2.  CONFIG_AVX2_OPT tells us
+ * that the compiler supports the target attribute and <immintrin.h>.
+ */
+#include <immintrin.h>
+#include "host/cpuinfo.h"
+#define CRC32C_HW
+#define CRC32C_HW_ATTR          __attribute__((target("sse4.2")))
+#define crc32c_hw_u8(c, v)      _mm_crc32_u8(c, v)
+#define crc32c_hw_u64(c, v)     ((uint32_t)_mm_crc32_u64(c, v))
+#define crc32c_hw_available()   (cpuinfo_init() & CPUINFO_SSE42)
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define CRC32C_HW
+#define CRC32C_HW_ATTR
+#define crc32c_hw_u8(c, v)      __crc32cb(c, v)
+#define crc32c_hw_u64(c, v)     __crc32cd(c, v)
+#define crc32c_hw_available()   true
+#endif
+
 /*
  * This is the CRC-32C table
  * Generated with:
@@ -105,7 +127,8 @@ static const uint32_t crc32c_table[256] = {
 };
 
 
-uint32_t crc32c(uint32_t crc, const uint8_t *data, unsigned int length)
+static uint32_t crc32c_sw(uint32_t crc, const uint8_t *data,
+                          unsigned int length)
 {
     while (length--) {
         crc = crc32c_table[(crc ^ *data++) & 0xFFL] ^ (crc >> 8);
@@ -113,6 +136,147 @@ uint32_t crc32c(uint32_t crc, const uint8_t *data, unsigned int length)
     return crc^0xffffffff;
 }
 
+#ifdef CRC32C_HW
+/*
+ * The crc32 instruction has a latency of several cycles but can start
+ * one operation per cycle, so large buffers are split into three
+ * blocks whose CRCs are computed in parallel.  The CRC of the
+ * concatenation is then obtained by running the CRC of the first block
+ * over as many zero bytes as the second is long and xoring in the CRC
+ * of the second, and likewise for the third.  Running a CRC over a
+ * fixed number of zero bytes is a linear operator, which is applied
+ * with four table lookups.
+ */
+#define CRC32C_POLY     0x82F63B78u     /* reflected 0x1EDC6F41 */
+#define CRC32C_LONG     8192
+#define CRC32C_SHORT    256
+
+static uint32_t crc32c_long[4][256];
+static uint32_t crc32c_short[4][256];
+
+static uint32_t gf2_matrix_times(const uint32_t *mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+
+    for (; vec; vec >>= 1, mat++) {
+        if (vec & 1) {
+            sum ^= *mat;
+        }
+    }
+    return sum;
+}
+
+static void gf2_matrix_square(uint32_t *square, const uint32_t *mat)
+{
+    int n;
+
+    for (n = 0; n < 32; n++) {
+        square[n] = gf2_matrix_times(mat, mat[n]);
+    }
+}
+
+/* Build the tables that run a CRC over @len zero bytes, a power of 2. */
+static void crc32c_zeros(uint32_t zeros[4][256], size_t len)
+{
+    uint32_t op[32], tmp[32];
+    uint32_t *odd = op, *even = tmp, *swap;
+    int n;
+
+    /* One zero bit, doubled to one zero byte, then up to @len bytes */
+    odd[0] = CRC32C_POLY;
+    for (n = 1; n < 32; n++) {
+        odd[n] = 1u << (n - 1);
+    }
+    for (len *= 8; len > 1; len >>= 1) {
+        gf2_matrix_square(even, odd);
+        swap = odd;
+        odd = even;
+        even = swap;
+    }
+
+    for (n = 0; n < 256; n++) {
+        zeros[0][n] = gf2_matrix_times(odd, n);
+        zeros[1][n] = gf2_matrix_times(odd, n << 8);
+        zeros[2][n] = gf2_matrix_times(odd, n << 16);
+        zeros[3][n] = gf2_matrix_times(odd, n << 24);
+    }
+}
+
+static inline uint32_t crc32c_shift(uint32_t zeros[4][256], uint32_t crc)
+{
+    return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+           zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+#define CRC32C_HW_BLOCKS(crc0, data, length, size, zeros)               \
+    while (length >= 3 * size) {                                        \
+        const uint8_t *end = data + size;                               \
+        uint32_t crc1 = 0, crc2 = 0;                                    \
+        do {                                                            \
+            crc0 = crc32c_hw_u64(crc0, ldq_le_p(data));                 \
+            crc1 = crc32c_hw_u64(crc1, ldq_le_p(data + size));          \
+            crc2 = crc32c_hw_u64(crc2, ldq_le_p(data + 2 * size));      \
+            data += 8;                                                  \
+        } while (data < end);                                           \
+        crc0 = crc32c_shift(zeros, crc0) ^ crc1;                        \
+        crc0 = crc32c_shift(zeros, crc0) ^ crc2;                        \
+        data += 2 * size;                                               \
+        length -= 3 * size;                                             \
+    }
+
+static uint32_t CRC32C_HW_ATTR
+crc32c_hw(uint32_t crc, const uint8_t *data, unsigned int length)
+{
+    while (length && ((uintptr_t)data & 7)) {
+        crc = crc32c_hw_u8(crc, *data++);
+        length--;
+    }
+
+    CRC32C_HW_BLOCKS(crc, data, length, CRC32C_LONG, crc32c_long);
+    CRC32C_HW_BLOCKS(crc, data, length, CRC32C_SHORT, crc32c_short);
+
+    for (; length >= 8; length -= 8, data += 8) {
+        crc = crc32c_hw_u64(crc, ldq_le_p(data));
+    }
+    while (length--) {
+        crc = crc32c_hw_u8(crc, *data++);
+    }
+    return crc ^ 0xffffffff;
+}
+#endif
+
+static uint32_t (*crc32c_accel)(uint32_t, const uint8_t *, unsigned int) =
+    crc32c_sw;
+
+static void __attribute__((constructor)) crc32c_init(void)
+{
+#ifdef CRC32C_HW
+    if (crc32c_hw_available()) {
+        crc32c_zeros(crc32c_long, CRC32C_LONG);
+        crc32c_zeros(crc32c_short, CRC32C_SHORT);
+        crc32c_accel = crc32c_hw;
+    }
+#endif
+}
+
+/*
+ * Switch to the next implementation, for testing.  Returns false once
+ * the table-driven one, which is always tested last, is in use.
+ */
+bool test_crc32c_next_accel(void)
+{
+    if (crc32c_accel == crc32c_sw) {
+        return false;
+    }
+    crc32c_accel = crc32c_sw;
+    return true;
+}
+
+uint32_t crc32c(uint32_t crc, const uint8_t *data, unsigned int length)
+{
+    return crc32c_accel(crc, data, length);
+}
+
 uint32_t iov_crc32c(uint32_t crc, const struct iovec *iov, size_t iov_cnt)
 {
     while (iov_cnt--) {
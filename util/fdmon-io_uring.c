@@ -25,7 +25,11 @@
  *
  * File descriptor monitoring is implemented using the following operations:
  *
- * 1. IORING_OP_POLL_ADD - adds a file descriptor to be monitored.
+ * 1. IORING_OP_POLL_ADD - adds a file descriptor to be monitored.  When the
+ *    kernel supports it, the poll is multishot and level-triggered so that it
+ *    stays armed after completing and does not need to be resubmitted each
+ *    time the file descriptor becomes ready.  Completions with
+ *    IORING_CQE_F_MORE set mean that the poll is still armed.
  * 2. IORING_OP_POLL_REMOVE - removes a file descriptor being monitored.  When
  *    the poll mask changes for a file descriptor it is first removed and then
  *    re-added with the new poll mask, so this operation is also used as part
@@ -171,7 +175,16 @@ static void add_poll_add_sqe(AioContext *ctx, AioHandler *node)
     struct io_uring_sqe *sqe = get_sqe(ctx);
     int events = poll_events_from_pfd(node->pfd.events);
 
+#ifdef HAVE_IO_URING_PREP_POLL_MULTISHOT
+    if (ctx->fdmon_io_uring_multishot) {
+        io_uring_prep_poll_multishot(sqe, node->pfd.fd, events);
+        sqe->len |= IORING_POLL_ADD_LEVEL;
+    } else {
+        io_uring_prep_poll_add(sqe, node->pfd.fd, events);
+    }
+#else
     io_uring_prep_poll_add(sqe, node->pfd.fd, events);
+#endif
     io_uring_sqe_set_data(sqe, node);
 }
 
@@ -227,6 +240,7 @@ static bool process_cqe(AioContext *ctx,
                         struct io_uring_cqe *cqe)
 {
     AioHandler *node = io_uring_cqe_get_data(cqe);
+    bool armed = cqe->flags & IORING_CQE_F_MORE;
     unsigned flags;
 
     /* poll_timeout and poll_remove have a zero user_data field */
@@ -234,21 +248,34 @@ static bool process_cqe(AioContext *ctx,
         return false;
     }
 
+    /*
+     * A multishot IORING_OP_POLL_ADD that is still armed will complete again,
+     * at the latest with -ECANCELED once IORING_OP_POLL_REMOVE is processed.
+     */
+    if (armed && (qatomic_read(&node->flags) & FDMON_IO_URING_REMOVE)) {
+        return false;
+    }
+
     /*
      * Deletion can only happen when IORING_OP_POLL_ADD completes.  If we race
      * with enqueue() here then we can safely clear the FDMON_IO_URING_REMOVE
      * bit before IORING_OP_POLL_REMOVE is submitted.
      */
-    flags = qatomic_fetch_and(&node->flags, ~FDMON_IO_URING_REMOVE);
-    if (flags & FDMON_IO_URING_REMOVE) {
-        QLIST_INSERT_HEAD_RCU(&ctx->deleted_aio_handlers, node, node_deleted);
-        return false;
+    if (!armed) {
+        flags = qatomic_fetch_and(&node->flags, ~FDMON_IO_URING_REMOVE);
+        if (flags & FDMON_IO_URING_REMOVE) {
+            QLIST_INSERT_HEAD_RCU(&ctx->deleted_aio_handlers, node,
+                                  node_deleted);
+            return false;
+        }
     }
 
     aio_add_ready_handler(ready_list, node, pfd_events_from_poll(cqe->res));
 
-    /* IORING_OP_POLL_ADD is one-shot so we must re-arm it */
-    add_poll_add_sqe(ctx, node);
+    /* One-shot IORING_OP_POLL_ADD must be re-armed */
+    if (!armed) {
+        add_poll_add_sqe(ctx, node);
+    }
     return true;
 }
 
@@ -321,6 +348,73 @@ static const FDMonOps fdmon_io_uring_ops = {
     .need_wait = fdmon_io_uring_need_wait,
 };
 
+#ifdef HAVE_IO_URING_PREP_POLL_MULTISHOT
+/*
+ * Check whether the kernel supports level-triggered multishot polls by
+ * polling a pipe that is already readable.  Called before the ring is used
+ * for anything else, so all cqes seen here belong to the probe.
+ *
+ * Returns 1 if supported, 0 if not, and -1 if a probe cqe may still be
+ * pending so that the ring must not be used.
+ */
+static int fdmon_io_uring_probe_multishot(struct io_uring *ring)
+{
+    static char probe_tag;
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    bool supported = false;
+    bool done = false;
+    int fds[2];
+
+    if (!g_unix_open_pipe(fds, FD_CLOEXEC, NULL)) {
+        return 0;
+    }
+    if (write(fds[1], "", 1) != 1) {
+        done = true;
+        goto out;
+    }
+
+    sqe = io_uring_get_sqe(ring);
+    io_uring_prep_poll_multishot(sqe, fds[0], POLLIN);
+    sqe->len |= IORING_POLL_ADD_LEVEL;
+    io_uring_sqe_set_data(sqe, &probe_tag);
+
+    sqe = io_uring_get_sqe(ring);
+#ifdef LIBURING_HAVE_DATA64
+    io_uring_prep_poll_remove(sqe, (__u64)(uintptr_t)&probe_tag);
+#else
+    io_uring_prep_poll_remove(sqe, &probe_tag);
+#endif
+    io_uring_sqe_set_data(sqe, NULL);
+
+    if (io_uring_submit(ring) != 2) {
+        goto out;
+    }
+
+    /* Wait until the poll has completed for good */
+    while (!done) {
+        if (io_uring_wait_cqe(ring, &cqe) < 0) {
+            break;
+        }
+        if (io_uring_cqe_get_data(cqe) == &probe_tag) {
+            if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_MORE)) {
+                supported = true;
+            }
+            done = !(cqe->flags & IORING_CQE_F_MORE);
+        }
+        io_uring_cqe_seen(ring, cqe);
+    }
+
+out:
+    close(fds[0]);
+    close(fds[1]);
+    if (!done) {
+        return -1;
+    }
+    return supported;
+}
+#endif
+
 bool fdmon_io_uring_setup(AioContext *ctx)
 {
     int ret;
@@ -331,6 +425,14 @@ bool fdmon_io_uring_setup(AioContext *ctx)
     }
 
     QSLIST_INIT(&ctx->submit_list);
+#ifdef HAVE_IO_URING_PREP_POLL_MULTISHOT
+    ret = fdmon_io_uring_probe_multishot(&ctx->fdmon_io_uring);
+    if (ret < 0) {
+        io_uring_queue_exit(&ctx->fdmon_io_uring);
+        return false;
+    }
+    ctx->fdmon_io_uring_multishot = ret;
+#endif
     ctx->fdmon_ops = &fdmon_io_uring_ops;
     return true;
 }
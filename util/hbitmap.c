@@ -217,6 +217,45 @@ int64_t hbitmap_next_dirty(const HBitmap *hb, int64_t start, int64_t count)
     return MAX(start, first_dirty_off);
 }
 
+#define HBITMAP_SKIP_BLOCK 8
+
+/*
+ * Return the index of the first word in @words[@pos, @sz) that is not all
+ * ones, or @sz if there is none.  Large fully dirty areas are common (for
+ * example right after a full backup is started), so check a block of words
+ * at a time; the inner loop has no early exit and the compiler can turn it
+ * into vector instructions.
+ */
+static size_t hbitmap_skip_ones(const unsigned long *words, size_t pos,
+                                size_t sz)
+{
+    while (pos < sz && (pos & (HBITMAP_SKIP_BLOCK - 1))) {
+        if (words[pos] != (unsigned long)-1) {
+            return pos;
+        }
+        pos++;
+    }
+
+    while (sz - pos >= HBITMAP_SKIP_BLOCK) {
+        unsigned long acc = (unsigned long)-1;
+        int i;
+
+        for (i = 0; i < HBITMAP_SKIP_BLOCK; i++) {
+            acc &= words[pos + i];
+        }
+        if (acc != (unsigned long)-1) {
+            break;
+        }
+        pos += HBITMAP_SKIP_BLOCK;
+    }
+
+    while (pos < sz && words[pos] == (unsigned long)-1) {
+        pos++;
+    }
+
+    return pos;
+}
+
 int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
 {
     size_t pos = (start >> hb->granularity) >> BITS_PER_LEVEL;
@@ -245,10 +284,7 @@ int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
     assert((start >> hb->granularity) < hb->size);
 
     if (cur == (unsigned long)-1) {
-        do {
-            pos++;
-        } while (pos < sz && last_lev[pos] == (unsigned long)-1);
-
+        pos = hbitmap_skip_ones(last_lev, pos + 1, sz);
         if (pos >= sz) {
             return -1;
         }
@@ -21,11 +21,27 @@
 #include "qemu/sockets.h"
 #include "qemu/cutils.h"
 
+/*
+ * Most callers pass a single element, or access data that lies within
+ * the first one (e.g. a packet header), so check for that up front.
+ */
+static inline bool iov_in_first(const struct iovec *iov, unsigned int iov_cnt,
+                                size_t offset, size_t bytes)
+{
+    return likely(iov_cnt) && offset < iov[0].iov_len &&
+           bytes <= iov[0].iov_len - offset;
+}
+
 size_t iov_from_buf_full(const struct iovec *iov, unsigned int iov_cnt,
                          size_t offset, const void *buf, size_t bytes)
 {
     size_t done;
     unsigned int i;
+
+    if (iov_in_first(iov, iov_cnt, offset, bytes)) {
+        memcpy(iov[0].iov_base + offset, buf, bytes);
+        return bytes;
+    }
     for (i = 0, done = 0; (offset || done < bytes) && i < iov_cnt; i++) {
         if (offset < iov[i].iov_len) {
             size_t len = MIN(iov[i].iov_len - offset, bytes - done);
@@ -45,6 +61,11 @@ size_t iov_to_buf_full(const struct iovec *iov, const unsigned int iov_cnt,
 {
     size_t done;
     unsigned int i;
+
+    if (iov_in_first(iov, iov_cnt, offset, bytes)) {
+        memcpy(buf, iov[0].iov_base + offset, bytes);
+        return bytes;
+    }
     for (i = 0, done = 0; (offset || done < bytes) && i < iov_cnt; i++) {
         if (offset < iov[i].iov_len) {
             size_t len = MIN(iov[i].iov_len - offset, bytes - done);
@@ -64,6 +85,11 @@ size_t iov_memset(const struct iovec *iov, const unsigned int iov_cnt,
 {
     size_t done;
     unsigned int i;
+
+    if (iov_in_first(iov, iov_cnt, offset, bytes)) {
+        memset(iov[0].iov_base + offset, fillc, bytes);
+        return bytes;
+    }
     for (i = 0, done = 0; (offset || done < bytes) && i < iov_cnt; i++) {
         if (offset < iov[i].iov_len) {
             size_t len = MIN(iov[i].iov_len - offset, bytes - done);
@@ -199,6 +199,8 @@ static void main_loop_update_params(EventLoopBase *base, Error **errp)
 
     aio_context_set_thread_pool_params(qemu_aio_context, base->thread_pool_min,
                                        base->thread_pool_max, errp);
+    aio_context_set_thread_pool_context(qemu_aio_context,
+                                        base->thread_pool_context);
 }
 
 MainLoop *mloop;
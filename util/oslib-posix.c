@@ -420,7 +420,14 @@ static int touch_all_pages(char *area, size_t hpagesize, size_t numpages,
     MemsetContext context = {
         .num_threads = get_memset_num_threads(hpagesize, numpages, max_threads),
     };
-    size_t numpages_per_thread, leftover;
+    /*
+     * Hand out whole transparent huge pages (or whatever the host maps
+     * huge) to each thread, so that threads do not fault in the same huge
+     * page from both ends and page walks stay shallow.
+     */
+    size_t pages_per_chunk = MAX(1, QEMU_VMALLOC_ALIGN / hpagesize);
+    size_t numchunks = DIV_ROUND_UP(numpages, pages_per_chunk);
+    size_t chunks_per_thread, leftover, remaining = numpages;
     void *(*touch_fn)(void *);
     int ret = 0, i = 0;
     char *addr = area;
@@ -446,11 +453,15 @@ static int touch_all_pages(char *area, size_t hpagesize, size_t numpages,
     }
 
     context.threads = g_new0(MemsetThread, context.num_threads);
-    numpages_per_thread = numpages / context.num_threads;
-    leftover = numpages % context.num_threads;
+    chunks_per_thread = numchunks / context.num_threads;
+    leftover = numchunks % context.num_threads;
     for (i = 0; i < context.num_threads; i++) {
+        size_t chunks = chunks_per_thread + (i < leftover);
+
         context.threads[i].addr = addr;
-        context.threads[i].numpages = numpages_per_thread + (i < leftover);
+        context.threads[i].numpages = MIN(chunks * pages_per_chunk,
+                                          remaining);
+        remaining -= context.threads[i].numpages;
         context.threads[i].hpagesize = hpagesize;
         context.threads[i].context = &context;
         if (tc) {
@@ -29,10 +29,21 @@
 enum {
     POOL_MIN_BATCH_SIZE = 64,
     POOL_INITIAL_MAX_SIZE = 64,
+    POOL_NODES = 8,
 };
 
-/** Free list to speed up creation */
-static QSLIST_HEAD(, Coroutine) release_pool = QSLIST_HEAD_INITIALIZER(pool);
+/**
+ * Free lists to speed up creation.  There is one per host NUMA node (modulo
+ * POOL_NODES), and a coroutine always goes back to the list of the node it
+ * was created on, so that threads reuse stacks that are local to them.
+ * release_pool_size is the total over all nodes.
+ */
+typedef struct {
+    QSLIST_HEAD(, Coroutine) list;
+    unsigned int size;
+} QEMU_ALIGNED(64) CoroutineReleasePool;
+
+static CoroutineReleasePool release_pool[POOL_NODES];
 static unsigned int pool_max_size = POOL_INITIAL_MAX_SIZE;
 static unsigned int release_pool_size;
 
@@ -41,6 +52,46 @@ QEMU_DEFINE_STATIC_CO_TLS(CoroutineQSList, alloc_pool);
 QEMU_DEFINE_STATIC_CO_TLS(unsigned int, alloc_pool_size);
 QEMU_DEFINE_STATIC_CO_TLS(Notifier, coroutine_pool_cleanup_notifier);
 
+static unsigned int coroutine_pool_node(void)
+{
+#ifdef CONFIG_GETCPU
+    unsigned int cpu, node;
+
+    if (getcpu(&cpu, &node) == 0) {
+        return node % POOL_NODES;
+    }
+#endif
+    return 0;
+}
+
+/*
+ * Take a batch from the release pool of @node, or from any other node if that
+ * one does not have enough coroutines.  Returns the number of coroutines
+ * moved to @alloc_pool.
+ */
+static unsigned int coroutine_pool_refill(CoroutineQSList *alloc_pool,
+                                          unsigned int node)
+{
+    unsigned int i, n;
+
+    for (i = 0; i < POOL_NODES; i++) {
+        CoroutineReleasePool *pool = &release_pool[(node + i) % POOL_NODES];
+
+        if (qatomic_read(&pool->size) > POOL_MIN_BATCH_SIZE) {
+            /* This is not exact; there could be a little skew between
+             * pool->size and the actual size of pool->list.  But it is just
+             * a heuristic, it does not need to be perfect.
+             */
+            n = qatomic_xchg(&pool->size, 0);
+            qatomic_sub(&release_pool_size, n);
+            QSLIST_MOVE_ATOMIC(alloc_pool, &pool->list);
+            trace_qemu_coroutine_pool_refill((node + i) % POOL_NODES, n);
+            return n;
+        }
+    }
+    return 0;
+}
+
 static void coroutine_pool_cleanup(Notifier *n, void *value)
 {
     Coroutine *co;
@@ -62,7 +113,7 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
 
         co = QSLIST_FIRST(alloc_pool);
         if (!co) {
-            if (release_pool_size > POOL_MIN_BATCH_SIZE) {
+            if (qatomic_read(&release_pool_size) > POOL_MIN_BATCH_SIZE) {
                 /* Slow path; a good place to register the destructor, too.  */
                 Notifier *notifier = get_ptr_coroutine_pool_cleanup_notifier();
                 if (!notifier->notify) {
@@ -70,12 +121,8 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
                     qemu_thread_atexit_add(notifier);
                 }
 
-                /* This is not exact; there could be a little skew between
-                 * release_pool_size and the actual size of release_pool.  But
-                 * it is just a heuristic, it does not need to be perfect.
-                 */
-                set_alloc_pool_size(qatomic_xchg(&release_pool_size, 0));
-                QSLIST_MOVE_ATOMIC(alloc_pool, &release_pool);
+                set_alloc_pool_size(coroutine_pool_refill(alloc_pool,
+                                                coroutine_pool_node()));
                 co = QSLIST_FIRST(alloc_pool);
             }
         }
@@ -87,6 +134,8 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
 
     if (!co) {
         co = qemu_coroutine_new();
+        co->pool_node = coroutine_pool_node();
+        trace_qemu_coroutine_pool_miss(co->pool_node);
     }
 
     co->entry = entry;
@@ -100,9 +149,14 @@ static void coroutine_delete(Coroutine *co)
     co->caller = NULL;
 
     if (IS_ENABLED(CONFIG_COROUTINE_POOL)) {
-        if (release_pool_size < qatomic_read(&pool_max_size) * 2) {
-            QSLIST_INSERT_HEAD_ATOMIC(&release_pool, co, pool_next);
+        if (qatomic_read(&release_pool_size) <
+            qatomic_read(&pool_max_size) * 2) {
+            CoroutineReleasePool *pool = &release_pool[co->pool_node];
+
+            /* Keep release_pool_size >= the sum of the pool sizes */
             qatomic_inc(&release_pool_size);
+            QSLIST_INSERT_HEAD_ATOMIC(&pool->list, co, pool_next);
+            qatomic_inc(&pool->size);
             return;
         }
         if (get_alloc_pool_size() < qatomic_read(&pool_max_size)) {
@@ -29,6 +29,7 @@
 #include "sysemu/cpu-timers.h"
 #include "sysemu/replay.h"
 #include "sysemu/cpus.h"
+#include "trace.h"
 
 #ifdef CONFIG_POSIX
 #include <pthread.h>
@@ -66,7 +67,23 @@ static QEMUClock qemu_clocks[QEMU_CLOCK_MAX];
 struct QEMUTimerList {
     QEMUClock *clock;
     QemuMutex active_timers_lock;
-    QEMUTimer *active_timers;
+
+    /*
+     * Binary min-heap of the pending timers, ordered by expire_time and
+     * then by insertion order, so that active_timers[0] expires first.
+     * nr_active can be read without active_timers_lock to check
+     * for an empty list.
+     */
+    QEMUTimer **active_timers;
+    size_t nr_active;
+    size_t heap_size;
+    uint64_t next_seq;
+
+    /* Timer churn statistics, protected by active_timers_lock */
+    uint64_t nr_mods;
+    uint64_t nr_dels;
+    uint64_t nr_expired;
+
     QLIST_ENTRY(QEMUTimerList) list;
     QEMUTimerListNotifyCB *notify_cb;
     void *notify_opaque;
@@ -93,6 +110,100 @@ static bool timer_expired_ns(QEMUTimer *timer_head, int64_t current_time)
     return timer_head && (timer_head->expire_time <= current_time);
 }
 
+static bool timer_before(QEMUTimer *a, QEMUTimer *b)
+{
+    return a->expire_time < b->expire_time ||
+           (a->expire_time == b->expire_time && a->seq < b->seq);
+}
+
+/* Return the first timer to expire, or NULL.  Called with the lock held. */
+static QEMUTimer *timerlist_first(QEMUTimerList *timer_list)
+{
+    return timer_list->nr_active ? timer_list->active_timers[0] : NULL;
+}
+
+static void timer_heap_set(QEMUTimerList *timer_list, size_t i, QEMUTimer *ts)
+{
+    timer_list->active_timers[i] = ts;
+    ts->heap_index = i;
+}
+
+static void timer_heap_sift_up(QEMUTimerList *timer_list, size_t i)
+{
+    QEMUTimer *ts = timer_list->active_timers[i];
+
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        QEMUTimer *p = timer_list->active_timers[parent];
+
+        if (!timer_before(ts, p)) {
+            break;
+        }
+        timer_heap_set(timer_list, i, p);
+        i = parent;
+    }
+    timer_heap_set(timer_list, i, ts);
+}
+
+static void timer_heap_sift_down(QEMUTimerList *timer_list, size_t i)
+{
+    QEMUTimer **heap = timer_list->active_timers;
+    QEMUTimer *ts = heap[i];
+    size_t n = timer_list->nr_active;
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+
+        if (child >= n) {
+            break;
+        }
+        if (child + 1 < n && timer_before(heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!timer_before(heap[child], ts)) {
+            break;
+        }
+        timer_heap_set(timer_list, i, heap[child]);
+        i = child;
+    }
+    timer_heap_set(timer_list, i, ts);
+}
+
+static void timer_heap_insert(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    size_t n = timer_list->nr_active;
+
+    if (n == timer_list->heap_size) {
+        timer_list->heap_size = MAX(16, timer_list->heap_size * 2);
+        timer_list->active_timers = g_renew(QEMUTimer *,
+                                            timer_list->active_timers,
+                                            timer_list->heap_size);
+    }
+    ts->seq = timer_list->next_seq++;
+    timer_heap_set(timer_list, n, ts);
+    qatomic_set(&timer_list->nr_active, n + 1);
+    timer_heap_sift_up(timer_list, n);
+}
+
+static void timer_heap_remove(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    size_t i = ts->heap_index;
+    size_t n = timer_list->nr_active - 1;
+    QEMUTimer *last = timer_list->active_timers[n];
+
+    qatomic_set(&timer_list->nr_active, n);
+    if (i == n) {
+        return;
+    }
+
+    timer_heap_set(timer_list, i, last);
+    if (i > 0 && timer_before(last, timer_list->active_timers[(i - 1) / 2])) {
+        timer_heap_sift_up(timer_list, i);
+    } else {
+        timer_heap_sift_down(timer_list, i);
+    }
+}
+
 QEMUTimerList *timerlist_new(QEMUClockType type,
                              QEMUTimerListNotifyCB *cb,
                              void *opaque)
@@ -117,6 +228,7 @@ void timerlist_free(QEMUTimerList *timer_list)
         QLIST_REMOVE(timer_list, list);
     }
     qemu_mutex_destroy(&timer_list->active_timers_lock);
+    g_free(timer_list->active_timers);
     g_free(timer_list);
 }
 
@@ -171,7 +283,7 @@ void qemu_clock_enable(QEMUClockType type, bool enabled)
 
 bool timerlist_has_timers(QEMUTimerList *timer_list)
 {
-    return !!qatomic_read(&timer_list->active_timers);
+    return qatomic_read(&timer_list->nr_active) != 0;
 }
 
 bool qemu_clock_has_timers(QEMUClockType type)
@@ -184,15 +296,15 @@ bool timerlist_expired(QEMUTimerList *timer_list)
 {
     int64_t expire_time;
 
-    if (!qatomic_read(&timer_list->active_timers)) {
+    if (!timerlist_has_timers(timer_list)) {
         return false;
     }
 
     WITH_QEMU_LOCK_GUARD(&timer_list->active_timers_lock) {
-        if (!timer_list->active_timers) {
+        if (!timer_list->nr_active) {
             return false;
         }
-        expire_time = timer_list->active_timers->expire_time;
+        expire_time = timerlist_first(timer_list)->expire_time;
     }
 
     return expire_time <= qemu_clock_get_ns(timer_list->clock->type);
@@ -214,7 +326,7 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
     int64_t delta;
     int64_t expire_time;
 
-    if (!qatomic_read(&timer_list->active_timers)) {
+    if (!timerlist_has_timers(timer_list)) {
         return -1;
     }
 
@@ -227,10 +339,10 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
      * the caller should notice the change and there is no race condition.
      */
     WITH_QEMU_LOCK_GUARD(&timer_list->active_timers_lock) {
-        if (!timer_list->active_timers) {
+        if (!timer_list->nr_active) {
             return -1;
         }
-        expire_time = timer_list->active_timers->expire_time;
+        expire_time = timerlist_first(timer_list)->expire_time;
     }
 
     delta = expire_time - qemu_clock_get_ns(timer_list->clock->type);
@@ -242,6 +354,29 @@ int64_t timerlist_deadline_ns(QEMUTimerList *timer_list)
     return delta;
 }
 
+/*
+ * Return the first timer to expire among those whose attributes are all
+ * included in @attr_mask, or NULL.  The heap is only ordered by expire
+ * time, so this has to look at all timers; it is only used when the
+ * first timer does not match.
+ */
+static QEMUTimer *timerlist_first_matching(QEMUTimerList *timer_list,
+                                           int attr_mask)
+{
+    QEMUTimer *first = NULL;
+    size_t i;
+
+    for (i = 0; i < timer_list->nr_active; i++) {
+        QEMUTimer *ts = timer_list->active_timers[i];
+
+        if (!(ts->attributes & ~attr_mask) &&
+            (!first || timer_before(ts, first))) {
+            first = ts;
+        }
+    }
+    return first;
+}
+
 /* Calculate the soonest deadline across all timerlists attached
  * to the clock. This is used for the icount timeout so we
  * ignore whether or not the clock should be used in deadline
@@ -261,14 +396,14 @@ int64_t qemu_clock_deadline_ns_all(QEMUClockType type, int attr_mask)
     }
 
     QLIST_FOREACH(timer_list, &clock->timerlists, list) {
-        if (!qatomic_read(&timer_list->active_timers)) {
+        if (!timerlist_has_timers(timer_list)) {
             continue;
         }
         qemu_mutex_lock(&timer_list->active_timers_lock);
-        ts = timer_list->active_timers;
-        /* Skip all external timers */
-        while (ts && (ts->attributes & ~attr_mask)) {
-            ts = ts->next;
+        ts = timerlist_first(timer_list);
+        if (ts && (ts->attributes & ~attr_mask)) {
+            /* Skip all external timers */
+            ts = timerlist_first_matching(timer_list, attr_mask);
         }
         if (!ts) {
             qemu_mutex_unlock(&timer_list->active_timers_lock);
@@ -380,41 +515,24 @@ void timer_deinit(QEMUTimer *ts)
 
 static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
 {
-    QEMUTimer **pt, *t;
+    size_t i = ts->heap_index;
 
-    ts->expire_time = -1;
-    pt = &timer_list->active_timers;
-    for(;;) {
-        t = *pt;
-        if (!t)
-            break;
-        if (t == ts) {
-            qatomic_set(pt, t->next);
-            break;
-        }
-        pt = &t->next;
+    if (ts->expire_time != -1 && i < timer_list->nr_active &&
+        timer_list->active_timers[i] == ts) {
+        timer_heap_remove(timer_list, ts);
+        timer_list->nr_dels++;
     }
+    ts->expire_time = -1;
 }
 
 static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
                                 QEMUTimer *ts, int64_t expire_time)
 {
-    QEMUTimer **pt, *t;
-
-    /* add the timer in the sorted list */
-    pt = &timer_list->active_timers;
-    for (;;) {
-        t = *pt;
-        if (!timer_expired_ns(t, expire_time)) {
-            break;
-        }
-        pt = &t->next;
-    }
     ts->expire_time = MAX(expire_time, 0);
-    ts->next = *pt;
-    qatomic_set(pt, ts);
+    timer_heap_insert(timer_list, ts);
+    timer_list->nr_mods++;
 
-    return pt == &timer_list->active_timers;
+    return ts->heap_index == 0;
 }
 
 static void timerlist_rearm(QEMUTimerList *timer_list)
@@ -503,10 +621,11 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
     QEMUTimer *ts;
     int64_t current_time;
     bool progress = false;
+    unsigned expired = 0;
     QEMUTimerCB *cb;
     void *opaque;
 
-    if (!qatomic_read(&timer_list->active_timers)) {
+    if (!timerlist_has_timers(timer_list)) {
         return false;
     }
 
@@ -545,7 +664,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
      */
     current_time = qemu_clock_get_ns(timer_list->clock->type);
     qemu_mutex_lock(&timer_list->active_timers_lock);
-    while ((ts = timer_list->active_timers)) {
+    while ((ts = timerlist_first(timer_list))) {
         if (!timer_expired_ns(ts, current_time)) {
             /* No expired timers left.  The checkpoint can be skipped
              * if no timers fired or they were all external.
@@ -565,9 +684,10 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
         }
 
         /* remove timer from the list before calling the callback */
-        timer_list->active_timers = ts->next;
-        ts->next = NULL;
+        timer_heap_remove(timer_list, ts);
         ts->expire_time = -1;
+        timer_list->nr_expired++;
+        expired++;
         cb = ts->cb;
         opaque = ts->opaque;
 
@@ -578,6 +698,13 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
 
         progress = true;
     }
+    if (expired) {
+        trace_timerlist_run_timers(timer_list->clock->type, expired,
+                                   timer_list->nr_active,
+                                   timer_list->nr_mods,
+                                   timer_list->nr_dels,
+                                   timer_list->nr_expired);
+    }
     qemu_mutex_unlock(&timer_list->active_timers_lock);
 
 out:
@@ -176,6 +176,7 @@ struct qht_tsan_lock {
  * @n_added_buckets: number of added (i.e. "non-head") buckets
  * @n_added_buckets_threshold: threshold to trigger an upward resize once the
  *                             number of added buckets surpasses it.
+ * @lookup_retries: number of lookups retried due to concurrent writers.
  * @tsan_bucket_locks: Array of striped locks to be used only under TSAN.
  *
  * Buckets are tracked in what we call a "map", i.e. this structure.
@@ -186,6 +187,7 @@ struct qht_map {
     size_t n_buckets;
     size_t n_added_buckets;
     size_t n_added_buckets_threshold;
+    size_t lookup_retries;
 #ifdef CONFIG_TSAN
     struct qht_tsan_lock tsan_bucket_locks[QHT_TSAN_BUCKET_LOCKS];
 #endif
@@ -580,13 +582,15 @@ void *qht_do_lookup(const struct qht_bucket *head, qht_lookup_func_t func,
 }
 
 static __attribute__((noinline))
-void *qht_lookup__slowpath(const struct qht_bucket *b, qht_lookup_func_t func,
-                           const void *userp, uint32_t hash)
+void *qht_lookup__slowpath(struct qht_map *map, const struct qht_bucket *b,
+                           qht_lookup_func_t func, const void *userp,
+                           uint32_t hash)
 {
     unsigned int version;
     void *ret;
 
     do {
+        qatomic_inc(&map->lookup_retries);
         version = seqlock_read_begin(&b->sequence);
         ret = qht_do_lookup(b, func, userp, hash);
     } while (seqlock_read_retry(&b->sequence, version));
@@ -597,7 +601,7 @@ void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
                         qht_lookup_func_t func)
 {
     const struct qht_bucket *b;
-    const struct qht_map *map;
+    struct qht_map *map;
     unsigned int version;
     void *ret;
 
@@ -613,7 +617,7 @@ void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
      * Removing the do/while from the fastpath gives a 4% perf. increase when
      * running a 100%-lookup microbenchmark.
      */
-    return qht_lookup__slowpath(b, func, userp, hash);
+    return qht_lookup__slowpath(map, b, func, userp, hash);
 }
 
 void *qht_lookup(const struct qht *ht, const void *userp, uint32_t hash)
@@ -926,25 +930,41 @@ static void qht_do_resize_reset(struct qht *ht, struct qht_map *new, bool reset)
         .type = QHT_ITER_VOID,
     };
     struct qht_map_copy_data data;
+    size_t i;
 
     old = ht->map;
-    qht_map_lock_buckets(old);
-
-    if (reset) {
-        qht_map_reset__all_locked(old);
-    }
-
-    if (new == NULL) {
-        qht_map_unlock_buckets(old);
-        return;
+    if (reset || new == NULL) {
+        qht_map_lock_buckets(old);
+        if (reset) {
+            qht_map_reset__all_locked(old);
+        }
+        if (new == NULL) {
+            qht_map_unlock_buckets(old);
+            return;
+        }
+    } else {
+        /*
+         * Migrate the buckets one at a time, so that writers to the
+         * buckets that have not been copied yet can make progress in the
+         * meantime.  Copied buckets stay locked until the new map is
+         * published; writers that wait on them will then see a stale map
+         * and retry on the new one.  Lookups are unaffected, since the
+         * old map is left intact.
+         */
+        data.ht = ht;
+        data.new = new;
+        for (i = 0; i < old->n_buckets; i++) {
+            struct qht_bucket *b = &old->buckets[i];
+
+            qht_do_if_first_in_stripe(old, b, qemu_spin_lock);
+            qht_bucket_iter(b, &iter, &data);
+        }
     }
 
     g_assert(new->n_buckets != old->n_buckets);
-    data.ht = ht;
-    data.new = new;
-    qht_map_iter__all_locked(old, &iter, &data);
     qht_map_debug__all_locked(new);
 
+    new->lookup_retries = qatomic_read(&old->lookup_retries);
     qatomic_rcu_set(&ht->map, new);
     qht_map_unlock_buckets(old);
     call_rcu(old, qht_map_destroy, rcu);
@@ -978,6 +998,7 @@ void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
 
     stats->used_head_buckets = 0;
     stats->entries = 0;
+    stats->lookup_retries = 0;
     qdist_init(&stats->chain);
     qdist_init(&stats->occupancy);
     /* bail out if the qht has not yet been initialized */
@@ -986,6 +1007,7 @@ void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
         return;
     }
     stats->head_buckets = map->n_buckets;
+    stats->lookup_retries = qatomic_read(&map->lookup_retries);
 
     for (i = 0; i < map->n_buckets; i++) {
         const struct qht_bucket *head = &map->buckets[i];
@@ -32,6 +32,7 @@
 #include "qemu/thread.h"
 #include "qemu/main-loop.h"
 #include "qemu/lockable.h"
+#include "qemu/thread-stats.h"
 #if defined(CONFIG_MALLOC_TRIM)
 #include <malloc.h>
 #endif
@@ -45,6 +46,14 @@
 
 unsigned long rcu_gp_ctr = RCU_GP_LOCKED;
 
+/*
+ * Grace period sequence number.  It is odd while synchronize_rcu() is
+ * waiting for readers and even otherwise, and only written with
+ * rcu_sync_lock held.  Used by concurrent callers of synchronize_rcu()
+ * to piggyback on a grace period that started after they were called.
+ */
+static unsigned long rcu_gp_seq;
+
 QemuEvent rcu_gp_event;
 static int in_drain_call_rcu;
 static QemuMutex rcu_registry_lock;
@@ -143,7 +152,23 @@ static void wait_for_readers(void)
 
 void synchronize_rcu(void)
 {
+    unsigned long snap;
+
+    /*
+     * Any grace period that starts after this point also covers the
+     * caller's writes to RCU-protected pointers.  If one is in progress,
+     * its smp_mb_global() may already be behind us, so wait for the
+     * end of the next one.
+     */
+    smp_mb();
+    snap = (qatomic_read(&rcu_gp_seq) + 3) & ~1UL;
+
     QEMU_LOCK_GUARD(&rcu_sync_lock);
+    if ((long)(rcu_gp_seq - snap) >= 0) {
+        /* Another thread completed a full grace period for us.  */
+        return;
+    }
+    qatomic_set(&rcu_gp_seq, rcu_gp_seq + 1);
 
     /* Write RCU-protected pointers before reading p_rcu_reader->ctr.
      * Pairs with smp_mb_placeholder() in rcu_read_lock().
@@ -153,8 +178,10 @@ void synchronize_rcu(void)
      */
     smp_mb_global();
 
-    QEMU_LOCK_GUARD(&rcu_registry_lock);
-    if (!QLIST_EMPTY(&registry)) {
+    WITH_QEMU_LOCK_GUARD(&rcu_registry_lock) {
+        if (QLIST_EMPTY(&registry)) {
+            break;
+        }
         if (sizeof(rcu_gp_ctr) < 8) {
             /* For architectures with 32-bit longs, a two-subphases algorithm
              * ensures we do not encounter overflow bugs.
@@ -171,6 +198,9 @@ void synchronize_rcu(void)
 
         wait_for_readers();
     }
+
+    qatomic_store_release(&rcu_gp_seq, rcu_gp_seq + 1);
+    qemu_thread_stat_add(QEMU_STAT_RCU_GRACE_PERIODS, 1);
 }
 
 
@@ -264,9 +294,12 @@ static void *call_rcu_thread(void *opaque)
 
         /* Heuristically wait for a decent number of callbacks to pile up.
          * Fetch rcu_call_count now, we only must process elements that were
-         * added before synchronize_rcu() starts.
+         * added before synchronize_rcu() starts.  Do not delay callbacks
+         * if a thread is waiting synchronously in drain_call_rcu().
          */
-        while (n == 0 || (n < RCU_CALL_MIN_SIZE && ++tries <= 5)) {
+        while (n == 0 ||
+               (n < RCU_CALL_MIN_SIZE && ++tries <= 5 &&
+                !qatomic_read(&in_drain_call_rcu))) {
             g_usleep(10000);
             if (n == 0) {
                 qemu_event_reset(&rcu_call_ready_event);
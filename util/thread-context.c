@@ -14,8 +14,10 @@
 #include "qemu/thread-context.h"
 #include "qapi/error.h"
 #include "qapi/qapi-builtin-visit.h"
+#include "qapi/qapi-types-qom.h"
 #include "qapi/visitor.h"
 #include "qemu/config-file.h"
+#include "qemu/cutils.h"
 #include "qapi/qapi-builtin-visit.h"
 #include "qom/object_interfaces.h"
 #include "qemu/module.h"
@@ -235,6 +237,227 @@ out:
 #endif
 }
 
+#ifdef CONFIG_LINUX
+/*
+ * Add the host CPUs that share the last-level cache with host CPU @cpu to
+ * @bitmap, which is grown as needed.
+ */
+static bool thread_context_add_llc_cpus(unsigned int cpu,
+                                        unsigned long **bitmap, int *nbits,
+                                        Error **errp)
+{
+    g_autofree char *list = NULL;
+    unsigned long level, max_level = 0;
+    unsigned long first, last;
+    const char *p;
+    int i;
+
+    for (i = 0; ; i++) {
+        g_autofree char *dir = g_strdup_printf(
+            "/sys/devices/system/cpu/cpu%u/cache/index%d", cpu, i);
+        g_autofree char *path = g_strdup_printf("%s/level", dir);
+        g_autofree char *buf = NULL;
+
+        if (!g_file_get_contents(path, &buf, NULL, NULL)) {
+            break;
+        }
+        if (qemu_strtoul(g_strstrip(buf), NULL, 10, &level) < 0 ||
+            level < max_level) {
+            continue;
+        }
+
+        g_free(path);
+        path = g_strdup_printf("%s/shared_cpu_list", dir);
+        g_free(list);
+        list = NULL;
+        if (g_file_get_contents(path, &list, NULL, NULL)) {
+            max_level = level;
+        }
+    }
+
+    if (!list) {
+        error_setg(errp, "Cannot find the last-level cache of host CPU %u",
+                   cpu);
+        return false;
+    }
+
+    /* The list looks like "0-3,8-11" */
+    p = g_strstrip(list);
+    while (*p) {
+        if (qemu_strtoul(p, &p, 10, &first) < 0) {
+            goto fail;
+        }
+        last = first;
+        if (*p == '-' && qemu_strtoul(p + 1, &p, 10, &last) < 0) {
+            goto fail;
+        }
+        if (last < first || last > UINT16_MAX ||
+            (*p && *p++ != ',')) {
+            goto fail;
+        }
+        if (last >= *nbits) {
+            *bitmap = bitmap_zero_extend(*bitmap, *nbits, last + 1);
+            *nbits = last + 1;
+        }
+        bitmap_set(*bitmap, first, last - first + 1);
+    }
+    return true;
+
+fail:
+    error_setg(errp, "Cannot parse the CPUs sharing a cache with host CPU %u",
+               cpu);
+    return false;
+}
+#endif
+
+static void thread_context_set_cache_affinity(Object *obj, Visitor *v,
+                                              const char *name, void *opaque,
+                                              Error **errp)
+{
+#ifdef CONFIG_LINUX
+    ThreadContext *tc = THREAD_CONTEXT(obj);
+    uint16List *l, *host_cpus = NULL;
+    unsigned long *bitmap = NULL;
+    int nbits = 0, ret;
+
+    if (tc->init_cpu_bitmap) {
+        error_setg(errp, "Mixing CPU and node affinity not supported");
+        return;
+    }
+
+    if (!visit_type_uint16List(v, name, &host_cpus, errp)) {
+        return;
+    }
+
+    if (!host_cpus) {
+        error_setg(errp, "CPU list is empty");
+        goto out;
+    }
+
+    for (l = host_cpus; l; l = l->next) {
+        if (!thread_context_add_llc_cpus(l->value, &bitmap, &nbits, errp)) {
+            goto out;
+        }
+    }
+
+    if (tc->thread_id != -1) {
+        /*
+         * Note: we won't be adjusting the affinity of any thread that is still
+         * around, but only the affinity of the context thread.
+         */
+        ret = qemu_thread_set_affinity(&tc->thread, bitmap, nbits);
+        if (ret) {
+            error_setg(errp, "Setting CPU affinity failed: %s", strerror(ret));
+        }
+    } else {
+        tc->init_cpu_bitmap = bitmap;
+        bitmap = NULL;
+        tc->init_cpu_nbits = nbits;
+    }
+out:
+    g_free(bitmap);
+    qapi_free_uint16List(host_cpus);
+#else
+    error_setg(errp, "Cache affinity is not supported by this QEMU");
+#endif
+}
+
+/*
+ * Apply the scheduling policy to the context thread, from which newly
+ * created threads inherit it.  The priority only matters for the real-time
+ * policies, which do not accept 0.
+ */
+static void thread_context_apply_sched(ThreadContext *tc, Error **errp)
+{
+#ifdef CONFIG_POSIX
+    struct sched_param param = { };
+    int policy, ret;
+
+    switch (tc->sched_policy) {
+    case THREAD_CONTEXT_SCHED_POLICY_OTHER:
+        policy = SCHED_OTHER;
+        break;
+#ifdef SCHED_BATCH
+    case THREAD_CONTEXT_SCHED_POLICY_BATCH:
+        policy = SCHED_BATCH;
+        break;
+#endif
+#ifdef SCHED_IDLE
+    case THREAD_CONTEXT_SCHED_POLICY_IDLE:
+        policy = SCHED_IDLE;
+        break;
+#endif
+    case THREAD_CONTEXT_SCHED_POLICY_FIFO:
+        policy = SCHED_FIFO;
+        break;
+    case THREAD_CONTEXT_SCHED_POLICY_RR:
+        policy = SCHED_RR;
+        break;
+    default:
+        error_setg(errp, "Scheduling policy '%s' is not supported by this "
+                   "host", ThreadContextSchedPolicy_str(tc->sched_policy));
+        return;
+    }
+
+    if (policy == SCHED_FIFO || policy == SCHED_RR) {
+        param.sched_priority = MAX(tc->sched_priority,
+                                   sched_get_priority_min(policy));
+    }
+
+    ret = pthread_setschedparam(tc->thread.thread, policy, &param);
+    if (ret) {
+        error_setg(errp, "Setting scheduling policy failed: %s",
+                   strerror(ret));
+    }
+#else
+    error_setg(errp, "Scheduling policies are not supported by this QEMU");
+#endif
+}
+
+static int thread_context_get_sched_policy(Object *obj, Error **errp)
+{
+    return THREAD_CONTEXT(obj)->sched_policy;
+}
+
+static void thread_context_set_sched_policy(Object *obj, int value,
+                                            Error **errp)
+{
+    ThreadContext *tc = THREAD_CONTEXT(obj);
+
+    tc->sched_policy = value;
+    tc->sched_set = true;
+    if (tc->thread_id != -1) {
+        thread_context_apply_sched(tc, errp);
+    }
+}
+
+static void thread_context_get_sched_priority(Object *obj, Visitor *v,
+                                              const char *name, void *opaque,
+                                              Error **errp)
+{
+    ThreadContext *tc = THREAD_CONTEXT(obj);
+
+    visit_type_uint8(v, name, &tc->sched_priority, errp);
+}
+
+static void thread_context_set_sched_priority(Object *obj, Visitor *v,
+                                              const char *name, void *opaque,
+                                              Error **errp)
+{
+    ThreadContext *tc = THREAD_CONTEXT(obj);
+    uint8_t value;
+
+    if (!visit_type_uint8(v, name, &value, errp)) {
+        return;
+    }
+
+    tc->sched_priority = value;
+    tc->sched_set = true;
+    if (tc->thread_id != -1) {
+        thread_context_apply_sched(tc, errp);
+    }
+}
+
 static void thread_context_get_thread_id(Object *obj, Visitor *v,
                                          const char *name, void *opaque,
                                          Error **errp)
@@ -249,7 +472,7 @@ static void thread_context_instance_complete(UserCreatable *uc, Error **errp)
 {
     ThreadContext *tc = THREAD_CONTEXT(uc);
     char *thread_name;
-    int ret;
+    int ret = 0;
 
     thread_name = g_strdup_printf("TC %s",
                                object_get_canonical_path_component(OBJECT(uc)));
@@ -271,6 +494,10 @@ static void thread_context_instance_complete(UserCreatable *uc, Error **errp)
         g_free(tc->init_cpu_bitmap);
         tc->init_cpu_bitmap = NULL;
     }
+
+    if (tc->sched_set && !ret) {
+        thread_context_apply_sched(tc, errp);
+    }
 }
 
 static void thread_context_class_init(ObjectClass *oc, void *data)
@@ -286,6 +513,16 @@ static void thread_context_class_init(ObjectClass *oc, void *data)
                               thread_context_set_cpu_affinity, NULL, NULL);
     object_class_property_add(oc, "node-affinity", "int", NULL,
                               thread_context_set_node_affinity, NULL, NULL);
+    object_class_property_add(oc, "cache-affinity", "int", NULL,
+                              thread_context_set_cache_affinity, NULL, NULL);
+    object_class_property_add_enum(oc, "sched-policy",
+                                   "ThreadContextSchedPolicy",
+                                   &ThreadContextSchedPolicy_lookup,
+                                   thread_context_get_sched_policy,
+                                   thread_context_set_sched_policy);
+    object_class_property_add(oc, "sched-priority", "uint8",
+                              thread_context_get_sched_priority,
+                              thread_context_set_sched_priority, NULL, NULL);
 }
 
 static void thread_context_instance_init(Object *obj)
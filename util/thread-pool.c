@@ -19,6 +19,7 @@
 #include "qemu/queue.h"
 #include "qemu/thread.h"
 #include "qemu/coroutine.h"
+#include "qemu/thread-context.h"
 #include "trace.h"
 #include "block/thread-pool.h"
 #include "qemu/main-loop.h"
@@ -49,6 +50,15 @@ struct ThreadPoolElement {
     /* Access to this list is protected by lock.  */
     QTAILQ_ENTRY(ThreadPoolElement) reqs;
 
+    /*
+     * Pushed to done_list once, when state becomes THREAD_DONE, and then
+     * moved to the completed queue by the completion BH.
+     */
+    union {
+        QSLIST_ENTRY(ThreadPoolElement) next_done;
+        QSIMPLEQ_ENTRY(ThreadPoolElement) next_completed;
+    };
+
     /* This list is only written by the thread pool's mother thread.  */
     QLIST_ENTRY(ThreadPoolElement) all;
 };
@@ -63,9 +73,14 @@ struct ThreadPool {
 
     /* The following variables are only accessed from one AioContext. */
     QLIST_HEAD(, ThreadPoolElement) head;
+    QSIMPLEQ_HEAD(, ThreadPoolElement) completed;
+
+    /* Finished requests, pushed by the workers without taking lock.  */
+    QSLIST_HEAD(, ThreadPoolElement) done_list;
 
     /* The following variables are protected by lock.  */
     QTAILQ_HEAD(, ThreadPoolElement) request_list;
+    ThreadContext *thread_context;
     int cur_threads;
     int idle_threads;
     int new_threads;     /* backlog of threads we need to create */
@@ -115,6 +130,7 @@ static void *worker_thread(void *opaque)
         smp_wmb();
         req->state = THREAD_DONE;
 
+        QSLIST_INSERT_HEAD_ATOMIC(&pool->done_list, req, next_done);
         qemu_bh_schedule(pool->completion_bh);
         qemu_mutex_lock(&pool->lock);
     }
@@ -143,7 +159,14 @@ static void do_spawn_thread(ThreadPool *pool)
     pool->new_threads--;
     pool->pending_threads++;
 
-    qemu_thread_create(&t, "worker", worker_thread, pool, QEMU_THREAD_DETACHED);
+    if (pool->thread_context) {
+        thread_context_create_thread(pool->thread_context, &t, "worker",
+                                     worker_thread, pool,
+                                     QEMU_THREAD_DETACHED);
+    } else {
+        qemu_thread_create(&t, "worker", worker_thread, pool,
+                           QEMU_THREAD_DETACHED);
+    }
 }
 
 static void spawn_thread_bh_fn(void *opaque)
@@ -171,18 +194,39 @@ static void spawn_thread(ThreadPool *pool)
     }
 }
 
+/* Move requests from done_list to the completed queue, oldest first */
+static void thread_pool_collect_done(ThreadPool *pool)
+{
+    QSLIST_HEAD(, ThreadPoolElement) done;
+    QSIMPLEQ_HEAD(, ThreadPoolElement) batch =
+        QSIMPLEQ_HEAD_INITIALIZER(batch);
+    ThreadPoolElement *elem;
+
+    QSLIST_MOVE_ATOMIC(&done, &pool->done_list);
+
+    /* done is in LIFO order, reverse it */
+    while ((elem = QSLIST_FIRST(&done))) {
+        QSLIST_REMOVE_HEAD(&done, next_done);
+        QSIMPLEQ_INSERT_HEAD(&batch, elem, next_completed);
+    }
+    QSIMPLEQ_CONCAT(&pool->completed, &batch);
+}
+
 static void thread_pool_completion_bh(void *opaque)
 {
     ThreadPool *pool = opaque;
-    ThreadPoolElement *elem, *next;
+    ThreadPoolElement *elem;
 
     defer_call_begin(); /* cb() may use defer_call() to coalesce work */
 
-restart:
-    QLIST_FOREACH_SAFE(elem, &pool->head, all, next) {
-        if (elem->state != THREAD_DONE) {
-            continue;
-        }
+    thread_pool_collect_done(pool);
+
+    /*
+     * pool->completed is shared with nested invocations, so that a cb() that
+     * calls aio_poll() can complete requests of the same batch.
+     */
+    while ((elem = QSIMPLEQ_FIRST(&pool->completed))) {
+        QSIMPLEQ_REMOVE_HEAD(&pool->completed, next_completed);
 
         trace_thread_pool_complete(pool, elem, elem->common.opaque,
                                    elem->ret);
@@ -200,16 +244,13 @@ restart:
             elem->common.cb(elem->common.opaque, elem->ret);
 
             /* We can safely cancel the completion_bh here regardless of someone
-             * else having scheduled it meanwhile because we reenter the
-             * completion function anyway (goto restart).
+             * else having scheduled it meanwhile because we collect newly
+             * completed requests below anyway.
              */
             qemu_bh_cancel(pool->completion_bh);
-
-            qemu_aio_unref(elem);
-            goto restart;
-        } else {
-            qemu_aio_unref(elem);
+            thread_pool_collect_done(pool);
         }
+        qemu_aio_unref(elem);
     }
 
     defer_call_end();
@@ -225,10 +266,11 @@ static void thread_pool_cancel(BlockAIOCB *acb)
     QEMU_LOCK_GUARD(&pool->lock);
     if (elem->state == THREAD_QUEUED) {
         QTAILQ_REMOVE(&pool->request_list, elem, reqs);
-        qemu_bh_schedule(pool->completion_bh);
 
         elem->state = THREAD_DONE;
         elem->ret = -ECANCELED;
+        QSLIST_INSERT_HEAD_ATOMIC(&pool->done_list, elem, next_done);
+        qemu_bh_schedule(pool->completion_bh);
     }
 
 }
@@ -302,6 +344,16 @@ void thread_pool_update_params(ThreadPool *pool, AioContext *ctx)
     pool->min_threads = ctx->thread_pool_min;
     pool->max_threads = ctx->thread_pool_max;
 
+    if (pool->thread_context != ctx->thread_pool_context) {
+        if (pool->thread_context) {
+            object_unref(OBJECT(pool->thread_context));
+        }
+        pool->thread_context = ctx->thread_pool_context;
+        if (pool->thread_context) {
+            object_ref(OBJECT(pool->thread_context));
+        }
+    }
+
     /*
      * We either have to:
      *  - Increase the number available of threads until over the min_threads
@@ -337,6 +389,8 @@ static void thread_pool_init_one(ThreadPool *pool, AioContext *ctx)
     pool->new_thread_bh = aio_bh_new(ctx, spawn_thread_bh_fn, pool);
 
     QLIST_INIT(&pool->head);
+    QSIMPLEQ_INIT(&pool->completed);
+    QSLIST_INIT(&pool->done_list);
     QTAILQ_INIT(&pool->request_list);
 
     thread_pool_update_params(pool, ctx);
@@ -371,6 +425,9 @@ void thread_pool_free(ThreadPool *pool)
         qemu_cond_wait(&pool->worker_stopped, &pool->lock);
     }
 
+    if (pool->thread_context) {
+        object_unref(OBJECT(pool->thread_context));
+    }
     qemu_mutex_unlock(&pool->lock);
 
     qemu_bh_delete(pool->completion_bh);
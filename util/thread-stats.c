@@ -0,0 +1,89 @@
+/*
+ * Per-thread event counters
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/thread-stats.h"
+#include "qemu/stats64.h"
+#include "qemu/thread.h"
+#include "qemu/notify.h"
+#include "qemu/queue.h"
+
+typedef struct ThreadStats {
+    Stat64 val[QEMU_STAT__MAX];
+    Notifier exit;
+    QLIST_ENTRY(ThreadStats) next;
+} ThreadStats;
+
+static __thread ThreadStats *thread_stats;
+
+/*
+ * Protects thread_stats_list and retired_stats.  A spinlock does not
+ * need to be initialized, so counters can be bumped from constructors.
+ */
+static QemuSpin thread_stats_lock;
+static QLIST_HEAD(, ThreadStats) thread_stats_list =
+    QLIST_HEAD_INITIALIZER(thread_stats_list);
+
+/* Totals of the threads that have exited */
+static uint64_t retired_stats[QEMU_STAT__MAX];
+
+static void thread_stats_exit(Notifier *n, void *data)
+{
+    ThreadStats *ts = container_of(n, ThreadStats, exit);
+    int i;
+
+    qemu_spin_lock(&thread_stats_lock);
+    for (i = 0; i < QEMU_STAT__MAX; i++) {
+        retired_stats[i] += stat64_get(&ts->val[i]);
+    }
+    QLIST_REMOVE(ts, next);
+    qemu_spin_unlock(&thread_stats_lock);
+
+    thread_stats = NULL;
+    g_free(ts);
+}
+
+static ThreadStats *thread_stats_register(void)
+{
+    ThreadStats *ts = g_new0(ThreadStats, 1);
+
+    qemu_spin_lock(&thread_stats_lock);
+    QLIST_INSERT_HEAD(&thread_stats_list, ts, next);
+    qemu_spin_unlock(&thread_stats_lock);
+
+    /* Only threads created with qemu_thread_create() call this */
+    ts->exit.notify = thread_stats_exit;
+    qemu_thread_atexit_add(&ts->exit);
+
+    thread_stats = ts;
+    return ts;
+}
+
+void qemu_thread_stat_add(QemuThreadStat stat, uint64_t val)
+{
+    ThreadStats *ts = thread_stats;
+
+    if (unlikely(!ts)) {
+        ts = thread_stats_register();
+    }
+    stat64_add(&ts->val[stat], val);
+}
+
+void qemu_thread_stats_get(uint64_t *vals)
+{
+    ThreadStats *ts;
+    int i;
+
+    qemu_spin_lock(&thread_stats_lock);
+    memcpy(vals, retired_stats, sizeof(retired_stats));
+    QLIST_FOREACH(ts, &thread_stats_list, next) {
+        for (i = 0; i < QEMU_STAT__MAX; i++) {
+            vals[i] += stat64_get(&ts->val[i]);
+        }
+    }
+    qemu_spin_unlock(&thread_stats_lock);
+}
@@ -28,6 +28,15 @@
 #include "qemu/timer.h"
 #include "block/aio.h"
 
+static const BucketType bucket_types_size[THROTTLE_MAX][2] = {
+    { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
+    { THROTTLE_BPS_TOTAL, THROTTLE_BPS_WRITE }
+};
+static const BucketType bucket_types_units[THROTTLE_MAX][2] = {
+    { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
+    { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
+};
+
 /* This function make a bucket leak
  *
  * @bkt:   the bucket to make leak
@@ -462,6 +471,32 @@ bool throttle_schedule_timer(ThrottleState *ts,
     return true;
 }
 
+/* add @size bytes and @units operations to the buckets of @direction
+ *
+ * Negative values give back what was accounted before.
+ */
+static void throttle_do_account(ThrottleState *ts, ThrottleDirection direction,
+                                double units, double size)
+{
+    unsigned i;
+
+    for (i = 0; i < ARRAY_SIZE(bucket_types_size[THROTTLE_READ]); i++) {
+        LeakyBucket *bkt;
+
+        bkt = &ts->cfg.buckets[bucket_types_size[direction][i]];
+        bkt->level += size;
+        if (bkt->burst_length > 1) {
+            bkt->burst_level += size;
+        }
+
+        bkt = &ts->cfg.buckets[bucket_types_units[direction][i]];
+        bkt->level += units;
+        if (bkt->burst_length > 1) {
+            bkt->burst_level += units;
+        }
+    }
+}
+
 /* do the accounting for this operation
  *
  * @direction: throttle direction
@@ -470,16 +505,7 @@ bool throttle_schedule_timer(ThrottleState *ts,
 void throttle_account(ThrottleState *ts, ThrottleDirection direction,
                       uint64_t size)
 {
-    static const BucketType bucket_types_size[THROTTLE_MAX][2] = {
-        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
-        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_WRITE }
-    };
-    static const BucketType bucket_types_units[THROTTLE_MAX][2] = {
-        { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
-        { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
-    };
     double units = 1.0;
-    unsigned i;
 
     assert(direction < THROTTLE_MAX);
     /* if cfg.op_size is defined and smaller than size we compute unit count */
@@ -487,21 +513,107 @@ void throttle_account(ThrottleState *ts, ThrottleDirection direction,
         units = (double) size / ts->cfg.op_size;
     }
 
+    throttle_do_account(ts, direction, units, size);
+}
+
+/* compute how many units fit into a bucket before I/O has to wait
+ *
+ * @bkt: the leaky bucket we operate on
+ * @ret: the free room in the bucket, may be negative
+ */
+static double throttle_bucket_room(LeakyBucket *bkt)
+{
+    double room;
+
+    /* Same bucket sizes as in throttle_compute_wait() */
+    if (!bkt->max) {
+        room = (double) bkt->avg / 10 - bkt->level;
+    } else {
+        room = bkt->max * bkt->burst_length - bkt->level;
+    }
+
+    if (bkt->burst_length > 1) {
+        room = MIN(room, (double) bkt->max / 10 - bkt->burst_level);
+    }
+
+    return room;
+}
+
+/* reserve tokens for a batch of future operations
+ *
+ * Compute how many operations and bytes can be done in @direction without
+ * any of them having to wait, capped to what the average limits allow in
+ * @slice_ns, and account them right away.  Buckets without a limit do not
+ * restrict the reservation, which is capped to UINT32_MAX.  This is only
+ * exact if cfg.op_size is 0 because every operation is assumed to take one
+ * unit.
+ *
+ * @now:      the current clock timestamp
+ * @slice_ns: the longest time span to reserve tokens for
+ * @ops:      the number of reserved operations, 0 if none fit
+ * @bytes:    the number of reserved bytes, 0 if none fit
+ */
+void throttle_reserve(ThrottleState *ts, ThrottleDirection direction,
+                      int64_t now, int64_t slice_ns,
+                      uint32_t *ops, uint32_t *bytes)
+{
+    double ops_room = UINT32_MAX;
+    double bytes_room = UINT32_MAX;
+    unsigned i;
+
+    assert(direction < THROTTLE_MAX);
+
+    throttle_do_leak(ts, now);
+
     for (i = 0; i < ARRAY_SIZE(bucket_types_size[THROTTLE_READ]); i++) {
         LeakyBucket *bkt;
 
         bkt = &ts->cfg.buckets[bucket_types_size[direction][i]];
-        bkt->level += size;
-        if (bkt->burst_length > 1) {
-            bkt->burst_level += size;
+        if (bkt->avg) {
+            bytes_room = MIN(bytes_room, throttle_bucket_room(bkt));
+            bytes_room = MIN(bytes_room, bkt->avg * (double) slice_ns /
+                                         NANOSECONDS_PER_SECOND);
         }
 
         bkt = &ts->cfg.buckets[bucket_types_units[direction][i]];
-        bkt->level += units;
-        if (bkt->burst_length > 1) {
-            bkt->burst_level += units;
+        if (bkt->avg) {
+            ops_room = MIN(ops_room, throttle_bucket_room(bkt));
+            ops_room = MIN(ops_room, bkt->avg * (double) slice_ns /
+                                     NANOSECONDS_PER_SECOND);
         }
     }
+
+    if (ops_room < 1 || bytes_room < 1) {
+        *ops = 0;
+        *bytes = 0;
+        return;
+    }
+
+    *ops = ops_room;
+    *bytes = bytes_room;
+    throttle_do_account(ts, direction, *ops, *bytes);
+}
+
+/* give back tokens that throttle_reserve() reserved but that were not used
+ *
+ * @ops:   the number of unused operations
+ * @bytes: the number of unused bytes
+ */
+void throttle_unreserve(ThrottleState *ts, ThrottleDirection direction,
+                        uint32_t ops, uint32_t bytes)
+{
+    unsigned i;
+
+    assert(direction < THROTTLE_MAX);
+
+    throttle_do_account(ts, direction, -(double) ops, -(double) bytes);
+
+    /* The reserved tokens may have leaked already */
+    for (i = 0; i < BUCKETS_COUNT; i++) {
+        ts->cfg.buckets[i].level = MAX(ts->cfg.buckets[i].level, 0);
+        ts->cfg.buckets[i].burst_level =
+            MAX(ts->cfg.buckets[i].burst_level, 0);
+    }
 }
 
 /* return a ThrottleConfig based on the options in a ThrottleLimits